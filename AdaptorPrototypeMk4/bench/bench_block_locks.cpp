@@ -0,0 +1,144 @@
+/**
+ * @file bench_block_locks.cpp
+ * @brief Write throughput of concurrent writers to disjoint blocks of one region
+ *
+ * Each writer thread copies a record into a block of its own and publishes
+ * a version, 1, 2, 4 and 8 threads at a time, either:
+ *  - serialised by one mutex taken around every write, as writers of a
+ *    region had to be while the version was incremented non-atomically,
+ *  - or under the block locks of its block, with the version published
+ *    atomically.
+ *
+ * Threads stand in for processes; both cost the same per write.
+ *
+ * Usage: bench_block_locks [writes per thread] [record bytes]
+ */
+
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shared_memory.h"
+#include "change_tracking.h"
+#include "memory_layout.h"
+#include "block_locks.h"
+
+#define BENCH_REGION "BenchBlockLocks"
+#define BENCH_MAX_THREADS 8
+
+/**
+ * @brief Wall clock time in seconds
+ */
+static double benchNowSeconds() {
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+}
+
+// State of one writer thread
+struct WriterState {
+    char* region;
+    BlockLockTable* locks;
+    HANDLE mutex;               // NULL to use the block locks
+    size_t offset;
+    size_t recordSize;
+    long writes;
+};
+
+static unsigned int __stdcall writerThread(void* arg) {
+    WriterState* state = static_cast<WriterState*>(arg);
+    char record[BLOCK_LOCK_SIZE];
+    memset(record, 0x5A, sizeof(record));
+    for (long i = 0; i < state->writes; i++) {
+        record[0] = static_cast<char>(i);
+        if (state->mutex) {
+            WaitForSingleObject(state->mutex, INFINITE);
+            beginRegionWrite(state->region);
+            memcpy(state->region + state->offset, record, state->recordSize);
+            publishRegionVersion(state->region);
+            endRegionWrite(state->region);
+            ReleaseMutex(state->mutex);
+        } else {
+            uint64_t stripes = beginBlockWrite(state->locks, &state->region, state->offset, state->recordSize);
+            memcpy(state->region + state->offset, record, state->recordSize);
+            publishRegionVersion(state->region);
+            endBlockWrite(state->locks, state->region, stripes);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Run the writers and return the writes per second of all of them together
+ */
+static double runWriters(char* region, BlockLockTable* locks, HANDLE mutex, int threads, long writes,
+                         size_t recordSize) {
+    WriterState states[BENCH_MAX_THREADS];
+    HANDLE handles[BENCH_MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        states[t].region = region;
+        states[t].locks = locks;
+        states[t].mutex = mutex;
+        states[t].offset = (t + 1) * BLOCK_LOCK_SIZE;
+        states[t].recordSize = recordSize;
+        states[t].writes = writes;
+    }
+    double start = benchNowSeconds();
+    for (int t = 0; t < threads; t++) {
+        handles[t] = reinterpret_cast<HANDLE>(_beginthreadex(NULL, 0, writerThread, &states[t], 0, NULL));
+    }
+    for (int t = 0; t < threads; t++) {
+        WaitForSingleObject(handles[t], INFINITE);
+        CloseHandle(handles[t]);
+    }
+    return static_cast<double>(writes) * threads / (benchNowSeconds() - start);
+}
+
+int main(int argc, char* argv[]) {
+    long writes = 1000000;
+    size_t recordSize = 256;
+    if (argc > 1) {
+        writes = atol(argv[1]);
+    }
+    if (argc > 2) {
+        recordSize = static_cast<size_t>(atol(argv[2]));
+    }
+    if (recordSize == 0 || recordSize > BLOCK_LOCK_SIZE) {
+        fprintf(stderr, "Record size must be 1 to %d bytes\n", BLOCK_LOCK_SIZE);
+        return 1;
+    }
+
+    initChangeTracking();
+    if (!initializeSharedMemory(BENCH_REGION, (BENCH_MAX_THREADS + 1) * BLOCK_LOCK_SIZE)) {
+        fprintf(stderr, "Failed to create the benchmark region\n");
+        return 1;
+    }
+    char* region = static_cast<char*>(getSharedMemory(BENCH_REGION));
+    BlockLockTable* locks = attachBlockLocks(BENCH_REGION);
+    if (!locks) {
+        fprintf(stderr, "Failed to attach the block locks\n");
+        cleanupSharedMemory(BENCH_REGION);
+        return 1;
+    }
+    HANDLE mutex = CreateMutex(NULL, FALSE, NULL);
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+
+    printf("%lu CPUs, %lu-byte records\n", static_cast<unsigned long>(systemInfo.dwNumberOfProcessors),
+           static_cast<unsigned long>(recordSize));
+    printf("%-8s %22s %22s\n", "Writers", "One mutex (Mwrites/s)", "Block locks (Mwrites/s)");
+    for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+        double serialised = runWriters(region, locks, mutex, threads, writes / threads, recordSize);
+        double striped = runWriters(region, locks, NULL, threads, writes / threads, recordSize);
+        printf("%-8d %22.2f %22.2f\n", threads, serialised / 1e6, striped / 1e6);
+    }
+
+    CloseHandle(mutex);
+    detachBlockLocks(BENCH_REGION);
+    cleanupSharedMemory(BENCH_REGION);
+    cleanupChangeTracking();
+    return 0;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file bench_crdt_counter.cpp
+ * @brief Cost of adding to a CRDT counter against a tracked write
+ *
+ * Compares, per increment of a value in a shared region:
+ *  - crdtCounterAdd, the atomic add to this node's slot,
+ *  - the same with four threads adding to one counter,
+ *  - a plain write bracketed by beginRegionWrite/endRegionWrite and queued
+ *    with markRegionChanged, as single-writer regions are updated,
+ *  - publishCrdtFields after every add, the most a sync pass can cost.
+ *
+ * Usage: bench_crdt_counter [iterations]
+ */
+
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "shared_memory.h"
+#include "change_tracking.h"
+#include "memory_layout.h"
+#include "crdt_field.h"
+
+#define BENCH_REGION "BenchCrdtCounter"
+#define BENCH_THREADS 4
+
+/**
+ * @brief Wall clock time in seconds
+ */
+static double benchNowSeconds() {
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+}
+
+static void report(const char* name, double seconds, long operations) {
+    printf("%-40s %10.1f ns\n", name, seconds * 1e9 / static_cast<double>(operations));
+}
+
+// State shared by the adding threads
+struct AddState {
+    CrdtGCounter* counter;
+    long iterations;
+};
+
+static unsigned int __stdcall addThread(void* arg) {
+    AddState* state = static_cast<AddState*>(arg);
+    for (long i = 0; i < state->iterations; i++) {
+        crdtCounterAdd(state->counter, 1);
+    }
+    return 0;
+}
+
+static void clearPendingChanges() {
+    lockChangesMutex();
+    g_pendingChanges.erase(BENCH_REGION);
+    unlockChangesMutex();
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = 10000000;
+    if (argc > 1) {
+        iterations = atol(argv[1]);
+    }
+
+    initChangeTracking();
+    setLeaseNodeId(1);
+    if (!initializeSharedMemory(BENCH_REGION, 4096)) {
+        fprintf(stderr, "Failed to create the benchmark region\n");
+        return 1;
+    }
+    char* region = static_cast<char*>(getSharedMemory(BENCH_REGION));
+    size_t offset = sizeof(MemoryLayout);
+    registerCrdtField(BENCH_REGION, offset, CRDT_G_COUNTER);
+    CrdtGCounter* counter = reinterpret_cast<CrdtGCounter*>(region + offset);
+
+    printf("%-40s %13s\n", "Operation", "per add");
+
+    // One thread
+    double start = benchNowSeconds();
+    for (long i = 0; i < iterations; i++) {
+        crdtCounterAdd(counter, 1);
+    }
+    report("crdtCounterAdd, one thread", benchNowSeconds() - start, iterations);
+
+    // Several threads on one counter, so one slot
+    AddState state;
+    state.counter = counter;
+    state.iterations = iterations / BENCH_THREADS;
+    HANDLE threads[BENCH_THREADS];
+    start = benchNowSeconds();
+    for (int t = 0; t < BENCH_THREADS; t++) {
+        threads[t] = reinterpret_cast<HANDLE>(_beginthreadex(NULL, 0, addThread, &state, 0, NULL));
+    }
+    for (int t = 0; t < BENCH_THREADS; t++) {
+        WaitForSingleObject(threads[t], INFINITE);
+    }
+    report("crdtCounterAdd, 4 threads", benchNowSeconds() - start, state.iterations * BENCH_THREADS);
+    for (int t = 0; t < BENCH_THREADS; t++) {
+        CloseHandle(threads[t]);
+    }
+    publishCrdtFields(BENCH_REGION);
+    clearPendingChanges();
+
+    // A tracked write, drained every 1000 changes so the queue stays small
+    long tracked = iterations / 10;
+    uint64_t* plain = reinterpret_cast<uint64_t*>(region + offset + sizeof(CrdtGCounter));
+    start = benchNowSeconds();
+    for (long i = 0; i < tracked; i++) {
+        beginRegionWrite(region);
+        (*plain)++;
+        endRegionWrite(region);
+        markRegionChanged(BENCH_REGION, offset + sizeof(CrdtGCounter), sizeof(uint64_t));
+        if (i % 1000 == 999) {
+            clearPendingChanges();
+        }
+    }
+    report("Bracketed write + markRegionChanged", benchNowSeconds() - start, tracked);
+    clearPendingChanges();
+
+    // Publishing after every add
+    start = benchNowSeconds();
+    for (long i = 0; i < tracked; i++) {
+        crdtCounterAdd(counter, 1);
+        publishCrdtFields(BENCH_REGION);
+        if (i % 1000 == 999) {
+            clearPendingChanges();
+        }
+    }
+    report("crdtCounterAdd + publishCrdtFields", benchNowSeconds() - start, tracked);
+    clearPendingChanges();
+
+    printf("Counter value: %llu\n", static_cast<unsigned long long>(crdtCounterValue(counter)));
+
+    unregisterCrdtFields(BENCH_REGION);
+    cleanupSharedMemory(BENCH_REGION);
+    cleanupChangeTracking();
+    return 0;
+}
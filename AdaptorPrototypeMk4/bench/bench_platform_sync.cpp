@@ -0,0 +1,164 @@
+/**
+ * @file bench_platform_sync.cpp
+ * @brief Lock and wake-up costs of the platform layer
+ *
+ * Measures the primitives the sources use, through their Win32 names, so the
+ * same binary built on Windows and on Linux (src/posix) gives a side-by-side
+ * comparison:
+ *  - an uncontended mutex acquire and release (WaitForSingleObject + ReleaseMutex),
+ *  - the platform's own lightweight lock for reference (CRITICAL_SECTION on
+ *    Windows, pthread_mutex_t on Linux),
+ *  - a mutex shared by two threads incrementing a counter,
+ *  - wake-up latency: two threads passing control through a pair of events,
+ *  - starting a thread and waiting for it to finish.
+ *
+ * Usage: bench_platform_sync [iterations]
+ */
+
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+/**
+ * @brief Wall clock time in seconds
+ */
+static double benchNowSeconds() {
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+}
+
+static void report(const char* name, double seconds, long operations) {
+    printf("%-40s %10.1f ns\n", name, seconds * 1e9 / static_cast<double>(operations));
+}
+
+// State shared by the two-thread measurements
+struct SharedState {
+    HANDLE mutex;
+    HANDLE ping;
+    HANDLE pong;
+    long iterations;
+    volatile long counter;
+};
+
+static unsigned int __stdcall incrementThread(void* arg) {
+    SharedState* state = static_cast<SharedState*>(arg);
+    for (long i = 0; i < state->iterations; i++) {
+        WaitForSingleObject(state->mutex, INFINITE);
+        state->counter++;
+        ReleaseMutex(state->mutex);
+    }
+    return 0;
+}
+
+static unsigned int __stdcall pongThread(void* arg) {
+    SharedState* state = static_cast<SharedState*>(arg);
+    for (long i = 0; i < state->iterations; i++) {
+        WaitForSingleObject(state->ping, INFINITE);
+        SetEvent(state->pong);
+    }
+    return 0;
+}
+
+static unsigned int __stdcall emptyThread(void* arg) {
+    (void)arg;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = 10000000;
+    if (argc > 1) {
+        iterations = atol(argv[1]);
+    }
+
+#ifdef _WIN32
+    printf("Platform: Win32\n");
+#else
+    printf("Platform: Linux (src/posix: pthreads, futex waits)\n");
+#endif
+    printf("%-40s %13s\n", "Operation", "per op");
+
+    // Uncontended mutex
+    HANDLE mutex = CreateMutex(NULL, FALSE, NULL);
+    double start = benchNowSeconds();
+    for (long i = 0; i < iterations; i++) {
+        WaitForSingleObject(mutex, INFINITE);
+        ReleaseMutex(mutex);
+    }
+    report("Mutex acquire + release, uncontended", benchNowSeconds() - start, iterations);
+
+    // The platform's lightweight lock, for reference
+#ifdef _WIN32
+    CRITICAL_SECTION section;
+    InitializeCriticalSection(&section);
+    start = benchNowSeconds();
+    for (long i = 0; i < iterations; i++) {
+        EnterCriticalSection(&section);
+        LeaveCriticalSection(&section);
+    }
+    report("CRITICAL_SECTION enter + leave", benchNowSeconds() - start, iterations);
+    DeleteCriticalSection(&section);
+#else
+    pthread_mutex_t reference = PTHREAD_MUTEX_INITIALIZER;
+    start = benchNowSeconds();
+    for (long i = 0; i < iterations; i++) {
+        pthread_mutex_lock(&reference);
+        pthread_mutex_unlock(&reference);
+    }
+    report("pthread_mutex lock + unlock", benchNowSeconds() - start, iterations);
+#endif
+
+    // Contended mutex: two threads taking turns at random
+    SharedState state;
+    state.mutex = mutex;
+    state.iterations = iterations / 10;
+    state.counter = 0;
+    unsigned int threadId;
+    start = benchNowSeconds();
+    HANDLE first = (HANDLE)_beginthreadex(NULL, 0, incrementThread, &state, 0, &threadId);
+    HANDLE second = (HANDLE)_beginthreadex(NULL, 0, incrementThread, &state, 0, &threadId);
+    WaitForSingleObject(first, INFINITE);
+    WaitForSingleObject(second, INFINITE);
+    report("Mutex acquire + release, 2 threads", benchNowSeconds() - start, 2 * state.iterations);
+    CloseHandle(first);
+    CloseHandle(second);
+    if (state.counter != 2 * state.iterations) {
+        fprintf(stderr, "Counter is %ld, expected %ld\n", state.counter, 2 * state.iterations);
+        return 1;
+    }
+
+    // Wake-up latency: each round trip wakes the other thread twice
+    state.ping = CreateEvent(NULL, FALSE, FALSE, NULL);
+    state.pong = CreateEvent(NULL, FALSE, FALSE, NULL);
+    state.iterations = iterations / 100;
+    HANDLE partner = (HANDLE)_beginthreadex(NULL, 0, pongThread, &state, 0, &threadId);
+    start = benchNowSeconds();
+    for (long i = 0; i < state.iterations; i++) {
+        SetEvent(state.ping);
+        WaitForSingleObject(state.pong, INFINITE);
+    }
+    report("Event wake-up (half a round trip)", benchNowSeconds() - start, 2 * state.iterations);
+    WaitForSingleObject(partner, INFINITE);
+    CloseHandle(partner);
+    CloseHandle(state.ping);
+    CloseHandle(state.pong);
+
+    // Thread start and join
+    long threads = iterations / 1000;
+    start = benchNowSeconds();
+    for (long i = 0; i < threads; i++) {
+        HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, emptyThread, NULL, 0, &threadId);
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+    }
+    report("Thread start + wait for exit", benchNowSeconds() - start, threads);
+
+    CloseHandle(mutex);
+    return 0;
+}
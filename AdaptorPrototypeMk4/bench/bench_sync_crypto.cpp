@@ -0,0 +1,186 @@
+/**
+ * @file bench_sync_crypto.cpp
+ * @brief Cost of encrypting sync datagrams, per payload size
+ *
+ * For payloads from an empty message up to a full MAX_SYNC_DATA_SIZE chunk,
+ * times what the send path does to a message before sendto: the CRC stamp
+ * alone (the path without keys), the stamp plus sealing with AES-NI, the
+ * stamp plus sealing with the portable code, and opening on the receive
+ * side. Then sends datagrams to a socket on loopback through
+ * sendSyncMessage, without and with a key for the destination, to show the
+ * overhead against the cost of the send itself.
+ *
+ * Usage: bench_sync_crypto [loopback_datagrams]
+ */
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "network_sync.h"
+#include "sync_message.h"
+#include "region_checksum.h"
+#include "sync_crypto.h"
+
+#define BENCH_PEER_IP "127.0.0.1"
+
+/**
+ * @brief Wall clock time in seconds
+ */
+static double benchNowSeconds() {
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+}
+
+static void fillMessage(SyncMessage* message, size_t size) {
+    memset(message, 0, sizeof(SyncMessage));
+    message->msgType = MSG_SINGLE_UPDATE;
+    strcpy(message->memoryName, "BenchCryptoRegion");
+    message->version = 1;
+    message->size = size;
+    for (size_t i = 0; i < size; i++) {
+        message->data[i] = static_cast<char>(rand());
+    }
+}
+
+/**
+ * @brief Best time per message of stamping, and of sealing too if a port is given
+ */
+static double timeSeal(SyncMessage* message, int port, int calls) {
+    static char datagram[MAX_SECURE_DATAGRAM_SIZE];
+    double best = 1e30;
+    for (int iter = 0; iter < 5; iter++) {
+        double start = benchNowSeconds();
+        for (int i = 0; i < calls; i++) {
+            message->version++;
+            stampSyncMessage(*message);
+            if (port != 0) {
+                sealSyncMessage(*message, BENCH_PEER_IP, port, datagram);
+            }
+        }
+        double elapsed = (benchNowSeconds() - start) / calls;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Best time per datagram of opening a batch of sealed datagrams
+ *
+ * Each datagram opens once, so a fresh batch is sealed for every round.
+ */
+static double timeOpen(SyncMessage* message, int port, int calls) {
+    const int batch = 1000;
+    static char datagrams[1000][MAX_SECURE_DATAGRAM_SIZE];
+    size_t sizes[1000];
+    SyncMessage opened;
+    size_t messageBytes = 0;
+    double total = 0;
+    int done = 0;
+    while (done < calls) {
+        for (int i = 0; i < batch; i++) {
+            stampSyncMessage(*message);
+            sizes[i] = sealSyncMessage(*message, BENCH_PEER_IP, port, datagrams[i]);
+        }
+        double start = benchNowSeconds();
+        for (int i = 0; i < batch; i++) {
+            if (!openSyncMessage(datagrams[i], sizes[i], BENCH_PEER_IP, port, opened, &messageBytes)) {
+                printf("open failed\n");
+                exit(1);
+            }
+        }
+        total += benchNowSeconds() - start;
+        done += batch;
+    }
+    return total / done;
+}
+
+/**
+ * @brief Datagrams per second sent to a socket on loopback through sendSyncMessage
+ */
+static double sendRate(SOCKET sender, int port, SyncMessage* message, int datagrams) {
+    double start = benchNowSeconds();
+    for (int i = 0; i < datagrams; i++) {
+        message->version++;
+        sendSyncMessage(sender, BENCH_PEER_IP, port, *message);
+    }
+    return datagrams / (benchNowSeconds() - start);
+}
+
+int main(int argc, char* argv[]) {
+    int datagrams = 200000;
+    if (argc > 1) {
+        datagrams = atoi(argv[1]);
+    }
+
+    unsigned char key[16];
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = static_cast<unsigned char>(i * 17 + 3);
+    }
+    // Port 1 has a key for sealing; port 0 stands for no encryption
+    const int sealPort = 1;
+    addPeerKey(BENCH_PEER_IP, sealPort, key, sizeof(key));
+    setSecureSenderId(1);
+
+    printf("AES-GCM: AES-NI %s\n", aesGcmUsesHardware() ? "available" : "not available");
+    printf("%8s %12s %14s %16s %12s\n", "payload", "stamp ns", "+seal AES-NI", "+seal portable", "open ns");
+
+    const size_t payloads[] = { 0, 16, 64, 256, 1024 };
+    SyncMessage message;
+    srand(12345);
+    for (size_t p = 0; p < sizeof(payloads) / sizeof(payloads[0]); p++) {
+        fillMessage(&message, payloads[p]);
+        const int calls = 200000;
+        double stampOnly = timeSeal(&message, 0, calls);
+        double hardware = timeSeal(&message, sealPort, calls);
+        setAesGcmSoftwareOnly(true);
+        double software = timeSeal(&message, sealPort, calls / 10);
+        setAesGcmSoftwareOnly(false);
+        double open = timeOpen(&message, sealPort, calls);
+        printf("%8lu %12.1f %14.1f %16.1f %12.1f\n", static_cast<unsigned long>(payloads[p]),
+               stampOnly * 1e9, hardware * 1e9, software * 1e9, open * 1e9);
+    }
+
+    // Loopback sends: a receiver that is bound but never reads, so only the send side is timed
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+    SOCKET sender = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    SOCKET receiver = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = 0;
+    inet_pton(AF_INET, BENCH_PEER_IP, &address.sin_addr);
+    if (sender == INVALID_SOCKET || receiver == INVALID_SOCKET ||
+        bind(receiver, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR) {
+        printf("loopback sockets not available\n");
+        return 0;
+    }
+    socklen_t addressLength = sizeof(address);
+    getsockname(receiver, reinterpret_cast<sockaddr*>(&address), &addressLength);
+    int receiverPort = ntohs(address.sin_port);
+
+    printf("\nLoopback sendSyncMessage, %d datagrams\n", datagrams);
+    printf("%8s %16s %16s %10s\n", "payload", "plain msg/s", "sealed msg/s", "ratio");
+    for (size_t p = 0; p < sizeof(payloads) / sizeof(payloads[0]); p++) {
+        fillMessage(&message, payloads[p]);
+        clearPeerKeys();
+        double plain = sendRate(sender, receiverPort, &message, datagrams);
+        addPeerKey(BENCH_PEER_IP, receiverPort, key, sizeof(key));
+        double sealed = sendRate(sender, receiverPort, &message, datagrams);
+        printf("%8lu %16.0f %16.0f %10.2f\n", static_cast<unsigned long>(payloads[p]), plain, sealed, sealed / plain);
+    }
+
+    closesocket(sender);
+    closesocket(receiver);
+    WSACleanup();
+    clearPeerKeys();
+    return 0;
+}
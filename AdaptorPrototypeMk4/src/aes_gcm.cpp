@@ -0,0 +1,600 @@
+/**
+ * @file aes_gcm.cpp
+ * @brief Implementation of AES-GCM
+ *
+ * The counter blocks are numbered as in SP 800-38D: block 1 (J0) masks the
+ * tag and blocks 2 onwards encrypt the data. The hardware path encrypts J0
+ * in the same batch as the first data blocks, so a short datagram costs one
+ * pass of eight interleaved AES pipelines rather than two serial blocks.
+ *
+ * GHASH with PCLMULQDQ works on byte-reversed blocks, so that a 128-bit
+ * carry-less multiply and the shift-and-reduce of Intel's white paper
+ * ("Intel Carry-Less Multiplication Instruction and its Usage for Computing
+ * the GCM Mode") apply. Reduction is linear, so the four products of
+ * (Y ^ X1) * H^4 + X2 * H^3 + X3 * H^2 + X4 * H are summed before a single
+ * reduction.
+ *
+ * The portable path looks up the S-box and the GHASH tables by secret
+ * indices, so unlike AES-NI it is not hardened against cache-timing attacks.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "aes_gcm.h"
+#include <string.h>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#define GCM_HAVE_X64 1
+#define GCM_HARDWARE_TARGET
+#elif defined(__GNUC__) && defined(__x86_64__)
+#include <cpuid.h>
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#define GCM_HAVE_X64 1
+#define GCM_HARDWARE_TARGET __attribute__((target("aes,pclmul,ssse3")))
+#endif
+
+/// Counter blocks encrypted side by side on the hardware path
+#define GCM_PARALLEL_BLOCKS 8
+
+/**
+ * @brief AES S-box, built before main runs
+ */
+struct AesTables {
+    unsigned char sbox[256];
+
+    AesTables();
+};
+
+static unsigned char xtime(unsigned char x) {
+    return static_cast<unsigned char>((x << 1) ^ ((x & 0x80) ? 0x1B : 0));
+}
+
+static unsigned char multiplyGf256(unsigned char a, unsigned char b) {
+    unsigned char product = 0;
+    while (b) {
+        if (b & 1) {
+            product ^= a;
+        }
+        a = xtime(a);
+        b >>= 1;
+    }
+    return product;
+}
+
+AesTables::AesTables() {
+    for (int x = 0; x < 256; x++) {
+        // Multiplicative inverse as x^254, then the affine transform
+        unsigned char inverse = 1;
+        unsigned char power = static_cast<unsigned char>(x);
+        for (int e = 254; e > 0; e >>= 1) {
+            if (e & 1) {
+                inverse = multiplyGf256(inverse, power);
+            }
+            power = multiplyGf256(power, power);
+        }
+        if (x == 0) {
+            inverse = 0;
+        }
+        unsigned char s = inverse;
+        for (int r = 1; r < 5; r++) {
+            s ^= static_cast<unsigned char>((inverse << r) | (inverse >> (8 - r)));
+        }
+        sbox[x] = static_cast<unsigned char>(s ^ 0x63);
+    }
+}
+
+static const AesTables g_aesTables;
+
+/// Reduction of the four bits shifted out of a GHASH table multiply
+static const uint64_t g_ghashLast4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+/// Instruction support: -1 = not probed yet, 0 = portable, 1 = AES-NI and PCLMULQDQ
+static volatile LONG g_gcmHardware = -1;
+
+/// Set by setAesGcmSoftwareOnly
+static volatile LONG g_gcmSoftwareOnly = 0;
+
+/**
+ * @brief Check the processor for AES-NI, PCLMULQDQ and SSSE3
+ */
+static bool detectGcmInstructions() {
+#if defined(GCM_HAVE_X64)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    unsigned int ecx = static_cast<unsigned int>(info[2]);
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+#endif
+    const unsigned int required = (1u << 25) | (1u << 1) | (1u << 9);
+    return (ecx & required) == required;
+#else
+    return false;
+#endif
+}
+
+static bool gcmHardwareAvailable() {
+    if (g_gcmHardware < 0) {
+        InterlockedExchange(&g_gcmHardware, detectGcmInstructions() ? 1 : 0);
+    }
+    return g_gcmHardware == 1;
+}
+
+bool aesGcmUsesHardware() {
+    return gcmHardwareAvailable() && g_gcmSoftwareOnly == 0;
+}
+
+void setAesGcmSoftwareOnly(bool softwareOnly) {
+    InterlockedExchange(&g_gcmSoftwareOnly, softwareOnly ? 1 : 0);
+}
+
+static uint64_t loadBigEndian64(const unsigned char* bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+static void storeBigEndian64(unsigned char* bytes, uint64_t value) {
+    for (int i = 7; i >= 0; i--) {
+        bytes[i] = static_cast<unsigned char>(value);
+        value >>= 8;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Portable AES and GHASH
+// ---------------------------------------------------------------------------
+
+static void softwareEncryptBlock(const AesGcmKey* key, const unsigned char* in, unsigned char* out) {
+    const unsigned char* sbox = g_aesTables.sbox;
+    unsigned char state[16];
+    for (int i = 0; i < 16; i++) {
+        state[i] = in[i] ^ key->roundKeys[0][i];
+    }
+    for (int round = 1; round <= key->rounds; round++) {
+        // SubBytes and ShiftRows: row r moves left by r columns
+        unsigned char shifted[16];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                shifted[r + 4 * c] = sbox[state[r + 4 * ((c + r) & 3)]];
+            }
+        }
+        if (round == key->rounds) {
+            for (int i = 0; i < 16; i++) {
+                state[i] = shifted[i] ^ key->roundKeys[round][i];
+            }
+            break;
+        }
+        // MixColumns and AddRoundKey
+        for (int c = 0; c < 4; c++) {
+            unsigned char a0 = shifted[4 * c];
+            unsigned char a1 = shifted[4 * c + 1];
+            unsigned char a2 = shifted[4 * c + 2];
+            unsigned char a3 = shifted[4 * c + 3];
+            unsigned char all = a0 ^ a1 ^ a2 ^ a3;
+            state[4 * c] = a0 ^ all ^ xtime(a0 ^ a1) ^ key->roundKeys[round][4 * c];
+            state[4 * c + 1] = a1 ^ all ^ xtime(a1 ^ a2) ^ key->roundKeys[round][4 * c + 1];
+            state[4 * c + 2] = a2 ^ all ^ xtime(a2 ^ a3) ^ key->roundKeys[round][4 * c + 2];
+            state[4 * c + 3] = a3 ^ all ^ xtime(a3 ^ a0) ^ key->roundKeys[round][4 * c + 3];
+        }
+    }
+    memcpy(out, state, 16);
+}
+
+/**
+ * @brief Multiply a GHASH block by H with the 4-bit tables (big-endian bit order)
+ */
+static void softwareGhashMultiply(const AesGcmKey* key, unsigned char* x) {
+    int low = x[15] & 0xF;
+    uint64_t zHigh = key->hashHigh[low];
+    uint64_t zLow = key->hashLow[low];
+    for (int i = 15; i >= 0; i--) {
+        low = x[i] & 0xF;
+        int high = (x[i] >> 4) & 0xF;
+        if (i != 15) {
+            int rem = static_cast<int>(zLow & 0xF);
+            zLow = (zHigh << 60) | (zLow >> 4);
+            zHigh = (zHigh >> 4) ^ (g_ghashLast4[rem] << 48) ^ key->hashHigh[low];
+            zLow ^= key->hashLow[low];
+        }
+        int rem = static_cast<int>(zLow & 0xF);
+        zLow = (zHigh << 60) | (zLow >> 4);
+        zHigh = (zHigh >> 4) ^ (g_ghashLast4[rem] << 48) ^ key->hashHigh[high];
+        zLow ^= key->hashLow[high];
+    }
+    storeBigEndian64(x, zHigh);
+    storeBigEndian64(x + 8, zLow);
+}
+
+static void softwareGhash(const AesGcmKey* key, unsigned char* y, const unsigned char* data, size_t size) {
+    while (size > 0) {
+        size_t chunk = (size < 16) ? size : 16;
+        for (size_t i = 0; i < chunk; i++) {
+            y[i] ^= data[i];
+        }
+        softwareGhashMultiply(key, y);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+static void incrementCounter(unsigned char* counter) {
+    for (int i = 15; i >= 12; i--) {
+        if (++counter[i] != 0) {
+            break;
+        }
+    }
+}
+
+static void softwareCtr(const AesGcmKey* key, const unsigned char* j0, const unsigned char* in,
+                        unsigned char* out, size_t size, unsigned char* tagMask) {
+    unsigned char counter[16];
+    unsigned char stream[16];
+    memcpy(counter, j0, 16);
+    if (tagMask) {
+        softwareEncryptBlock(key, counter, tagMask);
+    }
+    while (size > 0) {
+        incrementCounter(counter);
+        softwareEncryptBlock(key, counter, stream);
+        size_t chunk = (size < 16) ? size : 16;
+        for (size_t i = 0; i < chunk; i++) {
+            out[i] = in[i] ^ stream[i];
+        }
+        in += chunk;
+        out += chunk;
+        size -= chunk;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// AES-NI and PCLMULQDQ
+// ---------------------------------------------------------------------------
+
+#if defined(GCM_HAVE_X64)
+GCM_HARDWARE_TARGET static __m128i byteSwapMask() {
+    return _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+/**
+ * @brief 256-bit carry-less product of two byte-reversed blocks
+ */
+GCM_HARDWARE_TARGET static void clmulProduct(__m128i a, __m128i b, __m128i* low, __m128i* high) {
+    __m128i t0 = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i t1 = _mm_clmulepi64_si128(a, b, 0x10);
+    __m128i t2 = _mm_clmulepi64_si128(a, b, 0x01);
+    __m128i t3 = _mm_clmulepi64_si128(a, b, 0x11);
+    t1 = _mm_xor_si128(t1, t2);
+    *low = _mm_xor_si128(t0, _mm_slli_si128(t1, 8));
+    *high = _mm_xor_si128(t3, _mm_srli_si128(t1, 8));
+}
+
+/**
+ * @brief Shift a carry-less product left by one bit and reduce it modulo the GCM polynomial
+ */
+GCM_HARDWARE_TARGET static __m128i clmulReduce(__m128i low, __m128i high) {
+    __m128i carryLow = _mm_srli_epi32(low, 31);
+    __m128i carryHigh = _mm_srli_epi32(high, 31);
+    low = _mm_slli_epi32(low, 1);
+    high = _mm_slli_epi32(high, 1);
+    __m128i carryAcross = _mm_srli_si128(carryLow, 12);
+    carryHigh = _mm_slli_si128(carryHigh, 4);
+    carryLow = _mm_slli_si128(carryLow, 4);
+    low = _mm_or_si128(low, carryLow);
+    high = _mm_or_si128(_mm_or_si128(high, carryHigh), carryAcross);
+
+    __m128i a = _mm_slli_epi32(low, 31);
+    __m128i b = _mm_slli_epi32(low, 30);
+    __m128i c = _mm_slli_epi32(low, 25);
+    a = _mm_xor_si128(_mm_xor_si128(a, b), c);
+    b = _mm_srli_si128(a, 4);
+    a = _mm_slli_si128(a, 12);
+    low = _mm_xor_si128(low, a);
+
+    __m128i d = _mm_srli_epi32(low, 1);
+    __m128i e = _mm_srli_epi32(low, 2);
+    __m128i f = _mm_srli_epi32(low, 7);
+    d = _mm_xor_si128(_mm_xor_si128(d, e), _mm_xor_si128(f, b));
+    low = _mm_xor_si128(low, d);
+    return _mm_xor_si128(high, low);
+}
+
+GCM_HARDWARE_TARGET static __m128i clmulMultiply(__m128i a, __m128i b) {
+    __m128i low, high;
+    clmulProduct(a, b, &low, &high);
+    return clmulReduce(low, high);
+}
+
+GCM_HARDWARE_TARGET static void hardwareHashPowers(AesGcmKey* key, const unsigned char* hashKey) {
+    __m128i h = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hashKey)), byteSwapMask());
+    __m128i power = h;
+    for (int i = 0; i < 4; i++) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(key->hashPowers[i]), power);
+        power = clmulMultiply(power, h);
+    }
+}
+
+GCM_HARDWARE_TARGET static void hardwareGhash(const AesGcmKey* key, unsigned char* yBytes,
+                                              const unsigned char* data, size_t size) {
+    const __m128i swap = byteSwapMask();
+    const __m128i* powers = reinterpret_cast<const __m128i*>(key->hashPowers);
+    __m128i h1 = _mm_loadu_si128(powers);
+    __m128i h2 = _mm_loadu_si128(powers + 1);
+    __m128i h3 = _mm_loadu_si128(powers + 2);
+    __m128i h4 = _mm_loadu_si128(powers + 3);
+    __m128i y = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(yBytes)), swap);
+
+    while (size >= 64) {
+        const __m128i* blocks = reinterpret_cast<const __m128i*>(data);
+        __m128i x0 = _mm_xor_si128(y, _mm_shuffle_epi8(_mm_loadu_si128(blocks), swap));
+        __m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128(blocks + 1), swap);
+        __m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128(blocks + 2), swap);
+        __m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128(blocks + 3), swap);
+        __m128i low, high, partLow, partHigh;
+        clmulProduct(x0, h4, &low, &high);
+        clmulProduct(x1, h3, &partLow, &partHigh);
+        low = _mm_xor_si128(low, partLow);
+        high = _mm_xor_si128(high, partHigh);
+        clmulProduct(x2, h2, &partLow, &partHigh);
+        low = _mm_xor_si128(low, partLow);
+        high = _mm_xor_si128(high, partHigh);
+        clmulProduct(x3, h1, &partLow, &partHigh);
+        low = _mm_xor_si128(low, partLow);
+        high = _mm_xor_si128(high, partHigh);
+        y = clmulReduce(low, high);
+        data += 64;
+        size -= 64;
+    }
+    while (size > 0) {
+        __m128i x;
+        if (size >= 16) {
+            x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            data += 16;
+            size -= 16;
+        } else {
+            unsigned char padded[16];
+            memset(padded, 0, sizeof(padded));
+            memcpy(padded, data, size);
+            x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded));
+            size = 0;
+        }
+        y = clmulMultiply(_mm_xor_si128(y, _mm_shuffle_epi8(x, swap)), h1);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(yBytes), _mm_shuffle_epi8(y, swap));
+}
+
+/**
+ * @brief Counter mode over up to GCM_PARALLEL_BLOCKS blocks per pass
+ *
+ * The counter is kept byte-reversed, so its 32-bit big-endian count is the
+ * low lane and one _mm_add_epi32 increments it.
+ */
+GCM_HARDWARE_TARGET static void hardwareCtr(const AesGcmKey* key, const unsigned char* j0, const unsigned char* in,
+                                            unsigned char* out, size_t size, unsigned char* tagMask) {
+    const __m128i swap = byteSwapMask();
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    __m128i roundKeys[15];
+    for (int r = 0; r <= key->rounds; r++) {
+        roundKeys[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key->roundKeys[r]));
+    }
+
+    __m128i counter = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(j0)), swap);
+    if (!tagMask) {
+        counter = _mm_add_epi32(counter, one);
+    }
+    size_t remaining = (size + 15) / 16 + (tagMask ? 1 : 0);
+    size_t position = 0;
+
+    while (remaining > 0) {
+        size_t count = (remaining < GCM_PARALLEL_BLOCKS) ? remaining : GCM_PARALLEL_BLOCKS;
+        __m128i blocks[GCM_PARALLEL_BLOCKS];
+        if (count == GCM_PARALLEL_BLOCKS) {
+            for (int i = 0; i < GCM_PARALLEL_BLOCKS; i++) {
+                blocks[i] = _mm_xor_si128(_mm_shuffle_epi8(counter, swap), roundKeys[0]);
+                counter = _mm_add_epi32(counter, one);
+            }
+            for (int r = 1; r < key->rounds; r++) {
+                for (int i = 0; i < GCM_PARALLEL_BLOCKS; i++) {
+                    blocks[i] = _mm_aesenc_si128(blocks[i], roundKeys[r]);
+                }
+            }
+            for (int i = 0; i < GCM_PARALLEL_BLOCKS; i++) {
+                blocks[i] = _mm_aesenclast_si128(blocks[i], roundKeys[key->rounds]);
+            }
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                blocks[i] = _mm_xor_si128(_mm_shuffle_epi8(counter, swap), roundKeys[0]);
+                counter = _mm_add_epi32(counter, one);
+            }
+            for (int r = 1; r < key->rounds; r++) {
+                for (size_t i = 0; i < count; i++) {
+                    blocks[i] = _mm_aesenc_si128(blocks[i], roundKeys[r]);
+                }
+            }
+            for (size_t i = 0; i < count; i++) {
+                blocks[i] = _mm_aesenclast_si128(blocks[i], roundKeys[key->rounds]);
+            }
+        }
+
+        size_t i = 0;
+        if (tagMask) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(tagMask), blocks[0]);
+            tagMask = NULL;
+            i = 1;
+        }
+        for (; i < count; i++) {
+            if (size - position >= 16) {
+                __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + position));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + position), _mm_xor_si128(data, blocks[i]));
+                position += 16;
+            } else {
+                unsigned char stream[16];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(stream), blocks[i]);
+                for (size_t j = 0; position + j < size; j++) {
+                    out[position + j] = in[position + j] ^ stream[j];
+                }
+                position = size;
+            }
+        }
+        remaining -= count;
+    }
+}
+#endif // GCM_HAVE_X64
+
+// ---------------------------------------------------------------------------
+// Public API
+// ---------------------------------------------------------------------------
+
+bool aesGcmInitKey(AesGcmKey* key, const void* keyBytes, size_t keySize) {
+    if (keySize != 16 && keySize != 32) {
+        return false;
+    }
+    memset(key, 0, sizeof(AesGcmKey));
+
+    // FIPS-197 key expansion, one 4-byte word at a time
+    size_t keyWords = keySize / 4;
+    key->rounds = static_cast<int>(keyWords) + 6;
+    size_t totalWords = 4 * (key->rounds + 1);
+    unsigned char* words = &key->roundKeys[0][0];
+    memcpy(words, keyBytes, keySize);
+    unsigned char roundConstant = 1;
+    for (size_t i = keyWords; i < totalWords; i++) {
+        unsigned char temp[4];
+        memcpy(temp, words + 4 * (i - 1), 4);
+        if (i % keyWords == 0) {
+            unsigned char first = temp[0];
+            temp[0] = static_cast<unsigned char>(g_aesTables.sbox[temp[1]] ^ roundConstant);
+            temp[1] = g_aesTables.sbox[temp[2]];
+            temp[2] = g_aesTables.sbox[temp[3]];
+            temp[3] = g_aesTables.sbox[first];
+            roundConstant = xtime(roundConstant);
+        } else if (keyWords > 6 && i % keyWords == 4) {
+            for (int j = 0; j < 4; j++) {
+                temp[j] = g_aesTables.sbox[temp[j]];
+            }
+        }
+        for (int j = 0; j < 4; j++) {
+            words[4 * i + j] = words[4 * (i - keyWords) + j] ^ temp[j];
+        }
+    }
+
+    // Hash key H = E(K, 0) and the GHASH tables for it
+    unsigned char hashKey[16];
+    memset(hashKey, 0, sizeof(hashKey));
+    softwareEncryptBlock(key, hashKey, hashKey);
+
+    uint64_t high = loadBigEndian64(hashKey);
+    uint64_t low = loadBigEndian64(hashKey + 8);
+    key->hashHigh[8] = high;
+    key->hashLow[8] = low;
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t reduce = (low & 1) ? 0xE100000000000000ull : 0;
+        low = (high << 63) | (low >> 1);
+        high = (high >> 1) ^ reduce;
+        key->hashHigh[i] = high;
+        key->hashLow[i] = low;
+    }
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; j++) {
+            key->hashHigh[i + j] = key->hashHigh[i] ^ key->hashHigh[j];
+            key->hashLow[i + j] = key->hashLow[i] ^ key->hashLow[j];
+        }
+    }
+
+#if defined(GCM_HAVE_X64)
+    if (gcmHardwareAvailable()) {
+        hardwareHashPowers(key, hashKey);
+    }
+#endif
+    return true;
+}
+
+/**
+ * @brief GHASH of the additional data, the ciphertext and their lengths
+ */
+static void ghash(const AesGcmKey* key, const void* aad, size_t aadSize, const void* ciphertext, size_t size,
+                  unsigned char* hash) {
+    unsigned char lengths[16];
+    storeBigEndian64(lengths, static_cast<uint64_t>(aadSize) * 8);
+    storeBigEndian64(lengths + 8, static_cast<uint64_t>(size) * 8);
+    memset(hash, 0, 16);
+#if defined(GCM_HAVE_X64)
+    if (aesGcmUsesHardware()) {
+        // Each part is padded to a whole block on its own
+        hardwareGhash(key, hash, static_cast<const unsigned char*>(aad), aadSize);
+        hardwareGhash(key, hash, static_cast<const unsigned char*>(ciphertext), size);
+        hardwareGhash(key, hash, lengths, 16);
+        return;
+    }
+#endif
+    softwareGhash(key, hash, static_cast<const unsigned char*>(aad), aadSize);
+    softwareGhash(key, hash, static_cast<const unsigned char*>(ciphertext), size);
+    softwareGhash(key, hash, lengths, 16);
+}
+
+static void counterMode(const AesGcmKey* key, const unsigned char* j0, const void* in, void* out, size_t size,
+                        unsigned char* tagMask) {
+#if defined(GCM_HAVE_X64)
+    if (aesGcmUsesHardware()) {
+        hardwareCtr(key, j0, static_cast<const unsigned char*>(in), static_cast<unsigned char*>(out), size, tagMask);
+        return;
+    }
+#endif
+    softwareCtr(key, j0, static_cast<const unsigned char*>(in), static_cast<unsigned char*>(out), size, tagMask);
+}
+
+void aesGcmSeal(const AesGcmKey* key, const unsigned char* nonce, const void* aad, size_t aadSize,
+                const void* plaintext, size_t size, void* ciphertext, unsigned char* tag) {
+    unsigned char j0[16];
+    memcpy(j0, nonce, AES_GCM_NONCE_SIZE);
+    j0[12] = 0;
+    j0[13] = 0;
+    j0[14] = 0;
+    j0[15] = 1;
+
+    unsigned char tagMask[16];
+    counterMode(key, j0, plaintext, ciphertext, size, tagMask);
+    ghash(key, aad, aadSize, ciphertext, size, tag);
+    for (int i = 0; i < AES_GCM_TAG_SIZE; i++) {
+        tag[i] ^= tagMask[i];
+    }
+}
+
+bool aesGcmOpen(const AesGcmKey* key, const unsigned char* nonce, const void* aad, size_t aadSize,
+                const void* ciphertext, size_t size, void* plaintext, const unsigned char* tag) {
+    unsigned char j0[16];
+    memcpy(j0, nonce, AES_GCM_NONCE_SIZE);
+    j0[12] = 0;
+    j0[13] = 0;
+    j0[14] = 0;
+    j0[15] = 1;
+
+    unsigned char expected[16];
+    unsigned char tagMask[16];
+    ghash(key, aad, aadSize, ciphertext, size, expected);
+    counterMode(key, j0, NULL, NULL, 0, tagMask);
+
+    // Compare without an early exit, so the time taken says nothing about the tag
+    unsigned char difference = 0;
+    for (int i = 0; i < AES_GCM_TAG_SIZE; i++) {
+        difference |= static_cast<unsigned char>(expected[i] ^ tagMask[i] ^ tag[i]);
+    }
+    if (difference != 0) {
+        return false;
+    }
+    counterMode(key, j0, ciphertext, plaintext, size, NULL);
+    return true;
+}
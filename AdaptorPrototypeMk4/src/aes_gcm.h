@@ -0,0 +1,97 @@
+#ifndef AES_GCM_H
+#define AES_GCM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief AES-GCM authenticated encryption (NIST SP 800-38D)
+ *
+ * AES-128 or AES-256 in counter mode with a GHASH tag over the additional
+ * data and the ciphertext. Nonces are 96 bits and tags are 128 bits. A nonce
+ * must never be used twice with the same key.
+ *
+ * On x86 processors with AES-NI and PCLMULQDQ, eight counter blocks are
+ * encrypted side by side so the AES round latency is hidden, and GHASH
+ * folds four blocks per reduction using precomputed powers of the hash key.
+ * Elsewhere a portable byte-oriented AES and a 4-bit table GHASH are used.
+ * The choice is made once at run time.
+ */
+
+#define AES_GCM_NONCE_SIZE 12
+#define AES_GCM_TAG_SIZE 16
+
+/**
+ * @brief An expanded AES-GCM key
+ *
+ * Built once per key with aesGcmInitKey; read-only afterwards, so one key
+ * can be used from several threads.
+ */
+struct AesGcmKey {
+    unsigned char roundKeys[15][16];    // AES round keys
+    int rounds;                         // 10 for AES-128, 14 for AES-256
+    uint64_t hashHigh[16];              // GHASH table: high halves of n * H for 4-bit n
+    uint64_t hashLow[16];               // GHASH table: low halves
+    unsigned char hashPowers[4][16];    // H, H^2, H^3, H^4 in PCLMULQDQ byte order
+};
+
+/**
+ * @brief Expand a key
+ *
+ * @param key Receives the expanded key
+ * @param keyBytes The raw key
+ * @param keySize 16 for AES-128 or 32 for AES-256
+ * @return true if the key size is supported
+ */
+bool aesGcmInitKey(AesGcmKey* key, const void* keyBytes, size_t keySize);
+
+/**
+ * @brief Encrypt and authenticate
+ *
+ * @param key The expanded key
+ * @param nonce AES_GCM_NONCE_SIZE bytes, unique for this key
+ * @param aad Additional data authenticated but not encrypted
+ * @param aadSize Size of the additional data
+ * @param plaintext Data to encrypt
+ * @param size Size of the data
+ * @param ciphertext Receives size bytes; may be the same buffer as plaintext
+ * @param tag Receives AES_GCM_TAG_SIZE bytes
+ */
+void aesGcmSeal(const AesGcmKey* key, const unsigned char* nonce, const void* aad, size_t aadSize,
+                const void* plaintext, size_t size, void* ciphertext, unsigned char* tag);
+
+/**
+ * @brief Check the tag and decrypt
+ *
+ * Nothing is decrypted unless the tag matches.
+ *
+ * @param key The expanded key
+ * @param nonce The nonce the data was sealed with
+ * @param aad The additional data it was sealed with
+ * @param aadSize Size of the additional data
+ * @param ciphertext Data to decrypt
+ * @param size Size of the data
+ * @param plaintext Receives size bytes; may be the same buffer as ciphertext
+ * @param tag The AES_GCM_TAG_SIZE-byte tag
+ * @return true if the tag matches and the data was decrypted
+ */
+bool aesGcmOpen(const AesGcmKey* key, const unsigned char* nonce, const void* aad, size_t aadSize,
+                const void* ciphertext, size_t size, void* plaintext, const unsigned char* tag);
+
+/**
+ * @brief Check whether AES-NI and PCLMULQDQ are used
+ *
+ * @return true if the instructions are available and not disabled
+ */
+bool aesGcmUsesHardware();
+
+/**
+ * @brief Force the portable code even where AES-NI is available
+ *
+ * Intended for benchmarks and tests that compare the two paths.
+ *
+ * @param softwareOnly true to use the portable code only
+ */
+void setAesGcmSoftwareOnly(bool softwareOnly);
+
+#endif // AES_GCM_H
@@ -0,0 +1,453 @@
+/**
+ * @file aggregates.cpp
+ * @brief Implementation of incrementally maintained aggregates
+ *
+ * Each aggregate registers an apply observer on its region. The observer
+ * walks only the elements touched by the update, subtracts their old values
+ * and adds their new ones, then republishes the slot in the side segment.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "aggregates.h"
+#include "shared_memory.h"
+#include "change_tracking.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+/**
+ * @brief Process-local state of one aggregate
+ */
+struct AggregateState {
+    std::string memoryName;         // Region the aggregate covers
+    int slot;                       // Slot in the side segment
+    ColumnType type;                // Element type
+    uint32_t width;                 // Element width in bytes
+    size_t offset;                  // Region offset of element 0
+    uint64_t count;                 // Elements [0, count) are aggregated
+    bool followsTable;              // true if count follows a record table's recordCount
+    size_t headerOffset;            // Region offset of the table header (followsTable only)
+    uint64_t capacity;              // Largest possible count
+
+    int64_t integerSum;             // Running exact sum for integer types
+    double sum;                     // Running sum of the finite elements
+    double compensation;            // Low-order bits lost from sum (Neumaier summation)
+    uint64_t nanCount;              // NaN elements, kept out of sum
+    uint64_t positiveInfinities;    // +Inf elements, kept out of sum
+    uint64_t negativeInfinities;    // -Inf elements, kept out of sum
+    std::map<double, uint64_t> values;  // Multiplicity of each value, for min/max
+    uint64_t updates;               // Applied updates seen so far
+};
+
+/// Aggregates by id (the id is the observer context)
+static std::map<int, AggregateState*> g_aggregates;
+
+/// Next aggregate id
+static int g_nextAggregateId = 0;
+
+/// Mutex protecting the aggregates
+static HANDLE g_aggregatesMutex = NULL;
+
+static void lockAggregatesMutex() {
+    if (g_aggregatesMutex == NULL) {
+        g_aggregatesMutex = CreateMutex(NULL, FALSE, NULL);
+        if (g_aggregatesMutex == NULL) {
+            std::cerr << "Failed to create aggregates mutex: " << GetLastError() << std::endl;
+        }
+    }
+    if (g_aggregatesMutex != NULL) {
+        WaitForSingleObject(g_aggregatesMutex, INFINITE);
+    }
+}
+
+static void unlockAggregatesMutex() {
+    if (g_aggregatesMutex != NULL) {
+        ReleaseMutex(g_aggregatesMutex);
+    }
+}
+
+/**
+ * @brief Get the side segment name for a region
+ */
+static std::string aggregateSegmentName(const char* memoryName) {
+    return std::string(memoryName) + AGGREGATE_SEGMENT_SUFFIX;
+}
+
+/**
+ * @brief Map (creating if needed) the side segment of a region
+ */
+static AggregateSegment* mapAggregateSegment(const char* memoryName, bool create) {
+    std::string name = aggregateSegmentName(memoryName);
+    if (create && !initializeSharedMemory(name.c_str(), sizeof(AggregateSegment))) {
+        return NULL;
+    }
+
+    void* mem = getSharedMemory(name.c_str());
+    if (!mem || getSharedMemorySize(name.c_str()) < sizeof(AggregateSegment)) {
+        return NULL;
+    }
+
+    AggregateSegment* segment = static_cast<AggregateSegment*>(mem);
+    if (create && segment->magic != AGGREGATE_SEGMENT_MAGIC) {
+        memset(segment, 0, sizeof(AggregateSegment));
+        segment->magic = AGGREGATE_SEGMENT_MAGIC;
+    }
+    return (segment->magic == AGGREGATE_SEGMENT_MAGIC) ? segment : NULL;
+}
+
+/**
+ * @brief Convert an element to double
+ */
+static double elementValue(ColumnType type, const void* cell) {
+    switch (type) {
+        case COLUMN_INT32:  { int32_t v;  memcpy(&v, cell, sizeof(v)); return static_cast<double>(v); }
+        case COLUMN_UINT32: { uint32_t v; memcpy(&v, cell, sizeof(v)); return static_cast<double>(v); }
+        case COLUMN_INT64:  { int64_t v;  memcpy(&v, cell, sizeof(v)); return static_cast<double>(v); }
+        case COLUMN_UINT64: { uint64_t v; memcpy(&v, cell, sizeof(v)); return static_cast<double>(v); }
+        case COLUMN_FLOAT:  { float v;    memcpy(&v, cell, sizeof(v)); return static_cast<double>(v); }
+        case COLUMN_DOUBLE: { double v;   memcpy(&v, cell, sizeof(v)); return v; }
+        default:
+            return 0.0;
+    }
+}
+
+/**
+ * @brief Convert an integer element to int64 (wrapping for large uint64 values)
+ */
+static int64_t elementInteger(ColumnType type, const void* cell) {
+    switch (type) {
+        case COLUMN_INT32:  { int32_t v;  memcpy(&v, cell, sizeof(v)); return v; }
+        case COLUMN_UINT32: { uint32_t v; memcpy(&v, cell, sizeof(v)); return v; }
+        case COLUMN_INT64:  { int64_t v;  memcpy(&v, cell, sizeof(v)); return v; }
+        case COLUMN_UINT64: { uint64_t v; memcpy(&v, cell, sizeof(v)); return static_cast<int64_t>(v); }
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Add a finite value to the running sum with compensation
+ *
+ * Elements are added and removed for the lifetime of the aggregate, so
+ * plain accumulation would drift away from the true sum. Neumaier's variant
+ * of Kahan summation keeps the error independent of the number of updates.
+ */
+static void accumulate(AggregateState* state, double value) {
+    double total = state->sum + value;
+    if (fabs(state->sum) >= fabs(value)) {
+        state->compensation += (state->sum - total) + value;
+    } else {
+        state->compensation += (value - total) + state->sum;
+    }
+    state->sum = total;
+}
+
+/**
+ * @brief Count a non-finite value, or return false if the value is finite
+ */
+static bool countNonFinite(AggregateState* state, double value, int delta) {
+    uint64_t* counter;
+    if (value != value) {
+        counter = &state->nanCount;
+    } else if (value > DBL_MAX) {
+        counter = &state->positiveInfinities;
+    } else if (value < -DBL_MAX) {
+        counter = &state->negativeInfinities;
+    } else {
+        return false;
+    }
+    *counter += delta;
+    return true;
+}
+
+static void addElement(AggregateState* state, const void* cell) {
+    double value = elementValue(state->type, cell);
+    state->integerSum += elementInteger(state->type, cell);
+    if (!countNonFinite(state, value, 1)) {
+        accumulate(state, value);
+    }
+    if (value == value) {   // NaN has no place in an ordering
+        state->values[value]++;
+    }
+}
+
+static void removeElement(AggregateState* state, const void* cell) {
+    double value = elementValue(state->type, cell);
+    state->integerSum -= elementInteger(state->type, cell);
+    if (!countNonFinite(state, value, -1)) {
+        accumulate(state, -value);
+    }
+    if (value == value) {
+        std::map<double, uint64_t>::iterator it = state->values.find(value);
+        if (it != state->values.end() && --it->second == 0) {
+            state->values.erase(it);
+        }
+    }
+}
+
+/**
+ * @brief Current sum of an aggregate, following IEEE rules for non-finite elements
+ */
+static double aggregateSum(const AggregateState* state) {
+    if (state->nanCount > 0 || (state->positiveInfinities > 0 && state->negativeInfinities > 0)) {
+        return NAN;
+    }
+    if (state->positiveInfinities > 0) {
+        return HUGE_VAL;
+    }
+    if (state->negativeInfinities > 0) {
+        return -HUGE_VAL;
+    }
+    return state->sum + state->compensation;
+}
+
+/**
+ * @brief Write an aggregate's current values to its slot
+ */
+static void publishAggregate(AggregateState* state) {
+    AggregateSegment* segment = mapAggregateSegment(state->memoryName.c_str(), false);
+    if (!segment) {
+        return;
+    }
+
+    AggregateSlot& slot = segment->slots[state->slot];
+    slot.sequence++;            // Odd: readers retry
+    MemoryBarrier();
+
+    slot.active = 1;
+    slot.count = state->count;
+    slot.integerSum = state->integerSum;
+    slot.sum = aggregateSum(state);
+    slot.min = state->values.empty() ? 0.0 : state->values.begin()->first;
+    slot.max = state->values.empty() ? 0.0 : state->values.rbegin()->first;
+    slot.updates = state->updates;
+
+    MemoryBarrier();
+    slot.sequence++;            // Even again: slot is consistent
+}
+
+/**
+ * @brief Apply observer that keeps an aggregate in step with applied updates
+ *
+ * @param context The aggregate id, cast to a pointer
+ */
+static void aggregateApplyObserver(const char* memoryName, size_t offset, size_t size,
+                                   const void* oldData, const void* newData, void* context) {
+    (void)memoryName;
+    int id = static_cast<int>(reinterpret_cast<intptr_t>(context));
+    const char* region = static_cast<const char*>(newData) - offset;
+    size_t end = offset + size;
+
+    lockAggregatesMutex();
+    std::map<int, AggregateState*>::iterator it = g_aggregates.find(id);
+    if (it == g_aggregates.end()) {
+        unlockAggregatesMutex();
+        return;
+    }
+    AggregateState* state = it->second;
+    bool changed = false;
+
+    // Elements touched by this update
+    size_t arrayStart = state->offset;
+    size_t arrayEnd = state->offset + static_cast<size_t>(state->count) * state->width;
+    size_t low = (offset > arrayStart) ? offset : arrayStart;
+    size_t high = (end < arrayEnd) ? end : arrayEnd;
+
+    if (low < high) {
+        uint64_t first = (low - arrayStart) / state->width;
+        uint64_t last = (high - arrayStart + state->width - 1) / state->width;
+
+        char oldCell[8];
+        for (uint64_t i = first; i < last; i++) {
+            size_t cellOffset = arrayStart + static_cast<size_t>(i) * state->width;
+            const char* cell = region + cellOffset;
+            restoreOldBytes(offset, size, oldData, cellOffset, state->width, cell, oldCell);
+            if (memcmp(oldCell, cell, state->width) != 0) {
+                removeElement(state, oldCell);
+                addElement(state, cell);
+                changed = true;
+            }
+        }
+    }
+
+    // Column aggregates follow the replicated recordCount
+    if (state->followsTable) {
+        size_t countOffset = state->headerOffset + offsetof(RecordTableHeader, recordCount);
+        if (offset < countOffset + sizeof(uint64_t) && countOffset < end) {
+            const RecordTableHeader* table =
+                reinterpret_cast<const RecordTableHeader*>(region + state->headerOffset);
+            uint64_t newCount = (table->recordCount < state->capacity) ? table->recordCount : state->capacity;
+
+            for (uint64_t i = state->count; i < newCount; i++) {
+                addElement(state, region + state->offset + static_cast<size_t>(i) * state->width);
+            }
+            for (uint64_t i = newCount; i < state->count; i++) {
+                removeElement(state, region + state->offset + static_cast<size_t>(i) * state->width);
+            }
+            changed = changed || (newCount != state->count);
+            state->count = newCount;
+        }
+    }
+
+    if (changed) {
+        state->updates++;
+        publishAggregate(state);
+    }
+
+    unlockAggregatesMutex();
+}
+
+/**
+ * @brief Common registration for range and column aggregates
+ */
+static int registerAggregate(const char* memoryName, size_t offset, ColumnType type, uint64_t count,
+                             bool followsTable, size_t headerOffset, uint64_t capacity) {
+    uint32_t width = columnTypeWidth(type, 0);
+    if (type == COLUMN_BYTES || width == 0) {
+        std::cerr << "[AGGREGATE] Unsupported element type for " << memoryName << std::endl;
+        return -1;
+    }
+
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(memoryName, &regionSize));
+    if (!region || offset > regionSize || capacity > (regionSize - offset) / width) {
+        std::cerr << "[AGGREGATE] Range is outside region " << memoryName << std::endl;
+        return -1;
+    }
+
+    lockAggregatesMutex();
+
+    AggregateSegment* segment = mapAggregateSegment(memoryName, true);
+    if (!segment || segment->slotCount >= MAX_REGION_AGGREGATES) {
+        std::cerr << "[AGGREGATE] No free aggregate slot for " << memoryName << std::endl;
+        unlockAggregatesMutex();
+        return -1;
+    }
+
+    AggregateState* state = new AggregateState();
+    state->memoryName = memoryName;
+    state->slot = static_cast<int>(segment->slotCount++);
+    state->type = type;
+    state->width = width;
+    state->offset = offset;
+    state->count = count;
+    state->followsTable = followsTable;
+    state->headerOffset = headerOffset;
+    state->capacity = capacity;
+    state->integerSum = 0;
+    state->sum = 0.0;
+    state->compensation = 0.0;
+    state->nanCount = 0;
+    state->positiveInfinities = 0;
+    state->negativeInfinities = 0;
+    state->updates = 0;
+
+    // Initial pass; from here on only changed elements are visited
+    for (uint64_t i = 0; i < count; i++) {
+        addElement(state, region + offset + static_cast<size_t>(i) * width);
+    }
+
+    int id = g_nextAggregateId++;
+    g_aggregates[id] = state;
+    publishAggregate(state);
+    int slot = state->slot;
+    unlockAggregatesMutex();
+
+    registerApplyObserver(memoryName, aggregateApplyObserver, reinterpret_cast<void*>(static_cast<intptr_t>(id)));
+    return slot;
+}
+
+int registerRangeAggregate(const char* memoryName, size_t offset, ColumnType type, uint64_t count) {
+    return registerAggregate(memoryName, offset, type, count, false, 0, count);
+}
+
+int registerColumnAggregate(const char* memoryName, const char* columnName) {
+    RecordTableHeader* table = openRecordTable(getSharedMemory(memoryName));
+    if (!table) {
+        std::cerr << "[AGGREGATE] No record table in " << memoryName << std::endl;
+        return -1;
+    }
+
+    int column = findRecordColumn(table, columnName);
+    if (column < 0) {
+        std::cerr << "[AGGREGATE] Unknown column " << columnName << " in " << memoryName << std::endl;
+        return -1;
+    }
+
+    uint64_t count = (table->recordCount < table->capacity) ? table->recordCount : table->capacity;
+    return registerAggregate(memoryName, static_cast<size_t>(table->columns[column].dataOffset),
+                             static_cast<ColumnType>(table->columns[column].type), count,
+                             true, recordTableHeaderOffset(table), table->capacity);
+}
+
+bool unregisterAggregate(const char* memoryName, int slot) {
+    int id = -1;
+    AggregateState* state = NULL;
+
+    lockAggregatesMutex();
+    std::map<int, AggregateState*>::iterator it;
+    for (it = g_aggregates.begin(); it != g_aggregates.end(); ++it) {
+        if (it->second->slot == slot && it->second->memoryName == memoryName) {
+            id = it->first;
+            state = it->second;
+            g_aggregates.erase(it);
+            break;
+        }
+    }
+
+    if (state) {
+        AggregateSegment* segment = mapAggregateSegment(memoryName, false);
+        if (segment) {
+            segment->slots[slot].active = 0;
+        }
+    }
+    unlockAggregatesMutex();
+
+    if (!state) {
+        return false;
+    }
+
+    unregisterApplyObserver(memoryName, aggregateApplyObserver, reinterpret_cast<void*>(static_cast<intptr_t>(id)));
+    delete state;
+    return true;
+}
+
+bool readAggregate(const char* memoryName, int slot, AggregateValue* value) {
+    if (!value || slot < 0 || slot >= MAX_REGION_AGGREGATES) {
+        return false;
+    }
+
+    AggregateSegment* segment = mapAggregateSegment(memoryName, false);
+    if (!segment) {
+        return false;
+    }
+
+    const AggregateSlot& source = segment->slots[slot];
+    for (int attempt = 0; ; attempt++) {
+        uint32_t before = source.sequence;
+        if ((before & 1) == 0) {
+            MemoryBarrier();
+            value->count = source.count;
+            value->integerSum = source.integerSum;
+            value->sum = source.sum;
+            value->min = source.min;
+            value->max = source.max;
+            value->updates = source.updates;
+            bool active = (source.active != 0);
+            MemoryBarrier();
+            if (source.sequence == before) {
+                return active;
+            }
+        }
+
+        // The writer only holds a slot for a few stores; back off if we keep losing
+        if (attempt > 100) {
+            Sleep(0);
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef AGGREGATES_H
+#define AGGREGATES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "record_table.h"
+
+/**
+ * @brief Incrementally maintained aggregates over replicated regions
+ *
+ * An aggregate view covers either a column of a record table (records
+ * [0, recordCount)) or a fixed typed array inside any region. The receiver
+ * keeps sum, count, min and max up to date from the old and new values seen
+ * by applyUpdate, so each update costs O(changed elements) regardless of the
+ * size of the region.
+ *
+ * Results are published in a small side segment named "<region>_agg" that
+ * any local process can map. Each slot is protected by a sequence counter,
+ * so reading an aggregate is O(1) and never blocks the apply path.
+ */
+
+#define AGGREGATE_SEGMENT_SUFFIX "_agg"
+#define AGGREGATE_SEGMENT_MAGIC 0x31474741u    // "AGG1"
+#define MAX_REGION_AGGREGATES 64
+
+/**
+ * @brief One published aggregate result
+ */
+typedef struct {
+    volatile uint32_t sequence;     // Odd while the slot is being updated
+    uint32_t active;                // Non-zero once the aggregate is registered
+    uint64_t count;                 // Number of elements covered
+    int64_t integerSum;             // Exact sum for integer element types
+    double sum;                     // Sum of the elements (NaN/Inf if any element is non-finite)
+    double min;                     // Smallest element (0 if count is 0)
+    double max;                     // Largest element (0 if count is 0)
+    uint64_t updates;               // Number of applied updates reflected in the slot
+} AggregateSlot;
+
+/**
+ * @brief Layout of the "<region>_agg" side segment
+ */
+typedef struct {
+    uint32_t magic;                             // AGGREGATE_SEGMENT_MAGIC once initialised
+    uint32_t slotCount;                         // Number of slots handed out
+    AggregateSlot slots[MAX_REGION_AGGREGATES];
+} AggregateSegment;
+
+/**
+ * @brief A consistent copy of an aggregate slot
+ */
+struct AggregateValue {
+    uint64_t count;
+    int64_t integerSum;
+    double sum;
+    double min;
+    double max;
+    uint64_t updates;
+};
+
+/**
+ * @brief Register an aggregate over a fixed typed array in a region
+ *
+ * @param memoryName Name of the shared memory region
+ * @param offset Region offset of the first element
+ * @param type Element type (COLUMN_BYTES is not supported)
+ * @param count Number of elements
+ * @return Slot number of the aggregate in the side segment, or -1 on failure
+ */
+int registerRangeAggregate(const char* memoryName, size_t offset, ColumnType type, uint64_t count);
+
+/**
+ * @brief Register an aggregate over a column of a record table region
+ *
+ * The aggregate follows the table's recordCount as replicated headers change it.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param columnName Name of the aggregated column
+ * @return Slot number of the aggregate in the side segment, or -1 on failure
+ */
+int registerColumnAggregate(const char* memoryName, const char* columnName);
+
+/**
+ * @brief Stop maintaining an aggregate
+ *
+ * The slot stays in the side segment with its last values but is marked inactive.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param slot Slot number returned at registration
+ * @return true if the aggregate existed, false otherwise
+ */
+bool unregisterAggregate(const char* memoryName, int slot);
+
+/**
+ * @brief Read an aggregate in O(1)
+ *
+ * Works from any process that can map the side segment.
+ *
+ * @param memoryName Name of the shared memory region the aggregate covers
+ * @param slot Slot number returned at registration
+ * @param value Receives a consistent copy of the slot
+ * @return true if the slot is active and was read, false otherwise
+ */
+bool readAggregate(const char* memoryName, int slot, AggregateValue* value);
+
+#endif // AGGREGATES_H
@@ -0,0 +1,186 @@
+/**
+ * @file block_codec.cpp
+ * @brief Implementation of LZ4-format block compression
+ *
+ * Each sequence is a token (literal count in the high nibble, match length
+ * minus 4 in the low nibble, 15 meaning "more length bytes follow"), the
+ * literals, a little-endian 16-bit match offset and the extra length bytes.
+ * The last sequence has literals only. As the format requires, the last 5
+ * bytes of a block are always literals and no match starts in its last 12.
+ */
+
+#include "block_codec.h"
+#include <stdint.h>
+#include <string.h>
+
+#define CODEC_MIN_MATCH 4
+#define CODEC_LAST_LITERALS 5         // Bytes at the end of a block that are always literals
+#define CODEC_MATCH_LIMIT 12          // No match may start this close to the end
+#define CODEC_MAX_OFFSET 65535
+#define CODEC_HASH_BITS 12
+
+static uint32_t read32(const char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hashSequence(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - CODEC_HASH_BITS);
+}
+
+/**
+ * @brief Write a length beyond the 15 its token nibble holds
+ */
+static bool writeLength(char* dst, size_t dstCapacity, size_t* op, size_t length) {
+    for (; length >= 255; length -= 255) {
+        if (*op >= dstCapacity) {
+            return false;
+        }
+        dst[(*op)++] = static_cast<char>(255);
+    }
+    if (*op >= dstCapacity) {
+        return false;
+    }
+    dst[(*op)++] = static_cast<char>(length);
+    return true;
+}
+
+/**
+ * @brief Write one sequence; matchLength 0 writes the closing literals-only sequence
+ */
+static bool writeSequence(char* dst, size_t dstCapacity, size_t* op,
+                          const char* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    if (*op >= dstCapacity) {
+        return false;
+    }
+    size_t matchCode = matchLength ? matchLength - CODEC_MIN_MATCH : 0;
+    dst[(*op)++] = static_cast<char>(((literalLength < 15 ? literalLength : 15) << 4) |
+                                     (matchCode < 15 ? matchCode : 15));
+    if (literalLength >= 15 && !writeLength(dst, dstCapacity, op, literalLength - 15)) {
+        return false;
+    }
+
+    if (dstCapacity - *op < literalLength) {
+        return false;
+    }
+    memcpy(dst + *op, literals, literalLength);
+    *op += literalLength;
+
+    if (matchLength == 0) {
+        return true;
+    }
+    if (dstCapacity - *op < 2) {
+        return false;
+    }
+    dst[(*op)++] = static_cast<char>(offset & 0xFF);
+    dst[(*op)++] = static_cast<char>(offset >> 8);
+    return matchCode < 15 || writeLength(dst, dstCapacity, op, matchCode - 15);
+}
+
+size_t compressBlockBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t compressBlock(const char* src, size_t srcSize, char* dst, size_t dstCapacity) {
+    size_t op = 0;
+    size_t anchor = 0;
+
+    if (srcSize > CODEC_MATCH_LIMIT) {
+        uint32_t table[1 << CODEC_HASH_BITS];
+        memset(table, 0, sizeof(table));
+
+        size_t matchStartLimit = srcSize - CODEC_MATCH_LIMIT;
+        size_t matchEndLimit = srcSize - CODEC_LAST_LITERALS;
+        size_t ip = 0;
+        while (ip < matchStartLimit) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t hash = hashSequence(sequence);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(ip);
+
+            if (candidate >= ip || ip - candidate > CODEC_MAX_OFFSET || read32(src + candidate) != sequence) {
+                ip++;
+                continue;
+            }
+
+            size_t length = CODEC_MIN_MATCH;
+            while (ip + length < matchEndLimit && src[candidate + length] == src[ip + length]) {
+                length++;
+            }
+            if (!writeSequence(dst, dstCapacity, &op, src + anchor, ip - anchor, ip - candidate, length)) {
+                return 0;
+            }
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    if (!writeSequence(dst, dstCapacity, &op, src + anchor, srcSize - anchor, 0, 0)) {
+        return 0;
+    }
+    return op;
+}
+
+/**
+ * @brief Read a length continued past its token nibble
+ */
+static bool readLength(const char* src, size_t srcSize, size_t* ip, size_t* length) {
+    unsigned char byte;
+    do {
+        if (*ip >= srcSize) {
+            return false;
+        }
+        byte = static_cast<unsigned char>(src[(*ip)++]);
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+size_t decompressBlock(const char* src, size_t srcSize, char* dst, size_t dstCapacity) {
+    const size_t failed = static_cast<size_t>(-1);
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < srcSize) {
+        unsigned char token = static_cast<unsigned char>(src[ip++]);
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(src, srcSize, &ip, &literalLength)) {
+            return failed;
+        }
+        if (srcSize - ip < literalLength || dstCapacity - op < literalLength) {
+            return failed;
+        }
+        memcpy(dst + op, src + ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        // The last sequence ends after its literals
+        if (ip == srcSize) {
+            return op;
+        }
+
+        if (srcSize - ip < 2) {
+            return failed;
+        }
+        size_t offset = static_cast<unsigned char>(src[ip]) | (static_cast<size_t>(static_cast<unsigned char>(src[ip + 1])) << 8);
+        ip += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(src, srcSize, &ip, &matchLength)) {
+            return failed;
+        }
+        matchLength += CODEC_MIN_MATCH;
+        if (offset == 0 || offset > op || dstCapacity - op < matchLength) {
+            return failed;
+        }
+
+        // Byte by byte: a match may overlap the bytes it is producing
+        const char* match = dst + op - offset;
+        for (size_t i = 0; i < matchLength; i++) {
+            dst[op + i] = match[i];
+        }
+        op += matchLength;
+    }
+    return failed;
+}
@@ -0,0 +1,49 @@
+#ifndef BLOCK_CODEC_H
+#define BLOCK_CODEC_H
+
+#include <stddef.h>
+
+/**
+ * @brief Block compression in the LZ4 block format
+ *
+ * Region contents are mostly zeros and repeated records, which a byte-level
+ * LZ77 coder shrinks well at memory speed. Blocks are written in the LZ4
+ * block format (token, literals, 16-bit offset, match length), so other
+ * tools can decode them with a stock LZ4 library.
+ *
+ * The compressor is a greedy single-probe hash coder. The decompressor checks
+ * every length and offset against both buffers, so a corrupt or hostile
+ * block fails cleanly instead of reading or writing out of bounds.
+ */
+
+/**
+ * @brief Worst-case compressed size of a block
+ *
+ * @param size Uncompressed size in bytes
+ * @return The largest size compressBlock can produce
+ */
+size_t compressBlockBound(size_t size);
+
+/**
+ * @brief Compress a block
+ *
+ * @param src Block contents
+ * @param srcSize Block size in bytes
+ * @param dst Buffer receiving the compressed block
+ * @param dstCapacity Size of dst in bytes
+ * @return Compressed size, or 0 if it wouldn't fit in dstCapacity
+ */
+size_t compressBlock(const char* src, size_t srcSize, char* dst, size_t dstCapacity);
+
+/**
+ * @brief Decompress a block
+ *
+ * @param src Compressed block
+ * @param srcSize Compressed size in bytes
+ * @param dst Buffer receiving the contents
+ * @param dstCapacity Size of dst in bytes
+ * @return Decompressed size, or (size_t)-1 if the block is malformed or too large
+ */
+size_t decompressBlock(const char* src, size_t srcSize, char* dst, size_t dstCapacity);
+
+#endif // BLOCK_CODEC_H
@@ -0,0 +1,191 @@
+/**
+ * @file block_hash.cpp
+ * @brief Implementation of per-block hashing for delta resync
+ *
+ * The first block is hashed from a copy with the local-only header fields
+ * cleared, so two copies that agree on the replicated contents hash alike.
+ */
+
+#include "block_hash.h"
+#include "memory_layout.h"
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+#define ADLER_MODULUS 65521u
+#define FNV64_OFFSET_BASIS 14695981039346656037ULL
+#define FNV64_PRIME 1099511628211ULL
+
+uint32_t weakBlockHash(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    uint32_t a = 1;
+    uint32_t b = 0;
+    size_t i = 0;
+    while (i < size) {
+        // 5552 bytes is the most that can be summed before the sums can overflow
+        size_t end = (size - i > 5552) ? i + 5552 : size;
+        for (; i < end; i++) {
+            a += bytes[i];
+            b += a;
+        }
+        a %= ADLER_MODULUS;
+        b %= ADLER_MODULUS;
+    }
+    return (b << 16) | a;
+}
+
+uint64_t strongBlockHash(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    uint64_t hash = FNV64_OFFSET_BASIS;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV64_PRIME;
+    }
+    return hash;
+}
+
+size_t regionBlockCount(size_t regionSize) {
+    return (regionSize + RESYNC_BLOCK_SIZE - 1) / RESYNC_BLOCK_SIZE;
+}
+
+void hashRegionBlock(const char* region, size_t regionSize, size_t block, BlockHash* hash) {
+    size_t offset = block * RESYNC_BLOCK_SIZE;
+    size_t size = (regionSize - offset > RESYNC_BLOCK_SIZE) ? RESYNC_BLOCK_SIZE : regionSize - offset;
+    const char* data = region + offset;
+
+    char masked[RESYNC_BLOCK_SIZE];
+    if (block == 0 && size >= sizeof(MemoryLayout)) {
+        memcpy(masked, data, size);
+        MemoryLayout* header = reinterpret_cast<MemoryLayout*>(masked);
+        header->sequence = 0;
+        header->dirty = false;
+        memset(masked + offsetof(MemoryLayout, magic), 0, sizeof(MemoryLayout) - offsetof(MemoryLayout, magic));
+        data = masked;
+    }
+
+    hash->weak = weakBlockHash(data, size);
+    hash->reserved = 0;
+    hash->strong = strongBlockHash(data, size);
+}
+
+void hashRegionBlocks(const char* region, size_t regionSize, std::vector<BlockHash>& hashes) {
+    hashes.resize(regionBlockCount(regionSize));
+    for (size_t block = 0; block < hashes.size(); block++) {
+        hashRegionBlock(region, regionSize, block, &hashes[block]);
+    }
+}
+
+void findDifferingBlocks(const char* region, size_t regionSize,
+                         const std::vector<BlockHash>& peerHashes, const std::vector<bool>& peerHave,
+                         size_t peerSize, std::vector<size_t>& differing) {
+    size_t blocks = regionBlockCount(regionSize);
+    for (size_t block = 0; block < blocks; block++) {
+        size_t end = (block + 1) * RESYNC_BLOCK_SIZE;
+        if (end > regionSize) {
+            end = regionSize;
+        }
+        if (block >= peerHashes.size() || block >= peerHave.size() || !peerHave[block] || end > peerSize) {
+            differing.push_back(block);
+            continue;
+        }
+
+        BlockHash local;
+        hashRegionBlock(region, regionSize, block, &local);
+        if (local.weak != peerHashes[block].weak || local.strong != peerHashes[block].strong) {
+            differing.push_back(block);
+        }
+    }
+}
+
+void startResyncTransfer(ResyncTransfer* transfer, const std::vector<size_t>& differing) {
+    transfer->pending.clear();
+    transfer->round.clear();
+    transfer->roundBlocks = RESYNC_FIRST_ROUND_BLOCKS;
+    transfer->roundCap = RESYNC_ROUND_BLOCKS;
+    transfer->failedRounds = 0;
+    transfer->blocksSent = 0;
+    bool header = false;
+    for (size_t i = 0; i < differing.size(); i++) {
+        if (differing[i] == 0) {
+            header = true;
+        } else {
+            transfer->pending.push_back(differing[i]);
+        }
+    }
+    if (header) {
+        transfer->pending.push_back(0);
+    }
+}
+
+bool nextResyncRound(ResyncTransfer* transfer) {
+    transfer->round.clear();
+    size_t count = transfer->pending.size();
+    if (count > transfer->roundBlocks) {
+        count = transfer->roundBlocks;
+    }
+
+    // The header block waits for a round of its own
+    if (count > 1 && count == transfer->pending.size() && transfer->pending.back() == 0) {
+        count--;
+    }
+    transfer->round.assign(transfer->pending.begin(), transfer->pending.begin() + count);
+    transfer->pending.erase(transfer->pending.begin(), transfer->pending.begin() + count);
+    transfer->blocksSent += count;
+    return count > 0;
+}
+
+void resyncRoundSpan(const ResyncTransfer* transfer, size_t* firstBlock, size_t* blockCount) {
+    *firstBlock = 0;
+    *blockCount = 0;
+    if (transfer->round.empty()) {
+        return;
+    }
+    size_t lowest = transfer->round[0];
+    size_t highest = transfer->round[0];
+    for (size_t i = 1; i < transfer->round.size(); i++) {
+        if (transfer->round[i] < lowest) {
+            lowest = transfer->round[i];
+        }
+        if (transfer->round[i] > highest) {
+            highest = transfer->round[i];
+        }
+    }
+    *firstBlock = lowest;
+    *blockCount = highest - lowest + 1;
+}
+
+bool finishResyncRound(ResyncTransfer* transfer, const std::vector<size_t>& stillDiffering) {
+    // Only blocks of the round count; the header block stays last
+    std::vector<size_t> resend;
+    bool header = false;
+    for (size_t i = 0; i < stillDiffering.size(); i++) {
+        if (std::find(transfer->round.begin(), transfer->round.end(), stillDiffering[i]) == transfer->round.end()) {
+            continue;
+        }
+        if (stillDiffering[i] == 0) {
+            header = true;
+        } else {
+            resend.push_back(stillDiffering[i]);
+        }
+    }
+    size_t lost = resend.size() + (header ? 1 : 0);
+    transfer->failedRounds = (lost < transfer->round.size()) ? 0 : transfer->failedRounds + 1;
+    if (lost > 0) {
+        transfer->roundBlocks = (transfer->roundBlocks > 1) ? transfer->roundBlocks / 2 : 1;
+        transfer->roundCap = transfer->roundBlocks;
+    } else if (transfer->round.size() == transfer->roundBlocks) {
+        size_t grown = (transfer->roundBlocks < transfer->roundCap) ? transfer->roundBlocks * 2
+                                                                      : transfer->roundBlocks + 1;
+        if (grown > transfer->roundCap && transfer->roundBlocks < transfer->roundCap) {
+            grown = transfer->roundCap;
+        }
+        transfer->roundBlocks = (grown < RESYNC_ROUND_BLOCKS) ? grown : RESYNC_ROUND_BLOCKS;
+    }
+
+    transfer->pending.insert(transfer->pending.begin(), resend.begin(), resend.end());
+    if (header && (transfer->pending.empty() || transfer->pending.back() != 0)) {
+        transfer->pending.push_back(0);
+    }
+    transfer->round.clear();
+    return transfer->failedRounds < RESYNC_MAX_FAILED_ROUNDS;
+}
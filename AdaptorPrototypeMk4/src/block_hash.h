@@ -0,0 +1,159 @@
+#ifndef BLOCK_HASH_H
+#define BLOCK_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "sync_message.h"
+
+/**
+ * @brief Per-block hashes for resyncing a copy by its differences
+ *
+ * A region is divided into RESYNC_BLOCK_SIZE blocks (the last one may be
+ * short). When a source can't answer a resync request from its journal it
+ * asks the receiver for the hashes of its copy (MSG_BLOCK_HASH_REQUEST); the
+ * receiver sends a weak and a strong hash per block (MSG_BLOCK_HASHES) and
+ * the source replies with only the blocks whose hashes differ from its own.
+ * A copy that missed a few updates therefore costs a few blocks plus 16
+ * bytes of hashes per block, rather than the whole region.
+ *
+ * The weak hash is an Adler-style checksum and the strong hash 64-bit FNV-1a.
+ * Blocks are compared at the same offset only: region contents live at fixed
+ * offsets, so rolling the weak hash to find shifted blocks is not done.
+ *
+ * The local-only header fields (write sequence, magic, layout hash,
+ * generation, segment size) and the dirty flag differ between copies of the
+ * same contents, so they hash as zeros.
+ */
+
+/**
+ * @brief Adler-style weak checksum of a block
+ *
+ * @param data Block contents
+ * @param size Block size in bytes
+ * @return The checksum
+ */
+uint32_t weakBlockHash(const char* data, size_t size);
+
+/**
+ * @brief 64-bit FNV-1a hash of a block
+ *
+ * @param data Block contents
+ * @param size Block size in bytes
+ * @return The hash
+ */
+uint64_t strongBlockHash(const char* data, size_t size);
+
+/**
+ * @brief Number of RESYNC_BLOCK_SIZE blocks covering a region
+ *
+ * @param regionSize Size of the region in bytes
+ * @return The block count, counting a short last block
+ */
+size_t regionBlockCount(size_t regionSize);
+
+/**
+ * @brief Hash one block of a region
+ *
+ * @param region Start of the region
+ * @param regionSize Size of the region in bytes
+ * @param block Index of the block (must be below regionBlockCount)
+ * @param hash Receives the block's hashes
+ */
+void hashRegionBlock(const char* region, size_t regionSize, size_t block, BlockHash* hash);
+
+/**
+ * @brief Hash every block of a region
+ *
+ * @param region Start of the region
+ * @param regionSize Size of the region in bytes
+ * @param hashes Receives one hash per block
+ */
+void hashRegionBlocks(const char* region, size_t regionSize, std::vector<BlockHash>& hashes);
+
+/**
+ * @brief Find the blocks of a region that a peer's copy doesn't match
+ *
+ * A block differs when the peer sent no hash for it, when its copy is
+ * shorter than the block, or when either hash differs.
+ *
+ * @param region Start of the local region
+ * @param regionSize Size of the local region in bytes
+ * @param peerHashes The peer's hashes, indexed by block
+ * @param peerHave Whether each entry of peerHashes was received
+ * @param peerSize Size of the peer's copy in bytes
+ * @param differing Receives the indexes of the differing blocks, ascending
+ */
+void findDifferingBlocks(const char* region, size_t regionSize,
+                         const std::vector<BlockHash>& peerHashes, const std::vector<bool>& peerHave,
+                         size_t peerSize, std::vector<size_t>& differing);
+
+/// Most blocks sent to a peer before waiting for its hashes of them
+#define RESYNC_ROUND_BLOCKS 64
+
+/// Blocks in the first round of a transfer
+#define RESYNC_FIRST_ROUND_BLOCKS 8
+
+/// Rounds in a row in which no block arrives before a block transfer is given up
+#define RESYNC_MAX_FAILED_ROUNDS 5
+
+/**
+ * @brief The differing blocks of a region still to reach one peer
+ *
+ * The blocks are sent in rounds. After each round the source asks the peer
+ * for the hashes of the blocks the round spans, and the blocks that still
+ * differ are sent again at the start of the next round, so a lost datagram
+ * costs its block rather than the whole transfer. Round sizes follow the
+ * peer: a round that loses blocks halves the next one and caps the growth at
+ * that size, and a round that loses nothing lets the next one double below
+ * the cap and grow by a block above it, up to RESYNC_ROUND_BLOCKS. The
+ * header block goes last, alone, so the peer adopts the version only once every
+ * other block has arrived.
+ */
+struct ResyncTransfer {
+    std::vector<size_t> pending;    // Blocks still to send, in sending order
+    std::vector<size_t> round;      // Blocks of the round waiting for the peer's hashes
+    size_t roundBlocks;             // Size of the next round
+    size_t roundCap;                // Size above which rounds grow a block at a time
+    int failedRounds;               // Rounds in a row in which none of the blocks arrived
+    size_t blocksSent;              // Blocks sent so far, counting resends
+};
+
+/**
+ * @brief Start a transfer of the blocks a peer's copy doesn't match
+ *
+ * @param transfer The transfer to (re)start
+ * @param differing The differing blocks, as found by findDifferingBlocks
+ */
+void startResyncTransfer(ResyncTransfer* transfer, const std::vector<size_t>& differing);
+
+/**
+ * @brief Pick the blocks of the next round
+ *
+ * @param transfer The transfer
+ * @return false if no block is left to send, with round empty
+ */
+bool nextResyncRound(ResyncTransfer* transfer);
+
+/**
+ * @brief Get the blocks a round spans, for asking the peer for their hashes
+ *
+ * @param transfer The transfer, with a round picked
+ * @param firstBlock Receives the lowest block of the round
+ * @param blockCount Receives the number of blocks from firstBlock to the highest
+ */
+void resyncRoundSpan(const ResyncTransfer* transfer, size_t* firstBlock, size_t* blockCount);
+
+/**
+ * @brief Finish a round, queueing its blocks that didn't arrive to be sent first
+ *
+ * A round whose hashes never come back is finished with every block of the
+ * round still differing.
+ *
+ * @param transfer The transfer
+ * @param stillDiffering Blocks of the round that still differ on the peer
+ * @return false once RESYNC_MAX_FAILED_ROUNDS rounds in a row delivered nothing
+ */
+bool finishResyncRound(ResyncTransfer* transfer, const std::vector<size_t>& stillDiffering);
+
+#endif // BLOCK_HASH_H
@@ -0,0 +1,339 @@
+/**
+ * @file block_locks.cpp
+ * @brief Implementation of striped block locks
+ *
+ * A writer takes a stripe by putting its process id in the stripe's owner
+ * with a compare-exchange, then moves the sequence from even to odd. It
+ * gives the stripe back by moving the sequence on again before clearing the
+ * owner, so the sequence also tells readers that the stripe's blocks
+ * changed. Readers add up the sequences of the stripes they cover: as every
+ * sequence only grows, the sum is unchanged only if none of them moved.
+ *
+ * Because the owner is taken before the sequence moves, a process that
+ * takes over the stripe of an exited one finds it in one of two states: the
+ * sequence is even if the holder died before marking it held, and odd if it
+ * died during its write. Either way the new owner leaves it odd and gives it
+ * back as its own.
+ *
+ * Dirty bits are set with an atomic or and taken with an atomic exchange,
+ * a word at a time, the summary bit after the word's bits. A word whose
+ * summary bit is taken before a writer sets it is taken on the next call.
+ */
+
+#include <windows.h>
+
+#include "block_locks.h"
+#include "shared_memory.h"
+#include "change_tracking.h"
+#include <iostream>
+#include <map>
+#include <stdio.h>
+#include <string>
+
+/**
+ * @brief A process's mapping of a region's block locks
+ */
+struct BlockLockMapping {
+    HANDLE section;
+    BlockLockTable* table;
+    int attached;
+};
+
+/// Mapped block locks by region
+static std::map<std::string, BlockLockMapping> g_blockLocks;
+
+/// Mutex protecting g_blockLocks
+static HANDLE g_blockLocksMutex = NULL;
+
+static void lockBlockLocksMutex() {
+    if (g_blockLocksMutex == NULL) {
+        g_blockLocksMutex = CreateMutex(NULL, FALSE, NULL);
+        if (g_blockLocksMutex == NULL) {
+            std::cerr << "Failed to create block locks mutex: " << GetLastError() << std::endl;
+        }
+    }
+    if (g_blockLocksMutex != NULL) {
+        WaitForSingleObject(g_blockLocksMutex, INFINITE);
+    }
+}
+
+static void unlockBlockLocksMutex() {
+    if (g_blockLocksMutex != NULL) {
+        ReleaseMutex(g_blockLocksMutex);
+    }
+}
+
+BlockLockTable* attachBlockLocks(const char* memoryName) {
+    if (!memoryName) {
+        return NULL;
+    }
+    lockBlockLocksMutex();
+    std::map<std::string, BlockLockMapping>::iterator it = g_blockLocks.find(memoryName);
+    if (it != g_blockLocks.end()) {
+        it->second.attached++;
+        BlockLockTable* table = it->second.table;
+        unlockBlockLocksMutex();
+        return table;
+    }
+
+    // A new section is zero-filled, which leaves every stripe free
+    std::string sectionName = std::string(memoryName) + ".locks";
+    HANDLE section = CreateSharedMemory(sectionName.c_str(), sizeof(BlockLockTable));
+    void* view = section ? MapSharedMemory(section, sizeof(BlockLockTable)) : NULL;
+    if (!view) {
+        if (section) {
+            CloseSharedMemory(section);
+        }
+        unlockBlockLocksMutex();
+        std::cerr << "[LOCKS] Failed to map the block locks of " << memoryName << std::endl;
+        return NULL;
+    }
+
+    // Every process names the same region, so concurrent stores agree
+    BlockLockMapping& mapping = g_blockLocks[memoryName];
+    mapping.section = section;
+    mapping.table = static_cast<BlockLockTable*>(view);
+    snprintf(mapping.table->memoryName, sizeof(mapping.table->memoryName), "%s", memoryName);
+    mapping.attached = 1;
+    unlockBlockLocksMutex();
+    return mapping.table;
+}
+
+void detachBlockLocks(const char* memoryName) {
+    if (!memoryName) {
+        return;
+    }
+    lockBlockLocksMutex();
+    std::map<std::string, BlockLockMapping>::iterator it = g_blockLocks.find(memoryName);
+    if (it != g_blockLocks.end() && --it->second.attached == 0) {
+        UnmapSharedMemory(it->second.table);
+        CloseSharedMemory(it->second.section);
+        g_blockLocks.erase(it);
+    }
+    unlockBlockLocksMutex();
+}
+
+uint64_t blockLockStripes(size_t offset, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    size_t first = offset / BLOCK_LOCK_SIZE;
+    size_t last = (offset + size - 1) / BLOCK_LOCK_SIZE;
+    if (last - first + 1 >= BLOCK_LOCK_STRIPES) {
+        return ~static_cast<uint64_t>(0);
+    }
+    uint64_t stripes = 0;
+    for (size_t block = first; block <= last; block++) {
+        stripes |= static_cast<uint64_t>(1) << (block % BLOCK_LOCK_STRIPES);
+    }
+    return stripes;
+}
+
+/**
+ * @brief Take a stripe over from a holder that has exited
+ *
+ * @param locks The region's block locks
+ * @param stripe The stripe, held by another process
+ * @param region Pointer to the start of the region, or NULL to look it up
+ * @return true if the stripe is now held by this process
+ */
+static bool takeAbandonedStripe(BlockLockTable* locks, BlockLockStripe* stripe, void* region) {
+    LONG self = static_cast<LONG>(GetCurrentProcessId());
+    LONG owner = stripe->owner;
+    if (owner == 0 || owner == self || isProcessRunning(static_cast<DWORD>(owner)) ||
+        InterlockedCompareExchange(&stripe->owner, self, owner) != owner) {
+        return false;
+    }
+
+    // The holder died before marking the stripe held
+    if ((stripe->sequence & 1) == 0) {
+        InterlockedIncrement(&stripe->sequence);
+    }
+
+    // Its write is still counted in the region's write sequence, which would keep region readers waiting
+    if (InterlockedExchange(&stripe->regionWrite, 0)) {
+        if (!region) {
+            region = getSharedMemory(locks->memoryName);
+        }
+        if (region) {
+            endRegionWrite(region);
+        } else {
+            std::cerr << "[LOCKS] Can't end the region write of exited process " << owner
+                      << ": " << locks->memoryName << " is not attached" << std::endl;
+        }
+    }
+    std::cerr << "[LOCKS] Took over a block lock stripe of exited process " << owner << std::endl;
+    return true;
+}
+
+/**
+ * @brief Wait for a stripe to be free and take it
+ */
+static void lockStripe(BlockLockTable* locks, BlockLockStripe* stripe, void* region) {
+    LONG self = static_cast<LONG>(GetCurrentProcessId());
+    for (int attempt = 1; ; attempt++) {
+        if (stripe->owner == 0 && InterlockedCompareExchange(&stripe->owner, self, 0) == 0) {
+            InterlockedIncrement(&stripe->sequence);
+            return;
+        }
+        if (attempt % BLOCK_LOCK_OWNER_CHECK == 0 && takeAbandonedStripe(locks, stripe, region)) {
+            return;
+        }
+
+        // Writers hold a stripe for one write; yield if it takes longer
+        if (attempt > 100) {
+            Sleep(0);
+        } else {
+            YieldProcessor();
+        }
+    }
+}
+
+/**
+ * @brief Give back a stripe taken with lockStripe
+ */
+static void unlockStripe(BlockLockStripe* stripe) {
+    InterlockedIncrement(&stripe->sequence);
+    InterlockedExchange(&stripe->owner, 0);
+}
+
+/**
+ * @brief Set the dirty bits of the parts a range covers, then their summary bits
+ */
+static void markDirtyParts(BlockLockTable* locks, size_t offset, size_t size) {
+    size_t first = offset / BLOCK_DIRTY_SIZE;
+    if (size == 0 || first >= BLOCK_DIRTY_BITS) {
+        return;
+    }
+    size_t last = (offset + size - 1) / BLOCK_DIRTY_SIZE;
+    if (last >= BLOCK_DIRTY_BITS) {
+        last = BLOCK_DIRTY_BITS - 1;
+    }
+    for (size_t word = first / 64; word <= last / 64; word++) {
+        size_t low = word == first / 64 ? first % 64 : 0;
+        size_t high = word == last / 64 ? last % 64 : 63;
+        uint64_t bits = (~static_cast<uint64_t>(0) >> (63 - high)) & (~static_cast<uint64_t>(0) << low);
+        InterlockedOr64(&locks->dirty[word], static_cast<LONG64>(bits));
+        InterlockedOr64(&locks->summary[word / 64], static_cast<LONG64>(static_cast<uint64_t>(1) << (word % 64)));
+    }
+}
+
+uint64_t beginBlockWrite(BlockLockTable* locks, char** region, size_t offset, size_t size) {
+    uint64_t stripes = blockLockStripes(offset, size);
+    int lowest = -1;
+    for (int stripe = 0; stripe < BLOCK_LOCK_STRIPES; stripe++) {
+        if (stripes & (static_cast<uint64_t>(1) << stripe)) {
+            lockStripe(locks, &locks->stripes[stripe], *region);
+            if (lowest < 0) {
+                lowest = stripe;
+            }
+        }
+    }
+
+    // Marked under the stripes, so a sync thread taking the bits waits for the write
+    markDirtyParts(locks, offset, size);
+    if (!beginRegionWrite(*region)) {
+        // The write must be counted somewhere, as endBlockWrite ends it
+        char* current = NULL;
+        while (current == NULL) {
+            current = static_cast<char*>(beginNamedRegionWrite(locks->memoryName, *region));
+        }
+        *region = current;
+    }
+    if (lowest >= 0) {
+        InterlockedExchange(&locks->stripes[lowest].regionWrite, 1);
+    }
+    return stripes;
+}
+
+void endBlockWrite(BlockLockTable* locks, void* region, uint64_t stripes) {
+    for (int stripe = 0; stripe < BLOCK_LOCK_STRIPES; stripe++) {
+        if (stripes & (static_cast<uint64_t>(1) << stripe)) {
+            InterlockedExchange(&locks->stripes[stripe].regionWrite, 0);
+            break;
+        }
+    }
+    endRegionWrite(region);
+    for (int stripe = 0; stripe < BLOCK_LOCK_STRIPES; stripe++) {
+        if (stripes & (static_cast<uint64_t>(1) << stripe)) {
+            unlockStripe(&locks->stripes[stripe]);
+        }
+    }
+}
+
+/**
+ * @brief Add up the sequences of some stripes; false if one is held
+ */
+static bool sumStripes(const BlockLockTable* locks, uint64_t stripes, uint32_t* sum) {
+    *sum = 0;
+    for (int stripe = 0; stripe < BLOCK_LOCK_STRIPES; stripe++) {
+        if (stripes & (static_cast<uint64_t>(1) << stripe)) {
+            LONG sequence = locks->stripes[stripe].sequence;
+            if (sequence & 1) {
+                return false;
+            }
+            *sum += static_cast<uint32_t>(sequence);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Release the held stripes among some whose holders have exited
+ */
+static void releaseAbandonedStripes(const BlockLockTable* locks, uint64_t stripes) {
+    BlockLockTable* shared = const_cast<BlockLockTable*>(locks);
+    for (int stripe = 0; stripe < BLOCK_LOCK_STRIPES; stripe++) {
+        if ((stripes & (static_cast<uint64_t>(1) << stripe)) && (locks->stripes[stripe].sequence & 1) &&
+            takeAbandonedStripe(shared, &shared->stripes[stripe], NULL)) {
+            unlockStripe(&shared->stripes[stripe]);
+        }
+    }
+}
+
+uint32_t beginBlockRead(const BlockLockTable* locks, size_t offset, size_t size) {
+    uint64_t stripes = blockLockStripes(offset, size);
+    for (int attempt = 1; ; attempt++) {
+        uint32_t sequence;
+        if (sumStripes(locks, stripes, &sequence)) {
+            MemoryBarrier();
+            return sequence;
+        }
+        if (attempt % BLOCK_LOCK_OWNER_CHECK == 0) {
+            releaseAbandonedStripes(locks, stripes);
+        }
+        if (attempt > 100) {
+            Sleep(0);
+        }
+    }
+}
+
+bool endBlockRead(const BlockLockTable* locks, size_t offset, size_t size, uint32_t sequence) {
+    MemoryBarrier();
+    uint32_t now;
+    return sumStripes(locks, blockLockStripes(offset, size), &now) && now == sequence;
+}
+
+void takeDirtyParts(BlockLockTable* locks, size_t regionSize, std::vector<size_t>& parts) {
+    size_t regionParts = (regionSize + BLOCK_DIRTY_SIZE - 1) / BLOCK_DIRTY_SIZE;
+    parts.clear();
+    for (size_t group = 0; group < BLOCK_DIRTY_WORDS / 64; group++) {
+        if (locks->summary[group] == 0) {
+            continue;
+        }
+        uint64_t words = static_cast<uint64_t>(InterlockedExchange64(&locks->summary[group], 0));
+        for (size_t w = 0; w < 64; w++) {
+            if (!(words & (static_cast<uint64_t>(1) << w))) {
+                continue;
+            }
+            size_t word = group * 64 + w;
+            uint64_t bits = static_cast<uint64_t>(InterlockedExchange64(&locks->dirty[word], 0));
+            for (size_t bit = 0; bit < 64; bit++) {
+                size_t part = word * 64 + bit;
+                if ((bits & (static_cast<uint64_t>(1) << bit)) && part < regionParts) {
+                    parts.push_back(part);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,172 @@
+#ifndef BLOCK_LOCKS_H
+#define BLOCK_LOCKS_H
+
+#include <windows.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "sync_message.h"
+
+/**
+ * @brief Striped block locks for regions written by several processes at once
+ *
+ * A region is divided into blocks of BLOCK_LOCK_SIZE bytes that share
+ * BLOCK_LOCK_STRIPES locks, block b using stripe b % BLOCK_LOCK_STRIPES.
+ * Each stripe has a cache line of its own, so writers of disjoint blocks
+ * don't wait for each other or share lines, and writers of the same block
+ * take turns. A write locks the stripes of the blocks it covers in stripe
+ * order, so writes over several blocks never deadlock.
+ *
+ * The region's header is replicated and its size is part of the region
+ * layout, so the stripes are kept in a shared section of their own named
+ * after the region ("<name>.locks"). Every process that attaches the region
+ * by name locks the same stripes.
+ *
+ * A stripe is also a sequence lock: it is odd while a writer holds it and
+ * moves on with every write, so readers of a range can check that none of
+ * its blocks was written during the read without taking a lock. Block
+ * writes are counted in the region's write sequence as well, so readers of
+ * whole regions keep working unchanged.
+ *
+ * The section also holds a dirty bitmap with a bit per BLOCK_DIRTY_SIZE
+ * bytes of the region. A writer sets the bits of its range while it holds
+ * the stripes, and the region's sync thread takes them, so writes made by
+ * any process are sent, not only those recorded by the syncing process's
+ * markRegionChanged. The bitmap has a bit for every part of the largest
+ * region, and a summary bit per word of it, so the sync thread only looks at
+ * the words that were written. The section's pages are only committed once
+ * touched, so small regions don't pay for the bitmap of a large one.
+ *
+ * The region can move to a larger segment (resizeSharedMemory). A block
+ * write that finds the segment it was given retired starts on the segment
+ * that replaced it, and hands that back to the caller to write through.
+ *
+ * A stripe records the process holding it. Writers and readers waiting on a
+ * stripe whose holder has exited take it over, and end the dead writer's
+ * count in the region's write sequence if it had one.
+ */
+
+/// Region bytes per block
+#define BLOCK_LOCK_SIZE 4096
+
+/// Locks shared by the blocks of a region; one bit each in a stripe mask
+#define BLOCK_LOCK_STRIPES 64
+
+/// Region bytes per bit of the dirty bitmap, a sync message's worth
+#define BLOCK_DIRTY_SIZE 1024
+
+/// Bits of the dirty bitmap, enough for a 4 GB region
+#define BLOCK_DIRTY_BITS (4 * 1024 * 1024)
+
+/// Words of the dirty bitmap, and so bits of its summary
+#define BLOCK_DIRTY_WORDS (BLOCK_DIRTY_BITS / 64)
+
+/// Attempts at a held stripe between checks that its holder is still running
+#define BLOCK_LOCK_OWNER_CHECK 10000
+
+/**
+ * @brief One lock, alone on its cache line
+ */
+struct BlockLockStripe {
+    volatile LONG sequence;     // Odd while a writer holds the stripe
+    volatile LONG owner;        // Process id of the holder, 0 if free
+    volatile LONG regionWrite;  // Set while the holder is counted in the region's write sequence
+    char padding[52];
+};
+
+/**
+ * @brief The stripes of a region, in the section shared by its writers
+ */
+struct BlockLockTable {
+    BlockLockStripe stripes[BLOCK_LOCK_STRIPES];
+    char memoryName[MAX_MEMORY_NAME_LENGTH];          // Region the locks belong to
+    volatile LONG64 summary[BLOCK_DIRTY_WORDS / 64];  // Words of dirty with bits set
+    volatile LONG64 dirty[BLOCK_DIRTY_WORDS];         // Parts written since the sync thread last took them
+};
+
+/**
+ * @brief Map the block locks of a region, creating them for the first process
+ *
+ * Attaching a region again in the same process returns the same table.
+ *
+ * @param memoryName Name of the region
+ * @return The table, or NULL if the section can't be created
+ */
+BlockLockTable* attachBlockLocks(const char* memoryName);
+
+/**
+ * @brief Unmap the block locks of a region once every attach has been matched
+ *
+ * @param memoryName Name of the region
+ */
+void detachBlockLocks(const char* memoryName);
+
+/**
+ * @brief Get the stripes covering a range, as a mask with bit s for stripe s
+ */
+uint64_t blockLockStripes(size_t offset, size_t size);
+
+/**
+ * @brief Start a write to a range of a region
+ *
+ * Waits for the stripes of the range, taking over those of exited
+ * processes, marks its parts dirty, then counts the write in the region's write sequence. Publish the change with
+ * publishRegionVersion before endBlockWrite; markRegionChanged does that
+ * too, and also records the exact range for this process's sync thread.
+ *
+ * @param locks The region's block locks
+ * @param region The region as last fetched with getSharedMemory; set to the
+ *               segment that replaced it if a resize has retired it
+ * @param offset Region offset of the range
+ * @param size Size of the range
+ * @return The stripes held, for endBlockWrite
+ */
+uint64_t beginBlockWrite(BlockLockTable* locks, char** region, size_t offset, size_t size);
+
+/**
+ * @brief Finish a write started with beginBlockWrite
+ *
+ * @param locks The region's block locks
+ * @param region The segment beginBlockWrite left in its region argument
+ * @param stripes The value returned by beginBlockWrite
+ */
+void endBlockWrite(BlockLockTable* locks, void* region, uint64_t stripes);
+
+/**
+ * @brief Start a consistent read of a range of a region
+ *
+ * Waits until no block of the range is being written, releasing the
+ * stripes of exited processes.
+ *
+ * @param locks The region's block locks
+ * @param offset Region offset of the range
+ * @param size Size of the range
+ * @return The sequence to pass to endBlockRead
+ */
+uint32_t beginBlockRead(const BlockLockTable* locks, size_t offset, size_t size);
+
+/**
+ * @brief Check that a read started with beginBlockRead saw a consistent range
+ *
+ * @param locks The region's block locks
+ * @param offset Region offset of the range
+ * @param size Size of the range
+ * @param sequence The value returned by beginBlockRead
+ * @return true if no block of the range was written during the read
+ */
+bool endBlockRead(const BlockLockTable* locks, size_t offset, size_t size, uint32_t sequence);
+
+/**
+ * @brief Take the parts of a region written since the last call
+ *
+ * Clears the bits it returns, so each write is taken once. A part taken
+ * while its write is still going on is marked before the write publishes
+ * its version, and beginBlockRead waits for the write to end.
+ *
+ * @param locks The region's block locks
+ * @param regionSize Size of the region
+ * @param parts Receives the index of each part written, in order; part p starts at p * BLOCK_DIRTY_SIZE
+ */
+void takeDirtyParts(BlockLockTable* locks, size_t regionSize, std::vector<size_t>& parts);
+
+#endif // BLOCK_LOCKS_H
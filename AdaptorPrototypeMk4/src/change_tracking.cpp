@@ -5,9 +5,12 @@
 #include "change_tracking.h"
 #include "sync_message.h"
 #include "network_sync.h"
+#include "update_journal.h"
 #include <iostream>
 #include <algorithm>
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 
 
 // Initialize global variables
@@ -16,6 +19,36 @@ std::map<uint64_t, UpdateInfo> g_inProgressUpdates;
 HANDLE g_changesMutex = NULL;
 HANDLE g_updatesMutex = NULL;
 
+// Apply observers for each memory region, protected by their own mutex
+static std::map<std::string, std::vector<ApplyObserverEntry> > g_applyObservers;
+
+/**
+ * @brief A registered apply merger
+ */
+struct ApplyMergerEntry {
+    ApplyMerger merger;
+    void* context;
+};
+
+// Apply mergers for each memory region, protected by the observers mutex
+static std::map<std::string, ApplyMergerEntry> g_applyMergers;
+static HANDLE g_observersMutex = NULL;
+
+static void lockObserversMutex() {
+    if (g_observersMutex == NULL) {
+        g_observersMutex = CreateMutex(NULL, FALSE, NULL);
+    }
+    if (g_observersMutex != NULL) {
+        WaitForSingleObject(g_observersMutex, INFINITE);
+    }
+}
+
+static void unlockObserversMutex() {
+    if (g_observersMutex != NULL) {
+        ReleaseMutex(g_observersMutex);
+    }
+}
+
 void initChangeTracking() {
     // Initialize mutexes if they haven't been already
     if (g_changesMutex == NULL) {
@@ -39,7 +72,7 @@ void cleanupChangeTracking() {
     if (g_changesMutex) {
         // Try to lock with a timeout to avoid deadlocks
         DWORD waitResult = WaitForSingleObject(g_changesMutex, 1000); // 1 second timeout
-        if (waitResult == WAIT_OBJECT_0) {
+        if (waitResult == WAIT_OBJECT_0 || waitResult == WAIT_ABANDONED) {
             // Successfully locked
             g_pendingChanges.clear();
             ReleaseMutex(g_changesMutex);
@@ -53,7 +86,7 @@ void cleanupChangeTracking() {
     if (g_updatesMutex) {
         // Try to lock with a timeout to avoid deadlocks
         DWORD waitResult = WaitForSingleObject(g_updatesMutex, 1000); // 1 second timeout
-        if (waitResult == WAIT_OBJECT_0) {
+        if (waitResult == WAIT_OBJECT_0 || waitResult == WAIT_ABANDONED) {
             // Successfully locked
             g_inProgressUpdates.clear();
             ReleaseMutex(g_updatesMutex);
@@ -76,6 +109,14 @@ void cleanupChangeTracking() {
     }
 }
 
+uint64_t publishRegionVersion(void* region) {
+    // Other processes writing the region increment it too; the dirty flag follows the version
+    MemoryLayout* layout = static_cast<MemoryLayout*>(region);
+    uint64_t version = InterlockedIncrement64(reinterpret_cast<volatile LONG64*>(&layout->version));
+    layout->dirty = true;
+    return version;
+}
+
 void markRegionChanged(const char* memoryName, size_t offset, size_t size) {
     // Get a pointer to the shared memory
     void* sharedMem = getSharedMemory(memoryName);
@@ -97,9 +138,39 @@ void markRegionChanged(const char* memoryName, size_t offset, size_t size) {
 
     // Mark the memory as dirty and increment the version
     // This assumes the memory layout has version and dirty fields at the beginning
-    MemoryLayout* layout = static_cast<MemoryLayout*>(sharedMem);
-    layout->version++;
-    layout->dirty = true;
+    publishRegionVersion(sharedMem);
+
+    // Write the change and the header back if the region is file-backed
+    markSharedMemoryRangeDirty(memoryName, offset, size);
+    markSharedMemoryRangeDirty(memoryName, 0, sizeof(MemoryLayout));
+}
+
+void markRegionsChanged(const char* memoryName, const std::vector<MemoryChange>& changes) {
+    if (changes.empty()) {
+        return;
+    }
+
+    // Get a pointer to the shared memory
+    void* sharedMem = getSharedMemory(memoryName);
+    if (!sharedMem) {
+        std::cerr << "Failed to get shared memory for marking changes" << std::endl;
+        return;
+    }
+
+    // Add all changes under a single lock
+    lockChangesMutex();
+    std::vector<MemoryChange>& pending = g_pendingChanges[memoryName];
+    pending.insert(pending.end(), changes.begin(), changes.end());
+    unlockChangesMutex();
+
+    // One version increment for the whole batch
+    publishRegionVersion(sharedMem);
+
+    // Write the changes and the header back if the region is file-backed
+    for (size_t i = 0; i < changes.size(); i++) {
+        markSharedMemoryRangeDirty(memoryName, changes[i].offset, changes[i].size);
+    }
+    markSharedMemoryRangeDirty(memoryName, 0, sizeof(MemoryLayout));
 }
 
 void markFieldChanged(const char* memoryName, size_t fieldOffset, size_t fieldSize) {
@@ -108,16 +179,19 @@ void markFieldChanged(const char* memoryName, size_t fieldOffset, size_t fieldSi
 
 uint64_t generateUniqueId() {
     // Generate a unique ID based on time and a random component
-    static uint64_t lastId = 0;
-    uint64_t newId = (uint64_t)GetTickCount64() << 32 | (rand() & 0xFFFFFFFF);
-
-    // Ensure it's different from the last one
-    if (newId == lastId) {
-        newId++;
+    static volatile LONG64 lastId = 0;
+    for (;;) {
+        LONG64 previous = lastId;
+        uint64_t newId = (uint64_t)GetTickCount64() << 32 | (rand() & 0xFFFFFFFF);
+
+        // Ensure it's after the last one, also when threads ask at the same time
+        if (newId <= static_cast<uint64_t>(previous)) {
+            newId = static_cast<uint64_t>(previous) + 1;
+        }
+        if (InterlockedCompareExchange64(&lastId, static_cast<LONG64>(newId), previous) == previous) {
+            return newId;
+        }
     }
-
-    lastId = newId;
-    return newId;
 }
 
 void checkUpdateTimeouts() {
@@ -141,15 +215,83 @@ void checkUpdateTimeouts() {
     unlockUpdatesMutex();
 }
 
-void applyUpdate(const SyncMessage& message) {
+void copyUpdateData(char* region, size_t regionSize, size_t offset, const char* data, size_t size) {
+    if (regionSize < sizeof(MemoryLayout)) {
+        memcpy(region + offset, data, size);
+        return;
+    }
+
+    // Local-only ranges of the header, in offset order
+    const size_t localStart[] = { offsetof(MemoryLayout, sequence), offsetof(MemoryLayout, magic) };
+    const size_t localEnd[] = { offsetof(MemoryLayout, sequence) + sizeof(uint32_t), sizeof(MemoryLayout) };
+
+    size_t position = offset;
+    size_t end = offset + size;
+    for (size_t i = 0; i < 2 && position < end; i++) {
+        if (localEnd[i] <= position || localStart[i] >= end) {
+            continue;
+        }
+        if (position < localStart[i]) {
+            memcpy(region + position, data + (position - offset), localStart[i] - position);
+        }
+        position = localEnd[i];
+    }
+    if (position < end) {
+        memcpy(region + position, data + (position - offset), end - position);
+    }
+}
+
+/**
+ * @brief Apply one update without bracketing it in the region's write sequence
+ */
+static void applyUpdateData(const SyncMessage& message) {
     // Get the shared memory
-    void* sharedMem = getSharedMemory(message.memoryName);
+    size_t regionSize = 0;
+    void* sharedMem = getSharedMemoryMapping(message.memoryName, &regionSize);
     if (sharedMem) {
+        // Reject updates that don't fit in the message or the region
+        if (message.size > MAX_SYNC_DATA_SIZE || message.offset > regionSize ||
+            message.size > regionSize - message.offset) {
+            std::cerr << "Discarding out-of-range update for " << message.memoryName
+                      << " at offset " << message.offset << " with size " << message.size << std::endl;
+            return;
+        }
+
         // Calculate the target address
         char* target = static_cast<char*>(sharedMem) + message.offset;
 
-        // Copy the data
-        memcpy(target, message.data, message.size);
+        // Take a copy of the observers and the merger so they can run without holding the lock
+        std::vector<ApplyObserverEntry> observers;
+        ApplyMergerEntry merger = { NULL, NULL };
+        lockObserversMutex();
+        std::map<std::string, std::vector<ApplyObserverEntry> >::iterator it =
+            g_applyObservers.find(message.memoryName);
+        if (it != g_applyObservers.end()) {
+            observers = it->second;
+        }
+        std::map<std::string, ApplyMergerEntry>::iterator mergerIt = g_applyMergers.find(message.memoryName);
+        if (mergerIt != g_applyMergers.end()) {
+            merger = mergerIt->second;
+        }
+        unlockObserversMutex();
+
+        // Keep the old contents only when someone needs them
+        char oldData[MAX_SYNC_DATA_SIZE];
+        if (!observers.empty()) {
+            memcpy(oldData, target, message.size);
+        }
+
+        // Copy the data, unless the merger applies it
+        if (!merger.merger || !merger.merger(message, target, merger.context)) {
+            copyUpdateData(static_cast<char*>(sharedMem), regionSize, message.offset, message.data, message.size);
+        }
+        markSharedMemoryRangeDirty(message.memoryName, message.offset, message.size);
+
+        // Let the observers update their derived state
+        for (size_t i = 0; i < observers.size(); i++) {
+            observers[i].observer(message.memoryName, message.offset, message.size,
+                                  oldData, target, observers[i].context);
+        }
 
         // Invoke the callback if registered
         if (g_networkCallback) {
@@ -158,6 +300,205 @@ void applyUpdate(const SyncMessage& message) {
     }
 }
 
+/**
+ * @brief Get a region for bracketing writes, or NULL if it has no MemoryLayout prefix
+ */
+static void* sequencedRegion(const char* memoryName) {
+    void* region = getSharedMemory(memoryName);
+    if (region && getSharedMemorySize(memoryName) >= sizeof(MemoryLayout)) {
+        return region;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Adopt the version carried by an update once all of it has been applied
+ *
+ * Called inside the region's write bracket. Parts flagged with
+ * SYNC_FLAG_MORE_IN_VERSION leave the version alone so that a restart never
+ * claims a version it only has half of.
+ */
+static void adoptUpdateVersion(const SyncMessage& message) {
+    // Fetched again: a resize may have switched the region since the write began
+    MemoryLayout* layout = static_cast<MemoryLayout*>(sequencedRegion(message.memoryName));
+    if (!layout || (message.flags & SYNC_FLAG_MORE_IN_VERSION)) {
+        return;
+    }
+
+    // Raised with a compare-exchange, as local writers publish with an atomic increment
+    volatile LONG64* version = reinterpret_cast<volatile LONG64*>(&layout->version);
+    for (;;) {
+        LONG64 current = *version;
+        if (message.version <= static_cast<uint64_t>(current)) {
+            return;
+        }
+        if (InterlockedCompareExchange64(version, static_cast<LONG64>(message.version), current) == current) {
+            break;
+        }
+    }
+    markSharedMemoryRangeDirty(message.memoryName, 0, sizeof(MemoryLayout));
+}
+
+/**
+ * @brief Wait for a region being resized to be large enough for an update
+ *
+ * Must be called outside the region's write bracket, as the switch to the
+ * larger segment waits for the writes in progress to finish.
+ */
+static void waitForRoom(const SyncMessage& message) {
+    if (message.offset + message.size > getSharedMemorySize(message.memoryName) &&
+        !waitForSharedMemoryResize(message.memoryName, RESIZE_APPLY_WAIT_MS)) {
+        std::cerr << "Timed out waiting for " << message.memoryName << " to grow" << std::endl;
+    }
+}
+
+void applyUpdate(const SyncMessage& message) {
+    waitForRoom(message);
+    void* region = sequencedRegion(message.memoryName);
+    if (region) {
+        region = beginNamedRegionWrite(message.memoryName, region);
+    }
+
+    applyUpdateData(message);
+
+    if (region) {
+        adoptUpdateVersion(message);
+        endRegionWrite(region);
+    }
+
+    journalUpdate(message, !(message.flags & SYNC_FLAG_MORE_IN_VERSION));
+}
+
+bool beginRegionWrite(void* region) {
+    // A compare-exchange, so that the count never goes up on a segment a resize has retired
+    MemoryLayout* layout = static_cast<MemoryLayout*>(region);
+    volatile LONG* sequence = reinterpret_cast<volatile LONG*>(&layout->sequence);
+    for (;;) {
+        LONG current = *sequence;
+        if (current & REGION_RETIRED) {
+            return false;
+        }
+        if (InterlockedCompareExchange(sequence, current + 1, current) == current) {
+            return true;
+        }
+    }
+}
+
+void* beginNamedRegionWrite(const char* memoryName, void* region) {
+    // The switch to the next segment follows the retirement at once, but another process only sees it in the header
+    ULONGLONG deadline = GetTickCount64() + REGION_RETIRED_WAIT_MS;
+    for (int attempt = 0; region != NULL; attempt++) {
+        if (beginRegionWrite(region)) {
+            return region;
+        }
+        if (GetTickCount64() >= deadline) {
+            std::cerr << "[RESIZE] " << memoryName << " has no segment to write to after "
+                      << REGION_RETIRED_WAIT_MS << " ms" << std::endl;
+            return NULL;
+        }
+        if (attempt > 0) {
+            Sleep(1);
+        }
+        region = sequencedRegion(memoryName);
+    }
+    return NULL;
+}
+
+void endRegionWrite(void* region) {
+    // One less writer and one more write done, in a single step
+    MemoryLayout* layout = static_cast<MemoryLayout*>(region);
+    InterlockedExchangeAdd(reinterpret_cast<volatile LONG*>(&layout->sequence), REGION_WRITE_DONE - 1);
+}
+
+uint32_t beginRegionRead(const void* region) {
+    const MemoryLayout* layout = static_cast<const MemoryLayout*>(region);
+    for (int attempt = 0; ; attempt++) {
+        uint32_t sequence = layout->sequence;
+        if ((sequence & REGION_WRITERS_MASK) == 0) {
+            MemoryBarrier();
+            return sequence;
+        }
+
+        // Each writer stays counted for one update; yield if they take longer
+        if (attempt > 100) {
+            Sleep(0);
+        }
+    }
+}
+
+bool endRegionRead(const void* region, uint32_t sequence) {
+    const MemoryLayout* layout = static_cast<const MemoryLayout*>(region);
+    MemoryBarrier();
+    return layout->sequence == sequence;
+}
+
+bool registerApplyObserver(const char* memoryName, ApplyObserver observer, void* context) {
+    if (!memoryName || !observer) {
+        return false;
+    }
+
+    ApplyObserverEntry entry;
+    entry.observer = observer;
+    entry.context = context;
+
+    lockObserversMutex();
+    g_applyObservers[memoryName].push_back(entry);
+    unlockObserversMutex();
+    return true;
+}
+
+bool unregisterApplyObserver(const char* memoryName, ApplyObserver observer, void* context) {
+    bool found = false;
+
+    lockObserversMutex();
+    std::map<std::string, std::vector<ApplyObserverEntry> >::iterator it =
+        g_applyObservers.find(memoryName);
+    if (it != g_applyObservers.end()) {
+        std::vector<ApplyObserverEntry>& entries = it->second;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].observer == observer && entries[i].context == context) {
+                entries.erase(entries.begin() + i);
+                found = true;
+                break;
+            }
+        }
+        if (entries.empty()) {
+            g_applyObservers.erase(it);
+        }
+    }
+    unlockObserversMutex();
+    return found;
+}
+
+bool registerApplyMerger(const char* memoryName, ApplyMerger merger, void* context) {
+    if (!memoryName || !merger) {
+        return false;
+    }
+
+    ApplyMergerEntry entry;
+    entry.merger = merger;
+    entry.context = context;
+
+    lockObserversMutex();
+    g_applyMergers[memoryName] = entry;
+    unlockObserversMutex();
+    return true;
+}
+
+bool unregisterApplyMerger(const char* memoryName) {
+    lockObserversMutex();
+    bool found = g_applyMergers.erase(memoryName) > 0;
+    unlockObserversMutex();
+    return found;
+}
+
+/**
+ * @brief Orders the chunks of a multi-part update by offset
+ */
+static bool chunkOffsetLess(const SyncMessage& a, const SyncMessage& b) {
+    return a.offset < b.offset;
+}
+
 void applyMultipartUpdate(uint64_t updateId) {
     lockUpdatesMutex();
 
@@ -167,20 +508,62 @@ void applyMultipartUpdate(uint64_t updateId) {
         std::vector<SyncMessage>& chunks = it->second.chunks;
 
         // Sort chunks by offset
-        std::sort(chunks.begin(), chunks.end(),
-                  [](const SyncMessage& a, const SyncMessage& b) {
-                      return a.offset < b.offset;
-                  });
+        std::sort(chunks.begin(), chunks.end(), chunkOffsetLess);
 
-        // Apply each chunk
+        // Apply each chunk as one write, so readers never see half an update
+        if (!chunks.empty()) {
+            waitForRoom(chunks.back());
+        }
+        void* region = chunks.empty() ? NULL : sequencedRegion(chunks[0].memoryName);
+        if (region) {
+            region = beginNamedRegionWrite(chunks[0].memoryName, region);
+        }
+        for (size_t i = 0; i < chunks.size(); i++) {
+            applyUpdateData(chunks[i]);
+        }
+        if (region) {
+            adoptUpdateVersion(chunks.back());
+            endRegionWrite(region);
+        }
+
+        // The update only counts as complete with its last chunk
         for (size_t i = 0; i < chunks.size(); i++) {
-            applyUpdate(chunks[i]);
+            bool lastChunk = (i + 1 == chunks.size()) && !(chunks[i].flags & SYNC_FLAG_MORE_IN_VERSION);
+            journalUpdate(chunks[i], lastChunk);
         }
     }
 
     unlockUpdatesMutex();
 }
 
+void applyResize(const SyncMessage& message) {
+    if (message.size < sizeof(RegionResizeInfo)) {
+        return;
+    }
+
+    RegionResizeInfo info;
+    memcpy(&info, message.data, sizeof(info));
+    size_t newSize = static_cast<size_t>(info.newSize);
+    if (newSize > getSharedMemorySize(message.memoryName)) {
+        std::cout << "[RESIZE] " << message.memoryName << " grew to " << newSize << " bytes at version "
+                  << message.version << std::endl;
+        resizeSharedMemory(message.memoryName, newSize);
+    }
+}
+
+void restoreOldBytes(size_t offset, size_t size, const void* oldData,
+                     size_t cellOffset, size_t cellSize, const void* currentCell, void* out) {
+    memcpy(out, currentCell, cellSize);
+
+    size_t end = offset + size;
+    size_t from = (offset > cellOffset) ? offset : cellOffset;
+    size_t to = (end < cellOffset + cellSize) ? end : cellOffset + cellSize;
+    if (from < to) {
+        memcpy(static_cast<char*>(out) + (from - cellOffset),
+               static_cast<const char*>(oldData) + (from - offset), to - from);
+    }
+}
+
 void lockChangesMutex() {
     if (g_changesMutex != NULL) {
         WaitForSingleObject(g_changesMutex, INFINITE);
@@ -27,6 +27,46 @@ struct UpdateInfo {
     uint64_t startTime;                 // Time when first chunk was received
 };
 
+/**
+ * @brief Callback invoked after a network update has been applied
+ *
+ * Observers receive the bytes of the changed range both before and after the
+ * update, which lets them maintain derived state (indexes, aggregates, ...)
+ * incrementally instead of rescanning the region.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param offset Offset of the changed range within the region
+ * @param size Size of the changed range
+ * @param oldData Contents of the range before the update
+ * @param newData Contents of the range after the update (points into the region)
+ * @param context Context pointer given at registration
+ */
+typedef void (*ApplyObserver)(const char* memoryName, size_t offset, size_t size,
+                              const void* oldData, const void* newData, void* context);
+
+/**
+ * @brief A registered apply observer
+ */
+struct ApplyObserverEntry {
+    ApplyObserver observer;     // Function to call
+    void* context;              // Context pointer passed back to the function
+};
+
+/**
+ * @brief Callback that applies a network update in place of the plain copy
+ *
+ * Called inside the region's write bracket, before the apply observers run,
+ * for every update to a region that has a merger. A merger that handles the
+ * update writes the bytes it keeps, merging the ones it owns with the
+ * region's current contents, so the observers see the merged result.
+ *
+ * @param message The update, already checked to fit the region
+ * @param target The range in the region the update covers
+ * @param context Context pointer given at registration
+ * @return true if the merger applied the update, false to have it copied as usual
+ */
+typedef bool (*ApplyMerger)(const SyncMessage& message, void* target, void* context);
+
 // Vector to track pending changes for each memory region
 extern std::map<std::string, std::vector<MemoryChange> > g_pendingChanges;
 
@@ -42,6 +82,12 @@ extern HANDLE g_updatesMutex;
 // Timeout for multi-part updates (milliseconds)
 #define UPDATE_TIMEOUT_MS 5000
 
+// How long an update that needs a larger region waits for the resize (milliseconds)
+#define RESIZE_APPLY_WAIT_MS 5000
+
+// How long a write to a retired segment waits for the region's next one (milliseconds)
+#define REGION_RETIRED_WAIT_MS 1000
+
 /**
  * @brief Initialize the change tracking system
  *
@@ -67,6 +113,28 @@ void cleanupChangeTracking();
  */
 void markRegionChanged(const char* memoryName, size_t offset, size_t size);
 
+/**
+ * @brief Increment a region's version and mark it dirty
+ *
+ * The increment is atomic, so every process writing the region publishes a
+ * version of its own. markRegionChanged and markRegionsChanged call this.
+ *
+ * @param region Pointer to the start of the region
+ * @return The new version
+ */
+uint64_t publishRegionVersion(void* region);
+
+/**
+ * @brief Mark several regions of shared memory as changed
+ *
+ * This function adds a batch of changes to the pending changes list for a
+ * memory region and increments the version once for the whole batch.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param changes The changed ranges
+ */
+void markRegionsChanged(const char* memoryName, const std::vector<MemoryChange>& changes);
+
 /**
  * @brief Mark a specific field as changed
  *
@@ -81,7 +149,8 @@ void markFieldChanged(const char* memoryName, size_t fieldOffset, size_t fieldSi
 /**
  * @brief Generate a unique update ID
  *
- * This function generates a unique ID for a multi-part update.
+ * This function generates a unique ID for a multi-part update. It may be
+ * called from any thread; each call returns a larger ID than the last.
  *
  * @return A unique update ID
  */
@@ -104,6 +173,21 @@ void checkUpdateTimeouts();
  */
 void applyUpdate(const SyncMessage& message);
 
+/**
+ * @brief Copy update data into a region without touching its local header fields
+ *
+ * The write sequence and the segment fields from magic onwards describe each
+ * process group's own segment, so bytes of a replicated MemoryLayout header
+ * that cover them are skipped. Mergers use it for the bytes they copy as is.
+ *
+ * @param region Start of the region
+ * @param regionSize Size of the region
+ * @param offset Offset of the data within the region
+ * @param data The data
+ * @param size Number of bytes, which must fit the region
+ */
+void copyUpdateData(char* region, size_t regionSize, size_t offset, const char* data, size_t size);
+
 /**
  * @brief Apply a multi-part update to shared memory
  *
@@ -113,6 +197,137 @@ void applyUpdate(const SyncMessage& message);
  */
 void applyMultipartUpdate(uint64_t updateId);
 
+/**
+ * @brief Follow a region's source to a larger size
+ *
+ * Applies a MSG_RESIZE message: the local copy of the region is moved to a
+ * larger segment in the background (see resizeSharedMemory). Updates that
+ * only fit the larger size wait for the switch; others carry on meanwhile.
+ *
+ * @param message The MSG_RESIZE message
+ */
+void applyResize(const SyncMessage& message);
+
+/**
+ * @brief Register an observer for updates applied to a memory region
+ *
+ * The observer is called from the receive thread after each applied update
+ * that targets the region.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param observer The function to call
+ * @param context Context pointer passed back to the function
+ * @return true if the observer was registered, false otherwise
+ */
+bool registerApplyObserver(const char* memoryName, ApplyObserver observer, void* context);
+
+/**
+ * @brief Remove an observer registered with registerApplyObserver
+ *
+ * @param memoryName Name of the shared memory region
+ * @param observer The function that was registered
+ * @param context The context pointer that was registered
+ * @return true if the observer was found and removed, false otherwise
+ */
+bool unregisterApplyObserver(const char* memoryName, ApplyObserver observer, void* context);
+
+/**
+ * @brief Set the function that merges network updates to a region
+ *
+ * A region has at most one merger; registering another replaces it.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param merger Function to call for each applied update
+ * @param context Context pointer passed back to the function
+ * @return true if the merger was registered, false on invalid arguments
+ */
+bool registerApplyMerger(const char* memoryName, ApplyMerger merger, void* context);
+
+/**
+ * @brief Remove the merger of a region, so updates are copied as they are
+ *
+ * @param memoryName Name of the shared memory region
+ * @return true if the region had a merger
+ */
+bool unregisterApplyMerger(const char* memoryName);
+
+/**
+ * @brief Rebuild the pre-update contents of a cell touched by an update
+ *
+ * Helper for apply observers: copies the current cell and puts back the part
+ * of it that was overwritten by the update described by offset/size/oldData.
+ *
+ * @param offset Offset of the applied update
+ * @param size Size of the applied update
+ * @param oldData Contents of the update's range before it was applied
+ * @param cellOffset Region offset of the cell
+ * @param cellSize Size of the cell
+ * @param currentCell Pointer to the cell's current contents
+ * @param out Buffer of cellSize bytes receiving the old contents
+ */
+void restoreOldBytes(size_t offset, size_t size, const void* oldData,
+                     size_t cellOffset, size_t cellSize, const void* currentCell, void* out);
+
+/**
+ * @brief Mark the start of a local write to a region
+ *
+ * Counts the write in the region's MemoryLayout::sequence so that readers
+ * using beginRegionRead/endRegionRead retry. applyUpdate and
+ * applyMultipartUpdate bracket every replicated write this way; local
+ * writers may do the same. Brackets of several threads or processes may
+ * overlap, up to REGION_WRITERS_MASK at a time; writers of the same bytes
+ * must still exclude each other, for instance with block_locks.h.
+ *
+ * A resize retires the segment only when no write is counted in it, and no
+ * write starts on a retired segment, so a counted write is never lost.
+ *
+ * @param region Pointer to the start of the region
+ * @return true if the write is counted; false if a resize has retired the
+ *         segment, in which case fetch the region again (or use
+ *         beginNamedRegionWrite)
+ */
+bool beginRegionWrite(void* region);
+
+/**
+ * @brief Mark the start of a local write to a named region, following a resize
+ *
+ * Starts the write on the segment given, or on the segment that replaced
+ * it if a resize has retired it.
+ *
+ * @param memoryName Name of the region
+ * @param region The region as last fetched with getSharedMemory
+ * @return The segment the write is counted in, to write through and pass to
+ *         endRegionWrite; NULL if no segment took the write within
+ *         REGION_RETIRED_WAIT_MS
+ */
+void* beginNamedRegionWrite(const char* memoryName, void* region);
+
+/**
+ * @brief Mark the end of a local write started with beginRegionWrite
+ *
+ * @param region Pointer to the start of the region
+ */
+void endRegionWrite(void* region);
+
+/**
+ * @brief Start a consistent read of a region
+ *
+ * Waits until no write is in progress and returns the region's sequence.
+ *
+ * @param region Pointer to the start of the region
+ * @return The sequence to pass to endRegionRead
+ */
+uint32_t beginRegionRead(const void* region);
+
+/**
+ * @brief Check that a read started with beginRegionRead saw a consistent region
+ *
+ * @param region Pointer to the start of the region
+ * @param sequence The value returned by beginRegionRead
+ * @return true if no write happened during the read, false if it must be retried
+ */
+bool endRegionRead(const void* region, uint32_t sequence);
+
 /**
  * @brief Lock the changes mutex
  */
@@ -0,0 +1,598 @@
+/**
+ * @file column_scan.cpp
+ * @brief Implementation of vectorised predicate scans
+ *
+ * Every kernel turns a block of 64 cells into a 64-bit match word. Scans run
+ * over chunks of SCAN_CHUNK_WORDS words at a time so the match words stay in
+ * L1, and the words are then either counted or expanded into indices.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "column_scan.h"
+#include "shared_memory.h"
+#include "change_tracking.h"
+#include <iostream>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define SCAN_HAVE_X86 1
+#define SCAN_AVX2_TARGET
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define SCAN_HAVE_X86 1
+#define SCAN_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+/// Match words produced per chunk (4096 cells)
+#define SCAN_CHUNK_WORDS 64
+
+/// Whole-range snapshot attempts before falling back to per-chunk snapshots
+#define SCAN_SNAPSHOT_RETRIES 4
+
+/// Kernel selection: -1 = not probed yet, 0 = scalar, 1 = AVX2
+static volatile LONG g_scanAvx2 = -1;
+
+/// Set by setScanScalarOnly
+static volatile LONG g_scanScalarOnly = 0;
+
+/**
+ * @brief Check the processor and OS for AVX2 support
+ */
+static bool detectAvx2() {
+#if defined(SCAN_HAVE_X86)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, 0) < 7 || !__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    bool osxsave = (ecx & (1u << 27)) != 0;
+    bool avx = (ecx & (1u << 28)) != 0;
+    if (!osxsave || !avx) {
+        return false;
+    }
+    unsigned int xcr0, xcr0High;
+    __asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+    if ((xcr0 & 6) != 6) {
+        return false;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1u << 5)) != 0;
+#endif
+#else
+    return false;
+#endif
+}
+
+bool scanUsesAvx2() {
+    if (g_scanAvx2 < 0) {
+        InterlockedExchange(&g_scanAvx2, detectAvx2() ? 1 : 0);
+    }
+    return g_scanAvx2 == 1 && g_scanScalarOnly == 0;
+}
+
+void setScanScalarOnly(bool scalarOnly) {
+    InterlockedExchange(&g_scanScalarOnly, scalarOnly ? 1 : 0);
+}
+
+/**
+ * @brief Count the set bits of a match word
+ */
+static uint32_t popCount(uint64_t word) {
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<uint32_t>((word * 0x0101010101010101ULL) >> 56);
+}
+
+/**
+ * @brief Index of the lowest set bit of a non-zero match word
+ */
+static uint32_t lowestBit(uint64_t word) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return index;
+#elif defined(__GNUC__)
+    return static_cast<uint32_t>(__builtin_ctzll(word));
+#else
+    uint32_t index = 0;
+    while ((word & 1) == 0) {
+        word >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/**
+ * @brief Bitmask operators (not defined for floating point cells)
+ */
+template <typename T> struct ScanMask {
+    static bool any(T cell, T mask) { return (cell & mask) != 0; }
+    static bool all(T cell, T mask) { return (cell & mask) == mask; }
+};
+template <> struct ScanMask<float> {
+    static bool any(float, float) { return false; }
+    static bool all(float, float) { return false; }
+};
+template <> struct ScanMask<double> {
+    static bool any(double, double) { return false; }
+    static bool all(double, double) { return false; }
+};
+
+/**
+ * @brief Scalar kernel: match word for up to 64 cells
+ */
+template <typename T>
+static uint64_t scalarMatchWord(const T* cells, uint32_t count, ScanOp op, T a, T b) {
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        T cell = cells[i];
+        bool match = false;
+        switch (op) {
+            case SCAN_EQUAL:     match = (cell == a); break;
+            case SCAN_NOT_EQUAL: match = (cell != a); break;
+            case SCAN_RANGE:     match = (a <= cell && cell <= b); break;
+            case SCAN_MASK_ANY:  match = ScanMask<T>::any(cell, a); break;
+            case SCAN_MASK_ALL:  match = ScanMask<T>::all(cell, a); break;
+        }
+        word |= static_cast<uint64_t>(match) << i;
+    }
+    return word;
+}
+
+#if defined(SCAN_HAVE_X86)
+
+/**
+ * @brief AVX2 kernel for 32-bit integer cells (unsigned via sign-bit bias)
+ */
+SCAN_AVX2_TARGET
+static void avx2MatchInt32(const int32_t* cells, size_t words, ScanOp op, int32_t a, int32_t b,
+                           bool isUnsigned, uint64_t* out) {
+    const __m256i bias = _mm256_set1_epi32(isUnsigned ? static_cast<int32_t>(0x80000000u) : 0);
+    const __m256i va = _mm256_set1_epi32(a);
+    const __m256i low = _mm256_xor_si256(va, bias);
+    const __m256i high = _mm256_xor_si256(_mm256_set1_epi32(b), bias);
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (size_t w = 0; w < words; w++) {
+        uint64_t word = 0;
+        for (int g = 0; g < 8; g++) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells + w * 64 + g * 8));
+            __m256i m;
+            int invert = 0;
+            switch (op) {
+                case SCAN_EQUAL:
+                    m = _mm256_cmpeq_epi32(x, va);
+                    break;
+                case SCAN_NOT_EQUAL:
+                    m = _mm256_cmpeq_epi32(x, va);
+                    invert = 0xFF;
+                    break;
+                case SCAN_RANGE: {
+                    __m256i xb = _mm256_xor_si256(x, bias);
+                    m = _mm256_or_si256(_mm256_cmpgt_epi32(low, xb), _mm256_cmpgt_epi32(xb, high));
+                    invert = 0xFF;
+                    break;
+                }
+                case SCAN_MASK_ANY:
+                    m = _mm256_cmpeq_epi32(_mm256_and_si256(x, va), zero);
+                    invert = 0xFF;
+                    break;
+                default:
+                    m = _mm256_cmpeq_epi32(_mm256_and_si256(x, va), va);
+                    break;
+            }
+            uint64_t bits = static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(m)) ^ invert);
+            word |= bits << (g * 8);
+        }
+        out[w] = word;
+    }
+}
+
+/**
+ * @brief AVX2 kernel for 64-bit integer cells (unsigned via sign-bit bias)
+ */
+SCAN_AVX2_TARGET
+static void avx2MatchInt64(const int64_t* cells, size_t words, ScanOp op, int64_t a, int64_t b,
+                           bool isUnsigned, uint64_t* out) {
+    const __m256i bias = _mm256_set1_epi64x(isUnsigned ? static_cast<int64_t>(0x8000000000000000ULL) : 0);
+    const __m256i va = _mm256_set1_epi64x(a);
+    const __m256i low = _mm256_xor_si256(va, bias);
+    const __m256i high = _mm256_xor_si256(_mm256_set1_epi64x(b), bias);
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (size_t w = 0; w < words; w++) {
+        uint64_t word = 0;
+        for (int g = 0; g < 16; g++) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells + w * 64 + g * 4));
+            __m256i m;
+            int invert = 0;
+            switch (op) {
+                case SCAN_EQUAL:
+                    m = _mm256_cmpeq_epi64(x, va);
+                    break;
+                case SCAN_NOT_EQUAL:
+                    m = _mm256_cmpeq_epi64(x, va);
+                    invert = 0xF;
+                    break;
+                case SCAN_RANGE: {
+                    __m256i xb = _mm256_xor_si256(x, bias);
+                    m = _mm256_or_si256(_mm256_cmpgt_epi64(low, xb), _mm256_cmpgt_epi64(xb, high));
+                    invert = 0xF;
+                    break;
+                }
+                case SCAN_MASK_ANY:
+                    m = _mm256_cmpeq_epi64(_mm256_and_si256(x, va), zero);
+                    invert = 0xF;
+                    break;
+                default:
+                    m = _mm256_cmpeq_epi64(_mm256_and_si256(x, va), va);
+                    break;
+            }
+            uint64_t bits = static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(m)) ^ invert);
+            word |= bits << (g * 4);
+        }
+        out[w] = word;
+    }
+}
+
+/**
+ * @brief AVX2 kernel for float cells (same NaN behaviour as the scalar kernel)
+ */
+SCAN_AVX2_TARGET
+static void avx2MatchFloat(const float* cells, size_t words, ScanOp op, float a, float b, uint64_t* out) {
+    const __m256 va = _mm256_set1_ps(a);
+    const __m256 vb = _mm256_set1_ps(b);
+
+    for (size_t w = 0; w < words; w++) {
+        uint64_t word = 0;
+        for (int g = 0; g < 8; g++) {
+            __m256 x = _mm256_loadu_ps(cells + w * 64 + g * 8);
+            __m256 m;
+            switch (op) {
+                case SCAN_EQUAL:
+                    m = _mm256_cmp_ps(x, va, _CMP_EQ_OQ);
+                    break;
+                case SCAN_NOT_EQUAL:
+                    m = _mm256_cmp_ps(x, va, _CMP_NEQ_UQ);
+                    break;
+                default:
+                    m = _mm256_and_ps(_mm256_cmp_ps(x, va, _CMP_GE_OQ), _mm256_cmp_ps(x, vb, _CMP_LE_OQ));
+                    break;
+            }
+            word |= static_cast<uint64_t>(_mm256_movemask_ps(m)) << (g * 8);
+        }
+        out[w] = word;
+    }
+}
+
+/**
+ * @brief AVX2 kernel for double cells (same NaN behaviour as the scalar kernel)
+ */
+SCAN_AVX2_TARGET
+static void avx2MatchDouble(const double* cells, size_t words, ScanOp op, double a, double b, uint64_t* out) {
+    const __m256d va = _mm256_set1_pd(a);
+    const __m256d vb = _mm256_set1_pd(b);
+
+    for (size_t w = 0; w < words; w++) {
+        uint64_t word = 0;
+        for (int g = 0; g < 16; g++) {
+            __m256d x = _mm256_loadu_pd(cells + w * 64 + g * 4);
+            __m256d m;
+            switch (op) {
+                case SCAN_EQUAL:
+                    m = _mm256_cmp_pd(x, va, _CMP_EQ_OQ);
+                    break;
+                case SCAN_NOT_EQUAL:
+                    m = _mm256_cmp_pd(x, va, _CMP_NEQ_UQ);
+                    break;
+                default:
+                    m = _mm256_and_pd(_mm256_cmp_pd(x, va, _CMP_GE_OQ), _mm256_cmp_pd(x, vb, _CMP_LE_OQ));
+                    break;
+            }
+            word |= static_cast<uint64_t>(_mm256_movemask_pd(m)) << (g * 4);
+        }
+        out[w] = word;
+    }
+}
+
+#endif // SCAN_HAVE_X86
+
+/**
+ * @brief Compute match words for cells with the scalar kernel
+ */
+template <typename T>
+static void scalarMatchWords(const T* cells, uint64_t count, const ScanPredicate& predicate, uint64_t* out) {
+    T a, b;
+    memcpy(&a, predicate.operand, sizeof(T));
+    memcpy(&b, predicate.operand2, sizeof(T));
+
+    size_t words = static_cast<size_t>((count + 63) / 64);
+    for (size_t w = 0; w < words; w++) {
+        uint64_t remaining = count - w * 64;
+        uint32_t n = (remaining < 64) ? static_cast<uint32_t>(remaining) : 64;
+        out[w] = scalarMatchWord<T>(cells + w * 64, n, predicate.op, a, b);
+    }
+}
+
+/**
+ * @brief Compute the match words for count cells (at most SCAN_CHUNK_WORDS * 64)
+ *
+ * Whole words go through the AVX2 kernel when it is in use; a trailing
+ * partial word always uses the scalar kernel.
+ */
+static void matchWords(const void* cells, uint64_t count, const ScanPredicate& predicate,
+                       bool avx2, uint64_t* out) {
+    uint64_t vectorCount = avx2 ? (count / 64) * 64 : 0;
+    size_t words = static_cast<size_t>(vectorCount / 64);
+
+#if defined(SCAN_HAVE_X86)
+    if (words > 0) {
+        switch (predicate.type) {
+            case COLUMN_INT32:
+            case COLUMN_UINT32: {
+                int32_t a, b;
+                memcpy(&a, predicate.operand, sizeof(a));
+                memcpy(&b, predicate.operand2, sizeof(b));
+                avx2MatchInt32(static_cast<const int32_t*>(cells), words, predicate.op, a, b,
+                               predicate.type == COLUMN_UINT32, out);
+                break;
+            }
+            case COLUMN_INT64:
+            case COLUMN_UINT64: {
+                int64_t a, b;
+                memcpy(&a, predicate.operand, sizeof(a));
+                memcpy(&b, predicate.operand2, sizeof(b));
+                avx2MatchInt64(static_cast<const int64_t*>(cells), words, predicate.op, a, b,
+                               predicate.type == COLUMN_UINT64, out);
+                break;
+            }
+            case COLUMN_FLOAT: {
+                float a, b;
+                memcpy(&a, predicate.operand, sizeof(a));
+                memcpy(&b, predicate.operand2, sizeof(b));
+                avx2MatchFloat(static_cast<const float*>(cells), words, predicate.op, a, b, out);
+                break;
+            }
+            case COLUMN_DOUBLE: {
+                double a, b;
+                memcpy(&a, predicate.operand, sizeof(a));
+                memcpy(&b, predicate.operand2, sizeof(b));
+                avx2MatchDouble(static_cast<const double*>(cells), words, predicate.op, a, b, out);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+#else
+    vectorCount = 0;
+    words = 0;
+#endif
+
+    if (vectorCount == count) {
+        return;
+    }
+
+    uint32_t width = columnTypeWidth(predicate.type, 0);
+    const void* rest = static_cast<const char*>(cells) + vectorCount * width;
+    uint64_t restCount = count - vectorCount;
+    switch (predicate.type) {
+        case COLUMN_INT32:  scalarMatchWords(static_cast<const int32_t*>(rest), restCount, predicate, out + words); break;
+        case COLUMN_UINT32: scalarMatchWords(static_cast<const uint32_t*>(rest), restCount, predicate, out + words); break;
+        case COLUMN_INT64:  scalarMatchWords(static_cast<const int64_t*>(rest), restCount, predicate, out + words); break;
+        case COLUMN_UINT64: scalarMatchWords(static_cast<const uint64_t*>(rest), restCount, predicate, out + words); break;
+        case COLUMN_FLOAT:  scalarMatchWords(static_cast<const float*>(rest), restCount, predicate, out + words); break;
+        case COLUMN_DOUBLE: scalarMatchWords(static_cast<const double*>(rest), restCount, predicate, out + words); break;
+        default: break;
+    }
+}
+
+/**
+ * @brief Check that a predicate can be evaluated
+ */
+static bool validPredicate(const ScanPredicate& predicate) {
+    switch (predicate.type) {
+        case COLUMN_INT32:
+        case COLUMN_UINT32:
+        case COLUMN_INT64:
+        case COLUMN_UINT64:
+            return predicate.op >= SCAN_EQUAL && predicate.op <= SCAN_MASK_ALL;
+        case COLUMN_FLOAT:
+        case COLUMN_DOUBLE:
+            return predicate.op >= SCAN_EQUAL && predicate.op <= SCAN_RANGE;
+        default:
+            return false;
+    }
+}
+
+int64_t scanCells(const void* cells, uint64_t count, const ScanPredicate& predicate,
+                  std::vector<uint64_t>* matches) {
+    if (!validPredicate(predicate) || (!cells && count > 0)) {
+        return -1;
+    }
+
+    bool avx2 = scanUsesAvx2();
+    uint32_t width = columnTypeWidth(predicate.type, 0);
+    const uint64_t chunkCells = SCAN_CHUNK_WORDS * 64;
+    uint64_t words[SCAN_CHUNK_WORDS];
+    int64_t total = 0;
+
+    for (uint64_t first = 0; first < count; first += chunkCells) {
+        uint64_t n = (count - first < chunkCells) ? count - first : chunkCells;
+        matchWords(static_cast<const char*>(cells) + first * width, n, predicate, avx2, words);
+
+        size_t wordCount = static_cast<size_t>((n + 63) / 64);
+        for (size_t w = 0; w < wordCount; w++) {
+            uint64_t word = words[w];
+            if (word == 0) {
+                continue;
+            }
+            total += popCount(word);
+            if (matches) {
+                uint64_t base = first + w * 64;
+                while (word != 0) {
+                    matches->push_back(base + lowestBit(word));
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+
+    return total;
+}
+
+/**
+ * @brief Read the number of cells to scan
+ */
+static uint64_t scanLimit(const char* region, uint64_t count, size_t countOffset) {
+    if (countOffset == 0) {
+        return count;
+    }
+    uint64_t recordCount;
+    memcpy(&recordCount, region + countOffset, sizeof(recordCount));
+    return (recordCount < count) ? recordCount : count;
+}
+
+/**
+ * @brief Scan chunk by chunk, each chunk under its own region read
+ *
+ * Used when whole-range snapshots keep losing to writers. A chunk takes a
+ * few microseconds to scan, so it fits between updates that a full column
+ * never would; the result is consistent within each chunk but chunks may
+ * reflect different updates.
+ */
+static int64_t scanChunks(const char* region, size_t offset, uint64_t count, size_t countOffset,
+                          const ScanPredicate& predicate, std::vector<uint64_t>* matches) {
+    uint32_t width = columnTypeWidth(predicate.type, 0);
+    const uint64_t chunkCells = SCAN_CHUNK_WORDS * 64;
+    int64_t total = 0;
+
+    uint32_t sequence = beginRegionRead(region);
+    uint64_t n = scanLimit(region, count, countOffset);
+    while (!endRegionRead(region, sequence)) {
+        sequence = beginRegionRead(region);
+        n = scanLimit(region, count, countOffset);
+    }
+
+    for (uint64_t first = 0; first < n; first += chunkCells) {
+        uint64_t cells = (n - first < chunkCells) ? n - first : chunkCells;
+        size_t mark = matches ? matches->size() : 0;
+
+        for (;;) {
+            sequence = beginRegionRead(region);
+            int64_t result = scanCells(region + offset + first * width, cells, predicate, matches);
+            if (result < 0) {
+                return result;
+            }
+            if (endRegionRead(region, sequence)) {
+                total += result;
+                break;
+            }
+            if (matches) {
+                matches->resize(mark);
+            }
+        }
+
+        // scanCells numbers matches from the start of the chunk
+        if (matches) {
+            for (size_t i = mark; i < matches->size(); i++) {
+                (*matches)[i] += first;
+            }
+        }
+    }
+
+    return total;
+}
+
+/**
+ * @brief Run a scan over region cells under the region's write sequence
+ *
+ * The whole range is retried up to SCAN_SNAPSHOT_RETRIES times; if writers
+ * keep interrupting it, the scan falls back to per-chunk snapshots so a
+ * steady update stream cannot starve it.
+ *
+ * @param countOffset If non-zero, the region offset of a uint64_t record count
+ *                    that limits the scan (read inside the same snapshot)
+ */
+static int64_t scanSnapshot(const char* memoryName, size_t offset, uint64_t count, size_t countOffset,
+                            const ScanPredicate& predicate, std::vector<uint64_t>* matches) {
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(memoryName, &regionSize));
+    uint32_t width = columnTypeWidth(predicate.type, 0);
+    if (!region || width == 0 || offset > regionSize || count > (regionSize - offset) / width) {
+        std::cerr << "[SCAN] Range is outside region " << memoryName << std::endl;
+        return -1;
+    }
+
+    if (regionSize < sizeof(MemoryLayout)) {
+        // No write sequence to read under
+        return scanCells(region + offset, scanLimit(region, count, countOffset), predicate, matches);
+    }
+
+    size_t mark = matches ? matches->size() : 0;
+
+    for (int attempt = 0; attempt < SCAN_SNAPSHOT_RETRIES; attempt++) {
+        uint32_t sequence = beginRegionRead(region);
+        uint64_t n = scanLimit(region, count, countOffset);
+
+        int64_t result = scanCells(region + offset, n, predicate, matches);
+        if (result < 0 || endRegionRead(region, sequence)) {
+            return result;
+        }
+
+        // An update was applied while scanning; throw the results away and retry
+        if (matches) {
+            matches->resize(mark);
+        }
+    }
+
+    return scanChunks(region, offset, count, countOffset, predicate, matches);
+}
+
+int64_t scanRegionCells(const char* memoryName, size_t offset, uint64_t count,
+                        const ScanPredicate& predicate, std::vector<uint64_t>* matches) {
+    return scanSnapshot(memoryName, offset, count, 0, predicate, matches);
+}
+
+int64_t scanRecordColumn(const char* memoryName, const char* columnName,
+                         const ScanPredicate& predicate, std::vector<uint64_t>* matches) {
+    RecordTableHeader* table = openRecordTable(getSharedMemory(memoryName));
+    if (!table) {
+        std::cerr << "[SCAN] No record table in " << memoryName << std::endl;
+        return -1;
+    }
+
+    int column = findRecordColumn(table, columnName);
+    if (column < 0) {
+        std::cerr << "[SCAN] Unknown column " << columnName << " in " << memoryName << std::endl;
+        return -1;
+    }
+    if (table->columns[column].type != static_cast<uint32_t>(predicate.type)) {
+        std::cerr << "[SCAN] Predicate type does not match column " << columnName << std::endl;
+        return -1;
+    }
+
+    size_t countOffset = recordTableHeaderOffset(table) + offsetof(RecordTableHeader, recordCount);
+    return scanSnapshot(memoryName, static_cast<size_t>(table->columns[column].dataOffset),
+                        table->capacity, countOffset, predicate, matches);
+}
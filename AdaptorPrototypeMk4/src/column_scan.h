@@ -0,0 +1,136 @@
+#ifndef COLUMN_SCAN_H
+#define COLUMN_SCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "record_table.h"
+
+/**
+ * @brief Vectorised predicate scans over typed columns in replicated regions
+ *
+ * A scan evaluates one predicate over a contiguous array of numeric cells
+ * (a record table column, or any typed array in a region) and returns either
+ * the number of matching elements or their indices. The kernels use AVX2
+ * when the processor and OS support it and a scalar loop otherwise; the
+ * choice is made once at run time.
+ *
+ * The region-level functions read under the region's write sequence
+ * (see beginRegionRead), so results always describe a state between two
+ * applied updates, without copying the region out first. If updates keep
+ * landing during a scan, it falls back to snapshots of 4096-cell chunks:
+ * each chunk is then consistent, but different chunks may straddle updates.
+ */
+
+/**
+ * @brief Predicate operators
+ */
+typedef enum {
+    SCAN_EQUAL,         // cell == operand
+    SCAN_NOT_EQUAL,     // cell != operand
+    SCAN_RANGE,         // operand <= cell <= operand2
+    SCAN_MASK_ANY,      // (cell & operand) != 0 (integer columns only)
+    SCAN_MASK_ALL       // (cell & operand) == operand (integer columns only)
+} ScanOp;
+
+/**
+ * @brief A predicate over cells of one column type
+ *
+ * Operands are stored as raw cell bytes; use the scanEqual/scanRange/...
+ * helpers below to build predicates from typed values.
+ */
+struct ScanPredicate {
+    ScanOp op;                      // Operator
+    ColumnType type;                // Type of the scanned cells
+    unsigned char operand[8];       // Value, lower bound or mask
+    unsigned char operand2[8];      // Upper bound (SCAN_RANGE only)
+};
+
+/**
+ * @brief Build a predicate with typed operands
+ */
+template <typename T>
+ScanPredicate makeScanPredicate(ScanOp op, T operand, T operand2) {
+    ScanPredicate predicate;
+    memset(&predicate, 0, sizeof(predicate));
+    predicate.op = op;
+    predicate.type = static_cast<ColumnType>(ColumnTypeOf<T>::value);
+    memcpy(predicate.operand, &operand, sizeof(T));
+    memcpy(predicate.operand2, &operand2, sizeof(T));
+    return predicate;
+}
+
+template <typename T>
+ScanPredicate scanEqual(T value) { return makeScanPredicate<T>(SCAN_EQUAL, value, value); }
+
+template <typename T>
+ScanPredicate scanNotEqual(T value) { return makeScanPredicate<T>(SCAN_NOT_EQUAL, value, value); }
+
+template <typename T>
+ScanPredicate scanRange(T low, T high) { return makeScanPredicate<T>(SCAN_RANGE, low, high); }
+
+template <typename T>
+ScanPredicate scanMaskAny(T mask) { return makeScanPredicate<T>(SCAN_MASK_ANY, mask, mask); }
+
+template <typename T>
+ScanPredicate scanMaskAll(T mask) { return makeScanPredicate<T>(SCAN_MASK_ALL, mask, mask); }
+
+/**
+ * @brief Scan an array of cells in local memory
+ *
+ * No locking is done; the caller must keep the cells stable.
+ *
+ * @param cells Pointer to the first cell
+ * @param count Number of cells
+ * @param predicate The predicate (its type gives the cell type)
+ * @param matches If not NULL, indices of matching cells are appended
+ * @return Number of matching cells, or -1 if the predicate is invalid
+ */
+int64_t scanCells(const void* cells, uint64_t count, const ScanPredicate& predicate,
+                  std::vector<uint64_t>* matches);
+
+/**
+ * @brief Scan a typed array inside a shared memory region under its write sequence
+ *
+ * @param memoryName Name of the shared memory region
+ * @param offset Region offset of the first cell
+ * @param count Number of cells
+ * @param predicate The predicate (its type gives the cell type)
+ * @param matches If not NULL, indices of matching cells are appended
+ * @return Number of matching cells, or -1 on error
+ */
+int64_t scanRegionCells(const char* memoryName, size_t offset, uint64_t count,
+                        const ScanPredicate& predicate, std::vector<uint64_t>* matches);
+
+/**
+ * @brief Scan records [0, recordCount) of a record table column under the region's write sequence
+ *
+ * The predicate type must match the column type.
+ *
+ * @param memoryName Name of the shared memory region holding the table
+ * @param columnName Name of the scanned column
+ * @param predicate The predicate
+ * @param matches If not NULL, matching record numbers are appended
+ * @return Number of matching records, or -1 on error
+ */
+int64_t scanRecordColumn(const char* memoryName, const char* columnName,
+                         const ScanPredicate& predicate, std::vector<uint64_t>* matches);
+
+/**
+ * @brief Check whether scans use the AVX2 kernels
+ *
+ * @return true if AVX2 is available and not disabled
+ */
+bool scanUsesAvx2();
+
+/**
+ * @brief Force the scalar kernels even where AVX2 is available
+ *
+ * Intended for benchmarks and tests that compare the two paths.
+ *
+ * @param scalarOnly true to use the scalar kernels only
+ */
+void setScanScalarOnly(bool scalarOnly);
+
+#endif // COLUMN_SCAN_H
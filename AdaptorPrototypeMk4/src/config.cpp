@@ -5,7 +5,10 @@
 #include <algorithm>
 
 Config::Config()
-    : localIp("127.0.0.1"), localPort(8080), instanceId(1) {
+    : localIp("127.0.0.1"), localPort(8080), instanceId(1), journalSizeMb(64), checkpointIntervalS(60),
+      regionPrefault("none"), versionHistoryKb(0), lazyRegionMb(0), threadPlacement("none"), networkNumaNode(-1),
+      regionChecksums(false), sharedRegionSize(0), leaseDurationMs(10000), leaseMigrationWrites(32),
+      sharedCountersOffset(0), sharedCounterCount(0) {
     // Default configuration
 }
 
@@ -19,8 +22,10 @@ bool Config::loadFromFile(const std::string& filePath) {
 
     std::cout << "[CONFIG] Loading configuration from " << filePath << std::endl;
 
-    // Clear any existing remote nodes
+    // Clear any existing remote nodes and keys
     remoteNodes.clear();
+    peerKeys.clear();
+    leaseRanges.clear();
 
     // Parse the file line by line
     std::string line;
@@ -105,6 +110,153 @@ bool Config::parseLine(const std::string& line) {
 
         // Add the remote node
         remoteNodes.push_back(RemoteNode(ip, port, id));
+    } else if (key == "region_dir") {
+        regionDir = value;
+    } else if (key == "region_prefault") {
+        if (value != "none" && value != "async" && value != "sync" && value != "locked") {
+            std::cerr << "[CONFIG] Invalid region_prefault value: " << value << std::endl;
+            return false;
+        }
+        regionPrefault = value;
+    } else if (key == "version_history_kb") {
+        // VS2010 compatible conversion (no std::stoi)
+        std::istringstream ss(value);
+        if (!(ss >> versionHistoryKb) || !ss.eof() || versionHistoryKb < 0) {
+            std::cerr << "[CONFIG] Invalid version_history_kb value: " << value << std::endl;
+            return false;
+        }
+    } else if (key == "lazy_region_mb") {
+        // VS2010 compatible conversion (no std::stoi)
+        std::istringstream ss(value);
+        if (!(ss >> lazyRegionMb) || !ss.eof() || lazyRegionMb < 0) {
+            std::cerr << "[CONFIG] Invalid lazy_region_mb value: " << value << std::endl;
+            return false;
+        }
+    } else if (key == "bootstrap_snapshot") {
+        bootstrapSnapshot = value;
+    } else if (key == "thread_placement") {
+        if (value != "none" && value != "numa") {
+            std::cerr << "[CONFIG] Invalid thread_placement value: " << value << std::endl;
+            return false;
+        }
+        threadPlacement = value;
+    } else if (key == "network_numa_node") {
+        // VS2010 compatible conversion (no std::stoi)
+        std::istringstream ss(value);
+        if (!(ss >> networkNumaNode) || !ss.eof() || networkNumaNode < -1) {
+            std::cerr << "[CONFIG] Invalid network_numa_node value: " << value << std::endl;
+            return false;
+        }
+    } else if (key == "region_checksums") {
+        if (value != "true" && value != "false") {
+            std::cerr << "[CONFIG] Invalid region_checksums value: " << value << std::endl;
+            return false;
+        }
+        regionChecksums = (value == "true");
+    } else if (key == "peer_key") {
+        // Parse peer key (format: IP:port:hex key)
+        std::istringstream iss(value);
+        std::string ip;
+        std::string portStr;
+        std::string hexKey;
+        if (!std::getline(iss, ip, ':') || !std::getline(iss, portStr, ':') || !std::getline(iss, hexKey)) {
+            std::cerr << "[CONFIG] Invalid peer_key format (expected <ip>:<port>:<hex key>)" << std::endl;
+            return false;
+        }
+
+        // The key itself is not echoed to the log
+        int port;
+        std::istringstream portSS(portStr);
+        if (!(portSS >> port) || !portSS.eof()) {
+            std::cerr << "[CONFIG] Invalid peer_key port for " << ip << std::endl;
+            return false;
+        }
+        if ((hexKey.size() != 32 && hexKey.size() != 64) ||
+            hexKey.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+            std::cerr << "[CONFIG] Invalid peer_key for " << ip << ":" << port
+                      << " (expected 32 or 64 hex digits)" << std::endl;
+            return false;
+        }
+
+        peerKeys.push_back(PeerKey(ip, port, hexKey));
+    } else if (key == "shared_region") {
+        // Parse shared region (format: name:data_bytes)
+        size_t colonPos = value.rfind(':');
+        size_t size = 0;
+        std::istringstream sizeSS(colonPos != std::string::npos ? value.substr(colonPos + 1) : "");
+        if (colonPos == 0 || colonPos == std::string::npos || !(sizeSS >> size) || !sizeSS.eof() || size == 0) {
+            std::cerr << "[CONFIG] Invalid shared_region format: " << value << std::endl;
+            return false;
+        }
+        sharedRegion = value.substr(0, colonPos);
+        sharedRegionSize = size;
+    } else if (key == "lease_range") {
+        // Parse lease range (format: offset:size)
+        std::istringstream iss(value);
+        std::string offsetStr;
+        std::string sizeStr;
+        if (!std::getline(iss, offsetStr, ':') || !std::getline(iss, sizeStr)) {
+            std::cerr << "[CONFIG] Invalid lease_range format: " << value << std::endl;
+            return false;
+        }
+
+        // Convert offset and size to integers (VS2010 compatible)
+        size_t offset, size;
+        std::istringstream offsetSS(offsetStr);
+        std::istringstream sizeSS(sizeStr);
+        if (!(offsetSS >> offset) || !offsetSS.eof() || !(sizeSS >> size) || !sizeSS.eof() || size == 0) {
+            std::cerr << "[CONFIG] Invalid lease_range offset or size: " << value << std::endl;
+            return false;
+        }
+        leaseRanges.push_back(LeaseRange(offset, size));
+    } else if (key == "lease_duration_ms") {
+        // VS2010 compatible conversion (no std::stoi)
+        std::istringstream ss(value);
+        if (!(ss >> leaseDurationMs) || !ss.eof() || leaseDurationMs <= 0) {
+            std::cerr << "[CONFIG] Invalid lease_duration_ms value: " << value << std::endl;
+            return false;
+        }
+    } else if (key == "lease_migration_writes") {
+        // VS2010 compatible conversion (no std::stoi)
+        std::istringstream ss(value);
+        if (!(ss >> leaseMigrationWrites) || !ss.eof() || leaseMigrationWrites < 0) {
+            std::cerr << "[CONFIG] Invalid lease_migration_writes value: " << value << std::endl;
+            return false;
+        }
+    } else if (key == "shared_counters") {
+        // Parse shared counters (format: offset:count)
+        std::istringstream iss(value);
+        std::string offsetStr;
+        std::string countStr;
+        if (!std::getline(iss, offsetStr, ':') || !std::getline(iss, countStr)) {
+            std::cerr << "[CONFIG] Invalid shared_counters format: " << value << std::endl;
+            return false;
+        }
+
+        // Convert offset and count to integers (VS2010 compatible)
+        std::istringstream offsetSS(offsetStr);
+        std::istringstream countSS(countStr);
+        if (!(offsetSS >> sharedCountersOffset) || !offsetSS.eof() ||
+            !(countSS >> sharedCounterCount) || !countSS.eof() || sharedCounterCount <= 0) {
+            std::cerr << "[CONFIG] Invalid shared_counters offset or count: " << value << std::endl;
+            return false;
+        }
+    } else if (key == "journal_dir") {
+        journalDir = value;
+    } else if (key == "journal_size_mb") {
+        // VS2010 compatible conversion (no std::stoi)
+        std::istringstream ss(value);
+        if (!(ss >> journalSizeMb) || !ss.eof() || journalSizeMb <= 0) {
+            std::cerr << "[CONFIG] Invalid journal_size_mb value: " << value << std::endl;
+            return false;
+        }
+    } else if (key == "checkpoint_interval_s") {
+        // VS2010 compatible conversion (no std::stoi)
+        std::istringstream ss(value);
+        if (!(ss >> checkpointIntervalS) || !ss.eof() || checkpointIntervalS < 0) {
+            std::cerr << "[CONFIG] Invalid checkpoint_interval_s value: " << value << std::endl;
+            return false;
+        }
     } else {
         std::cerr << "[CONFIG] Unknown configuration key: " << key << std::endl;
         return false;
@@ -136,6 +288,60 @@ std::string Config::toString() const {
         oss << "    " << it->ip << ":" << it->port << ":" << it->instanceId << std::endl;
     }
 
+    if (!regionDir.empty()) {
+        oss << "  Region Files: " << regionDir << std::endl;
+    }
+
+    if (regionPrefault != "none") {
+        oss << "  Region Prefault: " << regionPrefault << std::endl;
+    }
+
+    if (versionHistoryKb > 0) {
+        oss << "  Version History: " << versionHistoryKb << " KB per replicated region" << std::endl;
+    }
+
+    if (lazyRegionMb > 0) {
+        oss << "  Lazy Replication: " << lazyRegionMb << " MB reserved per remote region" << std::endl;
+    }
+
+    if (!bootstrapSnapshot.empty()) {
+        oss << "  Bootstrap Snapshot: " << bootstrapSnapshot << std::endl;
+    }
+
+    if (threadPlacement != "none") {
+        oss << "  Thread Placement: " << threadPlacement;
+        if (networkNumaNode >= 0) {
+            oss << " (receive thread on node " << networkNumaNode << ")";
+        }
+        oss << std::endl;
+    }
+
+    if (regionChecksums) {
+        oss << "  Region Checksums: enabled" << std::endl;
+    }
+
+    if (!peerKeys.empty()) {
+        oss << "  Encrypted Peers: " << peerKeys.size() << std::endl;
+    }
+
+    if (!sharedRegion.empty()) {
+        oss << "  Shared Region: " << sharedRegion << " (" << sharedRegionSize << " bytes, "
+            << leaseRanges.size() << " leased ranges, " << leaseDurationMs << " ms leases, ";
+        if (leaseMigrationWrites > 0) {
+            oss << "moved after " << leaseMigrationWrites << " writes/s)" << std::endl;
+        } else {
+            oss << "never moved)" << std::endl;
+        }
+        if (sharedCounterCount > 0) {
+            oss << "  Shared Counters: " << sharedCounterCount << " at byte " << sharedCountersOffset << std::endl;
+        }
+    }
+
+    if (!journalDir.empty()) {
+        oss << "  Journal: " << journalDir << " (" << journalSizeMb << " MB, checkpoint every "
+            << checkpointIntervalS << " s)" << std::endl;
+    }
+
     return oss.str();
 }
 
@@ -3,7 +3,6 @@
 
 #include <string>
 #include <vector>
-#include <unordered_map>
 
 /**
  * @brief Configuration class for shared memory sync application
@@ -26,6 +25,29 @@ public:
             : ip(_ip), port(_port), instanceId(_instanceId) {}
     };
 
+    /**
+     * @brief Structure to represent a range of the shared region this node leases
+     */
+    struct LeaseRange {
+        size_t offset;      // Offset within the shared region's data
+        size_t size;
+
+        LeaseRange(size_t _offset, size_t _size)
+            : offset(_offset), size(_size) {}
+    };
+
+    /**
+     * @brief Structure to represent the key shared with a remote node
+     */
+    struct PeerKey {
+        std::string ip;
+        int port;
+        std::string key;    // 32 or 64 hex digits
+
+        PeerKey(const std::string& _ip, int _port, const std::string& _key)
+            : ip(_ip), port(_port), key(_key) {}
+    };
+
     /**
      * @brief Default constructor
      *
@@ -69,6 +91,139 @@ public:
      */
     const std::vector<RemoteNode>& getRemoteNodes() const { return remoteNodes; }
 
+    /**
+     * @brief Get the update journal directory
+     *
+     * @return Journal directory, empty if journaling is disabled
+     */
+    std::string getJournalDir() const { return journalDir; }
+
+    /**
+     * @brief Get the size of each region's journal file
+     *
+     * @return Journal size in megabytes
+     */
+    int getJournalSizeMb() const { return journalSizeMb; }
+
+    /**
+     * @brief Get the interval between checkpoints of changing regions
+     *
+     * @return Checkpoint interval in seconds (0 = only when a journal fills up)
+     */
+    int getCheckpointIntervalS() const { return checkpointIntervalS; }
+
+    /**
+     * @brief Get the directory of file-backed regions
+     *
+     * @return Region directory, empty if regions are backed by the paging file
+     */
+    std::string getRegionDir() const { return regionDir; }
+
+    /**
+     * @brief Get how region pages are brought into memory at startup
+     *
+     * @return "none", "async", "sync" or "locked"
+     */
+    std::string getRegionPrefault() const { return regionPrefault; }
+
+    /**
+     * @brief Get the size of the version history kept for each replicated region
+     *
+     * @return History size in kilobytes (0 = no history)
+     */
+    int getVersionHistoryKb() const { return versionHistoryKb; }
+
+    /**
+     * @brief Get the size reserved for each lazy copy of a remote region
+     *
+     * @return Size in megabytes (0 = remote regions are replicated in full)
+     */
+    int getLazyRegionMb() const { return lazyRegionMb; }
+
+    /**
+     * @brief Get the snapshot file new replicas are seeded from
+     *
+     * @return Path of the snapshot file, empty to fill replicas over the network only
+     */
+    std::string getBootstrapSnapshot() const { return bootstrapSnapshot; }
+
+    /**
+     * @brief Get how the receive, sync and notifier threads are placed
+     *
+     * @return "none" or "numa"
+     */
+    std::string getThreadPlacement() const { return threadPlacement; }
+
+    /**
+     * @brief Get the NUMA node the receive thread runs on
+     *
+     * @return Node number, or -1 to follow the replicated regions
+     */
+    int getNetworkNumaNode() const { return networkNumaNode; }
+
+    /**
+     * @brief Check whether owners send region checksums and copies are checked against them
+     *
+     * @return true if region checksums are enabled
+     */
+    bool getRegionChecksums() const { return regionChecksums; }
+
+    /**
+     * @brief Get the keys shared with remote nodes
+     *
+     * @return Vector of peer keys, empty if sync traffic is not encrypted
+     */
+    const std::vector<PeerKey>& getPeerKeys() const { return peerKeys; }
+
+    /**
+     * @brief Get the name of the multi-writer region shared by all nodes
+     *
+     * @return Region name, empty if there is no shared region
+     */
+    std::string getSharedRegion() const { return sharedRegion; }
+
+    /**
+     * @brief Get the size of the shared region's data
+     *
+     * @return Size in bytes, not counting the header and lease table
+     */
+    size_t getSharedRegionSize() const { return sharedRegionSize; }
+
+    /**
+     * @brief Get the ranges of the shared region this node leases at startup
+     *
+     * @return Vector of ranges
+     */
+    const std::vector<LeaseRange>& getLeaseRanges() const { return leaseRanges; }
+
+    /**
+     * @brief Get how long a lease lasts between renewals
+     *
+     * @return Lease duration in milliseconds
+     */
+    int getLeaseDurationMs() const { return leaseDurationMs; }
+
+    /**
+     * @brief Get how many writes a remote instance must make to a lease in a second before it moves there
+     *
+     * @return Writes per second; 0 if leases never move
+     */
+    int getLeaseMigrationWrites() const { return leaseMigrationWrites; }
+
+    /**
+     * @brief Get where the shared region's counters start
+     *
+     * @return Offset within the shared region's data
+     */
+    size_t getSharedCountersOffset() const { return sharedCountersOffset; }
+
+    /**
+     * @brief Get how many counters the shared region holds
+     *
+     * @return Number of CrdtPNCounter fields; 0 for none
+     */
+    int getSharedCounterCount() const { return sharedCounterCount; }
+
     /**
      * @brief Check if the configuration is valid
      *
@@ -92,6 +247,41 @@ private:
     // Remote nodes configuration
     std::vector<RemoteNode> remoteNodes;
 
+    // Update journal configuration
+    std::string journalDir;
+    int journalSizeMb;
+    int checkpointIntervalS;
+
+    // Persistent region configuration
+    std::string regionDir;
+    std::string regionPrefault;
+
+    // Version history configuration
+    int versionHistoryKb;
+    int lazyRegionMb;
+
+    // Snapshot file replicas are seeded from
+    std::string bootstrapSnapshot;
+
+    // Thread placement configuration
+    std::string threadPlacement;
+    int networkNumaNode;
+
+    // Integrity check configuration
+    bool regionChecksums;
+
+    // Sync encryption configuration
+    std::vector<PeerKey> peerKeys;
+
+    // Multi-writer region configuration
+    std::string sharedRegion;
+    size_t sharedRegionSize;
+    std::vector<LeaseRange> leaseRanges;
+    int leaseDurationMs;
+    int leaseMigrationWrites;
+    size_t sharedCountersOffset;
+    int sharedCounterCount;
+
     // Helper function to parse a line from the config file
     bool parseLine(const std::string& line);
 
@@ -0,0 +1,352 @@
+/**
+ * @file crc32c.cpp
+ * @brief Implementation of CRC-32C
+ *
+ * Both paths work on the raw CRC register (the CRC before its final XOR).
+ *
+ * The CRC32 instruction has a latency of three cycles but can start one
+ * every cycle, so a single dependent chain uses a third of its throughput.
+ * Long inputs are therefore cut into three consecutive streams that are
+ * checksummed side by side, and the first two registers are then moved past
+ * the bytes that follow them with a table lookup ("shift tables") and XORed
+ * in. This is the layout of Mark Adler's crc32c.c.
+ *
+ * Shifting a register past n zero bytes is a multiplication by x^(8n)
+ * modulo the polynomial. For the two fixed stream lengths this is done with
+ * four table lookups. For other lengths (combine, range update) x^(8n) is
+ * built from the powers x^(2^k) with one multiplication per set bit of n.
+ * With PCLMULQDQ a multiplication is one carry-less multiply reduced by a
+ * CRC32 instruction; otherwise it is done bit by bit in software.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "crc32c.h"
+#include <string.h>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#define CRC_HAVE_X64 1
+#define CRC_SSE42_TARGET
+#define CRC_CLMUL_TARGET
+#elif defined(__GNUC__) && defined(__x86_64__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#define CRC_HAVE_X64 1
+#define CRC_SSE42_TARGET __attribute__((target("sse4.2")))
+#define CRC_CLMUL_TARGET __attribute__((target("sse4.2,pclmul")))
+#endif
+
+/// Reflected CRC-32C polynomial
+#define CRC32C_POLY 0x82F63B78u
+
+/// Bytes per stream for inputs of at least three times this
+#define CRC_LONG 8192
+
+/// Bytes per stream for the rest of the input above three times this
+#define CRC_SHORT 256
+
+/**
+ * @brief Lookup tables, built before main runs
+ */
+struct Crc32cTables {
+    uint32_t bytes[8][256];     // bytes[k][n]: register for byte n followed by k zero bytes
+    uint32_t longShift[4][256]; // Register moved past CRC_LONG zero bytes, one table per register byte
+    uint32_t shortShift[4][256];// Register moved past CRC_SHORT zero bytes
+    uint32_t powers[32];        // x^(2^k) modulo the polynomial
+
+    Crc32cTables();
+};
+
+static uint32_t softwareMultiply(uint32_t a, uint32_t b);
+static void buildShiftTable(const Crc32cTables& tables, size_t zeros, uint32_t shift[4][256]);
+
+Crc32cTables::Crc32cTables() {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        bytes[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = bytes[0][n];
+        for (int k = 1; k < 8; k++) {
+            crc = bytes[0][crc & 0xFF] ^ (crc >> 8);
+            bytes[k][n] = crc;
+        }
+    }
+
+    // In the reflected representation the top bit is x^0, so x^1 is bit 30
+    powers[0] = 1u << 30;
+    for (int k = 1; k < 32; k++) {
+        powers[k] = softwareMultiply(powers[k - 1], powers[k - 1]);
+    }
+
+    buildShiftTable(*this, CRC_LONG, longShift);
+    buildShiftTable(*this, CRC_SHORT, shortShift);
+}
+
+static const Crc32cTables g_crcTables;
+
+/// Implementation selection: -1 = not probed yet, 0 = tables, 1 = SSE4.2, 2 = SSE4.2 and PCLMULQDQ
+static volatile LONG g_crcHardware = -1;
+
+/// Set by setCrc32cSoftwareOnly
+static volatile LONG g_crcSoftwareOnly = 0;
+
+/**
+ * @brief Multiply two polynomials modulo the CRC polynomial, bit by bit
+ */
+static uint32_t softwareMultiply(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31;
+    uint32_t product = 0;
+    for (;;) {
+        if (a & m) {
+            product ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+#if defined(CRC_HAVE_X64)
+/**
+ * @brief Multiply two polynomials modulo the CRC polynomial with PCLMULQDQ
+ *
+ * The 63-bit product, shifted up one bit to line up with the reflected
+ * representation, is reduced by running its low half through the CRC32
+ * instruction, which multiplies by x^32 modulo the polynomial.
+ */
+CRC_CLMUL_TARGET static uint32_t clmulMultiply(uint32_t a, uint32_t b) {
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(a)),
+                                           _mm_cvtsi32_si128(static_cast<int>(b)), 0);
+    uint64_t wide = static_cast<uint64_t>(_mm_cvtsi128_si64(product)) << 1;
+    return _mm_crc32_u32(0, static_cast<uint32_t>(wide)) ^ static_cast<uint32_t>(wide >> 32);
+}
+#endif // CRC_HAVE_X64
+
+static bool crc32cUsesClmul();
+
+/**
+ * @brief Multiply two polynomials modulo the CRC polynomial (reflected representation)
+ */
+static uint32_t multiplyModPoly(uint32_t a, uint32_t b) {
+#if defined(CRC_HAVE_X64)
+    if (crc32cUsesClmul()) {
+        return clmulMultiply(a, b);
+    }
+#endif
+    return softwareMultiply(a, b);
+}
+
+/**
+ * @brief x^(8 * zeros) modulo the CRC polynomial
+ */
+static uint32_t zerosOperator(size_t zeros) {
+    uint32_t result = 1u << 31;
+    int k = 3;
+    while (zeros != 0) {
+        if (zeros & 1) {
+            result = multiplyModPoly(g_crcTables.powers[k & 31], result);
+        }
+        zeros >>= 1;
+        k++;
+    }
+    return result;
+}
+
+/**
+ * @brief Build the table that moves a register past a fixed number of zero bytes
+ *
+ * Moving the register is linear, so the result for each of its bits is
+ * worked out once and the table entries are XORs of those.
+ */
+static void buildShiftTable(const Crc32cTables& tables, size_t zeros, uint32_t shift[4][256]) {
+    uint32_t bitResults[32];
+    for (int bit = 0; bit < 32; bit++) {
+        uint32_t crc = 1u << bit;
+        for (size_t i = 0; i < zeros; i++) {
+            crc = tables.bytes[0][crc & 0xFF] ^ (crc >> 8);
+        }
+        bitResults[bit] = crc;
+    }
+    for (int k = 0; k < 4; k++) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t crc = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                if (n & (1u << bit)) {
+                    crc ^= bitResults[8 * k + bit];
+                }
+            }
+            shift[k][n] = crc;
+        }
+    }
+}
+
+static uint32_t shiftRegister(const uint32_t shift[4][256], uint32_t crc) {
+    return shift[0][crc & 0xFF] ^ shift[1][(crc >> 8) & 0xFF] ^
+           shift[2][(crc >> 16) & 0xFF] ^ shift[3][crc >> 24];
+}
+
+/**
+ * @brief Slicing-by-8: one 64-bit load and eight lookups per eight bytes
+ */
+static uint32_t softwareRegister(uint32_t crc, const unsigned char* data, size_t size) {
+    const uint32_t (*table)[256] = g_crcTables.bytes;
+    while (size > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+        crc = table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        size--;
+    }
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        word ^= crc;
+        crc = table[7][word & 0xFF] ^ table[6][(word >> 8) & 0xFF] ^
+              table[5][(word >> 16) & 0xFF] ^ table[4][(word >> 24) & 0xFF] ^
+              table[3][(word >> 32) & 0xFF] ^ table[2][(word >> 40) & 0xFF] ^
+              table[1][(word >> 48) & 0xFF] ^ table[0][word >> 56];
+        data += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc = table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        size--;
+    }
+    return crc;
+}
+
+#if defined(CRC_HAVE_X64)
+static uint64_t load64(const unsigned char* data) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+/**
+ * @brief Checksum three consecutive streams of streamSize bytes side by side
+ */
+CRC_SSE42_TARGET static uint64_t hardwareThreeStreams(uint64_t crc0, const unsigned char*& data,
+                                                      size_t streamSize, const uint32_t shift[4][256]) {
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    const unsigned char* end = data + streamSize;
+    do {
+        crc0 = _mm_crc32_u64(crc0, load64(data));
+        crc1 = _mm_crc32_u64(crc1, load64(data + streamSize));
+        crc2 = _mm_crc32_u64(crc2, load64(data + 2 * streamSize));
+        data += 8;
+    } while (data < end);
+    crc0 = shiftRegister(shift, static_cast<uint32_t>(crc0)) ^ crc1;
+    crc0 = shiftRegister(shift, static_cast<uint32_t>(crc0)) ^ crc2;
+    data += 2 * streamSize;
+    return crc0;
+}
+
+CRC_SSE42_TARGET static uint32_t hardwareRegister(uint32_t crc, const unsigned char* data, size_t size) {
+    uint64_t crc0 = crc;
+    while (size > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *data++);
+        size--;
+    }
+    while (size >= 3 * CRC_LONG) {
+        crc0 = hardwareThreeStreams(crc0, data, CRC_LONG, g_crcTables.longShift);
+        size -= 3 * CRC_LONG;
+    }
+    while (size >= 3 * CRC_SHORT) {
+        crc0 = hardwareThreeStreams(crc0, data, CRC_SHORT, g_crcTables.shortShift);
+        size -= 3 * CRC_SHORT;
+    }
+    while (size >= 8) {
+        crc0 = _mm_crc32_u64(crc0, load64(data));
+        data += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *data++);
+        size--;
+    }
+    return static_cast<uint32_t>(crc0);
+}
+#endif // CRC_HAVE_X64
+
+/**
+ * @brief Check the processor for SSE4.2 and PCLMULQDQ
+ *
+ * @return 0 for neither, 1 for SSE4.2, 2 for both
+ */
+static LONG detectCrcInstructions() {
+#if defined(CRC_HAVE_X64)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    unsigned int ecx = static_cast<unsigned int>(info[2]);
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+#endif
+    if (!(ecx & (1u << 20))) {
+        return 0;
+    }
+    return (ecx & (1u << 1)) ? 2 : 1;
+#else
+    return 0;
+#endif
+}
+
+bool crc32cUsesHardware() {
+    if (g_crcHardware < 0) {
+        InterlockedExchange(&g_crcHardware, detectCrcInstructions());
+    }
+    return g_crcHardware >= 1 && g_crcSoftwareOnly == 0;
+}
+
+static bool crc32cUsesClmul() {
+    return crc32cUsesHardware() && g_crcHardware == 2;
+}
+
+void setCrc32cSoftwareOnly(bool softwareOnly) {
+    InterlockedExchange(&g_crcSoftwareOnly, softwareOnly ? 1 : 0);
+}
+
+/**
+ * @brief Run the CRC register over a buffer
+ */
+static uint32_t crcRegister(uint32_t crc, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+#if defined(CRC_HAVE_X64)
+    if (crc32cUsesHardware()) {
+        return hardwareRegister(crc, bytes, size);
+    }
+#endif
+    return softwareRegister(crc, bytes, size);
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+    return ~crcRegister(~crc, data, size);
+}
+
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, size_t sizeB) {
+    return multiplyModPoly(zerosOperator(sizeB), crcA) ^ crcB;
+}
+
+uint32_t crc32cUpdateRange(uint32_t crc, size_t size, size_t offset,
+                           const void* oldData, const void* newData, size_t rangeSize) {
+    if (rangeSize == 0) {
+        return crc;
+    }
+    // With a zero register, leading zero bytes don't change the CRC, so the
+    // change is the CRC of the XOR of the old and new bytes moved past the tail
+    uint32_t difference = crcRegister(0, oldData, rangeSize) ^ crcRegister(0, newData, rangeSize);
+    return crc ^ multiplyModPoly(zerosOperator(size - offset - rangeSize), difference);
+}
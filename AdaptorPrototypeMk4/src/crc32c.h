@@ -0,0 +1,76 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief CRC-32C (Castagnoli) checksums
+ *
+ * The CRC used by iSCSI, ext4 and SCTP: reflected polynomial 0x82F63B78,
+ * initial value and final XOR 0xFFFFFFFF. The CRC of "123456789" is
+ * 0xE3069283.
+ *
+ * On x86 processors with SSE4.2 the CRC32 instruction is used, over three
+ * interleaved streams for long inputs so its latency is hidden. Elsewhere a
+ * slicing-by-8 table loop is used. The choice is made once at run time.
+ *
+ * Because a CRC is linear, the CRC of a buffer can be combined with another
+ * (crc32cCombine) or brought up to date after part of the buffer changes
+ * (crc32cUpdateRange) without reading the rest of the buffer again. These
+ * use PCLMULQDQ carry-less multiplies where the processor has them.
+ */
+
+/**
+ * @brief Compute or continue a CRC-32C
+ *
+ * @param crc 0 to start, or the CRC of the preceding bytes to continue it
+ * @param data Bytes to checksum
+ * @param size Number of bytes
+ * @return The CRC of the preceding bytes followed by data
+ */
+uint32_t crc32c(uint32_t crc, const void* data, size_t size);
+
+/**
+ * @brief CRC of two buffers laid end to end, from their separate CRCs
+ *
+ * @param crcA CRC of the first buffer
+ * @param crcB CRC of the second buffer
+ * @param sizeB Size of the second buffer in bytes
+ * @return The CRC of the first buffer followed by the second
+ */
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, size_t sizeB);
+
+/**
+ * @brief Bring a buffer's CRC up to date after a range of it was overwritten
+ *
+ * Reads only the old and new contents of the range.
+ *
+ * @param crc CRC of the buffer before the change
+ * @param size Size of the whole buffer in bytes
+ * @param offset Offset of the changed range within the buffer
+ * @param oldData Contents of the range before the change
+ * @param newData Contents of the range after the change
+ * @param rangeSize Size of the changed range in bytes
+ * @return The CRC of the buffer after the change
+ */
+uint32_t crc32cUpdateRange(uint32_t crc, size_t size, size_t offset,
+                           const void* oldData, const void* newData, size_t rangeSize);
+
+/**
+ * @brief Check whether CRCs are computed with the SSE4.2 CRC32 instruction
+ *
+ * @return true if the instruction is available and not disabled
+ */
+bool crc32cUsesHardware();
+
+/**
+ * @brief Force the table-driven code even where SSE4.2 and PCLMULQDQ are available
+ *
+ * Intended for benchmarks and tests that compare the two paths.
+ *
+ * @param softwareOnly true to use the table-driven code only
+ */
+void setCrc32cSoftwareOnly(bool softwareOnly);
+
+#endif // CRC32C_H
@@ -0,0 +1,389 @@
+/**
+ * @file crdt_field.cpp
+ * @brief Implementation of CRDT counters and registers
+ *
+ * A region's fields are kept sorted by offset. The merger registered for
+ * the region applies each update that touches a field: plain bytes are
+ * copied, counter slots are raised with a compare-and-swap so a local add
+ * running at the same time is never lost, and registers are replaced only
+ * by a later stamp. Registers are written, locally or by the merger, under
+ * g_crdtMutex so two writes never interleave.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "crdt_field.h"
+#include "shared_memory.h"
+#include "change_tracking.h"
+#include "memory_layout.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <string.h>
+#include <vector>
+
+/**
+ * @brief A registered field, and what this node last queued of its own slots
+ */
+struct CrdtField {
+    size_t offset;
+    CrdtFieldType type;
+    uint64_t published[2];
+};
+
+/// Fields by region, sorted by offset
+static std::map<std::string, std::vector<CrdtField> > g_crdtFields;
+
+/// Mutex protecting g_crdtFields and serializing register writes
+static HANDLE g_crdtMutex = NULL;
+
+/// Latest hybrid logical clock stamp made or applied here
+static volatile LONG64 g_hlc = 0;
+
+static void lockCrdtMutex() {
+    if (g_crdtMutex == NULL) {
+        g_crdtMutex = CreateMutex(NULL, FALSE, NULL);
+        if (g_crdtMutex == NULL) {
+            std::cerr << "Failed to create CRDT mutex: " << GetLastError() << std::endl;
+        }
+    }
+    if (g_crdtMutex != NULL) {
+        WaitForSingleObject(g_crdtMutex, INFINITE);
+    }
+}
+
+static void unlockCrdtMutex() {
+    if (g_crdtMutex != NULL) {
+        ReleaseMutex(g_crdtMutex);
+    }
+}
+
+static size_t crdtFieldSize(CrdtFieldType type) {
+    switch (type) {
+        case CRDT_G_COUNTER:
+            return sizeof(CrdtGCounter);
+        case CRDT_PN_COUNTER:
+            return sizeof(CrdtPNCounter);
+        case CRDT_LWW_REGISTER:
+            return sizeof(CrdtRegister);
+    }
+    return 0;
+}
+
+/**
+ * @brief Region offsets of this node's slots in a counter; returns how many there are
+ */
+static int ownSlotOffsets(const CrdtField& field, size_t offsets[2]) {
+    uint32_t node = leaseNodeId();
+    if (node == 0 || field.type == CRDT_LWW_REGISTER) {
+        return 0;
+    }
+    offsets[0] = field.offset + (node - 1) * sizeof(uint64_t);
+    if (field.type == CRDT_G_COUNTER) {
+        return 1;
+    }
+    offsets[1] = offsets[0] + sizeof(CrdtGCounter);
+    return 2;
+}
+
+/**
+ * @brief Raise a counter slot to a value if it is below it
+ */
+static void mergeSlot(char* slot, uint64_t value) {
+    volatile LONG64* target = reinterpret_cast<volatile LONG64*>(slot);
+    for (;;) {
+        LONG64 current = *target;
+        if (static_cast<uint64_t>(current) >= value ||
+            InterlockedCompareExchange64(target, static_cast<LONG64>(value), current) == current) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Check whether a register write wins over another
+ */
+static bool registerWins(const CrdtRegister& a, const CrdtRegister& b) {
+    return a.stamp > b.stamp || (a.stamp == b.stamp && a.node > b.node);
+}
+
+/**
+ * @brief Merge the part of an update that falls in one field
+ *
+ * @param region Start of the region
+ * @param start Region offset of the first byte of the update in the field
+ * @param end Region offset after the last byte of the update in the field
+ * @param data The update's byte at region offset 'start'
+ */
+static void mergeField(const CrdtField& field, char* region, size_t start, size_t end, const char* data) {
+    if (field.type == CRDT_LWW_REGISTER) {
+        // Only a whole register can be compared
+        if (start != field.offset || end != field.offset + sizeof(CrdtRegister)) {
+            return;
+        }
+        CrdtRegister incoming;
+        CrdtRegister current;
+        memcpy(&incoming, data, sizeof(incoming));
+        memcpy(&current, region + field.offset, sizeof(current));
+        hlcObserve(incoming.stamp);
+        if (registerWins(incoming, current)) {
+            memcpy(region + field.offset, &incoming, sizeof(incoming));
+        }
+        return;
+    }
+
+    // Whole slots only; the slots of both halves of a PN counter follow each other
+    size_t first = field.offset + ((start - field.offset + sizeof(uint64_t) - 1) / sizeof(uint64_t)) * sizeof(uint64_t);
+    for (size_t slot = first; slot + sizeof(uint64_t) <= end; slot += sizeof(uint64_t)) {
+        uint64_t value;
+        memcpy(&value, data + (slot - start), sizeof(value));
+        mergeSlot(region + slot, value);
+    }
+}
+
+/**
+ * @brief Apply an update to a region with CRDT fields
+ *
+ * Updates that touch no field, or that touch the region header, are left
+ * to the plain copy.
+ */
+static bool mergeCrdtUpdate(const SyncMessage& message, void* target, void* context) {
+    (void)context;
+    const char* memoryName = message.memoryName;
+    size_t offset = message.offset;
+    size_t size = message.size;
+    const void* data = message.data;
+    if (offset < sizeof(MemoryLayout)) {
+        return false;
+    }
+
+    lockCrdtMutex();
+    std::map<std::string, std::vector<CrdtField> >::iterator it = g_crdtFields.find(memoryName);
+    if (it == g_crdtFields.end()) {
+        unlockCrdtMutex();
+        return false;
+    }
+    const std::vector<CrdtField>& fields = it->second;
+    size_t end = offset + size;
+    bool touchesField = false;
+    for (size_t i = 0; i < fields.size() && !touchesField; i++) {
+        touchesField = fields[i].offset < end && offset < fields[i].offset + crdtFieldSize(fields[i].type);
+    }
+    if (!touchesField) {
+        unlockCrdtMutex();
+        return false;
+    }
+
+    char* region = static_cast<char*>(target) - offset;
+    const char* bytes = static_cast<const char*>(data);
+    size_t position = offset;
+    for (size_t i = 0; i < fields.size() && position < end; i++) {
+        size_t fieldStart = fields[i].offset;
+        size_t fieldEnd = fieldStart + crdtFieldSize(fields[i].type);
+        if (fieldEnd <= position || fieldStart >= end) {
+            continue;
+        }
+        if (position < fieldStart) {
+            memcpy(region + position, bytes + (position - offset), fieldStart - position);
+            position = fieldStart;
+        }
+        size_t mergeEnd = (fieldEnd < end) ? fieldEnd : end;
+        mergeField(fields[i], region, position, mergeEnd, bytes + (position - offset));
+        position = mergeEnd;
+    }
+    if (position < end) {
+        memcpy(region + position, bytes + (position - offset), end - position);
+    }
+    unlockCrdtMutex();
+    return true;
+}
+
+bool registerCrdtField(const char* memoryName, size_t offset, CrdtFieldType type) {
+    size_t regionSize = 0;
+    char* region = static_cast<char*>(getSharedMemoryMapping(memoryName, &regionSize));
+    size_t size = crdtFieldSize(type);
+    if (!region || size == 0 || offset < sizeof(MemoryLayout) || offset % sizeof(uint64_t) != 0 ||
+        offset > regionSize || size > regionSize - offset) {
+        return false;
+    }
+
+    lockCrdtMutex();
+    std::vector<CrdtField>& fields = g_crdtFields[memoryName];
+    size_t position = 0;
+    while (position < fields.size() && fields[position].offset < offset) {
+        position++;
+    }
+    bool overlaps = (position > 0 && fields[position - 1].offset + crdtFieldSize(fields[position - 1].type) > offset) ||
+                    (position < fields.size() && fields[position].offset < offset + size);
+    if (overlaps) {
+        if (fields.empty()) {
+            g_crdtFields.erase(memoryName);
+        }
+        unlockCrdtMutex();
+        return false;
+    }
+
+    // What the slots hold already, such as after a restart, doesn't need sending
+    CrdtField field;
+    field.offset = offset;
+    field.type = type;
+    field.published[0] = 0;
+    field.published[1] = 0;
+    size_t slotOffsets[2];
+    int slots = ownSlotOffsets(field, slotOffsets);
+    for (int i = 0; i < slots; i++) {
+        memcpy(&field.published[i], region + slotOffsets[i], sizeof(uint64_t));
+    }
+    fields.insert(fields.begin() + position, field);
+    bool first = (fields.size() == 1);
+    unlockCrdtMutex();
+
+    if (first) {
+        registerApplyMerger(memoryName, mergeCrdtUpdate, NULL);
+    }
+    return true;
+}
+
+void unregisterCrdtFields(const char* memoryName) {
+    lockCrdtMutex();
+    bool found = g_crdtFields.erase(memoryName) > 0;
+    unlockCrdtMutex();
+    if (found) {
+        unregisterApplyMerger(memoryName);
+    }
+}
+
+bool crdtCounterAdd(CrdtGCounter* counter, uint64_t amount) {
+    uint32_t node = leaseNodeId();
+    if (node == 0) {
+        return false;
+    }
+    InterlockedExchangeAdd64(reinterpret_cast<volatile LONG64*>(&counter->slots[node - 1]),
+                             static_cast<LONG64>(amount));
+    return true;
+}
+
+uint64_t crdtCounterValue(const CrdtGCounter* counter) {
+    uint64_t total = 0;
+    for (int i = 0; i < MAX_LEASE_NODES; i++) {
+        total += *reinterpret_cast<const volatile uint64_t*>(&counter->slots[i]);
+    }
+    return total;
+}
+
+bool crdtPNCounterAdd(CrdtPNCounter* counter, int64_t amount) {
+    if (amount >= 0) {
+        return crdtCounterAdd(&counter->increments, static_cast<uint64_t>(amount));
+    }
+    return crdtCounterAdd(&counter->decrements, static_cast<uint64_t>(-(amount + 1)) + 1);
+}
+
+int64_t crdtPNCounterValue(const CrdtPNCounter* counter) {
+    return static_cast<int64_t>(crdtCounterValue(&counter->increments) - crdtCounterValue(&counter->decrements));
+}
+
+bool crdtRegisterSet(const char* memoryName, size_t offset, const void* value, size_t size) {
+    size_t regionSize = 0;
+    char* region = static_cast<char*>(getSharedMemoryMapping(memoryName, &regionSize));
+    if (!region || leaseNodeId() == 0 || size > CRDT_REGISTER_VALUE_SIZE || offset < sizeof(MemoryLayout) ||
+        offset > regionSize || sizeof(CrdtRegister) > regionSize - offset) {
+        return false;
+    }
+
+    CrdtRegister reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.node = leaseNodeId();
+    reg.size = static_cast<uint32_t>(size);
+    memcpy(reg.value, value, size);
+
+    lockCrdtMutex();
+    reg.stamp = hlcNow();
+    region = static_cast<char*>(beginNamedRegionWrite(memoryName, region));
+    if (!region) {
+        unlockCrdtMutex();
+        return false;
+    }
+    memcpy(region + offset, &reg, sizeof(reg));
+    markRegionChanged(memoryName, offset, sizeof(reg));
+    endRegionWrite(region);
+    unlockCrdtMutex();
+    return true;
+}
+
+bool crdtRegisterGet(const char* memoryName, size_t offset, CrdtRegister* reg) {
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(memoryName, &regionSize));
+    if (!region || offset < sizeof(MemoryLayout) || offset > regionSize ||
+        sizeof(CrdtRegister) > regionSize - offset) {
+        return false;
+    }
+    for (;;) {
+        uint32_t sequence = beginRegionRead(region);
+        memcpy(reg, region + offset, sizeof(CrdtRegister));
+        if (endRegionRead(region, sequence)) {
+            return true;
+        }
+    }
+}
+
+int publishCrdtFields(const char* memoryName) {
+    lockCrdtMutex();
+    std::map<std::string, std::vector<CrdtField> >::iterator it = g_crdtFields.find(memoryName);
+    if (it == g_crdtFields.end()) {
+        unlockCrdtMutex();
+        return 0;
+    }
+    const char* region = static_cast<const char*>(getSharedMemory(memoryName));
+    std::vector<MemoryChange> changes;
+    for (size_t i = 0; region && i < it->second.size(); i++) {
+        CrdtField& field = it->second[i];
+        size_t slotOffsets[2];
+        int slots = ownSlotOffsets(field, slotOffsets);
+        for (int s = 0; s < slots; s++) {
+            uint64_t value = *reinterpret_cast<const volatile uint64_t*>(region + slotOffsets[s]);
+            if (value != field.published[s]) {
+                MemoryChange change;
+                change.offset = slotOffsets[s];
+                change.size = sizeof(uint64_t);
+                change.inProgress = false;
+                changes.push_back(change);
+                field.published[s] = value;
+            }
+        }
+    }
+    unlockCrdtMutex();
+
+    // One version for all the slots of this pass
+    if (!changes.empty()) {
+        markRegionsChanged(memoryName, changes);
+    }
+    return static_cast<int>(changes.size());
+}
+
+uint64_t hlcNow() {
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    uint64_t wallMs = ((static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime) / 10000;
+    uint64_t physical = wallMs << 16;
+    for (;;) {
+        LONG64 last = g_hlc;
+        uint64_t next = static_cast<uint64_t>(last) + 1;
+        if (physical > next) {
+            next = physical;
+        }
+        if (InterlockedCompareExchange64(&g_hlc, static_cast<LONG64>(next), last) == last) {
+            return next;
+        }
+    }
+}
+
+void hlcObserve(uint64_t stamp) {
+    for (;;) {
+        LONG64 last = g_hlc;
+        if (static_cast<uint64_t>(last) >= stamp ||
+            InterlockedCompareExchange64(&g_hlc, static_cast<LONG64>(stamp), last) == last) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,157 @@
+#ifndef CRDT_FIELD_H
+#define CRDT_FIELD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "range_lease.h"
+
+/**
+ * @brief Counters and registers that every node updates locally
+ *
+ * CRDT fields live in a region that every node writes, such as a
+ * multi-writer region outside its leased ranges. Every node registers the
+ * same fields at the same offsets with registerCrdtField. Updates to them
+ * are then merged on apply instead of copied, so the copies converge
+ * whatever order the updates arrive in and however often they repeat.
+ *
+ * Counters keep one slot per node ID (see setLeaseNodeId). A node adds to
+ * its own slot with one atomic add, and the region's sync thread sends the
+ * slots that changed on its next pass, as ordinary updates. A slot merges
+ * to the larger of its two values, and a counter's value is the sum of its
+ * slots.
+ *
+ * Registers hold up to CRDT_REGISTER_VALUE_SIZE bytes stamped with a hybrid
+ * logical clock and the writer's node ID. The later stamp wins a merge, and
+ * the higher node ID breaks a tie. The clock follows the wall clock and
+ * moves past every stamp this node applies, so a write here wins over every
+ * write this node has already seen.
+ */
+
+/// Bytes a register can hold
+#define CRDT_REGISTER_VALUE_SIZE 48
+
+/**
+ * @brief Grow-only counter
+ */
+struct CrdtGCounter {
+    uint64_t slots[MAX_LEASE_NODES];        // Total added by each node, indexed by node ID - 1
+};
+
+/**
+ * @brief Counter that can go up and down
+ */
+struct CrdtPNCounter {
+    CrdtGCounter increments;
+    CrdtGCounter decrements;
+};
+
+/**
+ * @brief Last-writer-wins register
+ */
+struct CrdtRegister {
+    uint64_t stamp;         // Hybrid logical clock time of the write
+    uint32_t node;          // Node ID of the writer
+    uint32_t size;          // Bytes of value in use
+    char value[CRDT_REGISTER_VALUE_SIZE];
+};
+
+typedef enum {
+    CRDT_G_COUNTER,         // A CrdtGCounter
+    CRDT_PN_COUNTER,        // A CrdtPNCounter
+    CRDT_LWW_REGISTER       // A CrdtRegister
+} CrdtFieldType;
+
+/**
+ * @brief Merge updates to a field of a region instead of copying them
+ *
+ * Updates are merged when they cover whole counter slots or a whole
+ * register, as the updates sent for CRDT fields do.
+ *
+ * @param memoryName Name of the region
+ * @param offset Region offset of the field; 8-byte aligned, after the MemoryLayout header
+ * @param type Type of the field
+ * @return true if the field was registered; false if it doesn't fit the
+ *         region or overlaps another field
+ */
+bool registerCrdtField(const char* memoryName, size_t offset, CrdtFieldType type);
+
+/**
+ * @brief Forget the CRDT fields of a region
+ *
+ * @param memoryName Name of the region
+ */
+void unregisterCrdtFields(const char* memoryName);
+
+/**
+ * @brief Add to this node's slot of a counter
+ *
+ * @param counter The counter, in a region where it is registered
+ * @param amount Amount to add
+ * @return false if this node has no node ID
+ */
+bool crdtCounterAdd(CrdtGCounter* counter, uint64_t amount);
+
+/**
+ * @brief Get the value of a counter
+ */
+uint64_t crdtCounterValue(const CrdtGCounter* counter);
+
+/**
+ * @brief Add to or subtract from a counter
+ *
+ * @param counter The counter, in a region where it is registered
+ * @param amount Amount to add; negative to subtract
+ * @return false if this node has no node ID
+ */
+bool crdtPNCounterAdd(CrdtPNCounter* counter, int64_t amount);
+
+/**
+ * @brief Get the value of a counter that can go up and down
+ */
+int64_t crdtPNCounterValue(const CrdtPNCounter* counter);
+
+/**
+ * @brief Write a register, stamped with this node's clock
+ *
+ * @param memoryName Name of the region
+ * @param offset Region offset of the register
+ * @param value Bytes to store
+ * @param size Number of bytes, at most CRDT_REGISTER_VALUE_SIZE
+ * @return true if the register was written
+ */
+bool crdtRegisterSet(const char* memoryName, size_t offset, const void* value, size_t size);
+
+/**
+ * @brief Read a register without seeing a write in progress
+ *
+ * @param memoryName Name of the region
+ * @param offset Region offset of the register
+ * @param reg Receives the register
+ * @return true if the region holds a register at the offset
+ */
+bool crdtRegisterGet(const char* memoryName, size_t offset, CrdtRegister* reg);
+
+/**
+ * @brief Queue the counter slots this node changed since the last call
+ *
+ * Called from the region's sync thread on every pass.
+ *
+ * @param memoryName Name of the region
+ * @return Number of slots queued
+ */
+int publishCrdtFields(const char* memoryName);
+
+/**
+ * @brief Get a new hybrid logical clock stamp
+ *
+ * Stamps are wall-clock milliseconds shifted left by 16 bits plus a count,
+ * and each is later than every stamp this node has made or applied.
+ */
+uint64_t hlcNow();
+
+/**
+ * @brief Move the clock past a stamp received from another node
+ */
+void hlcObserve(uint64_t stamp);
+
+#endif // CRDT_FIELD_H
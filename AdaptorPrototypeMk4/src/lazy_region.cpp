@@ -0,0 +1,718 @@
+/**
+ * @file lazy_region.cpp
+ * @brief Implementation of lazy copies of remote regions
+ *
+ * Each lazy copy has a userfaultfd covering its pages after the first, and
+ * a fault thread that reads the faults and sends a request for each page not
+ * already on its way. A page that has gone LAZY_PAGE_RETRY_MS without a part
+ * arriving is asked for again, naming the parts already received, and the
+ * source resends only the others unless the region has moved on since. The
+ * parts of a page are collected in its PendingPage, and once all of them
+ * are in, the updates held for it are laid over them and the page is placed
+ * with UFFDIO_COPY, which wakes the threads waiting for it.
+ *
+ * The receive thread never touches a page that isn't present: the merger
+ * registered for the region writes present pages only, and pages are
+ * installed without reading the mapping. Page requests are sent outside
+ * g_lazyMutex, as the sync threads take it while holding the remote nodes
+ * mutex.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+#include <process.h>  // For _beginthreadex
+
+#include "lazy_region.h"
+#include "shared_memory.h"
+#include "memory_layout.h"
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/// How long the fault thread waits for a fault before checking its requests
+#define LAZY_POLL_MS 20
+
+/// Attempts at placing a page while the kernel reports the mapping as changing
+#define LAZY_COPY_ATTEMPTS 3
+
+/**
+ * @brief A page of a lazy copy that has been requested
+ */
+struct PendingPage {
+    ULONGLONG requestTime;          // When the page was last requested or a part arrived; 0 to request it now
+    uint64_t version;               // Source version of the parts received
+    uint64_t partsReceived;         // Bit per MAX_SYNC_DATA_SIZE part of the page
+    std::vector<char> buffer;       // The page as received so far
+    std::vector<SyncMessage> held;  // Updates that touch the page, applied once it is in
+};
+
+/**
+ * @brief State of a lazy copy
+ */
+struct LazyRegion {
+    std::string name;
+    uint64_t copyId;                            // Sent with every page request
+    char* base;
+    size_t size;
+    size_t pageSize;
+    int uffd;
+    HANDLE thread;
+    volatile bool running;
+    std::map<uint64_t, uint64_t> resident;      // Present pages and the source version they were fetched at
+    std::map<uint64_t, PendingPage> pending;    // Pages on their way
+    LazyRegionStats stats;
+};
+
+/**
+ * @brief Pages of a region that a lazy copy at a peer has fetched
+ */
+struct LazyPeer {
+    size_t pageSize;
+    uint64_t copyId;                // Copy the pages were fetched by
+    bool current;                   // false once the peer resyncs, until it asks for a page again
+    std::set<uint64_t> pages;
+};
+
+/// Lazy copies by region
+static std::map<std::string, LazyRegion*> g_lazyRegions;
+
+/// Lazy copies of the regions this node is the source of, by region and then peer
+static std::map<std::string, std::map<std::string, LazyPeer> > g_lazyPeers;
+
+/// Mutex protecting the maps above and the state of each copy
+static HANDLE g_lazyMutex = NULL;
+
+/// Function used to send page requests
+static LazyPageSender g_lazyPageSender = NULL;
+
+static void lockLazyMutex() {
+    if (g_lazyMutex == NULL) {
+        g_lazyMutex = CreateMutex(NULL, FALSE, NULL);
+        if (g_lazyMutex == NULL) {
+            std::cerr << "Failed to create lazy region mutex: " << GetLastError() << std::endl;
+        }
+    }
+    if (g_lazyMutex != NULL) {
+        WaitForSingleObject(g_lazyMutex, INFINITE);
+    }
+}
+
+static void unlockLazyMutex() {
+    if (g_lazyMutex != NULL) {
+        ReleaseMutex(g_lazyMutex);
+    }
+}
+
+/**
+ * @brief Look up a lazy copy; call with g_lazyMutex held
+ */
+static LazyRegion* findLazyRegion(const char* memoryName) {
+    std::map<std::string, LazyRegion*>::iterator it = g_lazyRegions.find(memoryName);
+    return (it != g_lazyRegions.end()) ? it->second : NULL;
+}
+
+/**
+ * @brief Start fetching a page; call with g_lazyMutex held
+ */
+static void addPendingPage(LazyRegion* lazy, uint64_t page) {
+    PendingPage& pending = lazy->pending[page];
+    pending.requestTime = 0;
+    pending.version = 0;
+    pending.partsReceived = 0;
+    pending.buffer.assign(lazy->pageSize, 0);
+}
+
+/**
+ * @brief Build the requests for pages without recent progress; call with g_lazyMutex held
+ */
+static void collectPageRequests(LazyRegion* lazy, std::vector<SyncMessage>& requests) {
+    ULONGLONG now = GetTickCount64();
+    std::map<uint64_t, PendingPage>::iterator it;
+    for (it = lazy->pending.begin(); it != lazy->pending.end(); ++it) {
+        if (it->second.requestTime != 0 && now - it->second.requestTime < LAZY_PAGE_RETRY_MS) {
+            continue;
+        }
+        SyncMessage request;
+        memset(&request, 0, sizeof(request));
+        request.msgType = MSG_PAGE_REQUEST;
+        snprintf(request.memoryName, sizeof(request.memoryName), "%s", lazy->name.c_str());
+        request.updateId = generateUniqueId();
+        request.offset = static_cast<size_t>(it->first) * lazy->pageSize;
+        PageRequestInfo info;
+        info.pageSize = lazy->pageSize;
+        info.version = it->second.version;
+        info.partsReceived = it->second.partsReceived;
+        info.copyId = lazy->copyId;
+        memcpy(request.data, &info, sizeof(info));
+        request.size = sizeof(info);
+        request.timestamp = GetTickCount();
+        requests.push_back(request);
+        it->second.requestTime = now;
+    }
+}
+
+/**
+ * @brief Send page requests through the registered sender
+ */
+static void sendPageRequests(const std::vector<SyncMessage>& requests) {
+    lockLazyMutex();
+    LazyPageSender sender = g_lazyPageSender;
+    unlockLazyMutex();
+    for (size_t i = 0; sender && i < requests.size(); i++) {
+        sender(requests[i]);
+    }
+}
+
+/**
+ * @brief Copy the part of an update that falls in a page into a buffer holding the page
+ */
+static void overlayUpdate(const SyncMessage& message, size_t pageOffset, size_t pageSize, char* page) {
+    size_t start = (message.offset > pageOffset) ? message.offset : pageOffset;
+    size_t end = message.offset + message.size;
+    if (end > pageOffset + pageSize) {
+        end = pageOffset + pageSize;
+    }
+    if (start < end) {
+        memcpy(page + (start - pageOffset), message.data + (start - message.offset), end - start);
+    }
+}
+
+#ifndef _WIN32
+/**
+ * @brief Copy a page into a hole of a lazy copy, waking the threads that wait for it
+ *
+ * @return true if the page holds the data, false if the kernel refused the copy
+ */
+static bool copyPage(LazyRegion* lazy, size_t pageOffset, const char* data) {
+    int error = 0;
+    for (int attempt = 0; attempt < LAZY_COPY_ATTEMPTS; attempt++) {
+        struct uffdio_copy copy;
+        copy.dst = reinterpret_cast<uintptr_t>(lazy->base + pageOffset);
+        copy.src = reinterpret_cast<uintptr_t>(data);
+        copy.len = lazy->pageSize;
+        copy.mode = 0;
+        copy.copy = 0;
+        if (ioctl(lazy->uffd, UFFDIO_COPY, &copy) == 0) {
+            return true;
+        }
+        error = errno;
+        if (error == EEXIST) {
+            // Already present, for instance written locally; overwrite it
+            memcpy(lazy->base + pageOffset, data, lazy->pageSize);
+            return true;
+        }
+        if (error != EAGAIN) {
+            break;
+        }
+    }
+    std::cerr << "[LAZY] Failed to place page " << pageOffset / lazy->pageSize << " of " << lazy->name
+              << ": " << strerror(error) << "; fetching it again" << std::endl;
+    return false;
+}
+#endif
+
+/**
+ * @brief Place a page whose parts have all arrived; call with g_lazyMutex held
+ *
+ * @return true if the page is now resident; false if it must be fetched again
+ */
+static bool installPage(LazyRegion* lazy, uint64_t page, PendingPage& pending) {
+    size_t pageOffset = static_cast<size_t>(page) * lazy->pageSize;
+
+    // Updates that arrived while the page was on its way, unless the page already has them
+    for (size_t i = 0; i < pending.held.size(); i++) {
+        if (pending.held[i].version >= pending.version) {
+            overlayUpdate(pending.held[i], pageOffset, lazy->pageSize, &pending.buffer[0]);
+        }
+    }
+
+    bool placed = true;
+    beginRegionWrite(lazy->base);   // Lazy copies don't grow, so their segment is never retired
+    if (page == 0) {
+        // The header page is always present; keep the newer version
+        MemoryLayout* layout = reinterpret_cast<MemoryLayout*>(lazy->base);
+        uint64_t version = layout->version;
+        copyUpdateData(lazy->base, lazy->size, 0, &pending.buffer[0], lazy->pageSize);
+        if (version > layout->version) {
+            layout->version = version;
+        }
+    } else {
+#ifndef _WIN32
+        placed = copyPage(lazy, pageOffset, &pending.buffer[0]);
+#endif
+    }
+    endRegionWrite(lazy->base);
+
+    if (placed) {
+        lazy->resident[page] = pending.version;
+    }
+    return placed;
+}
+
+/**
+ * @brief Apply an update to a lazy copy, writing only the pages that are present
+ *
+ * Updates that only touch present pages, and are no older than them, are
+ * left to the plain copy.
+ */
+static bool mergeLazyUpdate(const SyncMessage& message, void* target, void* context) {
+    (void)context;
+    if (message.size == 0) {
+        return false;
+    }
+
+    lockLazyMutex();
+    LazyRegion* lazy = findLazyRegion(message.memoryName);
+    if (!lazy) {
+        unlockLazyMutex();
+        return false;
+    }
+
+    uint64_t first = message.offset / lazy->pageSize;
+    uint64_t last = (message.offset + message.size - 1) / lazy->pageSize;
+    bool plain = true;
+    for (uint64_t page = first; page <= last && plain; page++) {
+        std::map<uint64_t, uint64_t>::iterator resident = lazy->resident.find(page);
+        plain = resident != lazy->resident.end() && message.version >= resident->second &&
+                lazy->pending.find(page) == lazy->pending.end();
+    }
+    if (plain) {
+        unlockLazyMutex();
+        return false;
+    }
+
+    char* region = static_cast<char*>(target) - message.offset;
+    for (uint64_t page = first; page <= last; page++) {
+        size_t pageOffset = static_cast<size_t>(page) * lazy->pageSize;
+        size_t start = (message.offset > pageOffset) ? message.offset : pageOffset;
+        size_t end = message.offset + message.size;
+        if (end > pageOffset + lazy->pageSize) {
+            end = pageOffset + lazy->pageSize;
+        }
+
+        std::map<uint64_t, uint64_t>::iterator resident = lazy->resident.find(page);
+        std::map<uint64_t, PendingPage>::iterator pending = lazy->pending.find(page);
+        if (resident != lazy->resident.end() && message.version >= resident->second) {
+            copyUpdateData(region, lazy->size, start, message.data + (start - message.offset), end - start);
+        } else if (pending == lazy->pending.end()) {
+            lazy->stats.updatesDropped++;
+        }
+        if (pending != lazy->pending.end()) {
+            pending->second.held.push_back(message);
+        }
+    }
+    unlockLazyMutex();
+    return true;
+}
+
+#ifndef _WIN32
+/**
+ * @brief Thread function that turns the faults of a lazy copy into page requests
+ *
+ * @param arg The region's LazyRegion
+ * @return Thread exit code (always 0)
+ */
+static unsigned int __stdcall lazyFaultThreadFunc(void* arg) {
+    LazyRegion* lazy = static_cast<LazyRegion*>(arg);
+    while (lazy->running) {
+        std::vector<uint64_t> faulted;
+        struct pollfd poller;
+        poller.fd = lazy->uffd;
+        poller.events = POLLIN;
+        poller.revents = 0;
+        if (poll(&poller, 1, LAZY_POLL_MS) > 0) {
+            struct uffd_msg events[16];
+            ssize_t bytes = read(lazy->uffd, events, sizeof(events));
+            for (ssize_t i = 0; bytes > 0 && i < bytes / static_cast<ssize_t>(sizeof(events[0])); i++) {
+                if (events[i].event == UFFD_EVENT_PAGEFAULT) {
+                    uintptr_t address = static_cast<uintptr_t>(events[i].arg.pagefault.address);
+                    faulted.push_back((address - reinterpret_cast<uintptr_t>(lazy->base)) / lazy->pageSize);
+                }
+            }
+        }
+
+        std::vector<SyncMessage> requests;
+        lockLazyMutex();
+        for (size_t i = 0; i < faulted.size(); i++) {
+            // Several readers can fault on a page before it arrives
+            if (lazy->resident.find(faulted[i]) == lazy->resident.end() &&
+                lazy->pending.find(faulted[i]) == lazy->pending.end()) {
+                addPendingPage(lazy, faulted[i]);
+                lazy->stats.faults++;
+            }
+        }
+        collectPageRequests(lazy, requests);
+        unlockLazyMutex();
+        sendPageRequests(requests);
+    }
+    return 0;
+}
+
+/**
+ * @brief Open a userfaultfd that can serve faults on shared memory
+ *
+ * @return The descriptor, or -1 if this kernel or process can't have one
+ */
+static int openUserFaultFd() {
+    int uffd = static_cast<int>(syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+#ifdef UFFD_USER_MODE_ONLY
+    // Unprivileged processes may only handle faults from user space
+    if (uffd < 0 && errno == EPERM) {
+        uffd = static_cast<int>(syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY));
+    }
+#endif
+    if (uffd < 0) {
+        return -1;
+    }
+
+    struct uffdio_api api;
+    memset(&api, 0, sizeof(api));
+    api.api = UFFD_API;
+    if (ioctl(uffd, UFFDIO_API, &api) != 0 || !(api.features & UFFD_FEATURE_MISSING_SHMEM)) {
+        close(uffd);
+        return -1;
+    }
+    return uffd;
+}
+
+/**
+ * @brief Check whether any page after the first of a mapping is present
+ */
+static bool hasPresentPages(char* base, size_t size, size_t pageSize) {
+    std::vector<unsigned char> present(size / pageSize);
+    if (present.empty() || mincore(base, present.size() * pageSize, &present[0]) != 0) {
+        return true;
+    }
+    for (size_t i = 1; i < present.size(); i++) {
+        if (present[i] & 1) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+bool lazyReplicationSupported() {
+#ifdef _WIN32
+    return false;
+#else
+    int uffd = openUserFaultFd();
+    if (uffd < 0) {
+        return false;
+    }
+    close(uffd);
+    return true;
+#endif
+}
+
+void setLazyPageSender(LazyPageSender sender) {
+    lockLazyMutex();
+    g_lazyPageSender = sender;
+    unlockLazyMutex();
+}
+
+bool startLazyRegion(const char* memoryName) {
+#ifdef _WIN32
+    std::cerr << "[LAZY] Lazy copies need userfaultfd; " << memoryName << " is replicated in full" << std::endl;
+    return false;
+#else
+    size_t size = 0;
+    char* base = static_cast<char*>(getSharedMemoryMapping(memoryName, &size));
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    size_t pageSize = systemInfo.dwPageSize;
+    if (!base || pageSize < MAX_SYNC_DATA_SIZE || pageSize > LAZY_MAX_PAGE_SIZE || size / pageSize < 2) {
+        std::cerr << "[LAZY] " << memoryName << " can't be a lazy copy; it is replicated in full" << std::endl;
+        return false;
+    }
+
+    lockLazyMutex();
+    if (findLazyRegion(memoryName)) {
+        unlockLazyMutex();
+        return true;
+    }
+    unlockLazyMutex();
+
+    int uffd = openUserFaultFd();
+    if (uffd < 0) {
+        std::cerr << "[LAZY] userfaultfd is not available; " << memoryName << " is replicated in full" << std::endl;
+        return false;
+    }
+
+    LazyRegion* lazy = new LazyRegion();
+    lazy->name = memoryName;
+    lazy->copyId = generateUniqueId();
+    lazy->base = base;
+    lazy->size = size;
+    lazy->pageSize = pageSize;
+    lazy->uffd = uffd;
+    lazy->thread = NULL;
+    lazy->running = true;
+    memset(&lazy->stats, 0, sizeof(lazy->stats));
+    lazy->resident[0] = 0;
+
+    // Updates to pages that aren't present are dropped from here on, so none lands in a hole
+    lockLazyMutex();
+    g_lazyRegions[memoryName] = lazy;
+    unlockLazyMutex();
+    registerApplyMerger(memoryName, mergeLazyUpdate, NULL);
+
+    struct uffdio_register range;
+    memset(&range, 0, sizeof(range));
+    range.range.start = reinterpret_cast<uintptr_t>(base + pageSize);
+    range.range.len = (size / pageSize - 1) * pageSize;
+    range.mode = UFFDIO_REGISTER_MODE_MISSING;
+    bool registered = ioctl(uffd, UFFDIO_REGISTER, &range) == 0;
+
+    // A page that already holds data would never fault, and could be stale
+    if (!registered || hasPresentPages(base, size, pageSize)) {
+        std::cerr << "[LAZY] " << memoryName << (registered ? " already holds data" : " can't be registered")
+                  << "; it is replicated in full" << std::endl;
+        lockLazyMutex();
+        g_lazyRegions.erase(memoryName);
+        unlockLazyMutex();
+        unregisterApplyMerger(memoryName);
+        close(uffd);
+        delete lazy;
+        return false;
+    }
+
+    // The header page comes first, and tells the source this copy is lazy
+    lockLazyMutex();
+    addPendingPage(lazy, 0);
+    unlockLazyMutex();
+
+    unsigned int threadId;
+    lazy->thread = (HANDLE)_beginthreadex(NULL, 0, lazyFaultThreadFunc, lazy, 0, &threadId);
+    if (lazy->thread == NULL) {
+        std::cerr << "Failed to create lazy fault thread: " << GetLastError() << std::endl;
+        stopLazyRegion(memoryName);
+        return false;
+    }
+
+    std::cout << "[LAZY] " << memoryName << " fetches its " << size / pageSize << " pages on first access"
+              << std::endl;
+    return true;
+#endif
+}
+
+void stopLazyRegion(const char* memoryName) {
+    lockLazyMutex();
+    LazyRegion* lazy = findLazyRegion(memoryName);
+    unlockLazyMutex();
+    if (!lazy) {
+        return;
+    }
+
+    lazy->running = false;
+    if (lazy->thread != NULL) {
+        WaitForSingleObject(lazy->thread, INFINITE);
+        CloseHandle(lazy->thread);
+    }
+
+    // Closing the descriptor wakes the readers still waiting; they get zero pages
+    lockLazyMutex();
+#ifndef _WIN32
+    close(lazy->uffd);
+#endif
+    lazy->uffd = -1;
+    g_lazyRegions.erase(memoryName);
+    unlockLazyMutex();
+    unregisterApplyMerger(memoryName);
+    delete lazy;
+}
+
+bool isLazyRegion(const char* memoryName) {
+    lockLazyMutex();
+    bool lazy = findLazyRegion(memoryName) != NULL;
+    unlockLazyMutex();
+    return lazy;
+}
+
+bool receiveLazyPage(const SyncMessage& message) {
+    lockLazyMutex();
+    LazyRegion* lazy = findLazyRegion(message.memoryName);
+    if (!lazy) {
+        unlockLazyMutex();
+        return false;
+    }
+
+    size_t inPage = message.offset % lazy->pageSize;
+    std::map<uint64_t, PendingPage>::iterator it = lazy->pending.find(message.offset / lazy->pageSize);
+    if (it == lazy->pending.end() || message.size == 0 || message.size > MAX_SYNC_DATA_SIZE ||
+        inPage % MAX_SYNC_DATA_SIZE != 0 || inPage + message.size > lazy->pageSize) {
+        unlockLazyMutex();
+        return false;
+    }
+
+    // Parts of an answer to an earlier request may be older than the ones collected
+    PendingPage& pending = it->second;
+    if (pending.partsReceived != 0 && message.version != pending.version) {
+        if (message.version < pending.version) {
+            unlockLazyMutex();
+            return true;
+        }
+        pending.partsReceived = 0;
+    }
+    pending.version = message.version;
+    pending.requestTime = GetTickCount64();
+    memcpy(&pending.buffer[inPage], message.data, message.size);
+    pending.partsReceived |= 1ull << (inPage / MAX_SYNC_DATA_SIZE);
+    lazy->stats.bytesFetched += message.size;
+
+    size_t parts = (lazy->pageSize + MAX_SYNC_DATA_SIZE - 1) / MAX_SYNC_DATA_SIZE;
+    uint64_t all = (parts >= 64) ? ~0ull : (1ull << parts) - 1;
+    if (pending.partsReceived == all) {
+        if (installPage(lazy, it->first, pending)) {
+            lazy->pending.erase(it);
+        } else {
+            // Held updates stay with the page and are applied to the next copy
+            addPendingPage(lazy, it->first);
+        }
+    }
+    unlockLazyMutex();
+    return true;
+}
+
+bool getLazyRegionStats(const char* memoryName, LazyRegionStats* stats) {
+    lockLazyMutex();
+    LazyRegion* lazy = findLazyRegion(memoryName);
+    if (lazy && stats) {
+        *stats = lazy->stats;
+        stats->residentPages = lazy->resident.size();
+        stats->pendingPages = lazy->pending.size();
+    }
+    unlockLazyMutex();
+    return lazy != NULL;
+}
+
+bool buildLazyPageReplies(const SyncMessage& request, const char* peer, std::vector<SyncMessage>& replies) {
+    if (request.size != sizeof(PageRequestInfo)) {
+        return false;
+    }
+    PageRequestInfo info;
+    memcpy(&info, request.data, sizeof(info));
+    size_t pageSize = static_cast<size_t>(info.pageSize);
+    if (pageSize < MAX_SYNC_DATA_SIZE || pageSize > LAZY_MAX_PAGE_SIZE || (pageSize & (pageSize - 1)) != 0 ||
+        request.offset % pageSize != 0) {
+        return false;
+    }
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(request.memoryName, &regionSize));
+    if (!region || regionSize < sizeof(MemoryLayout) || request.offset >= regionSize) {
+        return false;
+    }
+
+    // Record the page before reading it, so every change made after the read is sent to the peer
+    lockLazyMutex();
+    // A request from another copy (the peer restarted or rejoined) starts the record over
+    LazyPeer& lazyPeer = g_lazyPeers[request.memoryName][peer];
+    if (lazyPeer.pageSize != pageSize || lazyPeer.copyId != info.copyId) {
+        lazyPeer.pageSize = pageSize;
+        lazyPeer.copyId = info.copyId;
+        lazyPeer.pages.clear();
+    }
+    lazyPeer.current = true;
+    lazyPeer.pages.insert(request.offset / pageSize);
+    unlockLazyMutex();
+
+    // Read the page between two writes, past the end of the region as zeros
+    std::vector<char> page(pageSize, 0);
+    size_t available = (regionSize - request.offset < pageSize) ? regionSize - request.offset : pageSize;
+    uint64_t version;
+    for (;;) {
+        uint32_t sequence = beginRegionRead(region);
+        memcpy(&page[0], region + request.offset, available);
+        version = reinterpret_cast<const MemoryLayout*>(region)->version;
+        if (endRegionRead(region, sequence)) {
+            break;
+        }
+    }
+
+    SyncMessage reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.msgType = MSG_PAGE_DATA;
+    snprintf(reply.memoryName, sizeof(reply.memoryName), "%s", request.memoryName);
+    reply.updateId = request.updateId;
+    reply.version = version;
+
+    // A retry at the same version only needs the parts that didn't arrive
+    uint64_t skip = (info.version == version) ? info.partsReceived : 0;
+    size_t first = replies.size();
+    for (size_t part = 0; part < pageSize; part += MAX_SYNC_DATA_SIZE) {
+        if (skip & (1ull << (part / MAX_SYNC_DATA_SIZE))) {
+            continue;
+        }
+        reply.offset = request.offset + part;
+        reply.size = MAX_SYNC_DATA_SIZE;
+        reply.timestamp = GetTickCount();
+        reply.flags = SYNC_FLAG_MORE_IN_VERSION;
+        memcpy(reply.data, &page[part], MAX_SYNC_DATA_SIZE);
+        replies.push_back(reply);
+    }
+    if (replies.size() > first) {
+        replies.back().flags = 0;
+    }
+    return true;
+}
+
+bool lazyPeerWantsChanges(const char* memoryName, const char* peer, const std::vector<MemoryChange>& changes) {
+    lockLazyMutex();
+    std::map<std::string, std::map<std::string, LazyPeer> >::iterator region = g_lazyPeers.find(memoryName);
+    if (region == g_lazyPeers.end()) {
+        unlockLazyMutex();
+        return true;
+    }
+    std::map<std::string, LazyPeer>::iterator it = region->second.find(peer);
+    if (it == region->second.end() || !it->second.current) {
+        unlockLazyMutex();
+        return true;
+    }
+
+    // The header page is always present at the peer
+    const LazyPeer& lazyPeer = it->second;
+    bool wanted = false;
+    for (size_t i = 0; i < changes.size() && !wanted; i++) {
+        if (changes[i].size == 0) {
+            continue;
+        }
+        uint64_t first = changes[i].offset / lazyPeer.pageSize;
+        uint64_t last = (changes[i].offset + changes[i].size - 1) / lazyPeer.pageSize;
+        std::set<uint64_t>::const_iterator page = lazyPeer.pages.lower_bound(first);
+        wanted = first == 0 || (page != lazyPeer.pages.end() && *page <= last);
+    }
+    unlockLazyMutex();
+    return wanted;
+}
+
+void resetLazyPeer(const char* memoryName, const char* peer) {
+    lockLazyMutex();
+    std::map<std::string, std::map<std::string, LazyPeer> >::iterator region = g_lazyPeers.find(memoryName);
+    if (region != g_lazyPeers.end()) {
+        std::map<std::string, LazyPeer>::iterator it = region->second.find(peer);
+        if (it != region->second.end()) {
+            it->second.current = false;
+        }
+    }
+    unlockLazyMutex();
+}
+
+void forgetLazyPeers(const char* memoryName) {
+    lockLazyMutex();
+    g_lazyPeers.erase(memoryName);
+    unlockLazyMutex();
+}
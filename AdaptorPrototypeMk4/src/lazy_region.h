@@ -0,0 +1,155 @@
+#ifndef LAZY_REGION_H
+#define LAZY_REGION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "sync_message.h"
+#include "change_tracking.h"
+
+/**
+ * @brief Copies of remote regions that fetch each page on its first access
+ *
+ * A lazy copy is created at a reserved size and starts out empty. The page
+ * holding the MemoryLayout header is fetched at once. Every other page is
+ * registered with userfaultfd, so the first access to it blocks while the
+ * region's fault thread asks the source for the page (MSG_PAGE_REQUEST).
+ * The receive thread installs the page from the MSG_PAGE_DATA replies, which
+ * wakes the reader. Memory use and bootstrap traffic then follow the pages
+ * that are read rather than the size of the region.
+ *
+ * Updates to pages that are present are applied as usual, unless they are
+ * older than the page. Updates to a page that is being fetched are held and
+ * applied on top of it, and updates to other pages are dropped, as the page
+ * is fetched whole when it is first read. The source records the pages each
+ * lazy copy has fetched and only sends it the updates that touch them.
+ *
+ * Lazy copies need Linux; on Windows they are replicated in full. They
+ * don't grow, so the reserved size must cover the source region. Apply
+ * observers, checksums, journals and snapshots read the whole region and
+ * are not used with them.
+ */
+
+/// Time without a part of a requested page arriving after which it is asked for again
+#define LAZY_PAGE_RETRY_MS 50
+
+/// Largest page a source serves
+#define LAZY_MAX_PAGE_SIZE 65536
+
+/**
+ * @brief Counters of a lazy copy
+ */
+struct LazyRegionStats {
+    uint64_t residentPages;     // Pages present, the header page included
+    uint64_t pendingPages;      // Pages being fetched
+    uint64_t faults;            // Pages requested because they were read
+    uint64_t bytesFetched;      // Page bytes received
+    uint64_t updatesDropped;    // Update parts dropped because their page isn't present
+};
+
+/**
+ * @brief Function that sends a page request to the source of a region
+ */
+typedef void (*LazyPageSender)(const SyncMessage& message);
+
+/**
+ * @brief Check whether lazy copies are possible on this platform
+ */
+bool lazyReplicationSupported();
+
+/**
+ * @brief Set the function used to send page requests
+ *
+ * @param sender Function to call; NULL to stop sending
+ */
+void setLazyPageSender(LazyPageSender sender);
+
+/**
+ * @brief Make a new copy of a remote region lazy
+ *
+ * Called right after the region is created, before anything reads it.
+ * Fails if pages other than the header already hold data, for instance
+ * contents kept from before a restart.
+ *
+ * @param memoryName Name of the region
+ * @return true if the region is now lazy; false if it must be replicated in full
+ */
+bool startLazyRegion(const char* memoryName);
+
+/**
+ * @brief Stop fetching pages of a lazy copy
+ *
+ * Readers still waiting for a page then see zeros.
+ *
+ * @param memoryName Name of the region
+ */
+void stopLazyRegion(const char* memoryName);
+
+/**
+ * @brief Check whether a region is a lazy copy
+ */
+bool isLazyRegion(const char* memoryName);
+
+/**
+ * @brief Install a part of a fetched page
+ *
+ * Called from the receive thread for each MSG_PAGE_DATA message.
+ *
+ * @param message The MSG_PAGE_DATA message
+ * @return true if the part belongs to a page being fetched
+ */
+bool receiveLazyPage(const SyncMessage& message);
+
+/**
+ * @brief Get the counters of a lazy copy
+ *
+ * @param memoryName Name of the region
+ * @param stats Receives the counters
+ * @return true if the region is a lazy copy
+ */
+bool getLazyRegionStats(const char* memoryName, LazyRegionStats* stats);
+
+/**
+ * @brief Answer a page request from a lazy copy of a region this node is the source of
+ *
+ * Records the page for the peer, so from then on it is sent the updates that
+ * touch it, and then reads the page between two writes.
+ *
+ * @param request The MSG_PAGE_REQUEST message
+ * @param peer Address of the peer as "ip:port"
+ * @param replies Receives the MSG_PAGE_DATA messages to send back
+ * @return true if the request was valid
+ */
+bool buildLazyPageReplies(const SyncMessage& request, const char* peer, std::vector<SyncMessage>& replies);
+
+/**
+ * @brief Check whether a peer wants a batch of changes to a region
+ *
+ * @param memoryName Name of the region
+ * @param peer Address of the peer as "ip:port"
+ * @param changes Ranges of the batch
+ * @return false only for a lazy copy that has fetched none of the pages the batch touches
+ */
+bool lazyPeerWantsChanges(const char* memoryName, const char* peer, const std::vector<MemoryChange>& changes);
+
+/**
+ * @brief Stop trusting the pages recorded for a peer's copy of a region
+ *
+ * Called when the peer asks to resync, which it does when it starts or
+ * rejoins. Until its next page request the peer is sent every change, as
+ * its copy may now be full or a new lazy copy. A request from the same lazy
+ * copy keeps the pages it had fetched; one from a new copy starts over.
+ *
+ * @param memoryName Name of the region
+ * @param peer Address of the peer as "ip:port"
+ */
+void resetLazyPeer(const char* memoryName, const char* peer);
+
+/**
+ * @brief Forget the pages lazy copies fetched from a region
+ *
+ * @param memoryName Name of the region
+ */
+void forgetLazyPeers(const char* memoryName);
+
+#endif // LAZY_REGION_H
@@ -8,17 +8,41 @@
 #include <vector>
 #include <map>
 #include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
 #include "shared_memory.h"
 #include "network_sync.h"
 #include "memory_layout.h"
 #include "config.h"
 #include "change_tracking.h"
+#include "update_journal.h"
+#include "version_history.h"
+#include "region_snapshot.h"
+#include "snapshot_file.h"
+#include "thread_placement.h"
+#include "region_checksum.h"
+#include "sync_crypto.h"
+#include "range_lease.h"
+#include "crdt_field.h"
+#include "lazy_region.h"
+#include "remote_fetch.h"
+#include "block_locks.h"
 
 // Global variables
 bool running = true;
 int instance_id = 0;
 std::string primary_memory_name;
+BlockLockTable* primary_block_locks = NULL;  // Shared with other processes writing the primary region
 std::map<int, std::string> secondary_memory_names;
+std::string region_dir;  // Directory of file-backed regions, empty for paging-file regions
+RegionPrefaultMode region_prefault = REGION_PREFAULT_NONE;  // How region pages are brought in at startup
+size_t version_history_bytes = 0;  // History kept per secondary region for reads at older versions, 0 for none
+size_t lazy_region_bytes = 0;  // Size reserved for each lazy secondary region, 0 to replicate them in full
+std::map<int, int> secondary_histories;  // Version history handle of each secondary region
+std::string bootstrap_snapshot;  // Snapshot file secondary regions are seeded from, empty for none
+std::string shared_memory_name;  // Multi-writer region shared by all instances, empty for none
+size_t shared_counters_offset = 0;  // Offset of the shared region's counters within its data
+int shared_counter_count = 0;  // Counters in the shared region, 0 for none
 HANDLE memory_names_mutex = NULL;
 
 /**
@@ -116,7 +140,10 @@ bool initializePrimaryMemory() {
     primary_memory_name = createMemoryName(instance_id);
     std::cout << "[INIT] Creating primary shared memory: " << primary_memory_name << std::endl;
 
-    if (!initializeSharedMemory(primary_memory_name.c_str(), sizeof(MemoryLayout))) {
+    RegionOptions options;
+    options.backingDirectory = region_dir.c_str();
+    options.prefault = region_prefault;
+    if (!initializeSharedMemoryWithOptions(primary_memory_name.c_str(), sizeof(MemoryLayout), options)) {
         std::cerr << "[ERROR] Failed to initialize primary shared memory" << std::endl;
         return false;
     }
@@ -128,11 +155,28 @@ bool initializePrimaryMemory() {
         return false;
     }
 
+    // Restore the state from before a restart if it was journaled
+    bool recovered = wasSharedMemoryRestored(primary_memory_name.c_str());
+    bool replayed = false;
+    recoverRegionFromJournal(primary_memory_name.c_str(), &replayed);
+    recovered = recovered || replayed;
+
     // Initialize the memory
-    memory->version = 1;
-    memory->data = instance_id * 1000;  // Start with a value based on instance ID
-    memory->last_modified = GetTickCount();  // Use GetTickCount instead of chrono
-    memory->dirty = false;
+    if (!recovered) {
+        memory->version = 1;
+        memory->data = instance_id * 1000;  // Start with a value based on instance ID
+        memory->last_modified = GetTickCount();  // Use GetTickCount instead of chrono
+        memory->dirty = false;
+    }
+    openUpdateJournal(primary_memory_name.c_str(), JOURNAL_SOURCE);
+    setRegionSource(primary_memory_name.c_str());
+
+    // Other local processes may write the region too; writes to different blocks go ahead in parallel
+    primary_block_locks = attachBlockLocks(primary_memory_name.c_str());
+    if (!primary_block_locks) {
+        std::cerr << "[ERROR] Failed to attach the primary region's block locks" << std::endl;
+        return false;
+    }
 
     // Register memory change callback
     registerMemoryChangeCallback(primary_memory_name.c_str(), memoryUpdateCallback);
@@ -172,7 +216,13 @@ bool initializeSecondaryMemory(int other_id) {
 
     std::cout << "[INIT] Creating secondary shared memory: " << memory_name << std::endl;
 
-    if (!initializeSharedMemory(memory_name.c_str(), sizeof(MemoryLayout))) {
+    // A lazy copy is reserved at its full size in the paging file and brings nothing in up front
+    bool lazy = lazy_region_bytes > 0;
+    RegionOptions options;
+    options.backingDirectory = lazy ? "" : region_dir.c_str();
+    options.prefault = lazy ? REGION_PREFAULT_NONE : region_prefault;
+    if (!initializeSharedMemoryWithOptions(memory_name.c_str(), lazy ? lazy_region_bytes : sizeof(MemoryLayout),
+                                           options)) {
         std::cerr << "[ERROR] Failed to initialize secondary shared memory for instance " << other_id << std::endl;
         unlockMemoryNamesMutex();
         return false;
@@ -186,6 +236,30 @@ bool initializeSecondaryMemory(int other_id) {
         return false;
     }
 
+    // Pages of a lazy copy are fetched from the owner when first read
+    if (lazy) {
+        lazy = startLazyRegion(memory_name.c_str());
+    }
+
+    if (!lazy) {
+        // Restore the copy from before a restart; the owner sends whatever is newer
+        recoverRegionFromJournal(memory_name.c_str(), NULL);
+        openUpdateJournal(memory_name.c_str(), JOURNAL_REPLICA);
+
+        // A local snapshot saves transferring the whole region; it is skipped if the copy is newer
+        if (!bootstrap_snapshot.empty()) {
+            seedRegionFromSnapshot(bootstrap_snapshot.c_str(), memory_name.c_str());
+        }
+    }
+
+    // The receive thread applies this region's updates; let it follow the region's node
+    addApplyRegion(memory_name.c_str());
+
+    // Keep block CRCs from the seeded contents on, so checking the copy needs no full pass
+    if (regionChecksumsEnabled() && !lazy) {
+        startRegionChecksums(memory_name.c_str());
+    }
+
     // Register memory change callback
     registerMemoryChangeCallback(memory_name.c_str(), memoryUpdateCallback);
 
@@ -196,6 +270,13 @@ bool initializeSecondaryMemory(int other_id) {
         return false;
     }
 
+    if (version_history_bytes > 0 && !lazy) {
+        int history = startVersionHistory(memory_name.c_str(), version_history_bytes);
+        if (history >= 0) {
+            secondary_histories[other_id] = history;
+        }
+    }
+
     secondary_memory_names[other_id] = memory_name;
     std::cout << "[INIT] Secondary shared memory for instance " << other_id << " initialized successfully" << std::endl;
 
@@ -203,6 +284,146 @@ bool initializeSecondaryMemory(int other_id) {
     return true;
 }
 
+/**
+ * Initializes the multi-writer region shared by all instances and leases this instance's ranges
+ *
+ * @param config Configuration naming the region and the ranges
+ * @return true if successful, false otherwise
+ */
+bool initializeSharedRegion(const Config& config) {
+    if (leaseNodeId() == 0) {
+        std::cerr << "[ERROR] Only instances 1 to " << MAX_LEASE_NODES << " can write to a shared region" << std::endl;
+        return false;
+    }
+    shared_memory_name = config.getSharedRegion();
+    std::cout << "[INIT] Creating shared multi-writer memory: " << shared_memory_name << std::endl;
+
+    RegionOptions options;
+    options.backingDirectory = region_dir.c_str();
+    options.prefault = region_prefault;
+    if (!initializeSharedMemoryWithOptions(shared_memory_name.c_str(),
+                                           MULTI_WRITER_DATA_OFFSET + config.getSharedRegionSize(), options) ||
+        !initRangeLeaseTable(shared_memory_name.c_str())) {
+        std::cerr << "[ERROR] Failed to initialize shared memory " << shared_memory_name << std::endl;
+        return false;
+    }
+
+    // Leases move to the instance that writes them most
+    setRangeMigration(static_cast<uint32_t>(config.getLeaseMigrationWrites()), RANGE_MIGRATION_WINDOW_MS);
+
+    // Counters every instance adds to, merged rather than copied on apply
+    for (int i = 0; i < config.getSharedCounterCount(); ++i) {
+        size_t offset = MULTI_WRITER_DATA_OFFSET + config.getSharedCountersOffset() + i * sizeof(CrdtPNCounter);
+        if (!registerCrdtField(shared_memory_name.c_str(), offset, CRDT_PN_COUNTER)) {
+            std::cerr << "[ERROR] Shared counter " << i << " doesn't fit the shared region" << std::endl;
+            return false;
+        }
+    }
+    shared_counters_offset = config.getSharedCountersOffset();
+    shared_counter_count = config.getSharedCounterCount();
+
+    // Every instance applies the others' ranges and sends its own
+    addApplyRegion(shared_memory_name.c_str());
+    if (!startSharedMemorySync(shared_memory_name.c_str())) {
+        std::cerr << "[ERROR] Failed to start shared memory sync for " << shared_memory_name << std::endl;
+        return false;
+    }
+
+    const std::vector<Config::LeaseRange>& ranges = config.getLeaseRanges();
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (acquireRangeLease(shared_memory_name.c_str(), MULTI_WRITER_DATA_OFFSET + ranges[i].offset,
+                              ranges[i].size, static_cast<uint32_t>(config.getLeaseDurationMs()))) {
+            std::cout << "[INIT] Leased shared bytes " << ranges[i].offset << " to "
+                      << ranges[i].offset + ranges[i].size << std::endl;
+        } else {
+            std::cerr << "[WARNING] Shared bytes " << ranges[i].offset << " to " << ranges[i].offset + ranges[i].size
+                      << " are leased by another instance" << std::endl;
+        }
+    }
+    return true;
+}
+
+/**
+ * Writes a value into the shared region, here or at the instance that leases the offset
+ *
+ * @param offset Offset within the shared region's data
+ * @param new_data The new data value to write
+ */
+void updateSharedMemory(size_t offset, int new_data) {
+    if (shared_memory_name.empty()) {
+        std::cout << "No shared region is configured." << std::endl;
+        return;
+    }
+    size_t region_offset = MULTI_WRITER_DATA_OFFSET + offset;
+    bool holder = rangeLeaseHolder(shared_memory_name.c_str(), region_offset, sizeof(new_data)) == leaseNodeId();
+    if (!writeSharedRange(shared_memory_name.c_str(), region_offset, &new_data, sizeof(new_data))) {
+        std::cerr << "[LEASE] No instance holds a lease on shared bytes " << offset << " to "
+                  << offset + sizeof(new_data) << std::endl;
+        return;
+    }
+    if (holder) {
+        std::cout << "[UPDATE] Shared memory updated at " << offset << ": data=" << new_data << std::endl;
+    } else {
+        std::cout << "[UPDATE] Shared memory write at " << offset << " sent to its holder: data=" << new_data
+                  << std::endl;
+    }
+}
+
+/**
+ * Adds to one of the shared region's counters; the sync thread sends the change
+ *
+ * @param counter Index of the counter
+ * @param amount Amount to add, negative to subtract
+ */
+void addToSharedCounter(int counter, int amount) {
+    if (counter < 0 || counter >= shared_counter_count) {
+        std::cout << "No shared counter " << counter << " is configured." << std::endl;
+        return;
+    }
+    char* shared = static_cast<char*>(getSharedMemory(shared_memory_name.c_str()));
+    if (!shared) {
+        std::cerr << "[ERROR] Failed to get shared memory for counter update" << std::endl;
+        return;
+    }
+    CrdtPNCounter* value = reinterpret_cast<CrdtPNCounter*>(
+        shared + MULTI_WRITER_DATA_OFFSET + shared_counters_offset + counter * sizeof(CrdtPNCounter));
+    crdtPNCounterAdd(value, amount);
+    std::cout << "[UPDATE] Shared counter " << counter << " is now " << crdtPNCounterValue(value) << std::endl;
+}
+
+/**
+ * Reads the memory of another instance once, from the instance itself, without replicating it
+ *
+ * @param other_id ID of the other instance
+ */
+void fetchInstanceMemory(int other_id) {
+    std::string memory_name = createMemoryName(other_id);
+    MemoryLayout remote;
+    uint64_t version = 0;
+    if (!fetchRemote(memory_name.c_str(), 0, sizeof(remote), &remote, 1000, &version)) {
+        std::cerr << "[FETCH] No connected instance answered for " << memory_name << std::endl;
+        return;
+    }
+    std::cout << "[FETCH] " << memory_name << " at version " << version << ":" << std::endl;
+    std::cout << "  Data: " << remote.data << std::endl;
+    std::cout << "  Last Modified: " << remote.last_modified << std::endl;
+}
+
+/**
+ * Asks a remote instance for the updates our copy of its memory is missing
+ *
+ * @param other_id ID of the other instance
+ */
+void requestSecondaryResync(int other_id) {
+    std::string memory_name = createMemoryName(other_id);
+    MemoryLayout* memory = static_cast<MemoryLayout*>(getSharedMemory(memory_name.c_str()));
+
+    // A lazy copy fetches each page whole when it is read
+    if (memory && !isLazyRegion(memory_name.c_str())) {
+        requestRegionResync(memory_name.c_str(), memory->version);
+    }
+}
+
 /**
  * Displays the current state of all shared memory regions
  */
@@ -235,11 +456,39 @@ void displayMemoryState() {
             std::cout << "  Data: " << secondary->data << std::endl;
             std::cout << "  Last Modified: " << secondary->last_modified << std::endl;
             std::cout << "  Dirty: " << (secondary->dirty ? "true" : "false") << std::endl;
+            LazyRegionStats lazy;
+            if (getLazyRegionStats(it->second.c_str(), &lazy)) {
+                std::cout << "  Lazy: " << lazy.residentPages << " pages present, " << lazy.pendingPages
+                          << " on their way, " << lazy.bytesFetched / 1024 << " KB fetched" << std::endl;
+            }
         }
     }
 
     unlockMemoryNamesMutex();
 
+    // Display the shared region's leases
+    std::vector<RangeLease> leases;
+    if (!shared_memory_name.empty() && getRangeLeases(shared_memory_name.c_str(), leases)) {
+        MemoryLayout* shared = static_cast<MemoryLayout*>(getSharedMemory(shared_memory_name.c_str()));
+        std::cout << "SHARED (" << shared_memory_name << "):" << std::endl;
+        std::cout << "  Version: " << (shared ? shared->version : 0) << std::endl;
+        for (size_t i = 0; i < leases.size(); ++i) {
+            std::cout << "  Bytes " << leases[i].offset - MULTI_WRITER_DATA_OFFSET << " to "
+                      << leases[i].offset + leases[i].size - MULTI_WRITER_DATA_OFFSET
+                      << " leased by instance " << leases[i].owner;
+            if (leases[i].handoffTo != 0) {
+                std::cout << ", moving to instance " << leases[i].handoffTo;
+            }
+            std::cout << std::endl;
+        }
+        for (int i = 0; shared && i < shared_counter_count; ++i) {
+            const CrdtPNCounter* counter = reinterpret_cast<const CrdtPNCounter*>(
+                reinterpret_cast<const char*>(shared) + MULTI_WRITER_DATA_OFFSET + shared_counters_offset +
+                i * sizeof(CrdtPNCounter));
+            std::cout << "  Counter " << i << ": " << crdtPNCounterValue(counter) << std::endl;
+        }
+    }
+
     std::cout << "================================\n" << std::endl;
 }
 
@@ -255,13 +504,19 @@ void updatePrimaryMemory(int new_data) {
         return;
     }
 
-    // Update the memory
+    // Update the memory under its block's lock, bracketed so snapshot cuts never see half of it
+    size_t first = offsetof(MemoryLayout, data);
+    size_t end = offsetof(MemoryLayout, last_modified) + sizeof(uint64_t);
+    char* segment = reinterpret_cast<char*>(memory);
+    uint64_t stripes = beginBlockWrite(primary_block_locks, &segment, first, end - first);
+    memory = reinterpret_cast<MemoryLayout*>(segment);
     memory->data = new_data;
     memory->last_modified = GetTickCount();  // Use GetTickCount instead of chrono
 
     // Mark the specific fields that changed
     markFieldChanged(primary_memory_name.c_str(), offsetof(MemoryLayout, data), sizeof(int));
     markFieldChanged(primary_memory_name.c_str(), offsetof(MemoryLayout, last_modified), sizeof(uint64_t));
+    endBlockWrite(primary_block_locks, segment, stripes);
 
     // Note: We don't need to manually increment version or set dirty flag
     // as markFieldChanged does this for us
@@ -270,6 +525,32 @@ void updatePrimaryMemory(int new_data) {
               << ", data=" << memory->data << std::endl;
 }
 
+/**
+ * Writes a consistent snapshot of the primary and all secondary regions to a file
+ */
+void writeMemorySnapshot() {
+    std::vector<std::string> names;
+    names.push_back(primary_memory_name);
+
+    initMemoryNamesMutex();
+    lockMemoryNamesMutex();
+    std::map<int, std::string>::iterator it;
+    for (it = secondary_memory_names.begin(); it != secondary_memory_names.end(); ++it) {
+        names.push_back(it->second);
+    }
+    unlockMemoryNamesMutex();
+
+    SnapshotCut cut;
+    if (!captureSnapshotCut(names, cut)) {
+        std::cerr << "[ERROR] Failed to capture a snapshot" << std::endl;
+        return;
+    }
+
+    std::ostringstream path;
+    path << "snapshot_instance" << instance_id << ".bin";
+    writeSnapshotFile(cut, path.str().c_str(), true);
+}
+
 /**
  * Displays the menu of available commands
  */
@@ -279,6 +560,11 @@ void displayMenu() {
     std::cout << "  2. Display memory state" << std::endl;
     std::cout << "  3. Connect to another instance" << std::endl;
     std::cout << "  4. Exit" << std::endl;
+    std::cout << "  5. Write snapshot of all regions" << std::endl;
+    std::cout << "  6. Show thread placement" << std::endl;
+    std::cout << "  7. Update shared memory" << std::endl;
+    std::cout << "  8. Add to a shared counter" << std::endl;
+    std::cout << "  9. Read another instance's memory once" << std::endl;
     std::cout << "Enter command number: ";
 }
 
@@ -328,6 +614,23 @@ void displayUsage(const char* programName) {
     std::cout << "  local_port = <port>              Local port number" << std::endl;
     std::cout << "  instance_id = <id>                Instance ID" << std::endl;
     std::cout << "  remote_node = <ip>:<port>:<id>   Remote node to connect to" << std::endl;
+    std::cout << "  region_dir = <dir>               Directory for file-backed regions (optional)" << std::endl;
+    std::cout << "  region_prefault = <mode>         none, async, sync or locked (default: none)" << std::endl;
+    std::cout << "  version_history_kb = <kb>        History per replicated region (default: 0, none)" << std::endl;
+    std::cout << "  lazy_region_mb = <mb>            Fetch remote regions' pages on first access (default: 0, off)" << std::endl;
+    std::cout << "  bootstrap_snapshot = <file>      Snapshot file new replicas are seeded from (optional)" << std::endl;
+    std::cout << "  thread_placement = <mode>        none or numa (default: none)" << std::endl;
+    std::cout << "  network_numa_node = <node>       Node for the receive thread (default: -1, follow regions)" << std::endl;
+    std::cout << "  region_checksums = <bool>        true or false: check copies against their owner (default: false)" << std::endl;
+    std::cout << "  peer_key = <ip>:<port>:<hex>     AES key shared with a remote node, 32 or 64 hex digits" << std::endl;
+    std::cout << "  shared_region = <name>:<bytes>   Multi-writer region shared by all instances (optional)" << std::endl;
+    std::cout << "  lease_range = <offset>:<bytes>   Range of the shared region this instance writes" << std::endl;
+    std::cout << "  lease_duration_ms = <ms>         Lease length between renewals (default: 10000)" << std::endl;
+    std::cout << "  lease_migration_writes = <n>     Writes/s by another instance that move a lease to it (default: 32)" << std::endl;
+    std::cout << "  shared_counters = <offset>:<n>   Counters in the shared region every instance adds to" << std::endl;
+    std::cout << "  journal_dir = <dir>              Update journal directory (optional)" << std::endl;
+    std::cout << "  journal_size_mb = <mb>           Journal size per region (default: 64)" << std::endl;
+    std::cout << "  checkpoint_interval_s = <s>      Seconds between checkpoints (default: 60)" << std::endl;
     std::cout << std::endl;
     std::cout << "Example configuration file:" << std::endl;
     std::cout << "  local_ip = 127.0.0.1" << std::endl;
@@ -394,6 +697,45 @@ int main(int argc, char* argv[]) {
 
     std::cout << "[INIT] Starting instance " << instance_id << " on " << local_ip << ":" << local_port << std::endl;
 
+    // Keep regions in files if configured
+    region_dir = config.getRegionDir();
+    parseRegionPrefaultMode(config.getRegionPrefault().c_str(), &region_prefault);
+    version_history_bytes = static_cast<size_t>(config.getVersionHistoryKb()) * 1024;
+    lazy_region_bytes = static_cast<size_t>(config.getLazyRegionMb()) * 1024 * 1024;
+    bootstrap_snapshot = config.getBootstrapSnapshot();
+
+    // Place threads on the NUMA nodes of their memory; must be set before any thread starts
+    configureThreadPlacement(config.getThreadPlacement() == "numa", config.getNetworkNumaNode(), local_ip.c_str());
+
+    // Check copies against the CRC their owner sends
+    setRegionChecksumsEnabled(config.getRegionChecksums());
+
+    // Stamp the updates this instance writes with its ID, so writes to leased ranges can be checked
+    setLeaseNodeId(static_cast<uint32_t>(instance_id));
+
+    // Encrypt sync traffic with the keys shared with each peer; must be set before the network starts
+    setSecureSenderId(static_cast<uint32_t>(instance_id));
+    const std::vector<Config::PeerKey>& peerKeys = config.getPeerKeys();
+    for (size_t i = 0; i < peerKeys.size(); ++i) {
+        std::vector<unsigned char> key;
+        if (!parseSyncKey(peerKeys[i].key, key) ||
+            !addPeerKey(peerKeys[i].ip.c_str(), peerKeys[i].port, &key[0], key.size())) {
+            std::cerr << "[ERROR] Invalid key for " << peerKeys[i].ip << ":" << peerKeys[i].port << std::endl;
+            return 1;
+        }
+    }
+    if (syncEncryptionEnabled()) {
+        std::cout << "[INIT] Sync traffic encrypted with AES-GCM for " << peerKeys.size() << " peer(s)"
+                  << (aesGcmUsesHardware() ? " (AES-NI)" : "") << std::endl;
+    }
+
+    // Enable the update journal if configured
+    if (!config.getJournalDir().empty()) {
+        setJournalDirectory(config.getJournalDir().c_str(),
+                            static_cast<size_t>(config.getJournalSizeMb()) * 1024 * 1024);
+        setCheckpointInterval(static_cast<uint32_t>(config.getCheckpointIntervalS()) * 1000);
+    }
+
     // Initialize primary shared memory
     if (!initializePrimaryMemory()) {
         std::cerr << "[ERROR] Failed to initialize primary shared memory" << std::endl;
@@ -410,6 +752,14 @@ int main(int argc, char* argv[]) {
     // Register network update callback
     registerNetworkUpdateCallback(networkUpdateCallback);
 
+    // Join the multi-writer region if configured
+    if (!config.getSharedRegion().empty() && !initializeSharedRegion(config)) {
+        std::cerr << "[ERROR] Failed to initialize the shared region" << std::endl;
+        shutdownNetworkSync();
+        cleanupSharedMemory(primary_memory_name.c_str());
+        return 1;
+    }
+
     // Connect to remote nodes from configuration
     const std::vector<Config::RemoteNode>& remoteNodes = config.getRemoteNodes();
     for (size_t i = 0; i < remoteNodes.size(); ++i) {
@@ -432,6 +782,9 @@ int main(int argc, char* argv[]) {
             std::cerr << "[WARNING] Failed to connect to remote node" << std::endl;
             // Continue anyway, they might connect to us later
         }
+
+        // Catch up on anything we missed while we were down
+        requestSecondaryResync(remote_instance_id);
     }
 
     std::cout << "[INIT] Initialization complete. Starting interactive mode." << std::endl;
@@ -503,6 +856,7 @@ int main(int argc, char* argv[]) {
                 if (!connectToRemoteNode(remote_ip.c_str(), remote_port)) {
                     std::cerr << "[WARNING] Failed to connect to remote node" << std::endl;
                 }
+                requestSecondaryResync(remote_instance_id);
                 break;
             }
 
@@ -510,6 +864,64 @@ int main(int argc, char* argv[]) {
                 running = false;
                 break;
 
+            case 5: // Write snapshot
+                writeMemorySnapshot();
+                break;
+
+            case 6: // Show thread placement
+                reportThreadPlacement();
+                break;
+
+            case 7: { // Update shared memory
+                std::cout << "Enter offset in shared memory: ";
+                std::getline(std::cin, input);
+                int offset = atoi(input.c_str());
+                if (offset < 0 || (offset == 0 && input != "0")) {
+                    std::cout << "Invalid offset." << std::endl;
+                    break;
+                }
+                std::cout << "Enter new data value: ";
+                std::getline(std::cin, input);
+                int new_data = atoi(input.c_str());
+                if (new_data == 0 && input != "0") {
+                    std::cout << "Invalid data value. Please enter a number." << std::endl;
+                } else {
+                    updateSharedMemory(static_cast<size_t>(offset), new_data);
+                }
+                break;
+            }
+
+            case 8: { // Add to a shared counter
+                std::cout << "Enter counter number: ";
+                std::getline(std::cin, input);
+                int counter = atoi(input.c_str());
+                if (counter == 0 && input != "0") {
+                    std::cout << "Invalid counter number." << std::endl;
+                    break;
+                }
+                std::cout << "Enter amount to add: ";
+                std::getline(std::cin, input);
+                int amount = atoi(input.c_str());
+                if (amount == 0 && input != "0") {
+                    std::cout << "Invalid amount. Please enter a number." << std::endl;
+                } else {
+                    addToSharedCounter(counter, amount);
+                }
+                break;
+            }
+
+            case 9: { // Read another instance's memory once
+                std::cout << "Enter instance ID: ";
+                std::getline(std::cin, input);
+                int other_id = atoi(input.c_str());
+                if (other_id == 0) {
+                    std::cout << "Invalid instance ID." << std::endl;
+                } else {
+                    fetchInstanceMemory(other_id);
+                }
+                break;
+            }
+
             default:
                 std::cout << "Unknown command." << std::endl;
                 break;
@@ -519,10 +931,21 @@ int main(int argc, char* argv[]) {
     // Clean up
     std::cout << "[CLEANUP] Stopping shared memory sync..." << std::endl;
 
+    // Flush and close the update journals while the regions still exist
+    shutdownUpdateJournals();
+
     // Stop primary memory sync
     stopSharedMemorySync(primary_memory_name.c_str());
+    detachBlockLocks(primary_memory_name.c_str());
     cleanupSharedMemory(primary_memory_name.c_str());
 
+    // Stop shared memory sync; this instance's leases lapse
+    if (!shared_memory_name.empty()) {
+        stopSharedMemorySync(shared_memory_name.c_str());
+        unregisterCrdtFields(shared_memory_name.c_str());
+        cleanupSharedMemory(shared_memory_name.c_str());
+    }
+
     // Stop secondary memory syncs
     // Initialize the mutex if needed
     initMemoryNamesMutex();
@@ -533,6 +956,11 @@ int main(int argc, char* argv[]) {
     std::map<int, std::string>::iterator it;
     for (it = secondary_memory_names.begin(); it != secondary_memory_names.end(); ++it) {
         stopSharedMemorySync(it->second.c_str());
+        stopLazyRegion(it->second.c_str());
+        stopRegionChecksums(it->second.c_str());
+        if (secondary_histories.count(it->first)) {
+            stopVersionHistory(secondary_histories[it->first]);
+        }
         cleanupSharedMemory(it->second.c_str());
     }
 
@@ -546,6 +974,7 @@ int main(int argc, char* argv[]) {
 
     // Shutdown network
     shutdownNetworkSync();
+    clearPeerKeys();
 
     std::cout << "[CLEANUP] Application exited cleanly" << std::endl;
     return 0;
@@ -3,12 +3,27 @@
 
 #include <stdint.h>
 
+// Stamped into MemoryLayout::magic of every region that has been initialized
+#define REGION_MAGIC 0x4E474552u  // "REGN"
+
+// MemoryLayout::sequence counts the writes in progress in its low bits and the finished ones above them
+#define REGION_WRITERS_MASK 0x3Fu
+#define REGION_RESIZING 0x40u     // Being copied to a larger segment; changes are marked in "<name>.resize"
+#define REGION_RETIRED 0x80u      // Replaced by a larger segment; no write may start on it
+#define REGION_WRITE_DONE 0x100u
+
 // Define the layout of the shared memory as used in main.cpp
 typedef struct {
     uint64_t version;           // Version number that increments with each change
     int data;                   // Example data field
+    volatile uint32_t sequence; // Local write sequence (writers in progress, then writes done); never replicated
     uint64_t last_modified;     // Timestamp of last modification
     bool dirty;                 // Flag indicating if data has been modified
+    // The fields below describe the local segment and are never replicated
+    uint32_t magic;             // REGION_MAGIC once the region has been initialized
+    uint32_t layoutHash;        // Hash of the header layout, initial region size and layout ID (see RegionOptions)
+    uint32_t generation;        // Latest segment generation; generation n > 0 is the segment "<name>.g<n>"
+    uint64_t segmentSize;       // Size of the latest generation's segment
 } MemoryLayout;
 
 #endif // MEMORY_LAYOUT_H
\ No newline at end of file
@@ -17,10 +17,30 @@
 #include "shared_memory.h"
 #include "memory_layout.h"
 #include "change_tracking.h"
+#include "update_journal.h"
+#include "block_hash.h"
+#include "thread_placement.h"
+#include "region_checksum.h"
+#include "sync_crypto.h"
+#include "range_lease.h"
+#include "crdt_field.h"
+#include "lazy_region.h"
+#include "remote_fetch.h"
+#include "block_locks.h"
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <process.h>  // For _beginthreadex
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/epoll.h>
+#endif
 
 /**
  * @brief Global variables for network synchronization
@@ -32,6 +52,14 @@
 /// Socket used for sending and receiving synchronization messages
 static SOCKET g_socket = INVALID_SOCKET;
 
+/// Receive buffer requested for g_socket; the system may cap it (net.core.rmem_max on Linux)
+#define SYNC_SOCKET_BUFFER_SIZE (4 * 1024 * 1024)
+
+#ifndef _WIN32
+/// epoll instance watching g_socket, so the receive loop sleeps in a single call
+static int g_socketEpoll = -1;
+#endif
+
 /// IP address of the local node
 static std::string g_localIp;
 
@@ -41,9 +69,13 @@ static int g_localPort;
 /// Map of remote nodes (key: "ip:port", value: "ip:port")
 static std::map<std::string, std::string> g_remoteNodes;
 
-/// Mutex to protect access to the g_remoteNodes map
+/// Mutex to protect access to the g_remoteNodes map and the lease node addresses
 static HANDLE g_remoteNodesMutex = NULL;
 
+/// Address of each lease node, learned from the updates it sends; port 0 until known
+static std::string g_leaseNodeIps[MAX_LEASE_NODES];
+static int g_leaseNodePorts[MAX_LEASE_NODES];
+
 /// Thread handle that receives synchronization messages from the network
 static HANDLE g_receiveThread = NULL;
 
@@ -56,9 +88,57 @@ NetworkUpdateCallback g_networkCallback = NULL;
 /// Map of threads that monitor shared memory regions for changes (key: memory name, value: thread handle)
 static std::map<std::string, HANDLE> g_syncThreads;
 
-/// Mutex to protect access to the g_syncThreads map
+/// Manual-reset events that stop the threads in g_syncThreads, by memory name
+static std::map<std::string, HANDLE> g_syncStopEvents;
+
+/// Mutex to protect access to the g_syncThreads and g_syncStopEvents maps, g_sourceRegions and g_syncBlockLocks
 static HANDLE g_syncThreadsMutex = NULL;
 
+/// Regions written by this node, which answer resync requests without a journal
+static std::set<std::string> g_sourceRegions;
+
+/// Regions whose sync thread attached the block locks, detached when it is stopped
+static std::set<std::string> g_syncBlockLocks;
+
+/**
+ * @brief Block hashes received from a peer for one resync session
+ */
+struct BlockHashSession {
+    std::string memoryName;         // Region being resynced
+    size_t peerSize;                // Size of the peer's copy
+    std::vector<BlockHash> hashes;  // The peer's hashes, indexed by block
+    std::vector<bool> received;     // Whether each hash has arrived
+    ULONGLONG startTime;            // When the first batch arrived
+};
+
+/// Open block-hash sessions by update ID (receive thread only)
+static std::map<uint64_t, BlockHashSession> g_hashSessions;
+
+/// Sessions whose last batch never arrives are dropped after this long
+#define BLOCK_HASH_SESSION_TIMEOUT_MS 30000
+
+/**
+ * @brief A block transfer to one peer, waiting for the hashes of its current round
+ */
+struct PeerResyncTransfer {
+    std::string memoryName;         // Region being resynced
+    std::string ip;                 // Address of the peer
+    int port;                       // Port of the peer
+    ResyncTransfer transfer;        // Blocks sent and still to send
+    uint64_t requestId;             // updateId of the round's MSG_BLOCK_HASH_REQUEST
+    ULONGLONG sentTime;             // When the round was sent
+    ULONGLONG roundTimeout;         // How long the round waits for its hashes
+};
+
+/// Block transfers by "<region>|<ip>:<port>" (receive thread only)
+static std::map<std::string, PeerResyncTransfer> g_resyncTransfers;
+
+/// How long the first round waits for its hashes, and the most any round waits
+#define RESYNC_ROUND_TIMEOUT_MS 500
+
+/// The least a round waits; later rounds wait four times as long as the last answered one took
+#define RESYNC_MIN_ROUND_TIMEOUT_MS 50
+
 /**
  * @brief Initialize the mutexes for thread safety
  *
@@ -160,7 +240,18 @@ bool initializeWinsock() {
  */
 SOCKET createSocket() {
     // Create a UDP socket (SOCK_DGRAM) using IPv4 (AF_INET) and the UDP protocol (IPPROTO_UDP)
-    return socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    // Resyncs, page requests and fetches answer with bursts of datagrams; room for
+    // them in the socket means a burst isn't dropped while the receive loop applies one
+    if (sock != INVALID_SOCKET) {
+        int bufferSize = SYNC_SOCKET_BUFFER_SIZE;
+        if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize),
+                       sizeof(bufferSize)) == SOCKET_ERROR) {
+            std::cerr << "[NETWORK] Failed to set the receive buffer size: " << WSAGetLastError() << std::endl;
+        }
+    }
+    return sock;
 }
 
 /**
@@ -192,7 +283,8 @@ bool bindSocket(SOCKET sock, const char* ipAddress, int port) {
  * @brief Sends a synchronization message to a remote node
  *
  * This function sends a SyncMessage structure to a specific IP address and port
- * using a UDP socket.
+ * using a UDP socket. The datagram is stamped with the CRC of the message and,
+ * when encryption is on, sealed with the key of the destination.
  *
  * @param sock The socket to send from
  * @param ipAddress The destination IP address
@@ -209,20 +301,70 @@ bool sendSyncMessage(SOCKET sock, const char* ipAddress, int port, const SyncMes
     // Convert IP address string to binary form
     inet_pton(AF_INET, ipAddress, &destAddr.sin_addr);
 
+    // Stamp a copy, so callers can keep reusing their message
+    SyncMessage stamped = message;
+    stampSyncMessage(stamped);
+
+    // With encryption on, a peer without a key gets nothing rather than plaintext
+    const char* datagram = reinterpret_cast<const char*>(&stamped);
+    size_t datagramSize = sizeof(stamped);
+    char sealed[MAX_SECURE_DATAGRAM_SIZE];
+    if (syncEncryptionEnabled()) {
+        datagramSize = sealSyncMessage(stamped, ipAddress, port, sealed);
+        if (datagramSize == 0) {
+            return false;
+        }
+        datagram = sealed;
+    }
+
     // Send the message to the destination address
-    // We need to cast the message to a char* for the sendto() function
-    int result = sendto(sock, reinterpret_cast<const char*>(&message), sizeof(message), 0,
+    int result = sendto(sock, datagram, static_cast<int>(datagramSize), 0,
                         reinterpret_cast<sockaddr*>(&destAddr), sizeof(destAddr));
 
     // Return true if sending succeeded (sendto() returns the number of bytes sent on success, SOCKET_ERROR on failure)
     return result != SOCKET_ERROR;
 }
 
+/**
+ * @brief Waits for a datagram to arrive on a socket
+ *
+ * On Linux the wait is an epoll_wait on the instance registered for
+ * g_socket; other sockets fall back to poll. Winsock uses select.
+ *
+ * @param sock The socket to wait on
+ * @param timeoutMs How long to wait in milliseconds
+ * @return true if a datagram can be read, false on timeout or error
+ */
+static bool waitForDatagram(SOCKET sock, int timeoutMs) {
+#ifdef _WIN32
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(sock, &readSet);
+
+    timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    return select(0, &readSet, NULL, NULL, &timeout) > 0;
+#else
+    if (g_socketEpoll >= 0 && sock == g_socket) {
+        epoll_event event;
+        return epoll_wait(g_socketEpoll, &event, 1, timeoutMs) > 0;
+    }
+    pollfd entry;
+    entry.fd = sock;
+    entry.events = POLLIN;
+    entry.revents = 0;
+    return poll(&entry, 1, timeoutMs) > 0;
+#endif
+}
+
 /**
  * @brief Receives a synchronization message from the network
  *
  * This function waits for a synchronization message to arrive on a socket and
- * returns the message along with the source IP address and port.
+ * returns the message along with the source IP address and port. Datagrams
+ * that are short or fail their CRC check are dropped, as are datagrams that
+ * don't open with the sender's key when encryption is on.
  *
  * @param sock The socket to receive on
  * @param message Reference to a SyncMessage structure to store the received message
@@ -233,31 +375,19 @@ bool sendSyncMessage(SOCKET sock, const char* ipAddress, int port, const SyncMes
 bool receiveSyncMessage(SOCKET sock, SyncMessage& message, std::string& sourceIp, int& sourcePort) {
     // Create a sockaddr_in structure to store the source address information
     sockaddr_in srcAddr;
-    int addrLen = sizeof(srcAddr);
-
-    // Set up a timeout for the socket using select
-    fd_set readSet;
-    FD_ZERO(&readSet);
-    FD_SET(sock, &readSet);
-
-    // Set up a timeout of 100ms
-    timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 100000; // 100ms
-
-    // Wait for the socket to be ready for reading or timeout
-    int selectResult = select(0, &readSet, NULL, NULL, &timeout);
+    socklen_t addrLen = sizeof(srcAddr);
 
-    // Check if select timed out or failed
-    if (selectResult <= 0) {
-        // Timeout or error, not a failure, just no data available
+    // Wait up to 100ms for a datagram; a timeout is not a failure, just no data
+    if (!waitForDatagram(sock, 100)) {
         return false;
     }
 
-    // Receive a message from the socket
-    // We need to cast the message to a char* for the recvfrom() function
-    int result = recvfrom(sock, reinterpret_cast<char*>(&message), sizeof(message), 0,
-                          reinterpret_cast<sockaddr*>(&srcAddr), &addrLen);
+    // Receive a message from the socket; sealed datagrams land in a separate buffer first
+    bool encrypted = syncEncryptionEnabled();
+    char sealed[MAX_SECURE_DATAGRAM_SIZE];
+    char* buffer = encrypted ? sealed : reinterpret_cast<char*>(&message);
+    int bufferSize = encrypted ? static_cast<int>(sizeof(sealed)) : static_cast<int>(sizeof(message));
+    int result = recvfrom(sock, buffer, bufferSize, 0, reinterpret_cast<sockaddr*>(&srcAddr), &addrLen);
 
     // If receiving succeeded (recvfrom() returns the number of bytes received on success, SOCKET_ERROR on failure)
     if (result != SOCKET_ERROR) {
@@ -268,6 +398,18 @@ bool receiveSyncMessage(SOCKET sock, SyncMessage& message, std::string& sourceIp
         // Store the source IP address and port
         sourceIp = ipStr;
         sourcePort = ntohs(srcAddr.sin_port);  // Convert port from network byte order
+
+        size_t messageBytes = static_cast<size_t>(result);
+        if (encrypted && !openSyncMessage(sealed, messageBytes, ipStr, sourcePort, message, &messageBytes)) {
+            std::cerr << "[CRYPTO] Dropped datagram from " << sourceIp << ":" << sourcePort << std::endl;
+            return false;
+        }
+
+        // Nothing from a damaged datagram may reach a region
+        if (!verifySyncMessage(message, messageBytes)) {
+            std::cerr << "[INTEGRITY] Dropped a corrupt datagram from " << sourceIp << ":" << sourcePort << std::endl;
+            return false;
+        }
         return true;
     }
     return false;
@@ -284,6 +426,533 @@ void cleanupWinsock() {
     WSACleanup();
 }
 
+/**
+ * @brief Build the MSG_RESIZE message announcing a region's size
+ *
+ * @param message Receives the message
+ * @param memoryName Name of the region
+ * @param version Version of the region when it grew
+ * @param newSize Size of the region from that version on
+ */
+static void buildResizeMessage(SyncMessage& message, const char* memoryName, uint64_t version, size_t newSize) {
+    memset(&message, 0, sizeof(message));
+    message.msgType = MSG_RESIZE;
+    strncpy(message.memoryName, memoryName, sizeof(message.memoryName) - 1);
+    message.updateId = generateUniqueId();
+    message.version = version;
+    message.timestamp = GetTickCount();
+
+    RegionResizeInfo info;
+    info.newSize = newSize;
+    memcpy(message.data, &info, sizeof(info));
+    message.size = sizeof(info);
+}
+
+/**
+ * @brief Send a message to every remote node
+ */
+static void broadcastSyncMessage(const SyncMessage& message) {
+    lockRemoteNodesMutex();
+    std::map<std::string, std::string>::iterator it;
+    for (it = g_remoteNodes.begin(); it != g_remoteNodes.end(); ++it) {
+        // The node value has the format "ip:port"
+        size_t colonPos = it->second.find(':');
+        if (colonPos != std::string::npos) {
+            std::string ip = it->second.substr(0, colonPos);
+            int port = atoi(it->second.substr(colonPos + 1).c_str());
+            sendSyncMessage(g_socket, ip.c_str(), port, message);
+        }
+    }
+    unlockRemoteNodesMutex();
+}
+
+/**
+ * @brief Check whether this node answers resync requests for a region
+ */
+static bool isRegionSource(const char* memoryName) {
+    if (isJournalSource(memoryName)) {
+        return true;
+    }
+    lockSyncThreadsMutex();
+    bool source = g_sourceRegions.find(memoryName) != g_sourceRegions.end();
+    unlockSyncThreadsMutex();
+    return source;
+}
+
+/**
+ * @brief Answer a peer's request for updates newer than its version
+ *
+ * Sends the journaled updates after the requested version as single updates,
+ * flagging every part of a version except its last. If the journal no longer
+ * reaches back that far, or there is no journal, the peer is asked for the
+ * block hashes of its copy so only the blocks that differ are sent.
+ *
+ * @param request The MSG_RESYNC_REQUEST message
+ * @param ip Address of the requesting node
+ * @param port Port of the requesting node
+ */
+static void serveResyncRequest(const SyncMessage& request, const std::string& ip, int port) {
+    // The peer has started or rejoined; the pages its lazy copy had fetched may be gone
+    char peer[64];
+    sprintf(peer, "%.40s:%d", ip.c_str(), port);
+    resetLazyPeer(request.memoryName, peer);
+
+    // A region that has grown since it was created tells the peer its size first
+    size_t currentSize = 0;
+    const MemoryLayout* current = static_cast<const MemoryLayout*>(
+        getSharedMemoryMapping(request.memoryName, &currentSize));
+    if (!current || currentSize < sizeof(MemoryLayout)) {
+        return;
+    }
+    if (current->generation > 0) {
+        SyncMessage resize;
+        buildResizeMessage(resize, request.memoryName, current->version, currentSize);
+        sendSyncMessage(g_socket, ip.c_str(), port, resize);
+    }
+
+    std::vector<JournalUpdate> updates;
+    if (collectJournalUpdates(request.memoryName, request.version, updates)) {
+        for (size_t i = 0; i < updates.size(); i++) {
+            SyncMessage& message = updates[i].message;
+            message.updateId = generateUniqueId();
+            message.timestamp = GetTickCount();
+            message.flags = updates[i].lastChunk ? 0 : SYNC_FLAG_MORE_IN_VERSION;
+            sendSyncMessage(g_socket, ip.c_str(), port, message);
+        }
+        std::cout << "[RESYNC] Sent " << updates.size() << " journaled updates for "
+                  << request.memoryName << " to " << ip << ":" << port << std::endl;
+        return;
+    }
+
+    SyncMessage message;
+    memset(&message, 0, sizeof(message));
+    message.msgType = MSG_BLOCK_HASH_REQUEST;
+    strncpy(message.memoryName, request.memoryName, sizeof(message.memoryName) - 1);
+    message.updateId = generateUniqueId();
+    message.version = current->version;
+    message.timestamp = GetTickCount();
+    sendSyncMessage(g_socket, ip.c_str(), port, message);
+}
+
+/**
+ * @brief Answer a lazy copy's request for a page of a region this node is the source of
+ *
+ * @param request The MSG_PAGE_REQUEST message
+ * @param ip Address of the requesting node
+ * @param port Port of the requesting node
+ */
+static void servePageRequest(const SyncMessage& request, const std::string& ip, int port) {
+    char peer[64];
+    sprintf(peer, "%.40s:%d", ip.c_str(), port);
+    std::vector<SyncMessage> replies;
+    if (!buildLazyPageReplies(request, peer, replies)) {
+        std::cerr << "[LAZY] Ignoring page request for " << request.memoryName << " at offset "
+                  << request.offset << " from " << peer << std::endl;
+        return;
+    }
+    for (size_t i = 0; i < replies.size(); i++) {
+        sendSyncMessage(g_socket, ip.c_str(), port, replies[i]);
+    }
+}
+
+/**
+ * @brief Answer another node's fetch of a range of a region this node is the source of
+ *
+ * @param request The MSG_FETCH_REQUEST message
+ * @param ip Address of the requesting node
+ * @param port Port of the requesting node
+ */
+static void serveFetchRequest(const SyncMessage& request, const std::string& ip, int port) {
+    char peer[64];
+    sprintf(peer, "%.40s:%d", ip.c_str(), port);
+    std::vector<SyncMessage> replies;
+    if (!buildFetchReplies(request, peer, replies)) {
+        std::cerr << "[FETCH] Ignoring fetch request for " << request.memoryName << " at offset "
+                  << request.offset << " from " << peer << std::endl;
+        return;
+    }
+    for (size_t i = 0; i < replies.size(); i++) {
+        sendSyncMessage(g_socket, ip.c_str(), port, replies[i]);
+    }
+}
+
+/**
+ * @brief Send the block hashes of the local copy of a region to its source
+ *
+ * A request flagged SYNC_FLAG_BLOCK_RANGE asks for some blocks only; the
+ * answer then carries the request's updateId and the same flag.
+ *
+ * @param request The MSG_BLOCK_HASH_REQUEST message, or the MSG_REGION_CHECKSUM it didn't match
+ * @param ip Address of the source node
+ * @param port Port of the source node
+ */
+static void sendBlockHashes(const SyncMessage& request, const std::string& ip, int port) {
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(request.memoryName, &regionSize));
+    if (!region) {
+        return;
+    }
+
+    size_t first = 0;
+    size_t end = regionBlockCount(regionSize);
+    bool ranged = request.msgType == MSG_BLOCK_HASH_REQUEST && (request.flags & SYNC_FLAG_BLOCK_RANGE) &&
+                  request.size == sizeof(BlockHashRangeInfo);
+    if (ranged) {
+        BlockHashRangeInfo range;
+        memcpy(&range, request.data, sizeof(range));
+        first = (range.firstBlock < end) ? static_cast<size_t>(range.firstBlock) : end;
+        if (range.blockCount < end - first) {
+            end = first + static_cast<size_t>(range.blockCount);
+        }
+    }
+
+    std::vector<BlockHash> hashes(end - first);
+    for (size_t block = first; block < end; block++) {
+        hashRegionBlock(region, regionSize, block, &hashes[block - first]);
+    }
+
+    SyncMessage message;
+    memset(&message, 0, sizeof(message));
+    message.msgType = MSG_BLOCK_HASHES;
+    strncpy(message.memoryName, request.memoryName, sizeof(message.memoryName) - 1);
+    message.updateId = ranged ? request.updateId : generateUniqueId();
+    message.version = (regionSize >= sizeof(MemoryLayout)) ? reinterpret_cast<const MemoryLayout*>(region)->version : 0;
+
+    // An empty region or range still sends one batch so the source knows the session is complete
+    size_t sent = 0;
+    do {
+        size_t count = hashes.size() - sent;
+        if (count > BLOCK_HASHES_PER_MESSAGE) {
+            count = BLOCK_HASHES_PER_MESSAGE;
+        }
+        BlockHashBatch batch;
+        batch.regionSize = regionSize;
+        batch.firstBlock = first + sent;
+        memcpy(message.data, &batch, sizeof(batch));
+        if (count > 0) {
+            memcpy(message.data + sizeof(batch), &hashes[sent], count * sizeof(BlockHash));
+        }
+        message.size = sizeof(batch) + count * sizeof(BlockHash);
+        message.offset = (first + sent) * RESYNC_BLOCK_SIZE;
+        message.timestamp = GetTickCount();
+        sent += count;
+        message.flags = (sent < hashes.size()) ? SYNC_FLAG_MORE_IN_VERSION : 0;
+        if (ranged) {
+            message.flags |= SYNC_FLAG_BLOCK_RANGE;
+        }
+        sendSyncMessage(g_socket, ip.c_str(), port, message);
+    } while (sent < hashes.size());
+}
+
+/**
+ * @brief Send one block of a region to a peer as single updates at the region's version
+ *
+ * Every part is flagged SYNC_FLAG_MORE_IN_VERSION except, when claimVersion
+ * is set, the last, so the peer adopts the version with it.
+ */
+static void sendResyncBlock(const char* memoryName, const char* region, size_t regionSize, size_t block,
+                            bool claimVersion, const std::string& ip, int port) {
+    size_t start = block * RESYNC_BLOCK_SIZE;
+    if (start >= regionSize) {
+        return;
+    }
+    size_t end = (regionSize - start > RESYNC_BLOCK_SIZE) ? start + RESYNC_BLOCK_SIZE : regionSize;
+
+    // The copy races with local writes; those are re-sent by the sync thread anyway
+    SyncMessage message;
+    memset(&message, 0, sizeof(message));
+    message.msgType = MSG_SINGLE_UPDATE;
+    strncpy(message.memoryName, memoryName, sizeof(message.memoryName) - 1);
+    message.version = reinterpret_cast<const MemoryLayout*>(region)->version;
+    for (size_t offset = start; offset < end; offset += message.size) {
+        message.updateId = generateUniqueId();
+        message.offset = offset;
+        message.size = (end - offset > MAX_SYNC_DATA_SIZE) ? MAX_SYNC_DATA_SIZE : end - offset;
+        message.timestamp = GetTickCount();
+        bool last = claimVersion && offset + message.size == end;
+        message.flags = last ? 0 : SYNC_FLAG_MORE_IN_VERSION;
+        memcpy(message.data, region + offset, message.size);
+        sendSyncMessage(g_socket, ip.c_str(), port, message);
+    }
+}
+
+/**
+ * @brief Send the next round of a block transfer and ask the peer for the hashes of its blocks
+ *
+ * @param state The transfer
+ * @return false when the transfer is over, with nothing left to send
+ */
+static bool sendResyncRound(PeerResyncTransfer& state) {
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(state.memoryName.c_str(), &regionSize));
+    if (!region || regionSize < sizeof(MemoryLayout) || !nextResyncRound(&state.transfer)) {
+        return false;
+    }
+
+    const std::vector<size_t>& round = state.transfer.round;
+    for (size_t i = 0; i < round.size(); i++) {
+        sendResyncBlock(state.memoryName.c_str(), region, regionSize, round[i], round[i] == 0, state.ip, state.port);
+    }
+
+    BlockHashRangeInfo range;
+    size_t firstBlock = 0;
+    size_t blockCount = 0;
+    resyncRoundSpan(&state.transfer, &firstBlock, &blockCount);
+    range.firstBlock = firstBlock;
+    range.blockCount = blockCount;
+
+    SyncMessage request;
+    memset(&request, 0, sizeof(request));
+    request.msgType = MSG_BLOCK_HASH_REQUEST;
+    strncpy(request.memoryName, state.memoryName.c_str(), sizeof(request.memoryName) - 1);
+    request.updateId = generateUniqueId();
+    request.version = reinterpret_cast<const MemoryLayout*>(region)->version;
+    request.timestamp = GetTickCount();
+    request.flags = SYNC_FLAG_BLOCK_RANGE;
+    request.size = sizeof(range);
+    memcpy(request.data, &range, sizeof(range));
+    sendSyncMessage(g_socket, state.ip.c_str(), state.port, request);
+
+    state.requestId = request.updateId;
+    state.sentTime = GetTickCount64();
+    return true;
+}
+
+/**
+ * @brief Move a block transfer on after a round, ending it when done or stuck
+ *
+ * @param key The transfer's key in g_resyncTransfers
+ * @param stillDiffering Blocks of the round that the peer's copy still doesn't match
+ * @param answered Whether the peer's hashes came back, rather than the round timing out
+ */
+static void finishRound(const std::string& key, const std::vector<size_t>& stillDiffering, bool answered) {
+    std::map<std::string, PeerResyncTransfer>::iterator it = g_resyncTransfers.find(key);
+    if (it == g_resyncTransfers.end()) {
+        return;
+    }
+    PeerResyncTransfer& state = it->second;
+
+    // Wait in proportion to how long the peer takes to answer, backing off while it doesn't
+    ULONGLONG timeout = answered ? 4 * (GetTickCount64() - state.sentTime) : 2 * state.roundTimeout;
+    state.roundTimeout = (timeout < RESYNC_MIN_ROUND_TIMEOUT_MS) ? RESYNC_MIN_ROUND_TIMEOUT_MS
+                       : (timeout > RESYNC_ROUND_TIMEOUT_MS) ? RESYNC_ROUND_TIMEOUT_MS : timeout;
+    if (!finishResyncRound(&state.transfer, stillDiffering)) {
+        std::cerr << "[RESYNC] Gave up sending " << state.transfer.pending.size() << " blocks of "
+                  << state.memoryName << " to " << state.ip << ":" << state.port << " after "
+                  << RESYNC_MAX_FAILED_ROUNDS << " rounds without progress" << std::endl;
+        g_resyncTransfers.erase(it);
+        return;
+    }
+    if (!sendResyncRound(state)) {
+        std::cout << "[RESYNC] Sent " << state.memoryName << " to " << state.ip << ":" << state.port
+                  << " (" << state.transfer.blocksSent << " blocks counting resends)" << std::endl;
+        g_resyncTransfers.erase(it);
+    }
+}
+
+/**
+ * @brief Re-run the rounds whose hashes haven't come back in time (receive thread)
+ *
+ * The round counts as delivering nothing, so its blocks are sent again.
+ */
+static void checkResyncTransfers() {
+    ULONGLONG now = GetTickCount64();
+    std::vector<std::string> timedOut;
+    std::map<std::string, PeerResyncTransfer>::iterator it;
+    for (it = g_resyncTransfers.begin(); it != g_resyncTransfers.end(); ++it) {
+        if (now - it->second.sentTime >= it->second.roundTimeout) {
+            timedOut.push_back(it->first);
+        }
+    }
+    for (size_t i = 0; i < timedOut.size(); i++) {
+        std::map<std::string, PeerResyncTransfer>::iterator found = g_resyncTransfers.find(timedOut[i]);
+        if (found != g_resyncTransfers.end()) {
+            std::vector<size_t> round = found->second.transfer.round;
+            finishRound(timedOut[i], round, false);
+        }
+    }
+}
+
+/**
+ * @brief Start sending a peer the blocks its copy of a region doesn't match
+ *
+ * @param session The peer's hashes of its whole copy
+ * @param ip Address of the peer
+ * @param port Port of the peer
+ */
+static void startBlockTransfer(const BlockHashSession& session, const std::string& ip, int port) {
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(session.memoryName.c_str(), &regionSize));
+    if (!region || regionSize < sizeof(MemoryLayout)) {
+        return;
+    }
+
+    std::vector<size_t> differing;
+    findDifferingBlocks(region, regionSize, session.hashes, session.received, session.peerSize, differing);
+    std::cout << "[RESYNC] Sending " << differing.size() << " of " << regionBlockCount(regionSize)
+              << " blocks of " << session.memoryName << " to " << ip << ":" << port << std::endl;
+
+    // A new request from the peer replaces a transfer still running
+    char peer[64];
+    sprintf(peer, "%.40s:%d", ip.c_str(), port);
+    std::string key = session.memoryName + "|" + peer;
+    PeerResyncTransfer& state = g_resyncTransfers[key];
+    state.memoryName = session.memoryName;
+    state.ip = ip;
+    state.port = port;
+    state.roundTimeout = RESYNC_ROUND_TIMEOUT_MS;
+    startResyncTransfer(&state.transfer, differing);
+    if (!sendResyncRound(state)) {
+        g_resyncTransfers.erase(key);
+    }
+}
+
+/**
+ * @brief Collect a batch of a peer's block hashes, acting once the last one arrives
+ *
+ * Hashes of a whole copy start a block transfer; hashes of a range finish a
+ * round of one. Blocks whose batch was lost are treated as differing.
+ *
+ * @param message The MSG_BLOCK_HASHES message
+ * @param ip Address of the peer
+ * @param port Port of the peer
+ */
+static void receiveBlockHashes(const SyncMessage& message, const std::string& ip, int port) {
+    ULONGLONG now = GetTickCount64();
+    std::map<uint64_t, BlockHashSession>::iterator it = g_hashSessions.begin();
+    while (it != g_hashSessions.end()) {
+        if (now - it->second.startTime > BLOCK_HASH_SESSION_TIMEOUT_MS) {
+            g_hashSessions.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+
+    BlockHashBatch batch;
+    if (message.size < sizeof(batch) || message.size > MAX_SYNC_DATA_SIZE) {
+        return;
+    }
+    memcpy(&batch, message.data, sizeof(batch));
+    size_t count = (message.size - sizeof(batch)) / sizeof(BlockHash);
+    size_t blocks = regionBlockCount(static_cast<size_t>(batch.regionSize));
+    if (batch.firstBlock > blocks || count > blocks - batch.firstBlock) {
+        return;
+    }
+
+    // Only the answer to the current round of a transfer counts
+    char peer[64];
+    sprintf(peer, "%.40s:%d", ip.c_str(), port);
+    std::string key = std::string(message.memoryName) + "|" + peer;
+    if (message.flags & SYNC_FLAG_BLOCK_RANGE) {
+        std::map<std::string, PeerResyncTransfer>::iterator transfer = g_resyncTransfers.find(key);
+        if (transfer == g_resyncTransfers.end() || transfer->second.requestId != message.updateId) {
+            return;
+        }
+    }
+
+    BlockHashSession& session = g_hashSessions[message.updateId];
+    if (session.memoryName.empty()) {
+        session.memoryName = message.memoryName;
+        session.peerSize = static_cast<size_t>(batch.regionSize);
+        session.hashes.resize(blocks);
+        session.received.resize(blocks, false);
+        session.startTime = now;
+    }
+    if (session.peerSize != batch.regionSize) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        memcpy(&session.hashes[batch.firstBlock + i], message.data + sizeof(batch) + i * sizeof(BlockHash),
+               sizeof(BlockHash));
+        session.received[batch.firstBlock + i] = true;
+    }
+
+    if (!(message.flags & SYNC_FLAG_MORE_IN_VERSION)) {
+        if (message.flags & SYNC_FLAG_BLOCK_RANGE) {
+            size_t regionSize = 0;
+            const char* region = static_cast<const char*>(getSharedMemoryMapping(message.memoryName, &regionSize));
+            std::vector<size_t> differing;
+            if (region) {
+                findDifferingBlocks(region, regionSize, session.hashes, session.received, session.peerSize, differing);
+                finishRound(key, differing, true);
+            } else {
+                g_resyncTransfers.erase(key);
+            }
+            g_hashSessions.erase(message.updateId);
+        } else {
+            startBlockTransfer(session, ip, port);
+            g_hashSessions.erase(message.updateId);
+        }
+    }
+}
+
+/**
+ * @brief Check an update against the lease table of a multi-writer region, logging a refusal
+ */
+static bool admitLeasedUpdate(const SyncMessage& message) {
+    if (rangeLeasesAdmit(message)) {
+        return true;
+    }
+    std::cerr << "[LEASE] Dropped an update to " << message.memoryName << " at offset " << message.offset
+              << " from node " << message.origin << std::endl;
+    return false;
+}
+
+/**
+ * @brief Remove the parts of a complete update that write ranges leased to another node, logging them
+ */
+static void dropUnleasedChunks(std::vector<SyncMessage>& chunks) {
+    if (chunks.empty()) {
+        return;
+    }
+    std::string memoryName = chunks[0].memoryName;
+    uint32_t origin = chunks[0].origin;
+    size_t removed = rangeLeasesFilterUpdate(chunks);
+    if (removed > 0) {
+        std::cerr << "[LEASE] Dropped " << removed << " parts of an update to " << memoryName << " from node "
+                  << origin << std::endl;
+    }
+}
+
+/**
+ * @brief Remember the address a lease node sends from
+ *
+ * Forwarded writes carry the origin of the write rather than of the sender,
+ * so they don't tell where their origin is.
+ */
+static void noteLeaseNodeAddress(const SyncMessage& message, const std::string& ip, int port) {
+    if (message.origin < 1 || message.origin > MAX_LEASE_NODES || message.msgType == MSG_RANGE_WRITE) {
+        return;
+    }
+    uint32_t index = message.origin - 1;
+    lockRemoteNodesMutex();
+    if (g_leaseNodePorts[index] != port || g_leaseNodeIps[index] != ip) {
+        g_leaseNodeIps[index] = ip;
+        g_leaseNodePorts[index] = port;
+    }
+    unlockRemoteNodesMutex();
+}
+
+/**
+ * @brief Send a write to the lease node that should apply it
+ */
+static void sendToLeaseNode(uint32_t nodeId, const SyncMessage& message) {
+    std::string ip;
+    int port = 0;
+    lockRemoteNodesMutex();
+    if (nodeId >= 1 && nodeId <= MAX_LEASE_NODES) {
+        ip = g_leaseNodeIps[nodeId - 1];
+        port = g_leaseNodePorts[nodeId - 1];
+    }
+    unlockRemoteNodesMutex();
+    if (port == 0) {
+        std::cerr << "[LEASE] No address known for node " << nodeId << "; dropped a write to "
+                  << message.memoryName << " at offset " << message.offset << std::endl;
+        return;
+    }
+    sendSyncMessage(g_socket, ip.c_str(), port, message);
+}
+
 /**
  * @brief Thread function for receiving synchronization messages
  *
@@ -302,11 +971,19 @@ unsigned int __stdcall receiveThreadFunc(void* arg) {
     SyncMessage message;
     std::string sourceIp;
     int sourcePort;
+    long placementGeneration = -1;
 
     // Continue receiving messages until the g_running flag is set to false
     while (g_running) {
-        // Try to receive a synchronization message
-        if (receiveSyncMessage(g_socket, message, sourceIp, sourcePort)) {
+        // Move next to the regions this thread applies to as they are added
+        if (threadPlacementChanged(&placementGeneration)) {
+            placeCurrentThread(THREAD_ROLE_RECEIVE, NULL);
+        }
+
+        // Try to receive a synchronization message; writes to a range leased to another node are dropped
+        if (receiveSyncMessage(g_socket, message, sourceIp, sourcePort) && admitLeasedUpdate(message)) {
+            noteLeaseNodeAddress(message, sourceIp, sourcePort);
+
             // We received a message, process it based on message type
             switch (message.msgType) {
                 case MSG_SINGLE_UPDATE:
@@ -351,26 +1028,95 @@ unsigned int __stdcall receiveThreadFunc(void* arg) {
                             g_inProgressUpdates.find(message.updateId);
                         if (it != g_inProgressUpdates.end()) {
                             it->second.chunks.push_back(message);
+                            dropUnleasedChunks(it->second.chunks);
                             applyMultipartUpdate(message.updateId);
                             g_inProgressUpdates.erase(it);
                         } else {
                             // We missed the start message, try to apply just this chunk
                             std::cerr << "Received end for unknown update ID: "
                                       << message.updateId << std::endl;
-                            applyUpdate(message);
+                            std::vector<SyncMessage> alone(1, message);
+                            dropUnleasedChunks(alone);
+                            if (!alone.empty()) {
+                                applyUpdate(message);
+                            }
                         }
                     }
                     unlockUpdatesMutex();
                     break;
+
+                case MSG_RESIZE:
+                    // Grow the local copy before the updates that need the room; lazy copies never grow
+                    if (!isLazyRegion(message.memoryName)) {
+                        applyResize(message);
+                    }
+                    break;
+
+                case MSG_RESYNC_REQUEST:
+                    // Only the instance that owns the region answers
+                    if (isRegionSource(message.memoryName)) {
+                        serveResyncRequest(message, sourceIp, sourcePort);
+                    }
+                    break;
+
+                case MSG_BLOCK_HASH_REQUEST:
+                    // The owner wants to know which blocks of our copy are stale; a lazy copy has no blocks to compare
+                    if (!isRegionSource(message.memoryName) && !isLazyRegion(message.memoryName)) {
+                        sendBlockHashes(message, sourceIp, sourcePort);
+                    }
+                    break;
+
+                case MSG_BLOCK_HASHES:
+                    if (isRegionSource(message.memoryName)) {
+                        receiveBlockHashes(message, sourceIp, sourcePort);
+                    }
+                    break;
+
+                case MSG_REGION_CHECKSUM:
+                    // A copy that differs from its owner at the same version sends its block hashes
+                    if (regionChecksumsEnabled() && !isRegionSource(message.memoryName) &&
+                        !isLazyRegion(message.memoryName) && !checkRegionChecksum(message)) {
+                        sendBlockHashes(message, sourceIp, sourcePort);
+                    }
+                    break;
+
+                case MSG_RANGE_WRITE:
+                    // A write to a range of a multi-writer region that this node holds or passes on
+                    receiveRangeWrite(message);
+                    break;
+
+                case MSG_PAGE_REQUEST:
+                    // A lazy copy read a page it doesn't have yet; only the instance that owns the region answers
+                    if (isRegionSource(message.memoryName)) {
+                        servePageRequest(message, sourceIp, sourcePort);
+                    }
+                    break;
+
+                case MSG_PAGE_DATA:
+                    receiveLazyPage(message);
+                    break;
+
+                case MSG_FETCH_REQUEST:
+                    // A node reading part of a region without replicating it; only the source answers
+                    if (isRegionSource(message.memoryName)) {
+                        serveFetchRequest(message, sourceIp, sourcePort);
+                    }
+                    break;
+
+                case MSG_FETCH_DATA:
+                    receiveFetchData(message);
+                    break;
             }
 
             // Check for timed-out updates
             checkUpdateTimeouts();
         }
 
-        // Sleep briefly to avoid consuming too much CPU
-        // This determines how quickly we respond to incoming messages (10ms latency here)
-        Sleep(10);
+        // Send again the rounds of block transfers that went unanswered
+        checkResyncTransfers();
+
+        // No sleep: receiveSyncMessage blocks for up to 100ms when the socket is idle
+        // and returns at once while datagrams are queued, so a burst is drained back to back
     }
     // When g_running is set to false, this thread will exit
     return 0;
@@ -379,8 +1125,76 @@ unsigned int __stdcall receiveThreadFunc(void* arg) {
 // Thread data structure for memory sync thread
 struct MemorySyncThreadData {
     std::string memoryName;
+    BlockLockTable* locks;  // Where processes writing the region mark what they wrote; NULL if not mapped
+    HANDLE stop;            // Set to stop the thread; owned by g_syncStopEvents
 };
 
+/**
+ * @brief Add the parts of a region written under block locks to its changes
+ *
+ * The parts come from every process writing the region. Changes recorded
+ * by this process that lie within them are dropped, as the parts are sent
+ * whole.
+ */
+static void addDirtyParts(BlockLockTable* locks, size_t regionSize, std::vector<MemoryChange>& changes) {
+    std::vector<size_t> parts;
+    takeDirtyParts(locks, regionSize, parts);
+    if (parts.empty()) {
+        return;
+    }
+
+    std::vector<MemoryChange> kept;
+    for (size_t i = 0; i < changes.size(); i++) {
+        if (changes[i].size == 0) {
+            continue;
+        }
+        size_t first = changes[i].offset / BLOCK_DIRTY_SIZE;
+        size_t last = (changes[i].offset + changes[i].size - 1) / BLOCK_DIRTY_SIZE;
+        bool covered = true;
+        for (size_t part = first; part <= last && covered; part++) {
+            covered = std::binary_search(parts.begin(), parts.end(), part);
+        }
+        if (!covered) {
+            kept.push_back(changes[i]);
+        }
+    }
+    changes.swap(kept);
+
+    // Each run of adjacent parts is one change
+    size_t run = 0;
+    while (run < parts.size()) {
+        size_t next = run + 1;
+        while (next < parts.size() && parts[next] == parts[next - 1] + 1) {
+            next++;
+        }
+        size_t end = (parts[next - 1] + 1) * BLOCK_DIRTY_SIZE;
+        MemoryChange change;
+        change.offset = parts[run] * BLOCK_DIRTY_SIZE;
+        change.size = ((end < regionSize) ? end : regionSize) - change.offset;
+        change.inProgress = false;
+        changes.push_back(change);
+        run = next;
+    }
+}
+
+/**
+ * @brief Copy the region bytes a message carries, between writes to their blocks
+ */
+static void copyChunkData(BlockLockTable* locks, const void* region, SyncMessage& message) {
+    const char* source = static_cast<const char*>(region) + message.offset;
+    if (!locks) {
+        memcpy(message.data, source, message.size);
+        return;
+    }
+    for (;;) {
+        uint32_t sequence = beginBlockRead(locks, message.offset, message.size);
+        memcpy(message.data, source, message.size);
+        if (endBlockRead(locks, message.offset, message.size, sequence)) {
+            return;
+        }
+    }
+}
+
 /**
  * @brief Thread function for monitoring and synchronizing shared memory
  *
@@ -389,7 +1203,9 @@ struct MemorySyncThreadData {
  * and dirty flag set), it creates synchronization messages for the changed regions
  * and sends them to all connected remote nodes.
  *
- * The thread continues running until the g_running flag is set to false.
+ * The thread continues running until the g_running flag is set to false or
+ * its stop event is set. It is never terminated, as it holds the remote nodes
+ * mutex while it sends.
  *
  * @param arg Pointer to a MemorySyncThreadData structure containing the memory name
  * @return Thread exit code
@@ -398,10 +1214,16 @@ unsigned int __stdcall memorySyncThreadFunc(void* arg) {
     // Extract the memory name from the thread data
     MemorySyncThreadData* data = static_cast<MemorySyncThreadData*>(arg);
     std::string memoryName = data->memoryName;
+    BlockLockTable* locks = data->locks;
+    HANDLE stop = data->stop;
     delete data;  // Free the thread data
 
+    // Run on the node holding the region this thread reads
+    placeCurrentThread(THREAD_ROLE_SYNC, memoryName.c_str());
+
     // Get a pointer to the shared memory region
-    void* sharedMem = getSharedMemory(memoryName.c_str());
+    size_t regionSize = 0;
+    void* sharedMem = getSharedMemoryMapping(memoryName.c_str(), &regionSize);
     if (!sharedMem) {
         // If we can't access the shared memory, exit the thread
         return 0;
@@ -413,26 +1235,87 @@ unsigned int __stdcall memorySyncThreadFunc(void* arg) {
     // Remember the current version to detect changes
     uint64_t lastVersion = layout->version;
 
-    // Continue monitoring until the g_running flag is set to false
-    while (g_running) {
+    // Version and time of the last region checksum sent
+    uint64_t checksumVersion = 0;
+    ULONGLONG checksumTime = 0;
+
+    // Time this node's leases in the region were last checked for renewal
+    ULONGLONG leaseCheckTime = 0;
+
+    // Continue monitoring until the g_running flag is set to false or the thread is stopped
+    while (g_running && WaitForSingleObject(stop, 0) == WAIT_TIMEOUT) {
+        // Queue the counter slots this node added to since the last pass
+        publishCrdtFields(memoryName.c_str());
+
+        // Follow a resize, and tell the remote nodes before sending anything that needs the room
+        size_t currentSize = 0;
+        void* current = getSharedMemoryMapping(memoryName.c_str(), &currentSize);
+        if (current != sharedMem) {
+            sharedMem = current;
+            layout = static_cast<MemoryLayout*>(sharedMem);
+            if (currentSize > regionSize) {
+                SyncMessage resize;
+                buildResizeMessage(resize, memoryName.c_str(), layout->version, currentSize);
+                broadcastSyncMessage(resize);
+            }
+            regionSize = currentSize;
+        }
+
         // Check if the memory has changed (version increased) and is marked as dirty
         if (layout->version > lastVersion && layout->dirty) {
-            // Check if there are pending changes to send
+            // Writers in other threads and processes keep publishing versions while we send
+            uint64_t sentVersion = layout->version;
+
+            // Take the changes this process recorded, then the parts any process wrote under
+            // block locks; not under the changes mutex, as a writer holding a stripe may want it
+            std::vector<MemoryChange> changes;
             lockChangesMutex();
             std::map<std::string, std::vector<MemoryChange> >::iterator changeIt =
                 g_pendingChanges.find(memoryName);
+            if (changeIt != g_pendingChanges.end()) {
+                changes.swap(changeIt->second);
+            }
+            unlockChangesMutex();
+            if (locks) {
+                addDirtyParts(locks, regionSize, changes);
+            }
 
-            if (changeIt != g_pendingChanges.end() && !changeIt->second.empty()) {
+            if (!changes.empty()) {
                 // We have specific changes to send
-                std::vector<MemoryChange>& changes = changeIt->second;
+                // Split changes that don't fit in a single message into chunks
+                std::vector<MemoryChange> chunks;
+                for (size_t i = 0; i < changes.size(); i++) {
+                    size_t offset = changes[i].offset;
+                    size_t remaining = changes[i].size;
+                    while (remaining > 0) {
+                        MemoryChange chunk;
+                        chunk.offset = offset;
+                        chunk.size = (remaining > MAX_SYNC_DATA_SIZE) ? MAX_SYNC_DATA_SIZE : remaining;
+                        chunk.inProgress = (remaining > chunk.size);
+                        chunks.push_back(chunk);
+                        offset += chunk.size;
+                        remaining -= chunk.size;
+                    }
+                }
 
                 // Generate a unique update ID for this batch
                 uint64_t updateId = generateUniqueId();
 
+                // Lazy copies only get the batches that touch pages they have fetched
+                std::set<std::string> skippedNodes;
+                lockRemoteNodesMutex();
+                for (std::map<std::string, std::string>::iterator node = g_remoteNodes.begin();
+                     node != g_remoteNodes.end(); ++node) {
+                    if (!lazyPeerWantsChanges(memoryName.c_str(), node->second.c_str(), changes)) {
+                        skippedNodes.insert(node->second);
+                    }
+                }
+                unlockRemoteNodesMutex();
+
                 // Determine if we need multiple messages
-                bool multipleMessages = (changes.size() > 1);
+                bool multipleMessages = (chunks.size() > 1);
 
-                for (size_t i = 0; i < changes.size(); i++) {
+                for (size_t i = 0; i < chunks.size(); i++) {
                     // Create a synchronization message
                     SyncMessage message;
 
@@ -440,7 +1323,7 @@ unsigned int __stdcall memorySyncThreadFunc(void* arg) {
                     if (multipleMessages) {
                         if (i == 0) {
                             message.msgType = MSG_START_UPDATE;
-                        } else if (i == changes.size() - 1) {
+                        } else if (i == chunks.size() - 1) {
                             message.msgType = MSG_END_UPDATE;
                         } else {
                             message.msgType = MSG_UPDATE_CHUNK;
@@ -457,20 +1340,31 @@ unsigned int __stdcall memorySyncThreadFunc(void* arg) {
                     message.memoryName[sizeof(message.memoryName) - 1] = '\0';
 
                     // Set the offset and size for this chunk
-                    message.offset = changes[i].offset;
-                    message.size = changes[i].size;
+                    message.offset = chunks[i].offset;
+                    message.size = chunks[i].size;
 
                     // Set the timestamp
                     message.timestamp = GetTickCount();
 
+                    // Tag every chunk of the batch with the version it brings the region to
+                    message.version = sentVersion;
+                    message.flags = 0;
+                    message.origin = leaseNodeId();
+
                     // Copy just the changed data
-                    char* source = static_cast<char*>(sharedMem) + message.offset;
-                    memcpy(message.data, source, message.size);
+                    copyChunkData(locks, sharedMem, message);
+
+                    // Journal what we send so restarted peers can catch up from us
+                    journalUpdate(message, i == chunks.size() - 1);
 
                     // Send the message to all remote nodes
                     lockRemoteNodesMutex();
                     std::map<std::string, std::string>::iterator it;
                     for (it = g_remoteNodes.begin(); it != g_remoteNodes.end(); ++it) {
+                        if (skippedNodes.count(it->second)) {
+                            continue;
+                        }
+
                         // Parse the IP address and port from the node value
                         // The format is "ip:port"
                         size_t colonPos = it->second.find(':');
@@ -487,9 +1381,6 @@ unsigned int __stdcall memorySyncThreadFunc(void* arg) {
                     }
                     unlockRemoteNodesMutex();
                 }
-
-                // Clear the pending changes
-                changes.clear();
             } else {
                 // No specific changes tracked, send the whole structure (fallback)
                 SyncMessage message;
@@ -509,8 +1400,14 @@ unsigned int __stdcall memorySyncThreadFunc(void* arg) {
                 // Set the timestamp
                 message.timestamp = GetTickCount();
 
+                // Tag the message with the version it brings the region to
+                message.version = sentVersion;
+                message.flags = 0;
+                message.origin = leaseNodeId();
+
                 // Copy the shared memory data to the message
                 memcpy(message.data, sharedMem, message.size);
+                journalUpdate(message, true);
 
                 // Send the message to all remote nodes
                 lockRemoteNodesMutex();
@@ -532,20 +1429,45 @@ unsigned int __stdcall memorySyncThreadFunc(void* arg) {
                 }
                 unlockRemoteNodesMutex();
             }
-            unlockChangesMutex();
 
             // Update our last known version
-            lastVersion = layout->version;
+            lastVersion = sentVersion;
 
-            // Clear the dirty flag since we've synchronized the changes
+            // Clear the dirty flag since we've synchronized the changes, and set it
+            // again if a writer published a version in the meantime
             layout->dirty = false;
+            MemoryBarrier();
+            if (layout->version != sentVersion) {
+                layout->dirty = true;
+            }
         }
 
-        // Sleep briefly to avoid consuming too much CPU
+        // Keep this node's leases on ranges of a multi-writer region from lapsing,
+        // and move them toward the nodes that write them
+        if (GetTickCount64() - leaseCheckTime >= RANGE_LEASE_CHECK_INTERVAL_MS) {
+            renewRangeLeases(memoryName.c_str());
+            balanceRangeLeases(memoryName.c_str());
+            leaseCheckTime = GetTickCount64();
+        }
+
+        // Let the copies check themselves against the region while it changes,
+        // at a version whose changes have all been sent
+        if (regionChecksumsEnabled() && lastVersion != checksumVersion &&
+            GetTickCount64() - checksumTime >= REGION_CHECKSUM_INTERVAL_MS &&
+            isRegionSource(memoryName.c_str())) {
+            SyncMessage checksum;
+            if (buildRegionChecksumMessage(memoryName.c_str(), checksum) && checksum.version == lastVersion) {
+                broadcastSyncMessage(checksum);
+                checksumVersion = checksum.version;
+            }
+            checksumTime = GetTickCount64();
+        }
+
+        // Sleep briefly to avoid consuming too much CPU, waking at once if stopped
         // This determines how quickly we detect and synchronize changes (10ms latency here)
-        Sleep(10);
+        WaitForSingleObject(stop, 10);
     }
-    // When g_running is set to false, this thread will exit
+    // When g_running is set to false or the thread is stopped, this thread will exit
     return 0;
 }
 
@@ -597,10 +1519,32 @@ bool initNetworkSync(const char* ip_address, int port) {
         return false;
     }
 
+#ifndef _WIN32
+    // The receive loop waits on an epoll instance rather than re-arming a poll set each time
+    g_socketEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (g_socketEpoll >= 0) {
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = g_socket;
+        if (epoll_ctl(g_socketEpoll, EPOLL_CTL_ADD, g_socket, &event) != 0) {
+            close(g_socketEpoll);
+            g_socketEpoll = -1;
+        }
+    }
+#endif
+
     // Step 4: Store the local address information for later use
     g_localIp = ip_address;
     g_localPort = port;
 
+    // Writes to ranges of a multi-writer region held elsewhere go to their holder
+    setRangeWriteForwarder(sendToLeaseNode);
+
+    // Lazy copies ask every node for their pages; only the source answers
+    setLazyPageSender(broadcastSyncMessage);
+    setFetchRequestSender(broadcastSyncMessage);
+
     // Step 5: Start the receive thread to listen for incoming messages
     g_running = true;  // Set the running flag to true
     unsigned int threadId;
@@ -615,6 +1559,12 @@ bool initNetworkSync(const char* ip_address, int port) {
 
     if (g_receiveThread == NULL) {
         std::cerr << "Failed to create receive thread: " << GetLastError() << std::endl;
+#ifndef _WIN32
+        if (g_socketEpoll >= 0) {
+            close(g_socketEpoll);
+            g_socketEpoll = -1;
+        }
+#endif
         closesocket(g_socket);
         cleanupWinsock();
         g_running = false;
@@ -655,6 +1605,8 @@ bool connectToRemoteNode(const char* ip_address, int port) {
 
     // Send a test message to verify that we can reach the remote node
     SyncMessage testMsg;
+    memset(&testMsg, 0, sizeof(testMsg));
+    testMsg.msgType = MSG_SINGLE_UPDATE;
     strcpy(testMsg.memoryName, "TEST");  // Special name for test messages
     testMsg.offset = 0;
     testMsg.size = 0;
@@ -663,6 +1615,56 @@ bool connectToRemoteNode(const char* ip_address, int port) {
     return sendSyncMessage(g_socket, ip_address, port, testMsg);
 }
 
+/**
+ * @brief Asks remote nodes for the updates a region is missing
+ *
+ * Sends a MSG_RESYNC_REQUEST carrying the region's current version to every
+ * remote node. The node that owns the region replies with the updates newer
+ * than that version, or, if its journal doesn't go back far enough, asks for
+ * the block hashes of the local copy and sends only the blocks that differ.
+ *
+ * @param memory_name The name of the shared memory region
+ * @param version The version the local copy is at (0 for an empty copy)
+ * @return true if the request was sent to at least one node, false otherwise
+ */
+bool requestRegionResync(const char* memory_name, uint64_t version) {
+    SyncMessage request;
+    memset(&request, 0, sizeof(request));
+    request.msgType = MSG_RESYNC_REQUEST;
+    strncpy(request.memoryName, memory_name, sizeof(request.memoryName) - 1);
+    request.version = version;
+    request.timestamp = GetTickCount();
+
+    bool sent = false;
+    lockRemoteNodesMutex();
+    std::map<std::string, std::string>::iterator it;
+    for (it = g_remoteNodes.begin(); it != g_remoteNodes.end(); ++it) {
+        size_t colonPos = it->second.find(':');
+        if (colonPos != std::string::npos) {
+            std::string ip = it->second.substr(0, colonPos);
+            int port = atoi(it->second.substr(colonPos + 1).c_str());
+            sent = sendSyncMessage(g_socket, ip.c_str(), port, request) || sent;
+        }
+    }
+    unlockRemoteNodesMutex();
+    return sent;
+}
+
+/**
+ * @brief Marks a region as written by this node
+ *
+ * The node then answers resync requests for the region even when the region
+ * has no journal, by comparing block hashes with the requester's copy.
+ *
+ * @param memory_name The name of the shared memory region
+ */
+void setRegionSource(const char* memory_name) {
+    initNetworkMutexes();
+    lockSyncThreadsMutex();
+    g_sourceRegions.insert(memory_name);
+    unlockSyncThreadsMutex();
+}
+
 /**
  * @brief Starts synchronization for a shared memory region
  *
@@ -685,9 +1687,18 @@ bool startSharedMemorySync(const char* memory_name) {
         return true;
     }
 
-    // Create thread data
+    // Create thread data; the block locks stay attached until the thread has been stopped and joined
+    HANDLE stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (stop == NULL) {
+        std::cerr << "Failed to create memory sync stop event: " << GetLastError() << std::endl;
+        unlockSyncThreadsMutex();
+        return false;
+    }
+    BlockLockTable* locks = attachBlockLocks(memory_name);
     MemorySyncThreadData* data = new MemorySyncThreadData();
     data->memoryName = memName;
+    data->locks = locks;
+    data->stop = stop;
 
     // Start a new thread to monitor and synchronize this memory region
     unsigned int threadId;
@@ -702,6 +1713,10 @@ bool startSharedMemorySync(const char* memory_name) {
 
     if (threadHandle == NULL) {
         std::cerr << "Failed to create memory sync thread: " << GetLastError() << std::endl;
+        if (locks) {
+            detachBlockLocks(memory_name);
+        }
+        CloseHandle(stop);
         delete data;
         unlockSyncThreadsMutex();
         return false;
@@ -709,6 +1724,10 @@ bool startSharedMemorySync(const char* memory_name) {
 
     // Store the thread handle in our map
     g_syncThreads[memName] = threadHandle;
+    g_syncStopEvents[memName] = stop;
+    if (locks) {
+        g_syncBlockLocks.insert(memName);
+    }
     unlockSyncThreadsMutex();
     return true;
 }
@@ -716,8 +1735,9 @@ bool startSharedMemorySync(const char* memory_name) {
 /**
  * @brief Stops synchronization for a shared memory region
  *
- * This function stops the thread that monitors a shared memory region for changes.
- * The region will no longer be synchronized with remote nodes.
+ * This function stops the thread that monitors a shared memory region for changes
+ * and waits for it to exit. The region will no longer be synchronized with remote
+ * nodes. The thread is joined outside g_syncThreadsMutex, which it takes itself.
  *
  * @param memory_name The name of the shared memory region to stop synchronizing
  */
@@ -725,25 +1745,35 @@ void stopSharedMemorySync(const char* memory_name) {
     // Convert the memory name to a string for easier handling
     std::string memName(memory_name);
 
-    // Find the synchronization thread for this memory region
+    // Find the synchronization thread for this memory region, remove it from our maps and ask it to stop
+    HANDLE thread = NULL;
+    HANDLE stop = NULL;
+    bool attachedLocks = false;
     lockSyncThreadsMutex();
     std::map<std::string, HANDLE>::iterator it = g_syncThreads.find(memName);
     if (it != g_syncThreads.end()) {
-        // We found the thread, now we need to stop and clean it up
-        // Note: The thread will exit when g_running is false, but we don't want to
-        // stop all threads, so we'll just terminate this one specifically
-
-        // Terminate the thread (not ideal, but we don't have a better way in this implementation)
-        TerminateThread(it->second, 0);
-
-        // Clean up the thread handle
-        CloseHandle(it->second);
-
-        // Remove the thread from our map
+        thread = it->second;
+        stop = g_syncStopEvents[memName];
         g_syncThreads.erase(it);
+        g_syncStopEvents.erase(memName);
+        attachedLocks = g_syncBlockLocks.erase(memName) != 0;
+        SetEvent(stop);
     }
     unlockSyncThreadsMutex();
-    // If the memory region isn't being synchronized, there's nothing to do
+    // If the memory region isn't being synchronized, there's nothing to stop
+
+    // Wait for it to finish its pass; it may need g_syncThreadsMutex until then
+    if (thread != NULL) {
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+        CloseHandle(stop);
+        if (attachedLocks) {
+            detachBlockLocks(memory_name);
+        }
+    }
+
+    // Forget the pages lazy copies fetched, in case the region is synchronized again
+    forgetLazyPeers(memory_name);
 }
 
 /**
@@ -756,44 +1786,59 @@ void stopSharedMemorySync(const char* memory_name) {
 void shutdownNetworkSync() {
     // Step 1: Stop all threads by setting the running flag to false
     g_running = false;
+    setRangeWriteForwarder(NULL);
+    setLazyPageSender(NULL);
+    setFetchRequestSender(NULL);
+    clearRemoteFetchCache();
 
     // Clean up change tracking
     cleanupChangeTracking();
 
     // Step 2: Wait for the receive thread to finish and clean it up
+    // It is joined rather than terminated: its receive wait times out, and a
+    // terminated thread would leave the mutexes it holds locked
     if (g_receiveThread) {
-        // Wait for the thread to finish with a timeout
-        DWORD waitResult = WaitForSingleObject(g_receiveThread, 1000); // 1 second timeout
-
-        // If the thread didn't finish within the timeout, terminate it
-        if (waitResult == WAIT_TIMEOUT) {
-            std::cout << "[CLEANUP] Receive thread did not exit cleanly, terminating..." << std::endl;
-            TerminateThread(g_receiveThread, 0);
-        }
-
+        WaitForSingleObject(g_receiveThread, INFINITE);
         CloseHandle(g_receiveThread);
         g_receiveThread = NULL;
     }
 
-    // Step 3: Wait for all synchronization threads to finish and clean them up
+    // Step 3: Wait for all synchronization threads to finish and clean them up,
+    // outside g_syncThreadsMutex, which they take themselves
     lockSyncThreadsMutex();
-    std::map<std::string, HANDLE>::iterator it;
-    for (it = g_syncThreads.begin(); it != g_syncThreads.end(); ++it) {
-        // Wait for the thread to finish with a timeout
-        DWORD waitResult = WaitForSingleObject(it->second, 1000); // 1 second timeout
-
-        // If the thread didn't finish within the timeout, terminate it
-        if (waitResult == WAIT_TIMEOUT) {
-            std::cout << "[CLEANUP] Sync thread did not exit cleanly, terminating..." << std::endl;
-            TerminateThread(it->second, 0);
-        }
+    std::map<std::string, HANDLE> threads;
+    threads.swap(g_syncThreads);
+    std::map<std::string, HANDLE> stopEvents;
+    stopEvents.swap(g_syncStopEvents);
+    unlockSyncThreadsMutex();
 
+    std::map<std::string, HANDLE>::iterator it;
+    for (it = threads.begin(); it != threads.end(); ++it) {
+        SetEvent(stopEvents[it->first]);
+    }
+    for (it = threads.begin(); it != threads.end(); ++it) {
+        WaitForSingleObject(it->second, INFINITE);
         CloseHandle(it->second);
+        CloseHandle(stopEvents[it->first]);
     }
-    g_syncThreads.clear();
+
+    lockSyncThreadsMutex();
+    g_sourceRegions.clear();
+    for (std::set<std::string>::iterator name = g_syncBlockLocks.begin(); name != g_syncBlockLocks.end(); ++name) {
+        detachBlockLocks(name->c_str());
+    }
+    g_syncBlockLocks.clear();
     unlockSyncThreadsMutex();
+    g_hashSessions.clear();
+    g_resyncTransfers.clear();
 
     // Step 4: Close the socket if it's open
+#ifndef _WIN32
+    if (g_socketEpoll >= 0) {
+        close(g_socketEpoll);
+        g_socketEpoll = -1;
+    }
+#endif
     if (g_socket != INVALID_SOCKET) {
         closesocket(g_socket);
         g_socket = INVALID_SOCKET;
@@ -19,6 +19,12 @@ bool startSharedMemorySync(const char* memory_name);
 // Function to stop shared memory synchronization
 void stopSharedMemorySync(const char* memory_name);
 
+// Function to ask remote nodes for the updates a region is missing since a version
+bool requestRegionResync(const char* memory_name, uint64_t version);
+
+// Function to mark a region as written by this node, so it answers resync requests
+void setRegionSource(const char* memory_name);
+
 // Function to shutdown network synchronization
 void shutdownNetworkSync();
 
@@ -0,0 +1,24 @@
+#ifndef POSIX_BCRYPT_H
+#define POSIX_BCRYPT_H
+
+/**
+ * @brief BCryptGenRandom on Linux
+ *
+ * Only the system-preferred generator is provided; the bytes come from
+ * getrandom, which blocks until the kernel's pool has been seeded.
+ */
+
+#include "windows.h"
+
+typedef LONG NTSTATUS;
+typedef void* BCRYPT_ALG_HANDLE;
+
+#define BCRYPT_SUCCESS(status) (static_cast<NTSTATUS>(status) >= 0)
+#define BCRYPT_USE_SYSTEM_PREFERRED_RNG 0x00000002
+#define STATUS_SUCCESS (static_cast<NTSTATUS>(0x00000000))
+#define STATUS_UNSUCCESSFUL (static_cast<NTSTATUS>(0xC0000001))
+#define STATUS_INVALID_PARAMETER (static_cast<NTSTATUS>(0xC000000D))
+
+NTSTATUS BCryptGenRandom(BCRYPT_ALG_HANDLE algorithm, UCHAR* buffer, ULONG size, ULONG flags);
+
+#endif // POSIX_BCRYPT_H
@@ -0,0 +1,17 @@
+#ifndef POSIX_PROCESS_H
+#define POSIX_PROCESS_H
+
+/**
+ * @brief _beginthreadex on top of pthreads
+ *
+ * The thread runs detached. The returned handle is signalled when the
+ * thread function returns, and is released with CloseHandle.
+ */
+
+#include "windows.h"
+
+uintptr_t _beginthreadex(void* security, unsigned int stackSize,
+                         unsigned int (*startAddress)(void*), void* argument,
+                         unsigned int initFlags, unsigned int* threadId);
+
+#endif // POSIX_PROCESS_H
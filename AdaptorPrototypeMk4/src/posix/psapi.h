@@ -0,0 +1,34 @@
+#ifndef POSIX_PSAPI_H
+#define POSIX_PSAPI_H
+
+/**
+ * @brief QueryWorkingSetEx on Linux
+ *
+ * A page counts as valid when it is resident (mincore). The node of a
+ * resident page comes from get_mempolicy; without NUMA support every page
+ * is on node 0. Only Valid and Node are filled in.
+ */
+
+#include "windows.h"
+
+typedef union _PSAPI_WORKING_SET_EX_BLOCK {
+    ULONG_PTR Flags;
+    struct {
+        ULONG_PTR Valid : 1;
+        ULONG_PTR ShareCount : 3;
+        ULONG_PTR Win32Protection : 11;
+        ULONG_PTR Shared : 1;
+        ULONG_PTR Node : 6;
+        ULONG_PTR Locked : 1;
+        ULONG_PTR LargePage : 1;
+    };
+} PSAPI_WORKING_SET_EX_BLOCK;
+
+typedef struct _PSAPI_WORKING_SET_EX_INFORMATION {
+    void* VirtualAddress;
+    PSAPI_WORKING_SET_EX_BLOCK VirtualAttributes;
+} PSAPI_WORKING_SET_EX_INFORMATION, *PPSAPI_WORKING_SET_EX_INFORMATION;
+
+BOOL QueryWorkingSetEx(HANDLE process, void* buffer, DWORD size);
+
+#endif // POSIX_PSAPI_H
@@ -0,0 +1,1312 @@
+/**
+ * @file win32_posix.cpp
+ * @brief Linux implementation of the Win32 subset in src/posix
+ *
+ * Mutexes are default pthread mutexes, which glibc locks and releases
+ * uncontended faster than the futex word this used before; recursion is
+ * counted here, next to the owner, so the pthread mutex is only taken once.
+ * Each thread lists the mutexes it holds, so a thread that exits or is
+ * cancelled holding one releases it as abandoned and the next owner gets
+ * WAIT_ABANDONED, as on Win32. (Robust mutexes would do the same in the
+ * kernel, but cost more per lock than the rest of it together.) Events and
+ * the "finished" word of a thread handle are futex words; only a waiter
+ * enters the kernel.
+ *
+ * A named section's holders each take a shared fcntl lock on its segment
+ * before anything else. Whether a holder is the only one is probed by a
+ * non-blocking conversion of that lock to an exclusive one, which fcntl
+ * performs atomically: the shared lock is kept if the conversion fails.
+ * Probes are serialized by a second, guard byte, so creating, opening and
+ * closing a segment never race.
+ *
+ * Views and VirtualAlloc blocks are recorded with their length, because
+ * munmap needs it and Win32 callers only pass the address.
+ */
+
+#include "windows.h"
+#include "process.h"
+#include "psapi.h"
+#include "bcrypt.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Object behind a HANDLE
+enum PosixHandleType {
+    POSIX_HANDLE_MUTEX,
+    POSIX_HANDLE_EVENT,
+    POSIX_HANDLE_THREAD,
+    POSIX_HANDLE_FILE,
+    POSIX_HANDLE_MAPPING,
+    POSIX_HANDLE_PROCESS
+};
+
+struct PosixHandle {
+    PosixHandleType type;
+};
+
+struct PosixMutex {
+    PosixHandle base;
+    pthread_mutex_t mutex;          // Taken once by the owner, however often it acquired the mutex
+    volatile DWORD owner;           // Thread holding the mutex; written by the owner only
+    unsigned int recursion;         // Times the owner has acquired it
+    bool abandoned;                 // Its last owner exited holding it
+    PosixMutex* nextHeld;           // Next mutex in the owner's t_heldMutexes
+};
+
+struct PosixEvent {
+    PosixHandle base;
+    volatile int signalled;         // 1 while set
+    bool manualReset;               // Stays set after releasing a waiter
+};
+
+struct PosixThread {
+    PosixHandle base;
+    volatile int finished;          // Set once the thread function returned
+    volatile int references;        // The handle and the running thread
+    pthread_t pthread;
+    unsigned int (*function)(void*);
+    void* argument;
+};
+
+struct PosixFile {
+    PosixHandle base;
+    int fd;
+};
+
+struct PosixProcess {
+    PosixHandle base;
+    pid_t pid;
+};
+
+struct PosixMapping {
+    PosixHandle base;
+    int fd;                         // Segment or backing file
+    uint64_t size;                  // Size of the section
+    bool writable;
+    std::string shmName;            // POSIX shared memory name, empty if file-backed
+    std::string localName;          // Name of a file-backed section, empty if unnamed
+};
+
+/// Pseudo-handles for the calling thread and process, with their Win32 values
+static const intptr_t CURRENT_PROCESS_PSEUDO_HANDLE = -1;
+static const intptr_t CURRENT_THREAD_PSEUDO_HANDLE = -2;
+
+/// Where NUMA nodes are described
+static const char NODE_DIRECTORY[] = "/sys/devices/system/node";
+
+/// get_mempolicy flags: report the node of the page at an address
+#define POSIX_MPOL_F_NODE 1
+#define POSIX_MPOL_F_ADDR 2
+
+/// Views and VirtualAlloc blocks by address, with their length
+static std::map<const char*, size_t> g_views;
+
+/// File-backed sections by name; their names are only known inside this process
+static std::map<std::string, PosixMapping*> g_localSections;
+
+/// Guards g_views and g_localSections
+static pthread_mutex_t g_registryMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread DWORD t_lastError = 0;
+static __thread DWORD t_threadId = 0;
+
+/// Mutexes the calling thread holds, most recently acquired first
+static __thread PosixMutex* t_heldMutexes = NULL;
+
+// ---------------------------------------------------------------------------
+// Futex waits
+// ---------------------------------------------------------------------------
+
+static uint64_t monotonicNanoseconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+static void futexWake(volatile int* word, int count) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+/**
+ * @brief Sleep while *word holds value, until a deadline (0 for none)
+ *
+ * @return false once the deadline has passed
+ */
+static bool futexWait(volatile int* word, int value, uint64_t deadline) {
+    if (deadline == 0) {
+        syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+        return true;
+    }
+    uint64_t now = monotonicNanoseconds();
+    if (now >= deadline) {
+        return false;
+    }
+    timespec timeout;
+    timeout.tv_sec = static_cast<time_t>((deadline - now) / 1000000000ull);
+    timeout.tv_nsec = static_cast<long>((deadline - now) % 1000000000ull);
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, &timeout, NULL, 0);
+    return true;
+}
+
+static uint64_t waitDeadline(DWORD milliseconds) {
+    if (milliseconds == INFINITE) {
+        return 0;
+    }
+    return monotonicNanoseconds() + static_cast<uint64_t>(milliseconds) * 1000000ull + 1;
+}
+
+// ---------------------------------------------------------------------------
+// Errors and time
+// ---------------------------------------------------------------------------
+
+DWORD GetLastError() {
+    return t_lastError;
+}
+
+void SetLastError(DWORD error) {
+    t_lastError = error;
+}
+
+static void setErrno() {
+    t_lastError = static_cast<DWORD>(errno);
+}
+
+void Sleep(DWORD milliseconds) {
+    if (milliseconds == 0) {
+        sched_yield();
+        return;
+    }
+    timespec delay;
+    delay.tv_sec = milliseconds / 1000;
+    delay.tv_nsec = static_cast<long>(milliseconds % 1000) * 1000000L;
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+DWORD GetTickCount() {
+    return static_cast<DWORD>(GetTickCount64());
+}
+
+ULONGLONG GetTickCount64() {
+    return monotonicNanoseconds() / 1000000ull;
+}
+
+void GetSystemTimeAsFileTime(FILETIME* time) {
+    // 100 ns intervals since 1601-01-01, as on Windows
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t intervals = static_cast<uint64_t>(now.tv_sec) * 10000000ull + static_cast<uint64_t>(now.tv_nsec) / 100 +
+                         116444736000000000ull;
+    time->dwLowDateTime = static_cast<DWORD>(intervals);
+    time->dwHighDateTime = static_cast<DWORD>(intervals >> 32);
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* counter) {
+    counter->QuadPart = static_cast<LONGLONG>(monotonicNanoseconds());
+    return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency) {
+    frequency->QuadPart = 1000000000LL;
+    return TRUE;
+}
+
+DWORD GetCurrentThreadId() {
+    if (t_threadId == 0) {
+        t_threadId = static_cast<DWORD>(syscall(SYS_gettid));
+    }
+    return t_threadId;
+}
+
+DWORD GetCurrentProcessId() {
+    return static_cast<DWORD>(getpid());
+}
+
+void GetSystemInfo(SYSTEM_INFO* info) {
+    memset(info, 0, sizeof(*info));
+    info->dwPageSize = static_cast<DWORD>(sysconf(_SC_PAGESIZE));
+    info->dwAllocationGranularity = info->dwPageSize;
+    info->dwNumberOfProcessors = static_cast<DWORD>(sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+// ---------------------------------------------------------------------------
+// Mutexes, events and threads
+// ---------------------------------------------------------------------------
+
+HANDLE CreateMutex(void* attributes, BOOL initialOwner, LPCSTR name) {
+    (void)attributes;
+    if (name != NULL) {
+        // Named mutexes are shared between processes on Windows; nothing here needs them
+        t_lastError = ERROR_INVALID_HANDLE;
+        return NULL;
+    }
+    PosixMutex* mutex = new PosixMutex();
+    mutex->base.type = POSIX_HANDLE_MUTEX;
+
+    mutex->owner = 0;
+    mutex->recursion = 0;
+    mutex->abandoned = false;
+    mutex->nextHeld = NULL;
+
+    int result = pthread_mutex_init(&mutex->mutex, NULL);
+    if (result != 0) {
+        t_lastError = static_cast<DWORD>(result);
+        delete mutex;
+        return NULL;
+    }
+    if (initialOwner) {
+        WaitForSingleObject(mutex, INFINITE);
+    }
+    t_lastError = ERROR_SUCCESS;
+    return mutex;
+}
+
+/**
+ * @brief Take a mutex off the calling thread's list of held mutexes
+ */
+static void forgetHeldMutex(PosixMutex* mutex) {
+    PosixMutex** link = &t_heldMutexes;
+    while (*link != mutex) {
+        link = &(*link)->nextHeld;
+    }
+    *link = mutex->nextHeld;
+}
+
+/**
+ * @brief Release every mutex the exiting thread still holds, as abandoned
+ */
+static void abandonHeldMutexes() {
+    while (t_heldMutexes != NULL) {
+        PosixMutex* mutex = t_heldMutexes;
+        t_heldMutexes = mutex->nextHeld;
+        mutex->recursion = 0;
+        mutex->owner = 0;
+        mutex->abandoned = true;
+        pthread_mutex_unlock(&mutex->mutex);
+    }
+}
+
+static DWORD lockMutex(PosixMutex* mutex, DWORD milliseconds) {
+    DWORD self = GetCurrentThreadId();
+    if (mutex->owner == self) {
+        mutex->recursion++;
+        return WAIT_OBJECT_0;
+    }
+
+    int result;
+    if (milliseconds == INFINITE) {
+        result = pthread_mutex_lock(&mutex->mutex);
+    } else if (milliseconds == 0) {
+        result = pthread_mutex_trylock(&mutex->mutex);
+    } else {
+        uint64_t deadline = waitDeadline(milliseconds);
+        timespec until;
+        until.tv_sec = static_cast<time_t>(deadline / 1000000000ull);
+        until.tv_nsec = static_cast<long>(deadline % 1000000000ull);
+        result = pthread_mutex_clocklock(&mutex->mutex, CLOCK_MONOTONIC, &until);
+    }
+
+    if (result == EBUSY || result == ETIMEDOUT) {
+        return WAIT_TIMEOUT;
+    }
+    if (result != 0) {
+        t_lastError = static_cast<DWORD>(result);
+        return WAIT_FAILED;
+    }
+
+    mutex->owner = self;
+    mutex->recursion = 1;
+    mutex->nextHeld = t_heldMutexes;
+    t_heldMutexes = mutex;
+    if (mutex->abandoned) {
+        // The owner exited holding it; the caller owns it now and must check what it guards
+        mutex->abandoned = false;
+        return WAIT_ABANDONED;
+    }
+    return WAIT_OBJECT_0;
+}
+
+BOOL ReleaseMutex(HANDLE handle) {
+    PosixMutex* mutex = static_cast<PosixMutex*>(handle);
+    if (mutex == NULL || mutex->base.type != POSIX_HANDLE_MUTEX || mutex->owner != GetCurrentThreadId()) {
+        t_lastError = ERROR_NOT_OWNER;
+        return FALSE;
+    }
+    if (--mutex->recursion > 0) {
+        return TRUE;
+    }
+    mutex->owner = 0;
+    forgetHeldMutex(mutex);
+    pthread_mutex_unlock(&mutex->mutex);
+    return TRUE;
+}
+
+HANDLE CreateEvent(void* attributes, BOOL manualReset, BOOL initialState, LPCSTR name) {
+    (void)attributes;
+    if (name != NULL) {
+        t_lastError = ERROR_INVALID_HANDLE;
+        return NULL;
+    }
+    PosixEvent* event = new PosixEvent();
+    event->base.type = POSIX_HANDLE_EVENT;
+    event->signalled = initialState ? 1 : 0;
+    event->manualReset = manualReset != FALSE;
+    return event;
+}
+
+BOOL SetEvent(HANDLE handle) {
+    PosixEvent* event = static_cast<PosixEvent*>(handle);
+    if (__sync_lock_test_and_set(&event->signalled, 1) == 0) {
+        futexWake(&event->signalled, event->manualReset ? INT_MAX : 1);
+    }
+    return TRUE;
+}
+
+BOOL ResetEvent(HANDLE handle) {
+    static_cast<PosixEvent*>(handle)->signalled = 0;
+    __sync_synchronize();
+    return TRUE;
+}
+
+static DWORD waitEvent(PosixEvent* event, DWORD milliseconds) {
+    uint64_t deadline = waitDeadline(milliseconds);
+    for (;;) {
+        if (event->manualReset ? event->signalled != 0
+                               : __sync_bool_compare_and_swap(&event->signalled, 1, 0)) {
+            return WAIT_OBJECT_0;
+        }
+        if (milliseconds == 0 || !futexWait(&event->signalled, 0, deadline)) {
+            return WAIT_TIMEOUT;
+        }
+    }
+}
+
+static void releaseThread(PosixThread* thread) {
+    if (__sync_sub_and_fetch(&thread->references, 1) == 0) {
+        delete thread;
+    }
+}
+
+/**
+ * @brief Signal a thread's handle once its function returned or it was terminated
+ */
+static void threadFinished(void* argument) {
+    PosixThread* thread = static_cast<PosixThread*>(argument);
+    abandonHeldMutexes();
+    __sync_lock_test_and_set(&thread->finished, 1);
+    futexWake(&thread->finished, INT_MAX);
+    releaseThread(thread);
+}
+
+static void* threadStart(void* argument) {
+    PosixThread* thread = static_cast<PosixThread*>(argument);
+    pthread_cleanup_push(threadFinished, thread);
+    thread->function(thread->argument);
+    pthread_cleanup_pop(1);
+    return NULL;
+}
+
+uintptr_t _beginthreadex(void* security, unsigned int stackSize,
+                         unsigned int (*startAddress)(void*), void* argument,
+                         unsigned int initFlags, unsigned int* threadId) {
+    (void)security;
+    (void)initFlags;
+    PosixThread* thread = new PosixThread();
+    thread->base.type = POSIX_HANDLE_THREAD;
+    thread->finished = 0;
+    thread->references = 2;
+    thread->function = startAddress;
+    thread->argument = argument;
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    if (stackSize > 0) {
+        pthread_attr_setstacksize(&attributes, stackSize);
+    }
+    int result = pthread_create(&thread->pthread, &attributes, threadStart, thread);
+    pthread_attr_destroy(&attributes);
+    if (result != 0) {
+        t_lastError = static_cast<DWORD>(result);
+        delete thread;
+        return 0;
+    }
+    if (threadId) {
+        *threadId = static_cast<unsigned int>(reinterpret_cast<uintptr_t>(thread));
+    }
+    return reinterpret_cast<uintptr_t>(thread);
+}
+
+BOOL TerminateThread(HANDLE handle, DWORD exitCode) {
+    (void)exitCode;
+    PosixThread* thread = static_cast<PosixThread*>(handle);
+    if (thread == NULL || thread->base.type != POSIX_HANDLE_THREAD) {
+        t_lastError = ERROR_INVALID_HANDLE;
+        return FALSE;
+    }
+    // Like TerminateThread, this is a last resort: the thread's mutexes are
+    // released as abandoned, but what they guard may be half updated
+    if (!thread->finished) {
+        pthread_cancel(thread->pthread);
+    }
+    return TRUE;
+}
+
+static DWORD waitThread(PosixThread* thread, DWORD milliseconds) {
+    uint64_t deadline = waitDeadline(milliseconds);
+    while (!thread->finished) {
+        if (milliseconds == 0 || !futexWait(&thread->finished, 0, deadline)) {
+            return WAIT_TIMEOUT;
+        }
+    }
+    return WAIT_OBJECT_0;
+}
+
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds) {
+    PosixHandle* object = static_cast<PosixHandle*>(handle);
+    if (object == NULL || handle == INVALID_HANDLE_VALUE) {
+        t_lastError = ERROR_INVALID_HANDLE;
+        return WAIT_FAILED;
+    }
+    switch (object->type) {
+    case POSIX_HANDLE_MUTEX:
+        return lockMutex(reinterpret_cast<PosixMutex*>(object), milliseconds);
+    case POSIX_HANDLE_EVENT:
+        return waitEvent(reinterpret_cast<PosixEvent*>(object), milliseconds);
+    case POSIX_HANDLE_THREAD:
+        return waitThread(reinterpret_cast<PosixThread*>(object), milliseconds);
+    default:
+        t_lastError = ERROR_INVALID_HANDLE;
+        return WAIT_FAILED;
+    }
+}
+
+HANDLE GetCurrentThread() {
+    return reinterpret_cast<HANDLE>(CURRENT_THREAD_PSEUDO_HANDLE);
+}
+
+HANDLE GetCurrentProcess() {
+    return reinterpret_cast<HANDLE>(CURRENT_PROCESS_PSEUDO_HANDLE);
+}
+
+/**
+ * @brief Check whether a process exists and hasn't exited
+ *
+ * kill(pid, 0) also succeeds for a zombie, which has exited but not been
+ * reaped, so the state letter in /proc is checked as well.
+ */
+static bool processRunning(pid_t pid) {
+    if (kill(pid, 0) != 0 && errno != EPERM) {
+        return false;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+    FILE* stat = fopen(path, "r");
+    if (stat == NULL) {
+        return true;
+    }
+    char line[512];
+    size_t length = fread(line, 1, sizeof(line) - 1, stat);
+    fclose(stat);
+    line[length] = '\0';
+
+    // The command name is in parentheses and may contain spaces
+    const char* close = strrchr(line, ')');
+    return close == NULL || close[1] != ' ' || (close[2] != 'Z' && close[2] != 'X');
+}
+
+HANDLE OpenProcess(DWORD access, BOOL inheritHandle, DWORD processId) {
+    (void)access;
+    (void)inheritHandle;
+    pid_t pid = static_cast<pid_t>(processId);
+    if (pid <= 0 || (kill(pid, 0) != 0 && errno == ESRCH)) {
+        t_lastError = ERROR_INVALID_PARAMETER;
+        return NULL;
+    }
+    PosixProcess* process = new PosixProcess();
+    process->base.type = POSIX_HANDLE_PROCESS;
+    process->pid = pid;
+    return process;
+}
+
+BOOL GetExitCodeProcess(HANDLE process, DWORD* exitCode) {
+    PosixHandle* object = static_cast<PosixHandle*>(process);
+    if (object == NULL || exitCode == NULL) {
+        t_lastError = ERROR_INVALID_HANDLE;
+        return FALSE;
+    }
+    if (process == GetCurrentProcess()) {
+        *exitCode = STILL_ACTIVE;
+        return TRUE;
+    }
+    if (object->type != POSIX_HANDLE_PROCESS) {
+        t_lastError = ERROR_INVALID_HANDLE;
+        return FALSE;
+    }
+    // The exit status belongs to the parent, so other processes only learn that it ended
+    *exitCode = processRunning(reinterpret_cast<PosixProcess*>(object)->pid) ? STILL_ACTIVE : 0;
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// NUMA topology and thread affinity
+// ---------------------------------------------------------------------------
+
+/**
+ * @brief Read the processors of a node from its cpulist ("0-3,8-11")
+ *
+ * Without a node directory the machine is one node holding every processor.
+ *
+ * @return false if the node does not exist
+ */
+static bool readNodeProcessors(unsigned int node, std::vector<unsigned int>& processors) {
+    processors.clear();
+    char path[128];
+    snprintf(path, sizeof(path), "%s/node%u/cpulist", NODE_DIRECTORY, node);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        if (node != 0 || access(NODE_DIRECTORY, F_OK) == 0) {
+            return false;
+        }
+        long count = sysconf(_SC_NPROCESSORS_CONF);
+        for (long i = 0; i < count; i++) {
+            processors.push_back(static_cast<unsigned int>(i));
+        }
+        return true;
+    }
+
+    char list[4096];
+    if (fgets(list, sizeof(list), file) == NULL) {
+        list[0] = '\0';
+    }
+    fclose(file);
+
+    // An empty list is a node with memory but no processors
+    char* cursor = list;
+    while (*cursor >= '0' && *cursor <= '9') {
+        unsigned long first = strtoul(cursor, &cursor, 10);
+        unsigned long last = first;
+        if (*cursor == '-') {
+            last = strtoul(cursor + 1, &cursor, 10);
+        }
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            processors.push_back(static_cast<unsigned int>(cpu));
+        }
+        if (*cursor == ',') {
+            cursor++;
+        }
+    }
+    return true;
+}
+
+BOOL GetNumaHighestNodeNumber(PULONG highestNodeNumber) {
+    ULONG highest = 0;
+    DIR* directory = opendir(NODE_DIRECTORY);
+    if (directory != NULL) {
+        dirent* entry;
+        while ((entry = readdir(directory)) != NULL) {
+            unsigned int node;
+            char extra;
+            if (sscanf(entry->d_name, "node%u%c", &node, &extra) == 1 && node > highest) {
+                highest = node;
+            }
+        }
+        closedir(directory);
+    }
+    *highestNodeNumber = highest;
+    return TRUE;
+}
+
+BOOL GetNumaNodeProcessorMaskEx(USHORT node, PGROUP_AFFINITY processorMask) {
+    std::vector<unsigned int> processors;
+    if (!readNodeProcessors(node, processors)) {
+        t_lastError = ERROR_INVALID_PARAMETER;
+        return FALSE;
+    }
+
+    // Like Windows, a node is reported within one group: the group of its first processor
+    memset(processorMask, 0, sizeof(*processorMask));
+    if (!processors.empty()) {
+        processorMask->Group = static_cast<WORD>(processors[0] / 64);
+    }
+    for (size_t i = 0; i < processors.size(); i++) {
+        if (processors[i] / 64 == processorMask->Group) {
+            processorMask->Mask |= static_cast<KAFFINITY>(1) << (processors[i] % 64);
+        }
+    }
+    return TRUE;
+}
+
+BOOL SetThreadGroupAffinity(HANDLE handle, const GROUP_AFFINITY* groupAffinity,
+                            PGROUP_AFFINITY previousGroupAffinity) {
+    pthread_t target;
+    if (handle == GetCurrentThread()) {
+        target = pthread_self();
+    } else {
+        PosixThread* thread = static_cast<PosixThread*>(handle);
+        if (thread == NULL || thread->base.type != POSIX_HANDLE_THREAD || thread->finished) {
+            t_lastError = ERROR_INVALID_HANDLE;
+            return FALSE;
+        }
+        target = thread->pthread;
+    }
+
+    if (previousGroupAffinity != NULL) {
+        cpu_set_t previous;
+        CPU_ZERO(&previous);
+        pthread_getaffinity_np(target, sizeof(previous), &previous);
+        memset(previousGroupAffinity, 0, sizeof(*previousGroupAffinity));
+        bool groupFound = false;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &previous)) {
+                continue;
+            }
+            if (!groupFound) {
+                previousGroupAffinity->Group = static_cast<WORD>(cpu / 64);
+                groupFound = true;
+            }
+            if (cpu / 64 == previousGroupAffinity->Group) {
+                previousGroupAffinity->Mask |= static_cast<KAFFINITY>(1) << (cpu % 64);
+            }
+        }
+    }
+
+    cpu_set_t processors;
+    CPU_ZERO(&processors);
+    for (int bit = 0; bit < 64; bit++) {
+        if ((groupAffinity->Mask >> bit) & 1) {
+            int cpu = groupAffinity->Group * 64 + bit;
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &processors);
+            }
+        }
+    }
+    if (CPU_COUNT(&processors) == 0) {
+        t_lastError = ERROR_INVALID_PARAMETER;
+        return FALSE;
+    }
+    int result = pthread_setaffinity_np(target, sizeof(processors), &processors);
+    if (result != 0) {
+        t_lastError = static_cast<DWORD>(result);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// Files
+// ---------------------------------------------------------------------------
+
+static int fileDescriptor(HANDLE handle) {
+    PosixHandle* object = static_cast<PosixHandle*>(handle);
+    if (object == NULL || handle == INVALID_HANDLE_VALUE || object->type != POSIX_HANDLE_FILE) {
+        return -1;
+    }
+    return reinterpret_cast<PosixFile*>(object)->fd;
+}
+
+HANDLE CreateFileA(LPCSTR path, DWORD access, DWORD share, void* attributes,
+                   DWORD disposition, DWORD flags, HANDLE templateFile) {
+    (void)share;
+    (void)attributes;
+    (void)templateFile;
+    int openFlags = O_CLOEXEC;
+    if ((access & GENERIC_READ) && (access & GENERIC_WRITE)) {
+        openFlags |= O_RDWR;
+    } else if (access & GENERIC_WRITE) {
+        openFlags |= O_WRONLY;
+    } else {
+        openFlags |= O_RDONLY;
+    }
+    switch (disposition) {
+    case CREATE_NEW:        openFlags |= O_CREAT | O_EXCL; break;
+    case CREATE_ALWAYS:     openFlags |= O_CREAT | O_TRUNC; break;
+    case OPEN_ALWAYS:       openFlags |= O_CREAT; break;
+    case TRUNCATE_EXISTING: openFlags |= O_TRUNC; break;
+    default:                break;
+    }
+    if (flags & FILE_FLAG_WRITE_THROUGH) {
+        openFlags |= O_DSYNC;
+    }
+
+    // Unbuffered I/O is O_DIRECT, with the same alignment rules; file systems
+    // without it (tmpfs) refuse the flag, and get buffered I/O instead
+    int fd = open(path, (flags & FILE_FLAG_NO_BUFFERING) ? openFlags | O_DIRECT : openFlags, 0644);
+    if (fd < 0 && errno == EINVAL && (flags & FILE_FLAG_NO_BUFFERING)) {
+        fd = open(path, openFlags, 0644);
+    }
+    if (fd < 0) {
+        t_lastError = (errno == ENOENT) ? ERROR_FILE_NOT_FOUND : static_cast<DWORD>(errno);
+        return INVALID_HANDLE_VALUE;
+    }
+    PosixFile* file = new PosixFile();
+    file->base.type = POSIX_HANDLE_FILE;
+    file->fd = fd;
+    t_lastError = ERROR_SUCCESS;
+    return file;
+}
+
+BOOL ReadFile(HANDLE file, void* buffer, DWORD size, LPDWORD read, void* overlapped) {
+    (void)overlapped;
+    int fd = fileDescriptor(file);
+    DWORD total = 0;
+    while (total < size) {
+        ssize_t result = ::read(fd, static_cast<char*>(buffer) + total, size - total);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            setErrno();
+            if (read) {
+                *read = total;
+            }
+            return FALSE;
+        }
+        if (result == 0) {
+            break;
+        }
+        total += static_cast<DWORD>(result);
+    }
+    if (read) {
+        *read = total;
+    }
+    return TRUE;
+}
+
+BOOL WriteFile(HANDLE file, const void* buffer, DWORD size, LPDWORD written, void* overlapped) {
+    (void)overlapped;
+    int fd = fileDescriptor(file);
+    DWORD total = 0;
+    while (total < size) {
+        ssize_t result = ::write(fd, static_cast<const char*>(buffer) + total, size - total);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            setErrno();
+            if (written) {
+                *written = total;
+            }
+            return FALSE;
+        }
+        total += static_cast<DWORD>(result);
+    }
+    if (written) {
+        *written = total;
+    }
+    return TRUE;
+}
+
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, PLARGE_INTEGER newPosition, DWORD method) {
+    int whence = (method == FILE_END) ? SEEK_END : (method == FILE_CURRENT) ? SEEK_CUR : SEEK_SET;
+    off_t position = lseek(fileDescriptor(file), static_cast<off_t>(distance.QuadPart), whence);
+    if (position < 0) {
+        setErrno();
+        return FALSE;
+    }
+    if (newPosition) {
+        newPosition->QuadPart = static_cast<LONGLONG>(position);
+    }
+    return TRUE;
+}
+
+BOOL GetFileSizeEx(HANDLE file, PLARGE_INTEGER size) {
+    struct stat status;
+    if (fstat(fileDescriptor(file), &status) != 0) {
+        setErrno();
+        return FALSE;
+    }
+    size->QuadPart = static_cast<LONGLONG>(status.st_size);
+    return TRUE;
+}
+
+BOOL SetEndOfFile(HANDLE file) {
+    int fd = fileDescriptor(file);
+    off_t position = lseek(fd, 0, SEEK_CUR);
+    if (position < 0 || ftruncate(fd, position) != 0) {
+        setErrno();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL FlushFileBuffers(HANDLE file) {
+    if (fsync(fileDescriptor(file)) != 0) {
+        setErrno();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL CreateDirectoryA(LPCSTR path, void* attributes) {
+    (void)attributes;
+    if (mkdir(path, 0755) != 0) {
+        t_lastError = (errno == EEXIST) ? ERROR_ALREADY_EXISTS : static_cast<DWORD>(errno);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL MoveFileExA(LPCSTR from, LPCSTR to, DWORD flags) {
+    (void)flags;
+    if (rename(from, to) != 0) {
+        setErrno();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL DeleteFileA(LPCSTR path) {
+    if (unlink(path) != 0) {
+        t_lastError = (errno == ENOENT) ? ERROR_FILE_NOT_FOUND : static_cast<DWORD>(errno);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// Sections and views
+// ---------------------------------------------------------------------------
+
+/**
+ * @brief POSIX shared memory name for a section name ("/name", no other slashes)
+ */
+static std::string shmName(LPCSTR name) {
+    std::string result = "/";
+    for (const char* p = name; *p; p++) {
+        result += (*p == '/' || *p == '\\') ? '_' : *p;
+    }
+    return result;
+}
+
+/// Bytes of a segment's fcntl locks: every holder shares the first, probes take the second
+#define SEGMENT_HOLDER_BYTE 0
+#define SEGMENT_GUARD_BYTE 1
+
+/**
+ * @brief Set, convert or release an open-file-description lock on one byte of a segment
+ *
+ * Unlike flock, converting a shared lock to an exclusive one with wait ==
+ * false either succeeds or leaves the shared lock in place.
+ *
+ * @param type F_RDLCK, F_WRLCK or F_UNLCK
+ * @param wait true to wait for conflicting locks to go
+ * @return true if the lock was set
+ */
+static bool lockSegmentByte(int fd, short type, off_t byte, bool wait) {
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = byte;
+    lock.l_len = 1;
+    int result;
+    do {
+        result = fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock);
+    } while (result != 0 && errno == EINTR);
+    return result == 0;
+}
+
+/**
+ * @brief Whether the caller's holder lock is the only one on a segment
+ *
+ * Called holding the guard byte and a shared lock on the holder byte. The
+ * lock is converted to an exclusive one and back, atomically both ways.
+ */
+static bool isOnlySegmentHolder(int fd) {
+    if (!lockSegmentByte(fd, F_WRLCK, SEGMENT_HOLDER_BYTE, false)) {
+        return false;
+    }
+    lockSegmentByte(fd, F_RDLCK, SEGMENT_HOLDER_BYTE, false);
+    return true;
+}
+
+static PosixMapping* newMapping(int fd, uint64_t size, bool writable) {
+    PosixMapping* mapping = new PosixMapping();
+    mapping->base.type = POSIX_HANDLE_MAPPING;
+    mapping->fd = fd;
+    mapping->size = size;
+    mapping->writable = writable;
+    return mapping;
+}
+
+/**
+ * @brief Create or attach a named section in POSIX shared memory
+ *
+ * The holder lock is taken first. If it is the only one, no handle anywhere
+ * holds the segment, which makes this the creator: any leftover contents
+ * (from a process that died without closing) are discarded, as Windows would
+ * have discarded the section with its last handle. The guard byte keeps
+ * others from probing until the segment is sized.
+ */
+static HANDLE createSharedSection(LPCSTR name, uint64_t size) {
+    std::string segment = shmName(name);
+    int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        setErrno();
+        return NULL;
+    }
+
+    lockSegmentByte(fd, F_WRLCK, SEGMENT_GUARD_BYTE, true);
+    lockSegmentByte(fd, F_RDLCK, SEGMENT_HOLDER_BYTE, true);
+    bool created = isOnlySegmentHolder(fd);
+    if (created) {
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            setErrno();
+            shm_unlink(segment.c_str());
+            close(fd);
+            return NULL;
+        }
+    }
+    lockSegmentByte(fd, F_UNLCK, SEGMENT_GUARD_BYTE, false);
+
+    struct stat status;
+    fstat(fd, &status);
+    PosixMapping* mapping = newMapping(fd, static_cast<uint64_t>(status.st_size), true);
+    mapping->shmName = segment;
+    t_lastError = created ? ERROR_SUCCESS : ERROR_ALREADY_EXISTS;
+    return mapping;
+}
+
+HANDLE CreateFileMappingA(HANDLE file, void* attributes, DWORD protect,
+                          DWORD sizeHigh, DWORD sizeLow, LPCSTR name) {
+    (void)attributes;
+    uint64_t size = (static_cast<uint64_t>(sizeHigh) << 32) | sizeLow;
+    bool writable = (protect == PAGE_READWRITE);
+
+    if (file == INVALID_HANDLE_VALUE) {
+        if (size == 0) {
+            t_lastError = ERROR_INVALID_HANDLE;
+            return NULL;
+        }
+        if (name != NULL) {
+            return createSharedSection(name, size);
+        }
+        // An unnamed paging-file section is a segment nobody else can find
+        static volatile int unnamedSections = 0;
+        char segment[64];
+        snprintf(segment, sizeof(segment), "/unnamed_%d_%d", static_cast<int>(getpid()),
+                 __sync_fetch_and_add(&unnamedSections, 1));
+        HANDLE handle = createSharedSection(segment + 1, size);
+        shm_unlink(segment);
+        if (handle) {
+            static_cast<PosixMapping*>(handle)->shmName.clear();
+        }
+        return handle;
+    }
+
+    int fd = fileDescriptor(file);
+    if (fd < 0) {
+        t_lastError = ERROR_INVALID_HANDLE;
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_registryMutex);
+    if (name != NULL) {
+        std::map<std::string, PosixMapping*>::iterator it = g_localSections.find(name);
+        if (it != g_localSections.end()) {
+            PosixMapping* mapping = newMapping(dup(it->second->fd), it->second->size, it->second->writable);
+            pthread_mutex_unlock(&g_registryMutex);
+            t_lastError = ERROR_ALREADY_EXISTS;
+            return mapping;
+        }
+    }
+
+    // Like Windows, a writable section extends a shorter file
+    struct stat status;
+    fstat(fd, &status);
+    if (size == 0) {
+        size = static_cast<uint64_t>(status.st_size);
+    } else if (writable && static_cast<uint64_t>(status.st_size) < size &&
+               ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        setErrno();
+        pthread_mutex_unlock(&g_registryMutex);
+        return NULL;
+    }
+
+    PosixMapping* mapping = newMapping(dup(fd), size, writable);
+    if (name != NULL) {
+        mapping->localName = name;
+        g_localSections[name] = mapping;
+    }
+    pthread_mutex_unlock(&g_registryMutex);
+    t_lastError = ERROR_SUCCESS;
+    return mapping;
+}
+
+HANDLE OpenFileMappingA(DWORD access, BOOL inherit, LPCSTR name) {
+    (void)inherit;
+    pthread_mutex_lock(&g_registryMutex);
+    std::map<std::string, PosixMapping*>::iterator it = g_localSections.find(name);
+    if (it != g_localSections.end()) {
+        PosixMapping* mapping = newMapping(dup(it->second->fd), it->second->size, it->second->writable);
+        pthread_mutex_unlock(&g_registryMutex);
+        return mapping;
+    }
+    pthread_mutex_unlock(&g_registryMutex);
+
+    std::string segment = shmName(name);
+    bool writable = (access & FILE_MAP_WRITE) != 0;
+    int fd = shm_open(segment.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC, 0);
+    if (fd < 0) {
+        t_lastError = (errno == ENOENT) ? ERROR_FILE_NOT_FOUND : static_cast<DWORD>(errno);
+        return NULL;
+    }
+
+    // A segment no other handle holds was left by a process that died; it is gone
+    lockSegmentByte(fd, F_WRLCK, SEGMENT_GUARD_BYTE, true);
+    lockSegmentByte(fd, F_RDLCK, SEGMENT_HOLDER_BYTE, true);
+    if (isOnlySegmentHolder(fd)) {
+        shm_unlink(segment.c_str());
+        close(fd);
+        t_lastError = ERROR_FILE_NOT_FOUND;
+        return NULL;
+    }
+    lockSegmentByte(fd, F_UNLCK, SEGMENT_GUARD_BYTE, false);
+
+    struct stat status;
+    fstat(fd, &status);
+    PosixMapping* mapping = newMapping(fd, static_cast<uint64_t>(status.st_size), writable);
+    mapping->shmName = segment;
+    return mapping;
+}
+
+static void closeMapping(PosixMapping* mapping) {
+    if (!mapping->localName.empty()) {
+        pthread_mutex_lock(&g_registryMutex);
+        std::map<std::string, PosixMapping*>::iterator it = g_localSections.find(mapping->localName);
+        if (it != g_localSections.end() && it->second == mapping) {
+            g_localSections.erase(it);
+        }
+        pthread_mutex_unlock(&g_registryMutex);
+    }
+
+    // The last handle anywhere removes the segment; closing releases the locks
+    if (!mapping->shmName.empty()) {
+        lockSegmentByte(mapping->fd, F_WRLCK, SEGMENT_GUARD_BYTE, true);
+        if (isOnlySegmentHolder(mapping->fd)) {
+            shm_unlink(mapping->shmName.c_str());
+        }
+    }
+    close(mapping->fd);
+    delete mapping;
+}
+
+static void recordBlock(void* address, size_t size) {
+    pthread_mutex_lock(&g_registryMutex);
+    g_views[static_cast<const char*>(address)] = size;
+    pthread_mutex_unlock(&g_registryMutex);
+}
+
+/**
+ * @brief Remove and unmap a recorded view or block
+ */
+static BOOL releaseBlock(LPCVOID address) {
+    pthread_mutex_lock(&g_registryMutex);
+    std::map<const char*, size_t>::iterator it = g_views.find(static_cast<const char*>(address));
+    if (it == g_views.end()) {
+        pthread_mutex_unlock(&g_registryMutex);
+        t_lastError = ERROR_INVALID_HANDLE;
+        return FALSE;
+    }
+    size_t size = it->second;
+    g_views.erase(it);
+    pthread_mutex_unlock(&g_registryMutex);
+
+    if (munmap(const_cast<void*>(address), size) != 0) {
+        setErrno();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void* MapViewOfFile(HANDLE handle, DWORD access, DWORD offsetHigh, DWORD offsetLow, SIZE_T size) {
+    PosixMapping* mapping = static_cast<PosixMapping*>(handle);
+    if (mapping == NULL || mapping->base.type != POSIX_HANDLE_MAPPING) {
+        t_lastError = ERROR_INVALID_HANDLE;
+        return NULL;
+    }
+    uint64_t offset = (static_cast<uint64_t>(offsetHigh) << 32) | offsetLow;
+    if (size == 0) {
+        size = static_cast<SIZE_T>(mapping->size - offset);
+    }
+
+    int protection = PROT_READ;
+    if ((access & FILE_MAP_WRITE) && mapping->writable) {
+        protection |= PROT_WRITE;
+    }
+    void* view = mmap(NULL, size, protection, MAP_SHARED, mapping->fd, static_cast<off_t>(offset));
+    if (view == MAP_FAILED) {
+        setErrno();
+        return NULL;
+    }
+    recordBlock(view, size);
+    return view;
+}
+
+BOOL UnmapViewOfFile(LPCVOID view) {
+    return releaseBlock(view);
+}
+
+BOOL FlushViewOfFile(LPCVOID address, SIZE_T size) {
+    // msync wants a page-aligned start
+    uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t start = reinterpret_cast<uintptr_t>(address) & ~(pageSize - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(address) + size;
+    if (msync(reinterpret_cast<void*>(start), end - start, MS_SYNC) != 0) {
+        setErrno();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// Virtual memory
+// ---------------------------------------------------------------------------
+
+void* VirtualAlloc(void* address, SIZE_T size, DWORD type, DWORD protect) {
+    (void)type;
+    int protection = (protect == PAGE_READONLY) ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* block = mmap(address, size, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) {
+        setErrno();
+        return NULL;
+    }
+    recordBlock(block, size);
+    return block;
+}
+
+BOOL VirtualFree(void* address, SIZE_T size, DWORD type) {
+    (void)size;
+    (void)type;
+    return releaseBlock(address);
+}
+
+BOOL VirtualLock(void* address, SIZE_T size) {
+    if (mlock(address, size) != 0) {
+        setErrno();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+SIZE_T VirtualQuery(LPCVOID address, MEMORY_BASIC_INFORMATION* info, SIZE_T size) {
+    if (size < sizeof(*info)) {
+        return 0;
+    }
+    const char* target = static_cast<const char*>(address);
+    pthread_mutex_lock(&g_registryMutex);
+    std::map<const char*, size_t>::iterator it = g_views.upper_bound(target);
+    bool found = false;
+    if (it != g_views.begin()) {
+        --it;
+        found = target < it->first + it->second;
+    }
+    if (found) {
+        // Like Windows, the region extends to the end of the view's last page
+        size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t mapped = (it->second + pageSize - 1) / pageSize * pageSize;
+        info->AllocationBase = const_cast<char*>(it->first);
+        info->BaseAddress = const_cast<char*>(target);
+        info->RegionSize = mapped - static_cast<size_t>(target - it->first);
+    }
+    pthread_mutex_unlock(&g_registryMutex);
+    return found ? sizeof(*info) : 0;
+}
+
+BOOL QueryWorkingSetEx(HANDLE process, void* buffer, DWORD size) {
+    (void)process;
+    PSAPI_WORKING_SET_EX_INFORMATION* entries = static_cast<PSAPI_WORKING_SET_EX_INFORMATION*>(buffer);
+    size_t count = size / sizeof(PSAPI_WORKING_SET_EX_INFORMATION);
+    uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    for (size_t i = 0; i < count; i++) {
+        entries[i].VirtualAttributes.Flags = 0;
+        void* page = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(entries[i].VirtualAddress) & ~(pageSize - 1));
+        unsigned char resident = 0;
+        if (mincore(page, static_cast<size_t>(pageSize), &resident) != 0 || (resident & 1) == 0) {
+            continue;
+        }
+        int node = 0;
+        if (syscall(SYS_get_mempolicy, &node, NULL, 0UL, page, POSIX_MPOL_F_NODE | POSIX_MPOL_F_ADDR) != 0) {
+            node = 0;
+        }
+        entries[i].VirtualAttributes.Valid = 1;
+        entries[i].VirtualAttributes.Node = static_cast<ULONG_PTR>(node);
+    }
+    return TRUE;
+}
+
+NTSTATUS BCryptGenRandom(BCRYPT_ALG_HANDLE algorithm, UCHAR* buffer, ULONG size, ULONG flags) {
+    if (algorithm != NULL || (flags & BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0 || (buffer == NULL && size > 0)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    ULONG filled = 0;
+    while (filled < size) {
+        ssize_t got = getrandom(buffer + filled, size - filled, 0);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return STATUS_UNSUCCESSFUL;
+        }
+        filled += static_cast<ULONG>(got);
+    }
+    return STATUS_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------
+// Handles
+// ---------------------------------------------------------------------------
+
+BOOL CloseHandle(HANDLE handle) {
+    PosixHandle* object = static_cast<PosixHandle*>(handle);
+    if (handle == GetCurrentThread()) {
+        return TRUE;
+    }
+    if (object == NULL || handle == INVALID_HANDLE_VALUE) {
+        t_lastError = ERROR_INVALID_HANDLE;
+        return FALSE;
+    }
+    switch (object->type) {
+    case POSIX_HANDLE_MUTEX:
+        pthread_mutex_destroy(&reinterpret_cast<PosixMutex*>(object)->mutex);
+        delete reinterpret_cast<PosixMutex*>(object);
+        break;
+    case POSIX_HANDLE_EVENT:
+        delete reinterpret_cast<PosixEvent*>(object);
+        break;
+    case POSIX_HANDLE_THREAD:
+        releaseThread(reinterpret_cast<PosixThread*>(object));
+        break;
+    case POSIX_HANDLE_FILE:
+        close(reinterpret_cast<PosixFile*>(object)->fd);
+        delete reinterpret_cast<PosixFile*>(object);
+        break;
+    case POSIX_HANDLE_MAPPING:
+        closeMapping(reinterpret_cast<PosixMapping*>(object));
+        break;
+    case POSIX_HANDLE_PROCESS:
+        delete reinterpret_cast<PosixProcess*>(object);
+        break;
+    }
+    return TRUE;
+}
@@ -0,0 +1,270 @@
+#ifndef POSIX_WINDOWS_H
+#define POSIX_WINDOWS_H
+
+/**
+ * @brief Win32 subset used by the sources, implemented on Linux
+ *
+ * Only built on non-Windows platforms: CMake puts src/posix ahead of the
+ * system headers, so <windows.h>, <winsock2.h>, <ws2tcpip.h> and
+ * <process.h> resolve here and the sources compile unchanged.
+ *
+ * Behind the Win32 names:
+ *  - Mutexes are recursive pthread mutexes. A mutex whose owner thread
+ *    exited or was terminated holding it is released, and the next wait
+ *    returns WAIT_ABANDONED with the waiter owning it, as on Win32.
+ *  - Threads are detached pthreads with a futex "finished" word that
+ *    WaitForSingleObject waits on.
+ *  - Named sections are POSIX shared memory (shm_open + mmap). Every handle
+ *    holds a shared fcntl lock on the segment. The last handle to close unlinks
+ *    it, and a segment nobody holds counts as gone, so a section disappears
+ *    with its last handle as it does on Windows.
+ *  - File-backed sections map the file itself. Their names are known inside
+ *    the process only.
+ *  - NUMA nodes and their processors come from /sys/devices/system/node.
+ *    A machine without that directory is one node holding every processor.
+ *
+ * Handles are pointers to small objects tagged with their type, so
+ * CloseHandle and WaitForSingleObject work on any of them. GetLastError
+ * returns errno values, except for the few Win32 codes the sources test.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define WINAPI
+#define __stdcall
+#define __cdecl
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef unsigned int DWORD;
+typedef unsigned int UINT;
+typedef unsigned char UCHAR;
+typedef unsigned short USHORT;
+typedef unsigned int ULONG;
+typedef int LONG;
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef long long LONG64;
+typedef size_t SIZE_T;
+typedef void* HANDLE;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef DWORD* LPDWORD;
+typedef ULONG* PULONG;
+typedef uintptr_t ULONG_PTR;
+typedef ULONG_PTR DWORD_PTR;
+typedef ULONG_PTR KAFFINITY;
+
+typedef union _LARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    } u;
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _FILETIME {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct _SYSTEM_INFO {
+    DWORD dwPageSize;
+    DWORD dwAllocationGranularity;
+    DWORD dwNumberOfProcessors;
+} SYSTEM_INFO;
+
+typedef struct _MEMORY_BASIC_INFORMATION {
+    void* BaseAddress;
+    void* AllocationBase;
+    SIZE_T RegionSize;
+} MEMORY_BASIC_INFORMATION;
+
+/// Processors of one group: group g holds processors 64g to 64g + 63
+typedef struct _GROUP_AFFINITY {
+    KAFFINITY Mask;
+    WORD Group;
+    WORD Reserved[3];
+} GROUP_AFFINITY, *PGROUP_AFFINITY;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define INVALID_HANDLE_VALUE (reinterpret_cast<HANDLE>(static_cast<intptr_t>(-1)))
+#define INFINITE 0xFFFFFFFFu
+#define MAKEWORD(low, high) (static_cast<WORD>(((low) & 0xFF) | (((high) & 0xFF) << 8)))
+
+// Wait results
+#define WAIT_OBJECT_0 0x00000000u
+#define WAIT_ABANDONED 0x00000080u
+#define WAIT_TIMEOUT 0x00000102u
+#define WAIT_FAILED 0xFFFFFFFFu
+
+// Error codes the sources compare against
+#define ERROR_SUCCESS 0
+#define ERROR_FILE_NOT_FOUND 2
+#define ERROR_ACCESS_DENIED 5
+#define ERROR_INVALID_HANDLE 6
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_NOT_OWNER 288
+#define ERROR_ALREADY_EXISTS 183
+
+// CreateFileA
+#define GENERIC_READ 0x80000000u
+#define GENERIC_WRITE 0x40000000u
+#define FILE_SHARE_READ 0x1
+#define FILE_SHARE_WRITE 0x2
+#define FILE_SHARE_DELETE 0x4
+#define CREATE_NEW 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define TRUNCATE_EXISTING 5
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_FLAG_WRITE_THROUGH 0x80000000u
+#define FILE_FLAG_NO_BUFFERING 0x20000000u    // O_DIRECT where the file system supports it
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+#define MOVEFILE_REPLACE_EXISTING 0x1
+#define MOVEFILE_WRITE_THROUGH 0x8
+
+// Sections and views
+#define PAGE_READONLY 0x02
+#define PAGE_READWRITE 0x04
+#define FILE_MAP_WRITE 0x0002
+#define FILE_MAP_READ 0x0004
+#define FILE_MAP_ALL_ACCESS 0x000F001F
+
+// Virtual memory
+#define MEM_COMMIT 0x00001000
+#define MEM_RESERVE 0x00002000
+#define MEM_RELEASE 0x00008000
+
+// Processes
+#define PROCESS_QUERY_LIMITED_INFORMATION 0x1000
+#define STILL_ACTIVE 259
+
+// Errors and time
+DWORD GetLastError();
+void SetLastError(DWORD error);
+void Sleep(DWORD milliseconds);
+DWORD GetTickCount();
+ULONGLONG GetTickCount64();
+void GetSystemTimeAsFileTime(FILETIME* time);
+BOOL QueryPerformanceCounter(LARGE_INTEGER* counter);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+DWORD GetCurrentThreadId();
+DWORD GetCurrentProcessId();
+void GetSystemInfo(SYSTEM_INFO* info);
+
+// Handles, mutexes and events
+BOOL CloseHandle(HANDLE handle);
+HANDLE CreateMutex(void* attributes, BOOL initialOwner, LPCSTR name);
+BOOL ReleaseMutex(HANDLE mutex);
+HANDLE CreateEvent(void* attributes, BOOL manualReset, BOOL initialState, LPCSTR name);
+BOOL SetEvent(HANDLE event);
+BOOL ResetEvent(HANDLE event);
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds);
+BOOL TerminateThread(HANDLE thread, DWORD exitCode);
+HANDLE GetCurrentThread();
+HANDLE GetCurrentProcess();
+HANDLE OpenProcess(DWORD access, BOOL inheritHandle, DWORD processId);
+BOOL GetExitCodeProcess(HANDLE process, DWORD* exitCode);
+
+// NUMA topology and thread affinity
+BOOL GetNumaHighestNodeNumber(PULONG highestNodeNumber);
+BOOL GetNumaNodeProcessorMaskEx(USHORT node, PGROUP_AFFINITY processorMask);
+BOOL SetThreadGroupAffinity(HANDLE thread, const GROUP_AFFINITY* groupAffinity,
+                            PGROUP_AFFINITY previousGroupAffinity);
+
+// Files
+HANDLE CreateFileA(LPCSTR path, DWORD access, DWORD share, void* attributes,
+                   DWORD disposition, DWORD flags, HANDLE templateFile);
+BOOL ReadFile(HANDLE file, void* buffer, DWORD size, LPDWORD read, void* overlapped);
+BOOL WriteFile(HANDLE file, const void* buffer, DWORD size, LPDWORD written, void* overlapped);
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, PLARGE_INTEGER newPosition, DWORD method);
+BOOL GetFileSizeEx(HANDLE file, PLARGE_INTEGER size);
+BOOL SetEndOfFile(HANDLE file);
+BOOL FlushFileBuffers(HANDLE file);
+BOOL CreateDirectoryA(LPCSTR path, void* attributes);
+BOOL MoveFileExA(LPCSTR from, LPCSTR to, DWORD flags);
+BOOL DeleteFileA(LPCSTR path);
+
+// Sections and views
+HANDLE CreateFileMappingA(HANDLE file, void* attributes, DWORD protect,
+                          DWORD sizeHigh, DWORD sizeLow, LPCSTR name);
+HANDLE OpenFileMappingA(DWORD access, BOOL inherit, LPCSTR name);
+void* MapViewOfFile(HANDLE mapping, DWORD access, DWORD offsetHigh, DWORD offsetLow, SIZE_T size);
+BOOL UnmapViewOfFile(LPCVOID view);
+BOOL FlushViewOfFile(LPCVOID address, SIZE_T size);
+
+// Virtual memory
+void* VirtualAlloc(void* address, SIZE_T size, DWORD type, DWORD protect);
+BOOL VirtualFree(void* address, SIZE_T size, DWORD type);
+BOOL VirtualLock(void* address, SIZE_T size);
+SIZE_T VirtualQuery(LPCVOID address, MEMORY_BASIC_INFORMATION* info, SIZE_T size);
+
+// Interlocked operations (full barriers, like their Win32 counterparts)
+inline LONG InterlockedIncrement(volatile LONG* value) {
+    return __sync_add_and_fetch(value, 1);
+}
+
+inline LONG InterlockedDecrement(volatile LONG* value) {
+    return __sync_sub_and_fetch(value, 1);
+}
+
+inline LONG InterlockedExchange(volatile LONG* target, LONG value) {
+    __sync_synchronize();
+    return __sync_lock_test_and_set(target, value);
+}
+
+inline LONG InterlockedCompareExchange(volatile LONG* target, LONG exchange, LONG comparand) {
+    return __sync_val_compare_and_swap(target, comparand, exchange);
+}
+
+inline LONG InterlockedExchangeAdd(volatile LONG* target, LONG value) {
+    return __sync_fetch_and_add(target, value);
+}
+
+inline LONG64 InterlockedIncrement64(volatile LONG64* value) {
+    return __sync_add_and_fetch(value, 1);
+}
+
+inline LONG64 InterlockedExchangeAdd64(volatile LONG64* target, LONG64 value) {
+    return __sync_fetch_and_add(target, value);
+}
+
+inline LONG64 InterlockedCompareExchange64(volatile LONG64* target, LONG64 exchange, LONG64 comparand) {
+    return __sync_val_compare_and_swap(target, comparand, exchange);
+}
+
+inline LONG64 InterlockedExchange64(volatile LONG64* target, LONG64 value) {
+    __sync_synchronize();
+    return __sync_lock_test_and_set(target, value);
+}
+
+inline LONG64 InterlockedOr64(volatile LONG64* target, LONG64 value) {
+    return __sync_fetch_and_or(target, value);
+}
+
+inline void MemoryBarrier() {
+    __sync_synchronize();
+}
+
+inline void YieldProcessor() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+#endif // POSIX_WINDOWS_H
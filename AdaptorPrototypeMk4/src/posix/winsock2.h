@@ -0,0 +1,49 @@
+#ifndef POSIX_WINSOCK2_H
+#define POSIX_WINSOCK2_H
+
+/**
+ * @brief Winsock names on top of BSD sockets
+ *
+ * A SOCKET is a file descriptor, and Winsock needs no start-up on Linux.
+ */
+
+#include "windows.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+
+typedef int SOCKET;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define SD_RECEIVE SHUT_RD
+#define SD_SEND SHUT_WR
+#define SD_BOTH SHUT_RDWR
+
+typedef struct WSAData {
+    WORD wVersion;
+    WORD wHighVersion;
+} WSADATA;
+
+inline int WSAStartup(WORD version, WSADATA* data) {
+    data->wVersion = version;
+    data->wHighVersion = version;
+    return 0;
+}
+
+inline int WSACleanup() {
+    return 0;
+}
+
+inline int WSAGetLastError() {
+    return errno;
+}
+
+inline int closesocket(SOCKET sock) {
+    return close(sock);
+}
+
+#endif // POSIX_WINSOCK2_H
@@ -0,0 +1,12 @@
+#ifndef POSIX_WS2TCPIP_H
+#define POSIX_WS2TCPIP_H
+
+/**
+ * @brief Winsock TCP/IP helpers: inet_pton, inet_ntop and friends
+ */
+
+#include "winsock2.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#endif // POSIX_WS2TCPIP_H
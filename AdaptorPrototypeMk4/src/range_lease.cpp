@@ -0,0 +1,810 @@
+/**
+ * @file range_lease.cpp
+ * @brief Implementation of per-range ownership leases
+ *
+ * The table is read as a whole into a local copy inside a region read
+ * bracket, so a row being applied by the receive thread is never seen half
+ * written. This node's row is only changed under g_leaseMutex, inside a
+ * region write bracket, and each changed lease is marked changed on its own
+ * so that updates to the table never cover more than one row.
+ *
+ * Writes to this node's leases are also made under g_leaseMutex, after
+ * checking the table, so a handoff can't start between the check and the
+ * write, and the handoff version covers every write the node made.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "range_lease.h"
+#include "shared_memory.h"
+#include "change_tracking.h"
+#include <deque>
+#include <iostream>
+#include <map>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+/// Lease node ID of this node, 0 until set
+static uint32_t g_leaseNodeId = 0;
+
+/// Mutex serializing changes to this node's row, writes to its leases, and the state below
+static HANDLE g_leaseMutex = NULL;
+
+/// Callback that sends writes to the nodes that hold their ranges
+static RangeWriteForwarder g_rangeWriteForwarder = NULL;
+
+/// Writes a remote node must make to a lease in a window before the lease moves; 0 never moves leases
+static uint32_t g_migrationWrites = RANGE_MIGRATION_DEFAULT_WRITES;
+
+/// Length of the window writes are counted over
+static uint32_t g_migrationWindowMs = RANGE_MIGRATION_WINDOW_MS;
+
+/**
+ * @brief Writes to this node's leases in a region in the current window, by origin
+ */
+struct RangeWriteCounts {
+    ULONGLONG windowStart;
+    uint32_t writes[RANGE_LEASES_PER_NODE][MAX_LEASE_NODES];
+};
+
+/// Write counts by region
+static std::map<std::string, RangeWriteCounts> g_writeCounts;
+
+/**
+ * @brief A forwarded write waiting for its range to be handed to this node
+ */
+struct HeldRangeWrite {
+    SyncMessage message;
+    ULONGLONG received;
+};
+
+/// Held writes, oldest first
+static std::deque<HeldRangeWrite> g_heldWrites;
+
+static void lockLeaseMutex() {
+    if (g_leaseMutex == NULL) {
+        g_leaseMutex = CreateMutex(NULL, FALSE, NULL);
+        if (g_leaseMutex == NULL) {
+            std::cerr << "Failed to create lease mutex: " << GetLastError() << std::endl;
+        }
+    }
+    if (g_leaseMutex != NULL) {
+        WaitForSingleObject(g_leaseMutex, INFINITE);
+    }
+}
+
+static void unlockLeaseMutex() {
+    if (g_leaseMutex != NULL) {
+        ReleaseMutex(g_leaseMutex);
+    }
+}
+
+/**
+ * @brief Wall-clock time in milliseconds, comparable between nodes
+ */
+static uint64_t leaseClockMs() {
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    return ((static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime) / 10000;
+}
+
+/**
+ * @brief Region offset of a lease in the table
+ */
+static size_t leaseEntryOffset(uint32_t nodeId, int slot) {
+    return RANGE_LEASE_TABLE_OFFSET + offsetof(RangeLeaseTable, leases) +
+           ((nodeId - 1) * RANGE_LEASES_PER_NODE + slot) * sizeof(RangeLease);
+}
+
+/**
+ * @brief Get a multi-writer region, or NULL if the region has no lease table
+ */
+static char* leaseRegion(const char* memoryName, size_t* regionSize) {
+    char* region = static_cast<char*>(getSharedMemoryMapping(memoryName, regionSize));
+    if (!region || *regionSize < MULTI_WRITER_DATA_OFFSET) {
+        return NULL;
+    }
+    const RangeLeaseTable* table = reinterpret_cast<const RangeLeaseTable*>(region + RANGE_LEASE_TABLE_OFFSET);
+    return (table->magic == RANGE_LEASE_TABLE_MAGIC) ? region : NULL;
+}
+
+/**
+ * @brief Copy the lease table without seeing a write in progress
+ */
+static void readLeaseTable(const char* region, RangeLeaseTable* table) {
+    for (;;) {
+        uint32_t sequence = beginRegionRead(region);
+        memcpy(table, region + RANGE_LEASE_TABLE_OFFSET, sizeof(RangeLeaseTable));
+        if (endRegionRead(region, sequence)) {
+            return;
+        }
+    }
+}
+
+static bool leaseLive(const RangeLease& lease, uint64_t now) {
+    return lease.size > 0 && lease.expires > now;
+}
+
+static bool leaseOverlaps(const RangeLease& lease, uint64_t offset, uint64_t size) {
+    return offset < lease.offset + lease.size && lease.offset < offset + size;
+}
+
+/**
+ * @brief Check whether a lease wins an overlap with another
+ *
+ * A lease being handed over yields to the lease of the node it goes to.
+ */
+static bool leasePrecedes(const RangeLease& a, const RangeLease& b) {
+    if (a.handoffTo == b.owner) {
+        return false;
+    }
+    if (b.handoffTo == a.owner) {
+        return true;
+    }
+    return a.granted < b.granted || (a.granted == b.granted && a.owner < b.owner);
+}
+
+/**
+ * @brief The live lease that covers a range and wins every overlap, or NULL
+ */
+static const RangeLease* findHolder(const RangeLeaseTable& table, uint64_t offset, uint64_t size, uint64_t now) {
+    for (int node = 0; node < MAX_LEASE_NODES; node++) {
+        for (int slot = 0; slot < RANGE_LEASES_PER_NODE; slot++) {
+            const RangeLease& lease = table.leases[node][slot];
+            if (!leaseLive(lease, now) || offset < lease.offset || offset + size > lease.offset + lease.size) {
+                continue;
+            }
+            bool wins = true;
+            for (int other = 0; other < MAX_LEASE_NODES && wins; other++) {
+                if (other == node) {
+                    continue;
+                }
+                for (int i = 0; i < RANGE_LEASES_PER_NODE; i++) {
+                    const RangeLease& rival = table.leases[other][i];
+                    if (leaseLive(rival, now) && leaseOverlaps(rival, offset, size) && leasePrecedes(rival, lease)) {
+                        wins = false;
+                        break;
+                    }
+                }
+            }
+            if (wins) {
+                return &lease;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief The node that applies writes to a range: its holder, or the node it is being handed to
+ */
+static uint32_t writeTarget(const RangeLease* holder) {
+    if (!holder) {
+        return 0;
+    }
+    return (holder->handoffTo != 0) ? holder->handoffTo : holder->owner;
+}
+
+/**
+ * @brief Check that a range lies within the part of a region that ranges can lease
+ */
+static bool inLeasableArea(size_t regionSize, size_t offset, size_t size) {
+    return size > 0 && offset >= MULTI_WRITER_DATA_OFFSET && offset <= regionSize && size <= regionSize - offset;
+}
+
+/**
+ * @brief Check whether a node other than the given one has a live lease overlapping a range
+ */
+static bool leasedByOther(const RangeLeaseTable& table, uint32_t nodeId, uint64_t offset, uint64_t size,
+                          uint64_t now) {
+    for (int node = 0; node < MAX_LEASE_NODES; node++) {
+        if (static_cast<uint32_t>(node + 1) == nodeId) {
+            continue;
+        }
+        for (int slot = 0; slot < RANGE_LEASES_PER_NODE; slot++) {
+            const RangeLease& lease = table.leases[node][slot];
+            if (leaseLive(lease, now) && leaseOverlaps(lease, offset, size)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Store one of this node's leases and send it to the peers
+ */
+static void writeLease(const char* memoryName, char* region, int slot, const RangeLease& lease) {
+    size_t entryOffset = leaseEntryOffset(g_leaseNodeId, slot);
+    region = static_cast<char*>(beginNamedRegionWrite(memoryName, region));
+    if (!region) {
+        return;
+    }
+    memcpy(region + entryOffset, &lease, sizeof(lease));
+    markRegionChanged(memoryName, entryOffset, sizeof(lease));
+    endRegionWrite(region);
+}
+
+/**
+ * @brief Write a range if this node holds it and isn't handing it over
+ *
+ * @param writer Lease node ID of the node the write came from, counted against the lease
+ * @return true if the bytes were written
+ */
+static bool writeIfHolder(const char* memoryName, char* region, size_t offset, const void* data, size_t size,
+                          uint32_t writer) {
+    lockLeaseMutex();
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    const RangeLease* holder = findHolder(table, offset, size, leaseClockMs());
+    if (!holder || holder->owner != g_leaseNodeId || holder->handoffTo != 0) {
+        unlockLeaseMutex();
+        return false;
+    }
+
+    region = static_cast<char*>(beginNamedRegionWrite(memoryName, region));
+    if (!region) {
+        unlockLeaseMutex();
+        return false;
+    }
+    memcpy(region + offset, data, size);
+    markRegionChanged(memoryName, offset, size);
+    endRegionWrite(region);
+
+    if (writer >= 1 && writer <= MAX_LEASE_NODES) {
+        int slot = static_cast<int>(holder - table.leases[g_leaseNodeId - 1]);
+        g_writeCounts[memoryName].writes[slot][writer - 1]++;
+    }
+    unlockLeaseMutex();
+    return true;
+}
+
+static void forwardRangeWrite(uint32_t nodeId, const SyncMessage& message) {
+    if (g_rangeWriteForwarder) {
+        g_rangeWriteForwarder(nodeId, message);
+    } else {
+        std::cerr << "[LEASE] Dropped a write to " << message.memoryName << " at offset " << message.offset
+                  << " for node " << nodeId << "; writes aren't forwarded" << std::endl;
+    }
+}
+
+static void holdRangeWrite(const SyncMessage& message) {
+    lockLeaseMutex();
+    if (g_heldWrites.size() >= RANGE_WRITE_HOLD_LIMIT) {
+        unlockLeaseMutex();
+        std::cerr << "[LEASE] Too many held writes; dropped a write to " << message.memoryName << " at offset "
+                  << message.offset << std::endl;
+        return;
+    }
+    HeldRangeWrite held;
+    held.message = message;
+    held.received = GetTickCount64();
+    g_heldWrites.push_back(held);
+    unlockLeaseMutex();
+}
+
+/**
+ * @brief Apply a forwarded write, or pass it on toward the node that should apply it
+ *
+ * A node handing a range over passes its writes to the new node. Any other
+ * node passes a write on once, flagged as forwarded, and holds a flagged
+ * write it can't apply rather than send it back.
+ *
+ * @return false if the write should be held until its range is handed to this node
+ */
+static bool routeRangeWrite(const SyncMessage& message) {
+    size_t regionSize = 0;
+    char* region = leaseRegion(message.memoryName, &regionSize);
+    if (!region || g_leaseNodeId == 0 || message.size > MAX_SYNC_DATA_SIZE ||
+        !inLeasableArea(regionSize, message.offset, message.size)) {
+        return true;
+    }
+    if (writeIfHolder(message.memoryName, region, message.offset, message.data, message.size, message.origin)) {
+        return true;
+    }
+
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    const RangeLease* holder = findHolder(table, message.offset, message.size, leaseClockMs());
+    uint32_t target = writeTarget(holder);
+    bool handingOver = holder && holder->owner == g_leaseNodeId;
+    if (!handingOver && (target == g_leaseNodeId || (message.flags & SYNC_FLAG_FORWARDED))) {
+        return false;
+    }
+    if (target == 0) {
+        std::cerr << "[LEASE] Dropped a write to " << message.memoryName << " at offset " << message.offset
+                  << " from node " << message.origin << "; no node leases it" << std::endl;
+        return true;
+    }
+    SyncMessage forwarded = message;
+    forwarded.flags |= SYNC_FLAG_FORWARDED;
+    forwardRangeWrite(target, forwarded);
+    return true;
+}
+
+/**
+ * @brief Apply or pass on the held writes of a region that no longer need to wait
+ */
+static void retryHeldWrites(const char* memoryName) {
+    std::deque<HeldRangeWrite> held;
+    lockLeaseMutex();
+    held.swap(g_heldWrites);
+    unlockLeaseMutex();
+    if (held.empty()) {
+        return;
+    }
+
+    ULONGLONG now = GetTickCount64();
+    std::deque<HeldRangeWrite> kept;
+    for (size_t i = 0; i < held.size(); i++) {
+        const SyncMessage& message = held[i].message;
+        if (strcmp(message.memoryName, memoryName) != 0) {
+            kept.push_back(held[i]);
+        } else if (routeRangeWrite(message)) {
+            continue;
+        } else if (now - held[i].received < RANGE_WRITE_HOLD_MS) {
+            kept.push_back(held[i]);
+        } else {
+            std::cerr << "[LEASE] Dropped a write to " << memoryName << " at offset " << message.offset
+                      << " from node " << message.origin << "; its range was never handed here" << std::endl;
+        }
+    }
+
+    // Writes held while these were out go after them
+    lockLeaseMutex();
+    kept.insert(kept.end(), g_heldWrites.begin(), g_heldWrites.end());
+    g_heldWrites.swap(kept);
+    unlockLeaseMutex();
+}
+
+bool setLeaseNodeId(uint32_t nodeId) {
+    if (nodeId < 1 || nodeId > MAX_LEASE_NODES) {
+        return false;
+    }
+    g_leaseNodeId = nodeId;
+    return true;
+}
+
+uint32_t leaseNodeId() {
+    return g_leaseNodeId;
+}
+
+bool initRangeLeaseTable(const char* memoryName) {
+    size_t regionSize = 0;
+    char* region = static_cast<char*>(getSharedMemoryMapping(memoryName, &regionSize));
+    if (!region || regionSize < MULTI_WRITER_DATA_OFFSET) {
+        std::cerr << "[LEASE] " << memoryName << " is too small for a lease table" << std::endl;
+        return false;
+    }
+    RangeLeaseTable* table = reinterpret_cast<RangeLeaseTable*>(region + RANGE_LEASE_TABLE_OFFSET);
+    if (table->magic != RANGE_LEASE_TABLE_MAGIC) {
+        table->magic = RANGE_LEASE_TABLE_MAGIC;
+        markSharedMemoryRangeDirty(memoryName, RANGE_LEASE_TABLE_OFFSET, sizeof(uint32_t));
+    }
+
+    lockLeaseMutex();
+    g_writeCounts.erase(memoryName);
+    std::deque<HeldRangeWrite> kept;
+    for (size_t i = 0; i < g_heldWrites.size(); i++) {
+        if (strcmp(g_heldWrites[i].message.memoryName, memoryName) != 0) {
+            kept.push_back(g_heldWrites[i]);
+        }
+    }
+    g_heldWrites.swap(kept);
+    unlockLeaseMutex();
+    return true;
+}
+
+bool acquireRangeLease(const char* memoryName, size_t offset, size_t size, uint32_t durationMs) {
+    size_t regionSize = 0;
+    char* region = leaseRegion(memoryName, &regionSize);
+    if (!region || g_leaseNodeId == 0 || size == 0 || durationMs == 0 || offset < MULTI_WRITER_DATA_OFFSET ||
+        offset > regionSize || size > regionSize - offset) {
+        return false;
+    }
+
+    lockLeaseMutex();
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    uint64_t now = leaseClockMs();
+    if (leasedByOther(table, g_leaseNodeId, offset, size, now)) {
+        unlockLeaseMutex();
+        return false;
+    }
+
+    // The same range again is a renewal and keeps its place in overlaps
+    RangeLease* row = table.leases[g_leaseNodeId - 1];
+    int freeSlot = -1;
+    for (int slot = 0; slot < RANGE_LEASES_PER_NODE; slot++) {
+        if (leaseLive(row[slot], now) && row[slot].offset == offset && row[slot].size == size) {
+            row[slot].expires = now + durationMs;
+            row[slot].durationMs = durationMs;
+            writeLease(memoryName, region, slot, row[slot]);
+            unlockLeaseMutex();
+            return true;
+        }
+        if (leaseLive(row[slot], now) && leaseOverlaps(row[slot], offset, size)) {
+            unlockLeaseMutex();
+            return false;
+        }
+        if (freeSlot < 0 && !leaseLive(row[slot], now)) {
+            freeSlot = slot;
+        }
+    }
+    if (freeSlot < 0) {
+        std::cerr << "[LEASE] No free lease slot in " << memoryName << std::endl;
+        unlockLeaseMutex();
+        return false;
+    }
+
+    RangeLease lease;
+    memset(&lease, 0, sizeof(lease));
+    lease.offset = offset;
+    lease.size = size;
+    lease.granted = now;
+    lease.expires = now + durationMs;
+    lease.owner = g_leaseNodeId;
+    lease.durationMs = durationMs;
+    writeLease(memoryName, region, freeSlot, lease);
+    memset(g_writeCounts[memoryName].writes[freeSlot], 0, sizeof(g_writeCounts[memoryName].writes[freeSlot]));
+    unlockLeaseMutex();
+    return true;
+}
+
+bool releaseRangeLease(const char* memoryName, size_t offset, size_t size) {
+    size_t regionSize = 0;
+    char* region = leaseRegion(memoryName, &regionSize);
+    if (!region || g_leaseNodeId == 0) {
+        return false;
+    }
+
+    lockLeaseMutex();
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    const RangeLease* row = table.leases[g_leaseNodeId - 1];
+    for (int slot = 0; slot < RANGE_LEASES_PER_NODE; slot++) {
+        if (row[slot].size > 0 && row[slot].offset == offset && row[slot].size == size) {
+            RangeLease empty;
+            memset(&empty, 0, sizeof(empty));
+            writeLease(memoryName, region, slot, empty);
+            unlockLeaseMutex();
+            return true;
+        }
+    }
+    unlockLeaseMutex();
+    return false;
+}
+
+int renewRangeLeases(const char* memoryName) {
+    size_t regionSize = 0;
+    char* region = leaseRegion(memoryName, &regionSize);
+    if (!region || g_leaseNodeId == 0) {
+        return 0;
+    }
+
+    lockLeaseMutex();
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    uint64_t now = leaseClockMs();
+    int renewed = 0;
+    RangeLease* row = table.leases[g_leaseNodeId - 1];
+    for (int slot = 0; slot < RANGE_LEASES_PER_NODE; slot++) {
+        RangeLease& lease = row[slot];
+        if (lease.size == 0) {
+            continue;
+        }
+        if (!leaseLive(lease, now)) {
+            std::cerr << "[LEASE] Lease on " << memoryName << " [" << lease.offset << ", "
+                      << lease.offset + lease.size << ") lapsed" << std::endl;
+            memset(&lease, 0, sizeof(lease));
+            writeLease(memoryName, region, slot, lease);
+        } else if (lease.expires - now <= lease.durationMs / 2) {
+            lease.expires = now + lease.durationMs;
+            writeLease(memoryName, region, slot, lease);
+            renewed++;
+        }
+    }
+    unlockLeaseMutex();
+    return renewed;
+}
+
+uint32_t rangeLeaseHolder(const char* memoryName, size_t offset, size_t size) {
+    size_t regionSize = 0;
+    char* region = leaseRegion(memoryName, &regionSize);
+    if (!region) {
+        return 0;
+    }
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    const RangeLease* holder = findHolder(table, offset, size, leaseClockMs());
+    return holder ? holder->owner : 0;
+}
+
+bool writeLeasedRange(const char* memoryName, size_t offset, const void* data, size_t size) {
+    size_t regionSize = 0;
+    char* region = leaseRegion(memoryName, &regionSize);
+    if (!region || g_leaseNodeId == 0 || !inLeasableArea(regionSize, offset, size)) {
+        return false;
+    }
+    return writeIfHolder(memoryName, region, offset, data, size, g_leaseNodeId);
+}
+
+void setRangeWriteForwarder(RangeWriteForwarder forwarder) {
+    g_rangeWriteForwarder = forwarder;
+}
+
+void setRangeMigration(uint32_t minWrites, uint32_t windowMs) {
+    lockLeaseMutex();
+    g_migrationWrites = minWrites;
+    g_migrationWindowMs = windowMs;
+    unlockLeaseMutex();
+}
+
+bool writeSharedRange(const char* memoryName, size_t offset, const void* data, size_t size) {
+    size_t regionSize = 0;
+    char* region = leaseRegion(memoryName, &regionSize);
+    if (!region || g_leaseNodeId == 0 || !inLeasableArea(regionSize, offset, size)) {
+        return false;
+    }
+    if (writeIfHolder(memoryName, region, offset, data, size, g_leaseNodeId)) {
+        return true;
+    }
+
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    const RangeLease* holder = findHolder(table, offset, size, leaseClockMs());
+    uint32_t target = writeTarget(holder);
+    if (target == 0) {
+        return false;
+    }
+
+    // Each forwarded write fits in one message; a range this node is handing over is flagged so the new node waits for it
+    const char* bytes = static_cast<const char*>(data);
+    for (size_t done = 0; done < size; done += MAX_SYNC_DATA_SIZE) {
+        SyncMessage message;
+        memset(&message, 0, offsetof(SyncMessage, data));
+        message.msgType = MSG_RANGE_WRITE;
+        strncpy(message.memoryName, memoryName, sizeof(message.memoryName) - 1);
+        message.updateId = generateUniqueId();
+        message.offset = offset + done;
+        message.size = (size - done > MAX_SYNC_DATA_SIZE) ? MAX_SYNC_DATA_SIZE : size - done;
+        message.timestamp = GetTickCount();
+        message.flags = (holder->owner == g_leaseNodeId) ? SYNC_FLAG_FORWARDED : 0;
+        message.origin = g_leaseNodeId;
+        memcpy(message.data, bytes + done, message.size);
+        if (target == g_leaseNodeId) {
+            holdRangeWrite(message);
+        } else {
+            forwardRangeWrite(target, message);
+        }
+    }
+    return true;
+}
+
+void receiveRangeWrite(const SyncMessage& message) {
+    if (!routeRangeWrite(message)) {
+        holdRangeWrite(message);
+    }
+}
+
+int balanceRangeLeases(const char* memoryName) {
+    size_t regionSize = 0;
+    char* region = leaseRegion(memoryName, &regionSize);
+    if (!region || g_leaseNodeId == 0) {
+        return 0;
+    }
+
+    lockLeaseMutex();
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    uint64_t now = leaseClockMs();
+    uint64_t version = reinterpret_cast<const MemoryLayout*>(region)->version;
+    RangeWriteCounts& counts = g_writeCounts[memoryName];
+    RangeLease* row = table.leases[g_leaseNodeId - 1];
+    int moved = 0;
+
+    // Take the ranges handed to this node, within the first half of the handoff so the old holder hasn't given up
+    for (int node = 0; node < MAX_LEASE_NODES; node++) {
+        for (int slot = 0; slot < RANGE_LEASES_PER_NODE; slot++) {
+            const RangeLease& lease = table.leases[node][slot];
+            if (!leaseLive(lease, now) || lease.handoffTo != g_leaseNodeId ||
+                now + lease.durationMs / 2 >= lease.handoffExpires || version < lease.handoffVersion) {
+                continue;
+            }
+            int freeSlot = -1;
+            bool overlaps = false;
+            for (int i = 0; i < RANGE_LEASES_PER_NODE; i++) {
+                if (leaseLive(row[i], now)) {
+                    overlaps = overlaps || leaseOverlaps(row[i], lease.offset, lease.size);
+                } else if (freeSlot < 0) {
+                    freeSlot = i;
+                }
+            }
+            if (overlaps || freeSlot < 0) {
+                continue;
+            }
+            RangeLease& taken = row[freeSlot];
+            memset(&taken, 0, sizeof(taken));
+            taken.offset = lease.offset;
+            taken.size = lease.size;
+            taken.granted = lease.granted;
+            taken.expires = now + lease.durationMs;
+            taken.owner = g_leaseNodeId;
+            taken.durationMs = lease.durationMs;
+            writeLease(memoryName, region, freeSlot, taken);
+            memset(counts.writes[freeSlot], 0, sizeof(counts.writes[freeSlot]));
+            std::cout << "[LEASE] Took over " << memoryName << " [" << lease.offset << ", "
+                      << lease.offset + lease.size << ") from node " << lease.owner << std::endl;
+            moved++;
+        }
+    }
+
+    // Drop the leases the new node has taken, and take back the ones it didn't take in time
+    for (int slot = 0; slot < RANGE_LEASES_PER_NODE; slot++) {
+        RangeLease& lease = row[slot];
+        if (!leaseLive(lease, now) || lease.handoffTo == 0) {
+            continue;
+        }
+        bool taken = false;
+        const RangeLease* targetRow = table.leases[lease.handoffTo - 1];
+        for (int i = 0; i < RANGE_LEASES_PER_NODE && !taken; i++) {
+            taken = leaseLive(targetRow[i], now) && targetRow[i].offset == lease.offset &&
+                    targetRow[i].size == lease.size;
+        }
+        if (taken) {
+            std::cout << "[LEASE] Handed " << memoryName << " [" << lease.offset << ", "
+                      << lease.offset + lease.size << ") to node " << lease.handoffTo << std::endl;
+            memset(&lease, 0, sizeof(lease));
+            writeLease(memoryName, region, slot, lease);
+            moved++;
+        } else if (now >= lease.handoffExpires) {
+            std::cerr << "[LEASE] Node " << lease.handoffTo << " didn't take " << memoryName << " ["
+                      << lease.offset << ", " << lease.offset + lease.size << "); writing it here again" << std::endl;
+            lease.handoffTo = 0;
+            lease.handoffVersion = 0;
+            lease.handoffExpires = 0;
+            writeLease(memoryName, region, slot, lease);
+        }
+    }
+
+    // At the end of each window, hand each lease to a remote node that made most of its writes
+    ULONGLONG tick = GetTickCount64();
+    if (tick - counts.windowStart >= g_migrationWindowMs) {
+        for (int slot = 0; slot < RANGE_LEASES_PER_NODE && g_migrationWrites > 0 && counts.windowStart != 0; slot++) {
+            RangeLease& lease = row[slot];
+            if (!leaseLive(lease, now) || lease.handoffTo != 0) {
+                continue;
+            }
+            uint32_t total = 0;
+            uint32_t topNode = 0;
+            uint32_t topWrites = 0;
+            for (int node = 0; node < MAX_LEASE_NODES; node++) {
+                uint32_t writes = counts.writes[slot][node];
+                total += writes;
+                if (static_cast<uint32_t>(node + 1) != g_leaseNodeId && writes > topWrites) {
+                    topNode = node + 1;
+                    topWrites = writes;
+                }
+            }
+            if (topWrites < g_migrationWrites || static_cast<uint64_t>(topWrites) * 4 < static_cast<uint64_t>(total) * 3) {
+                continue;
+            }
+            lease.handoffTo = topNode;
+            lease.handoffVersion = version;
+            lease.handoffExpires = now + lease.durationMs;
+            writeLease(memoryName, region, slot, lease);
+            std::cout << "[LEASE] Handing " << memoryName << " [" << lease.offset << ", "
+                      << lease.offset + lease.size << ") to node " << topNode << ", which made " << topWrites
+                      << " of its " << total << " writes" << std::endl;
+            moved++;
+        }
+        memset(counts.writes, 0, sizeof(counts.writes));
+        counts.windowStart = tick;
+    }
+    unlockLeaseMutex();
+
+    // Writes held for ranges this node has just taken are applied now
+    retryHeldWrites(memoryName);
+    return moved;
+}
+
+/**
+ * @brief Check whether a node may write a range of data
+ *
+ * The range's holder may, and so may anyone while no other node leases it.
+ */
+static bool dataWriteAdmitted(const RangeLeaseTable& table, uint32_t origin, uint64_t offset, uint64_t size,
+                              uint64_t now) {
+    const RangeLease* holder = findHolder(table, offset, size, now);
+    return (holder && holder->owner == origin) || !leasedByOther(table, origin, offset, size, now);
+}
+
+bool rangeLeasesAdmit(const SyncMessage& message) {
+    if (message.msgType != MSG_SINGLE_UPDATE && message.msgType != MSG_START_UPDATE &&
+        message.msgType != MSG_UPDATE_CHUNK && message.msgType != MSG_END_UPDATE) {
+        return true;
+    }
+    size_t regionSize = 0;
+    char* region = leaseRegion(message.memoryName, &regionSize);
+    if (!region) {
+        return true;
+    }
+
+    uint64_t start = message.offset;
+    uint64_t end = message.offset + message.size;
+    if (end <= RANGE_LEASE_TABLE_OFFSET) {
+        return true;
+    }
+
+    // A lease row is written by its own node only
+    if (start < MULTI_WRITER_DATA_OFFSET) {
+        if (message.origin < 1 || message.origin > MAX_LEASE_NODES) {
+            return false;
+        }
+        size_t rowStart = leaseEntryOffset(message.origin, 0);
+        size_t rowEnd = rowStart + RANGE_LEASES_PER_NODE * sizeof(RangeLease);
+        return start >= rowStart && end <= rowEnd;
+    }
+
+    // The data of a multi-part update is checked once all of its parts are in
+    if (message.msgType != MSG_SINGLE_UPDATE) {
+        return true;
+    }
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    return dataWriteAdmitted(table, message.origin, start, end - start, leaseClockMs());
+}
+
+size_t rangeLeasesFilterUpdate(std::vector<SyncMessage>& chunks) {
+    size_t regionSize = 0;
+    char* region = chunks.empty() ? NULL : leaseRegion(chunks[0].memoryName, &regionSize);
+    if (!region) {
+        return 0;
+    }
+
+    // Lease rows in the update count as applied; rangeLeasesAdmit has only let through each origin's own row
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i].offset >= RANGE_LEASE_TABLE_OFFSET &&
+            chunks[i].offset + chunks[i].size <= MULTI_WRITER_DATA_OFFSET) {
+            memcpy(reinterpret_cast<char*>(&table) + (chunks[i].offset - RANGE_LEASE_TABLE_OFFSET), chunks[i].data,
+                   chunks[i].size);
+        }
+    }
+
+    uint64_t now = leaseClockMs();
+    std::vector<SyncMessage> admitted;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i].offset + chunks[i].size > MULTI_WRITER_DATA_OFFSET &&
+            !dataWriteAdmitted(table, chunks[i].origin, chunks[i].offset, chunks[i].size, now)) {
+            continue;
+        }
+        admitted.push_back(chunks[i]);
+    }
+    size_t removed = chunks.size() - admitted.size();
+    chunks.swap(admitted);
+    return removed;
+}
+
+bool getRangeLeases(const char* memoryName, std::vector<RangeLease>& leases) {
+    leases.clear();
+    size_t regionSize = 0;
+    char* region = leaseRegion(memoryName, &regionSize);
+    if (!region) {
+        return false;
+    }
+    RangeLeaseTable table;
+    readLeaseTable(region, &table);
+    uint64_t now = leaseClockMs();
+    for (int node = 0; node < MAX_LEASE_NODES; node++) {
+        for (int slot = 0; slot < RANGE_LEASES_PER_NODE; slot++) {
+            if (leaseLive(table.leases[node][slot], now)) {
+                leases.push_back(table.leases[node][slot]);
+            }
+        }
+    }
+    return true;
+}
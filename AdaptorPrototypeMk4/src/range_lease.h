@@ -0,0 +1,294 @@
+#ifndef RANGE_LEASE_H
+#define RANGE_LEASE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "sync_message.h"
+#include "memory_layout.h"
+
+/**
+ * @brief Multi-writer regions with per-range ownership leases
+ *
+ * A multi-writer region has the same name on every node and a lease table
+ * right after its MemoryLayout header. A node that holds a live lease on a
+ * range writes it locally with writeLeasedRange, and its sync thread sends
+ * the change to every peer directly, as for any region it writes. Versions
+ * follow the usual rule: a local write increments the version and an
+ * applied update raises it to the update's version.
+ *
+ * The table has a row of RANGE_LEASES_PER_NODE leases per node, indexed by
+ * lease node ID (1 to MAX_LEASE_NODES). Each node only writes its own row,
+ * so the table replicates like any other range with a single writer. Lease
+ * times are wall-clock milliseconds, so nodes need loosely synchronized
+ * clocks; a lease is renewed by its node's sync thread when half of its
+ * duration has passed, and lapses if the node stops.
+ *
+ * Two nodes can claim overlapping ranges before either has seen the
+ * other's row. Once the rows have replicated, every node resolves the
+ * overlap the same way: the lease granted first wins, and the lower node
+ * ID breaks a tie. Receivers drop updates to a range whose winning lease
+ * belongs to a node other than the update's origin.
+ *
+ * writeSharedRange writes a range anywhere: a node that doesn't hold the
+ * range forwards the write to the holder, which applies and publishes it.
+ * The holder counts the writes to each of its leases by origin, and when
+ * one remote node makes most of them it hands the lease over:
+ *
+ *  1. The holder stops writing the range and sets handoffTo and
+ *     handoffVersion, the region version at that point, in its lease.
+ *     Writes it gets for the range from then on go to the new node.
+ *  2. The new node takes the range once its copy has reached
+ *     handoffVersion, with a lease of its own that keeps the old lease's
+ *     grant time. A lease being handed over always yields to the new
+ *     node's lease, so every node agrees on the holder from then on. Writes
+ *     that reach the new node before it can take the range are held until
+ *     it does.
+ *  3. The old holder drops its lease once it sees the new one, or takes
+ *     the range back if the new node hasn't taken it within a lease
+ *     duration.
+ *
+ * Updates from one sender arrive in the order they were sent, so the new
+ * node has applied the old holder's last writes before it takes the range.
+ */
+
+#define RANGE_LEASE_TABLE_MAGIC 0x45534C52u   // "RLSE"
+
+/// Node IDs that can hold leases are 1 to MAX_LEASE_NODES
+#define MAX_LEASE_NODES 16
+
+/// Leases one node can hold in a region at once
+#define RANGE_LEASES_PER_NODE 8
+
+/// How often a region's sync thread looks for leases to renew
+#define RANGE_LEASE_CHECK_INTERVAL_MS 100
+
+/// Writes a remote node must make to a lease in one window before the lease moves to it
+#define RANGE_MIGRATION_DEFAULT_WRITES 32
+
+/// Length of the window over which writes to a lease are counted
+#define RANGE_MIGRATION_WINDOW_MS 1000
+
+/// How long a forwarded write waits for its range to be handed to this node
+#define RANGE_WRITE_HOLD_MS 1000
+
+/// Most forwarded writes held at once
+#define RANGE_WRITE_HOLD_LIMIT 1024
+
+/**
+ * @brief One lease; free while size is 0
+ */
+struct RangeLease {
+    uint64_t offset;        // Region offset of the leased range
+    uint64_t size;          // Size of the range
+    uint64_t granted;       // Wall-clock time the lease was first granted, in ms
+    uint64_t expires;       // Wall-clock time the lease lapses unless renewed, in ms
+    uint64_t handoffVersion;  // Region version at which the holder stopped writing for handoffTo
+    uint64_t handoffExpires;  // Wall-clock time the handoff is abandoned unless handoffTo has the range
+    uint32_t owner;         // Lease node ID of the holder
+    uint32_t durationMs;    // Length of each renewal
+    uint32_t handoffTo;     // Lease node ID the range is being handed to, or 0
+    uint32_t reserved;
+};
+
+/**
+ * @brief The lease table that follows MemoryLayout in a multi-writer region
+ */
+struct RangeLeaseTable {
+    uint32_t magic;         // RANGE_LEASE_TABLE_MAGIC; set locally and never replicated
+    uint32_t reserved;
+    RangeLease leases[MAX_LEASE_NODES][RANGE_LEASES_PER_NODE];
+};
+
+#define RANGE_LEASE_TABLE_OFFSET sizeof(MemoryLayout)
+
+/// Offset of the first byte of a multi-writer region that ranges can lease
+#define MULTI_WRITER_DATA_OFFSET (sizeof(MemoryLayout) + sizeof(RangeLeaseTable))
+
+/**
+ * @brief Set the lease node ID of this node
+ *
+ * Stamped as SyncMessage::origin on the updates this node writes.
+ *
+ * @param nodeId 1 to MAX_LEASE_NODES, usually the instance ID
+ * @return true if the ID is in range
+ */
+bool setLeaseNodeId(uint32_t nodeId);
+
+/**
+ * @brief Get the lease node ID of this node
+ *
+ * @return The ID, or 0 if none has been set
+ */
+uint32_t leaseNodeId();
+
+/**
+ * @brief Make a region a multi-writer region
+ *
+ * Marks the lease table as present. Every node calls this for its own copy
+ * of the region; existing leases in a recovered region are kept, and the
+ * region's write counts and held writes are cleared.
+ *
+ * @param memoryName Name of the region; at least MULTI_WRITER_DATA_OFFSET bytes
+ * @return true if the region has a lease table
+ */
+bool initRangeLeaseTable(const char* memoryName);
+
+/**
+ * @brief Take a lease on a range
+ *
+ * Fails if the range overlaps a live lease of another node. Taking a range
+ * this node already leases renews it.
+ *
+ * @param memoryName Name of the region
+ * @param offset Region offset of the range; at least MULTI_WRITER_DATA_OFFSET
+ * @param size Size of the range
+ * @param durationMs How long the lease lasts between renewals
+ * @return true if the lease was granted
+ */
+bool acquireRangeLease(const char* memoryName, size_t offset, size_t size, uint32_t durationMs);
+
+/**
+ * @brief Give up a lease taken with acquireRangeLease
+ *
+ * @param memoryName Name of the region
+ * @param offset Region offset of the range
+ * @param size Size of the range
+ * @return true if this node held the lease
+ */
+bool releaseRangeLease(const char* memoryName, size_t offset, size_t size);
+
+/**
+ * @brief Renew this node's leases that are past half of their duration
+ *
+ * Called from the region's sync thread. Leases that have already lapsed are
+ * dropped rather than renewed, as another node may have taken the range.
+ *
+ * @param memoryName Name of the region
+ * @return Number of leases renewed
+ */
+int renewRangeLeases(const char* memoryName);
+
+/**
+ * @brief Find the node that may write a range
+ *
+ * @param memoryName Name of the region
+ * @param offset Region offset of the range
+ * @param size Size of the range
+ * @return Lease node ID of the holder of a live lease covering the whole
+ *         range that wins every overlap, or 0 if there is none
+ */
+uint32_t rangeLeaseHolder(const char* memoryName, size_t offset, size_t size);
+
+/**
+ * @brief Write a range this node holds the lease on
+ *
+ * The write is bracketed in the region's write sequence and marked changed,
+ * so the sync thread sends it to every peer.
+ *
+ * @param memoryName Name of the region
+ * @param offset Region offset to write at
+ * @param data Bytes to write
+ * @param size Number of bytes
+ * @return true if this node holds the range, isn't handing it over, and the
+ *         bytes were written
+ */
+bool writeLeasedRange(const char* memoryName, size_t offset, const void* data, size_t size);
+
+/**
+ * @brief Callback that sends a forwarded write to another node
+ *
+ * @param nodeId Lease node ID of the node to send to
+ * @param message A MSG_RANGE_WRITE message
+ */
+typedef void (*RangeWriteForwarder)(uint32_t nodeId, const SyncMessage& message);
+
+/**
+ * @brief Set the callback that sends writes to the node holding a range
+ *
+ * @param forwarder The callback, or NULL to drop writes this node can't apply
+ */
+void setRangeWriteForwarder(RangeWriteForwarder forwarder);
+
+/**
+ * @brief Set when a lease moves to the node that writes it most
+ *
+ * @param minWrites Writes a remote node must make in one window, and at
+ *        least three quarters of all writes to the lease; 0 never moves leases
+ * @param windowMs Length of the window
+ */
+void setRangeMigration(uint32_t minWrites, uint32_t windowMs);
+
+/**
+ * @brief Write a range wherever it is held
+ *
+ * Writes locally when this node holds the range, and otherwise forwards the
+ * write to the holder in MSG_RANGE_WRITE messages.
+ *
+ * @param memoryName Name of the region
+ * @param offset Region offset to write at
+ * @param data Bytes to write
+ * @param size Number of bytes
+ * @return true if the bytes were written or passed on
+ */
+bool writeSharedRange(const char* memoryName, size_t offset, const void* data, size_t size);
+
+/**
+ * @brief Handle a write forwarded by another node
+ *
+ * Applies the write if this node holds the range, holds it if the range is
+ * being handed to this node, and otherwise passes it on to the holder once.
+ *
+ * @param message The MSG_RANGE_WRITE message
+ */
+void receiveRangeWrite(const SyncMessage& message);
+
+/**
+ * @brief Move leases toward the nodes that write them
+ *
+ * Called from the region's sync thread. Takes ranges being handed to this
+ * node, finishes or abandons this node's handoffs, starts a handoff for each
+ * lease a remote node wrote most in the last window, and applies held writes
+ * whose range this node now holds.
+ *
+ * @param memoryName Name of the region
+ * @return Number of handoffs started or completed
+ */
+int balanceRangeLeases(const char* memoryName);
+
+/**
+ * @brief Check a received update against the lease table
+ *
+ * Updates to a range leased to another node, and writes to a lease row by
+ * any node other than the row's own, are refused. Messages that aren't
+ * updates, and updates to regions without a lease table, are admitted. The
+ * data in the parts of a multi-part update is checked when the update is
+ * complete, with rangeLeasesFilterUpdate.
+ *
+ * @param message The received message
+ * @return true if the update may be applied
+ */
+bool rangeLeasesAdmit(const SyncMessage& message);
+
+/**
+ * @brief Check the data in a complete multi-part update against the lease table
+ *
+ * Lease rows the update carries count as already applied, so a node can
+ * take a range and write it in the same update.
+ *
+ * @param chunks The parts of the update, each admitted by rangeLeasesAdmit;
+ *        the parts that may not be applied are removed
+ * @return Number of parts removed
+ */
+size_t rangeLeasesFilterUpdate(std::vector<SyncMessage>& chunks);
+
+/**
+ * @brief Get the live leases of a region
+ *
+ * @param memoryName Name of the region
+ * @param leases Receives the leases, by node
+ * @return true if the region has a lease table
+ */
+bool getRangeLeases(const char* memoryName, std::vector<RangeLease>& leases);
+
+#endif // RANGE_LEASE_H
@@ -0,0 +1,326 @@
+/**
+ * @file record_table.cpp
+ * @brief Implementation of columnar record tables in shared memory
+ *
+ * This file contains the layout, dirty tracking and change collection for
+ * record tables, plus the glue that creates a table in a named shared memory
+ * region and hands the changed cells to the change tracking system.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "record_table.h"
+#include "memory_layout.h"
+#include "shared_memory.h"
+#include "change_tracking.h"
+#include <iostream>
+#include <string.h>
+
+/**
+ * @brief Round a value up to the table alignment
+ */
+static uint64_t alignUp(uint64_t value) {
+    return (value + RECORD_TABLE_ALIGNMENT - 1) & ~static_cast<uint64_t>(RECORD_TABLE_ALIGNMENT - 1);
+}
+
+/**
+ * @brief Size of one column's dirty bitmap in bytes (whole 64-bit words)
+ */
+static uint64_t dirtyBitmapSize(uint64_t capacity) {
+    return ((capacity + 63) / 64) * sizeof(uint64_t);
+}
+
+/**
+ * @brief Region offset of the table header (after the MemoryLayout prefix)
+ */
+static uint64_t tableHeaderOffset() {
+    return alignUp(sizeof(MemoryLayout));
+}
+
+uint32_t columnTypeWidth(ColumnType type, uint32_t bytesWidth) {
+    switch (type) {
+        case COLUMN_INT32:
+        case COLUMN_UINT32:
+        case COLUMN_FLOAT:
+            return 4;
+        case COLUMN_INT64:
+        case COLUMN_UINT64:
+        case COLUMN_DOUBLE:
+            return 8;
+        case COLUMN_BYTES:
+            return bytesWidth;
+    }
+    return 0;
+}
+
+size_t recordTableRegionSize(const RecordColumnSpec* specs, int columnCount, uint64_t capacity) {
+    if (!specs || columnCount <= 0 || columnCount > MAX_RECORD_COLUMNS || capacity == 0) {
+        return 0;
+    }
+
+    uint64_t offset = alignUp(tableHeaderOffset() + sizeof(RecordTableHeader));
+    for (int i = 0; i < columnCount; i++) {
+        uint32_t width = columnTypeWidth(specs[i].type, specs[i].width);
+        if (width == 0) {
+            return 0;
+        }
+        offset = alignUp(offset + width * capacity);
+        offset = alignUp(offset + dirtyBitmapSize(capacity));
+    }
+    return static_cast<size_t>(offset);
+}
+
+RecordTableHeader* createRecordTable(void* region, size_t regionSize,
+                                     const RecordColumnSpec* specs, int columnCount,
+                                     uint64_t capacity) {
+    size_t required = recordTableRegionSize(specs, columnCount, capacity);
+    if (!region || required == 0 || regionSize < required) {
+        std::cerr << "[RECORD TABLE] Region too small for table: need " << required
+                  << " bytes, have " << regionSize << std::endl;
+        return NULL;
+    }
+
+    char* base = static_cast<char*>(region);
+    RecordTableHeader* table = reinterpret_cast<RecordTableHeader*>(base + tableHeaderOffset());
+    memset(table, 0, sizeof(RecordTableHeader));
+
+    table->columnCount = static_cast<uint32_t>(columnCount);
+    table->capacity = capacity;
+    table->recordCount = 0;
+    table->tableOffset = tableHeaderOffset();
+    table->regionSize = regionSize;
+
+    // Columns are laid out one after another, each followed by its dirty bitmap
+    uint64_t offset = alignUp(tableHeaderOffset() + sizeof(RecordTableHeader));
+    for (int i = 0; i < columnCount; i++) {
+        RecordColumn& column = table->columns[i];
+        if (specs[i].name) {
+            strncpy(column.name, specs[i].name, sizeof(column.name) - 1);
+        }
+        column.type = static_cast<uint32_t>(specs[i].type);
+        column.width = columnTypeWidth(specs[i].type, specs[i].width);
+        column.dataOffset = offset;
+        offset = alignUp(offset + column.width * capacity);
+        column.dirtyOffset = offset;
+        offset = alignUp(offset + dirtyBitmapSize(capacity));
+
+        memset(base + column.dirtyOffset, 0, static_cast<size_t>(dirtyBitmapSize(capacity)));
+    }
+
+    // Publish the magic last so a half-initialised table is never opened
+    table->magic = RECORD_TABLE_MAGIC;
+    return table;
+}
+
+RecordTableHeader* openRecordTable(void* region) {
+    if (!region) {
+        return NULL;
+    }
+
+    RecordTableHeader* table = reinterpret_cast<RecordTableHeader*>(
+        static_cast<char*>(region) + tableHeaderOffset());
+    if (table->magic != RECORD_TABLE_MAGIC || table->tableOffset != tableHeaderOffset() ||
+        table->columnCount > MAX_RECORD_COLUMNS) {
+        return NULL;
+    }
+    return table;
+}
+
+int findRecordColumn(const RecordTableHeader* table, const char* name) {
+    for (uint32_t i = 0; i < table->columnCount; i++) {
+        if (strncmp(table->columns[i].name, name, MAX_COLUMN_NAME_LENGTH) == 0) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+size_t recordTableHeaderOffset(const RecordTableHeader* table) {
+    return static_cast<size_t>(table->tableOffset);
+}
+
+/**
+ * @brief Get a column's dirty bitmap
+ *
+ * Writers in other processes mark bits while the sync thread collects them,
+ * so words are only ever set with an atomic or and taken with an atomic exchange.
+ */
+static volatile LONG64* dirtyBitmap(RecordTableHeader* table, int column) {
+    char* base = reinterpret_cast<char*>(table) - table->tableOffset;
+    return reinterpret_cast<volatile LONG64*>(base + table->columns[column].dirtyOffset);
+}
+
+void setRecordCount(RecordTableHeader* table, uint64_t recordCount) {
+    if (recordCount > table->capacity) {
+        recordCount = table->capacity;
+    }
+    if (table->recordCount != recordCount) {
+        table->recordCount = recordCount;
+        table->headerDirty = 1;
+    }
+}
+
+void markRecordCellsDirty(RecordTableHeader* table, int column, uint64_t firstRecord, uint64_t count) {
+    if (column < 0 || static_cast<uint32_t>(column) >= table->columnCount ||
+        firstRecord >= table->capacity) {
+        return;
+    }
+    if (count > table->capacity - firstRecord) {
+        count = table->capacity - firstRecord;
+    }
+
+    volatile LONG64* bits = dirtyBitmap(table, column);
+    uint64_t record = firstRecord;
+    uint64_t end = firstRecord + count;
+
+    while (record < end) {
+        uint64_t word = record / 64;
+        uint64_t bit = record % 64;
+        uint64_t span = 64 - bit;
+        if (span > end - record) {
+            span = end - record;
+        }
+        uint64_t mask = (span == 64) ? ~static_cast<uint64_t>(0)
+                                     : (((static_cast<uint64_t>(1) << span) - 1) << bit);
+        InterlockedOr64(&bits[word], static_cast<LONG64>(mask));
+        record += span;
+    }
+}
+
+void markRecordDirty(RecordTableHeader* table, uint64_t record) {
+    for (uint32_t i = 0; i < table->columnCount; i++) {
+        markRecordCellsDirty(table, static_cast<int>(i), record, 1);
+    }
+}
+
+size_t collectRecordTableChanges(RecordTableHeader* table, std::vector<RecordTableRange>& ranges,
+                                 size_t mergeGapBytes) {
+    size_t added = 0;
+    uint64_t words = (table->capacity + 63) / 64;
+
+    if (table->headerDirty &&
+        InterlockedExchange(reinterpret_cast<volatile LONG*>(&table->headerDirty), 0) != 0) {
+        RecordTableRange range;
+        range.offset = recordTableHeaderOffset(table);
+        range.size = sizeof(RecordTableHeader);
+        range.column = -1;
+        ranges.push_back(range);
+        added++;
+    }
+
+    for (uint32_t c = 0; c < table->columnCount; c++) {
+        const RecordColumn& column = table->columns[c];
+        volatile LONG64* bits = dirtyBitmap(table, static_cast<int>(c));
+        uint64_t gapRecords = column.width ? mergeGapBytes / column.width : 0;
+
+        bool open = false;
+        uint64_t runStart = 0;
+        uint64_t runEnd = 0;    // One past the last dirty record of the open run
+
+        for (uint64_t w = 0; w < words; w++) {
+            if (bits[w] == 0) {
+                continue;
+            }
+            uint64_t word = static_cast<uint64_t>(InterlockedExchange64(&bits[w], 0));
+
+            // Walk the runs of set bits in this word
+            while (word != 0) {
+                uint64_t bit = 0;
+                while (((word >> bit) & 1) == 0) {
+                    bit++;
+                }
+                uint64_t length = 0;
+                while (bit + length < 64 && ((word >> (bit + length)) & 1) != 0) {
+                    length++;
+                }
+                uint64_t first = w * 64 + bit;
+                uint64_t last = first + length;
+
+                if (open && first <= runEnd + gapRecords) {
+                    // Close enough to the previous run to share a range
+                    runEnd = last;
+                } else {
+                    if (open) {
+                        RecordTableRange range;
+                        range.offset = static_cast<size_t>(column.dataOffset + runStart * column.width);
+                        range.size = static_cast<size_t>((runEnd - runStart) * column.width);
+                        range.column = static_cast<int>(c);
+                        ranges.push_back(range);
+                        added++;
+                    }
+                    open = true;
+                    runStart = first;
+                    runEnd = last;
+                }
+
+                if (length == 64) {
+                    word = 0;
+                } else {
+                    word &= ~(((static_cast<uint64_t>(1) << length) - 1) << bit);
+                }
+            }
+        }
+
+        if (open) {
+            RecordTableRange range;
+            range.offset = static_cast<size_t>(column.dataOffset + runStart * column.width);
+            range.size = static_cast<size_t>((runEnd - runStart) * column.width);
+            range.column = static_cast<int>(c);
+            ranges.push_back(range);
+            added++;
+        }
+    }
+
+    return added;
+}
+
+bool initializeRecordTableRegion(const char* memoryName, const RecordColumnSpec* specs,
+                                 int columnCount, uint64_t capacity) {
+    size_t size = recordTableRegionSize(specs, columnCount, capacity);
+    if (size == 0) {
+        std::cerr << "[RECORD TABLE] Invalid table specification for " << memoryName << std::endl;
+        return false;
+    }
+
+    if (!initializeSharedMemory(memoryName, size)) {
+        return false;
+    }
+
+    void* region = getSharedMemory(memoryName);
+    RecordTableHeader* table = createRecordTable(region, size, specs, columnCount, capacity);
+    if (!table) {
+        return false;
+    }
+
+    // Replicate the header so receivers can interpret the columns
+    markRegionChanged(memoryName, recordTableHeaderOffset(table), sizeof(RecordTableHeader));
+    return true;
+}
+
+size_t flushRecordTableChanges(const char* memoryName) {
+    RecordTableHeader* table = openRecordTable(getSharedMemory(memoryName));
+    if (!table) {
+        std::cerr << "[RECORD TABLE] No record table in " << memoryName << std::endl;
+        return 0;
+    }
+
+    std::vector<RecordTableRange> ranges;
+    collectRecordTableChanges(table, ranges, RECORD_TABLE_MERGE_GAP_BYTES);
+    if (ranges.empty()) {
+        return 0;
+    }
+
+    std::vector<MemoryChange> changes;
+    changes.reserve(ranges.size());
+    for (size_t i = 0; i < ranges.size(); i++) {
+        MemoryChange change;
+        change.offset = ranges[i].offset;
+        change.size = ranges[i].size;
+        change.inProgress = false;
+        changes.push_back(change);
+    }
+
+    markRegionsChanged(memoryName, changes);
+    return changes.size();
+}
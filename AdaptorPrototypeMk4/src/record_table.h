@@ -0,0 +1,280 @@
+#ifndef RECORD_TABLE_H
+#define RECORD_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <vector>
+
+/**
+ * @brief Columnar (structure-of-arrays) record tables stored in shared memory
+ *
+ * A record table region starts with the usual MemoryLayout header (so the
+ * version/dirty handling in the sync threads keeps working) followed by a
+ * RecordTableHeader and one contiguous array per column. Each column also has
+ * a dirty bitmap with one bit per record, so a writer can update cells in
+ * place and later replicate only the cells that actually changed.
+ *
+ * All offsets stored in the table are relative to the start of the region,
+ * so the same table can be used from any process and on any replica.
+ */
+
+#define RECORD_TABLE_MAGIC 0x31425452u   // "RTB1"
+#define MAX_RECORD_COLUMNS 32
+#define MAX_COLUMN_NAME_LENGTH 32
+#define RECORD_TABLE_ALIGNMENT 64
+
+// Clean gap (in bytes) bridged when merging dirty runs of the same column
+#define RECORD_TABLE_MERGE_GAP_BYTES 32
+
+/**
+ * @brief Element types supported by record table columns
+ */
+typedef enum {
+    COLUMN_INT32,
+    COLUMN_UINT32,
+    COLUMN_INT64,
+    COLUMN_UINT64,
+    COLUMN_FLOAT,
+    COLUMN_DOUBLE,
+    COLUMN_BYTES     // Fixed-width opaque bytes (width given in the column spec)
+} ColumnType;
+
+/**
+ * @brief Description of a column used when creating a table
+ */
+typedef struct {
+    const char* name;   // Column name (truncated to MAX_COLUMN_NAME_LENGTH - 1)
+    ColumnType type;    // Element type
+    uint32_t width;     // Cell width in bytes (only used for COLUMN_BYTES)
+} RecordColumnSpec;
+
+/**
+ * @brief Column descriptor stored in the shared memory header
+ */
+typedef struct {
+    char name[MAX_COLUMN_NAME_LENGTH];  // Column name
+    uint32_t type;                      // ColumnType of the cells
+    uint32_t width;                     // Cell width in bytes
+    uint64_t dataOffset;                // Region offset of the cell array
+    uint64_t dirtyOffset;               // Region offset of the dirty bitmap (1 bit per record)
+} RecordColumn;
+
+/**
+ * @brief Header of a record table, stored in the region after MemoryLayout
+ */
+typedef struct {
+    uint32_t magic;                          // RECORD_TABLE_MAGIC once initialised
+    uint32_t columnCount;                    // Number of columns in use
+    uint64_t capacity;                       // Number of records the table can hold
+    uint64_t recordCount;                    // Number of records currently in use
+    uint64_t tableOffset;                    // Region offset of this header
+    uint64_t regionSize;                     // Total size of the region in bytes
+    uint32_t headerDirty;                    // Set when header fields need replicating
+    uint32_t reserved;                       // Padding, keeps columns 8-byte aligned
+    RecordColumn columns[MAX_RECORD_COLUMNS];
+} RecordTableHeader;
+
+/**
+ * @brief A changed byte range collected from the dirty bitmaps
+ */
+struct RecordTableRange {
+    size_t offset;      // Region offset of the first changed cell
+    size_t size;        // Size of the range in bytes
+    int column;         // Column the range belongs to
+};
+
+/**
+ * @brief Get the cell width of a column type
+ *
+ * @param type The column type
+ * @param bytesWidth Width to use for COLUMN_BYTES
+ * @return Cell width in bytes
+ */
+uint32_t columnTypeWidth(ColumnType type, uint32_t bytesWidth);
+
+/**
+ * @brief Compute the region size needed for a record table
+ *
+ * The size includes the MemoryLayout header at the start of the region.
+ *
+ * @param specs Column specifications
+ * @param columnCount Number of columns
+ * @param capacity Number of records
+ * @return Region size in bytes, or 0 if the specification is invalid
+ */
+size_t recordTableRegionSize(const RecordColumnSpec* specs, int columnCount, uint64_t capacity);
+
+/**
+ * @brief Lay out a new record table in a region
+ *
+ * Writes the table header, zeroes the dirty bitmaps and leaves the cell
+ * arrays untouched (fresh mappings are already zero).
+ *
+ * @param region Start of the shared memory region
+ * @param regionSize Size of the region in bytes
+ * @param specs Column specifications
+ * @param columnCount Number of columns
+ * @param capacity Number of records
+ * @return Pointer to the table header, or NULL if the region is too small
+ */
+RecordTableHeader* createRecordTable(void* region, size_t regionSize,
+                                     const RecordColumnSpec* specs, int columnCount,
+                                     uint64_t capacity);
+
+/**
+ * @brief Get the record table stored in a region
+ *
+ * @param region Start of the shared memory region
+ * @return Pointer to the table header, or NULL if the region holds no table
+ */
+RecordTableHeader* openRecordTable(void* region);
+
+/**
+ * @brief Find a column by name
+ *
+ * @param table The record table
+ * @param name Column name
+ * @return Column index, or -1 if there is no such column
+ */
+int findRecordColumn(const RecordTableHeader* table, const char* name);
+
+/**
+ * @brief Get the region offset of the table's header fields
+ *
+ * Used when the header itself (e.g. recordCount) has to be replicated.
+ */
+size_t recordTableHeaderOffset(const RecordTableHeader* table);
+
+/**
+ * @brief Set the number of records in use
+ *
+ * The header is replicated with the next collected set of changes.
+ */
+void setRecordCount(RecordTableHeader* table, uint64_t recordCount);
+
+/**
+ * @brief Mark a run of cells in a column as dirty
+ *
+ * @param table The record table
+ * @param column Column index
+ * @param firstRecord First record of the run
+ * @param count Number of records in the run
+ */
+void markRecordCellsDirty(RecordTableHeader* table, int column, uint64_t firstRecord, uint64_t count);
+
+/**
+ * @brief Mark every column of a record as dirty
+ */
+void markRecordDirty(RecordTableHeader* table, uint64_t record);
+
+/**
+ * @brief Collect and clear the dirty cells of a table
+ *
+ * A dirty header is reported first. The remaining ranges are produced column
+ * by column, in record order, so cells of the same column (and therefore the
+ * same type) end up next to each other on the wire.
+ * Dirty runs separated by a gap of at most mergeGapBytes are merged into one
+ * range, which trades a few unchanged bytes for fewer messages.
+ *
+ * @param table The record table
+ * @param ranges Output vector the changed ranges are appended to
+ * @param mergeGapBytes Largest gap of clean cells bridged within a column
+ * @return Number of ranges appended
+ */
+size_t collectRecordTableChanges(RecordTableHeader* table, std::vector<RecordTableRange>& ranges,
+                                 size_t mergeGapBytes);
+
+/**
+ * @brief Create a record table in a new named shared memory region
+ *
+ * Initializes the region with the size needed for the table, lays out the
+ * table and marks the header for replication.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param specs Column specifications
+ * @param columnCount Number of columns
+ * @param capacity Number of records
+ * @return true if the table was created, false otherwise
+ */
+bool initializeRecordTableRegion(const char* memoryName, const RecordColumnSpec* specs,
+                                 int columnCount, uint64_t capacity);
+
+/**
+ * @brief Hand the dirty cells of a table region to the change tracking system
+ *
+ * Collects the changed cells (batched by column) and records them as pending
+ * changes of the region with a single version increment.
+ *
+ * @param memoryName Name of the shared memory region holding the table
+ * @return Number of ranges marked as changed
+ */
+size_t flushRecordTableChanges(const char* memoryName);
+
+/**
+ * @brief Get a pointer to the first cell of a column
+ */
+inline void* recordColumnData(RecordTableHeader* table, int column) {
+    char* base = reinterpret_cast<char*>(table) - table->tableOffset;
+    return base + table->columns[column].dataOffset;
+}
+
+inline const void* recordColumnData(const RecordTableHeader* table, int column) {
+    const char* base = reinterpret_cast<const char*>(table) - table->tableOffset;
+    return base + table->columns[column].dataOffset;
+}
+
+/**
+ * @brief Maps C++ element types to column types for the typed accessors
+ */
+template <typename T> struct ColumnTypeOf;
+template <> struct ColumnTypeOf<int32_t>  { enum { value = COLUMN_INT32 }; };
+template <> struct ColumnTypeOf<uint32_t> { enum { value = COLUMN_UINT32 }; };
+template <> struct ColumnTypeOf<int64_t>  { enum { value = COLUMN_INT64 }; };
+template <> struct ColumnTypeOf<uint64_t> { enum { value = COLUMN_UINT64 }; };
+template <> struct ColumnTypeOf<float>    { enum { value = COLUMN_FLOAT }; };
+template <> struct ColumnTypeOf<double>   { enum { value = COLUMN_DOUBLE }; };
+
+/**
+ * @brief Get a typed pointer to a column's cells
+ *
+ * The column type must match T.
+ */
+template <typename T>
+T* recordColumn(RecordTableHeader* table, int column) {
+    assert(table->columns[column].type == static_cast<uint32_t>(ColumnTypeOf<T>::value));
+    return static_cast<T*>(recordColumnData(table, column));
+}
+
+template <typename T>
+const T* recordColumn(const RecordTableHeader* table, int column) {
+    assert(table->columns[column].type == static_cast<uint32_t>(ColumnTypeOf<T>::value));
+    return static_cast<const T*>(recordColumnData(table, column));
+}
+
+/**
+ * @brief Read a single cell
+ */
+template <typename T>
+T getRecordCell(const RecordTableHeader* table, int column, uint64_t record) {
+    assert(record < table->capacity);
+    return recordColumn<T>(table, column)[record];
+}
+
+/**
+ * @brief Write a single cell and mark it dirty
+ *
+ * Writing the same value again does not mark the cell, so redundant updates
+ * are never replicated.
+ */
+template <typename T>
+void setRecordCell(RecordTableHeader* table, int column, uint64_t record, T value) {
+    assert(record < table->capacity);
+    T* cells = recordColumn<T>(table, column);
+    if (cells[record] != value) {
+        cells[record] = value;
+        markRecordCellsDirty(table, column, record, 1);
+    }
+}
+
+#endif // RECORD_TABLE_H
@@ -0,0 +1,367 @@
+/**
+ * @file region_arena.cpp
+ * @brief Implementation of the offset-addressed arena allocator
+ *
+ * Blocks are carved from the top of the arena the first time a class needs
+ * one and recycled through per-class free lists afterwards. The free list
+ * link lives in the block header, so a free block costs no extra space.
+ * When the top is used up, larger free blocks are halved down to the
+ * requested class, the unused halves going onto the smaller free lists.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "region_arena.h"
+#include "memory_layout.h"
+#include "shared_memory.h"
+#include <iostream>
+#include <string.h>
+
+/// Region offset of the arena in regions created by initializeArenaRegion
+#define ARENA_REGION_OFFSET 64
+
+/// Failed attempts on the arena lock between checks that its owner is still running
+#define ARENA_LOCK_OWNER_CHECK 10000
+
+/**
+ * @brief Take an arena's lock word for this process
+ *
+ * The lock is held for a handful of metadata stores, so waiters spin and
+ * then yield. Every ARENA_LOCK_OWNER_CHECK failed attempts the holder is
+ * checked, and a lock whose process has exited is taken over.
+ */
+static void lockArena(RegionArenaHeader* arena) {
+    LONG self = static_cast<LONG>(GetCurrentProcessId());
+    for (int attempt = 1; ; attempt++) {
+        LONG owner = arena->lock;
+        if (owner == 0) {
+            if (InterlockedCompareExchange(&arena->lock, self, 0) == 0) {
+                return;
+            }
+        } else if (owner != self && attempt % ARENA_LOCK_OWNER_CHECK == 0 &&
+                   !isProcessRunning(static_cast<DWORD>(owner)) &&
+                   InterlockedCompareExchange(&arena->lock, self, owner) == owner) {
+            std::cerr << "[ARENA] Took over the allocator lock of exited process " << owner << std::endl;
+            return;
+        }
+
+        if (attempt > 100) {
+            Sleep(0);
+        } else {
+            YieldProcessor();
+        }
+    }
+}
+
+static void unlockArena(RegionArenaHeader* arena) {
+    InterlockedExchange(&arena->lock, 0);
+}
+
+/**
+ * @brief Get the start of the region that holds an arena
+ */
+static char* arenaRegionBase(const RegionArenaHeader* arena) {
+    return const_cast<char*>(reinterpret_cast<const char*>(arena)) - arena->arenaOffset;
+}
+
+/**
+ * @brief Region offset of the first block (the header rounded up to block alignment)
+ */
+static uint64_t firstBlockOffset(const RegionArenaHeader* arena) {
+    const uint64_t alignment = sizeof(ArenaBlockHeader);
+    return arena->arenaOffset + (sizeof(RegionArenaHeader) + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * @brief Get the size in bytes of a size class (header included)
+ */
+static uint64_t classBlockSize(uint32_t sizeClass) {
+    return static_cast<uint64_t>(ARENA_MIN_BLOCK) << sizeClass;
+}
+
+/**
+ * @brief Get the smallest class whose blocks hold size payload bytes, or -1
+ */
+static int sizeClassFor(size_t size) {
+    uint64_t needed = static_cast<uint64_t>(size) + sizeof(ArenaBlockHeader);
+    for (uint32_t c = 0; c < ARENA_SIZE_CLASSES; c++) {
+        if (classBlockSize(c) >= needed) {
+            return static_cast<int>(c);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Record a changed metadata range
+ */
+static void addChange(std::vector<MemoryChange>* changes, const RegionArenaHeader* arena,
+                      const void* field, size_t size) {
+    if (!changes) {
+        return;
+    }
+    MemoryChange change;
+    change.offset = static_cast<const char*>(field) - arenaRegionBase(arena);
+    change.size = size;
+    change.inProgress = false;
+    changes->push_back(change);
+}
+
+/**
+ * @brief Get the header of a block from its payload offset, or NULL if out of bounds
+ */
+static ArenaBlockHeader* blockHeader(const RegionArenaHeader* arena, ArenaOffset offset) {
+    uint64_t first = firstBlockOffset(arena) + sizeof(ArenaBlockHeader);
+    if (offset < first || offset >= arena->top || (offset % sizeof(ArenaBlockHeader)) != 0) {
+        return NULL;
+    }
+
+    ArenaBlockHeader* header = reinterpret_cast<ArenaBlockHeader*>(
+        arenaRegionBase(arena) + offset - sizeof(ArenaBlockHeader));
+    if (header->sizeClass >= ARENA_SIZE_CLASSES ||
+        offset - sizeof(ArenaBlockHeader) + classBlockSize(header->sizeClass) > arena->top) {
+        return NULL;
+    }
+    return header;
+}
+
+RegionArenaHeader* createRegionArena(void* region, size_t regionSize, size_t arenaOffset, size_t arenaSize) {
+    if (!region || (arenaOffset % sizeof(ArenaBlockHeader)) != 0 || arenaOffset > regionSize ||
+        arenaSize > regionSize - arenaOffset || arenaSize < sizeof(RegionArenaHeader) + ARENA_MIN_BLOCK) {
+        std::cerr << "[ARENA] Arena of " << arenaSize << " bytes at offset " << arenaOffset
+                  << " does not fit a region of " << regionSize << " bytes" << std::endl;
+        return NULL;
+    }
+
+    RegionArenaHeader* arena = reinterpret_cast<RegionArenaHeader*>(static_cast<char*>(region) + arenaOffset);
+    memset(arena, 0, sizeof(RegionArenaHeader));
+    arena->arenaOffset = arenaOffset;
+    arena->arenaEnd = arenaOffset + arenaSize;
+    arena->top = firstBlockOffset(arena);
+
+    // Publish the magic last so a half-initialised arena is never opened
+    arena->magic = REGION_ARENA_MAGIC;
+    return arena;
+}
+
+RegionArenaHeader* openRegionArena(void* region, size_t arenaOffset) {
+    if (!region) {
+        return NULL;
+    }
+
+    RegionArenaHeader* arena = reinterpret_cast<RegionArenaHeader*>(static_cast<char*>(region) + arenaOffset);
+    if (arena->magic != REGION_ARENA_MAGIC || arena->arenaOffset != arenaOffset ||
+        arena->top > arena->arenaEnd) {
+        return NULL;
+    }
+    return arena;
+}
+
+/**
+ * @brief Take a free block of the nearest larger class and halve it down to a class
+ *
+ * Every split leaves the upper half free in the class below, so the block
+ * returned has the requested size and the rest of the larger block stays
+ * available to the smaller classes.
+ *
+ * @return Header of a block of the requested size (not yet tagged), or NULL if none is free
+ */
+static ArenaBlockHeader* splitLargerBlock(RegionArenaHeader* arena, uint32_t sizeClass,
+                                          std::vector<MemoryChange>* changes) {
+    uint32_t larger = sizeClass + 1;
+    while (larger < ARENA_SIZE_CLASSES && arena->freeList[larger] == 0) {
+        larger++;
+    }
+    if (larger >= ARENA_SIZE_CLASSES) {
+        return NULL;
+    }
+
+    ArenaBlockHeader* header = blockHeader(arena, arena->freeList[larger]);
+    if (!header || header->tag != ARENA_BLOCK_FREE) {
+        std::cerr << "[ARENA] Corrupt free list for class " << larger << std::endl;
+        return NULL;
+    }
+    arena->freeList[larger] = header->nextFree;
+    addChange(changes, arena, &arena->freeList[larger], sizeof(uint64_t));
+
+    char* base = arenaRegionBase(arena);
+    while (larger > sizeClass) {
+        larger--;
+        ArenaBlockHeader* half = reinterpret_cast<ArenaBlockHeader*>(
+            reinterpret_cast<char*>(header) + classBlockSize(larger));
+        half->tag = ARENA_BLOCK_FREE;
+        half->sizeClass = larger;
+        half->nextFree = arena->freeList[larger];
+        addChange(changes, arena, half, sizeof(ArenaBlockHeader));
+
+        arena->freeList[larger] = static_cast<uint64_t>(reinterpret_cast<char*>(half + 1) - base);
+        addChange(changes, arena, &arena->freeList[larger], sizeof(uint64_t));
+    }
+    return header;
+}
+
+ArenaOffset arenaAllocate(RegionArenaHeader* arena, size_t size, std::vector<MemoryChange>* changes) {
+    int sizeClass = sizeClassFor(size);
+    if (sizeClass < 0) {
+        return 0;
+    }
+
+    char* base = arenaRegionBase(arena);
+    uint64_t blockSize = classBlockSize(static_cast<uint32_t>(sizeClass));
+    ArenaBlockHeader* header = NULL;
+
+    if (arena->freeList[sizeClass] != 0) {
+        // Reuse the most recently freed block of this class
+        header = blockHeader(arena, arena->freeList[sizeClass]);
+        if (!header || header->tag != ARENA_BLOCK_FREE) {
+            std::cerr << "[ARENA] Corrupt free list for class " << sizeClass << std::endl;
+            return 0;
+        }
+        arena->freeList[sizeClass] = header->nextFree;
+        addChange(changes, arena, &arena->freeList[sizeClass], sizeof(uint64_t));
+    } else if (blockSize <= arena->arenaEnd - arena->top) {
+        // Carve a new block from the top of the arena
+        header = reinterpret_cast<ArenaBlockHeader*>(base + arena->top);
+        arena->top += blockSize;
+        addChange(changes, arena, &arena->top, sizeof(uint64_t));
+    } else {
+        header = splitLargerBlock(arena, static_cast<uint32_t>(sizeClass), changes);
+        if (!header) {
+            return 0;
+        }
+    }
+
+    header->tag = ARENA_BLOCK_USED;
+    header->sizeClass = static_cast<uint32_t>(sizeClass);
+    header->nextFree = 0;
+    addChange(changes, arena, header, sizeof(ArenaBlockHeader));
+
+    arena->bytesInUse += blockSize;
+    arena->blocksInUse[sizeClass]++;
+    addChange(changes, arena, &arena->bytesInUse, sizeof(uint64_t));
+    addChange(changes, arena, &arena->blocksInUse[sizeClass], sizeof(uint64_t));
+
+    return static_cast<ArenaOffset>(reinterpret_cast<char*>(header + 1) - base);
+}
+
+bool arenaFree(RegionArenaHeader* arena, ArenaOffset offset, std::vector<MemoryChange>* changes) {
+    ArenaBlockHeader* header = blockHeader(arena, offset);
+    if (!header || header->tag != ARENA_BLOCK_USED) {
+        std::cerr << "[ARENA] Free of offset " << offset << " which is not an allocated block" << std::endl;
+        return false;
+    }
+
+    uint32_t sizeClass = header->sizeClass;
+    header->tag = ARENA_BLOCK_FREE;
+    header->nextFree = arena->freeList[sizeClass];
+    addChange(changes, arena, header, sizeof(ArenaBlockHeader));
+
+    arena->freeList[sizeClass] = offset;
+    arena->bytesInUse -= classBlockSize(sizeClass);
+    arena->blocksInUse[sizeClass]--;
+    addChange(changes, arena, &arena->freeList[sizeClass], sizeof(uint64_t));
+    addChange(changes, arena, &arena->bytesInUse, sizeof(uint64_t));
+    addChange(changes, arena, &arena->blocksInUse[sizeClass], sizeof(uint64_t));
+    return true;
+}
+
+size_t arenaBlockSize(const RegionArenaHeader* arena, ArenaOffset offset) {
+    ArenaBlockHeader* header = blockHeader(arena, offset);
+    if (!header || header->tag != ARENA_BLOCK_USED) {
+        return 0;
+    }
+    return static_cast<size_t>(classBlockSize(header->sizeClass) - sizeof(ArenaBlockHeader));
+}
+
+void* arenaResolve(const RegionArenaHeader* arena, ArenaOffset offset, size_t size) {
+    size_t capacity = arenaBlockSize(arena, offset);
+    if (capacity == 0 || size > capacity) {
+        return NULL;
+    }
+    return arenaRegionBase(arena) + offset;
+}
+
+bool initializeArenaRegion(const char* memoryName, size_t arenaSize) {
+    size_t size = ARENA_REGION_OFFSET + arenaSize;
+    if (!initializeSharedMemory(memoryName, size)) {
+        return false;
+    }
+
+    RegionArenaHeader* arena = createRegionArena(getSharedMemory(memoryName), size,
+                                                 ARENA_REGION_OFFSET, arenaSize);
+    if (!arena) {
+        return false;
+    }
+
+    // Replicate the header so receivers can resolve offsets
+    markRegionChanged(memoryName, ARENA_REGION_OFFSET, sizeof(RegionArenaHeader));
+    return true;
+}
+
+RegionArenaHeader* getRegionArena(const char* memoryName) {
+    return openRegionArena(getSharedMemory(memoryName), ARENA_REGION_OFFSET);
+}
+
+ArenaOffset regionAllocate(const char* memoryName, size_t size) {
+    RegionArenaHeader* arena = getRegionArena(memoryName);
+    if (!arena) {
+        std::cerr << "[ARENA] No arena in " << memoryName << std::endl;
+        return 0;
+    }
+
+    std::vector<MemoryChange> changes;
+    lockArena(arena);
+    ArenaOffset offset = arenaAllocate(arena, size, &changes);
+    unlockArena(arena);
+
+    if (!changes.empty()) {
+        markRegionsChanged(memoryName, changes);
+    }
+    return offset;
+}
+
+bool regionFree(const char* memoryName, ArenaOffset offset) {
+    RegionArenaHeader* arena = getRegionArena(memoryName);
+    if (!arena) {
+        std::cerr << "[ARENA] No arena in " << memoryName << std::endl;
+        return false;
+    }
+
+    std::vector<MemoryChange> changes;
+    lockArena(arena);
+    bool freed = arenaFree(arena, offset, &changes);
+    unlockArena(arena);
+
+    if (!changes.empty()) {
+        markRegionsChanged(memoryName, changes);
+    }
+    return freed;
+}
+
+ArenaOffset regionStoreBytes(const char* memoryName, const void* data, size_t size) {
+    RegionArenaHeader* arena = getRegionArena(memoryName);
+    if (!arena) {
+        std::cerr << "[ARENA] No arena in " << memoryName << std::endl;
+        return 0;
+    }
+
+    std::vector<MemoryChange> changes;
+    lockArena(arena);
+    ArenaOffset offset = arenaAllocate(arena, size, &changes);
+    if (offset != 0) {
+        memcpy(arenaRegionBase(arena) + offset, data, size);
+
+        MemoryChange change;
+        change.offset = static_cast<size_t>(offset);
+        change.size = size;
+        change.inProgress = false;
+        changes.push_back(change);
+    }
+    unlockArena(arena);
+
+    if (!changes.empty()) {
+        markRegionsChanged(memoryName, changes);
+    }
+    return offset;
+}
@@ -0,0 +1,185 @@
+#ifndef REGION_ARENA_H
+#define REGION_ARENA_H
+
+#include <windows.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "change_tracking.h"
+
+/**
+ * @brief Offset-addressed arena allocator living inside a shared memory region
+ *
+ * The arena hands out blocks for variable-size objects (strings, payloads)
+ * and refers to them by region offset, so a stored "pointer" means the same
+ * thing in every process that maps the region and on every replica.
+ *
+ * Blocks come from power-of-two size classes (32 bytes to 1 MB, including a
+ * 16-byte block header). Freed blocks go onto their class's free list and
+ * are reused for the same class first. Once the arena has no untouched space
+ * left, a class with an empty free list splits a free block of the nearest
+ * larger class into halves. Blocks are never merged or moved, so space that
+ * went to small blocks doesn't come back to larger classes: a workload that
+ * moves from small to large objects can run out of arena while bytes are
+ * still free, and should get an arena of its own per phase.
+ *
+ * All allocator state is in the region. Every allocate/free reports the
+ * metadata bytes it changed as MemoryChange ranges, which the glue functions
+ * hand to markRegionsChanged so replicas see a consistent allocator.
+ *
+ * The glue functions serialise allocator updates from every process that
+ * maps the region with a lock word in the arena header, holding the ID of
+ * the process that took it. A lock left by a process that died is taken
+ * over; the update that process was making may be lost, leaking its block.
+ */
+
+#define REGION_ARENA_MAGIC 0x31414E41u        // "ANA1"
+#define ARENA_BLOCK_USED 0x55534544u          // Block header tag of an allocated block
+#define ARENA_BLOCK_FREE 0x46524545u          // Block header tag of a block on a free list
+#define ARENA_SIZE_CLASSES 16
+#define ARENA_MIN_BLOCK 32                    // Smallest block, including its header
+#define ARENA_MAX_BLOCK (ARENA_MIN_BLOCK << (ARENA_SIZE_CLASSES - 1))
+
+/// Region offset of an arena block's payload; 0 is the null offset
+typedef uint64_t ArenaOffset;
+
+/**
+ * @brief Header placed in front of every block
+ */
+typedef struct {
+    uint32_t tag;           // ARENA_BLOCK_USED or ARENA_BLOCK_FREE
+    uint32_t sizeClass;     // Size class index
+    uint64_t nextFree;      // Payload offset of the next free block of the class (free blocks only)
+} ArenaBlockHeader;
+
+/**
+ * @brief Allocator state, stored in the region at the arena offset
+ */
+typedef struct {
+    uint32_t magic;                                 // REGION_ARENA_MAGIC once initialised
+    volatile LONG lock;                             // ID of the process updating the allocator, 0 if none
+    uint64_t arenaOffset;                           // Region offset of this header
+    uint64_t arenaEnd;                              // Region offset one past the arena
+    uint64_t top;                                   // Region offset of the first never-used byte
+    uint64_t bytesInUse;                            // Sum of the block sizes currently allocated
+    uint64_t freeList[ARENA_SIZE_CLASSES];          // Head of each class's free list (0 = empty)
+    uint64_t blocksInUse[ARENA_SIZE_CLASSES];       // Allocated blocks per class
+} RegionArenaHeader;
+
+/**
+ * @brief Lay out a new arena in part of a region
+ *
+ * @param region Start of the shared memory region
+ * @param regionSize Size of the region in bytes
+ * @param arenaOffset Region offset of the arena (16-byte aligned)
+ * @param arenaSize Size of the arena in bytes, header included
+ * @return Pointer to the arena header, or NULL if it doesn't fit
+ */
+RegionArenaHeader* createRegionArena(void* region, size_t regionSize, size_t arenaOffset, size_t arenaSize);
+
+/**
+ * @brief Find an existing arena in a region
+ *
+ * @param region Start of the shared memory region
+ * @param arenaOffset Region offset the arena was created at
+ * @return Pointer to the arena header, or NULL if there is no valid arena there
+ */
+RegionArenaHeader* openRegionArena(void* region, size_t arenaOffset);
+
+/**
+ * @brief Allocate a block
+ *
+ * @param arena The arena
+ * @param size Number of payload bytes needed
+ * @param changes If not NULL, the metadata ranges written are appended
+ * @return Payload offset of the block, or 0 if the arena is full or size is too large
+ */
+ArenaOffset arenaAllocate(RegionArenaHeader* arena, size_t size, std::vector<MemoryChange>* changes);
+
+/**
+ * @brief Return a block to its class's free list
+ *
+ * @param arena The arena
+ * @param offset Payload offset returned by arenaAllocate
+ * @param changes If not NULL, the metadata ranges written are appended
+ * @return true if the block was freed, false if offset isn't an allocated block
+ */
+bool arenaFree(RegionArenaHeader* arena, ArenaOffset offset, std::vector<MemoryChange>* changes);
+
+/**
+ * @brief Get the usable payload size of an allocated block
+ *
+ * @param arena The arena
+ * @param offset Payload offset of the block
+ * @return Payload capacity in bytes, or 0 if offset isn't an allocated block
+ */
+size_t arenaBlockSize(const RegionArenaHeader* arena, ArenaOffset offset);
+
+/**
+ * @brief Resolve an offset to a pointer, checking it against the arena bounds
+ *
+ * Safe to use on replicas with offsets read from replicated data.
+ *
+ * @param arena The arena
+ * @param offset Payload offset of the block
+ * @param size Number of bytes the caller will access
+ * @return Pointer into the region, or NULL if the range is outside an allocated block
+ */
+void* arenaResolve(const RegionArenaHeader* arena, ArenaOffset offset, size_t size);
+
+/**
+ * @brief Typed wrapper for arenaResolve
+ */
+template <typename T>
+T* arenaPointer(const RegionArenaHeader* arena, ArenaOffset offset) {
+    return static_cast<T*>(arenaResolve(arena, offset, sizeof(T)));
+}
+
+/**
+ * @brief Create a shared memory region holding only an arena
+ *
+ * The arena starts after the MemoryLayout header and its header is replicated.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param arenaSize Size of the arena in bytes
+ * @return true if the region and arena were created, false otherwise
+ */
+bool initializeArenaRegion(const char* memoryName, size_t arenaSize);
+
+/**
+ * @brief Allocate a block in a region's arena and replicate the allocator metadata
+ *
+ * @param memoryName Name of a region created with initializeArenaRegion
+ * @param size Number of payload bytes needed
+ * @return Payload offset of the block, or 0 on failure
+ */
+ArenaOffset regionAllocate(const char* memoryName, size_t size);
+
+/**
+ * @brief Free a block in a region's arena and replicate the allocator metadata
+ *
+ * @param memoryName Name of a region created with initializeArenaRegion
+ * @param offset Payload offset of the block
+ * @return true if the block was freed, false otherwise
+ */
+bool regionFree(const char* memoryName, ArenaOffset offset);
+
+/**
+ * @brief Allocate a block, copy data into it and replicate both
+ *
+ * @param memoryName Name of a region created with initializeArenaRegion
+ * @param data Bytes to store
+ * @param size Number of bytes
+ * @return Payload offset of the block, or 0 on failure
+ */
+ArenaOffset regionStoreBytes(const char* memoryName, const void* data, size_t size);
+
+/**
+ * @brief Get the arena of a region created with initializeArenaRegion
+ *
+ * @param memoryName Name of the shared memory region
+ * @return Pointer to the arena header, or NULL if the region has no arena
+ */
+RegionArenaHeader* getRegionArena(const char* memoryName);
+
+#endif // REGION_ARENA_H
@@ -0,0 +1,335 @@
+/**
+ * @file region_checksum.cpp
+ * @brief Implementation of datagram and region checksums
+ *
+ * A region's block CRCs are kept up to date by an apply observer. An update
+ * inside a block changes the block's CRC by the CRC of the XOR of its old and
+ * new bytes, moved past the rest of the block, so only the updated bytes are
+ * read (crc32cUpdateRange). Updates that touch the header recompute block 0,
+ * since parts of the header are read as zeros. The region checksum is the
+ * block CRCs folded together with crc32cCombine.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "region_checksum.h"
+#include "crc32c.h"
+#include "shared_memory.h"
+#include "memory_layout.h"
+#include "change_tracking.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * @brief Block CRCs kept for one region
+ */
+struct RegionChecksums {
+    size_t regionSize;              // Size of the region the CRCs were computed for
+    std::vector<uint32_t> blocks;   // CRC of each RESYNC_BLOCK_SIZE block
+};
+
+/// Block CRCs by region name
+static std::map<std::string, RegionChecksums> g_regionChecksums;
+
+/// Integrity check counts
+static IntegrityStats g_integrityStats;
+
+/// Mutex protecting g_regionChecksums and g_integrityStats
+static HANDLE g_checksumMutex = NULL;
+
+/// Set by setRegionChecksumsEnabled
+static volatile LONG g_regionChecksumsEnabled = 0;
+
+static void lockChecksumMutex() {
+    if (g_checksumMutex == NULL) {
+        g_checksumMutex = CreateMutex(NULL, FALSE, NULL);
+        if (g_checksumMutex == NULL) {
+            std::cerr << "Failed to create checksum mutex: " << GetLastError() << std::endl;
+        }
+    }
+    if (g_checksumMutex != NULL) {
+        WaitForSingleObject(g_checksumMutex, INFINITE);
+    }
+}
+
+static void unlockChecksumMutex() {
+    if (g_checksumMutex != NULL) {
+        ReleaseMutex(g_checksumMutex);
+    }
+}
+
+void stampSyncMessage(SyncMessage& message) {
+    size_t size = (message.size > MAX_SYNC_DATA_SIZE) ? MAX_SYNC_DATA_SIZE : message.size;
+    uint32_t crc = crc32c(0, &message, offsetof(SyncMessage, checksum));
+    message.checksum = crc32c(crc, message.data, size);
+}
+
+bool verifySyncMessage(const SyncMessage& message, size_t receivedBytes) {
+    bool valid = receivedBytes >= offsetof(SyncMessage, data) && message.size <= MAX_SYNC_DATA_SIZE &&
+                 receivedBytes >= offsetof(SyncMessage, data) + message.size;
+    if (valid) {
+        uint32_t crc = crc32c(0, &message, offsetof(SyncMessage, checksum));
+        valid = crc32c(crc, message.data, message.size) == message.checksum;
+    }
+    if (!valid) {
+        lockChecksumMutex();
+        g_integrityStats.datagramsRejected++;
+        unlockChecksumMutex();
+    }
+    return valid;
+}
+
+/**
+ * @brief The region header with the fields that differ between copies zeroed
+ */
+static void maskedHeader(const char* region, MemoryLayout* header) {
+    const MemoryLayout* layout = reinterpret_cast<const MemoryLayout*>(region);
+    memset(header, 0, sizeof(MemoryLayout));
+    header->data = layout->data;
+    header->last_modified = layout->last_modified;
+}
+
+static size_t blockLength(size_t regionSize, size_t block) {
+    size_t start = block * RESYNC_BLOCK_SIZE;
+    return (regionSize - start > RESYNC_BLOCK_SIZE) ? RESYNC_BLOCK_SIZE : regionSize - start;
+}
+
+static uint32_t blockChecksum(const char* region, size_t regionSize, size_t block) {
+    size_t start = block * RESYNC_BLOCK_SIZE;
+    size_t length = blockLength(regionSize, block);
+    if (block == 0 && regionSize >= sizeof(MemoryLayout)) {
+        MemoryLayout header;
+        maskedHeader(region, &header);
+        uint32_t crc = crc32c(0, &header, sizeof(header));
+        return crc32c(crc, region + sizeof(MemoryLayout), length - sizeof(MemoryLayout));
+    }
+    return crc32c(0, region + start, length);
+}
+
+uint32_t computeRegionChecksum(const char* region, size_t regionSize) {
+    if (regionSize < sizeof(MemoryLayout)) {
+        return crc32c(0, region, regionSize);
+    }
+    MemoryLayout header;
+    maskedHeader(region, &header);
+    uint32_t crc = crc32c(0, &header, sizeof(header));
+    return crc32c(crc, region + sizeof(MemoryLayout), regionSize - sizeof(MemoryLayout));
+}
+
+static void rebuildBlockChecksums(RegionChecksums& checksums, const char* region, size_t regionSize) {
+    size_t blocks = (regionSize + RESYNC_BLOCK_SIZE - 1) / RESYNC_BLOCK_SIZE;
+    checksums.regionSize = regionSize;
+    checksums.blocks.resize(blocks);
+    for (size_t i = 0; i < blocks; i++) {
+        checksums.blocks[i] = blockChecksum(region, regionSize, i);
+    }
+}
+
+/**
+ * @brief Fold the block CRCs into the region checksum
+ */
+static uint32_t foldBlockChecksums(const RegionChecksums& checksums) {
+    if (checksums.blocks.empty()) {
+        return 0;
+    }
+    uint32_t crc = checksums.blocks[0];
+    for (size_t i = 1; i < checksums.blocks.size(); i++) {
+        crc = crc32cCombine(crc, checksums.blocks[i], blockLength(checksums.regionSize, i));
+    }
+    return crc;
+}
+
+/**
+ * @brief Apply observer bringing the CRCs of the updated blocks up to date
+ */
+static void checksumApplyObserver(const char* memoryName, size_t offset, size_t size,
+                                  const void* oldData, const void* newData, void* context) {
+    (void)context;
+    const char* oldBytes = static_cast<const char*>(oldData);
+    const char* newBytes = static_cast<const char*>(newData);
+
+    lockChecksumMutex();
+    std::map<std::string, RegionChecksums>::iterator it = g_regionChecksums.find(memoryName);
+    if (it == g_regionChecksums.end()) {
+        unlockChecksumMutex();
+        return;
+    }
+    RegionChecksums& checksums = it->second;
+
+    if (offset + size > checksums.regionSize) {
+        // The region grew since the CRCs were computed
+        size_t regionSize = 0;
+        const char* region = static_cast<const char*>(getSharedMemoryMapping(memoryName, &regionSize));
+        if (region) {
+            rebuildBlockChecksums(checksums, region, regionSize);
+        }
+        unlockChecksumMutex();
+        return;
+    }
+
+    // The region starts offset bytes before the new data
+    const char* region = newBytes - offset;
+    size_t end = offset + size;
+    for (size_t block = offset / RESYNC_BLOCK_SIZE; block * RESYNC_BLOCK_SIZE < end; block++) {
+        size_t start = block * RESYNC_BLOCK_SIZE;
+        if (block == 0 && offset < sizeof(MemoryLayout) && checksums.regionSize >= sizeof(MemoryLayout)) {
+            checksums.blocks[0] = blockChecksum(region, checksums.regionSize, 0);
+            continue;
+        }
+        size_t first = (offset > start) ? offset : start;
+        size_t last = (end < start + RESYNC_BLOCK_SIZE) ? end : start + RESYNC_BLOCK_SIZE;
+        checksums.blocks[block] = crc32cUpdateRange(checksums.blocks[block],
+                                                    blockLength(checksums.regionSize, block), first - start,
+                                                    oldBytes + (first - offset), newBytes + (first - offset),
+                                                    last - first);
+    }
+    unlockChecksumMutex();
+}
+
+void setRegionChecksumsEnabled(bool enabled) {
+    InterlockedExchange(&g_regionChecksumsEnabled, enabled ? 1 : 0);
+}
+
+bool regionChecksumsEnabled() {
+    return g_regionChecksumsEnabled != 0;
+}
+
+bool startRegionChecksums(const char* memoryName) {
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(memoryName, &regionSize));
+    if (!region) {
+        std::cerr << "[INTEGRITY] Region " << memoryName << " does not exist" << std::endl;
+        return false;
+    }
+
+    lockChecksumMutex();
+    bool started = g_regionChecksums.find(memoryName) == g_regionChecksums.end();
+    if (started) {
+        rebuildBlockChecksums(g_regionChecksums[memoryName], region, regionSize);
+    }
+    unlockChecksumMutex();
+
+    if (started) {
+        registerApplyObserver(memoryName, checksumApplyObserver, NULL);
+        std::cout << "[INTEGRITY] Keeping block checksums of " << memoryName << std::endl;
+    }
+    return true;
+}
+
+bool stopRegionChecksums(const char* memoryName) {
+    lockChecksumMutex();
+    bool found = g_regionChecksums.erase(memoryName) > 0;
+    unlockChecksumMutex();
+
+    if (found) {
+        unregisterApplyObserver(memoryName, checksumApplyObserver, NULL);
+    }
+    return found;
+}
+
+bool getRegionBlockChecksums(const char* memoryName, std::vector<uint32_t>& blocks) {
+    lockChecksumMutex();
+    std::map<std::string, RegionChecksums>::iterator it = g_regionChecksums.find(memoryName);
+    bool found = it != g_regionChecksums.end();
+    if (found) {
+        blocks = it->second.blocks;
+    }
+    unlockChecksumMutex();
+    return found;
+}
+
+bool buildRegionChecksumMessage(const char* memoryName, SyncMessage& message) {
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(memoryName, &regionSize));
+    if (!region || regionSize < sizeof(MemoryLayout)) {
+        return false;
+    }
+
+    RegionChecksumInfo info;
+    memset(&info, 0, sizeof(info));
+    info.regionSize = regionSize;
+    uint64_t version;
+    for (;;) {
+        uint32_t sequence = beginRegionRead(region);
+        version = reinterpret_cast<const MemoryLayout*>(region)->version;
+        info.crc = computeRegionChecksum(region, regionSize);
+        if (endRegionRead(region, sequence)) {
+            break;
+        }
+    }
+
+    memset(&message, 0, sizeof(message));
+    message.msgType = MSG_REGION_CHECKSUM;
+    strncpy(message.memoryName, memoryName, sizeof(message.memoryName) - 1);
+    message.updateId = generateUniqueId();
+    message.version = version;
+    message.timestamp = GetTickCount();
+    memcpy(message.data, &info, sizeof(info));
+    message.size = sizeof(info);
+    return true;
+}
+
+bool checkRegionChecksum(const SyncMessage& message) {
+    RegionChecksumInfo info;
+    if (message.size < sizeof(info)) {
+        return true;
+    }
+    memcpy(&info, message.data, sizeof(info));
+
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(message.memoryName, &regionSize));
+    if (!region || regionSize < sizeof(MemoryLayout) || regionSize != info.regionSize) {
+        return true;
+    }
+
+    uint64_t version;
+    uint32_t crc;
+    for (;;) {
+        uint32_t sequence = beginRegionRead(region);
+        version = reinterpret_cast<const MemoryLayout*>(region)->version;
+
+        // Taken inside the read, never while waiting for a writer, so the observer can't deadlock with us
+        lockChecksumMutex();
+        std::map<std::string, RegionChecksums>::iterator it = g_regionChecksums.find(message.memoryName);
+        if (it != g_regionChecksums.end()) {
+            if (it->second.regionSize != regionSize) {
+                rebuildBlockChecksums(it->second, region, regionSize);
+            }
+            crc = foldBlockChecksums(it->second);
+        } else {
+            crc = computeRegionChecksum(region, regionSize);
+        }
+        unlockChecksumMutex();
+
+        if (endRegionRead(region, sequence)) {
+            break;
+        }
+    }
+    if (version != message.version) {
+        return true;
+    }
+
+    lockChecksumMutex();
+    g_integrityStats.regionsChecked++;
+    if (crc != info.crc) {
+        g_integrityStats.regionMismatches++;
+    }
+    unlockChecksumMutex();
+
+    if (crc != info.crc) {
+        std::cerr << "[INTEGRITY] " << message.memoryName << " differs from its owner at version "
+                  << version << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void getIntegrityStats(IntegrityStats* stats) {
+    lockChecksumMutex();
+    *stats = g_integrityStats;
+    unlockChecksumMutex();
+}
@@ -0,0 +1,140 @@
+#ifndef REGION_CHECKSUM_H
+#define REGION_CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "sync_message.h"
+
+/**
+ * @brief CRC-32C integrity checks for datagrams and replicated regions
+ *
+ * Every SyncMessage carries a CRC-32C of its header fields and data. The
+ * sender stamps it and the receiver drops datagrams whose CRC doesn't match
+ * before anything is applied.
+ *
+ * A region's checksum is the CRC-32C of its contents with the header fields
+ * that differ between copies (version, write sequence, dirty flag and the
+ * segment fields) read as zeros, so the owner's region and an up-to-date copy
+ * have the same checksum. With region checksums enabled, the owner sends the
+ * checksum of its region about once a second while it changes
+ * (MSG_REGION_CHECKSUM). A copy at the same version that doesn't match asks
+ * the owner for the blocks that differ.
+ *
+ * startRegionChecksums keeps a CRC per RESYNC_BLOCK_SIZE block of a copy,
+ * updated from the old and new bytes of each applied update, so checking a
+ * copy costs a combine per block rather than a pass over the region. The
+ * block CRCs are kept in process memory next to the other derived state;
+ * the region header has a fixed layout that is hashed into layoutHash.
+ */
+
+#define REGION_CHECKSUM_INTERVAL_MS 1000
+
+/**
+ * @brief Counts of integrity checks since startup
+ */
+struct IntegrityStats {
+    uint64_t datagramsRejected;     // Datagrams dropped for a short length or a CRC mismatch
+    uint64_t regionsChecked;        // Region checksums compared at the same version
+    uint64_t regionMismatches;      // Comparisons that found a differing copy
+};
+
+/**
+ * @brief Stamp a message with the CRC of its header fields and data
+ *
+ * @param message The message, complete apart from its checksum
+ */
+void stampSyncMessage(SyncMessage& message);
+
+/**
+ * @brief Check a received datagram before it is used
+ *
+ * Counts the datagram in IntegrityStats::datagramsRejected if it fails.
+ *
+ * @param message The received message
+ * @param receivedBytes Number of bytes received
+ * @return true if the datagram is complete and its CRC matches
+ */
+bool verifySyncMessage(const SyncMessage& message, size_t receivedBytes);
+
+/**
+ * @brief Compute the checksum of a region's contents
+ *
+ * @param region Pointer to the start of the region
+ * @param regionSize Size of the region in bytes
+ * @return The region checksum
+ */
+uint32_t computeRegionChecksum(const char* region, size_t regionSize);
+
+/**
+ * @brief Turn the sending and checking of region checksums on or off
+ *
+ * @param enabled true to send MSG_REGION_CHECKSUM for owned regions and check them for copies
+ */
+void setRegionChecksumsEnabled(bool enabled);
+
+/**
+ * @brief Check whether region checksums are sent and checked
+ *
+ * @return true if enabled with setRegionChecksumsEnabled
+ */
+bool regionChecksumsEnabled();
+
+/**
+ * @brief Start keeping per-block CRCs of a replicated region
+ *
+ * @param memoryName Name of the shared memory region (already initialized)
+ * @return true if the CRCs are kept, false if the region doesn't exist
+ */
+bool startRegionChecksums(const char* memoryName);
+
+/**
+ * @brief Stop keeping the per-block CRCs of a region
+ *
+ * @param memoryName Name of the shared memory region
+ * @return true if CRCs were kept for the region, false otherwise
+ */
+bool stopRegionChecksums(const char* memoryName);
+
+/**
+ * @brief Get the per-block CRCs kept for a region
+ *
+ * Block 0 covers the header as computeRegionChecksum sees it.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param blocks Receives one CRC per block
+ * @return true if CRCs are kept for the region, false otherwise
+ */
+bool getRegionBlockChecksums(const char* memoryName, std::vector<uint32_t>& blocks);
+
+/**
+ * @brief Build the MSG_REGION_CHECKSUM message for a region
+ *
+ * The checksum is taken in a consistent read, together with the version it
+ * belongs to.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param message Receives the message
+ * @return true if the message was built, false if the region has no versioned header
+ */
+bool buildRegionChecksumMessage(const char* memoryName, SyncMessage& message);
+
+/**
+ * @brief Compare a copy of a region with the checksum its owner sent
+ *
+ * Copies at another version or size are not compared. Uses the per-block
+ * CRCs if they are kept for the region, otherwise reads the whole copy.
+ *
+ * @param message The MSG_REGION_CHECKSUM message
+ * @return false if the copy is at the same version and size and differs, true otherwise
+ */
+bool checkRegionChecksum(const SyncMessage& message);
+
+/**
+ * @brief Get the integrity check counts
+ *
+ * @param stats Receives the counts
+ */
+void getIntegrityStats(IntegrityStats* stats);
+
+#endif // REGION_CHECKSUM_H
@@ -0,0 +1,170 @@
+/**
+ * @file region_snapshot.cpp
+ * @brief Implementation of consistent snapshot cuts
+ *
+ * A cut is a double collect over the regions' write sequences. Region
+ * versions only move inside a write bracket, so if no sequence moved between
+ * the two collects, each region held its collected version the whole time
+ * and the versions form a consistent cut.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "region_snapshot.h"
+#include "version_history.h"
+#include "shared_memory.h"
+#include "memory_layout.h"
+#include "change_tracking.h"
+#include <iostream>
+#include <string.h>
+
+/**
+ * @brief Map a region for a cut, or return NULL if it has no MemoryLayout header
+ */
+static const char* snapshotRegion(const std::string& memoryName, size_t* size) {
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(memoryName.c_str(), size));
+    if (!region || *size < sizeof(MemoryLayout)) {
+        std::cerr << "[SNAPSHOT] Region " << memoryName << " is not available" << std::endl;
+        return NULL;
+    }
+    return region;
+}
+
+bool captureSnapshotCut(const std::vector<std::string>& memoryNames, SnapshotCut& cut) {
+    std::vector<const char*> regions(memoryNames.size());
+    std::vector<uint32_t> sequences(memoryNames.size());
+
+    for (int attempt = 0; attempt < SNAPSHOT_CUT_ATTEMPTS; attempt++) {
+        cut.regions.clear();
+        cut.regions.resize(memoryNames.size());
+
+        // First collect: versions, and copies of the regions nothing can roll back
+        for (size_t i = 0; i < memoryNames.size(); i++) {
+            SnapshotRegion& entry = cut.regions[i];
+            entry.memoryName = memoryNames[i];
+            regions[i] = snapshotRegion(memoryNames[i], &entry.size);
+            if (!regions[i]) {
+                return false;
+            }
+            entry.history = findVersionHistory(memoryNames[i].c_str());
+
+            sequences[i] = beginRegionRead(regions[i]);
+            entry.version = reinterpret_cast<const MemoryLayout*>(regions[i])->version;
+            if (entry.history < 0) {
+                entry.copy.assign(regions[i], regions[i] + entry.size);
+            }
+        }
+
+        // Second collect: nothing may have been written or switched meanwhile
+        bool consistent = true;
+        for (size_t i = 0; i < memoryNames.size() && consistent; i++) {
+            size_t size = 0;
+            consistent = endRegionRead(regions[i], sequences[i]) &&
+                         getSharedMemoryMapping(memoryNames[i].c_str(), &size) == regions[i];
+        }
+        if (consistent) {
+            std::cout << "[SNAPSHOT] Captured a cut of " << memoryNames.size() << " regions after "
+                      << (attempt + 1) << " collects" << std::endl;
+            return true;
+        }
+        Sleep(0);
+    }
+
+    std::cerr << "[SNAPSHOT] Regions kept changing; no consistent cut after "
+              << SNAPSHOT_CUT_ATTEMPTS << " collects" << std::endl;
+    cut.regions.clear();
+    return false;
+}
+
+bool captureSnapshotAt(const SnapshotVersionVector& versions, uint32_t timeoutMs, SnapshotCut& cut) {
+    cut.regions.clear();
+    ULONGLONG deadline = GetTickCount64() + timeoutMs;
+
+    SnapshotVersionVector::const_iterator it;
+    for (it = versions.begin(); it != versions.end(); ++it) {
+        SnapshotRegion entry;
+        entry.memoryName = it->first;
+        entry.version = it->second;
+        entry.history = findVersionHistory(it->first.c_str());
+
+        // Wait for the local copy to catch up with the cut
+        const char* region = NULL;
+        for (;;) {
+            region = snapshotRegion(it->first, &entry.size);
+            if (!region) {
+                return false;
+            }
+            if (reinterpret_cast<const MemoryLayout*>(region)->version >= entry.version) {
+                break;
+            }
+            if (GetTickCount64() >= deadline) {
+                std::cerr << "[SNAPSHOT] " << it->first << " did not reach version " << entry.version << std::endl;
+                return false;
+            }
+            Sleep(1);
+        }
+
+        if (entry.history >= 0) {
+            if (oldestReadableVersion(entry.history) > entry.version) {
+                std::cerr << "[SNAPSHOT] History of " << it->first << " no longer reaches version "
+                          << entry.version << std::endl;
+                return false;
+            }
+        } else {
+            // Without a history only the exact version can be copied
+            bool copied = false;
+            while (!copied) {
+                uint32_t sequence = beginRegionRead(region);
+                if (reinterpret_cast<const MemoryLayout*>(region)->version != entry.version) {
+                    std::cerr << "[SNAPSHOT] " << it->first << " moved past version " << entry.version
+                              << " and has no history" << std::endl;
+                    return false;
+                }
+                entry.copy.assign(region, region + entry.size);
+                copied = endRegionRead(region, sequence);
+            }
+        }
+        cut.regions.push_back(entry);
+    }
+    return true;
+}
+
+void getSnapshotVersions(const SnapshotCut& cut, SnapshotVersionVector& versions) {
+    versions.clear();
+    for (size_t i = 0; i < cut.regions.size(); i++) {
+        versions[cut.regions[i].memoryName] = cut.regions[i].version;
+    }
+}
+
+bool streamSnapshot(const SnapshotCut& cut, SnapshotSink sink, void* context) {
+    std::vector<char> chunk(SNAPSHOT_CHUNK_SIZE);
+
+    for (size_t i = 0; i < cut.regions.size(); i++) {
+        const SnapshotRegion& entry = cut.regions[i];
+        for (size_t offset = 0; offset < entry.size; offset += SNAPSHOT_CHUNK_SIZE) {
+            size_t size = (entry.size - offset > SNAPSHOT_CHUNK_SIZE) ? SNAPSHOT_CHUNK_SIZE : entry.size - offset;
+            if (entry.history >= 0) {
+                if (!readAtVersion(entry.history, entry.version, offset, size, &chunk[0])) {
+                    std::cerr << "[SNAPSHOT] History of " << entry.memoryName << " no longer reaches version "
+                              << entry.version << std::endl;
+                    return false;
+                }
+            } else {
+                memcpy(&chunk[0], &entry.copy[offset], size);
+            }
+
+            // The header's version isn't in the history, and the write sequence is local
+            if (offset == 0) {
+                MemoryLayout* layout = reinterpret_cast<MemoryLayout*>(&chunk[0]);
+                layout->version = entry.version;
+                layout->sequence = 0;
+            }
+
+            if (!sink(entry.memoryName.c_str(), entry.version, entry.size, offset, &chunk[0], size, context)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
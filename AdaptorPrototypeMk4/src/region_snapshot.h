@@ -0,0 +1,117 @@
+#ifndef REGION_SNAPSHOT_H
+#define REGION_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Consistent snapshots across several regions
+ *
+ * Reading regions one after another can mix states from different times. A
+ * snapshot cut fixes one version per region, and those versions all held at
+ * the same instant. The cut is found without blocking writers. Each region's
+ * write sequence and version are collected twice. If no sequence moved in
+ * between, every region held its collected version at once; otherwise the
+ * collect is retried.
+ *
+ * The contents are then read at those versions while writers carry on:
+ *  - A region with a version history (see version_history.h) is pinned by
+ *    version only. It is streamed later and read back at the cut version.
+ *  - A region without one is copied into the cut during the collect, so the
+ *    copy is validated by the same sequence check.
+ *
+ * A cut's version vector can be passed to captureSnapshotAt on another node.
+ * That node then reads its copies of the same regions at the same versions,
+ * so both nodes see the same cut.
+ *
+ * writeSnapshotFile (snapshot_file.h) stores a cut in the export format.
+ */
+
+#define SNAPSHOT_CUT_ATTEMPTS 100          // Collects tried before a cut gives up
+#define SNAPSHOT_CHUNK_SIZE (64 * 1024)   // Bytes handed to a sink per call
+
+/**
+ * @brief One region of a snapshot cut
+ */
+struct SnapshotRegion {
+    std::string memoryName;     // Name of the region
+    uint64_t version;           // Version of the region in the cut
+    size_t size;                // Size of the region at the cut
+    int history;                // Version history the contents are read from, or -1
+    std::vector<char> copy;     // Contents at the cut when there is no history
+};
+
+/**
+ * @brief A consistent cut across a set of regions
+ */
+struct SnapshotCut {
+    std::vector<SnapshotRegion> regions;
+};
+
+/// Version of each region in a cut, by region name
+typedef std::map<std::string, uint64_t> SnapshotVersionVector;
+
+/**
+ * @brief Receives the contents of a cut, in region order and offset order
+ *
+ * @param memoryName Name of the region
+ * @param version Version of the region in the cut
+ * @param regionSize Size of the region in the cut
+ * @param offset Region offset of the data
+ * @param data The region's contents at the cut version
+ * @param size Size of the data (at most SNAPSHOT_CHUNK_SIZE)
+ * @param context Context pointer given to streamSnapshot
+ * @return true to continue, false to stop streaming
+ */
+typedef bool (*SnapshotSink)(const char* memoryName, uint64_t version, size_t regionSize,
+                             size_t offset, const void* data, size_t size, void* context);
+
+/**
+ * @brief Capture a consistent cut across regions
+ *
+ * @param memoryNames Regions to include (each must have a MemoryLayout header)
+ * @param cut Receives the cut
+ * @return true if a cut was captured, false if a region is missing or
+ *         writers kept moving for SNAPSHOT_CUT_ATTEMPTS collects
+ */
+bool captureSnapshotCut(const std::vector<std::string>& memoryNames, SnapshotCut& cut);
+
+/**
+ * @brief Capture the cut described by a version vector from another node
+ *
+ * Waits for each local copy to reach its version. A region with a version
+ * history is then pinned at that version. A region without one must be at
+ * exactly that version, and is copied.
+ *
+ * @param versions Version of each region in the cut
+ * @param timeoutMs How long to wait for the copies to catch up
+ * @param cut Receives the cut
+ * @return true if the cut was captured, false otherwise
+ */
+bool captureSnapshotAt(const SnapshotVersionVector& versions, uint32_t timeoutMs, SnapshotCut& cut);
+
+/**
+ * @brief Get the version vector of a cut
+ *
+ * @param cut The cut
+ * @param versions Receives the version of each region in the cut
+ */
+void getSnapshotVersions(const SnapshotCut& cut, SnapshotVersionVector& versions);
+
+/**
+ * @brief Stream the contents of a cut to a sink
+ *
+ * Fails if a history no longer reaches back to its region's cut version;
+ * the ring should be sized for the changes expected while streaming.
+ *
+ * @param cut The cut
+ * @param sink Function receiving the contents
+ * @param context Context pointer passed to the sink
+ * @return true if every region was streamed, false otherwise
+ */
+bool streamSnapshot(const SnapshotCut& cut, SnapshotSink sink, void* context);
+
+#endif // REGION_SNAPSHOT_H
@@ -0,0 +1,533 @@
+/**
+ * @file remote_fetch.cpp
+ * @brief Implementation of one-off reads of remote regions
+ *
+ * The requester keeps a PendingFetch for each call of fetchRemote, keyed by
+ * the fetch ID that its requests and the replies carry. The receive thread
+ * copies each part straight into the caller's buffer and signals the
+ * caller, which sends the next windows and the retries. The PendingFetch is
+ * removed before fetchRemote returns, so nothing is written to the buffer
+ * afterwards.
+ *
+ * The source keeps a FetchSession per requester and fetch ID holding the
+ * range as read at one version. Requests are sent outside g_fetchMutex, as
+ * the sender takes the remote nodes mutex.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "remote_fetch.h"
+#include "shared_memory.h"
+#include "change_tracking.h"
+#include "memory_layout.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief A fetch made by this node that is waiting for its range
+ */
+struct PendingFetch {
+    std::string name;
+    size_t offset;
+    size_t size;
+    char* destination;
+    uint64_t knownVersion;              // Version of the cached copy; 0 if none
+    uint64_t version;                   // Version of the parts received
+    bool started;                       // A part has been received
+    std::vector<ULONGLONG> windowSent;  // When each window was last requested or had a part arrive; 0 if not yet
+    std::vector<size_t> windowParts;    // Parts received of each window
+    std::vector<bool> partReceived;
+    size_t windowsDone;
+    bool unchanged;
+    bool failed;
+    HANDLE event;
+};
+
+/**
+ * @brief A result kept by the requester
+ */
+struct CachedRange {
+    std::string name;
+    size_t offset;
+    std::vector<char> data;
+    uint64_t version;
+    ULONGLONG lastUsed;
+};
+
+/**
+ * @brief A range a source read for another node's fetch
+ */
+struct FetchSession {
+    std::vector<char> data;
+    uint64_t version;
+    ULONGLONG lastUsed;
+};
+
+/// Fetches in progress by fetch ID
+static std::map<uint64_t, PendingFetch*> g_pendingFetches;
+
+/// Recent results, oldest use first when evicting
+static std::vector<CachedRange> g_fetchCache;
+
+/// Ranges read for other nodes, by "peer/fetch ID"
+static std::map<std::string, FetchSession> g_fetchSessions;
+
+/// Bytes held by g_fetchSessions
+static size_t g_fetchSessionBytes = 0;
+
+static RemoteFetchStats g_fetchStats;
+
+/// Mutex protecting the state above
+static HANDLE g_fetchMutex = NULL;
+
+/// Function used to send fetch requests
+static FetchRequestSender g_fetchRequestSender = NULL;
+
+static void lockFetchMutex() {
+    if (g_fetchMutex == NULL) {
+        g_fetchMutex = CreateMutex(NULL, FALSE, NULL);
+        if (g_fetchMutex == NULL) {
+            std::cerr << "Failed to create remote fetch mutex: " << GetLastError() << std::endl;
+        }
+    }
+    if (g_fetchMutex != NULL) {
+        WaitForSingleObject(g_fetchMutex, INFINITE);
+    }
+}
+
+static void unlockFetchMutex() {
+    if (g_fetchMutex != NULL) {
+        ReleaseMutex(g_fetchMutex);
+    }
+}
+
+static size_t windowCount(size_t size) {
+    return (size + FETCH_WINDOW_SIZE - 1) / FETCH_WINDOW_SIZE;
+}
+
+/**
+ * @brief Number of MAX_SYNC_DATA_SIZE parts in a window of a range
+ */
+static size_t windowPartCount(size_t size, size_t window) {
+    size_t start = window * FETCH_WINDOW_SIZE;
+    size_t length = (size - start < FETCH_WINDOW_SIZE) ? size - start : FETCH_WINDOW_SIZE;
+    return (length + MAX_SYNC_DATA_SIZE - 1) / MAX_SYNC_DATA_SIZE;
+}
+
+/**
+ * @brief Look up a cached result; call with g_fetchMutex held
+ */
+static CachedRange* findCachedRange(const char* memoryName, size_t offset, size_t size) {
+    for (size_t i = 0; i < g_fetchCache.size(); i++) {
+        if (g_fetchCache[i].name == memoryName && g_fetchCache[i].offset == offset &&
+            g_fetchCache[i].data.size() == size) {
+            return &g_fetchCache[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Keep a result, evicting the least recently used one if the cache is full; call with g_fetchMutex held
+ */
+static void cacheRange(const PendingFetch& fetch) {
+    if (fetch.size > FETCH_CACHE_MAX_SIZE) {
+        return;
+    }
+    CachedRange* cached = findCachedRange(fetch.name.c_str(), fetch.offset, fetch.size);
+    if (!cached) {
+        if (g_fetchCache.size() >= FETCH_CACHE_ENTRIES) {
+            size_t oldest = 0;
+            for (size_t i = 1; i < g_fetchCache.size(); i++) {
+                if (g_fetchCache[i].lastUsed < g_fetchCache[oldest].lastUsed) {
+                    oldest = i;
+                }
+            }
+            g_fetchCache.erase(g_fetchCache.begin() + oldest);
+        }
+        g_fetchCache.push_back(CachedRange());
+        cached = &g_fetchCache.back();
+        cached->name = fetch.name;
+        cached->offset = fetch.offset;
+    }
+    cached->data.assign(fetch.destination, fetch.destination + fetch.size);
+    cached->version = fetch.version;
+    cached->lastUsed = GetTickCount64();
+}
+
+/**
+ * @brief Start receiving a fetch from scratch; call with g_fetchMutex held
+ */
+static void resetPendingFetch(PendingFetch* fetch) {
+    size_t windows = windowCount(fetch->size);
+    fetch->version = 0;
+    fetch->started = false;
+    fetch->windowSent.assign(windows, 0);
+    fetch->windowParts.assign(windows, 0);
+    fetch->partReceived.assign((fetch->size + MAX_SYNC_DATA_SIZE - 1) / MAX_SYNC_DATA_SIZE, false);
+    fetch->windowsDone = 0;
+}
+
+/**
+ * @brief Bits of the parts of a window that have been received; call with g_fetchMutex held
+ */
+static uint64_t windowPartsReceived(const PendingFetch* fetch, size_t window) {
+    size_t first = window * (FETCH_WINDOW_SIZE / MAX_SYNC_DATA_SIZE);
+    uint64_t received = 0;
+    for (size_t part = 0; part < windowPartCount(fetch->size, window); part++) {
+        if (fetch->partReceived[first + part]) {
+            received |= 1ull << part;
+        }
+    }
+    return received;
+}
+
+/**
+ * @brief Build the requests for the windows to send now; call with g_fetchMutex held
+ *
+ * While a cached copy is being checked, only the first window is requested,
+ * as the source may answer that the copy is still current.
+ */
+static void collectFetchRequests(uint64_t fetchId, PendingFetch* fetch, std::vector<SyncMessage>& requests) {
+    ULONGLONG now = GetTickCount64();
+    size_t windows = fetch->windowSent.size();
+    bool checking = fetch->knownVersion != 0 && !fetch->started;
+    size_t inFlight = 0;
+    for (size_t window = 0; window < windows; window++) {
+        if (fetch->windowSent[window] != 0 && fetch->windowParts[window] < windowPartCount(fetch->size, window)) {
+            inFlight++;
+        }
+    }
+
+    for (size_t window = 0; window < windows; window++) {
+        if (fetch->windowParts[window] == windowPartCount(fetch->size, window)) {
+            continue;
+        }
+        if (fetch->windowSent[window] == 0) {
+            if (inFlight >= FETCH_WINDOWS_IN_FLIGHT || (checking && window > 0)) {
+                continue;
+            }
+            inFlight++;
+        } else if (now - fetch->windowSent[window] < FETCH_RETRY_MS) {
+            continue;
+        } else {
+            g_fetchStats.windowRetries++;
+        }
+
+        SyncMessage request;
+        memset(&request, 0, sizeof(request));
+        request.msgType = MSG_FETCH_REQUEST;
+        snprintf(request.memoryName, sizeof(request.memoryName), "%s", fetch->name.c_str());
+        request.updateId = fetchId;
+        request.offset = fetch->offset + window * FETCH_WINDOW_SIZE;
+        FetchRequestInfo info;
+        info.offset = fetch->offset;
+        info.size = fetch->size;
+        info.knownVersion = checking ? fetch->knownVersion : 0;
+        info.version = fetch->started ? fetch->version : 0;
+        info.partsReceived = fetch->started ? windowPartsReceived(fetch, window) : 0;
+        memcpy(request.data, &info, sizeof(info));
+        request.size = sizeof(info);
+        request.timestamp = GetTickCount();
+        requests.push_back(request);
+        fetch->windowSent[window] = now;
+    }
+}
+
+void setFetchRequestSender(FetchRequestSender sender) {
+    lockFetchMutex();
+    g_fetchRequestSender = sender;
+    unlockFetchMutex();
+}
+
+bool fetchRemote(const char* memoryName, size_t offset, size_t size, void* destination, DWORD timeoutMs,
+                 uint64_t* version) {
+    if (!memoryName || strlen(memoryName) >= MAX_MEMORY_NAME_LENGTH || !destination || size == 0 ||
+        size > FETCH_MAX_SIZE) {
+        return false;
+    }
+    HANDLE event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (event == NULL) {
+        return false;
+    }
+
+    PendingFetch fetch;
+    fetch.name = memoryName;
+    fetch.offset = offset;
+    fetch.size = size;
+    fetch.destination = static_cast<char*>(destination);
+    fetch.knownVersion = 0;
+    fetch.unchanged = false;
+    fetch.failed = false;
+    fetch.event = event;
+    resetPendingFetch(&fetch);
+    uint64_t fetchId = generateUniqueId();
+
+    // A cached copy goes into the destination now and stays there if the source confirms it
+    lockFetchMutex();
+    g_fetchStats.fetches++;
+    CachedRange* cached = findCachedRange(memoryName, offset, size);
+    if (cached) {
+        memcpy(destination, &cached->data[0], size);
+        fetch.knownVersion = cached->version;
+    }
+    g_pendingFetches[fetchId] = &fetch;
+    unlockFetchMutex();
+
+    ULONGLONG deadline = GetTickCount64() + timeoutMs;
+    for (;;) {
+        std::vector<SyncMessage> requests;
+        lockFetchMutex();
+        FetchRequestSender sender = g_fetchRequestSender;
+        bool finished = fetch.unchanged || fetch.failed || fetch.windowsDone == fetch.windowSent.size();
+        if (!finished && sender) {
+            collectFetchRequests(fetchId, &fetch, requests);
+        }
+        unlockFetchMutex();
+        if (finished || !sender) {
+            break;
+        }
+        for (size_t i = 0; i < requests.size(); i++) {
+            sender(requests[i]);
+        }
+
+        ULONGLONG now = GetTickCount64();
+        if (now >= deadline) {
+            break;
+        }
+        DWORD wait = (deadline - now < FETCH_RETRY_MS) ? static_cast<DWORD>(deadline - now) : FETCH_RETRY_MS;
+        WaitForSingleObject(event, wait);
+    }
+
+    lockFetchMutex();
+    g_pendingFetches.erase(fetchId);
+    bool complete = fetch.unchanged || fetch.windowsDone == fetch.windowSent.size();
+    if (fetch.unchanged) {
+        fetch.version = fetch.knownVersion;
+        g_fetchStats.cacheHits++;
+        cached = findCachedRange(memoryName, offset, size);
+        if (cached) {
+            cached->lastUsed = GetTickCount64();
+        }
+    } else if (complete) {
+        g_fetchStats.bytesFetched += size;
+        cacheRange(fetch);
+    } else {
+        g_fetchStats.failures++;
+    }
+    unlockFetchMutex();
+    CloseHandle(event);
+
+    // Nothing writes to the destination once the fetch is removed
+    if (!complete) {
+        memset(destination, 0, size);
+    }
+
+    if (complete && version) {
+        *version = fetch.version;
+    }
+    return complete;
+}
+
+bool receiveFetchData(const SyncMessage& message) {
+    lockFetchMutex();
+    std::map<uint64_t, PendingFetch*>::iterator it = g_pendingFetches.find(message.updateId);
+    if (it == g_pendingFetches.end() || it->second->name != message.memoryName) {
+        unlockFetchMutex();
+        return false;
+    }
+    PendingFetch* fetch = it->second;
+
+    if (message.flags & SYNC_FLAG_FETCH_FAILED) {
+        fetch->failed = true;
+    } else if (message.flags & SYNC_FLAG_FETCH_UNCHANGED) {
+        fetch->unchanged = !fetch->started && fetch->knownVersion != 0 && message.version == fetch->knownVersion;
+    } else {
+        // Parts start every MAX_SYNC_DATA_SIZE bytes from the start of the range
+        size_t position = static_cast<size_t>(message.offset) - fetch->offset;
+        size_t part = position / MAX_SYNC_DATA_SIZE;
+        size_t expected = (fetch->size - position < MAX_SYNC_DATA_SIZE) ? fetch->size - position : MAX_SYNC_DATA_SIZE;
+        if (message.offset < fetch->offset || position >= fetch->size || position % MAX_SYNC_DATA_SIZE != 0 ||
+            message.size != expected) {
+            unlockFetchMutex();
+            return false;
+        }
+
+        // The source's copy was replaced, for instance after it expired: start over at the new version
+        if (fetch->started && message.version != fetch->version) {
+            resetPendingFetch(fetch);
+            g_fetchStats.restarts++;
+        }
+        fetch->version = message.version;
+        fetch->started = true;
+        if (!fetch->partReceived[part]) {
+            fetch->partReceived[part] = true;
+            memcpy(fetch->destination + position, message.data, message.size);
+            size_t window = position / FETCH_WINDOW_SIZE;
+
+            // A window still receiving parts isn't retried yet
+            fetch->windowSent[window] = GetTickCount64();
+            if (++fetch->windowParts[window] == windowPartCount(fetch->size, window)) {
+                fetch->windowsDone++;
+            }
+        }
+    }
+    SetEvent(fetch->event);
+    unlockFetchMutex();
+    return true;
+}
+
+/**
+ * @brief Build the single reply that ends a fetch without data
+ */
+static void addFetchAnswer(const SyncMessage& request, uint32_t flags, uint64_t version,
+                           std::vector<SyncMessage>& replies) {
+    SyncMessage reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.msgType = MSG_FETCH_DATA;
+    snprintf(reply.memoryName, sizeof(reply.memoryName), "%s", request.memoryName);
+    reply.updateId = request.updateId;
+    reply.offset = request.offset;
+    reply.version = version;
+    reply.flags = flags;
+    reply.timestamp = GetTickCount();
+    replies.push_back(reply);
+}
+
+/**
+ * @brief Drop the copies no request has used for FETCH_SESSION_MS; call with g_fetchMutex held
+ */
+static void expireFetchSessions(ULONGLONG now) {
+    std::map<std::string, FetchSession>::iterator it = g_fetchSessions.begin();
+    while (it != g_fetchSessions.end()) {
+        if (now - it->second.lastUsed >= FETCH_SESSION_MS) {
+            g_fetchSessionBytes -= it->second.data.size();
+            g_fetchSessions.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool buildFetchReplies(const SyncMessage& request, const char* peer, std::vector<SyncMessage>& replies) {
+    if (request.size != sizeof(FetchRequestInfo)) {
+        return false;
+    }
+    FetchRequestInfo info;
+    memcpy(&info, request.data, sizeof(info));
+    if (info.size == 0 || info.size > FETCH_MAX_SIZE || request.offset < info.offset ||
+        request.offset - info.offset >= info.size || (request.offset - info.offset) % FETCH_WINDOW_SIZE != 0) {
+        return false;
+    }
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(request.memoryName, &regionSize));
+    if (!region || regionSize < sizeof(MemoryLayout) || info.offset > regionSize || info.size > regionSize - info.offset) {
+        addFetchAnswer(request, SYNC_FLAG_FETCH_FAILED, 0, replies);
+        return true;
+    }
+
+    char key[128];
+    sprintf(key, "%.64s/%llu", peer, static_cast<unsigned long long>(request.updateId));
+    ULONGLONG now = GetTickCount64();
+    lockFetchMutex();
+    expireFetchSessions(now);
+    bool known = g_fetchSessions.find(key) != g_fetchSessions.end();
+    unlockFetchMutex();
+
+    if (!known) {
+        // Read the range between two writes, unless the requester's copy is still current
+        std::vector<char> data;
+        uint64_t version;
+        for (;;) {
+            uint32_t sequence = beginRegionRead(region);
+            version = reinterpret_cast<const MemoryLayout*>(region)->version;
+            if (info.knownVersion == 0 || version != info.knownVersion) {
+                data.assign(region + info.offset, region + info.offset + info.size);
+            }
+            if (endRegionRead(region, sequence)) {
+                break;
+            }
+        }
+        if (info.knownVersion != 0 && version == info.knownVersion) {
+            addFetchAnswer(request, SYNC_FLAG_FETCH_UNCHANGED, version, replies);
+            return true;
+        }
+
+        lockFetchMutex();
+        if (g_fetchSessions.find(key) == g_fetchSessions.end()) {
+            if (g_fetchSessionBytes + data.size() > FETCH_MAX_SESSION_BYTES) {
+                unlockFetchMutex();
+                std::cerr << "[FETCH] Refusing a fetch of " << info.size << " bytes of " << request.memoryName
+                          << " from " << peer << ": too many fetches in progress" << std::endl;
+                addFetchAnswer(request, SYNC_FLAG_FETCH_FAILED, 0, replies);
+                return true;
+            }
+            FetchSession& session = g_fetchSessions[key];
+            session.data.swap(data);
+            session.version = version;
+            session.lastUsed = now;
+            g_fetchSessionBytes += session.data.size();
+        }
+        unlockFetchMutex();
+    }
+
+    lockFetchMutex();
+    std::map<std::string, FetchSession>::iterator it = g_fetchSessions.find(key);
+    if (it == g_fetchSessions.end()) {
+        unlockFetchMutex();
+        return false;
+    }
+    FetchSession& session = it->second;
+    session.lastUsed = now;
+    size_t start = static_cast<size_t>(request.offset - info.offset);
+    size_t end = (session.data.size() - start < FETCH_WINDOW_SIZE) ? session.data.size() : start + FETCH_WINDOW_SIZE;
+
+    // A retry of a window of this copy only needs the parts that didn't arrive
+    uint64_t skip = (info.version == session.version) ? info.partsReceived : 0;
+    size_t first = replies.size();
+
+    SyncMessage reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.msgType = MSG_FETCH_DATA;
+    snprintf(reply.memoryName, sizeof(reply.memoryName), "%s", request.memoryName);
+    reply.updateId = request.updateId;
+    reply.version = session.version;
+    for (size_t position = start; position < end; position += MAX_SYNC_DATA_SIZE) {
+        if (skip & (1ull << ((position - start) / MAX_SYNC_DATA_SIZE))) {
+            continue;
+        }
+        size_t length = (end - position < MAX_SYNC_DATA_SIZE) ? end - position : MAX_SYNC_DATA_SIZE;
+        reply.offset = info.offset + position;
+        reply.size = length;
+        reply.timestamp = GetTickCount();
+        reply.flags = SYNC_FLAG_MORE_IN_VERSION;
+        memcpy(reply.data, &session.data[position], length);
+        replies.push_back(reply);
+    }
+    if (replies.size() > first) {
+        replies.back().flags = 0;
+    }
+    unlockFetchMutex();
+    return true;
+}
+
+void getRemoteFetchStats(RemoteFetchStats* stats) {
+    if (!stats) {
+        return;
+    }
+    lockFetchMutex();
+    *stats = g_fetchStats;
+    unlockFetchMutex();
+}
+
+void clearRemoteFetchCache() {
+    lockFetchMutex();
+    g_fetchCache.clear();
+    g_fetchSessions.clear();
+    g_fetchSessionBytes = 0;
+    unlockFetchMutex();
+}
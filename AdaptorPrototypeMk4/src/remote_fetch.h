@@ -0,0 +1,126 @@
+#ifndef REMOTE_FETCH_H
+#define REMOTE_FETCH_H
+
+#include <windows.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "sync_message.h"
+
+/**
+ * @brief One-off reads of remote regions without replicating them
+ *
+ * fetchRemote reads a range of a region owned by another node. The request
+ * is sent to every remote node and only the region's source answers. The
+ * range is split into windows of FETCH_WINDOW_SIZE bytes, of which up to
+ * FETCH_WINDOWS_IN_FLIGHT are requested at a time. A window that goes
+ * FETCH_RETRY_MS without a part arriving is requested again, naming the
+ * parts already received so that only the others are resent.
+ *
+ * The source copies the whole range between two writes when the first
+ * window is requested and serves every window of that fetch from the copy,
+ * so the result is the range at a single version. The copy is dropped
+ * FETCH_SESSION_MS after its last request.
+ *
+ * Recent results are cached by the requester. A fetch of a cached range
+ * first asks the source whether the region is still at the cached version,
+ * and the range is only sent again if it isn't.
+ */
+
+/// Bytes of a range requested at a time
+#define FETCH_WINDOW_SIZE 32768
+
+/// Windows of a fetch requested at once
+#define FETCH_WINDOWS_IN_FLIGHT 4
+
+/// Time without a part of a window arriving after which it is requested again
+#define FETCH_RETRY_MS 100
+
+/// Largest range one fetch can read
+#define FETCH_MAX_SIZE (16 * 1024 * 1024)
+
+/// Time a source keeps the copy of a range after the last request for it
+#define FETCH_SESSION_MS 5000
+
+/// Copies a source keeps at most, in bytes, across all fetches
+#define FETCH_MAX_SESSION_BYTES (4 * FETCH_MAX_SIZE)
+
+/// Results kept by the requester
+#define FETCH_CACHE_ENTRIES 16
+
+/// Largest result that is cached
+#define FETCH_CACHE_MAX_SIZE (1024 * 1024)
+
+/**
+ * @brief Counters of the fetches made by this node
+ */
+struct RemoteFetchStats {
+    uint64_t fetches;           // Calls to fetchRemote
+    uint64_t cacheHits;         // Fetches answered from the cache after the source confirmed its version
+    uint64_t bytesFetched;      // Range bytes received
+    uint64_t windowRetries;     // Windows requested again
+    uint64_t restarts;          // Fetches restarted because the source's copy changed version
+    uint64_t failures;          // Fetches the source refused or that timed out
+};
+
+/**
+ * @brief Function that sends a fetch request to the remote nodes
+ */
+typedef void (*FetchRequestSender)(const SyncMessage& message);
+
+/**
+ * @brief Set the function used to send fetch requests
+ *
+ * @param sender Function to call; NULL to stop fetching
+ */
+void setFetchRequestSender(FetchRequestSender sender);
+
+/**
+ * @brief Read a range of a remote region
+ *
+ * Blocks until the whole range has arrived or the timeout passes. A fetch
+ * that is refused or times out zeroes the destination, so it never holds a
+ * range that was only partly received.
+ *
+ * @param memoryName Name of the region
+ * @param offset Region offset of the range
+ * @param size Size of the range, at most FETCH_MAX_SIZE
+ * @param destination Buffer of size bytes receiving the range
+ * @param timeoutMs Time to wait for the range
+ * @param version Receives the version the range was read at; may be NULL
+ * @return true if the range was read
+ */
+bool fetchRemote(const char* memoryName, size_t offset, size_t size, void* destination, DWORD timeoutMs,
+                 uint64_t* version);
+
+/**
+ * @brief Take a part of a fetched range
+ *
+ * Called from the receive thread for each MSG_FETCH_DATA message.
+ *
+ * @param message The MSG_FETCH_DATA message
+ * @return true if the part belongs to a fetch in progress
+ */
+bool receiveFetchData(const SyncMessage& message);
+
+/**
+ * @brief Answer a fetch request for a region this node is the source of
+ *
+ * @param request The MSG_FETCH_REQUEST message
+ * @param peer Address of the requester as "ip:port"
+ * @param replies Receives the MSG_FETCH_DATA messages to send back
+ * @return true if the request was well formed
+ */
+bool buildFetchReplies(const SyncMessage& request, const char* peer, std::vector<SyncMessage>& replies);
+
+/**
+ * @brief Get the counters of the fetches made by this node
+ */
+void getRemoteFetchStats(RemoteFetchStats* stats);
+
+/**
+ * @brief Drop the cached results and the copies kept for other nodes' fetches
+ */
+void clearRemoteFetchCache();
+
+#endif // REMOTE_FETCH_H
@@ -0,0 +1,453 @@
+/**
+ * @file secondary_index.cpp
+ * @brief Implementation of incrementally maintained secondary indexes
+ *
+ * Each index is registered as an apply observer on its region. For every
+ * applied update the observer intersects the changed range with the indexed
+ * column, rebuilds the old value of each touched cell from the old bytes, and
+ * moves the record from its old key to its new key.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "secondary_index.h"
+#include "shared_memory.h"
+#include "change_tracking.h"
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <string.h>
+
+/**
+ * @brief One key of a hashed index and the records holding it
+ */
+struct HashSlot {
+    uint64_t key;
+    std::set<uint64_t> records;
+};
+
+/**
+ * @brief State of one secondary index
+ */
+struct SecondaryIndex {
+    std::string memoryName;     // Region the index belongs to
+    int column;                 // Indexed column
+    IndexKind kind;             // Sorted or hashed
+    ColumnType type;            // Column element type
+    uint32_t width;             // Cell width in bytes
+    uint64_t dataOffset;        // Region offset of the column's cells
+    uint64_t capacity;          // Table capacity
+    size_t headerOffset;        // Region offset of the table header
+    uint64_t recordCount;       // Records [0, recordCount) are indexed
+    size_t entries;             // Number of indexed records
+
+    std::set<std::pair<uint64_t, uint64_t> > sorted;    // (key, record) for sorted indexes
+    std::vector<std::vector<HashSlot> > buckets;        // Buckets for hashed indexes
+    size_t hashKeys;                                    // Distinct keys in the hash table
+};
+
+/// Registered indexes by handle
+static std::map<int, SecondaryIndex*> g_indexes;
+
+/// Next handle to hand out
+static int g_nextIndexHandle = 0;
+
+/// Mutex protecting the indexes (queries run on application threads, updates on the receive thread)
+static HANDLE g_indexMutex = NULL;
+
+static void lockIndexMutex() {
+    if (g_indexMutex == NULL) {
+        g_indexMutex = CreateMutex(NULL, FALSE, NULL);
+        if (g_indexMutex == NULL) {
+            std::cerr << "Failed to create index mutex: " << GetLastError() << std::endl;
+        }
+    }
+    if (g_indexMutex != NULL) {
+        WaitForSingleObject(g_indexMutex, INFINITE);
+    }
+}
+
+static void unlockIndexMutex() {
+    if (g_indexMutex != NULL) {
+        ReleaseMutex(g_indexMutex);
+    }
+}
+
+uint64_t encodeIndexKey(ColumnType type, uint32_t width, const void* cell) {
+    switch (type) {
+        case COLUMN_INT32: {
+            int32_t v;
+            memcpy(&v, cell, sizeof(v));
+            return static_cast<uint64_t>(static_cast<int64_t>(v)) ^ 0x8000000000000000ULL;
+        }
+        case COLUMN_UINT32: {
+            uint32_t v;
+            memcpy(&v, cell, sizeof(v));
+            return v;
+        }
+        case COLUMN_INT64: {
+            uint64_t v;
+            memcpy(&v, cell, sizeof(v));
+            return v ^ 0x8000000000000000ULL;
+        }
+        case COLUMN_UINT64: {
+            uint64_t v;
+            memcpy(&v, cell, sizeof(v));
+            return v;
+        }
+        case COLUMN_FLOAT: {
+            float f;
+            memcpy(&f, cell, sizeof(f));
+            double d = (f == 0.0f) ? 0.0 : f;   // Treat -0 and +0 as the same key
+            uint64_t v;
+            memcpy(&v, &d, sizeof(v));
+            return (v & 0x8000000000000000ULL) ? ~v : (v | 0x8000000000000000ULL);
+        }
+        case COLUMN_DOUBLE: {
+            double d;
+            memcpy(&d, cell, sizeof(d));
+            if (d == 0.0) {
+                d = 0.0;
+            }
+            uint64_t v;
+            memcpy(&v, &d, sizeof(v));
+            return (v & 0x8000000000000000ULL) ? ~v : (v | 0x8000000000000000ULL);
+        }
+        case COLUMN_BYTES: {
+            const unsigned char* bytes = static_cast<const unsigned char*>(cell);
+            uint64_t v = 0;
+            for (uint32_t i = 0; i < 8; i++) {
+                v = (v << 8) | (i < width ? bytes[i] : 0);
+            }
+            return v;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Compute the key a cell is stored under in an index
+ *
+ * Hashed indexes over byte columns hash the whole cell; everything else uses
+ * the order-preserving encoding.
+ */
+static uint64_t indexKey(const SecondaryIndex* index, const void* cell) {
+    if (index->kind == INDEX_HASHED && index->type == COLUMN_BYTES) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(cell);
+        uint64_t hash = 14695981039346656037ULL;    // FNV-1a
+        for (uint32_t i = 0; i < index->width; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+    return encodeIndexKey(index->type, index->width, cell);
+}
+
+/**
+ * @brief Pick the hash bucket for a key
+ */
+static size_t bucketFor(const SecondaryIndex* index, uint64_t key) {
+    uint64_t mixed = key * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>((mixed >> 32) % index->buckets.size());
+}
+
+/**
+ * @brief Grow the hash table when it gets too full
+ */
+static void rehashIfNeeded(SecondaryIndex* index) {
+    if (index->hashKeys < index->buckets.size() * 2) {
+        return;
+    }
+
+    std::vector<std::vector<HashSlot> > old;
+    old.swap(index->buckets);
+    index->buckets.resize(old.size() * 4);
+
+    for (size_t b = 0; b < old.size(); b++) {
+        for (size_t s = 0; s < old[b].size(); s++) {
+            index->buckets[bucketFor(index, old[b][s].key)].push_back(HashSlot());
+            HashSlot& slot = index->buckets[bucketFor(index, old[b][s].key)].back();
+            slot.key = old[b][s].key;
+            slot.records.swap(old[b][s].records);
+        }
+    }
+}
+
+static void indexInsert(SecondaryIndex* index, uint64_t key, uint64_t record) {
+    if (index->kind == INDEX_SORTED) {
+        if (index->sorted.insert(std::make_pair(key, record)).second) {
+            index->entries++;
+        }
+        return;
+    }
+
+    std::vector<HashSlot>& bucket = index->buckets[bucketFor(index, key)];
+    for (size_t i = 0; i < bucket.size(); i++) {
+        if (bucket[i].key == key) {
+            if (bucket[i].records.insert(record).second) {
+                index->entries++;
+            }
+            return;
+        }
+    }
+
+    bucket.push_back(HashSlot());
+    bucket.back().key = key;
+    bucket.back().records.insert(record);
+    index->entries++;
+    index->hashKeys++;
+    rehashIfNeeded(index);
+}
+
+static void indexRemove(SecondaryIndex* index, uint64_t key, uint64_t record) {
+    if (index->kind == INDEX_SORTED) {
+        if (index->sorted.erase(std::make_pair(key, record)) > 0) {
+            index->entries--;
+        }
+        return;
+    }
+
+    std::vector<HashSlot>& bucket = index->buckets[bucketFor(index, key)];
+    for (size_t i = 0; i < bucket.size(); i++) {
+        if (bucket[i].key == key) {
+            if (bucket[i].records.erase(record) > 0) {
+                index->entries--;
+            }
+            if (bucket[i].records.empty()) {
+                bucket.erase(bucket.begin() + i);
+                index->hashKeys--;
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Get a pointer to a record's cell in the mapped region
+ */
+static const char* cellAt(const SecondaryIndex* index, const char* region, uint64_t record) {
+    return region + index->dataOffset + record * index->width;
+}
+
+/**
+ * @brief Apply observer that keeps an index in step with applied updates
+ *
+ * @param context The index handle, cast to a pointer
+ */
+static void indexApplyObserver(const char* memoryName, size_t offset, size_t size,
+                               const void* oldData, const void* newData, void* context) {
+    (void)memoryName;
+    int handle = static_cast<int>(reinterpret_cast<intptr_t>(context));
+    const char* region = static_cast<const char*>(newData) - offset;
+    size_t end = offset + size;
+
+    lockIndexMutex();
+    std::map<int, SecondaryIndex*>::iterator it = g_indexes.find(handle);
+    if (it == g_indexes.end()) {
+        unlockIndexMutex();
+        return;
+    }
+    SecondaryIndex* index = it->second;
+
+    // Cells of the indexed column touched by this update
+    size_t columnStart = static_cast<size_t>(index->dataOffset);
+    size_t columnEnd = static_cast<size_t>(index->dataOffset + index->capacity * index->width);
+    size_t low = (offset > columnStart) ? offset : columnStart;
+    size_t high = (end < columnEnd) ? end : columnEnd;
+
+    if (low < high) {
+        uint64_t first = (low - columnStart) / index->width;
+        uint64_t last = (high - columnStart + index->width - 1) / index->width;
+        if (last > index->recordCount) {
+            last = index->recordCount;
+        }
+
+        std::vector<char> oldCell(index->width);
+        for (uint64_t record = first; record < last; record++) {
+            const char* cell = cellAt(index, region, record);
+            size_t cellOffset = static_cast<size_t>(columnStart + record * index->width);
+
+            restoreOldBytes(offset, size, oldData, cellOffset, index->width, cell, &oldCell[0]);
+
+            if (memcmp(&oldCell[0], cell, index->width) != 0) {
+                indexRemove(index, indexKey(index, &oldCell[0]), record);
+                indexInsert(index, indexKey(index, cell), record);
+            }
+        }
+    }
+
+    // A replicated header may have moved recordCount
+    size_t countOffset = index->headerOffset + offsetof(RecordTableHeader, recordCount);
+    if (offset < countOffset + sizeof(uint64_t) && countOffset < end) {
+        const RecordTableHeader* table =
+            reinterpret_cast<const RecordTableHeader*>(region + index->headerOffset);
+        uint64_t newCount = table->recordCount;
+        if (newCount > index->capacity) {
+            newCount = index->capacity;
+        }
+
+        for (uint64_t record = index->recordCount; record < newCount; record++) {
+            indexInsert(index, indexKey(index, cellAt(index, region, record)), record);
+        }
+        for (uint64_t record = newCount; record < index->recordCount; record++) {
+            indexRemove(index, indexKey(index, cellAt(index, region, record)), record);
+        }
+        index->recordCount = newCount;
+    }
+
+    unlockIndexMutex();
+}
+
+int registerSecondaryIndex(const char* memoryName, const char* columnName, IndexKind kind) {
+    void* region = getSharedMemory(memoryName);
+    RecordTableHeader* table = openRecordTable(region);
+    if (!table) {
+        std::cerr << "[INDEX] No record table in " << memoryName << std::endl;
+        return -1;
+    }
+
+    int column = findRecordColumn(table, columnName);
+    if (column < 0) {
+        std::cerr << "[INDEX] Unknown column " << columnName << " in " << memoryName << std::endl;
+        return -1;
+    }
+
+    // The mapping must cover the whole table before we read its cells
+    if (getSharedMemorySize(memoryName) < table->regionSize) {
+        std::cerr << "[INDEX] Region " << memoryName << " is smaller than its record table" << std::endl;
+        return -1;
+    }
+
+    SecondaryIndex* index = new SecondaryIndex();
+    index->memoryName = memoryName;
+    index->column = column;
+    index->kind = kind;
+    index->type = static_cast<ColumnType>(table->columns[column].type);
+    index->width = table->columns[column].width;
+    index->dataOffset = table->columns[column].dataOffset;
+    index->capacity = table->capacity;
+    index->headerOffset = recordTableHeaderOffset(table);
+    index->recordCount = (table->recordCount < table->capacity) ? table->recordCount : table->capacity;
+    index->entries = 0;
+    index->hashKeys = 0;
+    if (kind == INDEX_HASHED) {
+        index->buckets.resize(1024);
+    }
+
+    lockIndexMutex();
+
+    // Initial build; from here on the index is only updated incrementally
+    const char* base = static_cast<const char*>(region);
+    for (uint64_t record = 0; record < index->recordCount; record++) {
+        indexInsert(index, indexKey(index, cellAt(index, base, record)), record);
+    }
+
+    int handle = g_nextIndexHandle++;
+    g_indexes[handle] = index;
+    unlockIndexMutex();
+
+    registerApplyObserver(memoryName, indexApplyObserver,
+                          reinterpret_cast<void*>(static_cast<intptr_t>(handle)));
+    return handle;
+}
+
+bool unregisterSecondaryIndex(int handle) {
+    lockIndexMutex();
+    std::map<int, SecondaryIndex*>::iterator it = g_indexes.find(handle);
+    if (it == g_indexes.end()) {
+        unlockIndexMutex();
+        return false;
+    }
+    SecondaryIndex* index = it->second;
+    g_indexes.erase(it);
+    unlockIndexMutex();
+
+    unregisterApplyObserver(index->memoryName.c_str(), indexApplyObserver,
+                            reinterpret_cast<void*>(static_cast<intptr_t>(handle)));
+    delete index;
+    return true;
+}
+
+size_t secondaryIndexSize(int handle) {
+    size_t size = 0;
+    lockIndexMutex();
+    std::map<int, SecondaryIndex*>::iterator it = g_indexes.find(handle);
+    if (it != g_indexes.end()) {
+        size = it->second->entries;
+    }
+    unlockIndexMutex();
+    return size;
+}
+
+size_t indexFindEqualCell(int handle, const void* cell, std::vector<uint64_t>& records) {
+    size_t found = 0;
+
+    lockIndexMutex();
+    std::map<int, SecondaryIndex*>::iterator it = g_indexes.find(handle);
+    if (it == g_indexes.end()) {
+        unlockIndexMutex();
+        return 0;
+    }
+    SecondaryIndex* index = it->second;
+    uint64_t key = indexKey(index, cell);
+
+    // Byte columns can share a key, so confirm each candidate against the cell
+    bool confirm = (index->type == COLUMN_BYTES);
+    const char* region = confirm ? static_cast<const char*>(getSharedMemory(index->memoryName.c_str())) : NULL;
+
+    if (index->kind == INDEX_SORTED) {
+        std::set<std::pair<uint64_t, uint64_t> >::const_iterator pos =
+            index->sorted.lower_bound(std::make_pair(key, static_cast<uint64_t>(0)));
+        for (; pos != index->sorted.end() && pos->first == key; ++pos) {
+            if (!confirm || (region && memcmp(cellAt(index, region, pos->second), cell, index->width) == 0)) {
+                records.push_back(pos->second);
+                found++;
+            }
+        }
+    } else {
+        const std::vector<HashSlot>& bucket = index->buckets[bucketFor(index, key)];
+        for (size_t i = 0; i < bucket.size(); i++) {
+            if (bucket[i].key != key) {
+                continue;
+            }
+            std::set<uint64_t>::const_iterator pos;
+            for (pos = bucket[i].records.begin(); pos != bucket[i].records.end(); ++pos) {
+                if (!confirm || (region && memcmp(cellAt(index, region, *pos), cell, index->width) == 0)) {
+                    records.push_back(*pos);
+                    found++;
+                }
+            }
+        }
+    }
+
+    unlockIndexMutex();
+    return found;
+}
+
+size_t indexFindRangeCells(int handle, const void* lowCell, const void* highCell,
+                           std::vector<uint64_t>& records) {
+    size_t found = 0;
+
+    lockIndexMutex();
+    std::map<int, SecondaryIndex*>::iterator it = g_indexes.find(handle);
+    if (it == g_indexes.end() || it->second->kind != INDEX_SORTED || it->second->type == COLUMN_BYTES) {
+        unlockIndexMutex();
+        return 0;
+    }
+    SecondaryIndex* index = it->second;
+
+    uint64_t low = indexKey(index, lowCell);
+    uint64_t high = indexKey(index, highCell);
+    std::set<std::pair<uint64_t, uint64_t> >::const_iterator pos =
+        index->sorted.lower_bound(std::make_pair(low, static_cast<uint64_t>(0)));
+    for (; pos != index->sorted.end() && pos->first <= high; ++pos) {
+        records.push_back(pos->second);
+        found++;
+    }
+
+    unlockIndexMutex();
+    return found;
+}
@@ -0,0 +1,113 @@
+#ifndef SECONDARY_INDEX_H
+#define SECONDARY_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "record_table.h"
+
+/**
+ * @brief Secondary indexes over columns of replicated record tables
+ *
+ * A receiver registers an index over one column of a record table region.
+ * The index is built once at registration and from then on maintained from
+ * the exact ranges touched by each applied update (using the old and new
+ * bytes handed to apply observers), so it never needs a full rebuild.
+ *
+ * Only records below the table's recordCount are indexed; when a replicated
+ * header changes recordCount, the records entering or leaving that range are
+ * added to or removed from the index.
+ */
+
+/**
+ * @brief Kinds of secondary index
+ */
+typedef enum {
+    INDEX_SORTED,   // Ordered index, supports equality and range lookups in O(log n)
+    INDEX_HASHED    // Hash index, supports equality lookups in O(1)
+} IndexKind;
+
+/**
+ * @brief Encode a cell value as an order-preserving 64-bit key
+ *
+ * Signed integers and floating point values are mapped so that unsigned
+ * comparison of the keys matches the ordering of the values. COLUMN_BYTES
+ * cells use their first 8 bytes in big-endian order (exact matches are
+ * confirmed against the cell itself).
+ *
+ * @param type Column type of the cell
+ * @param width Cell width in bytes
+ * @param cell Pointer to the cell
+ * @return The encoded key
+ */
+uint64_t encodeIndexKey(ColumnType type, uint32_t width, const void* cell);
+
+/**
+ * @brief Register a secondary index over a column of a record table region
+ *
+ * The region must already be mapped and hold a record table.
+ *
+ * @param memoryName Name of the shared memory region
+ * @param columnName Name of the indexed column
+ * @param kind Kind of index to build
+ * @return Index handle (>= 0), or -1 on failure
+ */
+int registerSecondaryIndex(const char* memoryName, const char* columnName, IndexKind kind);
+
+/**
+ * @brief Drop an index registered with registerSecondaryIndex
+ *
+ * @param handle The index handle
+ * @return true if the index existed and was removed, false otherwise
+ */
+bool unregisterSecondaryIndex(int handle);
+
+/**
+ * @brief Get the number of records in an index
+ *
+ * @param handle The index handle
+ * @return Number of indexed records
+ */
+size_t secondaryIndexSize(int handle);
+
+/**
+ * @brief Find the records whose indexed cell equals a value
+ *
+ * @param handle The index handle
+ * @param cell Pointer to a value laid out like a cell of the column
+ * @param records Output vector the matching record numbers are appended to
+ * @return Number of records appended
+ */
+size_t indexFindEqualCell(int handle, const void* cell, std::vector<uint64_t>& records);
+
+/**
+ * @brief Find the records whose indexed cell lies in [low, high]
+ *
+ * Only supported by sorted indexes over numeric columns.
+ *
+ * @param handle The index handle
+ * @param lowCell Pointer to the lower bound, laid out like a cell
+ * @param highCell Pointer to the upper bound, laid out like a cell
+ * @param records Output vector the matching record numbers are appended to (in key order)
+ * @return Number of records appended
+ */
+size_t indexFindRangeCells(int handle, const void* lowCell, const void* highCell,
+                           std::vector<uint64_t>& records);
+
+/**
+ * @brief Typed wrapper for indexFindEqualCell
+ */
+template <typename T>
+size_t indexFindEqual(int handle, T value, std::vector<uint64_t>& records) {
+    return indexFindEqualCell(handle, &value, records);
+}
+
+/**
+ * @brief Typed wrapper for indexFindRangeCells
+ */
+template <typename T>
+size_t indexFindRange(int handle, T low, T high, std::vector<uint64_t>& records) {
+    return indexFindRangeCells(handle, &low, &high, records);
+}
+
+#endif // SECONDARY_INDEX_H
@@ -5,16 +5,98 @@
  * This file contains the implementation of functions for creating, accessing,
  * and monitoring shared memory regions in Windows. It provides both low-level
  * Windows API wrappers and higher-level functions for easier use.
+ *
+ * Regions are normally backed by the system paging file and disappear with
+ * the last handle. A region whose segment is still held by another process
+ * when it is initialized is re-attached rather than zeroed, provided its
+ * MemoryLayout header carries REGION_MAGIC and the expected layout hash.
+ * A region created with a backing directory is instead backed by
+ * "<directory>/<name>.region": on restart it is attached with its contents
+ * intact, and the ranges reported through markSharedMemoryRangeDirty
+ * are written back to the file by a background flush thread.
  */
 
 #include "shared_memory.h"
 #include "memory_layout.h"
+#include "thread_placement.h"
 #include <windows.h>
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 #include <process.h>  // For _beginthreadex
 
+/// How often changed ranges of file-backed regions are written back (milliseconds)
+#define REGION_FLUSH_INTERVAL_MS 50
+
+/// Above this many separate ranges, a region's pending ranges are merged into one
+#define MAX_PENDING_FLUSH_RANGES 1024
+
+/// Chunk size of the background copy into a larger segment
+#define RESIZE_COPY_CHUNK (1024 * 1024)
+
+/// Region bytes per bit of the bitmap of pages changed while a resize copies
+#define RESIZE_DIRTY_SIZE 4096
+
+/// Bits of that bitmap, enough for a 4 GB region
+#define RESIZE_DIRTY_BITS (1024 * 1024)
+
+/// How long a resize waits for a moment without writes before giving up (milliseconds)
+#define RESIZE_SWITCH_TIMEOUT_MS 5000
+
+/**
+ * @brief Pages of a region changed while a resize copies it
+ *
+ * Kept in the section "<name>.resize", so writers in every process mark
+ * what they change, the way block locks share "<name>.locks". Writers set
+ * bits while the region's sequence has REGION_RESIZING, and the resizing
+ * process copies those pages again before the switch.
+ */
+struct ResizeDirtyTable {
+    volatile LONG64 dirty[RESIZE_DIRTY_BITS / 64];
+};
+
+/// A changed range of a file-backed region: offset and size
+typedef std::pair<size_t, size_t> FlushRange;
+
+/// An earlier generation of a region: mapping handle and view
+typedef std::pair<HANDLE, void*> RetiredSegment;
+
+/**
+ * @struct PrefaultJob
+ * @brief State shared with a region's asynchronous prefault thread
+ */
+struct PrefaultJob {
+    std::string name;           ///< Name of the region, for reporting
+    void* data;                 ///< Pointer to the mapped memory region
+    SIZE_T size;                ///< Size of the region in bytes
+    volatile bool running;      ///< Cleared to abandon the prefault
+    volatile bool complete;     ///< Set once every page has been touched
+    double elapsedMs;           ///< Time the prefault took (valid once complete is set)
+};
+
+/**
+ * @struct ResizeJob
+ * @brief State shared with the thread moving a region to a larger segment
+ */
+struct ResizeJob {
+    std::string name;           ///< Name of the region
+    HANDLE handle;              ///< Mapping of the larger segment
+    void* data;                 ///< View of the larger segment
+    SIZE_T size;                ///< Size of the larger segment
+    uint32_t generation;        ///< Generation of the larger segment
+    void* oldData;              ///< View of the current segment
+    SIZE_T oldSize;             ///< Size of the current segment
+    bool sameFile;              ///< Both segments map the same backing file, so nothing is copied
+    volatile bool running;      ///< Cleared to abandon the resize
+    volatile bool complete;     ///< Set once the region has switched to the larger segment
+    volatile bool failed;       ///< Set if the resize gave up before the switch
+};
+
 /**
  * @struct SharedMemoryInfo
  * @brief Structure to hold information about a shared memory region
@@ -30,13 +112,31 @@ struct SharedMemoryInfo {
     HANDLE monitor_thread;      ///< Thread handle that monitors for changes in the memory
     volatile bool monitoring;   ///< Flag indicating if monitoring is active
     MemoryChangeCallback callback; ///< Callback function to invoke when memory changes
+    HANDLE file;                ///< Backing file, or NULL for the paging file
+    bool restored;              ///< true if the backing file already held the region's contents
+    std::vector<FlushRange> dirtyRanges; ///< Changed ranges not yet written back to the file
+    HANDLE prefault_thread;     ///< Thread touching the region's pages, if prefaulting asynchronously
+    PrefaultJob* prefault;      ///< State of the asynchronous prefault, or NULL
+    RegionStartupStats startup; ///< How long the region took to start up
+    uint32_t layoutId;          ///< Application layout identifier the region was created with
+    uint32_t generation;        ///< Generation of the segment that is mapped
+    HANDLE resize_thread;       ///< Thread moving the region to a larger segment, if resizing
+    ResizeJob* resize;          ///< State of the resize, or NULL
+    HANDLE resizeDirtyHandle;   ///< Section of the pages changed during a resize, once mapped
+    ResizeDirtyTable* resizeDirty; ///< View of that section, or NULL
+    std::vector<RetiredSegment> retired;  ///< Earlier generations, kept mapped so stale pointers stay readable
 
     /**
      * @brief Default constructor
      *
      * Initializes all members to safe default values.
      */
-    SharedMemoryInfo() : handle(NULL), data(NULL), size(0), monitor_thread(NULL), monitoring(false), callback(NULL) {}
+    SharedMemoryInfo() : handle(NULL), data(NULL), size(0), monitor_thread(NULL), monitoring(false), callback(NULL),
+                         file(NULL), restored(false), prefault_thread(NULL), prefault(NULL), layoutId(0),
+                         generation(0), resize_thread(NULL), resize(NULL), resizeDirtyHandle(NULL),
+                         resizeDirty(NULL) {
+        memset(&startup, 0, sizeof(startup));
+    }
 
     /**
      * @brief Copy constructor
@@ -52,7 +152,20 @@ struct SharedMemoryInfo {
         size(other.size),
         monitor_thread(other.monitor_thread),
         monitoring(other.monitoring),
-        callback(other.callback) {}
+        callback(other.callback),
+        file(other.file),
+        restored(other.restored),
+        dirtyRanges(other.dirtyRanges),
+        prefault_thread(other.prefault_thread),
+        prefault(other.prefault),
+        startup(other.startup),
+        layoutId(other.layoutId),
+        generation(other.generation),
+        resize_thread(other.resize_thread),
+        resize(other.resize),
+        resizeDirtyHandle(other.resizeDirtyHandle),
+        resizeDirty(other.resizeDirty),
+        retired(other.retired) {}
 
     /**
      * @brief Assignment operator
@@ -70,6 +183,19 @@ struct SharedMemoryInfo {
         monitor_thread = other.monitor_thread;
         monitoring = other.monitoring;
         callback = other.callback;
+        file = other.file;
+        restored = other.restored;
+        dirtyRanges = other.dirtyRanges;
+        prefault_thread = other.prefault_thread;
+        prefault = other.prefault;
+        startup = other.startup;
+        layoutId = other.layoutId;
+        generation = other.generation;
+        resize_thread = other.resize_thread;
+        resize = other.resize;
+        resizeDirtyHandle = other.resizeDirtyHandle;
+        resizeDirty = other.resizeDirty;
+        retired = other.retired;
         return *this;
     }
 };
@@ -92,6 +218,24 @@ static std::map<std::string, SharedMemoryInfo> shared_memories;
  */
 static HANDLE shared_memories_mutex = NULL;
 
+/**
+ * @brief Mutex held while changed ranges are written back to backing files
+ *
+ * Writing back happens outside shared_memories_mutex so that it never delays
+ * getSharedMemory. cleanupSharedMemory takes this mutex before
+ * shared_memories_mutex, so a region is never unmapped during a flush.
+ */
+static HANDLE region_flush_mutex = NULL;
+
+/// Thread that writes changed ranges of file-backed regions back to their files
+static HANDLE region_flush_thread = NULL;
+
+/// Flag keeping the flush thread running
+static volatile bool region_flush_running = false;
+
+/// Number of file-backed regions currently initialized
+static int file_backed_regions = 0;
+
 /**
  * @brief Initialize the mutex for thread safety
  *
@@ -105,6 +249,13 @@ void initSharedMemoryMutex() {
             std::cerr << "Failed to create mutex: " << GetLastError() << std::endl;
         }
     }
+
+    if (region_flush_mutex == NULL) {
+        region_flush_mutex = CreateMutex(NULL, FALSE, NULL);
+        if (region_flush_mutex == NULL) {
+            std::cerr << "Failed to create flush mutex: " << GetLastError() << std::endl;
+        }
+    }
 }
 
 /**
@@ -131,6 +282,24 @@ void unlockSharedMemoriesMutex() {
     }
 }
 
+/**
+ * @brief Acquire the region flush mutex
+ */
+static void lockRegionFlushMutex() {
+    if (region_flush_mutex != NULL) {
+        WaitForSingleObject(region_flush_mutex, INFINITE);
+    }
+}
+
+/**
+ * @brief Release the region flush mutex
+ */
+static void unlockRegionFlushMutex() {
+    if (region_flush_mutex != NULL) {
+        ReleaseMutex(region_flush_mutex);
+    }
+}
+
 /**
  * @brief Helper function to convert a char* string to LPCSTR (ANSI string)
  *
@@ -185,6 +354,71 @@ HANDLE CreateSharedMemory(const char* name, SIZE_T size) {
     return hMapFile;
 }
 
+/**
+ * @brief Opens or creates the backing file of a region
+ *
+ * The file is "<directory>/<name>.region". The directory is created if it
+ * doesn't exist yet.
+ *
+ * @param directory Directory holding region files
+ * @param name The name of the shared memory region
+ * @param existed Set to true if the file already existed with some contents
+ * @return Handle to the file, or INVALID_HANDLE_VALUE if it couldn't be opened
+ */
+HANDLE OpenRegionBackingFile(const char* directory, const char* name, bool* existed) {
+    // An existing directory is fine; other failures show up when the file is opened
+    CreateDirectoryA(directory, NULL);
+
+    std::string path = std::string(directory) + "/" + name + ".region";
+    HANDLE hFile = CreateFileA(
+        path.c_str(),                       // Path of the backing file
+        GENERIC_READ | GENERIC_WRITE,       // The mapping is read/write
+        FILE_SHARE_READ | FILE_SHARE_WRITE, // Other processes map the section, not the file
+        NULL,                               // Default security attributes
+        OPEN_ALWAYS,                        // Keep existing contents
+        FILE_ATTRIBUTE_NORMAL,              // Normal file
+        NULL                                // No template file
+    );
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        std::cerr << "Could not open region file " << path << ": " << GetLastError() << std::endl;
+        return INVALID_HANDLE_VALUE;
+    }
+
+    LARGE_INTEGER fileSize;
+    *existed = GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart > 0;
+    return hFile;
+}
+
+/**
+ * @brief Creates a shared memory region backed by a file
+ *
+ * Like CreateSharedMemory, but the section is backed by hFile instead of the
+ * paging file. The file is extended with zeros if it is smaller than size.
+ *
+ * @param name The name of the shared memory region (must be unique system-wide)
+ * @param hFile Handle to the backing file, opened for reading and writing
+ * @param size The size of the shared memory region in bytes
+ * @return HANDLE to the shared memory region, or NULL if creation failed
+ */
+HANDLE CreateFileBackedSharedMemory(const char* name, HANDLE hFile, SIZE_T size) {
+    uint64_t size64 = static_cast<uint64_t>(size);
+    HANDLE hMapFile = CreateFileMappingA(
+        hFile,                                      // Back the section with this file
+        NULL,                                       // Default security attributes
+        PAGE_READWRITE,                             // Read/write access
+        static_cast<DWORD>(size64 >> 32),           // High 32 bits of size
+        static_cast<DWORD>(size64 & 0xFFFFFFFF),    // Low 32 bits of size
+        CharToLPCSTR(name)                          // Name of the shared memory object
+    );
+
+    if (hMapFile == NULL) {
+        std::cerr << "Could not create file-backed mapping object: " << GetLastError() << std::endl;
+    }
+
+    return hMapFile;
+}
+
 /**
  * @brief Opens an existing shared memory region
  *
@@ -352,7 +586,8 @@ void MonitorSharedMemory(HANDLE hMapFile, void (*callback)(void*)) {
  *
  * This function creates a new shared memory region or opens an existing one with
  * the specified name and size. It handles all the details of creating the file
- * mapping object, mapping it into memory, and initializing it to zeros.
+ * mapping object, mapping it into memory, and initializing it to zeros unless
+ * it re-attaches to a segment that is still held by another process.
  *
  * The shared memory region is tracked in the global shared_memories map, so it can
  * be accessed later using getSharedMemory() and cleaned up using cleanupSharedMemory().
@@ -362,6 +597,326 @@ void MonitorSharedMemory(HANDLE hMapFile, void (*callback)(void*)) {
  * @return true if initialization was successful, false otherwise
  */
 bool initializeSharedMemory(const char* name, size_t size) {
+    return initializeSharedMemoryWithOptions(name, size, RegionOptions());
+}
+
+/**
+ * @brief Write changed ranges of a mapped file back to disk
+ *
+ * @param data Start of the mapped region
+ * @param file Backing file of the region
+ * @param ranges Changed ranges; sorted and merged in place
+ * @return true if every range was written, false otherwise
+ */
+static bool flushRanges(void* data, HANDLE file, std::vector<FlushRange>& ranges) {
+    std::sort(ranges.begin(), ranges.end());
+
+    bool success = true;
+    size_t i = 0;
+    while (i < ranges.size()) {
+        size_t start = ranges[i].first;
+        size_t end = ranges[i].first + ranges[i].second;
+        for (i++; i < ranges.size() && ranges[i].first <= end; i++) {
+            end = (std::max)(end, ranges[i].first + ranges[i].second);
+        }
+
+        if (!FlushViewOfFile(static_cast<char*>(data) + start, end - start)) {
+            std::cerr << "Failed to flush region range: " << GetLastError() << std::endl;
+            success = false;
+        }
+    }
+
+    if (!ranges.empty() && !FlushFileBuffers(file)) {
+        success = false;
+    }
+    return success;
+}
+
+/**
+ * @brief Thread function writing changed ranges of file-backed regions back to disk
+ *
+ * Every REGION_FLUSH_INTERVAL_MS it takes the pending ranges of each
+ * file-backed region and flushes just those pages (FlushViewOfFile), then the
+ * file itself, so write-back cost follows the amount of change.
+ *
+ * @param arg Thread argument (not used)
+ * @return Thread exit code
+ */
+unsigned int __stdcall regionFlushThreadFunc(void* arg) {
+    while (region_flush_running) {
+        Sleep(REGION_FLUSH_INTERVAL_MS);
+
+        lockRegionFlushMutex();
+
+        // Take the pending ranges under the map lock, flush them outside it
+        std::vector<void*> datas;
+        std::vector<HANDLE> files;
+        std::vector<std::vector<FlushRange> > ranges;
+        lockSharedMemoriesMutex();
+        std::map<std::string, SharedMemoryInfo>::iterator it;
+        for (it = shared_memories.begin(); it != shared_memories.end(); ++it) {
+            if (it->second.file != NULL && !it->second.dirtyRanges.empty()) {
+                datas.push_back(it->second.data);
+                files.push_back(it->second.file);
+                ranges.push_back(std::vector<FlushRange>());
+                ranges.back().swap(it->second.dirtyRanges);
+            }
+        }
+        unlockSharedMemoriesMutex();
+
+        for (size_t i = 0; i < datas.size(); i++) {
+            flushRanges(datas[i], files[i], ranges[i]);
+        }
+
+        unlockRegionFlushMutex();
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the milliseconds elapsed since a performance counter reading
+ *
+ * @param start Performance counter value at the start of the interval
+ * @return Elapsed time in milliseconds
+ */
+static double millisecondsSince(const LARGE_INTEGER& start) {
+    LARGE_INTEGER now;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)(now.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+}
+
+/**
+ * @brief Touches every page of a mapped region so it is faulted in
+ *
+ * Pages are only read, so this is safe on a region other processes are
+ * writing to.
+ *
+ * @param data The mapped region
+ * @param size The size of the region in bytes
+ * @param running Flag that abandons the walk when cleared, or NULL
+ * @return true if every page was touched, false if the walk was abandoned
+ */
+static bool touchPages(const void* data, SIZE_T size, volatile bool* running) {
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+
+    const volatile char* bytes = static_cast<const volatile char*>(data);
+    for (SIZE_T offset = 0; offset < size; offset += systemInfo.dwPageSize) {
+        if (running != NULL && !*running) {
+            return false;
+        }
+        (void)bytes[offset];
+    }
+    return true;
+}
+
+/**
+ * @brief Thread function that prefaults a region in the background
+ *
+ * @param arg The region's PrefaultJob
+ * @return Thread exit code (always 0)
+ */
+unsigned int __stdcall prefaultThreadFunc(void* arg) {
+    PrefaultJob* job = static_cast<PrefaultJob*>(arg);
+
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+    if (touchPages(job->data, job->size, &job->running)) {
+        job->elapsedMs = millisecondsSince(start);
+        job->complete = true;
+        std::cout << "[INIT] Prefaulted " << job->name << " in " << job->elapsedMs << " ms" << std::endl;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parses the name of a prefault mode
+ *
+ * @param text "none", "async", "sync" or "locked"
+ * @param mode Receives the parsed mode
+ * @return true if the name was recognised, false otherwise
+ */
+bool parseRegionPrefaultMode(const char* text, RegionPrefaultMode* mode) {
+    if (!text || !mode) {
+        return false;
+    }
+
+    if (strcmp(text, "none") == 0) {
+        *mode = REGION_PREFAULT_NONE;
+    } else if (strcmp(text, "async") == 0) {
+        *mode = REGION_PREFAULT_ASYNC;
+    } else if (strcmp(text, "sync") == 0) {
+        *mode = REGION_PREFAULT_SYNC;
+    } else if (strcmp(text, "locked") == 0) {
+        *mode = REGION_PREFAULT_LOCKED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Computes the layout hash stamped into a region's header
+ *
+ * Covers the MemoryLayout field offsets, the region size and the caller's
+ * layout ID, so a region is only re-attached by code that agrees on all three.
+ *
+ * @param size The size of the shared memory region in bytes
+ * @param layoutId Application layout identifier (RegionOptions::layoutId)
+ * @return The layout hash
+ */
+uint32_t computeRegionLayoutHash(size_t size, uint32_t layoutId) {
+    uint64_t values[] = {
+        sizeof(MemoryLayout),
+        offsetof(MemoryLayout, version),
+        offsetof(MemoryLayout, data),
+        offsetof(MemoryLayout, sequence),
+        offsetof(MemoryLayout, last_modified),
+        offsetof(MemoryLayout, dirty),
+        offsetof(MemoryLayout, magic),
+        offsetof(MemoryLayout, layoutHash),
+        static_cast<uint64_t>(size),
+        layoutId
+    };
+
+    // FNV-1a over the values
+    uint32_t hash = 2166136261u;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+    for (size_t i = 0; i < sizeof(values); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Returns the name of a region's segment of a given generation
+ *
+ * Generation 0 is the segment the region was created with; later ones are
+ * the larger segments it moved to when it was resized.
+ */
+static std::string segmentName(const char* name, uint32_t generation) {
+    if (generation == 0) {
+        return name;
+    }
+
+    char suffix[16];
+    sprintf(suffix, ".g%u", generation);
+    return std::string(name) + suffix;
+}
+
+/**
+ * @brief Remaps a region if its header names a newer segment
+ *
+ * Called with shared_memories_mutex held. The segment that is left is kept
+ * mapped until cleanup. A file-backed region whose newer segment no longer
+ * exists (after a restart) maps its file again at the newer size.
+ *
+ * @param info The region's entry in shared_memories
+ * @param name The name of the shared memory region
+ */
+static void followResizedSegment(SharedMemoryInfo& info, const char* name) {
+    while (info.size >= sizeof(MemoryLayout) && info.resize == NULL) {
+        const MemoryLayout* layout = static_cast<const MemoryLayout*>(info.data);
+        uint32_t generation = layout->generation;
+        SIZE_T size = static_cast<SIZE_T>(layout->segmentSize);
+        if (generation == info.generation || size <= info.size) {
+            return;
+        }
+
+        std::string segment = segmentName(name, generation);
+        HANDLE hMapFile = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, segment.c_str());
+        if (hMapFile == NULL && info.file != NULL) {
+            hMapFile = CreateFileBackedSharedMemory(segment.c_str(), info.file, size);
+        }
+        if (hMapFile == NULL) {
+            std::cerr << "[RESIZE] Could not open " << segment << ", staying on generation "
+                      << info.generation << std::endl;
+            return;
+        }
+
+        void* pBuf = MapSharedMemory(hMapFile, size);
+        if (pBuf == NULL) {
+            CloseSharedMemory(hMapFile);
+            return;
+        }
+
+        info.retired.push_back(RetiredSegment(info.handle, info.data));
+        info.handle = hMapFile;
+        info.data = pBuf;
+        info.size = size;
+        info.generation = generation;
+        std::cout << "[RESIZE] Following " << name << " to generation " << generation
+                  << " (" << size << " bytes)" << std::endl;
+    }
+}
+
+/**
+ * @brief Decides whether to keep the existing contents of a newly mapped region
+ *
+ * Contents are kept when the segment was still alive (held by another
+ * process) or the backing file already had data, and the header validates.
+ * Regions too small for a MemoryLayout header can't be validated, so only
+ * their backing files are trusted.
+ *
+ * @param name The name of the shared memory region
+ * @param pBuf The mapped region
+ * @param size The size of the region in bytes
+ * @param layoutId Application layout identifier
+ * @param live true if the segment already existed when it was created
+ * @param fromFile true if the backing file already had contents
+ * @return true if the contents were adopted, false if the region must be reset
+ */
+static bool adoptExistingContents(const char* name, void* pBuf, size_t size, uint32_t layoutId,
+                                  bool live, bool fromFile) {
+    if (!live && !fromFile) {
+        return false;
+    }
+
+    if (size < sizeof(MemoryLayout)) {
+        return fromFile && !live;
+    }
+
+    MemoryLayout* layout = static_cast<MemoryLayout*>(pBuf);
+    if (layout->magic != REGION_MAGIC || layout->layoutHash != computeRegionLayoutHash(size, layoutId)) {
+        std::cerr << "[INIT] Existing contents of " << name << " don't match this layout, resetting" << std::endl;
+        return false;
+    }
+
+    // The write sequence belongs to the processes attached to the segment;
+    // only when nobody is may a crash have left writers counted in it
+    if (!live) {
+        layout->sequence = 0;
+    }
+
+    std::cout << "[INIT] Re-attached to existing " << name << " at version " << layout->version << std::endl;
+    return true;
+}
+
+/**
+ * @brief Initializes a shared memory region with the given name, size and options
+ *
+ * Without a backing directory the region is backed by the paging file; with
+ * one, by its region file. Either way, existing contents (a segment another
+ * process still holds, or a backing file with data) are kept if their header
+ * validates, and the region starts zeroed otherwise. wasSharedMemoryRestored
+ * tells which happened.
+ *
+ * A new region is not written to, so its pages are only committed as they are
+ * first touched. options.prefault brings them in up front instead, either
+ * before returning or from a background thread; getSharedMemoryStartupStats
+ * reports how long that and the initialization took.
+ *
+ * @param name The name of the shared memory region (must be unique system-wide)
+ * @param size The size of the shared memory region in bytes
+ * @param options Creation options
+ * @return true if initialization was successful, false otherwise
+ */
+bool initializeSharedMemoryWithOptions(const char* name, size_t size, const RegionOptions& options) {
+    LARGE_INTEGER initStart;
+    QueryPerformanceCounter(&initStart);
+
     // Initialize the mutex if needed
     initSharedMemoryMutex();
 
@@ -376,10 +931,26 @@ bool initializeSharedMemory(const char* name, size_t size) {
         return true;
     }
 
+    // Open the backing file if the region is to persist
+    bool fileBacked = options.backingDirectory != NULL && options.backingDirectory[0] != '\0';
+    bool existed = false;
+    HANDLE hFile = NULL;
+    if (fileBacked) {
+        hFile = OpenRegionBackingFile(options.backingDirectory, name, &existed);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            unlockSharedMemoriesMutex();
+            return false;
+        }
+    }
+
     // Create the shared memory region using the low-level function
-    HANDLE hMapFile = CreateSharedMemory(name, size);
+    HANDLE hMapFile = fileBacked ? CreateFileBackedSharedMemory(name, hFile, size) : CreateSharedMemory(name, size);
+    bool live = (hMapFile != NULL && GetLastError() == ERROR_ALREADY_EXISTS);
     if (hMapFile == NULL) {
         // Creation failed, return false
+        if (hFile) {
+            CloseHandle(hFile);
+        }
         unlockSharedMemoriesMutex();
         return false;
     }
@@ -389,13 +960,75 @@ bool initializeSharedMemory(const char* name, size_t size) {
     if (pBuf == NULL) {
         // Mapping failed, clean up and return false
         CloseSharedMemory(hMapFile);
+        if (hFile) {
+            CloseHandle(hFile);
+        }
         unlockSharedMemoriesMutex();
         return false;
     }
 
-    // Initialize the memory to zeros
-    // This ensures that the memory starts in a known state
-    memset(pBuf, 0, size);
+    // Keep what another process or the backing file already holds, if it is ours
+    bool restored = adoptExistingContents(name, pBuf, size, options.layoutId, live, existed);
+    bool stamped = false;
+    if (!restored) {
+        // Clear stale contents so that the memory starts in a known state.
+        // A new section or backing file already reads as zeros, and writing
+        // them again would touch and commit every page up front.
+        if (existed || live) {
+            memset(pBuf, 0, size);
+        }
+
+        // Stamp the header so a later restart can re-attach
+        if (size >= sizeof(MemoryLayout)) {
+            MemoryLayout* layout = static_cast<MemoryLayout*>(pBuf);
+            layout->magic = REGION_MAGIC;
+            layout->layoutHash = computeRegionLayoutHash(size, options.layoutId);
+            layout->generation = 0;
+            layout->segmentSize = size;
+            stamped = true;
+        }
+    }
+
+    // Bring the pages in now if asked to, rather than on first touch
+    RegionStartupStats startup;
+    memset(&startup, 0, sizeof(startup));
+    startup.prefaultComplete = true;
+    if (options.prefault == REGION_PREFAULT_SYNC || options.prefault == REGION_PREFAULT_LOCKED) {
+        LARGE_INTEGER prefaultStart;
+        QueryPerformanceCounter(&prefaultStart);
+        touchPages(pBuf, size, NULL);
+        if (options.prefault == REGION_PREFAULT_LOCKED) {
+            startup.locked = VirtualLock(pBuf, size) != FALSE;
+            if (!startup.locked) {
+                std::cerr << "[INIT] Failed to lock " << name << " in memory (working set too small?): "
+                          << GetLastError() << std::endl;
+            }
+        }
+        startup.prefaultMs = millisecondsSince(prefaultStart);
+    }
+
+    HANDLE prefaultThread = NULL;
+    PrefaultJob* prefaultJob = NULL;
+    if (options.prefault == REGION_PREFAULT_ASYNC) {
+        prefaultJob = new PrefaultJob();
+        prefaultJob->name = name;
+        prefaultJob->data = pBuf;
+        prefaultJob->size = size;
+        prefaultJob->running = true;
+        prefaultJob->complete = false;
+        prefaultJob->elapsedMs = 0;
+
+        unsigned int threadId;
+        prefaultThread = (HANDLE)_beginthreadex(NULL, 0, prefaultThreadFunc, prefaultJob, 0, &threadId);
+        if (prefaultThread == NULL) {
+            // The pages are still faulted in on first touch
+            std::cerr << "Failed to create prefault thread for " << name << ": " << GetLastError() << std::endl;
+            delete prefaultJob;
+            prefaultJob = NULL;
+        } else {
+            startup.prefaultComplete = false;
+        }
+    }
 
     // Create a new SharedMemoryInfo object to track this shared memory region
     SharedMemoryInfo info;
@@ -405,14 +1038,515 @@ bool initializeSharedMemory(const char* name, size_t size) {
     info.monitor_thread = NULL;  // No monitoring thread yet
     info.monitoring = false;    // Not monitoring yet
     info.callback = NULL;       // No callback function yet
+    info.file = hFile;          // Backing file, if any
+    info.restored = restored;   // Contents came from a live segment or the backing file
+    info.prefault_thread = prefaultThread; // Background prefault, if any
+    info.prefault = prefaultJob;
+    info.startup = startup;
+    info.layoutId = options.layoutId;
+    if (fileBacked && stamped) {
+        info.dirtyRanges.push_back(FlushRange(0, sizeof(MemoryLayout)));
+    }
+
+    // Report how long the region took to become usable
+    info.startup.initMs = millisecondsSince(initStart);
+    std::cout << "[INIT] " << name << " (" << size << " bytes) ready in " << info.startup.initMs << " ms";
+    if (options.prefault == REGION_PREFAULT_SYNC || options.prefault == REGION_PREFAULT_LOCKED) {
+        std::cout << ", " << info.startup.prefaultMs << " ms of it prefaulting";
+    }
+    std::cout << std::endl;
 
     // Add the shared memory info to our map for future reference
-    shared_memories[name] = info;
+    SharedMemoryInfo& added = (shared_memories[name] = info);
+
+    // Existing contents may say the region has since moved to a larger segment
+    if (restored) {
+        followResizedSegment(added, name);
+    }
+
+    // Start writing changes back once there is a file-backed region
+    if (fileBacked) {
+        file_backed_regions++;
+        if (region_flush_thread == NULL) {
+            region_flush_running = true;
+            unsigned int threadId;
+            region_flush_thread = (HANDLE)_beginthreadex(NULL, 0, regionFlushThreadFunc, NULL, 0, &threadId);
+            if (region_flush_thread == NULL) {
+                std::cerr << "Failed to create region flush thread: " << GetLastError() << std::endl;
+                region_flush_running = false;
+            }
+        }
+    }
 
     unlockSharedMemoriesMutex();
     return true;
 }
 
+/**
+ * @brief Checks whether a region was attached to existing contents
+ *
+ * @param name The name of the shared memory region
+ * @return true if the region kept a live segment's or its backing file's
+ *         contents when it was initialized, false if it started zeroed
+ */
+bool wasSharedMemoryRestored(const char* name) {
+    initSharedMemoryMutex();
+    lockSharedMemoriesMutex();
+
+    bool restored = false;
+    std::map<std::string, SharedMemoryInfo>::iterator it = shared_memories.find(name);
+    if (it != shared_memories.end()) {
+        restored = it->second.restored;
+    }
+
+    unlockSharedMemoriesMutex();
+    return restored;
+}
+
+/**
+ * @brief Gets how long a region took to start up
+ *
+ * @param name The name of the shared memory region
+ * @param stats Receives the region's startup timings
+ * @return true if the region exists, false otherwise
+ */
+bool getSharedMemoryStartupStats(const char* name, RegionStartupStats* stats) {
+    if (!name || !stats) {
+        return false;
+    }
+
+    initSharedMemoryMutex();
+    lockSharedMemoriesMutex();
+
+    std::map<std::string, SharedMemoryInfo>::iterator it = shared_memories.find(name);
+    if (it == shared_memories.end()) {
+        unlockSharedMemoriesMutex();
+        return false;
+    }
+
+    *stats = it->second.startup;
+    PrefaultJob* job = it->second.prefault;
+    if (job != NULL && job->complete) {
+        stats->prefaultMs = job->elapsedMs;
+        stats->prefaultComplete = true;
+    }
+
+    unlockSharedMemoriesMutex();
+    return true;
+}
+
+/**
+ * @brief Adds a changed range to a list of pending ranges
+ *
+ * Ranges that extend the last one are merged into it, and past
+ * MAX_PENDING_FLUSH_RANGES the list collapses into the span of all of them.
+ */
+static void addPendingRange(std::vector<FlushRange>& ranges, size_t offset, size_t size) {
+    if (!ranges.empty() && offset >= ranges.back().first &&
+        offset <= ranges.back().first + ranges.back().second) {
+        // Extends the last range, the common case for sequential writes
+        size_t end = (std::max)(ranges.back().first + ranges.back().second, offset + size);
+        ranges.back().second = end - ranges.back().first;
+    } else if (ranges.size() >= MAX_PENDING_FLUSH_RANGES) {
+        // Too many ranges to track one by one; use their whole span
+        size_t start = offset;
+        size_t end = offset + size;
+        for (size_t i = 0; i < ranges.size(); i++) {
+            start = (std::min)(start, ranges[i].first);
+            end = (std::max)(end, ranges[i].first + ranges[i].second);
+        }
+        ranges.assign(1, FlushRange(start, end - start));
+    } else {
+        ranges.push_back(FlushRange(offset, size));
+    }
+}
+
+/**
+ * @brief Set or clear flags of a region's write sequence
+ */
+static void setSequenceFlags(void* region, LONG set, LONG clear) {
+    volatile LONG* sequence = reinterpret_cast<volatile LONG*>(&static_cast<MemoryLayout*>(region)->sequence);
+    for (;;) {
+        LONG current = *sequence;
+        if (InterlockedCompareExchange(sequence, (current | set) & ~clear, current) == current) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Map the section of pages changed during a resize of a region
+ *
+ * Called with shared_memories_mutex held.
+ *
+ * @param create true to create the section (for the resizing process)
+ * @return The table, or NULL if it can't be mapped
+ */
+static ResizeDirtyTable* attachResizeDirty(SharedMemoryInfo& info, const char* name, bool create) {
+    if (info.resizeDirty == NULL) {
+        std::string section = std::string(name) + ".resize";
+        HANDLE handle = create ? CreateSharedMemory(section.c_str(), sizeof(ResizeDirtyTable))
+                               : OpenSharedMemory(section.c_str());
+        void* view = handle ? MapSharedMemory(handle, sizeof(ResizeDirtyTable)) : NULL;
+        if (view == NULL) {
+            if (handle) {
+                CloseSharedMemory(handle);
+            }
+            std::cerr << "[RESIZE] Could not map " << section << std::endl;
+            return NULL;
+        }
+        info.resizeDirtyHandle = handle;
+        info.resizeDirty = static_cast<ResizeDirtyTable*>(view);
+    }
+    return info.resizeDirty;
+}
+
+/**
+ * @brief Set the bits of the pages a range covers in a resize's bitmap
+ */
+static void markResizeDirty(ResizeDirtyTable* table, size_t offset, size_t size) {
+    size_t last = (std::min)((offset + size - 1) / RESIZE_DIRTY_SIZE, static_cast<size_t>(RESIZE_DIRTY_BITS - 1));
+    for (size_t page = offset / RESIZE_DIRTY_SIZE; page <= last; page++) {
+        InterlockedOr64(&table->dirty[page / 64], static_cast<LONG64>(static_cast<uint64_t>(1) << (page % 64)));
+    }
+}
+
+/**
+ * @brief Records a changed range of a region
+ *
+ * For a file-backed region the range is written back to the region file by
+ * the flush thread. While a region is being resized, by this process or
+ * another, the range is also marked in the resize's shared bitmap and
+ * copied again into the larger segment before the switch. Call it after
+ * the change is made. Other calls are ignored.
+ *
+ * @param name The name of the shared memory region
+ * @param offset Offset of the changed range
+ * @param size Size of the changed range
+ */
+void markSharedMemoryRangeDirty(const char* name, size_t offset, size_t size) {
+    initSharedMemoryMutex();
+    lockSharedMemoriesMutex();
+
+    std::map<std::string, SharedMemoryInfo>::iterator it = shared_memories.find(name);
+    if (it != shared_memories.end() && size > 0 && offset < it->second.size) {
+        size = (std::min)(size, it->second.size - offset);
+        if (it->second.file != NULL) {
+            addPendingRange(it->second.dirtyRanges, offset, size);
+        }
+
+        // The change is made before the flag is read, and the copy starts after the flag is set
+        MemoryBarrier();
+        const MemoryLayout* layout = static_cast<const MemoryLayout*>(it->second.data);
+        if (it->second.size >= sizeof(MemoryLayout) && (layout->sequence & REGION_RESIZING)) {
+            ResizeDirtyTable* table = attachResizeDirty(it->second, name, false);
+            if (table != NULL) {
+                markResizeDirty(table, offset, size);
+            }
+        }
+    }
+
+    unlockSharedMemoriesMutex();
+}
+
+/**
+ * @brief Writes the changed ranges of a file-backed region back to its file now
+ *
+ * @param name The name of the shared memory region
+ * @return true if the ranges were written (or there was nothing to write), false otherwise
+ */
+bool flushSharedMemory(const char* name) {
+    initSharedMemoryMutex();
+    lockRegionFlushMutex();
+    lockSharedMemoriesMutex();
+
+    void* data = NULL;
+    HANDLE file = NULL;
+    std::vector<FlushRange> ranges;
+    std::map<std::string, SharedMemoryInfo>::iterator it = shared_memories.find(name);
+    if (it != shared_memories.end() && it->second.file != NULL) {
+        data = it->second.data;
+        file = it->second.file;
+        ranges.swap(it->second.dirtyRanges);
+    }
+    unlockSharedMemoriesMutex();
+
+    bool success = (data == NULL) || flushRanges(data, file, ranges);
+    unlockRegionFlushMutex();
+    return success;
+}
+
+/**
+ * @brief Switches a region to the larger segment a resize prepared
+ *
+ * Called with shared_memories_mutex held, once the current segment is
+ * retired: no write is in progress on it and none can start. Only the pages
+ * changed since the background copy are copied here, so writers wait no
+ * longer than that and the remap. The header of every earlier segment then
+ * names the new one, so processes still attached to them follow on their
+ * next getSharedMemory.
+ */
+static void switchToResizedSegment(SharedMemoryInfo& info, ResizeJob* job) {
+    char* target = static_cast<char*>(job->data);
+    const char* source = static_cast<const char*>(job->oldData);
+    ResizeDirtyTable* table = info.resizeDirty;
+    size_t words = (job->oldSize + 64 * RESIZE_DIRTY_SIZE - 1) / (64 * RESIZE_DIRTY_SIZE);
+    for (size_t word = 0; table != NULL && word < words && word < RESIZE_DIRTY_BITS / 64; word++) {
+        uint64_t bits = static_cast<uint64_t>(InterlockedExchange64(&table->dirty[word], 0));
+        for (size_t bit = 0; bits != 0 && !job->sameFile && bit < 64; bit++) {
+            if (bits & (static_cast<uint64_t>(1) << bit)) {
+                size_t offset = (word * 64 + bit) * RESIZE_DIRTY_SIZE;
+                memcpy(target + offset, source + offset, (std::min)(static_cast<size_t>(RESIZE_DIRTY_SIZE),
+                                                                    static_cast<size_t>(job->oldSize) - offset));
+            }
+        }
+    }
+    setSequenceFlags(job->oldData, 0, REGION_RESIZING);
+
+    MemoryLayout* layout = static_cast<MemoryLayout*>(job->data);
+    layout->sequence = static_cast<const MemoryLayout*>(job->oldData)->sequence & ~REGION_RETIRED;
+    layout->generation = job->generation;
+    layout->segmentSize = job->size;
+    MemoryBarrier();
+
+    info.retired.push_back(RetiredSegment(info.handle, info.data));
+    for (size_t i = 0; i < info.retired.size(); i++) {
+        MemoryLayout* retired = static_cast<MemoryLayout*>(info.retired[i].second);
+        retired->generation = job->generation;
+        retired->segmentSize = job->size;
+    }
+
+    info.handle = job->handle;
+    info.data = job->data;
+    info.size = job->size;
+    info.generation = job->generation;
+    job->complete = true;
+}
+
+/**
+ * @brief Thread function that moves a region to a larger segment
+ *
+ * Copies the current contents while writers carry on (what they change is
+ * marked through markSharedMemoryRangeDirty), then retires the current
+ * segment the moment no write is in progress on it, by setting
+ * REGION_RETIRED with the same compare-exchange writers count themselves
+ * with, and switches. Writers that come later find the flag and start on the
+ * new segment instead. If writes never pause for RESIZE_SWITCH_TIMEOUT_MS the
+ * resize is given up.
+ *
+ * @param arg The region's ResizeJob
+ * @return Thread exit code (always 0)
+ */
+unsigned int __stdcall resizeThreadFunc(void* arg) {
+    ResizeJob* job = static_cast<ResizeJob*>(arg);
+
+    if (!job->sameFile) {
+        for (SIZE_T offset = 0; offset < job->oldSize && job->running; offset += RESIZE_COPY_CHUNK) {
+            SIZE_T chunk = (std::min)(static_cast<SIZE_T>(RESIZE_COPY_CHUNK), job->oldSize - offset);
+            memcpy(static_cast<char*>(job->data) + offset, static_cast<const char*>(job->oldData) + offset, chunk);
+        }
+    }
+
+    volatile LONG* sequence = reinterpret_cast<volatile LONG*>(&static_cast<MemoryLayout*>(job->oldData)->sequence);
+    ULONGLONG deadline = GetTickCount64() + RESIZE_SWITCH_TIMEOUT_MS;
+    for (int attempt = 1; job->running; attempt++) {
+        LONG current = *sequence;
+        if ((current & REGION_WRITERS_MASK) == 0 &&
+            InterlockedCompareExchange(sequence, current | REGION_RETIRED, current) == current) {
+            lockSharedMemoriesMutex();
+            if (job->running) {
+                switchToResizedSegment(shared_memories[job->name], job);
+                unlockSharedMemoriesMutex();
+                std::cout << "[RESIZE] " << job->name << " moved to generation " << job->generation
+                          << " (" << job->size << " bytes)" << std::endl;
+                return 0;
+            }
+            setSequenceFlags(job->oldData, 0, REGION_RETIRED);
+            unlockSharedMemoriesMutex();
+            break;
+        }
+
+        if (GetTickCount64() >= deadline) {
+            std::cerr << "[RESIZE] Writes to " << job->name << " didn't pause for " << RESIZE_SWITCH_TIMEOUT_MS
+                      << " ms; giving up the resize" << std::endl;
+            break;
+        }
+
+        // Writers stay counted for one update; back off if they keep the segment busy
+        if (attempt > 100) {
+            Sleep(1);
+        } else {
+            YieldProcessor();
+        }
+    }
+
+    // Abandoned before the switch; nobody else has seen the new segment
+    setSequenceFlags(job->oldData, 0, REGION_RESIZING);
+    UnmapSharedMemory(job->data);
+    CloseSharedMemory(job->handle);
+    job->failed = true;
+    return 0;
+}
+
+/**
+ * @brief Waits for a region's resize to finish
+ *
+ * @param name The name of the shared memory region
+ * @param timeoutMs How long to wait at most (0 to only check)
+ * @return true if the region isn't being resized (any more), false on timeout
+ *         or if the resize was given up
+ */
+bool waitForSharedMemoryResize(const char* name, DWORD timeoutMs) {
+    if (!name) {
+        return false;
+    }
+
+    initSharedMemoryMutex();
+    ULONGLONG deadline = GetTickCount64() + timeoutMs;
+    for (;;) {
+        lockSharedMemoriesMutex();
+        std::map<std::string, SharedMemoryInfo>::iterator it = shared_memories.find(name);
+        if (it == shared_memories.end() || it->second.resize == NULL) {
+            unlockSharedMemoriesMutex();
+            return true;
+        }
+
+        if (it->second.resize->complete || it->second.resize->failed) {
+            // Reap the finished thread
+            HANDLE thread = it->second.resize_thread;
+            ResizeJob* job = it->second.resize;
+            it->second.resize_thread = NULL;
+            it->second.resize = NULL;
+            unlockSharedMemoriesMutex();
+
+            WaitForSingleObject(thread, INFINITE);
+            CloseHandle(thread);
+            bool complete = job->complete;
+            delete job;
+            return complete;
+        }
+        unlockSharedMemoriesMutex();
+
+        if (GetTickCount64() >= deadline) {
+            return false;
+        }
+        Sleep(1);
+    }
+}
+
+/**
+ * @brief Starts moving a region to a larger segment
+ *
+ * The larger segment is "<name>.g<generation>" (a second mapping of the same
+ * file for file-backed regions). The contents are copied into it in the
+ * background and the region switches to it between two updates; see
+ * waitForSharedMemoryResize. Pointers obtained from getSharedMemory before the
+ * switch keep pointing at the old segment, which stays mapped but is retired:
+ * beginRegionWrite refuses it, so writers fetch the pointer again for each
+ * update (beginNamedRegionWrite does so). Changes made by any process during
+ * the copy are marked in the shared section "<name>.resize" through
+ * markSharedMemoryRangeDirty. If writes never pause for
+ * RESIZE_SWITCH_TIMEOUT_MS the resize is given up.
+ *
+ * @param name The name of the shared memory region
+ * @param newSize The new size in bytes; regions only grow
+ * @return true if the resize was started (or the region already has that size), false otherwise
+ */
+bool resizeSharedMemory(const char* name, size_t newSize) {
+    if (!name) {
+        return false;
+    }
+
+    // Reap a previous resize that has finished
+    waitForSharedMemoryResize(name, 0);
+
+    initSharedMemoryMutex();
+    lockSharedMemoriesMutex();
+
+    std::map<std::string, SharedMemoryInfo>::iterator it = shared_memories.find(name);
+    if (it == shared_memories.end() || it->second.size < sizeof(MemoryLayout)) {
+        unlockSharedMemoriesMutex();
+        std::cerr << "[RESIZE] " << name << " is not a region that can be resized" << std::endl;
+        return false;
+    }
+
+    SharedMemoryInfo& info = it->second;
+    if (info.resize != NULL) {
+        unlockSharedMemoriesMutex();
+        std::cerr << "[RESIZE] " << name << " is already being resized" << std::endl;
+        return false;
+    }
+    if (newSize <= info.size) {
+        unlockSharedMemoriesMutex();
+        return newSize == info.size;
+    }
+
+    // Create and map the larger segment
+    const MemoryLayout* layout = static_cast<const MemoryLayout*>(info.data);
+    uint32_t generation = (std::max)(info.generation, layout->generation) + 1;
+    std::string segment = segmentName(name, generation);
+    HANDLE hMapFile = info.file != NULL ? CreateFileBackedSharedMemory(segment.c_str(), info.file, newSize)
+                                        : CreateSharedMemory(segment.c_str(), newSize);
+    if (hMapFile != NULL && GetLastError() == ERROR_ALREADY_EXISTS) {
+        std::cerr << "[RESIZE] Segment " << segment << " already exists" << std::endl;
+        CloseSharedMemory(hMapFile);
+        hMapFile = NULL;
+    }
+    void* pBuf = (hMapFile != NULL) ? MapSharedMemory(hMapFile, newSize) : NULL;
+    if (pBuf == NULL) {
+        if (hMapFile != NULL) {
+            CloseSharedMemory(hMapFile);
+        }
+        unlockSharedMemoriesMutex();
+        return false;
+    }
+
+    ResizeJob* job = new ResizeJob();
+    job->name = name;
+    job->handle = hMapFile;
+    job->data = pBuf;
+    job->size = newSize;
+    job->generation = generation;
+    job->oldData = info.data;
+    job->oldSize = info.size;
+    job->sameFile = (info.file != NULL);
+    job->running = true;
+    job->complete = false;
+    job->failed = false;
+
+    // Writers in every process mark what they change from here on, and the copy starts after that
+    ResizeDirtyTable* table = attachResizeDirty(info, name, true);
+    if (table == NULL) {
+        UnmapSharedMemory(pBuf);
+        CloseSharedMemory(hMapFile);
+        delete job;
+        unlockSharedMemoriesMutex();
+        return false;
+    }
+    memset(const_cast<LONG64*>(table->dirty), 0, sizeof(table->dirty));
+    setSequenceFlags(info.data, REGION_RESIZING, 0);
+
+    unsigned int threadId;
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, resizeThreadFunc, job, 0, &threadId);
+    if (thread == NULL) {
+        std::cerr << "Failed to create resize thread: " << GetLastError() << std::endl;
+        setSequenceFlags(info.data, 0, REGION_RESIZING);
+        UnmapSharedMemory(pBuf);
+        CloseSharedMemory(hMapFile);
+        delete job;
+        unlockSharedMemoriesMutex();
+        return false;
+    }
+
+    info.resize = job;
+    info.resize_thread = thread;
+    unlockSharedMemoriesMutex();
+
+    std::cout << "[RESIZE] Moving " << name << " to " << segment << " (" << job->oldSize << " -> "
+              << newSize << " bytes)" << std::endl;
+    return true;
+}
+
 /**
  * @brief Gets a pointer to a shared memory region
  *
@@ -428,6 +1562,25 @@ bool initializeSharedMemory(const char* name, size_t size) {
  * @return Pointer to the shared memory region, or nullptr if it doesn't exist or can't be opened
  */
 void* getSharedMemory(const char* name) {
+    return getSharedMemoryMapping(name, NULL);
+}
+
+/**
+ * @brief Gets a pointer to a shared memory region together with its size
+ *
+ * Like getSharedMemory, but the size is that of the same mapping. Use this
+ * rather than getSharedMemory and getSharedMemorySize when the size bounds
+ * accesses through the pointer: a resize can switch the region between the
+ * two calls.
+ *
+ * If the region has moved to a larger segment (see resizeSharedMemory), the
+ * newer segment is mapped first.
+ *
+ * @param name The name of the shared memory region to access
+ * @param size Receives the size of the mapping in bytes (may be NULL)
+ * @return Pointer to the shared memory region, or nullptr if it doesn't exist or can't be opened
+ */
+void* getSharedMemoryMapping(const char* name, size_t* size) {
     // Initialize the mutex if needed
     initSharedMemoryMutex();
 
@@ -438,7 +1591,11 @@ void* getSharedMemory(const char* name) {
     std::map<std::string, SharedMemoryInfo>::iterator it = shared_memories.find(name);
     if (it != shared_memories.end()) {
         // We already have it, return the pointer to the mapped memory
+        followResizedSegment(it->second, name);
         void* result = it->second.data;
+        if (size) {
+            *size = it->second.size;
+        }
         unlockSharedMemoriesMutex();
         return result;
     }
@@ -451,12 +1608,8 @@ void* getSharedMemory(const char* name) {
         return NULL;
     }
 
-    // We don't know the exact size of the shared memory region when opening it,
-    // so we'll use a reasonable default based on our expected structure
-    SIZE_T size = sizeof(MemoryLayout);
-
-    // Map the shared memory into our address space
-    void* pBuf = MapSharedMemory(hMapFile, size);
+    // Map the whole section (size 0); its size isn't known when opening it
+    void* pBuf = MapSharedMemory(hMapFile, 0);
     if (pBuf == NULL) {
         // Mapping failed, clean up and return NULL
         CloseSharedMemory(hMapFile);
@@ -464,22 +1617,61 @@ void* getSharedMemory(const char* name) {
         return NULL;
     }
 
+    // The view covers the section rounded up to whole pages
+    MEMORY_BASIC_INFORMATION mbi;
+    SIZE_T mappedSize = sizeof(MemoryLayout);
+    if (VirtualQuery(pBuf, &mbi, sizeof(mbi)) == sizeof(mbi)) {
+        mappedSize = mbi.RegionSize;
+    }
+
     // Create a new SharedMemoryInfo object to track this shared memory region
     SharedMemoryInfo info;
     info.handle = hMapFile;      // Windows handle to the file mapping object
     info.data = pBuf;           // Pointer to the mapped memory
-    info.size = size;           // Size of the shared memory region
+    info.size = mappedSize;     // Size of the shared memory region
     info.monitor_thread = NULL;  // No monitoring thread yet
     info.monitoring = false;    // Not monitoring yet
     info.callback = NULL;       // No callback function yet
 
     // Add the shared memory info to our map for future reference
-    shared_memories[name] = info;
+    SharedMemoryInfo& added = (shared_memories[name] = info);
+    followResizedSegment(added, name);
+    pBuf = added.data;
+    if (size) {
+        *size = added.size;
+    }
 
     unlockSharedMemoriesMutex();
     return pBuf;
 }
 
+/**
+ * @brief Gets the mapped size of a shared memory region
+ *
+ * This function returns the number of bytes of the region that are mapped into
+ * this process, which is the limit for any offset/size pair used on it.
+ * Callers that also need the pointer should use getSharedMemoryMapping.
+ *
+ * @param name The name of the shared memory region
+ * @return Size of the mapped region in bytes, or 0 if the region isn't mapped
+ */
+size_t getSharedMemorySize(const char* name) {
+    // Initialize the mutex if needed
+    initSharedMemoryMutex();
+
+    // Lock the shared_memories map to ensure thread safety
+    lockSharedMemoriesMutex();
+
+    size_t size = 0;
+    std::map<std::string, SharedMemoryInfo>::iterator it = shared_memories.find(name);
+    if (it != shared_memories.end()) {
+        size = it->second.size;
+    }
+
+    unlockSharedMemoriesMutex();
+    return size;
+}
+
 /**
  * @brief Cleans up a shared memory region
  *
@@ -500,16 +1692,53 @@ bool cleanupSharedMemory(const char* name) {
     }
 
     bool success = true;
+    HANDLE stoppedFlushThread = NULL;
 
     // Initialize the mutex if needed
     initSharedMemoryMutex();
 
+    // Stop a resize first; its thread takes shared_memories_mutex to switch
+    lockSharedMemoriesMutex();
+    HANDLE stoppedResizeThread = NULL;
+    ResizeJob* stoppedResize = NULL;
+    std::map<std::string, SharedMemoryInfo>::iterator resizing = shared_memories.find(name);
+    if (resizing != shared_memories.end() && resizing->second.resize != NULL) {
+        stoppedResize = resizing->second.resize;
+        stoppedResizeThread = resizing->second.resize_thread;
+        stoppedResize->running = false;
+        resizing->second.resize = NULL;
+        resizing->second.resize_thread = NULL;
+    }
+    unlockSharedMemoriesMutex();
+    if (stoppedResizeThread != NULL) {
+        WaitForSingleObject(stoppedResizeThread, INFINITE);
+        CloseHandle(stoppedResizeThread);
+        delete stoppedResize;
+    }
+
+    // Keep the flush thread off the region while it is unmapped
+    lockRegionFlushMutex();
+
     // Lock the shared_memories map to ensure thread safety
     lockSharedMemoriesMutex();
 
     // Find the shared memory region in our map
     std::map<std::string, SharedMemoryInfo>::iterator it = shared_memories.find(name);
     if (it != shared_memories.end()) {
+        // Write back what the flush thread hasn't yet and close the backing file
+        if (it->second.file != NULL) {
+            if (!flushRanges(it->second.data, it->second.file, it->second.dirtyRanges)) {
+                success = false;
+            }
+
+            file_backed_regions--;
+            if (file_backed_regions == 0 && region_flush_thread != NULL) {
+                region_flush_running = false;
+                stoppedFlushThread = region_flush_thread;
+                region_flush_thread = NULL;
+            }
+        }
+
         // Stop monitoring thread if it's active
         if (it->second.monitoring && it->second.monitor_thread) {
             // Signal the thread to stop by setting monitoring to false
@@ -523,6 +1752,16 @@ bool cleanupSharedMemory(const char* name) {
             it->second.monitor_thread = NULL;
         }
 
+        // Abandon a prefault still running over the region
+        if (it->second.prefault_thread != NULL) {
+            it->second.prefault->running = false;
+            WaitForSingleObject(it->second.prefault_thread, INFINITE);
+            CloseHandle(it->second.prefault_thread);
+            it->second.prefault_thread = NULL;
+        }
+        delete it->second.prefault;
+        it->second.prefault = NULL;
+
         // Unmap the shared memory from our address space
         if (!UnmapSharedMemory(it->second.data)) {
             success = false;
@@ -537,15 +1776,61 @@ bool cleanupSharedMemory(const char* name) {
         }
         it->second.handle = NULL; // Prevent double-close
 
+        if (it->second.resizeDirty != NULL) {
+            UnmapSharedMemory(it->second.resizeDirty);
+            CloseSharedMemory(it->second.resizeDirtyHandle);
+        }
+
+        // Release the generations the region moved away from
+        for (size_t i = 0; i < it->second.retired.size(); i++) {
+            UnmapSharedMemory(it->second.retired[i].second);
+            CloseSharedMemory(it->second.retired[i].first);
+        }
+        it->second.retired.clear();
+
+        // Close the backing file after the mapping that uses it
+        if (it->second.file != NULL) {
+            CloseHandle(it->second.file);
+            it->second.file = NULL;
+        }
+
         // Remove the shared memory info from our map
         shared_memories.erase(it);
     }
     // If the shared memory region isn't in our map, there's nothing to clean up
 
     unlockSharedMemoriesMutex();
+    unlockRegionFlushMutex();
+
+    // The flush thread waits on the flush mutex, so it is joined after releasing it
+    if (stoppedFlushThread != NULL) {
+        WaitForSingleObject(stoppedFlushThread, INFINITE);
+        CloseHandle(stoppedFlushThread);
+    }
     return success;
 }
 
+/**
+ * @brief Check whether a process is still running
+ *
+ * Lock words kept in shared memory hold the ID of the process that took
+ * them, and are reclaimed when this says the process has gone. A process
+ * that exists but can't be queried counts as running.
+ *
+ * @param processId The process ID
+ * @return true if the process exists and hasn't exited
+ */
+bool isProcessRunning(DWORD processId) {
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (process == NULL) {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    DWORD exitCode = 0;
+    BOOL queried = GetExitCodeProcess(process, &exitCode);
+    CloseHandle(process);
+    return !queried || exitCode == STILL_ACTIVE;
+}
+
 /**
  * @brief Checks if a shared memory region has changed since a given version
  *
@@ -605,6 +1890,9 @@ unsigned int __stdcall monitorThreadFunc(void* arg) {
     std::string name = data->name;
     delete data;  // Free the thread data
 
+    // Run the callback on the node holding the region
+    placeCurrentThread(THREAD_ROLE_NOTIFIER, name.c_str());
+
     // Cast the memory pointer to our expected structure type
     MemoryLayout* layout = static_cast<MemoryLayout*>(info->data);
 
@@ -613,6 +1901,9 @@ unsigned int __stdcall monitorThreadFunc(void* arg) {
 
     // Continue monitoring until the monitoring flag is set to false
     while (info->monitoring) {
+        // A resize moves the region to another segment
+        layout = static_cast<MemoryLayout*>(info->data);
+
         // Check if the version has increased since we last checked
         if (layout->version > lastVersion) {
             // Version has increased, memory has changed
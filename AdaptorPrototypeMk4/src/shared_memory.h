@@ -1,14 +1,51 @@
 #ifndef SHARED_MEMORY_H
 #define SHARED_MEMORY_H
 
-#include <Windows.h>
+#include <windows.h>
 #include <string>
 #include <map>
 #include <stdint.h>
 
+/**
+ * @brief How a region's pages are brought into memory when it is initialized
+ */
+enum RegionPrefaultMode {
+    REGION_PREFAULT_NONE,       // Pages are committed lazily, on first touch
+    REGION_PREFAULT_ASYNC,      // A background thread touches every page after initialization
+    REGION_PREFAULT_SYNC,       // Every page is touched before initialization returns
+    REGION_PREFAULT_LOCKED      // As REGION_PREFAULT_SYNC, and the pages are locked in memory
+};
+
+/**
+ * @brief Options for creating a shared memory region
+ */
+struct RegionOptions {
+    const char* backingDirectory;   // Directory of the region's backing file; NULL or "" for the paging file
+    uint32_t layoutId;              // Application layout identifier; existing contents are only kept if it matches
+    RegionPrefaultMode prefault;    // How the region's pages are brought in (lazily by default)
+
+    RegionOptions() : backingDirectory(NULL), layoutId(0), prefault(REGION_PREFAULT_NONE) {}
+};
+
+/**
+ * @brief Startup timings of a shared memory region
+ */
+struct RegionStartupStats {
+    double initMs;                  // Time spent initializing the region
+    double prefaultMs;              // Time spent touching its pages (valid once prefaultComplete is set)
+    bool prefaultComplete;          // false while an asynchronous prefault is still running
+    bool locked;                    // true if the region's pages are locked in memory
+};
+
 // Function to create shared memory
 HANDLE CreateSharedMemory(const char* name, SIZE_T size);
 
+// Function to create shared memory backed by an open file
+HANDLE CreateFileBackedSharedMemory(const char* name, HANDLE hFile, SIZE_T size);
+
+// Function to open or create the backing file of a region
+HANDLE OpenRegionBackingFile(const char* directory, const char* name, bool* existed);
+
 // Function to open existing shared memory
 HANDLE OpenSharedMemory(const char* name);
 
@@ -27,15 +64,51 @@ void MonitorSharedMemory(HANDLE hMapFile, void (*callback)(void*));
 // Initialize shared memory with given name and size
 bool initializeSharedMemory(const char* name, size_t size);
 
+// Initialize shared memory with given name, size and options
+bool initializeSharedMemoryWithOptions(const char* name, size_t size, const RegionOptions& options);
+
+// Check if a region was attached to existing contents (a live segment or a backing file) instead of starting zeroed
+bool wasSharedMemoryRestored(const char* name);
+
+// Get how long a region took to start up
+bool getSharedMemoryStartupStats(const char* name, RegionStartupStats* stats);
+
+// Parse a prefault mode name ("none", "async", "sync" or "locked")
+bool parseRegionPrefaultMode(const char* text, RegionPrefaultMode* mode);
+
+// Start moving a region to a larger segment; it switches over in the background
+bool resizeSharedMemory(const char* name, size_t newSize);
+
+// Wait for a region's resize to finish (timeout 0 only checks); false if it timed out or was given up
+bool waitForSharedMemoryResize(const char* name, DWORD timeoutMs);
+
+// Compute the layout hash stamped into a region's MemoryLayout header
+uint32_t computeRegionLayoutHash(size_t size, uint32_t layoutId);
+
+// Record a changed range of a region so it is written back to its file (and kept across a resize, from any process)
+void markSharedMemoryRangeDirty(const char* name, size_t offset, size_t size);
+
+// Write the recorded changed ranges of a file-backed region back to its file now
+bool flushSharedMemory(const char* name);
+
 // Get a pointer to the shared memory region
 void* getSharedMemory(const char* name);
 
+// Get a pointer to the shared memory region and the size of that same mapping
+void* getSharedMemoryMapping(const char* name, size_t* size);
+
+// Get the mapped size of a shared memory region (0 if unknown)
+size_t getSharedMemorySize(const char* name);
+
 // Clean up shared memory resources
 bool cleanupSharedMemory(const char* name);
 
 // Check if memory has changed since last check
 bool hasMemoryChanged(const char* name, uint64_t last_known_version);
 
+// Check whether a process that shares a region (e.g. the owner of a lock word in it) is still running
+bool isProcessRunning(DWORD processId);
+
 // Register a callback for when memory changes
 typedef void (*MemoryChangeCallback)(void* memory_ptr);
 bool registerMemoryChangeCallback(const char* name, MemoryChangeCallback callback);
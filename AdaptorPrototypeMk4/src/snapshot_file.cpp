@@ -0,0 +1,339 @@
+/**
+ * @file snapshot_file.cpp
+ * @brief Implementation of snapshot export files
+ *
+ * The writer knows every region's size from the cut, so the header, region
+ * table and index have a fixed size. It seeks past them, streams the blocks
+ * and writes the metadata last. Readers validate every offset and size once
+ * at open, so decoding a block afterwards never leaves the mapping.
+ */
+
+#include "snapshot_file.h"
+#include "block_codec.h"
+#include "block_hash.h"
+#include "shared_memory.h"
+#include "memory_layout.h"
+#include "change_tracking.h"
+#include "sync_message.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <string.h>
+
+/**
+ * @brief State of writeSnapshotFile's sink
+ */
+struct SnapshotFileWriter {
+    HANDLE file;                                // File being written
+    bool ok;                                    // false once a write failed
+    bool compress;                              // Compress blocks that get smaller
+    uint64_t position;                          // File offset of the next block
+    int region;                                 // Region table entry being streamed
+    std::vector<SnapshotFileRegion> regions;    // Region table
+    std::vector<SnapshotBlockEntry> blocks;     // Block index
+    std::vector<char> buffer;                   // Compression output
+};
+
+static bool writeAll(HANDLE file, const void* data, size_t size) {
+    DWORD written = 0;
+    return WriteFile(file, data, static_cast<DWORD>(size), &written, NULL) && written == size;
+}
+
+static bool seekTo(HANDLE file, uint64_t position) {
+    LARGE_INTEGER distance;
+    distance.QuadPart = static_cast<LONGLONG>(position);
+    return SetFilePointerEx(file, distance, NULL, FILE_BEGIN) != 0;
+}
+
+/**
+ * @brief Hash the region table and block index, which follow each other in the file
+ */
+static uint64_t metadataChecksum(const char* tables, size_t size) {
+    return strongBlockHash(tables, size);
+}
+
+static bool fileSink(const char* memoryName, uint64_t version, size_t regionSize,
+                     size_t offset, const void* data, size_t size, void* context) {
+    (void)memoryName;
+    (void)version;
+    (void)regionSize;
+    SnapshotFileWriter* writer = static_cast<SnapshotFileWriter*>(context);
+    if (offset == 0) {
+        writer->region++;
+    }
+
+    const SnapshotFileRegion& region = writer->regions[writer->region];
+    SnapshotBlockEntry& entry = writer->blocks[static_cast<size_t>(region.firstBlock + offset / SNAPSHOT_CHUNK_SIZE)];
+    entry.offset = writer->position;
+    entry.rawSize = static_cast<uint32_t>(size);
+    entry.flags = 0;
+    entry.reserved = 0;
+    entry.checksum = strongBlockHash(static_cast<const char*>(data), size);
+
+    const void* stored = data;
+    entry.storedSize = static_cast<uint32_t>(size);
+    if (writer->compress) {
+        size_t compressed = compressBlock(static_cast<const char*>(data), size, &writer->buffer[0], size - 1);
+        if (compressed > 0) {
+            stored = &writer->buffer[0];
+            entry.storedSize = static_cast<uint32_t>(compressed);
+            entry.flags = SNAPSHOT_BLOCK_COMPRESSED;
+        }
+    }
+
+    writer->ok = writeAll(writer->file, stored, entry.storedSize);
+    writer->position += entry.storedSize;
+    return writer->ok;
+}
+
+bool writeSnapshotFile(const SnapshotCut& cut, const char* path, bool compress) {
+    SnapshotFileWriter writer;
+    writer.ok = true;
+    writer.compress = compress;
+    writer.region = -1;
+    writer.buffer.resize(SNAPSHOT_CHUNK_SIZE);
+
+    // The tables have a fixed size, so the blocks can be streamed straight after them
+    uint64_t blockCount = 0;
+    writer.regions.resize(cut.regions.size());
+    for (size_t i = 0; i < cut.regions.size(); i++) {
+        SnapshotFileRegion& region = writer.regions[i];
+        memset(&region, 0, sizeof(region));
+        strncpy(region.memoryName, cut.regions[i].memoryName.c_str(), sizeof(region.memoryName) - 1);
+        region.version = cut.regions[i].version;
+        region.size = cut.regions[i].size;
+        region.firstBlock = blockCount;
+        region.blockCount = (cut.regions[i].size + SNAPSHOT_CHUNK_SIZE - 1) / SNAPSHOT_CHUNK_SIZE;
+        blockCount += region.blockCount;
+    }
+    writer.blocks.resize(static_cast<size_t>(blockCount));
+
+    SnapshotFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_FILE_MAGIC;
+    header.blockSize = SNAPSHOT_CHUNK_SIZE;
+    header.regionCount = static_cast<uint32_t>(cut.regions.size());
+    header.blockCount = blockCount;
+    header.regionsOffset = sizeof(header);
+    header.indexOffset = header.regionsOffset + writer.regions.size() * sizeof(SnapshotFileRegion);
+    writer.position = header.indexOffset + writer.blocks.size() * sizeof(SnapshotBlockEntry);
+
+    // Written next to the target and renamed, so a reader never sees half a snapshot
+    std::string temporary = std::string(path) + ".tmp";
+    writer.file = CreateFileA(temporary.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (writer.file == INVALID_HANDLE_VALUE) {
+        std::cerr << "[SNAPSHOT] Failed to create " << temporary << ": " << GetLastError() << std::endl;
+        return false;
+    }
+
+    bool ok = seekTo(writer.file, writer.position) && streamSnapshot(cut, fileSink, &writer);
+    if (ok) {
+        header.fileSize = writer.position;
+        size_t regionsSize = writer.regions.size() * sizeof(SnapshotFileRegion);
+        std::vector<char> tables(regionsSize + writer.blocks.size() * sizeof(SnapshotBlockEntry));
+        if (!writer.regions.empty()) {
+            memcpy(&tables[0], &writer.regions[0], regionsSize);
+        }
+        if (!writer.blocks.empty()) {
+            memcpy(&tables[regionsSize], &writer.blocks[0], writer.blocks.size() * sizeof(SnapshotBlockEntry));
+        }
+        header.checksum = tables.empty() ? metadataChecksum(NULL, 0) : metadataChecksum(&tables[0], tables.size());
+
+        ok = seekTo(writer.file, 0) && writeAll(writer.file, &header, sizeof(header)) &&
+             (tables.empty() || writeAll(writer.file, &tables[0], tables.size())) &&
+             FlushFileBuffers(writer.file);
+    }
+    CloseHandle(writer.file);
+
+    if (ok) {
+        ok = MoveFileExA(temporary.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+    }
+    if (!ok) {
+        std::cerr << "[SNAPSHOT] Failed to write " << path << ": " << GetLastError() << std::endl;
+        DeleteFileA(temporary.c_str());
+        return false;
+    }
+    std::cout << "[SNAPSHOT] Wrote " << cut.regions.size() << " regions to " << path
+              << " (" << header.fileSize << " bytes)" << std::endl;
+    return true;
+}
+
+/**
+ * @brief Check that every table, block and region of a mapped file lies within it
+ */
+static bool validateSnapshotFile(const char* view, uint64_t fileSize) {
+    if (fileSize < sizeof(SnapshotFileHeader)) {
+        return false;
+    }
+    const SnapshotFileHeader* header = reinterpret_cast<const SnapshotFileHeader*>(view);
+    if (header->magic != SNAPSHOT_FILE_MAGIC || header->fileSize != fileSize ||
+        header->blockSize == 0 || header->blockSize > SNAPSHOT_MAX_BLOCK_SIZE ||
+        header->regionsOffset != sizeof(SnapshotFileHeader) ||
+        header->indexOffset != header->regionsOffset + header->regionCount * sizeof(SnapshotFileRegion) ||
+        header->blockCount > (fileSize - header->indexOffset) / sizeof(SnapshotBlockEntry) ||
+        header->indexOffset > fileSize) {
+        return false;
+    }
+
+    size_t tablesSize = static_cast<size_t>(header->indexOffset - header->regionsOffset +
+                                            header->blockCount * sizeof(SnapshotBlockEntry));
+    if (metadataChecksum(view + header->regionsOffset, tablesSize) != header->checksum) {
+        return false;
+    }
+
+    const SnapshotFileRegion* regions = reinterpret_cast<const SnapshotFileRegion*>(view + header->regionsOffset);
+    for (uint32_t i = 0; i < header->regionCount; i++) {
+        if (regions[i].firstBlock > header->blockCount ||
+            regions[i].blockCount > header->blockCount - regions[i].firstBlock ||
+            regions[i].blockCount != (regions[i].size + header->blockSize - 1) / header->blockSize) {
+            return false;
+        }
+    }
+
+    const SnapshotBlockEntry* blocks = reinterpret_cast<const SnapshotBlockEntry*>(view + header->indexOffset);
+    for (uint64_t i = 0; i < header->blockCount; i++) {
+        if (blocks[i].offset > fileSize || blocks[i].storedSize > fileSize - blocks[i].offset ||
+            blocks[i].rawSize > header->blockSize ||
+            (!(blocks[i].flags & SNAPSHOT_BLOCK_COMPRESSED) && blocks[i].storedSize != blocks[i].rawSize)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool openSnapshotFile(const char* path, SnapshotFile* snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (snapshot->file == INVALID_HANDLE_VALUE) {
+        std::cerr << "[SNAPSHOT] Failed to open " << path << ": " << GetLastError() << std::endl;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(snapshot->file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(SnapshotFileHeader))) {
+        std::cerr << "[SNAPSHOT] " << path << " is not a snapshot file" << std::endl;
+        CloseHandle(snapshot->file);
+        snapshot->file = INVALID_HANDLE_VALUE;
+        return false;
+    }
+
+    snapshot->mapping = CreateFileMappingA(snapshot->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (snapshot->mapping != NULL) {
+        snapshot->view = static_cast<const char*>(MapViewOfFile(snapshot->mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (!snapshot->view || !validateSnapshotFile(snapshot->view, static_cast<uint64_t>(fileSize.QuadPart))) {
+        std::cerr << "[SNAPSHOT] " << path << " is not a valid snapshot file" << std::endl;
+        closeSnapshotFile(snapshot);
+        return false;
+    }
+
+    snapshot->header = reinterpret_cast<const SnapshotFileHeader*>(snapshot->view);
+    snapshot->regions = reinterpret_cast<const SnapshotFileRegion*>(snapshot->view + snapshot->header->regionsOffset);
+    snapshot->blocks = reinterpret_cast<const SnapshotBlockEntry*>(snapshot->view + snapshot->header->indexOffset);
+    return true;
+}
+
+void closeSnapshotFile(SnapshotFile* snapshot) {
+    if (snapshot->view) {
+        UnmapViewOfFile(snapshot->view);
+    }
+    if (snapshot->mapping) {
+        CloseHandle(snapshot->mapping);
+    }
+    if (snapshot->file && snapshot->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(snapshot->file);
+    }
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+int findSnapshotRegion(const SnapshotFile* snapshot, const char* memoryName) {
+    for (uint32_t i = 0; i < snapshot->header->regionCount; i++) {
+        if (strncmp(snapshot->regions[i].memoryName, memoryName, sizeof(snapshot->regions[i].memoryName)) == 0) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+size_t readSnapshotBlock(const SnapshotFile* snapshot, uint64_t block, char* dst) {
+    const size_t failed = static_cast<size_t>(-1);
+    if (block >= snapshot->header->blockCount) {
+        return failed;
+    }
+
+    const SnapshotBlockEntry& entry = snapshot->blocks[block];
+    const char* stored = snapshot->view + entry.offset;
+    if (entry.flags & SNAPSHOT_BLOCK_COMPRESSED) {
+        if (decompressBlock(stored, entry.storedSize, dst, snapshot->header->blockSize) != entry.rawSize) {
+            return failed;
+        }
+    } else {
+        memcpy(dst, stored, entry.rawSize);
+    }
+    return (strongBlockHash(dst, entry.rawSize) == entry.checksum) ? entry.rawSize : failed;
+}
+
+bool seedRegionFromSnapshot(const char* path, const char* memoryName) {
+    SnapshotFile snapshot;
+    if (!openSnapshotFile(path, &snapshot)) {
+        return false;
+    }
+    int index = findSnapshotRegion(&snapshot, memoryName);
+    size_t localSize = 0;
+    const MemoryLayout* layout = static_cast<const MemoryLayout*>(getSharedMemoryMapping(memoryName, &localSize));
+    if (index < 0 || !layout || localSize < sizeof(MemoryLayout)) {
+        closeSnapshotFile(&snapshot);
+        return false;
+    }
+
+    const SnapshotFileRegion& region = snapshot.regions[index];
+    if (layout->version >= region.version) {
+        std::cout << "[SNAPSHOT] " << memoryName << " is already at version " << layout->version
+                  << ", not seeding from " << path << std::endl;
+        closeSnapshotFile(&snapshot);
+        return false;
+    }
+    size_t size = (region.size < localSize) ? static_cast<size_t>(region.size) : localSize;
+    if (size < region.size) {
+        std::cerr << "[SNAPSHOT] " << memoryName << " is smaller than in " << path
+                  << "; seeding its first " << size << " bytes" << std::endl;
+    }
+
+    SyncMessage message;
+    memset(&message, 0, sizeof(message));
+    message.msgType = MSG_SINGLE_UPDATE;
+    strncpy(message.memoryName, memoryName, sizeof(message.memoryName) - 1);
+    message.version = region.version;
+
+    // Last block first, so the final part applied is the header and claims the version
+    std::vector<char> block(snapshot.header->blockSize);
+    bool ok = true;
+    size_t blocks = (size + snapshot.header->blockSize - 1) / snapshot.header->blockSize;
+    for (size_t i = blocks; i-- > 0 && ok;) {
+        size_t start = i * snapshot.header->blockSize;
+        size_t end = (size - start > snapshot.header->blockSize) ? start + snapshot.header->blockSize : size;
+        if (readSnapshotBlock(&snapshot, region.firstBlock + i, &block[0]) == static_cast<size_t>(-1)) {
+            std::cerr << "[SNAPSHOT] Block " << i << " of " << memoryName << " in " << path << " is corrupt" << std::endl;
+            ok = false;
+            break;
+        }
+
+        size_t chunks = (end - start + MAX_SYNC_DATA_SIZE - 1) / MAX_SYNC_DATA_SIZE;
+        for (size_t chunk = chunks; chunk-- > 0;) {
+            message.offset = start + chunk * MAX_SYNC_DATA_SIZE;
+            message.size = (end - message.offset > MAX_SYNC_DATA_SIZE) ? MAX_SYNC_DATA_SIZE : end - message.offset;
+            message.updateId = generateUniqueId();
+            message.timestamp = GetTickCount();
+            message.flags = (message.offset == 0) ? 0 : SYNC_FLAG_MORE_IN_VERSION;
+            memcpy(message.data, &block[message.offset - start], message.size);
+            applyUpdate(message);
+        }
+    }
+    closeSnapshotFile(&snapshot);
+
+    if (ok) {
+        std::cout << "[SNAPSHOT] Seeded " << memoryName << " from " << path << " at version "
+                  << message.version << std::endl;
+    }
+    return ok;
+}
@@ -0,0 +1,149 @@
+#ifndef SNAPSHOT_FILE_H
+#define SNAPSHOT_FILE_H
+
+#include <winsock2.h>
+#include <windows.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "region_snapshot.h"
+
+/**
+ * @brief Snapshot export files
+ *
+ * A snapshot file holds a cut of one or more regions, in this order:
+ *  - a SnapshotFileHeader,
+ *  - one SnapshotFileRegion per region,
+ *  - the block index, with one SnapshotBlockEntry per block of every region,
+ *  - the blocks themselves.
+ *
+ * Regions are divided into SNAPSHOT_CHUNK_SIZE blocks. Each block is stored
+ * either compressed in the LZ4 block format (see block_codec.h) or raw, when
+ * compression doesn't make it smaller. Every index entry carries the hash of
+ * the uncompressed block. The header carries a hash of the region table and
+ * the index, and its own fields are checked against the file's size.
+ *
+ * Everything is at a fixed place once the file is mapped, so a reader maps
+ * the file, checks the header once and then decodes any block on its own.
+ * Nothing else needs to be read or decompressed. Hashes are 64-bit FNV-1a
+ * (strongBlockHash).
+ *
+ * The same file seeds the copies of a new node. Its replicas are filled from
+ * a local file, and the network only has to carry what changed since.
+ */
+
+#define SNAPSHOT_FILE_MAGIC 0x32504E53u       // "SNP2"
+#define SNAPSHOT_BLOCK_COMPRESSED 0x1u        // Block is stored in the LZ4 block format
+#define SNAPSHOT_MAX_BLOCK_SIZE (16 * 1024 * 1024)
+
+/**
+ * @brief Header at the start of a snapshot file
+ */
+typedef struct {
+    uint32_t magic;             // SNAPSHOT_FILE_MAGIC
+    uint32_t blockSize;         // Uncompressed size of every block but a region's last
+    uint32_t regionCount;       // Entries in the region table
+    uint32_t reserved;
+    uint64_t blockCount;        // Entries in the block index
+    uint64_t regionsOffset;     // File offset of the region table
+    uint64_t indexOffset;       // File offset of the block index
+    uint64_t fileSize;          // Size of the whole file
+    uint64_t checksum;          // Hash of the region table and the index
+} SnapshotFileHeader;
+
+/**
+ * @brief Entry of the region table
+ */
+typedef struct {
+    char memoryName[64];        // Name of the region
+    uint64_t version;           // Version of the region in the cut
+    uint64_t size;              // Size of the region
+    uint64_t firstBlock;        // Index entry of the region's first block
+    uint64_t blockCount;        // Number of blocks of the region
+} SnapshotFileRegion;
+
+/**
+ * @brief Entry of the block index
+ */
+typedef struct {
+    uint64_t offset;            // File offset of the stored block
+    uint32_t storedSize;        // Bytes stored in the file
+    uint32_t rawSize;           // Bytes after decompression
+    uint32_t flags;             // SNAPSHOT_BLOCK_* bits
+    uint32_t reserved;
+    uint64_t checksum;          // Hash of the uncompressed block
+} SnapshotBlockEntry;
+
+/**
+ * @brief A snapshot file mapped for reading
+ */
+struct SnapshotFile {
+    HANDLE file;                            // Open file
+    HANDLE mapping;                         // Mapping of the whole file
+    const char* view;                       // Start of the mapped file
+    const SnapshotFileHeader* header;       // Header, at the start of the view
+    const SnapshotFileRegion* regions;      // Region table
+    const SnapshotBlockEntry* blocks;       // Block index
+};
+
+/**
+ * @brief Write a cut to a snapshot file
+ *
+ * The file is written under a temporary name and renamed when complete.
+ *
+ * @param cut The cut
+ * @param path Path of the file to create
+ * @param compress true to compress the blocks that get smaller
+ * @return true if the file was written, false otherwise
+ */
+bool writeSnapshotFile(const SnapshotCut& cut, const char* path, bool compress);
+
+/**
+ * @brief Map a snapshot file and check its header, region table and index
+ *
+ * @param path Path of the file
+ * @param snapshot Receives the mapped file
+ * @return true if the file is a valid snapshot, false otherwise
+ */
+bool openSnapshotFile(const char* path, SnapshotFile* snapshot);
+
+/**
+ * @brief Unmap and close a file opened with openSnapshotFile
+ *
+ * @param snapshot The mapped file
+ */
+void closeSnapshotFile(SnapshotFile* snapshot);
+
+/**
+ * @brief Find a region in a snapshot file
+ *
+ * @param snapshot The mapped file
+ * @param memoryName Name of the region
+ * @return Index in the region table, or -1 if the region isn't in the file
+ */
+int findSnapshotRegion(const SnapshotFile* snapshot, const char* memoryName);
+
+/**
+ * @brief Decode one block and check it against its hash
+ *
+ * @param snapshot The mapped file
+ * @param block Index of the block in the block index
+ * @param dst Buffer of header->blockSize bytes receiving the contents
+ * @return The block's size, or (size_t)-1 if it is corrupt
+ */
+size_t readSnapshotBlock(const SnapshotFile* snapshot, uint64_t block, char* dst);
+
+/**
+ * @brief Fill a local copy of a region from a snapshot file
+ *
+ * The blocks are applied as replicated updates at the snapshot's version,
+ * so observers and the journal see them. The header block goes last, so the
+ * copy only claims the version once all of it is in place. A copy that is
+ * already at or past the snapshot's version is left alone.
+ *
+ * @param path Path of the snapshot file
+ * @param memoryName Name of the region (already initialized)
+ * @return true if the copy was seeded, false otherwise
+ */
+bool seedRegionFromSnapshot(const char* path, const char* memoryName);
+
+#endif // SNAPSHOT_FILE_H
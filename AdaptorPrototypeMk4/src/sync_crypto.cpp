@@ -0,0 +1,307 @@
+/**
+ * @file sync_crypto.cpp
+ * @brief Implementation of sync datagram encryption
+ *
+ * Each peer has its expanded key and a replay window: the highest sequence
+ * number accepted and a bitmap of the SYNC_REPLAY_WINDOW numbers below it,
+ * bit i standing for highest - i. The window only moves once a datagram has
+ * opened, so forged datagrams can't push it forward.
+ *
+ * Session keys are the configured key's CTR keystream under a nonce made of
+ * a fixed prefix and the boot salt. The receive thread keeps the session
+ * key of the salt each peer last sealed with, and derives a new one when a
+ * datagram carries another salt, adopting it only once the datagram opens.
+ */
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+
+#include <bcrypt.h>
+
+#include "sync_crypto.h"
+#include <iostream>
+#include <map>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * @brief Key and replay window of one peer
+ */
+struct PeerCrypto {
+    AesGcmKey key;              // Key shared with the peer; only used to derive session keys
+    size_t keySize;             // Size of the shared key in bytes
+    AesGcmKey sendKey;          // Session key for this process's boot salt
+    AesGcmKey receiveKey;       // Session key for receiveSalt
+    uint64_t receiveSalt;       // Boot salt the peer last sealed with; 0 if none yet
+    uint64_t highestSequence;   // Highest sequence number accepted from the peer
+    uint64_t seenBelow;         // Bit i set if highestSequence - i was accepted
+};
+
+/// Peer keys by address and port (see peerId)
+static std::map<uint64_t, PeerCrypto*> g_peerKeys;
+
+/// Set once any peer has a key (read on every send and receive)
+static volatile LONG g_encryptionEnabled = 0;
+
+/// First 4 bytes of every nonce this node uses
+static uint32_t g_senderId = 0;
+
+/// Random salt of this process's session keys; 0 until the first key is added
+static uint64_t g_bootSalt = 0;
+
+/// First 4 bytes of the nonce that derives a session key
+#define SESSION_KEY_NONCE_PREFIX 0x5359454Bu    // "KEYS"
+
+/// Last sequence number used; 0 until the first datagram is sealed
+static volatile LONG64 g_sendSequence = 0;
+
+/// Datagram counts
+static volatile LONG g_sealedCount = 0;
+static volatile LONG g_openedCount = 0;
+static volatile LONG g_authFailureCount = 0;
+static volatile LONG g_replayCount = 0;
+static volatile LONG g_noKeyCount = 0;
+
+/**
+ * @brief Map key of a peer: its IPv4 address and port, or 0 if the address doesn't parse
+ *
+ * Looked up on every send and receive, where building an "ip:port" string
+ * would cost more than sealing a small message.
+ */
+static uint64_t peerId(const char* ip, int port) {
+    in_addr address;
+    if (inet_pton(AF_INET, ip, &address) != 1) {
+        return 0;
+    }
+    return (static_cast<uint64_t>(address.s_addr) << 16) | static_cast<uint16_t>(port);
+}
+
+static PeerCrypto* findPeer(const char* ip, int port) {
+    std::map<uint64_t, PeerCrypto*>::iterator it = g_peerKeys.find(peerId(ip, port));
+    return (it != g_peerKeys.end()) ? it->second : NULL;
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool parseSyncKey(const std::string& hex, std::vector<unsigned char>& key) {
+    if (hex.size() != 32 && hex.size() != 64) {
+        return false;
+    }
+    key.resize(hex.size() / 2);
+    for (size_t i = 0; i < key.size(); i++) {
+        int high = hexDigit(hex[2 * i]);
+        int low = hexDigit(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            key.clear();
+            return false;
+        }
+        key[i] = static_cast<unsigned char>((high << 4) | low);
+    }
+    return true;
+}
+
+/**
+ * @brief Derive the session key of a boot salt from a peer's shared key
+ */
+static void deriveSessionKey(const PeerCrypto* peer, uint64_t salt, AesGcmKey* session) {
+    unsigned char nonce[AES_GCM_NONCE_SIZE];
+    uint32_t prefix = SESSION_KEY_NONCE_PREFIX;
+    memcpy(nonce, &prefix, sizeof(prefix));
+    memcpy(nonce + sizeof(prefix), &salt, sizeof(salt));
+
+    unsigned char keyBytes[32];
+    unsigned char tag[AES_GCM_TAG_SIZE];
+    memset(keyBytes, 0, sizeof(keyBytes));
+    aesGcmSeal(&peer->key, nonce, NULL, 0, keyBytes, peer->keySize, keyBytes, tag);
+    aesGcmInitKey(session, keyBytes, peer->keySize);
+    memset(keyBytes, 0, sizeof(keyBytes));
+}
+
+/**
+ * @brief Draw this process's boot salt on first use
+ */
+static bool ensureBootSalt() {
+    while (g_bootSalt == 0) {
+        if (!BCRYPT_SUCCESS(BCryptGenRandom(NULL, reinterpret_cast<UCHAR*>(&g_bootSalt), sizeof(g_bootSalt),
+                                            BCRYPT_USE_SYSTEM_PREFERRED_RNG))) {
+            std::cerr << "[CRYPTO] Failed to draw a boot salt for the session keys" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool addPeerKey(const char* ip, int port, const unsigned char* key, size_t keySize) {
+    uint64_t id = peerId(ip, port);
+    if (id == 0 || !ensureBootSalt()) {
+        return false;
+    }
+    PeerCrypto* peer = new PeerCrypto();
+    if (!aesGcmInitKey(&peer->key, key, keySize)) {
+        delete peer;
+        return false;
+    }
+    peer->keySize = keySize;
+    deriveSessionKey(peer, g_bootSalt, &peer->sendKey);
+    peer->receiveSalt = 0;
+    peer->highestSequence = 0;
+    peer->seenBelow = 0;
+
+    std::map<uint64_t, PeerCrypto*>::iterator it = g_peerKeys.find(id);
+    if (it != g_peerKeys.end()) {
+        delete it->second;
+    }
+    g_peerKeys[id] = peer;
+    InterlockedExchange(&g_encryptionEnabled, 1);
+    return true;
+}
+
+void clearPeerKeys() {
+    InterlockedExchange(&g_encryptionEnabled, 0);
+    std::map<uint64_t, PeerCrypto*>::iterator it;
+    for (it = g_peerKeys.begin(); it != g_peerKeys.end(); ++it) {
+        // The expanded keys are as secret as the key itself
+        memset(&it->second->key, 0, sizeof(AesGcmKey));
+        memset(&it->second->sendKey, 0, sizeof(AesGcmKey));
+        memset(&it->second->receiveKey, 0, sizeof(AesGcmKey));
+        delete it->second;
+    }
+    g_peerKeys.clear();
+}
+
+void setSecureSenderId(uint32_t senderId) {
+    g_senderId = senderId;
+}
+
+bool syncEncryptionEnabled() {
+    return g_encryptionEnabled != 0;
+}
+
+/**
+ * @brief Next sequence number, starting from the wall-clock time on first use
+ */
+static uint64_t nextSequence() {
+    if (g_sendSequence == 0) {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        LONG64 start = static_cast<LONG64>((static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime);
+        InterlockedCompareExchange64(&g_sendSequence, start, 0);
+    }
+    return static_cast<uint64_t>(InterlockedIncrement64(&g_sendSequence));
+}
+
+size_t sealSyncMessage(const SyncMessage& message, const char* ip, int port, char* datagram) {
+    PeerCrypto* peer = findPeer(ip, port);
+    if (!peer) {
+        InterlockedIncrement(&g_noKeyCount);
+        return 0;
+    }
+
+    SecureDatagramHeader header;
+    header.magic = SECURE_DATAGRAM_MAGIC;
+    header.senderId = g_senderId;
+    header.sequence = nextSequence();
+    header.bootSalt = g_bootSalt;
+    memcpy(datagram, &header, sizeof(header));
+
+    // Only the used part of the data is sent
+    size_t dataSize = (message.size > MAX_SYNC_DATA_SIZE) ? MAX_SYNC_DATA_SIZE : message.size;
+    size_t plainSize = offsetof(SyncMessage, data) + dataSize;
+    unsigned char* ciphertext = reinterpret_cast<unsigned char*>(datagram) + sizeof(header);
+    aesGcmSeal(&peer->sendKey, reinterpret_cast<const unsigned char*>(&header.senderId), &header, sizeof(header),
+               &message, plainSize, ciphertext, ciphertext + plainSize);
+    InterlockedIncrement(&g_sealedCount);
+    return sizeof(header) + plainSize + AES_GCM_TAG_SIZE;
+}
+
+/**
+ * @brief Check a sequence number against a peer's replay window
+ */
+static bool sequenceSeen(const PeerCrypto* peer, uint64_t sequence) {
+    if (sequence > peer->highestSequence) {
+        return false;
+    }
+    uint64_t behind = peer->highestSequence - sequence;
+    return behind >= SYNC_REPLAY_WINDOW || (peer->seenBelow & (1ull << behind)) != 0;
+}
+
+static void recordSequence(PeerCrypto* peer, uint64_t sequence) {
+    if (sequence > peer->highestSequence) {
+        uint64_t ahead = sequence - peer->highestSequence;
+        peer->seenBelow = (ahead >= SYNC_REPLAY_WINDOW) ? 0 : peer->seenBelow << ahead;
+        peer->seenBelow |= 1;
+        peer->highestSequence = sequence;
+    } else {
+        peer->seenBelow |= 1ull << (peer->highestSequence - sequence);
+    }
+}
+
+bool openSyncMessage(const char* datagram, size_t size, const char* ip, int port,
+                     SyncMessage& message, size_t* messageBytes) {
+    SecureDatagramHeader header;
+    if (size < sizeof(header) + AES_GCM_TAG_SIZE ||
+        size - sizeof(header) - AES_GCM_TAG_SIZE > sizeof(SyncMessage)) {
+        InterlockedIncrement(&g_authFailureCount);
+        return false;
+    }
+    memcpy(&header, datagram, sizeof(header));
+    if (header.magic != SECURE_DATAGRAM_MAGIC) {
+        InterlockedIncrement(&g_authFailureCount);
+        return false;
+    }
+
+    PeerCrypto* peer = findPeer(ip, port);
+    if (!peer) {
+        InterlockedIncrement(&g_noKeyCount);
+        return false;
+    }
+    if (sequenceSeen(peer, header.sequence)) {
+        InterlockedIncrement(&g_replayCount);
+        return false;
+    }
+
+    size_t plainSize = size - sizeof(header) - AES_GCM_TAG_SIZE;
+    const unsigned char* ciphertext = reinterpret_cast<const unsigned char*>(datagram) + sizeof(header);
+
+    // A new salt means the peer restarted; its key is only kept if the datagram opens
+    AesGcmKey derived;
+    const AesGcmKey* session = &peer->receiveKey;
+    if (header.bootSalt != peer->receiveSalt || peer->receiveSalt == 0) {
+        deriveSessionKey(peer, header.bootSalt, &derived);
+        session = &derived;
+    }
+    if (!aesGcmOpen(session, reinterpret_cast<const unsigned char*>(&header.senderId), &header, sizeof(header),
+                    ciphertext, plainSize, &message, ciphertext + plainSize)) {
+        InterlockedIncrement(&g_authFailureCount);
+        return false;
+    }
+    if (session == &derived) {
+        peer->receiveKey = derived;
+        peer->receiveSalt = header.bootSalt;
+        memset(&derived, 0, sizeof(derived));
+    }
+    recordSequence(peer, header.sequence);
+    InterlockedIncrement(&g_openedCount);
+    *messageBytes = plainSize;
+    return true;
+}
+
+void getSyncCryptoStats(SyncCryptoStats* stats) {
+    stats->sealed = static_cast<uint64_t>(g_sealedCount);
+    stats->opened = static_cast<uint64_t>(g_openedCount);
+    stats->authFailures = static_cast<uint64_t>(g_authFailureCount);
+    stats->replays = static_cast<uint64_t>(g_replayCount);
+    stats->noKey = static_cast<uint64_t>(g_noKeyCount);
+}
@@ -0,0 +1,143 @@
+#ifndef SYNC_CRYPTO_H
+#define SYNC_CRYPTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "sync_message.h"
+#include "aes_gcm.h"
+
+/**
+ * @brief AES-GCM encryption of sync datagrams with per-peer keys
+ *
+ * Once a key has been added for any peer, every datagram is sealed with the
+ * key of the peer it goes to, and datagrams from a peer are only accepted if
+ * they open with that peer's key. Nothing is sent in plaintext to, or
+ * accepted from, a peer without a key. Both ends of a link configure the
+ * same key.
+ *
+ * A sealed datagram is a SecureDatagramHeader, the encrypted SyncMessage up
+ * to the end of its data, and a 16-byte tag. The header is authenticated
+ * but not encrypted. The nonce is the sender ID followed by the sequence
+ * number, so the two directions of a link never share a nonce. Sequence
+ * numbers start from the wall-clock time in 100 ns units when the process
+ * starts, so they keep rising across restarts, and receivers reject a
+ * sequence number they have already accepted or that is more than
+ * SYNC_REPLAY_WINDOW behind the highest one.
+ *
+ * The configured key is never used on data directly. Each process draws a
+ * random 64-bit boot salt and seals with a session key derived from the
+ * configured key and that salt; the salt travels in the header, so the
+ * receiver derives the same key. A nonce can only repeat under the same
+ * session key, so a clock that steps back across a restart doesn't reuse
+ * nonces. (Its datagrams are rejected as replays until the sequence passes
+ * the highest one the peer accepted, as before.)
+ *
+ * Keys are added before initNetworkSync; the key table is not locked
+ * against changes while datagrams flow.
+ */
+
+#define SECURE_DATAGRAM_MAGIC 0x4D434753u   // "SGCM"
+
+/// Sequence numbers a peer's datagrams may arrive out of order by
+#define SYNC_REPLAY_WINDOW 64
+
+/**
+ * @brief Plaintext header of a sealed datagram, authenticated as additional data
+ */
+typedef struct {
+    uint32_t magic;         // SECURE_DATAGRAM_MAGIC
+    uint32_t senderId;      // Instance ID of the sender; first 4 bytes of the nonce
+    uint64_t sequence;      // Sender's sequence number; last 8 bytes of the nonce
+    uint64_t bootSalt;      // Sender's boot salt, selecting the session key
+} SecureDatagramHeader;
+
+#define MAX_SECURE_DATAGRAM_SIZE (sizeof(SecureDatagramHeader) + sizeof(SyncMessage) + AES_GCM_TAG_SIZE)
+
+/**
+ * @brief Counts of sealed and opened datagrams since startup
+ */
+struct SyncCryptoStats {
+    uint64_t sealed;            // Datagrams sealed for sending
+    uint64_t opened;            // Datagrams that opened and were accepted
+    uint64_t authFailures;      // Datagrams that were malformed or failed their tag
+    uint64_t replays;           // Datagrams with a sequence number already seen or too old
+    uint64_t noKey;             // Datagrams to or from a peer without a key
+};
+
+/**
+ * @brief Parse a key written as hex digits
+ *
+ * @param hex 32 hex digits for AES-128 or 64 for AES-256
+ * @param key Receives the key bytes
+ * @return true if the string is a key of a supported size
+ */
+bool parseSyncKey(const std::string& hex, std::vector<unsigned char>& key);
+
+/**
+ * @brief Add the key shared with a peer, enabling encryption
+ *
+ * @param ip IP address of the peer
+ * @param port Port of the peer
+ * @param key Key bytes
+ * @param keySize 16 or 32
+ * @return true if the key was added; false for another key size, an address that isn't
+ *         IPv4, or if no boot salt could be drawn
+ */
+bool addPeerKey(const char* ip, int port, const unsigned char* key, size_t keySize);
+
+/**
+ * @brief Remove every peer key, disabling encryption
+ */
+void clearPeerKeys();
+
+/**
+ * @brief Set the sender ID that starts every nonce this node uses
+ *
+ * @param senderId The instance ID of this node
+ */
+void setSecureSenderId(uint32_t senderId);
+
+/**
+ * @brief Check whether datagrams are encrypted
+ *
+ * @return true if a key has been added for at least one peer
+ */
+bool syncEncryptionEnabled();
+
+/**
+ * @brief Seal a message for a peer
+ *
+ * @param message The message, stamped with its CRC
+ * @param ip IP address of the peer
+ * @param port Port of the peer
+ * @param datagram Receives the datagram; at least MAX_SECURE_DATAGRAM_SIZE bytes
+ * @return Size of the datagram, or 0 if there is no key for the peer
+ */
+size_t sealSyncMessage(const SyncMessage& message, const char* ip, int port, char* datagram);
+
+/**
+ * @brief Check and decrypt a datagram from a peer
+ *
+ * Called on the receive thread only, which keeps each peer's replay window.
+ *
+ * @param datagram The received bytes
+ * @param size Number of bytes received
+ * @param ip IP address of the peer
+ * @param port Port of the peer
+ * @param message Receives the message
+ * @param messageBytes Receives the number of message bytes decrypted
+ * @return true if the datagram opened with the peer's key and is not a replay
+ */
+bool openSyncMessage(const char* datagram, size_t size, const char* ip, int port,
+                     SyncMessage& message, size_t* messageBytes);
+
+/**
+ * @brief Get the counts of sealed and opened datagrams
+ *
+ * @param stats Receives the counts
+ */
+void getSyncCryptoStats(SyncCryptoStats* stats);
+
+#endif // SYNC_CRYPTO_H
@@ -6,6 +6,13 @@
 #define MAX_MEMORY_NAME_LENGTH 64
 #define MAX_SYNC_DATA_SIZE 1024
 
+// SyncMessage flags
+#define SYNC_FLAG_MORE_IN_VERSION 0x1   // More messages follow that belong to the same version
+#define SYNC_FLAG_FORWARDED 0x2         // A MSG_RANGE_WRITE already passed on by a node that doesn't hold the range
+#define SYNC_FLAG_FETCH_UNCHANGED 0x4   // A MSG_FETCH_DATA reply: the region is still at the requester's known version
+#define SYNC_FLAG_FETCH_FAILED 0x8      // A MSG_FETCH_DATA reply: the range can't be served
+#define SYNC_FLAG_BLOCK_RANGE 0x10      // A MSG_BLOCK_HASH_REQUEST with a BlockHashRangeInfo, or a MSG_BLOCK_HASHES answering one
+
 /**
  * @brief Message types for synchronization
  *
@@ -16,9 +23,91 @@ typedef enum {
     MSG_SINGLE_UPDATE,   // Complete update in a single message
     MSG_START_UPDATE,    // Start of an update sequence
     MSG_UPDATE_CHUNK,    // Middle chunk of an update
-    MSG_END_UPDATE       // End of an update sequence
+    MSG_END_UPDATE,      // End of an update sequence
+    MSG_RESYNC_REQUEST,  // Ask the region's source for updates newer than 'version'
+    MSG_RESIZE,          // The region grew at 'version'; data holds a RegionResizeInfo
+    MSG_BLOCK_HASH_REQUEST, // The source asks for the block hashes of the receiver's copy
+    MSG_BLOCK_HASHES,    // Block hashes of a copy; data holds a BlockHashBatch and its hashes
+    MSG_REGION_CHECKSUM, // CRC-32C of the source's region at 'version'; data holds a RegionChecksumInfo
+    MSG_RANGE_WRITE,     // A write to a leased range, sent to its holder by the node that made it ('origin')
+    MSG_PAGE_REQUEST,    // A lazy copy asks the source for the page at 'offset'; data holds a PageRequestInfo
+    MSG_PAGE_DATA,       // Part of a requested page at the source's 'version'; 'updateId' is the request's
+    MSG_FETCH_REQUEST,   // Ask the source for the window at 'offset' of a range; data holds a FetchRequestInfo
+    MSG_FETCH_DATA       // Part of a fetched range at 'version'; 'updateId' is the fetch's
 } MessageType;
 
+/**
+ * @brief Payload of a MSG_RESIZE message
+ */
+typedef struct {
+    uint64_t newSize;                        // Size of the region from 'version' on
+} RegionResizeInfo;
+
+/**
+ * @brief Payload of a MSG_REGION_CHECKSUM message
+ */
+typedef struct {
+    uint64_t regionSize;                     // Size of the region the checksum covers
+    uint32_t crc;                            // CRC-32C of the region (see region_checksum.h)
+    uint32_t reserved;
+} RegionChecksumInfo;
+
+/**
+ * @brief Payload of a MSG_PAGE_REQUEST message
+ */
+typedef struct {
+    uint64_t pageSize;                       // Page size of the lazy copy
+    uint64_t version;                        // Source version of the parts already received; 0 if none
+    uint64_t partsReceived;                  // Bit per MAX_SYNC_DATA_SIZE part already received
+    uint64_t copyId;                         // Identifies the lazy copy; a new one has fetched nothing yet
+} PageRequestInfo;
+
+/**
+ * @brief Payload of a MSG_FETCH_REQUEST message
+ */
+typedef struct {
+    uint64_t offset;                         // Region offset of the whole range
+    uint64_t size;                           // Size of the whole range
+    uint64_t knownVersion;                   // Version of the requester's cached copy; 0 if none
+    uint64_t version;                        // Version of the window's parts already received; 0 if none
+    uint64_t partsReceived;                  // Bit per MAX_SYNC_DATA_SIZE part of the window already received
+} FetchRequestInfo;
+
+#define RESYNC_BLOCK_SIZE 4096             // Region bytes covered by one BlockHash
+
+/**
+ * @brief Hashes of one RESYNC_BLOCK_SIZE block of a region copy
+ */
+typedef struct {
+    uint32_t weak;                           // Adler-style checksum, compared first
+    uint32_t reserved;
+    uint64_t strong;                         // 64-bit FNV-1a hash, compared when the weak ones match
+} BlockHash;
+
+/**
+ * @brief Payload header of a MSG_BLOCK_HASHES message; the hashes follow it
+ *
+ * The message's updateId identifies the resync session and every message of
+ * a session except the last carries SYNC_FLAG_MORE_IN_VERSION.
+ */
+typedef struct {
+    uint64_t regionSize;                     // Size of the sender's copy
+    uint64_t firstBlock;                     // Block index of the first hash in this message
+} BlockHashBatch;
+
+/**
+ * @brief Payload of a MSG_BLOCK_HASH_REQUEST flagged SYNC_FLAG_BLOCK_RANGE
+ *
+ * Asks for the hashes of some blocks only, after a round of a block
+ * transfer. The answer carries the request's updateId.
+ */
+typedef struct {
+    uint64_t firstBlock;                     // First block to hash
+    uint64_t blockCount;                     // Number of blocks from firstBlock
+} BlockHashRangeInfo;
+
+#define BLOCK_HASHES_PER_MESSAGE ((MAX_SYNC_DATA_SIZE - sizeof(BlockHashBatch)) / sizeof(BlockHash))
+
 /**
  * @brief Synchronization message structure
  *
@@ -29,9 +118,13 @@ typedef struct {
     char memoryName[MAX_MEMORY_NAME_LENGTH]; // Name of the shared memory region
     MessageType msgType;                     // Type of message (single, start, chunk, end)
     uint64_t updateId;                       // Unique ID for multi-part updates
+    uint64_t version;                        // Source region version the data belongs to
     size_t offset;                           // Offset within the shared memory
     size_t size;                             // Size of the data being synchronized
     uint32_t timestamp;                      // Timestamp of when the message was created
+    uint32_t flags;                          // SYNC_FLAG_* bits
+    uint32_t origin;                         // Lease node ID of the node that wrote the data; 0 if not known
+    uint32_t checksum;                       // CRC-32C of the fields above and the first 'size' bytes of data
     char data[MAX_SYNC_DATA_SIZE];           // Data to be synchronized
 } SyncMessage;
 
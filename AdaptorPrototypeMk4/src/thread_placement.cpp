@@ -0,0 +1,386 @@
+/**
+ * @file thread_placement.cpp
+ * @brief Implementation of NUMA-aware thread placement
+ *
+ * The node of a range is found with QueryWorkingSetEx on a sample of its
+ * pages. A thread is placed with SetThreadGroupAffinity on the processor
+ * mask of its node, so on hosts with more than 64 processors it runs in the
+ * node's processor group.
+ *
+ * Placements are recorded by role and region, so a restarted thread
+ * replaces its earlier entry and the report lists one line per thread.
+ */
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <psapi.h>
+
+#include "thread_placement.h"
+#include "shared_memory.h"
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <ifaddrs.h>
+#endif
+
+/// Pages sampled to find the node of a range
+#define PLACEMENT_SAMPLE_PAGES 64
+
+/**
+ * @brief Where one thread was placed
+ */
+struct PlacedThread {
+    ThreadRole role;
+    std::string memoryName;     // Region the thread serves, empty for the receive thread
+    int node;                   // Node it runs on, -1 if not placed
+};
+
+/// Whether threads are placed
+static bool g_placementEnabled = false;
+
+/// Node for the receive thread, -1 to follow its regions
+static int g_networkNode = -1;
+
+/// Local address the socket is bound to
+static std::string g_localIp;
+
+/// Regions the receive thread writes
+static std::set<std::string> g_applyRegions;
+
+/// Placements by role and region
+static std::map<std::string, PlacedThread> g_placedThreads;
+
+/// Cross-node counts when placement was configured
+static CrossNodeCounts g_baselineCounts;
+static bool g_haveBaselineCounts = false;
+
+/// Bumped whenever the receive thread needs to be placed again
+static volatile LONG g_placementGeneration = 0;
+
+/// Mutex protecting the placement state (threads place themselves while regions are added)
+static HANDLE g_placementMutex = NULL;
+
+static void lockPlacementMutex() {
+    if (g_placementMutex == NULL) {
+        g_placementMutex = CreateMutex(NULL, FALSE, NULL);
+        if (g_placementMutex == NULL) {
+            std::cerr << "Failed to create placement mutex: " << GetLastError() << std::endl;
+        }
+    }
+    if (g_placementMutex != NULL) {
+        WaitForSingleObject(g_placementMutex, INFINITE);
+    }
+}
+
+static void unlockPlacementMutex() {
+    if (g_placementMutex != NULL) {
+        ReleaseMutex(g_placementMutex);
+    }
+}
+
+static const char* roleName(ThreadRole role) {
+    switch (role) {
+        case THREAD_ROLE_RECEIVE:  return "Receive";
+        case THREAD_ROLE_SYNC:     return "Sync";
+        case THREAD_ROLE_NOTIFIER: return "Notifier";
+    }
+    return "Unknown";
+}
+
+static int countBits(KAFFINITY mask) {
+    int count = 0;
+    while (mask != 0) {
+        mask &= mask - 1;
+        count++;
+    }
+    return count;
+}
+
+bool readNumaTopology(NumaTopology* topology) {
+    memset(topology, 0, sizeof(*topology));
+    ULONG highestNode = 0;
+    if (!GetNumaHighestNodeNumber(&highestNode)) {
+        return false;
+    }
+    topology->nodeCount = static_cast<int>(highestNode) + 1;
+    if (topology->nodeCount > MAX_NUMA_NODES) {
+        topology->nodeCount = MAX_NUMA_NODES;
+    }
+    for (int node = 0; node < topology->nodeCount; node++) {
+        GROUP_AFFINITY affinity;
+        if (GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity)) {
+            topology->nodeProcessors[node] = countBits(affinity.Mask);
+            topology->processorCount += topology->nodeProcessors[node];
+        }
+    }
+    return true;
+}
+
+int getMemoryNumaNode(const void* address, size_t size) {
+    if (address == NULL || size == 0) {
+        return -1;
+    }
+
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    size_t pageSize = systemInfo.dwPageSize;
+    size_t pages = (size + pageSize - 1) / pageSize;
+    size_t samples = pages < PLACEMENT_SAMPLE_PAGES ? pages : PLACEMENT_SAMPLE_PAGES;
+
+    PSAPI_WORKING_SET_EX_INFORMATION entries[PLACEMENT_SAMPLE_PAGES];
+    for (size_t i = 0; i < samples; i++) {
+        size_t page = i * pages / samples;
+        entries[i].VirtualAddress = const_cast<char*>(static_cast<const char*>(address)) + page * pageSize;
+    }
+    if (!QueryWorkingSetEx(GetCurrentProcess(), entries,
+                           static_cast<DWORD>(samples * sizeof(PSAPI_WORKING_SET_EX_INFORMATION)))) {
+        return -1;
+    }
+
+    int pagesOnNode[MAX_NUMA_NODES];
+    memset(pagesOnNode, 0, sizeof(pagesOnNode));
+    for (size_t i = 0; i < samples; i++) {
+        if (entries[i].VirtualAttributes.Valid && entries[i].VirtualAttributes.Node < MAX_NUMA_NODES) {
+            pagesOnNode[entries[i].VirtualAttributes.Node]++;
+        }
+    }
+
+    int best = -1;
+    for (int node = 0; node < MAX_NUMA_NODES; node++) {
+        if (pagesOnNode[node] > 0 && (best < 0 || pagesOnNode[node] > pagesOnNode[best])) {
+            best = node;
+        }
+    }
+    return best;
+}
+
+int getRegionNumaNode(const char* memoryName) {
+    size_t size = 0;
+    void* memory = getSharedMemoryMapping(memoryName, &size);
+    if (memory == NULL) {
+        return -1;
+    }
+    return getMemoryNumaNode(memory, size);
+}
+
+int getInterfaceNumaNode(const char* localIp) {
+#ifdef _WIN32
+    // Windows does not report the node of a network adapter to applications
+    (void)localIp;
+    return -1;
+#else
+    ifaddrs* interfaces = NULL;
+    if (localIp == NULL || getifaddrs(&interfaces) != 0) {
+        return -1;
+    }
+
+    int node = -1;
+    for (ifaddrs* entry = interfaces; entry != NULL; entry = entry->ifa_next) {
+        if (entry->ifa_addr == NULL || entry->ifa_addr->sa_family != AF_INET) {
+            continue;
+        }
+        char address[INET_ADDRSTRLEN];
+        const sockaddr_in* inet = reinterpret_cast<const sockaddr_in*>(entry->ifa_addr);
+        if (inet_ntop(AF_INET, &inet->sin_addr, address, sizeof(address)) == NULL ||
+            strcmp(address, localIp) != 0) {
+            continue;
+        }
+
+        // Virtual interfaces (loopback, bridges) have no device and no node
+        char path[256];
+        snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", entry->ifa_name);
+        FILE* file = fopen(path, "r");
+        if (file != NULL) {
+            if (fscanf(file, "%d", &node) != 1) {
+                node = -1;
+            }
+            fclose(file);
+        }
+        break;
+    }
+    freeifaddrs(interfaces);
+    return node;
+#endif
+}
+
+void configureThreadPlacement(bool enabled, int networkNode, const char* localIp) {
+    lockPlacementMutex();
+    g_placementEnabled = enabled;
+    g_networkNode = networkNode;
+    g_localIp = localIp != NULL ? localIp : "";
+    g_haveBaselineCounts = readCrossNodeCounts(&g_baselineCounts);
+    unlockPlacementMutex();
+    InterlockedIncrement(&g_placementGeneration);
+}
+
+bool isThreadPlacementEnabled() {
+    return g_placementEnabled;
+}
+
+void addApplyRegion(const char* memoryName) {
+    lockPlacementMutex();
+    g_applyRegions.insert(memoryName);
+    unlockPlacementMutex();
+    InterlockedIncrement(&g_placementGeneration);
+}
+
+bool threadPlacementChanged(long* seenGeneration) {
+    long current = g_placementGeneration;
+    if (current == *seenGeneration) {
+        return false;
+    }
+    *seenGeneration = current;
+    return true;
+}
+
+/**
+ * @brief Choose the node for the receive thread
+ *
+ * The configured network node if there is one, otherwise the node holding
+ * most of the bytes of the regions it applies updates to, otherwise the
+ * node of the network interface. Called with the placement mutex held.
+ */
+static int chooseReceiveNode() {
+    if (g_networkNode >= 0) {
+        return g_networkNode;
+    }
+
+    uint64_t bytesOnNode[MAX_NUMA_NODES];
+    memset(bytesOnNode, 0, sizeof(bytesOnNode));
+    int best = -1;
+    for (std::set<std::string>::const_iterator it = g_applyRegions.begin(); it != g_applyRegions.end(); ++it) {
+        int node = getRegionNumaNode(it->c_str());
+        if (node < 0) {
+            continue;
+        }
+        bytesOnNode[node] += getSharedMemorySize(it->c_str());
+        if (best < 0 || bytesOnNode[node] > bytesOnNode[best]) {
+            best = node;
+        }
+    }
+
+    int interfaceNode = getInterfaceNumaNode(g_localIp.c_str());
+    if (best < 0) {
+        return interfaceNode;
+    }
+    if (interfaceNode >= 0 && interfaceNode != best) {
+        std::cout << "[PLACEMENT] Replicated regions are on node " << best << " but the interface for "
+                  << g_localIp << " is on node " << interfaceNode
+                  << "; set network_numa_node to keep the receive thread near the interface" << std::endl;
+    }
+    return best;
+}
+
+int placeCurrentThread(ThreadRole role, const char* memoryName) {
+    lockPlacementMutex();
+    if (!g_placementEnabled) {
+        unlockPlacementMutex();
+        return -1;
+    }
+
+    int node = role == THREAD_ROLE_RECEIVE ? chooseReceiveNode() : getRegionNumaNode(memoryName);
+
+    GROUP_AFFINITY affinity;
+    if (node >= 0) {
+        if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity) || affinity.Mask == 0) {
+            // A node without processors: leave the thread where it is
+            node = -1;
+        } else if (!SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL)) {
+            std::cerr << "[PLACEMENT] Failed to set thread affinity: " << GetLastError() << std::endl;
+            node = -1;
+        }
+    }
+
+    PlacedThread placed;
+    placed.role = role;
+    placed.memoryName = memoryName != NULL ? memoryName : "";
+    placed.node = node;
+    g_placedThreads[std::string(roleName(role)) + ":" + placed.memoryName] = placed;
+    unlockPlacementMutex();
+
+    if (node >= 0) {
+        std::cout << "[PLACEMENT] " << roleName(role) << " thread"
+                  << (placed.memoryName.empty() ? "" : " for " + placed.memoryName)
+                  << " placed on node " << node << std::endl;
+    }
+    return node;
+}
+
+bool readCrossNodeCounts(CrossNodeCounts* counts) {
+    memset(counts, 0, sizeof(*counts));
+#ifdef _WIN32
+    // Windows keeps no per-node placement counters for applications
+    return false;
+#else
+    ULONG highestNode = 0;
+    GetNumaHighestNodeNumber(&highestNode);
+    bool found = false;
+    for (ULONG node = 0; node <= highestNode; node++) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/numastat", node);
+        FILE* file = fopen(path, "r");
+        if (file == NULL) {
+            continue;
+        }
+        char name[64];
+        unsigned long long value;
+        while (fscanf(file, "%63s %llu", name, &value) == 2) {
+            if (strcmp(name, "local_node") == 0) {
+                counts->localNode += value;
+                found = true;
+            } else if (strcmp(name, "other_node") == 0) {
+                counts->otherNode += value;
+                found = true;
+            }
+        }
+        fclose(file);
+    }
+    return found;
+#endif
+}
+
+void reportThreadPlacement() {
+    NumaTopology topology;
+    if (readNumaTopology(&topology)) {
+        std::cout << "[PLACEMENT] " << topology.nodeCount << " NUMA node(s), "
+                  << topology.processorCount << " processor(s):";
+        for (int node = 0; node < topology.nodeCount; node++) {
+            std::cout << " node " << node << " has " << topology.nodeProcessors[node] << ";";
+        }
+        std::cout << std::endl;
+    }
+
+    lockPlacementMutex();
+    if (!g_placementEnabled) {
+        std::cout << "[PLACEMENT] Thread placement is disabled" << std::endl;
+    }
+    for (std::map<std::string, PlacedThread>::const_iterator it = g_placedThreads.begin();
+         it != g_placedThreads.end(); ++it) {
+        const PlacedThread& placed = it->second;
+        std::cout << "[PLACEMENT]   " << roleName(placed.role) << " thread"
+                  << (placed.memoryName.empty() ? "" : " for " + placed.memoryName) << ": ";
+        if (placed.node >= 0) {
+            std::cout << "node " << placed.node << std::endl;
+        } else {
+            std::cout << "not placed" << std::endl;
+        }
+    }
+    CrossNodeCounts baseline = g_baselineCounts;
+    bool haveBaseline = g_haveBaselineCounts;
+    unlockPlacementMutex();
+
+    CrossNodeCounts counts;
+    if (readCrossNodeCounts(&counts) && haveBaseline) {
+        uint64_t local = counts.localNode - baseline.localNode;
+        uint64_t other = counts.otherNode - baseline.otherNode;
+        std::cout << "[PLACEMENT] Pages allocated since startup (all processes): " << local
+                  << " on the local node, " << other << " on another node" << std::endl;
+    } else {
+        std::cout << "[PLACEMENT] Cross-node counts are not available on this platform" << std::endl;
+    }
+}
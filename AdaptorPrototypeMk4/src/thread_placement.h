@@ -0,0 +1,156 @@
+#ifndef THREAD_PLACEMENT_H
+#define THREAD_PLACEMENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief NUMA-aware placement of the receive, sync and notifier threads
+ *
+ * On a host with more than one NUMA node, a thread that writes or polls a
+ * region on another node pays for every cache line crossing the socket
+ * interconnect. With placement enabled, each thread restricts itself to the
+ * processors of the node its memory lives on:
+ *  - a region's sync thread (which reads the region to send changes) and
+ *    notifier thread (which runs its change callback) go to the node
+ *    holding most of the region's resident pages;
+ *  - the receive thread also applies every incoming update, so it goes to
+ *    the node holding most of the replicated regions it writes. A configured
+ *    network node overrides this, for hosts where the NIC's node matters
+ *    more than the regions'.
+ *
+ * Region pages stay on the node that first touched them; threads follow
+ * the memory rather than the other way round. Threads are placed when they
+ * start, and the receive thread again whenever a replicated region is added.
+ *
+ * With placement disabled (the default) no affinity is changed.
+ */
+
+/// Largest number of NUMA nodes tracked
+#define MAX_NUMA_NODES 64
+
+/**
+ * @brief What a placed thread does
+ */
+enum ThreadRole {
+    THREAD_ROLE_RECEIVE,    // Receives datagrams and applies them to replicated regions
+    THREAD_ROLE_SYNC,       // Sends a region's changes to remote nodes
+    THREAD_ROLE_NOTIFIER    // Runs a region's change callback
+};
+
+/**
+ * @brief NUMA nodes of this host and their processors
+ */
+struct NumaTopology {
+    int nodeCount;                          // Highest node number + 1
+    int processorCount;                     // Processors on all nodes
+    int nodeProcessors[MAX_NUMA_NODES];     // Processors on each node (0 for memory-only nodes)
+};
+
+/**
+ * @brief Page placements summed over the NUMA nodes of this host
+ *
+ * These are the kernel's per-node allocation counters (system-wide), the
+ * closest to cross-node access counts available without hardware counters.
+ */
+struct CrossNodeCounts {
+    uint64_t localNode;     // Pages allocated on the node of the allocating thread
+    uint64_t otherNode;     // Pages allocated on another node
+};
+
+/**
+ * @brief Read the NUMA topology of this host
+ *
+ * @param topology Receives the topology
+ * @return true if the topology was read
+ */
+bool readNumaTopology(NumaTopology* topology);
+
+/**
+ * @brief Find the node holding most of the resident pages of a range
+ *
+ * Samples up to 64 pages spread over the range. Pages that are not resident
+ * are not counted.
+ *
+ * @param address Start of the range
+ * @param size Size of the range
+ * @return Node number, or -1 if no sampled page is resident
+ */
+int getMemoryNumaNode(const void* address, size_t size);
+
+/**
+ * @brief Find the node holding most of a region's resident pages
+ *
+ * @param memoryName Name of the shared memory region
+ * @return Node number, or -1 if the region is unknown or not resident
+ */
+int getRegionNumaNode(const char* memoryName);
+
+/**
+ * @brief Find the node of the network interface owning a local address
+ *
+ * @param localIp Local IP address the socket is bound to
+ * @return Node number, or -1 if it cannot be determined on this platform
+ */
+int getInterfaceNumaNode(const char* localIp);
+
+/**
+ * @brief Enable or disable thread placement
+ *
+ * Call before any thread starts. Also records the cross-node counters that
+ * reportThreadPlacement compares against.
+ *
+ * @param enabled Whether threads are placed
+ * @param networkNode Node for the receive thread, or -1 to follow its regions
+ * @param localIp Local IP address, used to report the network interface's node
+ */
+void configureThreadPlacement(bool enabled, int networkNode, const char* localIp);
+
+/**
+ * @brief Check whether thread placement is enabled
+ */
+bool isThreadPlacementEnabled();
+
+/**
+ * @brief Record a region the receive thread writes
+ *
+ * The receive thread re-places itself on its next pass.
+ *
+ * @param memoryName Name of the replicated region
+ */
+void addApplyRegion(const char* memoryName);
+
+/**
+ * @brief Check whether the receive thread's placement needs to be redone
+ *
+ * @param seenGeneration The generation the caller last placed at; updated
+ * @return true if placement changed since that generation
+ */
+bool threadPlacementChanged(long* seenGeneration);
+
+/**
+ * @brief Restrict the calling thread to the processors of the node its role calls for
+ *
+ * Does nothing when placement is disabled or the node cannot be determined.
+ *
+ * @param role What the thread does
+ * @param memoryName Region the thread serves (NULL for the receive thread)
+ * @return The node the thread was placed on, or -1 if it was not placed
+ */
+int placeCurrentThread(ThreadRole role, const char* memoryName);
+
+/**
+ * @brief Read the kernel's per-node page placement counters
+ *
+ * @param counts Receives the counts summed over all nodes
+ * @return true if the counters are available on this platform
+ */
+bool readCrossNodeCounts(CrossNodeCounts* counts);
+
+/**
+ * @brief Log the topology, where each thread was placed, and the cross-node
+ *        counts since placement was configured
+ */
+void reportThreadPlacement();
+
+#endif // THREAD_PLACEMENT_H
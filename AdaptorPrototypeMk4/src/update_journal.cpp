@@ -0,0 +1,1130 @@
+/**
+ * @file update_journal.cpp
+ * @brief Implementation of the update journal and region checkpoints
+ *
+ * Appends happen on the thread that applies (or sends) an update and only
+ * copy into the mapped journal and mark the touched checkpoint blocks dirty.
+ * Durability is handled by a group-commit thread that flushes whatever was
+ * appended since its last pass; a separate checkpoint thread writes the
+ * dirty blocks out so that slow disk I/O never delays the flushes.
+ *
+ * An append never waits for a checkpoint. When the journal is full the
+ * record goes to an in-memory spill, the checkpoint thread is woken, and the
+ * spilled records move into the journal once the checkpoint has compacted it.
+ * Compaction writes the kept records to a new file that replaces the journal,
+ * so a crash during it leaves either the old journal or the new one.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+#include <process.h>
+
+#include "update_journal.h"
+#include "shared_memory.h"
+#include "memory_layout.h"
+#include "change_tracking.h"
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <string.h>
+
+/// Largest single ReadFile used to load checkpoints
+#define CHECKPOINT_IO_CHUNK (64 * 1024 * 1024)
+
+/// Staging buffer for unbuffered checkpoint writes (a whole number of blocks)
+#define CHECKPOINT_STAGING_BYTES (16 * CHECKPOINT_BLOCK_SIZE)
+
+/// How often the checkpoint thread looks for work
+#define CHECKPOINT_POLL_MS 100
+
+/// Largest backlog of records held in memory while a full journal waits for its checkpoint
+#define JOURNAL_SPILL_BYTES (16 * 1024 * 1024)
+
+/**
+ * @brief An open journal
+ */
+struct RegionJournal {
+    std::string memoryName;     // Region the journal belongs to
+    JournalRole role;           // Source or replica
+    HANDLE file;                // Journal file
+    HANDLE mapping;             // File mapping of the journal
+    char* view;                 // Mapped journal
+    uint64_t capacity;          // Size of the mapping
+    uint64_t tail;              // File offset of the next record
+    uint64_t flushedTail;       // Bytes before this offset are durable
+    size_t regionSize;          // Size of the region when the journal was opened
+    std::vector<char> spill;    // Records appended while the journal was full, not yet durable
+    std::vector<uint64_t> dirtyBlocks;  // Bitmap of blocks changed since the last checkpoint
+    bool dirty;                 // true if any bit in dirtyBlocks is set
+    bool checkpointMatches;     // The checkpoint file holds this region apart from dirty blocks
+    ULONGLONG lastCheckpoint;   // Tick count of the last checkpoint
+};
+
+/// Open journals by region name
+static std::map<std::string, RegionJournal*> g_journals;
+
+/// Mutex protecting g_journals and appends
+static HANDLE g_journalMutex = NULL;
+
+/// Mutex held while the group-commit thread flushes outside g_journalMutex
+static HANDLE g_journalFlushMutex = NULL;
+
+/// Mutex serialising checkpoints
+static HANDLE g_checkpointMutex = NULL;
+
+/// Journal directory; empty while journaling is disabled
+static std::string g_journalDirectory;
+
+/// Size of new journal files
+static size_t g_journalBytes = DEFAULT_JOURNAL_BYTES;
+
+/// Group-commit thread
+static HANDLE g_journalThread = NULL;
+
+/// Flag keeping the group-commit and checkpoint threads running
+static volatile bool g_journalRunning = false;
+
+/// Checkpoint thread
+static HANDLE g_checkpointThread = NULL;
+
+/// Event waking the checkpoint thread when a journal fills up
+static HANDLE g_checkpointEvent = NULL;
+
+/// Milliseconds between checkpoints of a changing region (0 = only when full)
+static volatile uint32_t g_checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL_MS;
+
+/// Regions recovered from a checkpoint of their current size and not yet reopened
+static std::set<std::string> g_recoveredRegions;
+
+static HANDLE createJournalMutex() {
+    HANDLE mutex = CreateMutex(NULL, FALSE, NULL);
+    if (mutex == NULL) {
+        std::cerr << "Failed to create journal mutex: " << GetLastError() << std::endl;
+    }
+    return mutex;
+}
+
+static void lockMutex(HANDLE mutex) {
+    if (mutex != NULL) {
+        WaitForSingleObject(mutex, INFINITE);
+    }
+}
+
+static void unlockMutex(HANDLE mutex) {
+    if (mutex != NULL) {
+        ReleaseMutex(mutex);
+    }
+}
+
+/**
+ * @brief Build the path of a region's journal or checkpoint file
+ */
+static std::string journalFilePath(const char* memoryName, const char* extension) {
+    return g_journalDirectory + "/" + memoryName + extension;
+}
+
+/**
+ * @brief Round a record length up to 8 bytes
+ */
+static uint64_t recordLength(uint32_t dataSize) {
+    return (sizeof(JournalRecord) + dataSize + 7) & ~static_cast<uint64_t>(7);
+}
+
+/**
+ * @brief Number of checkpoint blocks covering a region
+ */
+static size_t checkpointBlockCount(size_t regionSize) {
+    return (regionSize + CHECKPOINT_BLOCK_SIZE - 1) / CHECKPOINT_BLOCK_SIZE;
+}
+
+/**
+ * @brief Mark the checkpoint blocks covering a range as dirty
+ *
+ * Called with g_journalMutex held.
+ */
+static void markBlocksDirty(RegionJournal* journal, uint64_t offset, uint64_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (offset >= journal->regionSize) {
+        // The region has grown; the next checkpoint notices and writes all of it
+        journal->dirty = true;
+        return;
+    }
+
+    uint64_t end = (offset + size < journal->regionSize) ? offset + size : journal->regionSize;
+    for (uint64_t block = offset / CHECKPOINT_BLOCK_SIZE; block <= (end - 1) / CHECKPOINT_BLOCK_SIZE; block++) {
+        journal->dirtyBlocks[block / 64] |= static_cast<uint64_t>(1) << (block % 64);
+    }
+    journal->dirty = true;
+}
+
+/**
+ * @brief Mark every block of a region dirty, so the next checkpoint is a full one
+ */
+static void markAllBlocksDirty(RegionJournal* journal) {
+    size_t blocks = checkpointBlockCount(journal->regionSize);
+    journal->dirtyBlocks.assign((blocks + 63) / 64, ~static_cast<uint64_t>(0));
+    journal->checkpointMatches = false;
+    journal->dirty = true;
+}
+
+/**
+ * @brief FNV-1a checksum of a record's fields and data
+ */
+static uint32_t recordChecksum(const JournalRecord* record, const char* data) {
+    uint32_t hash = 2166136261u;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(record);
+    for (size_t i = 0; i < offsetof(JournalRecord, checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    const unsigned char* payload = reinterpret_cast<const unsigned char*>(data);
+    for (uint32_t i = 0; i < record->size; i++) {
+        hash = (hash ^ payload[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Get the record at a file offset, or NULL if there is no valid record there
+ */
+static const JournalRecord* validRecordAt(const char* view, uint64_t capacity, uint64_t position) {
+    if (position + sizeof(JournalRecord) > capacity) {
+        return NULL;
+    }
+
+    const JournalRecord* record = reinterpret_cast<const JournalRecord*>(view + position);
+    if (record->magic != JOURNAL_RECORD_MAGIC || record->size > MAX_SYNC_DATA_SIZE ||
+        position + recordLength(record->size) > capacity) {
+        return NULL;
+    }
+    if (record->checksum != recordChecksum(record, reinterpret_cast<const char*>(record + 1))) {
+        return NULL;
+    }
+    return record;
+}
+
+/**
+ * @brief Walk the valid records of a buffer of records, a journal or its spill
+ *
+ * @param position Offset of the first record
+ * @param sinceVersion Records at or below this version are skipped
+ * @param updates If not NULL, the remaining records are appended
+ * @param lastComplete If not NULL, receives the highest version whose last chunk was seen
+ * @return Offset just past the last valid record
+ */
+static uint64_t scanRecords(const char* view, uint64_t position, uint64_t capacity, uint64_t sinceVersion,
+                            std::vector<JournalUpdate>* updates, uint64_t* lastComplete) {
+    const JournalRecord* record;
+
+    while ((record = validRecordAt(view, capacity, position)) != NULL) {
+        if (record->version > sinceVersion) {
+            if (updates) {
+                JournalUpdate update;
+                memset(&update.message, 0, sizeof(update.message));
+                update.message.msgType = MSG_SINGLE_UPDATE;
+                update.message.version = record->version;
+                update.message.offset = static_cast<size_t>(record->offset);
+                update.message.size = record->size;
+                memcpy(update.message.data, record + 1, record->size);
+                update.lastChunk = (record->flags & JOURNAL_LAST_CHUNK) != 0;
+                updates->push_back(update);
+            }
+            if (lastComplete && (record->flags & JOURNAL_LAST_CHUNK) && record->version > *lastComplete) {
+                *lastComplete = record->version;
+            }
+        }
+        position += recordLength(record->size);
+    }
+    return position;
+}
+
+/**
+ * @brief Walk the valid records of a mapped journal (see scanRecords)
+ */
+static uint64_t scanJournal(const char* view, uint64_t capacity, uint64_t sinceVersion,
+                            std::vector<JournalUpdate>* updates, uint64_t* lastComplete) {
+    return scanRecords(view, sizeof(JournalFileHeader), capacity, sinceVersion, updates, lastComplete);
+}
+
+/**
+ * @brief Write an update as a record (the record's length must be available at target)
+ */
+static void writeRecord(char* target, const SyncMessage& message, bool lastChunk) {
+    JournalRecord* record = reinterpret_cast<JournalRecord*>(target);
+    memcpy(record + 1, message.data, message.size);
+    record->flags = lastChunk ? JOURNAL_LAST_CHUNK : 0;
+    record->version = message.version;
+    record->offset = message.offset;
+    record->size = static_cast<uint32_t>(message.size);
+    record->magic = JOURNAL_RECORD_MAGIC;
+    record->checksum = recordChecksum(record, message.data);
+}
+
+/**
+ * @brief Open (creating if needed) and map a region's journal file
+ */
+static RegionJournal* mapJournal(const char* memoryName) {
+    std::string path = journalFilePath(memoryName, ".journal");
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                              OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "[JOURNAL] Could not open " << path << ": " << GetLastError() << std::endl;
+        return NULL;
+    }
+
+    // Keep an existing journal's size; size new ones from the configuration
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return NULL;
+    }
+    uint64_t capacity = static_cast<uint64_t>(size.QuadPart);
+    if (capacity < sizeof(JournalFileHeader) + recordLength(MAX_SYNC_DATA_SIZE)) {
+        capacity = g_journalBytes;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE,
+                                        static_cast<DWORD>(capacity >> 32),
+                                        static_cast<DWORD>(capacity & 0xFFFFFFFF), NULL);
+    if (mapping == NULL) {
+        std::cerr << "[JOURNAL] Could not map " << path << ": " << GetLastError() << std::endl;
+        CloseHandle(file);
+        return NULL;
+    }
+
+    char* view = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(capacity)));
+    if (view == NULL) {
+        std::cerr << "[JOURNAL] Could not map view of " << path << ": " << GetLastError() << std::endl;
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return NULL;
+    }
+
+    JournalFileHeader* header = reinterpret_cast<JournalFileHeader*>(view);
+    if (header->magic != JOURNAL_FILE_MAGIC || header->capacity != capacity ||
+        strncmp(header->memoryName, memoryName, MAX_MEMORY_NAME_LENGTH) != 0) {
+        // New (or foreign) file: start an empty journal
+        memset(view, 0, sizeof(JournalFileHeader) + sizeof(JournalRecord));
+        header->capacity = capacity;
+        header->baseVersion = 0;
+        strncpy(header->memoryName, memoryName, MAX_MEMORY_NAME_LENGTH - 1);
+        header->magic = JOURNAL_FILE_MAGIC;
+    }
+
+    RegionJournal* journal = new RegionJournal();
+    journal->memoryName = memoryName;
+    journal->role = JOURNAL_REPLICA;
+    journal->file = file;
+    journal->mapping = mapping;
+    journal->view = view;
+    journal->capacity = capacity;
+    journal->tail = scanJournal(view, capacity, 0, NULL, NULL);
+    journal->flushedTail = sizeof(JournalFileHeader);
+    journal->regionSize = 0;
+    journal->dirty = false;
+    journal->checkpointMatches = false;
+    journal->lastCheckpoint = GetTickCount64();
+    return journal;
+}
+
+/**
+ * @brief Flush and unmap a journal
+ */
+static void unmapJournal(RegionJournal* journal) {
+    FlushViewOfFile(journal->view, static_cast<SIZE_T>(journal->tail));
+    FlushFileBuffers(journal->file);
+    UnmapViewOfFile(journal->view);
+    CloseHandle(journal->mapping);
+    CloseHandle(journal->file);
+    delete journal;
+}
+
+/**
+ * @brief Group-commit thread: flush new journal bytes and start checkpoints
+ */
+static unsigned int __stdcall journalThreadFunc(void* arg) {
+    (void)arg;
+    while (g_journalRunning) {
+        Sleep(JOURNAL_FLUSH_INTERVAL_MS);
+
+        lockMutex(g_journalFlushMutex);
+
+        // Take the ranges to flush under the journal lock, flush them outside it
+        std::vector<RegionJournal*> journals;
+        std::vector<uint64_t> starts;
+        std::vector<uint64_t> ends;
+        lockMutex(g_journalMutex);
+        std::map<std::string, RegionJournal*>::iterator it;
+        for (it = g_journals.begin(); it != g_journals.end(); ++it) {
+            RegionJournal* journal = it->second;
+            if (journal->tail > journal->flushedTail) {
+                journals.push_back(journal);
+                starts.push_back(journal->flushedTail);
+                ends.push_back(journal->tail);
+                journal->flushedTail = journal->tail;
+            }
+        }
+        unlockMutex(g_journalMutex);
+
+        for (size_t i = 0; i < journals.size(); i++) {
+            FlushViewOfFile(journals[i]->view + starts[i], static_cast<SIZE_T>(ends[i] - starts[i]));
+            FlushFileBuffers(journals[i]->file);
+        }
+        unlockMutex(g_journalFlushMutex);
+    }
+    return 0;
+}
+
+/**
+ * @brief Checkpoint thread: checkpoint regions that are due
+ *
+ * A region is due when its journal passes JOURNAL_CHECKPOINT_PERCENT full or
+ * has spilled, or when it has changed and the checkpoint interval has passed.
+ */
+static unsigned int __stdcall checkpointThreadFunc(void* arg) {
+    (void)arg;
+    while (g_journalRunning) {
+        if (g_checkpointEvent != NULL) {
+            WaitForSingleObject(g_checkpointEvent, CHECKPOINT_POLL_MS);
+        } else {
+            Sleep(CHECKPOINT_POLL_MS);
+        }
+
+        std::vector<std::string> due;
+        ULONGLONG now = GetTickCount64();
+        uint32_t interval = g_checkpointInterval;
+
+        lockMutex(g_journalMutex);
+        std::map<std::string, RegionJournal*>::iterator it;
+        for (it = g_journals.begin(); it != g_journals.end(); ++it) {
+            RegionJournal* journal = it->second;
+            bool full = journal->tail * 100 > journal->capacity * JOURNAL_CHECKPOINT_PERCENT || !journal->spill.empty();
+            bool stale = interval > 0 && journal->dirty && now - journal->lastCheckpoint >= interval;
+            if (full || stale) {
+                due.push_back(journal->memoryName);
+            }
+        }
+        unlockMutex(g_journalMutex);
+
+        for (size_t i = 0; i < due.size() && g_journalRunning; i++) {
+            checkpointRegion(due[i].c_str());
+        }
+    }
+    return 0;
+}
+
+bool setJournalDirectory(const char* directory, size_t journalBytes) {
+    if (!directory || directory[0] == '\0') {
+        return false;
+    }
+
+    if (g_journalMutex == NULL) {
+        g_journalMutex = createJournalMutex();
+        g_journalFlushMutex = createJournalMutex();
+        g_checkpointMutex = createJournalMutex();
+        g_checkpointEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    }
+
+    // An existing directory is fine; anything else shows up when files are opened
+    CreateDirectoryA(directory, NULL);
+
+    lockMutex(g_journalMutex);
+    g_journalDirectory = directory;
+    g_journalBytes = (journalBytes > 0) ? journalBytes : DEFAULT_JOURNAL_BYTES;
+    unlockMutex(g_journalMutex);
+
+    if (g_journalThread == NULL) {
+        g_journalRunning = true;
+        unsigned int threadId;
+        g_journalThread = (HANDLE)_beginthreadex(NULL, 0, journalThreadFunc, NULL, 0, &threadId);
+        if (g_journalThread == NULL) {
+            std::cerr << "Failed to create journal thread: " << GetLastError() << std::endl;
+            g_journalRunning = false;
+            return false;
+        }
+
+        g_checkpointThread = (HANDLE)_beginthreadex(NULL, 0, checkpointThreadFunc, NULL, 0, &threadId);
+        if (g_checkpointThread == NULL) {
+            std::cerr << "Failed to create checkpoint thread: " << GetLastError() << std::endl;
+        }
+    }
+
+    std::cout << "[JOURNAL] Journaling to " << directory << std::endl;
+    return true;
+}
+
+void setCheckpointInterval(uint32_t intervalMs) {
+    g_checkpointInterval = intervalMs;
+}
+
+/**
+ * @brief Load a region's checkpoint image, if there is one
+ *
+ * @param version Receives the checkpoint version
+ * @param sameSize Set to true if the checkpoint was taken at the region's current size
+ * @return true if a checkpoint was loaded, false otherwise
+ */
+static bool loadCheckpoint(const char* memoryName, char* region, size_t regionSize,
+                           uint64_t* version, bool* sameSize) {
+    std::string path = journalFilePath(memoryName, ".checkpoint");
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    CheckpointFileHeader header;
+    DWORD bytesRead = 0;
+    LARGE_INTEGER imageStart;
+    imageStart.QuadPart = CHECKPOINT_IMAGE_OFFSET;
+    if (!ReadFile(file, &header, sizeof(header), &bytesRead, NULL) || bytesRead != sizeof(header) ||
+        header.magic != CHECKPOINT_FILE_MAGIC || header.blockSize != CHECKPOINT_BLOCK_SIZE ||
+        strncmp(header.memoryName, memoryName, MAX_MEMORY_NAME_LENGTH) != 0 ||
+        !SetFilePointerEx(file, imageStart, NULL, FILE_BEGIN)) {
+        std::cerr << "[JOURNAL] Ignoring invalid checkpoint " << path << std::endl;
+        CloseHandle(file);
+        return false;
+    }
+
+    uint64_t imageSize = (header.regionSize < regionSize) ? header.regionSize : regionSize;
+    bool sequenced = regionSize >= sizeof(MemoryLayout);
+
+    // The MemoryLayout prefix is read aside so the local sequence and dirty flag survive
+    MemoryLayout prefix;
+    uint64_t position = 0;
+    if (sequenced) {
+        if (!ReadFile(file, &prefix, sizeof(prefix), &bytesRead, NULL) || bytesRead != sizeof(prefix)) {
+            CloseHandle(file);
+            return false;
+        }
+        position = sizeof(MemoryLayout);
+        beginRegionWrite(region);   // Recovery runs before any update could resize the region
+    }
+
+    bool complete = true;
+    while (position < imageSize) {
+        uint64_t remaining = imageSize - position;
+        DWORD chunk = static_cast<DWORD>((remaining < CHECKPOINT_IO_CHUNK) ? remaining : CHECKPOINT_IO_CHUNK);
+        if (!ReadFile(file, region + position, chunk, &bytesRead, NULL) || bytesRead != chunk) {
+            complete = false;
+            break;
+        }
+        position += chunk;
+    }
+
+    if (sequenced) {
+        MemoryLayout* layout = reinterpret_cast<MemoryLayout*>(region);
+        layout->data = prefix.data;
+        layout->last_modified = prefix.last_modified;
+        layout->version = complete ? header.version : 0;
+        endRegionWrite(region);
+    }
+    CloseHandle(file);
+
+    if (!complete) {
+        std::cerr << "[JOURNAL] Checkpoint " << path << " is truncated" << std::endl;
+        return false;
+    }
+    *version = header.version;
+    *sameSize = (header.regionSize == regionSize);
+    return true;
+}
+
+uint64_t recoverRegionFromJournal(const char* memoryName, bool* recovered) {
+    if (recovered) {
+        *recovered = false;
+    }
+    if (g_journalDirectory.empty()) {
+        return 0;
+    }
+
+    size_t regionSize = 0;
+    char* region = static_cast<char*>(getSharedMemoryMapping(memoryName, &regionSize));
+    if (!region) {
+        return 0;
+    }
+
+    uint64_t checkpointVersion = 0;
+    bool sameSize = false;
+    if (loadCheckpoint(memoryName, region, regionSize, &checkpointVersion, &sameSize)) {
+        if (recovered) {
+            *recovered = true;
+        }
+
+        // The checkpoint now matches the region, so the next one can be incremental
+        if (sameSize) {
+            lockMutex(g_journalMutex);
+            g_recoveredRegions.insert(memoryName);
+            unlockMutex(g_journalMutex);
+        }
+    }
+
+    RegionJournal* journal = mapJournal(memoryName);
+    if (!journal) {
+        return checkpointVersion;
+    }
+
+    const JournalFileHeader* header = reinterpret_cast<const JournalFileHeader*>(journal->view);
+    std::vector<JournalUpdate> updates;
+    uint64_t lastComplete = 0;
+    scanJournal(journal->view, journal->capacity, 0, &updates, &lastComplete);
+
+    // Replay every record in order through applyUpdate: some may predate the
+    // checkpoint, but they are followed by everything written after them, so
+    // the last writer still wins. The journal isn't registered yet, so
+    // nothing is re-journaled.
+    for (size_t i = 0; i < updates.size(); i++) {
+        SyncMessage& message = updates[i].message;
+        strncpy(message.memoryName, memoryName, MAX_MEMORY_NAME_LENGTH - 1);
+        message.flags = updates[i].lastChunk ? 0 : SYNC_FLAG_MORE_IN_VERSION;
+        applyUpdate(message);
+    }
+    if (!updates.empty() && recovered) {
+        *recovered = true;
+    }
+
+    // Records only mean something on top of the checkpoint they were compacted against
+    uint64_t version = checkpointVersion;
+    if (header->baseVersion > checkpointVersion) {
+        std::cerr << "[JOURNAL] Journal for " << memoryName << " is newer than its checkpoint" << std::endl;
+        version = 0;
+    } else if (lastComplete > version) {
+        version = lastComplete;
+    }
+
+    if (regionSize >= sizeof(MemoryLayout)) {
+        reinterpret_cast<MemoryLayout*>(region)->version = version;
+    }
+
+    std::cout << "[JOURNAL] Recovered " << memoryName << " to version " << version << " ("
+              << updates.size() << " journal records replayed)" << std::endl;
+    unmapJournal(journal);
+    return version;
+}
+
+bool openUpdateJournal(const char* memoryName, JournalRole role) {
+    if (g_journalDirectory.empty()) {
+        return false;
+    }
+
+    lockMutex(g_journalMutex);
+    if (g_journals.find(memoryName) != g_journals.end()) {
+        unlockMutex(g_journalMutex);
+        return true;
+    }
+
+    RegionJournal* journal = mapJournal(memoryName);
+    if (!journal) {
+        unlockMutex(g_journalMutex);
+        return false;
+    }
+    journal->role = role;
+
+    // Keep everything past the tail zeroed so only this run's records follow it
+    memset(journal->view + journal->tail, 0, static_cast<size_t>(journal->capacity - journal->tail));
+
+    // A checkpoint that was just recovered from only lacks the journaled blocks;
+    // anything else needs a full checkpoint first
+    journal->regionSize = getSharedMemorySize(memoryName);
+    markAllBlocksDirty(journal);
+    std::set<std::string>::iterator recoveredIt = g_recoveredRegions.find(memoryName);
+    if (recoveredIt != g_recoveredRegions.end()) {
+        g_recoveredRegions.erase(recoveredIt);
+        std::fill(journal->dirtyBlocks.begin(), journal->dirtyBlocks.end(), 0);
+        journal->checkpointMatches = true;
+        journal->dirty = false;
+
+        uint64_t position = sizeof(JournalFileHeader);
+        const JournalRecord* record;
+        while ((record = validRecordAt(journal->view, journal->capacity, position)) != NULL) {
+            markBlocksDirty(journal, record->offset, record->size);
+            position += recordLength(record->size);
+        }
+    }
+    g_journals[memoryName] = journal;
+    bool needsBase = (role == JOURNAL_SOURCE &&
+                      reinterpret_cast<JournalFileHeader*>(journal->view)->baseVersion == 0);
+    unlockMutex(g_journalMutex);
+
+    // A source needs a checkpoint to answer peers that are older than its journal
+    if (needsBase) {
+        checkpointRegion(memoryName);
+    }
+    return true;
+}
+
+void closeUpdateJournal(const char* memoryName) {
+    // A checkpoint in progress reads the journal outside g_journalMutex while it compacts it
+    lockMutex(g_checkpointMutex);
+    lockMutex(g_journalFlushMutex);
+    lockMutex(g_journalMutex);
+    std::map<std::string, RegionJournal*>::iterator it = g_journals.find(memoryName);
+    if (it != g_journals.end()) {
+        if (!it->second->spill.empty()) {
+            std::cerr << "[JOURNAL] Closing " << memoryName << " with " << it->second->spill.size()
+                      << " bytes of records that never fit in the journal" << std::endl;
+        }
+        unmapJournal(it->second);
+        g_journals.erase(it);
+    }
+    unlockMutex(g_journalMutex);
+    unlockMutex(g_journalFlushMutex);
+    unlockMutex(g_checkpointMutex);
+}
+
+void journalUpdate(const SyncMessage& message, bool lastChunk) {
+    if (g_journalMutex == NULL || message.size > MAX_SYNC_DATA_SIZE) {
+        return;
+    }
+
+    uint64_t length = recordLength(static_cast<uint32_t>(message.size));
+    lockMutex(g_journalMutex);
+    std::map<std::string, RegionJournal*>::iterator it = g_journals.find(message.memoryName);
+    if (it == g_journals.end()) {
+        unlockMutex(g_journalMutex);
+        return;
+    }
+
+    // Records keep their order: once one has spilled, the rest follow it
+    RegionJournal* journal = it->second;
+    markBlocksDirty(journal, message.offset, message.size);
+    if (journal->spill.empty() && journal->tail + length + sizeof(JournalRecord) <= journal->capacity) {
+        writeRecord(journal->view + journal->tail, message, lastChunk);
+        journal->tail += length;
+        unlockMutex(g_journalMutex);
+        return;
+    }
+
+    // Full: the checkpoint thread compacts the journal and moves the spill in after it
+    bool spilled = journal->spill.size() + length <= JOURNAL_SPILL_BYTES;
+    if (spilled) {
+        size_t position = journal->spill.size();
+        journal->spill.resize(position + static_cast<size_t>(length), 0);
+        writeRecord(&journal->spill[position], message, lastChunk);
+    }
+    unlockMutex(g_journalMutex);
+
+    if (g_checkpointEvent != NULL) {
+        SetEvent(g_checkpointEvent);
+    }
+    if (!spilled) {
+        std::cerr << "[JOURNAL] Journal for " << message.memoryName << " is full, update not journaled" << std::endl;
+    }
+}
+
+/**
+ * @brief A compacted copy of a journal, written next to it before it replaces it
+ */
+struct CompactedJournal {
+    HANDLE file;
+    HANDLE mapping;
+    char* view;
+    uint64_t tail;      // File offset of the next record
+};
+
+/**
+ * @brief Unmap a compacted copy that won't replace its journal and delete it
+ */
+static void discardCompaction(const char* memoryName, CompactedJournal* next) {
+    if (next->view) {
+        UnmapViewOfFile(next->view);
+    }
+    if (next->mapping) {
+        CloseHandle(next->mapping);
+    }
+    CloseHandle(next->file);
+    DeleteFileA(journalFilePath(memoryName, ".journal.tmp").c_str());
+}
+
+/**
+ * @brief Start a compacted copy of a journal without the records covered by a checkpoint
+ *
+ * A record is covered if it was already in the journal when the checkpoint
+ * took its dirty blocks (before cutTail) and is not newer than the checkpoint
+ * version. Copies and flushes the uncovered records before cutTail. Runs
+ * without g_journalMutex: appends only go past cutTail, and the journal stays
+ * mapped while g_checkpointMutex is held.
+ */
+static bool beginCompaction(RegionJournal* journal, uint64_t cutTail, uint64_t checkpointVersion,
+                            CompactedJournal* next) {
+    const char* memoryName = journal->memoryName.c_str();
+    std::string path = journalFilePath(memoryName, ".journal.tmp");
+    next->file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (next->file == INVALID_HANDLE_VALUE) {
+        std::cerr << "[JOURNAL] Could not create " << path << ": " << GetLastError() << std::endl;
+        return false;
+    }
+
+    // A new file reads as zeros, so nothing follows the copied records
+    next->view = NULL;
+    next->mapping = CreateFileMappingA(next->file, NULL, PAGE_READWRITE, static_cast<DWORD>(journal->capacity >> 32),
+                                       static_cast<DWORD>(journal->capacity & 0xFFFFFFFF), NULL);
+    if (next->mapping) {
+        next->view = static_cast<char*>(MapViewOfFile(next->mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+                                                      static_cast<SIZE_T>(journal->capacity)));
+    }
+    if (!next->view) {
+        std::cerr << "[JOURNAL] Could not map " << path << ": " << GetLastError() << std::endl;
+        discardCompaction(memoryName, next);
+        return false;
+    }
+
+    memcpy(next->view, journal->view, sizeof(JournalFileHeader));
+    reinterpret_cast<JournalFileHeader*>(next->view)->baseVersion = checkpointVersion;
+    uint64_t read = sizeof(JournalFileHeader);
+    uint64_t write = sizeof(JournalFileHeader);
+    const JournalRecord* record;
+    while (read < cutTail && (record = validRecordAt(journal->view, journal->capacity, read)) != NULL) {
+        uint64_t length = recordLength(record->size);
+        if (record->version > checkpointVersion) {
+            memcpy(next->view + write, record, static_cast<size_t>(length));
+            write += length;
+        }
+        read += length;
+    }
+    next->tail = write;
+
+    if (!FlushViewOfFile(next->view, static_cast<SIZE_T>(write)) || !FlushFileBuffers(next->file)) {
+        std::cerr << "[JOURNAL] Could not flush " << path << ": " << GetLastError() << std::endl;
+        discardCompaction(memoryName, next);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Finish a compacted copy and make it the journal
+ *
+ * Called with g_journalFlushMutex and g_journalMutex held. Copies the records
+ * appended since cutTail, flushes them, and renames the copy over the
+ * journal. The old journal is unmapped first, as Windows won't replace a
+ * mapped file.
+ */
+static bool finishCompaction(RegionJournal* journal, uint64_t cutTail, CompactedJournal* next) {
+    const char* memoryName = journal->memoryName.c_str();
+    uint64_t appended = journal->tail - cutTail;
+    memcpy(next->view + next->tail, journal->view + cutTail, static_cast<size_t>(appended));
+    if (!FlushViewOfFile(next->view + next->tail, static_cast<SIZE_T>(appended)) || !FlushFileBuffers(next->file)) {
+        std::cerr << "[JOURNAL] Could not flush the compacted journal of " << memoryName << ": "
+                  << GetLastError() << std::endl;
+        discardCompaction(memoryName, next);
+        return false;
+    }
+    next->tail += appended;
+
+    UnmapViewOfFile(journal->view);
+    CloseHandle(journal->mapping);
+    CloseHandle(journal->file);
+    journal->file = next->file;
+    journal->mapping = next->mapping;
+    journal->view = next->view;
+    journal->tail = next->tail;
+    journal->flushedTail = next->tail;
+
+    std::string path = journalFilePath(memoryName, ".journal");
+    std::string compacted = path + ".tmp";
+    if (!MoveFileExA(compacted.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        // Appends go on into the compacted file; a restart before the next compaction replays the old one
+        std::cerr << "[JOURNAL] Could not replace " << path << ": " << GetLastError() << std::endl;
+    }
+    return true;
+}
+
+/**
+ * @brief Move spilled records into the journal, as many as fit
+ *
+ * Called with g_journalMutex held. Records spilled before cutSpill are
+ * covered by the checkpoint, and dropped, on the same terms as the journal's.
+ */
+static void drainSpill(RegionJournal* journal, size_t cutSpill, uint64_t checkpointVersion) {
+    std::vector<char> kept;
+    size_t position = 0;
+    while (position < journal->spill.size()) {
+        const JournalRecord* record = reinterpret_cast<const JournalRecord*>(&journal->spill[position]);
+        size_t length = static_cast<size_t>(recordLength(record->size));
+        if (position >= cutSpill || record->version > checkpointVersion) {
+            if (kept.empty() && journal->tail + length + sizeof(JournalRecord) <= journal->capacity) {
+                memcpy(journal->view + journal->tail, record, length);
+                journal->tail += length;
+            } else {
+                kept.insert(kept.end(), journal->spill.begin() + position, journal->spill.begin() + position + length);
+            }
+        }
+        position += length;
+    }
+    journal->spill.swap(kept);
+}
+
+/**
+ * @brief Write part of a region to a checkpoint file through the staging buffer
+ *
+ * The file is opened for unbuffered I/O, so every write starts on a sector
+ * boundary and covers whole sectors; the end of the region is zero-padded.
+ */
+static bool writeCheckpointRange(HANDLE file, char* staging, const char* region, size_t regionSize,
+                                 uint64_t offset, uint64_t size) {
+    while (size > 0) {
+        uint64_t chunk = (size < CHECKPOINT_STAGING_BYTES) ? size : CHECKPOINT_STAGING_BYTES;
+        uint64_t copy = (offset + chunk <= regionSize) ? chunk : regionSize - offset;
+        uint64_t padded = (chunk + CHECKPOINT_SECTOR_SIZE - 1) & ~static_cast<uint64_t>(CHECKPOINT_SECTOR_SIZE - 1);
+        memcpy(staging, region + offset, static_cast<size_t>(copy));
+        memset(staging + copy, 0, static_cast<size_t>(padded - copy));
+
+        LARGE_INTEGER position;
+        position.QuadPart = CHECKPOINT_IMAGE_OFFSET + offset;
+        DWORD written = 0;
+        if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN) ||
+            !WriteFile(file, staging, static_cast<DWORD>(padded), &written, NULL) || written != padded) {
+            return false;
+        }
+        offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+/**
+ * @brief Write the header sector of a checkpoint file
+ */
+static bool writeCheckpointHeader(HANDLE file, char* staging, const char* memoryName,
+                                  uint64_t version, size_t regionSize) {
+    memset(staging, 0, CHECKPOINT_SECTOR_SIZE);
+    CheckpointFileHeader* header = reinterpret_cast<CheckpointFileHeader*>(staging);
+    header->magic = CHECKPOINT_FILE_MAGIC;
+    header->blockSize = CHECKPOINT_BLOCK_SIZE;
+    header->version = version;
+    header->regionSize = regionSize;
+    strncpy(header->memoryName, memoryName, MAX_MEMORY_NAME_LENGTH - 1);
+
+    LARGE_INTEGER position;
+    position.QuadPart = 0;
+    DWORD written = 0;
+    return SetFilePointerEx(file, position, NULL, FILE_BEGIN) &&
+           WriteFile(file, staging, CHECKPOINT_SECTOR_SIZE, &written, NULL) && written == CHECKPOINT_SECTOR_SIZE;
+}
+
+/**
+ * @brief Write the dirty blocks of a region to its checkpoint file
+ *
+ * A full checkpoint goes to a temporary file that replaces the old one once it
+ * is complete. An incremental one rewrites blocks in place and updates the
+ * header last; until then the old header version stays, and the journal
+ * records it needs are still there.
+ */
+static bool writeCheckpoint(const char* memoryName, const char* region, size_t regionSize,
+                            uint64_t version, const std::vector<uint64_t>& blocks, bool full) {
+    std::string path = journalFilePath(memoryName, ".checkpoint");
+    std::string target = full ? path + ".tmp" : path;
+    HANDLE file = CreateFileA(target.c_str(), GENERIC_WRITE, 0, NULL, full ? CREATE_ALWAYS : OPEN_EXISTING,
+                              FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "[JOURNAL] Could not open " << target << ": " << GetLastError() << std::endl;
+        return false;
+    }
+
+    char* staging = static_cast<char*>(VirtualAlloc(NULL, CHECKPOINT_STAGING_BYTES, MEM_COMMIT | MEM_RESERVE,
+                                                    PAGE_READWRITE));
+    bool ok = (staging != NULL);
+
+    // A full checkpoint needs its header up front, so the file is valid once renamed
+    if (ok && full) {
+        ok = writeCheckpointHeader(file, staging, memoryName, version, regionSize);
+    }
+
+    // Write runs of consecutive dirty blocks with as few calls as possible
+    size_t blockCount = checkpointBlockCount(regionSize);
+    size_t written = 0;
+    for (size_t block = 0; ok && block < blockCount; ) {
+        if (!(blocks[block / 64] & (static_cast<uint64_t>(1) << (block % 64)))) {
+            block++;
+            continue;
+        }
+        size_t first = block;
+        while (block < blockCount && (blocks[block / 64] & (static_cast<uint64_t>(1) << (block % 64)))) {
+            block++;
+        }
+        uint64_t offset = static_cast<uint64_t>(first) * CHECKPOINT_BLOCK_SIZE;
+        uint64_t end = static_cast<uint64_t>(block) * CHECKPOINT_BLOCK_SIZE;
+        if (end > regionSize) {
+            end = regionSize;
+        }
+        ok = writeCheckpointRange(file, staging, region, regionSize, offset, end - offset);
+        written += block - first;
+    }
+
+    // The blocks must be durable before the header claims the new version
+    if (ok && !full) {
+        ok = FlushFileBuffers(file) && writeCheckpointHeader(file, staging, memoryName, version, regionSize);
+    }
+    ok = ok && FlushFileBuffers(file);
+
+    if (staging) {
+        VirtualFree(staging, 0, MEM_RELEASE);
+    }
+    CloseHandle(file);
+
+    if (ok && full) {
+        ok = MoveFileExA(target.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+    }
+    if (!ok) {
+        std::cerr << "[JOURNAL] Failed to write checkpoint " << path << ": " << GetLastError() << std::endl;
+        if (full) {
+            DeleteFileA(target.c_str());
+        }
+        return false;
+    }
+
+    std::cout << "[JOURNAL] Checkpointed " << memoryName << " at version " << version << " ("
+              << written << " of " << blockCount << " blocks)" << std::endl;
+    return true;
+}
+
+bool checkpointRegion(const char* memoryName) {
+    if (g_journalDirectory.empty()) {
+        return false;
+    }
+
+    size_t regionSize = 0;
+    const char* region = static_cast<const char*>(getSharedMemoryMapping(memoryName, &regionSize));
+    if (!region) {
+        return false;
+    }
+
+    lockMutex(g_checkpointMutex);
+
+    // Take the dirty blocks and remember where the journal ended. Updates
+    // after this point mark blocks for the next checkpoint and their records
+    // survive compaction, so the copy below may race with them freely.
+    lockMutex(g_journalMutex);
+    std::map<std::string, RegionJournal*>::iterator it = g_journals.find(memoryName);
+    if (it == g_journals.end()) {
+        unlockMutex(g_journalMutex);
+        unlockMutex(g_checkpointMutex);
+        return false;
+    }
+    RegionJournal* journal = it->second;
+    if (journal->regionSize != regionSize) {
+        journal->regionSize = regionSize;
+        markAllBlocksDirty(journal);
+    }
+    std::vector<uint64_t> blocks(journal->dirtyBlocks.size(), 0);
+    blocks.swap(journal->dirtyBlocks);
+    bool full = !journal->checkpointMatches;
+    uint64_t cutTail = journal->tail;
+    size_t cutSpill = journal->spill.size();
+    journal->dirty = false;
+    unlockMutex(g_journalMutex);
+
+    // Everything journaled before the cut is applied by the time it is journaled
+    uint64_t version = 0;
+    if (regionSize >= sizeof(MemoryLayout)) {
+        version = reinterpret_cast<const MemoryLayout*>(region)->version;
+        MemoryBarrier();
+    }
+
+    bool ok = writeCheckpoint(memoryName, region, regionSize, version, blocks, full);
+
+    // The journal can't be closed while g_checkpointMutex is held
+    CompactedJournal next;
+    bool compacting = ok && beginCompaction(journal, cutTail, version, &next);
+
+    lockMutex(g_journalFlushMutex);
+    lockMutex(g_journalMutex);
+    it = g_journals.find(memoryName);
+    if (it != g_journals.end() && it->second == journal) {
+        if (ok) {
+            if (compacting) {
+                finishCompaction(journal, cutTail, &next);
+            }
+            drainSpill(journal, cutSpill, version);
+            journal->checkpointMatches = true;
+        } else if (journal->dirtyBlocks.size() == blocks.size()) {
+            // Put the blocks back for the next attempt
+            for (size_t i = 0; i < blocks.size(); i++) {
+                journal->dirtyBlocks[i] |= blocks[i];
+            }
+            journal->dirty = true;
+        }
+        journal->lastCheckpoint = GetTickCount64();
+    }
+    unlockMutex(g_journalMutex);
+    unlockMutex(g_journalFlushMutex);
+
+    unlockMutex(g_checkpointMutex);
+    return ok;
+}
+
+bool isJournalSource(const char* memoryName) {
+    if (g_journalMutex == NULL) {
+        return false;
+    }
+
+    lockMutex(g_journalMutex);
+    std::map<std::string, RegionJournal*>::iterator it = g_journals.find(memoryName);
+    bool source = (it != g_journals.end() && it->second->role == JOURNAL_SOURCE);
+    unlockMutex(g_journalMutex);
+    return source;
+}
+
+bool collectJournalUpdates(const char* memoryName, uint64_t sinceVersion, std::vector<JournalUpdate>& updates) {
+    if (g_journalMutex == NULL) {
+        return false;
+    }
+
+    lockMutex(g_journalMutex);
+    std::map<std::string, RegionJournal*>::iterator it = g_journals.find(memoryName);
+    if (it == g_journals.end()) {
+        unlockMutex(g_journalMutex);
+        return false;
+    }
+
+    RegionJournal* journal = it->second;
+    const JournalFileHeader* header = reinterpret_cast<const JournalFileHeader*>(journal->view);
+    bool covered = (sinceVersion >= header->baseVersion);
+    if (covered) {
+        size_t first = updates.size();
+        scanJournal(journal->view, journal->capacity, sinceVersion, &updates, NULL);
+        if (!journal->spill.empty()) {
+            scanRecords(&journal->spill[0], 0, journal->spill.size(), sinceVersion, &updates, NULL);
+        }
+        for (size_t i = first; i < updates.size(); i++) {
+            strncpy(updates[i].message.memoryName, memoryName, MAX_MEMORY_NAME_LENGTH - 1);
+        }
+    }
+    unlockMutex(g_journalMutex);
+    return covered;
+}
+
+void shutdownUpdateJournals() {
+    if (g_journalThread) {
+        g_journalRunning = false;
+        if (g_checkpointEvent != NULL) {
+            SetEvent(g_checkpointEvent);
+        }
+        WaitForSingleObject(g_journalThread, INFINITE);
+        CloseHandle(g_journalThread);
+        g_journalThread = NULL;
+    }
+    if (g_checkpointThread) {
+        WaitForSingleObject(g_checkpointThread, INFINITE);
+        CloseHandle(g_checkpointThread);
+        g_checkpointThread = NULL;
+    }
+
+    lockMutex(g_checkpointMutex);
+    lockMutex(g_journalMutex);
+    std::map<std::string, RegionJournal*>::iterator it;
+    for (it = g_journals.begin(); it != g_journals.end(); ++it) {
+        unmapJournal(it->second);
+    }
+    g_journals.clear();
+    g_recoveredRegions.clear();
+    g_journalDirectory.clear();
+    unlockMutex(g_journalMutex);
+    unlockMutex(g_checkpointMutex);
+}
@@ -0,0 +1,199 @@
+#ifndef UPDATE_JOURNAL_H
+#define UPDATE_JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "sync_message.h"
+
+/**
+ * @brief Write-ahead journal of region updates for crash recovery and fast restart
+ *
+ * When a journal directory is configured, each journaled region gets two files:
+ *  - "<region>.journal": a memory-mapped, append-only log of updates. Appends
+ *    are a memcpy into the mapping; a background thread group-commits them
+ *    (FlushViewOfFile + FlushFileBuffers) every JOURNAL_FLUSH_INTERVAL_MS.
+ *  - "<region>.checkpoint": an image of the region at some version. A
+ *    checkpoint thread refreshes it every checkpoint interval, or sooner when
+ *    the journal passes JOURNAL_CHECKPOINT_PERCENT full. Only blocks touched
+ *    by journaled updates since the previous checkpoint are rewritten, with
+ *    unbuffered write-through I/O, so checkpoint bandwidth follows the rate
+ *    of change rather than the region size. The journal is then compacted to
+ *    the records the new image doesn't cover, written to a new file that
+ *    replaces it. An update that finds the journal full is held in memory
+ *    and the checkpoint thread is woken; it reaches the journal, and disk,
+ *    once the checkpoint has made room.
+ *
+ * On restart a region is rebuilt from its checkpoint plus the journal tail,
+ * and only updates newer than the recovered version are requested from the
+ * region's source (MSG_RESYNC_REQUEST). A source answers from its own journal
+ * when that covers the requested version, and otherwise sends only the blocks
+ * whose hashes differ from the requester's copy (see block_hash.h).
+ *
+ * Records carry the source version of their update, a flag on the last chunk
+ * of each update and a checksum, so a torn tail or a half-written update is
+ * detected and the recovered version is the last complete one. The unused
+ * part of the journal is kept zeroed, so stale records are never replayed.
+ *
+ * Checkpoints never lock the region. Blocks are copied while writers keep
+ * going; every byte that may have changed during the copy is also in a
+ * journal record that compaction keeps, so replaying the journal over the
+ * image always yields a consistent region.
+ */
+
+#define JOURNAL_FILE_MAGIC 0x314C4E4Au         // "JNL1"
+#define JOURNAL_RECORD_MAGIC 0x3143524Au       // "JRC1"
+#define CHECKPOINT_FILE_MAGIC 0x32504B43u      // "CKP2"
+#define JOURNAL_LAST_CHUNK 0x1u                // Record is the last chunk of its update
+#define JOURNAL_FLUSH_INTERVAL_MS 5
+#define JOURNAL_CHECKPOINT_PERCENT 50
+#define DEFAULT_JOURNAL_BYTES (64 * 1024 * 1024)
+#define DEFAULT_CHECKPOINT_INTERVAL_MS 60000
+#define CHECKPOINT_BLOCK_SIZE (64 * 1024)      // Dirty tracking granularity
+#define CHECKPOINT_SECTOR_SIZE 4096            // Alignment for unbuffered I/O
+#define CHECKPOINT_IMAGE_OFFSET CHECKPOINT_SECTOR_SIZE
+
+/**
+ * @brief Role of this node for a journaled region
+ */
+typedef enum {
+    JOURNAL_SOURCE,     // Region is written locally; the journal serves resync requests
+    JOURNAL_REPLICA     // Region is a replica; the journal records applied updates
+} JournalRole;
+
+/**
+ * @brief Header at the start of a journal file
+ */
+typedef struct {
+    uint32_t magic;                             // JOURNAL_FILE_MAGIC
+    uint32_t reserved;
+    uint64_t capacity;                          // Size of the journal file in bytes
+    uint64_t baseVersion;                       // Version of the checkpoint the records build on
+    char memoryName[MAX_MEMORY_NAME_LENGTH];    // Region the journal belongs to
+} JournalFileHeader;
+
+/**
+ * @brief Header in front of each journaled update (data follows, padded to 8 bytes)
+ */
+typedef struct {
+    uint32_t magic;         // JOURNAL_RECORD_MAGIC
+    uint32_t flags;         // JOURNAL_LAST_CHUNK
+    uint64_t version;       // Source version of the update
+    uint64_t offset;        // Region offset of the data
+    uint32_t size;          // Data size in bytes
+    uint32_t checksum;      // Checksum of the fields above and the data
+} JournalRecord;
+
+/**
+ * @brief Header at the start of a checkpoint file
+ *
+ * The region image starts at CHECKPOINT_IMAGE_OFFSET.
+ */
+typedef struct {
+    uint32_t magic;                             // CHECKPOINT_FILE_MAGIC
+    uint32_t blockSize;                         // CHECKPOINT_BLOCK_SIZE when written
+    uint64_t version;                           // Region version the image is consistent with
+    uint64_t regionSize;                        // Size of the image in bytes
+    char memoryName[MAX_MEMORY_NAME_LENGTH];    // Region the image belongs to
+} CheckpointFileHeader;
+
+/**
+ * @brief An update read back from a journal
+ */
+struct JournalUpdate {
+    SyncMessage message;    // The update, with offset, size, data and version set
+    bool lastChunk;         // true if this is the last chunk of its update
+};
+
+/**
+ * @brief Enable journaling and set where journal and checkpoint files live
+ *
+ * Starts the group-commit thread. Must be called before openUpdateJournal.
+ *
+ * @param directory Directory for journal and checkpoint files (created if needed)
+ * @param journalBytes Size of each region's journal file
+ * @return true if journaling is enabled, false otherwise
+ */
+bool setJournalDirectory(const char* directory, size_t journalBytes);
+
+/**
+ * @brief Set how often regions with changes are checkpointed
+ *
+ * @param intervalMs Milliseconds between checkpoints of a changing region,
+ *                   0 to checkpoint only when a journal fills up
+ */
+void setCheckpointInterval(uint32_t intervalMs);
+
+/**
+ * @brief Rebuild a freshly created region from its checkpoint and journal
+ *
+ * Must be called before openUpdateJournal for the region. Replayed updates
+ * go through applyUpdate, so apply observers see them.
+ *
+ * @param memoryName Name of the shared memory region (already initialized)
+ * @param recovered Set to true if any checkpoint or journal data was applied
+ * @return The version the region was recovered to (0 if nothing was recovered)
+ */
+uint64_t recoverRegionFromJournal(const char* memoryName, bool* recovered);
+
+/**
+ * @brief Start journaling updates of a region
+ *
+ * @param memoryName Name of the shared memory region
+ * @param role Whether the region is written locally or replicated
+ * @return true if the journal is open, false otherwise
+ */
+bool openUpdateJournal(const char* memoryName, JournalRole role);
+
+/**
+ * @brief Flush and stop journaling a region
+ *
+ * @param memoryName Name of the shared memory region
+ */
+void closeUpdateJournal(const char* memoryName);
+
+/**
+ * @brief Append an update to the region's journal (no-op if the region isn't journaled)
+ *
+ * @param message The update; its version field is recorded
+ * @param lastChunk true if this is the last chunk of the update
+ */
+void journalUpdate(const SyncMessage& message, bool lastChunk);
+
+/**
+ * @brief Write a checkpoint of a region and compact its journal
+ *
+ * Writes the blocks changed since the last checkpoint, or the whole region
+ * if the checkpoint file doesn't match it yet. Normally called by the
+ * checkpoint thread; the region must have an open journal.
+ *
+ * @param memoryName Name of the shared memory region
+ * @return true if the checkpoint was written, false otherwise
+ */
+bool checkpointRegion(const char* memoryName);
+
+/**
+ * @brief Check whether this node is the journaling source of a region
+ *
+ * @param memoryName Name of the shared memory region
+ * @return true if the region's journal was opened with JOURNAL_SOURCE
+ */
+bool isJournalSource(const char* memoryName);
+
+/**
+ * @brief Read the journaled updates newer than a version
+ *
+ * @param memoryName Name of the shared memory region
+ * @param sinceVersion Only updates with a version above this are returned
+ * @param updates Output vector the updates are appended to, in journal order
+ * @return true if the journal covers everything after sinceVersion, false if
+ *         the caller must fall back to a block-hash resync
+ */
+bool collectJournalUpdates(const char* memoryName, uint64_t sinceVersion, std::vector<JournalUpdate>& updates);
+
+/**
+ * @brief Flush and close all journals and stop the group-commit thread
+ */
+void shutdownUpdateJournals();
+
+#endif // UPDATE_JOURNAL_H
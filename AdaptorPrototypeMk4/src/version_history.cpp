@@ -0,0 +1,309 @@
+/**
+ * @file version_history.cpp
+ * @brief Implementation of per-region version histories
+ *
+ * Each history is an apply observer. Records are appended to a byte ring:
+ * a record that doesn't fit before the end of the ring starts again at the
+ * bottom, dropping the oldest records until there is room. Dropping a record
+ * raises the oldest readable version past the record's version.
+ *
+ * A record's version is the region version when the update was applied, so
+ * its bytes are what the region held at that version and every earlier one
+ * back to the previous change of the range. Reading at version V therefore
+ * takes, for every byte, the old bytes of the oldest record at or after V
+ * that covers it, or the current contents if there is none.
+ */
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "version_history.h"
+#include "shared_memory.h"
+#include "memory_layout.h"
+#include "change_tracking.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <string.h>
+
+/**
+ * @brief Header of a record in the ring; the overwritten bytes follow it
+ */
+struct HistoryRecord {
+    uint64_t version;   // Region version when the update was applied
+    uint64_t offset;    // Region offset of the overwritten bytes
+    uint32_t size;      // Number of overwritten bytes
+    uint32_t length;    // Bytes the record takes in the ring, padded to 8
+};
+
+/**
+ * @brief State of one version history
+ */
+struct VersionHistory {
+    std::string memoryName;     // Region the history records
+    std::vector<char> ring;     // Record storage
+    size_t head;                // Ring offset of the oldest record
+    size_t tail;                // Ring offset the next record goes to
+    size_t wrapEnd;             // End of the records above head while they wrap
+    bool wrapped;               // Records run from head to wrapEnd, then from 0 to tail
+    size_t count;               // Number of records in the ring
+    uint64_t oldestVersion;     // Oldest version that can be rebuilt
+};
+
+/// Histories by handle
+static std::map<int, VersionHistory*> g_histories;
+
+/// Next handle to hand out
+static int g_nextHistoryHandle = 0;
+
+/// Mutex protecting the histories (reads run on application threads, records are added on the receive thread)
+static HANDLE g_historyMutex = NULL;
+
+static void lockHistoryMutex() {
+    if (g_historyMutex == NULL) {
+        g_historyMutex = CreateMutex(NULL, FALSE, NULL);
+        if (g_historyMutex == NULL) {
+            std::cerr << "Failed to create history mutex: " << GetLastError() << std::endl;
+        }
+    }
+    if (g_historyMutex != NULL) {
+        WaitForSingleObject(g_historyMutex, INFINITE);
+    }
+}
+
+static void unlockHistoryMutex() {
+    if (g_historyMutex != NULL) {
+        ReleaseMutex(g_historyMutex);
+    }
+}
+
+static size_t recordLength(size_t size) {
+    return (sizeof(HistoryRecord) + size + 7) & ~static_cast<size_t>(7);
+}
+
+static const HistoryRecord* recordAt(const VersionHistory* history, size_t position) {
+    return reinterpret_cast<const HistoryRecord*>(&history->ring[position]);
+}
+
+/**
+ * @brief Drop the oldest record, raising the oldest readable version past it
+ */
+static void dropOldestRecord(VersionHistory* history) {
+    const HistoryRecord* record = recordAt(history, history->head);
+    if (record->version + 1 > history->oldestVersion) {
+        history->oldestVersion = record->version + 1;
+    }
+    history->head += record->length;
+    history->count--;
+    if (history->wrapped && history->head == history->wrapEnd) {
+        history->head = 0;
+        history->wrapped = false;
+    }
+}
+
+static void appendRecord(VersionHistory* history, uint64_t version, size_t offset, size_t size, const void* oldData) {
+    size_t length = recordLength(size);
+    if (length > history->ring.size()) {
+        // Can't be kept at all, so nothing before it can be rebuilt either
+        history->count = 0;
+        history->head = history->tail = 0;
+        history->wrapped = false;
+        history->oldestVersion = version + 1;
+        return;
+    }
+
+    for (;;) {
+        if (history->count == 0) {
+            history->head = history->tail = 0;
+            history->wrapped = false;
+        }
+        if (!history->wrapped) {
+            if (history->ring.size() - history->tail >= length) {
+                break;
+            }
+            // Start again at the bottom of the ring
+            history->wrapEnd = history->tail;
+            history->tail = 0;
+            history->wrapped = true;
+            continue;
+        }
+        if (history->head - history->tail >= length) {
+            break;
+        }
+        dropOldestRecord(history);
+    }
+
+    HistoryRecord* record = reinterpret_cast<HistoryRecord*>(&history->ring[history->tail]);
+    record->version = version;
+    record->offset = offset;
+    record->size = static_cast<uint32_t>(size);
+    record->length = static_cast<uint32_t>(length);
+    memcpy(record + 1, oldData, size);
+    history->tail += length;
+    history->count++;
+}
+
+/**
+ * @brief Apply observer recording the bytes each update overwrote
+ */
+static void historyApplyObserver(const char* memoryName, size_t offset, size_t size,
+                                 const void* oldData, const void* newData, void* context) {
+    (void)memoryName;
+    int handle = static_cast<int>(reinterpret_cast<intptr_t>(context));
+
+    // The region starts offset bytes before the new data; its version is not adopted yet
+    const MemoryLayout* layout = reinterpret_cast<const MemoryLayout*>(static_cast<const char*>(newData) - offset);
+
+    lockHistoryMutex();
+    std::map<int, VersionHistory*>::iterator it = g_histories.find(handle);
+    if (it != g_histories.end()) {
+        appendRecord(it->second, layout->version, offset, size, oldData);
+    }
+    unlockHistoryMutex();
+}
+
+int startVersionHistory(const char* memoryName, size_t maxBytes) {
+    size_t regionSize = 0;
+    const MemoryLayout* layout = static_cast<const MemoryLayout*>(getSharedMemoryMapping(memoryName, &regionSize));
+    if (!layout || regionSize < sizeof(MemoryLayout)) {
+        std::cerr << "[HISTORY] Region " << memoryName << " has no versioned header" << std::endl;
+        return -1;
+    }
+
+    VersionHistory* history = new VersionHistory();
+    history->memoryName = memoryName;
+    history->ring.resize(maxBytes);
+    history->head = 0;
+    history->tail = 0;
+    history->wrapEnd = 0;
+    history->wrapped = false;
+    history->count = 0;
+    history->oldestVersion = layout->version;
+
+    lockHistoryMutex();
+    int handle = g_nextHistoryHandle++;
+    g_histories[handle] = history;
+    unlockHistoryMutex();
+
+    registerApplyObserver(memoryName, historyApplyObserver,
+                          reinterpret_cast<void*>(static_cast<intptr_t>(handle)));
+    std::cout << "[HISTORY] Recording " << memoryName << " from version " << layout->version
+              << " in " << maxBytes << " bytes" << std::endl;
+    return handle;
+}
+
+bool stopVersionHistory(int handle) {
+    lockHistoryMutex();
+    std::map<int, VersionHistory*>::iterator it = g_histories.find(handle);
+    if (it == g_histories.end()) {
+        unlockHistoryMutex();
+        return false;
+    }
+    VersionHistory* history = it->second;
+    g_histories.erase(it);
+    unlockHistoryMutex();
+
+    unregisterApplyObserver(history->memoryName.c_str(), historyApplyObserver,
+                            reinterpret_cast<void*>(static_cast<intptr_t>(handle)));
+    delete history;
+    return true;
+}
+
+int findVersionHistory(const char* memoryName) {
+    int handle = -1;
+    lockHistoryMutex();
+    std::map<int, VersionHistory*>::iterator it;
+    for (it = g_histories.begin(); it != g_histories.end(); ++it) {
+        if (it->second->memoryName == memoryName) {
+            handle = it->first;
+            break;
+        }
+    }
+    unlockHistoryMutex();
+    return handle;
+}
+
+/**
+ * @brief Put back the bytes of a range that changed at or after a version
+ *
+ * Called with the history mutex held.
+ *
+ * @return false if the version is older than the history reaches
+ */
+static bool undoNewerRecords(const VersionHistory* history, uint64_t version, size_t offset, size_t size, char* dst) {
+    if (version < history->oldestVersion) {
+        return false;
+    }
+
+    // Oldest records first; a byte takes the old value of the first record that covers it
+    std::vector<bool> restored(size, false);
+    size_t position = history->head;
+    for (size_t i = 0; i < history->count; i++) {
+        if (history->wrapped && position == history->wrapEnd) {
+            position = 0;
+        }
+        const HistoryRecord* record = recordAt(history, position);
+        position += record->length;
+
+        if (record->version < version || record->offset >= offset + size || record->offset + record->size <= offset) {
+            continue;
+        }
+        size_t start = (record->offset > offset) ? static_cast<size_t>(record->offset) : offset;
+        size_t end = (record->offset + record->size < offset + size) ? static_cast<size_t>(record->offset + record->size) : offset + size;
+        const char* oldBytes = reinterpret_cast<const char*>(record + 1);
+        for (size_t byte = start; byte < end; byte++) {
+            if (!restored[byte - offset]) {
+                dst[byte - offset] = oldBytes[byte - record->offset];
+                restored[byte - offset] = true;
+            }
+        }
+    }
+    return true;
+}
+
+bool readAtVersion(int handle, uint64_t version, size_t offset, size_t size, void* dst) {
+    lockHistoryMutex();
+    std::map<int, VersionHistory*>::iterator it = g_histories.find(handle);
+    std::string memoryName = (it != g_histories.end()) ? it->second->memoryName : std::string();
+    unlockHistoryMutex();
+    if (memoryName.empty()) {
+        return false;
+    }
+
+    for (;;) {
+        size_t regionSize = 0;
+        const char* region = static_cast<const char*>(getSharedMemoryMapping(memoryName.c_str(), &regionSize));
+        if (!region || offset > regionSize || size > regionSize - offset) {
+            return false;
+        }
+
+        uint32_t sequence = beginRegionRead(region);
+        memcpy(dst, region + offset, size);
+
+        // Taken inside the read, never while waiting for a writer, so the observer can't deadlock with us
+        lockHistoryMutex();
+        it = g_histories.find(handle);
+        bool ok = (it != g_histories.end()) &&
+                  undoNewerRecords(it->second, version, offset, size, static_cast<char*>(dst));
+        unlockHistoryMutex();
+        if (!ok) {
+            return false;
+        }
+
+        if (endRegionRead(region, sequence)) {
+            return true;
+        }
+    }
+}
+
+uint64_t oldestReadableVersion(int handle) {
+    uint64_t version = 0;
+    lockHistoryMutex();
+    std::map<int, VersionHistory*>::iterator it = g_histories.find(handle);
+    if (it != g_histories.end()) {
+        version = it->second->oldestVersion;
+    }
+    unlockHistoryMutex();
+    return version;
+}
@@ -0,0 +1,76 @@
+#ifndef VERSION_HISTORY_H
+#define VERSION_HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Bounded history of applied updates for reading recent older versions
+ *
+ * A version history is an apply observer that records, for every update
+ * applied to a replicated region, the region version at the time and the
+ * bytes the update overwrote. Records go into a byte ring of fixed size;
+ * when it is full the oldest records are dropped.
+ *
+ * readAtVersion rebuilds a range as it was at an older version from the
+ * current contents plus the overwritten bytes of every record at or after
+ * that version, so no copies of whole region states are kept. A version can
+ * be read as long as no record at or after it has been dropped and it is not
+ * older than the version the history was started at.
+ *
+ * Only updates applied from the network are recorded; local writes to a
+ * region are not seen by apply observers.
+ */
+
+#define VERSION_HISTORY_DEFAULT_BYTES (4 * 1024 * 1024)
+
+/**
+ * @brief Start recording the history of a region
+ *
+ * @param memoryName Name of the shared memory region (already initialized)
+ * @param maxBytes Size of the history ring, records included
+ * @return History handle (>= 0), or -1 on failure
+ */
+int startVersionHistory(const char* memoryName, size_t maxBytes);
+
+/**
+ * @brief Stop recording and free a history started with startVersionHistory
+ *
+ * @param handle The history handle
+ * @return true if the history existed and was removed, false otherwise
+ */
+bool stopVersionHistory(int handle);
+
+/**
+ * @brief Find the history recording a region
+ *
+ * @param memoryName Name of the shared memory region
+ * @return History handle, or -1 if the region has no history
+ */
+int findVersionHistory(const char* memoryName);
+
+/**
+ * @brief Read a range of the region as it was at an older version
+ *
+ * Versions at or above the current one read the current contents. The read
+ * is retried until no update is applied during it.
+ *
+ * @param handle The history handle
+ * @param version Version to read at
+ * @param offset Region offset of the range
+ * @param size Size of the range
+ * @param dst Buffer of size bytes receiving the contents
+ * @return true if the range was read, false if the version is no longer
+ *         covered by the history or the range is outside the region
+ */
+bool readAtVersion(int handle, uint64_t version, size_t offset, size_t size, void* dst);
+
+/**
+ * @brief Get the oldest version a history can still reconstruct
+ *
+ * @param handle The history handle
+ * @return The oldest readable version, or 0 if the handle is unknown
+ */
+uint64_t oldestReadableVersion(int handle);
+
+#endif // VERSION_HISTORY_H
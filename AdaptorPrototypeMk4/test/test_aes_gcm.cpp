@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include "../src/aes_gcm.h"
+#include <string.h>
+#include <string>
+#include <vector>
+
+static std::vector<unsigned char> fromHex(const char* hex) {
+    std::vector<unsigned char> bytes;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+        std::string pair(hex + i, 2);
+        bytes.push_back(static_cast<unsigned char>(strtoul(pair.c_str(), NULL, 16)));
+    }
+    return bytes;
+}
+
+/**
+ * @brief A test case from the GCM specification (McGrew and Viega)
+ */
+struct GcmVector {
+    const char* key;
+    const char* nonce;
+    const char* plaintext;
+    const char* aad;
+    const char* ciphertext;
+    const char* tag;
+};
+
+static const GcmVector g_vectors[] = {
+    // Test cases 1 to 4: AES-128
+    { "00000000000000000000000000000000", "000000000000000000000000", "", "", "",
+      "58e2fccefa7e3061367f1d57a4e7455a" },
+    { "00000000000000000000000000000000", "000000000000000000000000", "00000000000000000000000000000000", "",
+      "0388dace60b6a392f328c2b971b2fe78", "ab6e47d42cec13bdf53a67b21257bddf" },
+    { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+      "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525"
+      "b16aedf5aa0de657ba637b391aafd255", "",
+      "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa05"
+      "1ba30b396a0aac973d58e091473f5985", "4d5c2af327cd64a62cf35abd2ba6fab4" },
+    { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+      "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525"
+      "b16aedf5aa0de657ba637b39", "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+      "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa05"
+      "1ba30b396a0aac973d58e091", "5bc94fbc3221a5db94fae95ae7121a47" },
+    // Test cases 13, 14 and 16: AES-256
+    { "0000000000000000000000000000000000000000000000000000000000000000", "000000000000000000000000", "", "", "",
+      "530f8afbc74536b9a963b4f1c4cb738b" },
+    { "0000000000000000000000000000000000000000000000000000000000000000", "000000000000000000000000",
+      "00000000000000000000000000000000", "", "cea7403d4d606b6e074ec5d3baf39d18",
+      "d0d1c8a799996bf0265b98b5d48ab919" },
+    { "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+      "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525"
+      "b16aedf5aa0de657ba637b39", "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+      "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa8cb08e48590dbb3da7b08b1056828838"
+      "c5f61e6393ba7a0abcc9f662", "76fc6ece0f4e1768cddf8853bb2d551b" }
+};
+
+class AesGcmTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        setAesGcmSoftwareOnly(false);
+    }
+
+    void checkVectors() {
+        for (size_t v = 0; v < sizeof(g_vectors) / sizeof(g_vectors[0]); v++) {
+            std::vector<unsigned char> keyBytes = fromHex(g_vectors[v].key);
+            std::vector<unsigned char> nonce = fromHex(g_vectors[v].nonce);
+            std::vector<unsigned char> plaintext = fromHex(g_vectors[v].plaintext);
+            std::vector<unsigned char> aad = fromHex(g_vectors[v].aad);
+            std::vector<unsigned char> expected = fromHex(g_vectors[v].ciphertext);
+            std::vector<unsigned char> expectedTag = fromHex(g_vectors[v].tag);
+
+            AesGcmKey key;
+            ASSERT_TRUE(aesGcmInitKey(&key, &keyBytes[0], keyBytes.size()));
+            std::vector<unsigned char> ciphertext(plaintext.size() + 1);
+            unsigned char tag[AES_GCM_TAG_SIZE];
+            aesGcmSeal(&key, &nonce[0], aad.empty() ? NULL : &aad[0], aad.size(),
+                       plaintext.empty() ? NULL : &plaintext[0], plaintext.size(), &ciphertext[0], tag);
+            ciphertext.resize(plaintext.size());
+            EXPECT_EQ(expected, ciphertext) << "vector " << v;
+            EXPECT_EQ(0, memcmp(&expectedTag[0], tag, AES_GCM_TAG_SIZE)) << "vector " << v;
+
+            std::vector<unsigned char> decrypted(plaintext.size() + 1);
+            EXPECT_TRUE(aesGcmOpen(&key, &nonce[0], aad.empty() ? NULL : &aad[0], aad.size(),
+                                   ciphertext.empty() ? NULL : &ciphertext[0], ciphertext.size(),
+                                   &decrypted[0], tag));
+            decrypted.resize(plaintext.size());
+            EXPECT_EQ(plaintext, decrypted) << "vector " << v;
+        }
+    }
+};
+
+TEST_F(AesGcmTest, MatchesSpecificationVectors) {
+    checkVectors();
+}
+
+TEST_F(AesGcmTest, MatchesSpecificationVectorsWithoutHardware) {
+    setAesGcmSoftwareOnly(true);
+    checkVectors();
+}
+
+TEST_F(AesGcmTest, RejectsWrongKeySizes) {
+    unsigned char keyBytes[32];
+    memset(keyBytes, 1, sizeof(keyBytes));
+    AesGcmKey key;
+    EXPECT_FALSE(aesGcmInitKey(&key, keyBytes, 24));
+    EXPECT_FALSE(aesGcmInitKey(&key, keyBytes, 0));
+}
+
+TEST_F(AesGcmTest, HardwareAndSoftwareAgree) {
+    unsigned char keyBytes[16];
+    unsigned char nonce[AES_GCM_NONCE_SIZE];
+    std::vector<unsigned char> data(2000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<unsigned char>(i * 31 + 7);
+    }
+    memcpy(keyBytes, &data[100], sizeof(keyBytes));
+    memcpy(nonce, &data[200], sizeof(nonce));
+    AesGcmKey key;
+    ASSERT_TRUE(aesGcmInitKey(&key, keyBytes, sizeof(keyBytes)));
+
+    // Sizes around the parallel batch and the four-block GHASH stride
+    const size_t sizes[] = { 0, 1, 15, 16, 17, 63, 64, 65, 112, 127, 128, 129, 1140, 2000 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        std::vector<unsigned char> fast(sizes[s] + 1), slow(sizes[s] + 1);
+        unsigned char fastTag[AES_GCM_TAG_SIZE], slowTag[AES_GCM_TAG_SIZE];
+        setAesGcmSoftwareOnly(false);
+        aesGcmSeal(&key, nonce, &data[300], 20 + s, &data[0], sizes[s], &fast[0], fastTag);
+        setAesGcmSoftwareOnly(true);
+        aesGcmSeal(&key, nonce, &data[300], 20 + s, &data[0], sizes[s], &slow[0], slowTag);
+        EXPECT_EQ(fast, slow) << "size " << sizes[s];
+        EXPECT_EQ(0, memcmp(fastTag, slowTag, AES_GCM_TAG_SIZE)) << "size " << sizes[s];
+    }
+}
+
+TEST_F(AesGcmTest, RejectsTamperedData) {
+    unsigned char keyBytes[32];
+    memset(keyBytes, 0x42, sizeof(keyBytes));
+    unsigned char nonce[AES_GCM_NONCE_SIZE];
+    memset(nonce, 0x24, sizeof(nonce));
+    AesGcmKey key;
+    ASSERT_TRUE(aesGcmInitKey(&key, keyBytes, sizeof(keyBytes)));
+
+    const char header[] = "header";
+    unsigned char message[100];
+    memset(message, 0x5A, sizeof(message));
+    unsigned char sealed[100];
+    unsigned char tag[AES_GCM_TAG_SIZE];
+    aesGcmSeal(&key, nonce, header, sizeof(header), message, sizeof(message), sealed, tag);
+
+    // In place, as the receive path decrypts
+    unsigned char opened[100];
+    memcpy(opened, sealed, sizeof(sealed));
+    EXPECT_TRUE(aesGcmOpen(&key, nonce, header, sizeof(header), opened, sizeof(opened), opened, tag));
+    EXPECT_EQ(0, memcmp(opened, message, sizeof(message)));
+
+    memcpy(opened, sealed, sizeof(sealed));
+    opened[50] ^= 1;
+    EXPECT_FALSE(aesGcmOpen(&key, nonce, header, sizeof(header), opened, sizeof(opened), opened, tag));
+    opened[50] ^= 1;
+    EXPECT_FALSE(aesGcmOpen(&key, nonce, "Header", sizeof(header), opened, sizeof(opened), opened, tag));
+    nonce[0] ^= 1;
+    EXPECT_FALSE(aesGcmOpen(&key, nonce, header, sizeof(header), opened, sizeof(opened), opened, tag));
+    nonce[0] ^= 1;
+    tag[15] ^= 0x80;
+    EXPECT_FALSE(aesGcmOpen(&key, nonce, header, sizeof(header), opened, sizeof(opened), opened, tag));
+    // Nothing was decrypted by the failed opens
+    EXPECT_EQ(0, memcmp(opened, sealed, sizeof(sealed)));
+}
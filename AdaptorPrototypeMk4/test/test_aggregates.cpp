@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include "../src/aggregates.h"
+#include "../src/record_table.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include <math.h>
+
+class AggregatesTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        initChangeTracking();
+
+        RecordColumnSpec specs[] = {
+            { "qty", COLUMN_INT32, 0 },
+            { "price", COLUMN_DOUBLE, 0 }
+        };
+        size_t size = recordTableRegionSize(specs, 2, 128);
+        ASSERT_TRUE(initializeSharedMemory("TestAggTable", size));
+        table = createRecordTable(getSharedMemory("TestAggTable"), size, specs, 2, 128);
+        ASSERT_NE(table, nullptr);
+
+        int32_t* qty = recordColumn<int32_t>(table, 0);
+        double* price = recordColumn<double>(table, 1);
+        for (int i = 0; i < 10; i++) {
+            qty[i] = i + 1;             // 1..10
+            price[i] = 100.0 + i;       // 100..109
+        }
+        table->recordCount = 10;
+    }
+
+    void TearDown() override {
+        cleanupSharedMemory("TestAggTable");
+        cleanupSharedMemory("TestAggTable" AGGREGATE_SEGMENT_SUFFIX);
+        cleanupChangeTracking();
+    }
+
+    // Apply a replicated write, as the receive thread would
+    void applyBytes(size_t offset, const void* data, size_t size) {
+        SyncMessage message;
+        memset(&message, 0, sizeof(message));
+        strcpy(message.memoryName, "TestAggTable");
+        message.msgType = MSG_SINGLE_UPDATE;
+        message.offset = offset;
+        message.size = size;
+        memcpy(message.data, data, size);
+        applyUpdate(message);
+    }
+
+    void applyQty(uint64_t record, int32_t value) {
+        applyBytes(static_cast<size_t>(table->columns[0].dataOffset + record * sizeof(int32_t)),
+                   &value, sizeof(value));
+    }
+
+    RecordTableHeader* table;
+};
+
+TEST_F(AggregatesTest, InitialValues) {
+    int slot = registerColumnAggregate("TestAggTable", "qty");
+    ASSERT_GE(slot, 0);
+
+    AggregateValue value;
+    ASSERT_TRUE(readAggregate("TestAggTable", slot, &value));
+    EXPECT_EQ(value.count, 10u);
+    EXPECT_EQ(value.integerSum, 55);
+    EXPECT_DOUBLE_EQ(value.sum, 55.0);
+    EXPECT_DOUBLE_EQ(value.min, 1.0);
+    EXPECT_DOUBLE_EQ(value.max, 10.0);
+
+    EXPECT_TRUE(unregisterAggregate("TestAggTable", slot));
+}
+
+TEST_F(AggregatesTest, UpdateAdjustsSumMinMax) {
+    int slot = registerColumnAggregate("TestAggTable", "qty");
+    ASSERT_GE(slot, 0);
+
+    applyQty(0, 50);    // Old minimum replaced by a new maximum
+    AggregateValue value;
+    ASSERT_TRUE(readAggregate("TestAggTable", slot, &value));
+    EXPECT_EQ(value.integerSum, 55 - 1 + 50);
+    EXPECT_DOUBLE_EQ(value.min, 2.0);
+    EXPECT_DOUBLE_EQ(value.max, 50.0);
+    EXPECT_EQ(value.updates, 1u);
+
+    // Rewriting the same value is not a change
+    applyQty(0, 50);
+    ASSERT_TRUE(readAggregate("TestAggTable", slot, &value));
+    EXPECT_EQ(value.updates, 1u);
+
+    unregisterAggregate("TestAggTable", slot);
+}
+
+TEST_F(AggregatesTest, FollowsRecordCount) {
+    int slot = registerColumnAggregate("TestAggTable", "price");
+    ASSERT_GE(slot, 0);
+
+    // A replicated header shrinks the table to 5 records
+    RecordTableHeader header = *table;
+    header.recordCount = 5;
+    applyBytes(recordTableHeaderOffset(table) + offsetof(RecordTableHeader, recordCount),
+               &header.recordCount, sizeof(header.recordCount));
+
+    AggregateValue value;
+    ASSERT_TRUE(readAggregate("TestAggTable", slot, &value));
+    EXPECT_EQ(value.count, 5u);
+    EXPECT_DOUBLE_EQ(value.sum, 100.0 + 101.0 + 102.0 + 103.0 + 104.0);
+    EXPECT_DOUBLE_EQ(value.max, 104.0);
+
+    unregisterAggregate("TestAggTable", slot);
+}
+
+TEST_F(AggregatesTest, RangeAggregateIgnoresOutsideWrites) {
+    size_t offset = static_cast<size_t>(table->columns[0].dataOffset);
+    int slot = registerRangeAggregate("TestAggTable", offset, COLUMN_INT32, 4);
+    ASSERT_GE(slot, 0);
+
+    applyQty(8, 1000);  // Outside the first four elements
+    applyQty(3, 0);
+
+    AggregateValue value;
+    ASSERT_TRUE(readAggregate("TestAggTable", slot, &value));
+    EXPECT_EQ(value.count, 4u);
+    EXPECT_EQ(value.integerSum, 1 + 2 + 3 + 0);
+    EXPECT_DOUBLE_EQ(value.min, 0.0);
+    EXPECT_DOUBLE_EQ(value.max, 3.0);
+    EXPECT_EQ(value.updates, 1u);
+
+    unregisterAggregate("TestAggTable", slot);
+    EXPECT_FALSE(readAggregate("TestAggTable", slot, &value));
+}
+
+TEST_F(AggregatesTest, NonFiniteValuesLeaveFiniteSumIntact) {
+    int slot = registerColumnAggregate("TestAggTable", "price");
+    ASSERT_GE(slot, 0);
+
+    size_t cell = static_cast<size_t>(table->columns[1].dataOffset + 2 * sizeof(double));
+    double nan = NAN;
+    double original = 102.0;
+
+    applyBytes(cell, &nan, sizeof(nan));
+    AggregateValue value;
+    ASSERT_TRUE(readAggregate("TestAggTable", slot, &value));
+    EXPECT_TRUE(value.sum != value.sum);
+
+    // Once the NaN is overwritten the sum is exact again
+    applyBytes(cell, &original, sizeof(original));
+    ASSERT_TRUE(readAggregate("TestAggTable", slot, &value));
+    EXPECT_DOUBLE_EQ(value.sum, 1045.0);
+
+    unregisterAggregate("TestAggTable", slot);
+}
+
+TEST_F(AggregatesTest, CompensatedSumDoesNotDrift) {
+    int slot = registerColumnAggregate("TestAggTable", "price");
+    ASSERT_GE(slot, 0);
+
+    // Swap a small value in and out next to a large one many times
+    size_t large = static_cast<size_t>(table->columns[1].dataOffset);
+    size_t small = large + sizeof(double);
+    double big = 1e16;
+    applyBytes(large, &big, sizeof(big));
+    for (int i = 0; i < 1000; i++) {
+        double tiny = (i % 2 == 0) ? 0.1 : 101.0;
+        applyBytes(small, &tiny, sizeof(tiny));
+    }
+    double restored = 100.0;
+    applyBytes(large, &restored, sizeof(restored));
+
+    AggregateValue value;
+    ASSERT_TRUE(readAggregate("TestAggTable", slot, &value));
+    EXPECT_DOUBLE_EQ(value.sum, 1045.0);
+
+    unregisterAggregate("TestAggTable", slot);
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include "../src/block_codec.h"
+#include <string.h>
+#include <vector>
+
+#define CODEC_TEST_SIZE (64 * 1024)
+
+class BlockCodecTest : public ::testing::Test {
+protected:
+    // Compress and decompress data, returning the compressed size (0 if it didn't fit)
+    size_t roundTrip(const std::vector<char>& data) {
+        compressed.assign(compressBlockBound(data.size()), 0);
+        size_t size = compressBlock(data.empty() ? NULL : &data[0], data.size(), &compressed[0], compressed.size());
+        if (size == 0) {
+            return 0;
+        }
+        compressed.resize(size);
+
+        std::vector<char> restored(data.size() + 1);
+        EXPECT_EQ(data.size(), decompressBlock(&compressed[0], size, &restored[0], restored.size()));
+        restored.resize(data.size());
+        EXPECT_TRUE(restored == data);
+        return size;
+    }
+
+    std::vector<char> compressed;
+};
+
+TEST_F(BlockCodecTest, ZerosCompressWell) {
+    std::vector<char> data(CODEC_TEST_SIZE, 0);
+    size_t size = roundTrip(data);
+    ASSERT_GT(size, 0u);
+    EXPECT_LT(size, data.size() / 100);
+}
+
+TEST_F(BlockCodecTest, RepetitiveDataRoundTrips) {
+    std::vector<char> data(CODEC_TEST_SIZE);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<char>((i % 37) * 3 + (i / 4096));
+    }
+    size_t size = roundTrip(data);
+    ASSERT_GT(size, 0u);
+    EXPECT_LT(size, data.size() / 4);
+}
+
+TEST_F(BlockCodecTest, RandomDataStaysWithinBound) {
+    std::vector<char> data(CODEC_TEST_SIZE);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < data.size(); i++) {
+        state = state * 1103515245u + 12345u;
+        data[i] = static_cast<char>(state >> 24);
+    }
+    size_t size = roundTrip(data);
+    ASSERT_GT(size, 0u);
+    EXPECT_LE(size, compressBlockBound(data.size()));
+
+    // Incompressible data doesn't fit in less than its own size
+    std::vector<char> small(data.size() - 1);
+    EXPECT_EQ(0u, compressBlock(&data[0], data.size(), &small[0], small.size()));
+}
+
+TEST_F(BlockCodecTest, ShortBlocksAreLiteralsOnly) {
+    std::vector<char> data(5, 'a');
+    EXPECT_EQ(6u, roundTrip(data));
+    EXPECT_EQ(1u, roundTrip(std::vector<char>()));
+}
+
+TEST_F(BlockCodecTest, RejectsMalformedBlocks) {
+    std::vector<char> data(CODEC_TEST_SIZE, 'x');
+    size_t size = roundTrip(data);
+    ASSERT_GT(size, 0u);
+    std::vector<char> restored(data.size());
+    const size_t failed = static_cast<size_t>(-1);
+
+    // Truncated input
+    EXPECT_EQ(failed, decompressBlock(&compressed[0], size - 1, &restored[0], restored.size()));
+
+    // Output larger than the buffer
+    EXPECT_EQ(failed, decompressBlock(&compressed[0], size, &restored[0], restored.size() / 2));
+
+    // Match reaching back before the start of the output
+    const char badOffset[] = { 0x10, 'a', 0x05, 0x00, 0x00 };
+    EXPECT_EQ(failed, decompressBlock(badOffset, sizeof(badOffset), &restored[0], restored.size()));
+}
@@ -0,0 +1,201 @@
+#include <gtest/gtest.h>
+#include "../src/block_hash.h"
+#include "../src/memory_layout.h"
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#define BLOCK_TEST_BLOCKS 64
+#define BLOCK_TEST_SIZE (BLOCK_TEST_BLOCKS * RESYNC_BLOCK_SIZE)
+
+class BlockHashTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        source.resize(BLOCK_TEST_SIZE);
+        for (size_t i = sizeof(MemoryLayout); i < source.size(); i++) {
+            source[i] = static_cast<char>(i * 31 + 7);
+        }
+        header(source)->version = 10;
+        copy = source;
+    }
+
+    static MemoryLayout* header(std::vector<char>& region) {
+        return reinterpret_cast<MemoryLayout*>(&region[0]);
+    }
+
+    // Blocks of source that differ from copy, as the source would see them
+    std::vector<size_t> differingBlocks() {
+        std::vector<BlockHash> hashes;
+        hashRegionBlocks(&copy[0], copy.size(), hashes);
+        std::vector<bool> received(hashes.size(), true);
+        std::vector<size_t> differing;
+        findDifferingBlocks(&source[0], source.size(), hashes, received, copy.size(), differing);
+        return differing;
+    }
+
+    std::vector<char> source;
+    std::vector<char> copy;
+};
+
+TEST_F(BlockHashTest, WeakHashIsAdler32) {
+    EXPECT_EQ(0x11E60398u, weakBlockHash("Wikipedia", 9));
+    EXPECT_EQ(1u, weakBlockHash("", 0));
+}
+
+TEST_F(BlockHashTest, IdenticalCopiesDontDiffer) {
+    EXPECT_EQ(static_cast<size_t>(BLOCK_TEST_BLOCKS), regionBlockCount(BLOCK_TEST_SIZE));
+    EXPECT_TRUE(differingBlocks().empty());
+}
+
+TEST_F(BlockHashTest, OnlyChangedBlocksDiffer) {
+    source[5 * RESYNC_BLOCK_SIZE + 100]++;
+    source[40 * RESYNC_BLOCK_SIZE - 1]++;
+    source[40 * RESYNC_BLOCK_SIZE]++;
+
+    std::vector<size_t> differing = differingBlocks();
+    ASSERT_EQ(3u, differing.size());
+    EXPECT_EQ(5u, differing[0]);
+    EXPECT_EQ(39u, differing[1]);
+    EXPECT_EQ(40u, differing[2]);
+}
+
+TEST_F(BlockHashTest, LocalHeaderFieldsAreIgnored) {
+    header(copy)->sequence = 7;
+    header(copy)->dirty = true;
+    header(copy)->magic = REGION_MAGIC;
+    header(copy)->generation = 2;
+    header(copy)->segmentSize = 12345;
+    EXPECT_TRUE(differingBlocks().empty());
+
+    // A newer version is replicated, so the header block is sent
+    header(source)->version = 11;
+    std::vector<size_t> differing = differingBlocks();
+    ASSERT_EQ(1u, differing.size());
+    EXPECT_EQ(0u, differing[0]);
+}
+
+TEST_F(BlockHashTest, MissingHashesAndShortCopiesDiffer) {
+    std::vector<BlockHash> hashes;
+    hashRegionBlocks(&copy[0], copy.size(), hashes);
+    std::vector<bool> received(hashes.size(), true);
+    received[3] = false;
+
+    // The peer's copy ends half way through block 62
+    size_t peerSize = 62 * RESYNC_BLOCK_SIZE + RESYNC_BLOCK_SIZE / 2;
+    hashes.resize(regionBlockCount(peerSize));
+    received.resize(hashes.size());
+
+    std::vector<size_t> differing;
+    findDifferingBlocks(&source[0], source.size(), hashes, received, peerSize, differing);
+    ASSERT_EQ(3u, differing.size());
+    EXPECT_EQ(3u, differing[0]);
+    EXPECT_EQ(62u, differing[1]);
+    EXPECT_EQ(63u, differing[2]);
+}
+
+TEST_F(BlockHashTest, ShortLastBlockIsHashed) {
+    size_t size = BLOCK_TEST_SIZE - 100;
+    std::vector<BlockHash> hashes;
+    hashRegionBlocks(&source[0], size, hashes);
+    ASSERT_EQ(static_cast<size_t>(BLOCK_TEST_BLOCKS), hashes.size());
+
+    const char* last = &source[(BLOCK_TEST_BLOCKS - 1) * RESYNC_BLOCK_SIZE];
+    EXPECT_EQ(weakBlockHash(last, RESYNC_BLOCK_SIZE - 100), hashes.back().weak);
+    EXPECT_EQ(strongBlockHash(last, RESYNC_BLOCK_SIZE - 100), hashes.back().strong);
+}
+
+TEST_F(BlockHashTest, TransfersSendGrowingRoundsWithTheHeaderLast) {
+    std::vector<size_t> differing;
+    for (size_t block = 0; block <= 200; block++) {
+        differing.push_back(block);
+    }
+    ResyncTransfer transfer;
+    startResyncTransfer(&transfer, differing);
+
+    ASSERT_TRUE(nextResyncRound(&transfer));
+    ASSERT_EQ(static_cast<size_t>(RESYNC_FIRST_ROUND_BLOCKS), transfer.round.size());
+    size_t first = 0;
+    size_t count = 0;
+    resyncRoundSpan(&transfer, &first, &count);
+    EXPECT_EQ(1u, first);
+    EXPECT_EQ(static_cast<size_t>(RESYNC_FIRST_ROUND_BLOCKS), count);
+
+    // Rounds that lose nothing double until RESYNC_ROUND_BLOCKS
+    size_t sizes[] = { 8, 16, 32, 64, 64, 16 };
+    for (int round = 1; round < 6; round++) {
+        EXPECT_TRUE(finishResyncRound(&transfer, std::vector<size_t>()));
+        ASSERT_TRUE(nextResyncRound(&transfer));
+        EXPECT_EQ(sizes[round], transfer.round.size());
+        EXPECT_TRUE(std::find(transfer.round.begin(), transfer.round.end(), 0u) == transfer.round.end());
+    }
+
+    // Then the header on its own
+    EXPECT_TRUE(finishResyncRound(&transfer, std::vector<size_t>()));
+    ASSERT_TRUE(nextResyncRound(&transfer));
+    ASSERT_EQ(1u, transfer.round.size());
+    EXPECT_EQ(0u, transfer.round[0]);
+    EXPECT_TRUE(finishResyncRound(&transfer, std::vector<size_t>()));
+    EXPECT_FALSE(nextResyncRound(&transfer));
+    EXPECT_EQ(201u, transfer.blocksSent);
+}
+
+TEST_F(BlockHashTest, LossesShrinkRoundsAndSlowTheirGrowth) {
+    std::vector<size_t> differing;
+    for (size_t block = 1; block <= 200; block++) {
+        differing.push_back(block);
+    }
+    ResyncTransfer transfer;
+    startResyncTransfer(&transfer, differing);
+    ASSERT_TRUE(nextResyncRound(&transfer));
+    EXPECT_TRUE(finishResyncRound(&transfer, std::vector<size_t>()));
+    ASSERT_TRUE(nextResyncRound(&transfer));
+    ASSERT_EQ(16u, transfer.round.size());
+
+    // Losing the last block of a round halves the next, which then grows a block at a time
+    EXPECT_TRUE(finishResyncRound(&transfer, std::vector<size_t>(1, transfer.round.back())));
+    size_t sizes[] = { 8, 9, 10 };
+    for (int round = 0; round < 3; round++) {
+        ASSERT_TRUE(nextResyncRound(&transfer));
+        EXPECT_EQ(sizes[round], transfer.round.size());
+        EXPECT_TRUE(finishResyncRound(&transfer, std::vector<size_t>()));
+    }
+}
+
+TEST_F(BlockHashTest, TransfersResendOnlyTheBlocksThatDidntArrive) {
+    std::vector<size_t> differing;
+    for (size_t block = 1; block <= 10; block++) {
+        differing.push_back(block * 3);
+    }
+    ResyncTransfer transfer;
+    startResyncTransfer(&transfer, differing);
+    ASSERT_TRUE(nextResyncRound(&transfer));
+    ASSERT_EQ(8u, transfer.round.size());
+
+    // Blocks 6 and 21 were lost; block 30 is outside the round and ignored
+    std::vector<size_t> lost;
+    lost.push_back(6);
+    lost.push_back(21);
+    lost.push_back(30);
+    EXPECT_TRUE(finishResyncRound(&transfer, lost));
+
+    // The lost blocks come first, in a round half the size
+    ASSERT_TRUE(nextResyncRound(&transfer));
+    ASSERT_EQ(4u, transfer.round.size());
+    EXPECT_EQ(6u, transfer.round[0]);
+    EXPECT_EQ(21u, transfer.round[1]);
+    EXPECT_EQ(27u, transfer.round[2]);
+    EXPECT_EQ(30u, transfer.round[3]);
+    EXPECT_EQ(12u, transfer.blocksSent);
+}
+
+TEST_F(BlockHashTest, TransfersGiveUpAfterRoundsWithoutProgress) {
+    std::vector<size_t> differing(1, 7);
+    ResyncTransfer transfer;
+    startResyncTransfer(&transfer, differing);
+    for (int round = 1; round < RESYNC_MAX_FAILED_ROUNDS; round++) {
+        ASSERT_TRUE(nextResyncRound(&transfer));
+        EXPECT_TRUE(finishResyncRound(&transfer, transfer.round));
+    }
+    ASSERT_TRUE(nextResyncRound(&transfer));
+    EXPECT_FALSE(finishResyncRound(&transfer, transfer.round));
+}
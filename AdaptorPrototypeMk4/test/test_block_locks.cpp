@@ -0,0 +1,322 @@
+#include <gtest/gtest.h>
+#include "../src/block_locks.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include "../src/memory_layout.h"
+#include "../src/network_sync.h"
+#include <process.h>
+#include <string.h>
+#include <vector>
+
+#define LOCKED_REGION "TestBlockLocks"
+#define LOCKED_REGION_SIZE (80 * BLOCK_LOCK_SIZE)
+#define WRITER_THREADS 4
+#define WRITES_PER_THREAD 20000
+#define LOCKED_SYNC_PORT 47430
+
+static bool stripeHeld(const BlockLockTable* locks, int stripe) {
+    return (locks->stripes[stripe].sequence & 1) != 0;
+}
+
+/**
+ * @brief Writes made by one thread, each incrementing a counter under its block's lock
+ */
+struct WriterJob {
+    BlockLockTable* locks;
+    char* region;
+    size_t offset;
+    int writes;
+};
+
+static unsigned int __stdcall writerThreadFunc(void* arg) {
+    WriterJob* job = static_cast<WriterJob*>(arg);
+    for (int i = 0; i < job->writes; i++) {
+        uint64_t stripes = beginBlockWrite(job->locks, &job->region, job->offset, sizeof(uint64_t));
+        uint64_t* counter = reinterpret_cast<uint64_t*>(job->region + job->offset);
+        uint64_t value = *counter;
+        if (i % 64 == 0) {
+            Sleep(0);   // Let another writer of the block try its luck in the middle of the write
+        }
+        *counter = value + 1;
+        publishRegionVersion(job->region);
+        endBlockWrite(job->locks, job->region, stripes);
+    }
+    return 0;
+}
+
+static void runWriters(WriterJob* jobs, int count) {
+    HANDLE threads[WRITER_THREADS];
+    for (int t = 0; t < count; t++) {
+        threads[t] = (HANDLE)_beginthreadex(NULL, 0, writerThreadFunc, &jobs[t], 0, NULL);
+    }
+    for (int t = 0; t < count; t++) {
+        WaitForSingleObject(threads[t], INFINITE);
+        CloseHandle(threads[t]);
+    }
+}
+
+/// Ranges of the locked region applied by the receive thread
+static std::vector<std::pair<size_t, size_t> > g_received;
+static HANDLE g_receivedMutex = NULL;
+
+static void recordReceived(const char* memoryName, size_t offset, size_t size) {
+    if (strcmp(memoryName, LOCKED_REGION) == 0) {
+        WaitForSingleObject(g_receivedMutex, INFINITE);
+        g_received.push_back(std::make_pair(offset, size));
+        ReleaseMutex(g_receivedMutex);
+    }
+}
+
+static bool receivedRange(size_t offset, size_t size) {
+    WaitForSingleObject(g_receivedMutex, INFINITE);
+    bool found = false;
+    for (size_t i = 0; i < g_received.size() && !found; i++) {
+        found = g_received[i].first <= offset && offset + size <= g_received[i].first + g_received[i].second;
+    }
+    ReleaseMutex(g_receivedMutex);
+    return found;
+}
+
+class BlockLocksTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        initChangeTracking();
+        ASSERT_TRUE(initializeSharedMemory(LOCKED_REGION, LOCKED_REGION_SIZE));
+        region = static_cast<char*>(getSharedMemory(LOCKED_REGION));
+        locks = attachBlockLocks(LOCKED_REGION);
+        ASSERT_TRUE(locks != NULL);
+    }
+
+    void TearDown() override {
+        detachBlockLocks(LOCKED_REGION);
+        cleanupSharedMemory(LOCKED_REGION);
+        cleanupChangeTracking();
+    }
+
+    MemoryLayout* layout() {
+        return reinterpret_cast<MemoryLayout*>(region);
+    }
+
+    char* region;
+    BlockLockTable* locks;
+};
+
+TEST_F(BlockLocksTest, WritesHoldTheStripesOfTheirBlocks) {
+    EXPECT_EQ(0u, blockLockStripes(100, 0));
+    EXPECT_EQ(0x6u, blockLockStripes(BLOCK_LOCK_SIZE + 10, BLOCK_LOCK_SIZE));
+    EXPECT_EQ(0x8000000000000003ull, blockLockStripes(64 * BLOCK_LOCK_SIZE - 1, 2 + BLOCK_LOCK_SIZE));  // Blocks 63 to 65
+    EXPECT_EQ(~static_cast<uint64_t>(0), blockLockStripes(0, LOCKED_REGION_SIZE));
+
+    uint64_t stripes = beginBlockWrite(locks, &region, 2 * BLOCK_LOCK_SIZE - 4, 8);
+    EXPECT_EQ(0x6u, stripes);
+    EXPECT_FALSE(stripeHeld(locks, 0));
+    EXPECT_TRUE(stripeHeld(locks, 1));
+    EXPECT_TRUE(stripeHeld(locks, 2));
+    EXPECT_EQ(1u, layout()->sequence & REGION_WRITERS_MASK);
+    endBlockWrite(locks, region, stripes);
+    EXPECT_FALSE(stripeHeld(locks, 1));
+    EXPECT_FALSE(stripeHeld(locks, 2));
+    EXPECT_EQ(0u, layout()->sequence & REGION_WRITERS_MASK);
+}
+
+TEST_F(BlockLocksTest, ProcessesShareTheStripesThroughTheSection) {
+    EXPECT_EQ(locks, attachBlockLocks(LOCKED_REGION));
+    detachBlockLocks(LOCKED_REGION);
+
+    // A second view of the section, as another process would map it
+    HANDLE section = OpenSharedMemory(LOCKED_REGION ".locks");
+    ASSERT_TRUE(section != NULL);
+    BlockLockTable* other = static_cast<BlockLockTable*>(MapSharedMemory(section, sizeof(BlockLockTable)));
+    ASSERT_TRUE(other != NULL);
+    EXPECT_NE(locks, other);
+
+    uint64_t stripes = beginBlockWrite(other, &region, 5 * BLOCK_LOCK_SIZE, 16);
+    EXPECT_TRUE(stripeHeld(locks, 5));
+    endBlockWrite(other, region, stripes);
+    EXPECT_FALSE(stripeHeld(locks, 5));
+
+    UnmapSharedMemory(other);
+    CloseSharedMemory(section);
+}
+
+TEST_F(BlockLocksTest, OverlappingRegionWritesAreCounted) {
+    uint64_t version = layout()->version;
+    beginRegionWrite(region);
+    beginRegionWrite(region);
+    EXPECT_EQ(2u, layout()->sequence & REGION_WRITERS_MASK);
+    EXPECT_EQ(version + 1, publishRegionVersion(region));
+    EXPECT_TRUE(layout()->dirty);
+    endRegionWrite(region);
+    EXPECT_EQ(1u, layout()->sequence & REGION_WRITERS_MASK);
+    endRegionWrite(region);
+    EXPECT_EQ(0u, layout()->sequence & REGION_WRITERS_MASK);
+    EXPECT_EQ(2 * REGION_WRITE_DONE, layout()->sequence);
+
+    // A read spanning a write sees it
+    uint32_t sequence = beginRegionRead(region);
+    uint64_t stripes = beginBlockWrite(locks, &region, 3 * BLOCK_LOCK_SIZE, 8);
+    endBlockWrite(locks, region, stripes);
+    EXPECT_FALSE(endRegionRead(region, sequence));
+}
+
+TEST_F(BlockLocksTest, BlockReadsOnlyRetryForTheirBlocks) {
+    uint32_t sequence = beginBlockRead(locks, 3 * BLOCK_LOCK_SIZE, 100);
+    uint64_t stripes = beginBlockWrite(locks, &region, 4 * BLOCK_LOCK_SIZE, 8);
+    endBlockWrite(locks, region, stripes);
+    EXPECT_TRUE(endBlockRead(locks, 3 * BLOCK_LOCK_SIZE, 100, sequence));
+
+    // Block 67 shares block 3's stripe
+    stripes = beginBlockWrite(locks, &region, 67 * BLOCK_LOCK_SIZE, 8);
+    EXPECT_FALSE(endBlockRead(locks, 3 * BLOCK_LOCK_SIZE, 100, sequence));
+    endBlockWrite(locks, region, stripes);
+    EXPECT_FALSE(endBlockRead(locks, 3 * BLOCK_LOCK_SIZE, 100, sequence));
+}
+
+TEST_F(BlockLocksTest, ConcurrentWritersKeepEveryWriteAndVersion) {
+    uint64_t version = layout()->version;
+
+    // Each thread its own block, then all of them the same counter
+    WriterJob jobs[WRITER_THREADS];
+    for (int t = 0; t < WRITER_THREADS; t++) {
+        jobs[t].locks = locks;
+        jobs[t].region = region;
+        jobs[t].offset = (t + 1) * BLOCK_LOCK_SIZE;
+        jobs[t].writes = WRITES_PER_THREAD;
+    }
+    runWriters(jobs, WRITER_THREADS);
+    for (int t = 0; t < WRITER_THREADS; t++) {
+        EXPECT_EQ(static_cast<uint64_t>(WRITES_PER_THREAD),
+                  *reinterpret_cast<uint64_t*>(region + (t + 1) * BLOCK_LOCK_SIZE));
+        jobs[t].offset = 10 * BLOCK_LOCK_SIZE + 64;
+    }
+    runWriters(jobs, WRITER_THREADS);
+    EXPECT_EQ(static_cast<uint64_t>(WRITER_THREADS * WRITES_PER_THREAD),
+              *reinterpret_cast<uint64_t*>(region + 10 * BLOCK_LOCK_SIZE + 64));
+
+    EXPECT_EQ(version + 2 * WRITER_THREADS * WRITES_PER_THREAD, layout()->version);
+    EXPECT_EQ(0u, layout()->sequence & REGION_WRITERS_MASK);
+    for (int stripe = 0; stripe < BLOCK_LOCK_STRIPES; stripe++) {
+        EXPECT_FALSE(stripeHeld(locks, stripe));
+    }
+}
+
+TEST_F(BlockLocksTest, WritesMarkTheirPartsDirty) {
+    std::vector<size_t> parts;
+    takeDirtyParts(locks, LOCKED_REGION_SIZE, parts);
+    EXPECT_TRUE(parts.empty());
+
+    uint64_t stripes = beginBlockWrite(locks, &region, 3 * BLOCK_DIRTY_SIZE + 1000, 100);
+    endBlockWrite(locks, region, stripes);
+    stripes = beginBlockWrite(locks, &region, 70 * BLOCK_DIRTY_SIZE, 8);
+    endBlockWrite(locks, region, stripes);
+    takeDirtyParts(locks, LOCKED_REGION_SIZE, parts);
+    ASSERT_EQ(3u, parts.size());
+    EXPECT_EQ(3u, parts[0]);
+    EXPECT_EQ(4u, parts[1]);
+    EXPECT_EQ(70u, parts[2]);
+
+    // Each write is taken once
+    takeDirtyParts(locks, LOCKED_REGION_SIZE, parts);
+    EXPECT_TRUE(parts.empty());
+
+    // A write across words of the bitmap
+    stripes = beginBlockWrite(locks, &region, 62 * BLOCK_DIRTY_SIZE + 1, 3 * BLOCK_DIRTY_SIZE);
+    endBlockWrite(locks, region, stripes);
+    takeDirtyParts(locks, LOCKED_REGION_SIZE, parts);
+    ASSERT_EQ(4u, parts.size());
+    EXPECT_EQ(62u, parts[0]);
+    EXPECT_EQ(65u, parts[3]);
+
+    // Every part of the largest region has a bit of its own
+    const size_t lastPart = BLOCK_DIRTY_BITS - 1;
+    stripes = beginBlockWrite(locks, &region, 5 * BLOCK_DIRTY_SIZE, 8);
+    endBlockWrite(locks, region, stripes);
+    stripes = beginBlockWrite(locks, &region, lastPart * BLOCK_DIRTY_SIZE, 8);
+    endBlockWrite(locks, region, stripes);
+    takeDirtyParts(locks, static_cast<size_t>(BLOCK_DIRTY_BITS) * BLOCK_DIRTY_SIZE, parts);
+    ASSERT_EQ(2u, parts.size());
+    EXPECT_EQ(5u, parts[0]);
+    EXPECT_EQ(lastPart, parts[1]);
+}
+
+TEST_F(BlockLocksTest, StripesOfAnExitedWriterAreTakenOver) {
+    const LONG exited = 0x7FFFFFF0;  // Beyond any pid in use
+
+    // Died in the middle of a write, counted in the region's write sequence
+    BlockLockStripe& writing = locks->stripes[7];
+    writing.owner = exited;
+    writing.sequence++;
+    beginRegionWrite(region);
+    writing.regionWrite = 1;
+
+    uint64_t stripes = beginBlockWrite(locks, &region, 7 * BLOCK_LOCK_SIZE, 8);
+    EXPECT_EQ(static_cast<LONG>(GetCurrentProcessId()), writing.owner);
+    EXPECT_EQ(1u, layout()->sequence & REGION_WRITERS_MASK);
+    endBlockWrite(locks, region, stripes);
+    EXPECT_FALSE(stripeHeld(locks, 7));
+    EXPECT_EQ(0, writing.owner);
+    EXPECT_EQ(0u, layout()->sequence & REGION_WRITERS_MASK);
+
+    // Died after taking the owner but before marking the stripe held
+    BlockLockStripe& taking = locks->stripes[8];
+    taking.owner = exited;
+    stripes = beginBlockWrite(locks, &region, 8 * BLOCK_LOCK_SIZE, 8);
+    EXPECT_TRUE(stripeHeld(locks, 8));
+    endBlockWrite(locks, region, stripes);
+    EXPECT_FALSE(stripeHeld(locks, 8));
+    EXPECT_EQ(0, taking.owner);
+
+    // Readers release such a stripe too
+    BlockLockStripe& reading = locks->stripes[9];
+    reading.owner = exited;
+    reading.sequence++;
+    uint32_t sequence = beginBlockRead(locks, 9 * BLOCK_LOCK_SIZE, 8);
+    EXPECT_FALSE(stripeHeld(locks, 9));
+    EXPECT_EQ(0, reading.owner);
+    EXPECT_TRUE(endBlockRead(locks, 9 * BLOCK_LOCK_SIZE, 8, sequence));
+}
+
+TEST_F(BlockLocksTest, WritesThroughAnotherMappingAreSent) {
+    if (g_receivedMutex == NULL) {
+        g_receivedMutex = CreateMutex(NULL, FALSE, NULL);
+    }
+    g_received.clear();
+
+    // This node is its own remote node, so what the sync thread sends comes back over UDP
+    ASSERT_TRUE(initNetworkSync("127.0.0.1", LOCKED_SYNC_PORT));
+    ASSERT_TRUE(connectToRemoteNode("127.0.0.1", LOCKED_SYNC_PORT));
+    registerNetworkUpdateCallback(recordReceived);
+    ASSERT_TRUE(startSharedMemorySync(LOCKED_REGION));
+    Sleep(50);
+
+    // Views of the region and its locks as another process writing it would map them;
+    // that process records nothing in this process's pending changes
+    HANDLE section = OpenSharedMemory(LOCKED_REGION);
+    HANDLE lockSection = OpenSharedMemory(LOCKED_REGION ".locks");
+    ASSERT_TRUE(section != NULL && lockSection != NULL);
+    char* other = static_cast<char*>(MapSharedMemory(section, LOCKED_REGION_SIZE));
+    BlockLockTable* otherLocks = static_cast<BlockLockTable*>(MapSharedMemory(lockSection, sizeof(BlockLockTable)));
+    ASSERT_TRUE(other != NULL && otherLocks != NULL);
+
+    const size_t offset = 20 * BLOCK_LOCK_SIZE + 100;
+    uint64_t stripes = beginBlockWrite(otherLocks, &other, offset, 32);
+    memset(other + offset, 'P', 32);
+    publishRegionVersion(other);
+    endBlockWrite(otherLocks, other, stripes);
+
+    bool sent = false;
+    for (int i = 0; i < 200 && !sent; i++) {
+        Sleep(10);
+        sent = receivedRange(offset, 32);
+    }
+
+    // Shutting down lets the sync thread return rather than be terminated
+    shutdownNetworkSync();
+    registerNetworkUpdateCallback(NULL);
+    UnmapSharedMemory(otherLocks);
+    UnmapSharedMemory(other);
+    CloseSharedMemory(lockSection);
+    CloseSharedMemory(section);
+
+    EXPECT_TRUE(sent);
+}
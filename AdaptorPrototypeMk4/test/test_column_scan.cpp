@@ -0,0 +1,176 @@
+#include <winsock2.h>
+#include <windows.h>
+#include <process.h>
+#include <gtest/gtest.h>
+#include "../src/column_scan.h"
+#include "../src/record_table.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include <stdlib.h>
+#include <vector>
+
+// Run a predicate through both kernels and check they agree with a plain loop
+template <typename T>
+static void checkKernels(const std::vector<T>& cells, const ScanPredicate& predicate, size_t expected) {
+    std::vector<uint64_t> scalarMatches, vectorMatches;
+
+    setScanScalarOnly(true);
+    EXPECT_EQ(scanCells(&cells[0], cells.size(), predicate, &scalarMatches), static_cast<int64_t>(expected));
+    setScanScalarOnly(false);
+    EXPECT_EQ(scanCells(&cells[0], cells.size(), predicate, &vectorMatches), static_cast<int64_t>(expected));
+    EXPECT_EQ(scalarMatches, vectorMatches);
+}
+
+TEST(ColumnScanTest, KernelsAgreeOnIntegers) {
+    // 1000 cells: 15 whole match words plus a partial one
+    std::vector<int32_t> ints(1000);
+    std::vector<uint64_t> wide(1000);
+    srand(7);
+    for (size_t i = 0; i < ints.size(); i++) {
+        ints[i] = (rand() % 200) - 100;
+        wide[i] = (static_cast<uint64_t>(rand()) << 33) ^ static_cast<uint64_t>(rand());
+    }
+
+    size_t equal = 0, range = 0, maskAny = 0, maskAll = 0, wideRange = 0;
+    uint64_t wideLow = 1ULL << 62;
+    for (size_t i = 0; i < ints.size(); i++) {
+        equal += (ints[i] == 5);
+        range += (ints[i] >= -10 && ints[i] <= 20);
+        maskAny += ((ints[i] & 0x41) != 0);
+        maskAll += ((ints[i] & 0x41) == 0x41);
+        wideRange += (wide[i] >= wideLow);
+    }
+
+    checkKernels(ints, scanEqual<int32_t>(5), equal);
+    checkKernels(ints, scanNotEqual<int32_t>(5), ints.size() - equal);
+    checkKernels(ints, scanRange<int32_t>(-10, 20), range);
+    checkKernels(ints, scanMaskAny<int32_t>(0x41), maskAny);
+    checkKernels(ints, scanMaskAll<int32_t>(0x41), maskAll);
+
+    // Unsigned ordering must hold above the signed range
+    checkKernels(wide, scanRange<uint64_t>(wideLow, ~0ULL), wideRange);
+}
+
+TEST(ColumnScanTest, KernelsAgreeOnFloatingPoint) {
+    std::vector<double> cells(300);
+    for (size_t i = 0; i < cells.size(); i++) {
+        cells[i] = static_cast<double>(i) * 0.5;
+    }
+    cells[17] = 0.0 / 0.0;     // NaN never matches a range, always matches not-equal
+
+    checkKernels(cells, scanRange<double>(10.0, 20.0), 21u);
+    checkKernels(cells, scanNotEqual<double>(1.0), cells.size() - 1);
+
+    // Bitmask tests are not defined for floating point columns
+    EXPECT_EQ(scanCells(&cells[0], cells.size(), scanMaskAny<double>(1.0), NULL), -1);
+}
+
+TEST(ColumnScanTest, RecordColumnSnapshot) {
+    initChangeTracking();
+
+    RecordColumnSpec specs[] = {
+        { "venue", COLUMN_UINT32, 0 }
+    };
+    size_t size = recordTableRegionSize(specs, 1, 512);
+    ASSERT_TRUE(initializeSharedMemory("TestScanTable", size));
+    RecordTableHeader* table = createRecordTable(getSharedMemory("TestScanTable"), size, specs, 1, 512);
+    ASSERT_NE(table, nullptr);
+
+    uint32_t* venues = recordColumn<uint32_t>(table, 0);
+    for (uint32_t i = 0; i < 512; i++) {
+        venues[i] = i % 8;
+    }
+    table->recordCount = 400;   // Records past the count are not scanned
+
+    std::vector<uint64_t> matches;
+    EXPECT_EQ(scanRecordColumn("TestScanTable", "venue", scanEqual<uint32_t>(3), &matches), 50);
+    EXPECT_EQ(matches.front(), 3u);
+    EXPECT_EQ(matches.back(), 395u);
+
+    // Wrong predicate type for the column
+    EXPECT_EQ(scanRecordColumn("TestScanTable", "venue", scanEqual<int64_t>(3), NULL), -1);
+
+    cleanupSharedMemory("TestScanTable");
+    cleanupChangeTracking();
+}
+
+TEST(ColumnScanTest, ApplyKeepsLocalSequence) {
+    initChangeTracking();
+    ASSERT_TRUE(initializeSharedMemory("TestScanSequence", 4096));
+    MemoryLayout* layout = static_cast<MemoryLayout*>(getSharedMemory("TestScanSequence"));
+    uint32_t before = beginRegionRead(layout);
+
+    // A replicated copy of a whole header must not overwrite the local sequence
+    MemoryLayout remote;
+    memset(&remote, 0, sizeof(remote));
+    remote.data = 42;
+    remote.sequence = 12345;
+
+    SyncMessage message;
+    memset(&message, 0, sizeof(message));
+    strcpy(message.memoryName, "TestScanSequence");
+    message.msgType = MSG_SINGLE_UPDATE;
+    message.offset = 0;
+    message.size = sizeof(remote);
+    memcpy(message.data, &remote, sizeof(remote));
+    applyUpdate(message);
+
+    EXPECT_EQ(layout->data, 42);
+    EXPECT_EQ(layout->sequence, before + REGION_WRITE_DONE);
+    EXPECT_FALSE(endRegionRead(layout, before));
+
+    cleanupSharedMemory("TestScanSequence");
+    cleanupChangeTracking();
+}
+
+// Keeps committing empty writes to a region until told to stop
+struct ScanWriter {
+    MemoryLayout* layout;
+    volatile LONG stop;
+};
+
+static unsigned __stdcall scanWriterThread(void* arg) {
+    ScanWriter* writer = static_cast<ScanWriter*>(arg);
+    while (writer->stop == 0) {
+        beginRegionWrite(writer->layout);
+        endRegionWrite(writer->layout);
+        for (volatile int spin = 0; spin < 1000; spin++) {
+        }
+    }
+    return 0;
+}
+
+TEST(ColumnScanTest, ScanCompletesUnderSteadyWrites) {
+    initChangeTracking();
+
+    const uint64_t cells = 4 * 1024 * 1024;
+    size_t offset = sizeof(MemoryLayout);
+    ASSERT_TRUE(initializeSharedMemory("TestScanBusy", offset + cells * sizeof(uint32_t)));
+    char* region = static_cast<char*>(getSharedMemory("TestScanBusy"));
+    uint32_t* values = reinterpret_cast<uint32_t*>(region + offset);
+    for (uint64_t i = 0; i < cells; i++) {
+        values[i] = static_cast<uint32_t>(i % 16);
+    }
+
+    // Writes land far more often than a whole-range scan takes
+    ScanWriter writer;
+    writer.layout = reinterpret_cast<MemoryLayout*>(region);
+    writer.stop = 0;
+    unsigned threadId;
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, scanWriterThread, &writer, 0, &threadId);
+    ASSERT_NE(thread, (HANDLE)NULL);
+
+    std::vector<uint64_t> matches;
+    EXPECT_EQ(scanRegionCells("TestScanBusy", offset, cells, scanEqual<uint32_t>(5), &matches),
+              static_cast<int64_t>(cells / 16));
+    ASSERT_EQ(matches.size(), static_cast<size_t>(cells / 16));
+    EXPECT_EQ(matches.front(), 5u);
+    EXPECT_EQ(matches.back(), cells - 11);
+
+    InterlockedExchange(&writer.stop, 1);
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+
+    cleanupSharedMemory("TestScanBusy");
+    cleanupChangeTracking();
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include "../src/crc32c.h"
+#include <string.h>
+#include <vector>
+
+class Crc32cTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // Deterministic pseudo-random bytes
+        data.resize(100000);
+        uint32_t state = 12345;
+        for (size_t i = 0; i < data.size(); i++) {
+            state = state * 1103515245u + 12345u;
+            data[i] = static_cast<unsigned char>(state >> 16);
+        }
+    }
+
+    void TearDown() override {
+        setCrc32cSoftwareOnly(false);
+    }
+
+    std::vector<unsigned char> data;
+};
+
+TEST_F(Crc32cTest, MatchesKnownValues) {
+    EXPECT_EQ(crc32c(0, "123456789", 9), 0xE3069283u);
+    EXPECT_EQ(crc32c(0, "", 0), 0u);
+
+    unsigned char zeros[32];
+    memset(zeros, 0, sizeof(zeros));
+    EXPECT_EQ(crc32c(0, zeros, sizeof(zeros)), 0x8A9136AAu);
+
+    unsigned char ones[32];
+    memset(ones, 0xFF, sizeof(ones));
+    EXPECT_EQ(crc32c(0, ones, sizeof(ones)), 0x62A8AB43u);
+}
+
+TEST_F(Crc32cTest, HardwareAndSoftwareAgree) {
+    // Sizes around the stream lengths, at every alignment
+    const size_t sizes[] = { 1, 7, 8, 9, 255, 767, 768, 769, 4096, 24575, 24576, 24577, 30000, 99990 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t align = 0; align < 8; align++) {
+            setCrc32cSoftwareOnly(false);
+            uint32_t fast = crc32c(0, &data[align], sizes[s]);
+            setCrc32cSoftwareOnly(true);
+            uint32_t slow = crc32c(0, &data[align], sizes[s]);
+            EXPECT_EQ(fast, slow) << "size " << sizes[s] << " alignment " << align;
+        }
+    }
+}
+
+TEST_F(Crc32cTest, ContinuesAcrossCalls) {
+    uint32_t whole = crc32c(0, &data[0], 50000);
+    uint32_t parts = crc32c(0, &data[0], 12345);
+    parts = crc32c(parts, &data[12345], 50000 - 12345);
+    EXPECT_EQ(parts, whole);
+}
+
+TEST_F(Crc32cTest, CombinesSeparateCrcs) {
+    uint32_t whole = crc32c(0, &data[0], 10000);
+    uint32_t first = crc32c(0, &data[0], 4096);
+    uint32_t second = crc32c(0, &data[4096], 10000 - 4096);
+    EXPECT_EQ(crc32cCombine(first, second, 10000 - 4096), whole);
+    EXPECT_EQ(crc32cCombine(whole, 0, 0), whole);
+}
+
+TEST_F(Crc32cTest, UpdatesChangedRange) {
+    std::vector<unsigned char> buffer(data.begin(), data.begin() + 4096);
+    uint32_t crc = crc32c(0, &buffer[0], buffer.size());
+
+    // Change ranges at the start, the middle and the end
+    const size_t offsets[] = { 0, 1000, 4096 - 37 };
+    for (size_t i = 0; i < 3; i++) {
+        unsigned char oldBytes[37];
+        memcpy(oldBytes, &buffer[offsets[i]], sizeof(oldBytes));
+        memcpy(&buffer[offsets[i]], &data[50000 + i * 100], sizeof(oldBytes));
+        crc = crc32cUpdateRange(crc, buffer.size(), offsets[i], oldBytes, &buffer[offsets[i]], sizeof(oldBytes));
+        EXPECT_EQ(crc, crc32c(0, &buffer[0], buffer.size()));
+    }
+}
+
+TEST_F(Crc32cTest, CombineAgreesWithoutHardware) {
+    // Combining uses carry-less multiplies when available, bit-serial ones otherwise
+    const size_t sizes[] = { 0, 1, 3, 4096, 65535, 1u << 20, 123456789 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint32_t a = crc32c(0, &data[s * 100], 100);
+        uint32_t b = crc32c(0, &data[s * 100 + 50000], 100);
+        setCrc32cSoftwareOnly(false);
+        uint32_t fast = crc32cCombine(a, b, sizes[s]);
+        setCrc32cSoftwareOnly(true);
+        uint32_t slow = crc32cCombine(a, b, sizes[s]);
+        EXPECT_EQ(fast, slow) << "size " << sizes[s];
+    }
+}
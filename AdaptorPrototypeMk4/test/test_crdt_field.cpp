@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include "../src/crdt_field.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include "../src/memory_layout.h"
+#include <string.h>
+
+#define CRDT_REGION "TestCrdtRegion"
+#define COUNTER_OFFSET sizeof(MemoryLayout)
+#define PN_COUNTER_OFFSET (COUNTER_OFFSET + sizeof(CrdtGCounter))
+#define REGISTER_OFFSET (PN_COUNTER_OFFSET + sizeof(CrdtPNCounter))
+#define PLAIN_OFFSET (REGISTER_OFFSET + sizeof(CrdtRegister))
+
+class CrdtFieldTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        initChangeTracking();
+        ASSERT_TRUE(initializeSharedMemory(CRDT_REGION, 4096));
+        ASSERT_TRUE(setLeaseNodeId(1));
+        region = static_cast<char*>(getSharedMemory(CRDT_REGION));
+        ASSERT_TRUE(registerCrdtField(CRDT_REGION, COUNTER_OFFSET, CRDT_G_COUNTER));
+        ASSERT_TRUE(registerCrdtField(CRDT_REGION, PN_COUNTER_OFFSET, CRDT_PN_COUNTER));
+        ASSERT_TRUE(registerCrdtField(CRDT_REGION, REGISTER_OFFSET, CRDT_LWW_REGISTER));
+    }
+
+    void TearDown() override {
+        unregisterCrdtFields(CRDT_REGION);
+        lockChangesMutex();
+        g_pendingChanges.erase(CRDT_REGION);
+        unlockChangesMutex();
+        cleanupSharedMemory(CRDT_REGION);
+        cleanupChangeTracking();
+    }
+
+    CrdtGCounter* counter() {
+        return reinterpret_cast<CrdtGCounter*>(region + COUNTER_OFFSET);
+    }
+
+    CrdtPNCounter* pnCounter() {
+        return reinterpret_cast<CrdtPNCounter*>(region + PN_COUNTER_OFFSET);
+    }
+
+    void applyBytes(size_t offset, const void* data, size_t size, uint64_t version) {
+        SyncMessage message;
+        memset(&message, 0, sizeof(message));
+        message.msgType = MSG_SINGLE_UPDATE;
+        strcpy(message.memoryName, CRDT_REGION);
+        message.offset = offset;
+        message.size = size;
+        message.version = version;
+        memcpy(message.data, data, size);
+        applyUpdate(message);
+    }
+
+    void applySlot(size_t offset, uint64_t value) {
+        applyBytes(offset, &value, sizeof(value), 100);
+    }
+
+    size_t pendingChanges() {
+        lockChangesMutex();
+        size_t count = g_pendingChanges[CRDT_REGION].size();
+        unlockChangesMutex();
+        return count;
+    }
+
+    char* region;
+};
+
+TEST_F(CrdtFieldTest, RejectsBadFields) {
+    EXPECT_FALSE(registerCrdtField(CRDT_REGION, 0, CRDT_G_COUNTER));                     // Header
+    EXPECT_FALSE(registerCrdtField(CRDT_REGION, PLAIN_OFFSET + 4, CRDT_G_COUNTER));      // Unaligned
+    EXPECT_FALSE(registerCrdtField(CRDT_REGION, COUNTER_OFFSET + 8, CRDT_LWW_REGISTER)); // Overlaps
+    EXPECT_FALSE(registerCrdtField(CRDT_REGION, 4096 - 64, CRDT_G_COUNTER));             // Past the end
+    EXPECT_TRUE(registerCrdtField(CRDT_REGION, 4096 - sizeof(CrdtGCounter), CRDT_G_COUNTER));
+}
+
+TEST_F(CrdtFieldTest, CountersAddLocallyAndPublishTheirSlots) {
+    for (int i = 0; i < 5; i++) {
+        EXPECT_TRUE(crdtCounterAdd(counter(), 2));
+    }
+    EXPECT_TRUE(crdtPNCounterAdd(pnCounter(), 7));
+    EXPECT_TRUE(crdtPNCounterAdd(pnCounter(), -10));
+    EXPECT_EQ(10u, crdtCounterValue(counter()));
+    EXPECT_EQ(-3, crdtPNCounterValue(pnCounter()));
+    EXPECT_EQ(0u, pendingChanges());
+
+    // Only the slots this node changed are queued, once
+    uint64_t version = reinterpret_cast<MemoryLayout*>(region)->version;
+    EXPECT_EQ(3, publishCrdtFields(CRDT_REGION));
+    EXPECT_EQ(version + 1, reinterpret_cast<MemoryLayout*>(region)->version);
+    lockChangesMutex();
+    std::vector<MemoryChange> changes = g_pendingChanges[CRDT_REGION];
+    unlockChangesMutex();
+    ASSERT_EQ(3u, changes.size());
+    EXPECT_EQ(COUNTER_OFFSET, changes[0].offset);
+    EXPECT_EQ(sizeof(uint64_t), changes[0].size);
+    EXPECT_EQ(0, publishCrdtFields(CRDT_REGION));
+
+    EXPECT_TRUE(crdtCounterAdd(counter(), 1));
+    EXPECT_EQ(1, publishCrdtFields(CRDT_REGION));
+    EXPECT_EQ(11u, crdtCounterValue(counter()));
+}
+
+TEST_F(CrdtFieldTest, CounterSlotsMergeToTheLargerValue) {
+    crdtCounterAdd(counter(), 4);
+    applySlot(COUNTER_OFFSET + sizeof(uint64_t), 10);           // Node 2
+    EXPECT_EQ(14u, crdtCounterValue(counter()));
+
+    // A stale or repeated update changes nothing
+    applySlot(COUNTER_OFFSET + sizeof(uint64_t), 7);
+    applySlot(COUNTER_OFFSET + sizeof(uint64_t), 10);
+    EXPECT_EQ(14u, crdtCounterValue(counter()));
+
+    // Nor does an old copy of this node's own slot
+    applySlot(COUNTER_OFFSET, 1);
+    EXPECT_EQ(14u, crdtCounterValue(counter()));
+
+    // Both halves of a PN counter, in one update with the plain bytes after it
+    char bytes[sizeof(CrdtPNCounter) + sizeof(CrdtRegister) + 8];
+    memset(bytes, 0, sizeof(bytes));
+    uint64_t increments = 20;
+    uint64_t decrements = 5;
+    memcpy(bytes + sizeof(uint64_t), &increments, sizeof(increments));
+    memcpy(bytes + sizeof(CrdtGCounter) + sizeof(uint64_t), &decrements, sizeof(decrements));
+    memcpy(bytes + sizeof(CrdtPNCounter) + sizeof(CrdtRegister), "plain!!", 8);
+    applyBytes(PN_COUNTER_OFFSET, bytes, sizeof(bytes), 101);
+    EXPECT_EQ(15, crdtPNCounterValue(pnCounter()));
+    EXPECT_STREQ("plain!!", region + PLAIN_OFFSET);
+    EXPECT_EQ(101u, reinterpret_cast<MemoryLayout*>(region)->version);
+}
+
+TEST_F(CrdtFieldTest, RegisterKeepsTheLatestWrite) {
+    ASSERT_TRUE(crdtRegisterSet(CRDT_REGION, REGISTER_OFFSET, "local", 6));
+    CrdtRegister reg;
+    ASSERT_TRUE(crdtRegisterGet(CRDT_REGION, REGISTER_OFFSET, &reg));
+    EXPECT_STREQ("local", reg.value);
+    EXPECT_EQ(1u, reg.node);
+    EXPECT_EQ(6u, reg.size);
+
+    // A later write from node 2, even with its clock ahead of ours
+    CrdtRegister remote;
+    memset(&remote, 0, sizeof(remote));
+    remote.stamp = reg.stamp + (60000ull << 16);
+    remote.node = 2;
+    remote.size = 7;
+    strcpy(remote.value, "remote");
+    applyBytes(REGISTER_OFFSET, &remote, sizeof(remote), 100);
+    ASSERT_TRUE(crdtRegisterGet(CRDT_REGION, REGISTER_OFFSET, &reg));
+    EXPECT_STREQ("remote", reg.value);
+
+    // An earlier one loses
+    CrdtRegister stale = remote;
+    stale.stamp -= 1;
+    strcpy(stale.value, "stale");
+    applyBytes(REGISTER_OFFSET, &stale, sizeof(stale), 100);
+    ASSERT_TRUE(crdtRegisterGet(CRDT_REGION, REGISTER_OFFSET, &reg));
+    EXPECT_STREQ("remote", reg.value);
+
+    // The next local write comes after everything applied here
+    ASSERT_TRUE(crdtRegisterSet(CRDT_REGION, REGISTER_OFFSET, "again", 6));
+    ASSERT_TRUE(crdtRegisterGet(CRDT_REGION, REGISTER_OFFSET, &reg));
+    EXPECT_STREQ("again", reg.value);
+    EXPECT_GT(reg.stamp, remote.stamp);
+    EXPECT_FALSE(crdtRegisterSet(CRDT_REGION, REGISTER_OFFSET, "x", CRDT_REGISTER_VALUE_SIZE + 1));
+}
+
+TEST_F(CrdtFieldTest, ClockStaysAheadOfWhatItSaw) {
+    uint64_t first = hlcNow();
+    uint64_t second = hlcNow();
+    EXPECT_GT(second, first);
+    hlcObserve(second + (1000ull << 16));
+    EXPECT_GT(hlcNow(), second + (1000ull << 16));
+    hlcObserve(first);
+    EXPECT_GT(hlcNow(), second + (1000ull << 16));
+}
+
+TEST_F(CrdtFieldTest, UnregisteredRegionsCopyUpdates) {
+    unregisterCrdtFields(CRDT_REGION);
+    crdtCounterAdd(counter(), 4);
+    applySlot(COUNTER_OFFSET, 1);
+    EXPECT_EQ(1u, crdtCounterValue(counter()));
+}
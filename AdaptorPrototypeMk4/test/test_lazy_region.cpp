@@ -0,0 +1,407 @@
+#include <gtest/gtest.h>
+#include "../src/lazy_region.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include "../src/memory_layout.h"
+#include <process.h>
+#include <string.h>
+
+#define LAZY_SOURCE "TestLazySource"
+#define LAZY_COPY "TestLazyCopy"
+#define LAZY_PEER "10.0.0.2:8081"
+#define LAZY_PAGES 8
+
+static size_t g_pageSize = 0;
+static bool g_answerRequests = true;
+static std::vector<SyncMessage> g_requests;
+static HANDLE g_requestsMutex = NULL;
+
+/**
+ * @brief Answer a page request of the copy from the source region, as its owner would
+ */
+static void answerRequest(const SyncMessage& request) {
+    SyncMessage toSource = request;
+    strcpy(toSource.memoryName, LAZY_SOURCE);
+    std::vector<SyncMessage> replies;
+    buildLazyPageReplies(toSource, LAZY_PEER, replies);
+    for (size_t i = 0; i < replies.size(); i++) {
+        strcpy(replies[i].memoryName, LAZY_COPY);
+        receiveLazyPage(replies[i]);
+    }
+}
+
+static void testPageSender(const SyncMessage& request) {
+    WaitForSingleObject(g_requestsMutex, INFINITE);
+    g_requests.push_back(request);
+    bool answer = g_answerRequests;
+    ReleaseMutex(g_requestsMutex);
+    if (answer) {
+        answerRequest(request);
+    }
+}
+
+/**
+ * @brief A read of one byte, made on its own thread as it may wait for a page
+ */
+struct LazyRead {
+    const volatile char* address;
+    char value;
+};
+
+static unsigned int __stdcall lazyReadThreadFunc(void* arg) {
+    LazyRead* read = static_cast<LazyRead*>(arg);
+    read->value = *read->address;
+    return 0;
+}
+
+class LazyRegionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        if (!lazyReplicationSupported()) {
+            GTEST_SKIP() << "userfaultfd is not available";
+        }
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        g_pageSize = systemInfo.dwPageSize;
+        if (g_requestsMutex == NULL) {
+            g_requestsMutex = CreateMutex(NULL, FALSE, NULL);
+        }
+        g_requests.clear();
+        g_answerRequests = true;
+
+        initChangeTracking();
+        ASSERT_TRUE(initializeSharedMemory(LAZY_SOURCE, LAZY_PAGES * g_pageSize));
+        ASSERT_TRUE(initializeSharedMemory(LAZY_COPY, LAZY_PAGES * g_pageSize));
+        source = static_cast<char*>(getSharedMemory(LAZY_SOURCE));
+        copy = static_cast<char*>(getSharedMemory(LAZY_COPY));
+
+        // Page n of the source is filled with 'a' + n
+        for (int page = 0; page < LAZY_PAGES; page++) {
+            size_t start = (page == 0) ? sizeof(MemoryLayout) : page * g_pageSize;
+            memset(source + start, 'a' + page, (page + 1) * g_pageSize - start);
+        }
+        reinterpret_cast<MemoryLayout*>(source)->version = 7;
+        setLazyPageSender(testPageSender);
+    }
+
+    void TearDown() override {
+        if (!lazyReplicationSupported()) {
+            return;
+        }
+        stopLazyRegion(LAZY_COPY);
+        setLazyPageSender(NULL);
+        forgetLazyPeers(LAZY_SOURCE);
+        cleanupSharedMemory(LAZY_COPY);
+        cleanupSharedMemory(LAZY_SOURCE);
+        cleanupChangeTracking();
+    }
+
+    LazyRegionStats stats() {
+        LazyRegionStats lazy;
+        memset(&lazy, 0, sizeof(lazy));
+        getLazyRegionStats(LAZY_COPY, &lazy);
+        return lazy;
+    }
+
+    bool waitForNoPendingPages() {
+        for (int i = 0; i < 2000; i++) {
+            if (stats().pendingPages == 0) {
+                return true;
+            }
+            Sleep(1);
+        }
+        return false;
+    }
+
+    bool waitForRequest(size_t offset) {
+        for (int i = 0; i < 2000; i++) {
+            WaitForSingleObject(g_requestsMutex, INFINITE);
+            bool found = false;
+            for (size_t r = 0; r < g_requests.size() && !found; r++) {
+                found = g_requests[r].offset == offset;
+            }
+            ReleaseMutex(g_requestsMutex);
+            if (found) {
+                return true;
+            }
+            Sleep(1);
+        }
+        return false;
+    }
+
+    void applyBytes(size_t offset, const char* text, uint64_t version) {
+        SyncMessage message;
+        memset(&message, 0, sizeof(message));
+        message.msgType = MSG_SINGLE_UPDATE;
+        strcpy(message.memoryName, LAZY_COPY);
+        message.offset = offset;
+        message.size = strlen(text);
+        message.version = version;
+        memcpy(message.data, text, message.size);
+        applyUpdate(message);
+    }
+
+    char* source;
+    char* copy;
+};
+
+TEST_F(LazyRegionTest, ReadsFetchPagesFromTheSource) {
+    ASSERT_TRUE(startLazyRegion(LAZY_COPY));
+    EXPECT_TRUE(isLazyRegion(LAZY_COPY));
+    ASSERT_TRUE(waitForNoPendingPages());
+    EXPECT_EQ(7u, reinterpret_cast<MemoryLayout*>(copy)->version);
+    EXPECT_EQ('a', copy[sizeof(MemoryLayout)]);
+
+    // This thread waits for the page on its first read
+    EXPECT_EQ('a' + 3, copy[3 * g_pageSize + 5]);
+    EXPECT_EQ('a' + 3, copy[4 * g_pageSize - 1]);
+    LazyRegionStats lazy = stats();
+    EXPECT_EQ(2u, lazy.residentPages);
+    EXPECT_EQ(1u, lazy.faults);
+    EXPECT_EQ(2 * g_pageSize, lazy.bytesFetched);
+}
+
+TEST_F(LazyRegionTest, UpdatesOnlyLandOnPresentPages) {
+    ASSERT_TRUE(startLazyRegion(LAZY_COPY));
+    ASSERT_TRUE(waitForNoPendingPages());
+    EXPECT_EQ('a' + 2, copy[2 * g_pageSize]);
+
+    applyBytes(2 * g_pageSize + 10, "newer", 8);
+    EXPECT_EQ(0, memcmp(copy + 2 * g_pageSize + 10, "newer", 5));
+    applyBytes(2 * g_pageSize + 10, "older", 6);
+    EXPECT_EQ(0, memcmp(copy + 2 * g_pageSize + 10, "newer", 5));
+    EXPECT_EQ(8u, reinterpret_cast<MemoryLayout*>(copy)->version);
+    EXPECT_EQ(1u, stats().updatesDropped);
+
+    // An update across a present and an absent page keeps only its first part
+    applyBytes(3 * g_pageSize - 2, "span", 9);
+    EXPECT_EQ(0, memcmp(copy + 3 * g_pageSize - 2, "sp", 2));
+    EXPECT_EQ(2u, stats().updatesDropped);
+
+    // The absent page is fetched whole when read
+    applyBytes(5 * g_pageSize, "lost", 9);
+    EXPECT_EQ(3u, stats().updatesDropped);
+    EXPECT_EQ('a' + 5, copy[5 * g_pageSize]);
+    EXPECT_EQ('a' + 3, copy[3 * g_pageSize]);
+}
+
+TEST_F(LazyRegionTest, UpdatesToAPageOnItsWayAreHeld) {
+    ASSERT_TRUE(startLazyRegion(LAZY_COPY));
+    ASSERT_TRUE(waitForNoPendingPages());
+    g_answerRequests = false;
+
+    LazyRead read;
+    read.address = copy + 4 * g_pageSize + 100;
+    read.value = 0;
+    unsigned int threadId;
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, lazyReadThreadFunc, &read, 0, &threadId);
+    ASSERT_TRUE(thread != NULL);
+    ASSERT_TRUE(waitForRequest(4 * g_pageSize));
+    EXPECT_EQ(WAIT_TIMEOUT, WaitForSingleObject(thread, 50));
+
+    applyBytes(4 * g_pageSize + 100, "held", 9);
+    applyBytes(4 * g_pageSize + 200, "stale", 5);
+    EXPECT_EQ(0u, stats().updatesDropped);
+
+    // The source's page is at version 7: the newer update goes on top of it, the older one not
+    SyncMessage request;
+    WaitForSingleObject(g_requestsMutex, INFINITE);
+    request = g_requests.back();
+    ReleaseMutex(g_requestsMutex);
+    answerRequest(request);
+    ASSERT_EQ(WAIT_OBJECT_0, WaitForSingleObject(thread, 2000));
+    CloseHandle(thread);
+
+    EXPECT_EQ('h', read.value);
+    EXPECT_EQ(0, memcmp(copy + 4 * g_pageSize + 100, "held", 4));
+    EXPECT_EQ('a' + 4, copy[4 * g_pageSize + 200]);
+    EXPECT_EQ(0u, stats().pendingPages);
+}
+
+TEST_F(LazyRegionTest, RetriesAskOnlyForTheMissingParts) {
+    ASSERT_TRUE(startLazyRegion(LAZY_COPY));
+    ASSERT_TRUE(waitForNoPendingPages());
+    g_answerRequests = false;
+
+    LazyRead read;
+    read.address = copy + 6 * g_pageSize;
+    read.value = 0;
+    unsigned int threadId;
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, lazyReadThreadFunc, &read, 0, &threadId);
+    ASSERT_TRUE(thread != NULL);
+    ASSERT_TRUE(waitForRequest(6 * g_pageSize));
+
+    // Every part but the second arrives
+    SyncMessage request;
+    WaitForSingleObject(g_requestsMutex, INFINITE);
+    request = g_requests.back();
+    g_requests.clear();
+    ReleaseMutex(g_requestsMutex);
+    strcpy(request.memoryName, LAZY_SOURCE);
+    std::vector<SyncMessage> replies;
+    ASSERT_TRUE(buildLazyPageReplies(request, LAZY_PEER, replies));
+    for (size_t i = 0; i < replies.size(); i++) {
+        if (i != 1) {
+            strcpy(replies[i].memoryName, LAZY_COPY);
+            EXPECT_TRUE(receiveLazyPage(replies[i]));
+        }
+    }
+    EXPECT_EQ(WAIT_TIMEOUT, WaitForSingleObject(thread, 20));
+
+    // The retry names the parts received, so only the missing one is sent again
+    ASSERT_TRUE(waitForRequest(6 * g_pageSize));
+    WaitForSingleObject(g_requestsMutex, INFINITE);
+    request = g_requests.back();
+    ReleaseMutex(g_requestsMutex);
+    PageRequestInfo info;
+    memcpy(&info, request.data, sizeof(info));
+    EXPECT_EQ(7u, info.version);
+    EXPECT_EQ(replies.size() == 64 ? ~2ull : ((1ull << replies.size()) - 1) & ~2ull, info.partsReceived);
+    answerRequest(request);
+    ASSERT_EQ(WAIT_OBJECT_0, WaitForSingleObject(thread, 2000));
+    CloseHandle(thread);
+
+    EXPECT_EQ('a' + 6, read.value);
+    EXPECT_EQ(2 * g_pageSize, stats().bytesFetched);  // The header page and page 6, each part once
+}
+
+TEST_F(LazyRegionTest, RefusesACopyThatHoldsData) {
+    copy[2 * g_pageSize] = 'x';
+    EXPECT_FALSE(startLazyRegion(LAZY_COPY));
+    EXPECT_FALSE(isLazyRegion(LAZY_COPY));
+
+    // Updates are copied as usual
+    applyBytes(5 * g_pageSize, "full", 3);
+    EXPECT_EQ(0, memcmp(copy + 5 * g_pageSize, "full", 4));
+}
+
+TEST(LazyRegionSourceTest, RepliesWithPagesAndSendsOnlyTheirChanges) {
+    const size_t page = 4096;
+    initChangeTracking();
+    ASSERT_TRUE(initializeSharedMemory(LAZY_SOURCE, 4 * page));
+    char* region = static_cast<char*>(getSharedMemory(LAZY_SOURCE));
+    memset(region + page, 'q', page);
+    reinterpret_cast<MemoryLayout*>(region)->version = 3;
+
+    std::vector<MemoryChange> changes(1);
+    changes[0].offset = 2 * page + 8;
+    changes[0].size = 8;
+    changes[0].inProgress = false;
+    EXPECT_TRUE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+
+    SyncMessage request;
+    memset(&request, 0, sizeof(request));
+    request.msgType = MSG_PAGE_REQUEST;
+    strcpy(request.memoryName, LAZY_SOURCE);
+    request.updateId = 42;
+    request.offset = page;
+    PageRequestInfo info;
+    memset(&info, 0, sizeof(info));
+    info.pageSize = page;
+    memcpy(request.data, &info, sizeof(info));
+    request.size = sizeof(info);
+    std::vector<SyncMessage> replies;
+    ASSERT_TRUE(buildLazyPageReplies(request, LAZY_PEER, replies));
+    ASSERT_EQ(page / MAX_SYNC_DATA_SIZE, replies.size());
+    for (size_t i = 0; i < replies.size(); i++) {
+        EXPECT_EQ(MSG_PAGE_DATA, replies[i].msgType);
+        EXPECT_EQ(42u, replies[i].updateId);
+        EXPECT_EQ(3u, replies[i].version);
+        EXPECT_EQ(page + i * MAX_SYNC_DATA_SIZE, replies[i].offset);
+        EXPECT_EQ(i + 1 < replies.size() ? SYNC_FLAG_MORE_IN_VERSION : 0u, replies[i].flags);
+        EXPECT_EQ('q', replies[i].data[MAX_SYNC_DATA_SIZE - 1]);
+    }
+
+    // A retry at the same version gets only the parts it lacks, at another version all of them
+    info.version = 3;
+    info.partsReceived = 0x5;
+    memcpy(request.data, &info, sizeof(info));
+    replies.clear();
+    ASSERT_TRUE(buildLazyPageReplies(request, LAZY_PEER, replies));
+    ASSERT_EQ(page / MAX_SYNC_DATA_SIZE - 2, replies.size());
+    EXPECT_EQ(page + MAX_SYNC_DATA_SIZE, replies[0].offset);
+    EXPECT_EQ(page + 3 * MAX_SYNC_DATA_SIZE, replies[1].offset);
+    EXPECT_EQ(0u, replies.back().flags);
+    info.version = 2;
+    memcpy(request.data, &info, sizeof(info));
+    replies.clear();
+    ASSERT_TRUE(buildLazyPageReplies(request, LAZY_PEER, replies));
+    EXPECT_EQ(page / MAX_SYNC_DATA_SIZE, replies.size());
+    info.version = 0;
+    info.partsReceived = 0;
+
+    // The peer now only wants changes to the header page and the page it fetched
+    EXPECT_FALSE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+    EXPECT_TRUE(lazyPeerWantsChanges(LAZY_SOURCE, "10.0.0.3:8081", changes));
+    changes[0].offset = page - 4;
+    EXPECT_TRUE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+    changes[0].offset = 64;
+    EXPECT_TRUE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+
+    // Pages must be aligned and of a size the source serves
+    info.pageSize = 3000;
+    memcpy(request.data, &info, sizeof(info));
+    EXPECT_FALSE(buildLazyPageReplies(request, LAZY_PEER, replies));
+    info.pageSize = page;
+    memcpy(request.data, &info, sizeof(info));
+    request.offset = page / 2;
+    EXPECT_FALSE(buildLazyPageReplies(request, LAZY_PEER, replies));
+    request.offset = 8 * page;
+    EXPECT_FALSE(buildLazyPageReplies(request, LAZY_PEER, replies));
+
+    forgetLazyPeers(LAZY_SOURCE);
+    changes[0].offset = 2 * page + 8;
+    EXPECT_TRUE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+    cleanupSharedMemory(LAZY_SOURCE);
+    cleanupChangeTracking();
+}
+
+TEST(LazyRegionSourceTest, ForgetsPagesOfAPeerThatStartsOver) {
+    const size_t page = 4096;
+    initChangeTracking();
+    ASSERT_TRUE(initializeSharedMemory(LAZY_SOURCE, 4 * page));
+
+    SyncMessage request;
+    memset(&request, 0, sizeof(request));
+    request.msgType = MSG_PAGE_REQUEST;
+    strcpy(request.memoryName, LAZY_SOURCE);
+    request.offset = 2 * page;
+    PageRequestInfo info;
+    memset(&info, 0, sizeof(info));
+    info.pageSize = page;
+    info.copyId = 1;
+    memcpy(request.data, &info, sizeof(info));
+    request.size = sizeof(info);
+    std::vector<SyncMessage> replies;
+    ASSERT_TRUE(buildLazyPageReplies(request, LAZY_PEER, replies));
+
+    std::vector<MemoryChange> changes(1);
+    changes[0].offset = 2 * page + 8;
+    changes[0].size = 8;
+    changes[0].inProgress = false;
+    EXPECT_TRUE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+
+    // A resync sends the peer everything until it asks for a page again
+    changes[0].offset = 3 * page;
+    EXPECT_FALSE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+    resetLazyPeer(LAZY_SOURCE, LAZY_PEER);
+    EXPECT_TRUE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+
+    // The same copy keeps the pages it had
+    request.offset = page;
+    ASSERT_TRUE(buildLazyPageReplies(request, LAZY_PEER, replies));
+    EXPECT_FALSE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+    changes[0].offset = 2 * page + 8;
+    EXPECT_TRUE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+
+    // A new copy starts with none of them
+    info.copyId = 2;
+    memcpy(request.data, &info, sizeof(info));
+    request.offset = 0;
+    ASSERT_TRUE(buildLazyPageReplies(request, LAZY_PEER, replies));
+    EXPECT_FALSE(lazyPeerWantsChanges(LAZY_SOURCE, LAZY_PEER, changes));
+
+    forgetLazyPeers(LAZY_SOURCE);
+    cleanupSharedMemory(LAZY_SOURCE);
+    cleanupChangeTracking();
+}
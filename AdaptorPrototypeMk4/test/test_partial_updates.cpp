@@ -2,17 +2,23 @@
 #include "../src/change_tracking.h"
 #include "../src/sync_message.h"
 #include "../src/memory_layout.h"
+#include "../src/shared_memory.h"
 #include <string>
+#include <set>
+#include <vector>
+#include <process.h>
 
 class PartialUpdatesTest : public ::testing::Test {
 protected:
     void SetUp() override {
-        // Initialize change tracking
+        // Initialize change tracking and the region the tests mark as changed
         initChangeTracking();
+        ASSERT_TRUE(initializeSharedMemory("TestMemory", sizeof(MemoryLayout)));
     }
 
     void TearDown() override {
         // Clean up change tracking
+        cleanupSharedMemory("TestMemory");
         cleanupChangeTracking();
     }
 };
@@ -60,6 +66,33 @@ TEST_F(PartialUpdatesTest, GenerateUniqueId) {
     ASSERT_NE(id1, id3);
 }
 
+static unsigned int __stdcall generateIdsThreadFunc(void* arg) {
+    std::vector<uint64_t>* ids = static_cast<std::vector<uint64_t>*>(arg);
+    for (size_t i = 0; i < ids->size(); i++) {
+        (*ids)[i] = generateUniqueId();
+    }
+    return 0;
+}
+
+TEST_F(PartialUpdatesTest, GenerateUniqueIdFromManyThreads) {
+    // IDs generated at the same time on different threads are still unique
+    const int threadCount = 4;
+    std::vector<std::vector<uint64_t> > ids(threadCount, std::vector<uint64_t>(20000));
+    HANDLE threads[threadCount];
+    for (int t = 0; t < threadCount; t++) {
+        unsigned int threadId;
+        threads[t] = (HANDLE)_beginthreadex(NULL, 0, generateIdsThreadFunc, &ids[t], 0, &threadId);
+        ASSERT_TRUE(threads[t] != NULL);
+    }
+    std::set<uint64_t> unique;
+    for (int t = 0; t < threadCount; t++) {
+        ASSERT_EQ(WAIT_OBJECT_0, WaitForSingleObject(threads[t], 10000));
+        CloseHandle(threads[t]);
+        unique.insert(ids[t].begin(), ids[t].end());
+    }
+    ASSERT_EQ(static_cast<size_t>(threadCount * 20000), unique.size());
+}
+
 TEST_F(PartialUpdatesTest, UpdateTimeouts) {
     // Add some in-progress updates
     lockUpdatesMutex();
@@ -135,3 +168,39 @@ TEST_F(PartialUpdatesTest, MultipleChanges) {
     
     unlockChangesMutex();
 }
+
+TEST_F(PartialUpdatesTest, ResizeMessageGrowsRegionBeforeLaterUpdates) {
+    const char* memoryName = "TestResizedReplica";
+    ASSERT_TRUE(initializeSharedMemory(memoryName, 4096));
+
+    SyncMessage resize;
+    memset(&resize, 0, sizeof(resize));
+    resize.msgType = MSG_RESIZE;
+    strncpy(resize.memoryName, memoryName, sizeof(resize.memoryName) - 1);
+    resize.version = 3;
+    RegionResizeInfo info;
+    info.newSize = 64 * 1024;
+    memcpy(resize.data, &info, sizeof(info));
+    resize.size = sizeof(info);
+    applyResize(resize);
+
+    // An update past the old end waits for the switch instead of being discarded
+    SyncMessage update;
+    memset(&update, 0, sizeof(update));
+    update.msgType = MSG_SINGLE_UPDATE;
+    strncpy(update.memoryName, memoryName, sizeof(update.memoryName) - 1);
+    update.version = 4;
+    update.offset = 60000;
+    update.size = 4;
+    memcpy(update.data, "grow", 4);
+    applyUpdate(update);
+
+    size_t size = 0;
+    char* region = static_cast<char*>(getSharedMemoryMapping(memoryName, &size));
+    ASSERT_NE(region, nullptr);
+    EXPECT_EQ(size, 64u * 1024);
+    EXPECT_EQ(memcmp(region + 60000, "grow", 4), 0);
+    EXPECT_EQ(reinterpret_cast<MemoryLayout*>(region)->version, 4u);
+
+    cleanupSharedMemory(memoryName);
+}
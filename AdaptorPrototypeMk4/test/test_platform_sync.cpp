@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <windows.h>
+#include <process.h>
+
+namespace {
+
+struct MutexThreadState {
+    HANDLE mutex;
+    DWORD waitResult;
+    BOOL released;
+};
+
+// Takes the mutex twice and exits without releasing it
+unsigned int __stdcall abandonMutexThread(void* arg) {
+    MutexThreadState* state = static_cast<MutexThreadState*>(arg);
+    WaitForSingleObject(state->mutex, INFINITE);
+    WaitForSingleObject(state->mutex, INFINITE);
+    return 0;
+}
+
+// Tries the mutex briefly and to release it without owning it
+unsigned int __stdcall contendMutexThread(void* arg) {
+    MutexThreadState* state = static_cast<MutexThreadState*>(arg);
+    state->released = ReleaseMutex(state->mutex);
+    state->waitResult = WaitForSingleObject(state->mutex, 20);
+    return 0;
+}
+
+unsigned int __stdcall openSectionThread(void* arg) {
+    int* failures = static_cast<int*>(arg);
+    for (int i = 0; i < 200; i++) {
+        HANDLE section = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, 4096, "TestPlatformSection");
+        DWORD error = GetLastError();
+        char* view = section ? static_cast<char*>(MapViewOfFile(section, FILE_MAP_ALL_ACCESS, 0, 0, 4096)) : NULL;
+        if (view == NULL || error != ERROR_ALREADY_EXISTS || view[0] != 'k') {
+            (*failures)++;
+        }
+        if (view) {
+            UnmapViewOfFile(view);
+        }
+        if (section) {
+            CloseHandle(section);
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+TEST(PlatformSyncTest, MutexIsRecursiveAndOwned) {
+    HANDLE mutex = CreateMutex(NULL, FALSE, NULL);
+    ASSERT_NE(mutex, (HANDLE)NULL);
+    ASSERT_EQ(WaitForSingleObject(mutex, INFINITE), WAIT_OBJECT_0);
+    ASSERT_EQ(WaitForSingleObject(mutex, 0), WAIT_OBJECT_0);
+
+    MutexThreadState state = { mutex, WAIT_FAILED, TRUE };
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, contendMutexThread, &state, 0, NULL);
+    ASSERT_EQ(WaitForSingleObject(thread, 5000), WAIT_OBJECT_0);
+    CloseHandle(thread);
+    EXPECT_FALSE(state.released);
+    EXPECT_EQ(state.waitResult, WAIT_TIMEOUT);
+
+    // Held until released as often as it was acquired
+    EXPECT_TRUE(ReleaseMutex(mutex));
+    EXPECT_TRUE(ReleaseMutex(mutex));
+    EXPECT_FALSE(ReleaseMutex(mutex));
+    CloseHandle(mutex);
+}
+
+TEST(PlatformSyncTest, MutexOfAnExitedThreadIsAbandoned) {
+    HANDLE mutex = CreateMutex(NULL, FALSE, NULL);
+    ASSERT_NE(mutex, (HANDLE)NULL);
+
+    MutexThreadState state = { mutex, WAIT_FAILED, FALSE };
+    HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, abandonMutexThread, &state, 0, NULL);
+    ASSERT_EQ(WaitForSingleObject(thread, 5000), WAIT_OBJECT_0);
+    CloseHandle(thread);
+
+    // The next owner is told once, however often the thread had acquired it
+    ASSERT_EQ(WaitForSingleObject(mutex, 1000), WAIT_ABANDONED);
+    EXPECT_TRUE(ReleaseMutex(mutex));
+    ASSERT_EQ(WaitForSingleObject(mutex, 1000), WAIT_OBJECT_0);
+    EXPECT_TRUE(ReleaseMutex(mutex));
+    CloseHandle(mutex);
+}
+
+TEST(PlatformSyncTest, SectionLastsUntilItsLastHandle) {
+    HANDLE section = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, 4096, "TestPlatformSection");
+    ASSERT_NE(section, (HANDLE)NULL);
+    char* view = static_cast<char*>(MapViewOfFile(section, FILE_MAP_ALL_ACCESS, 0, 0, 4096));
+    ASSERT_NE(view, (char*)NULL);
+    view[0] = 'k';
+
+    // Handles opened and closed concurrently never recreate the section
+    int failures[4] = { 0, 0, 0, 0 };
+    HANDLE threads[4];
+    for (int t = 0; t < 4; t++) {
+        threads[t] = (HANDLE)_beginthreadex(NULL, 0, openSectionThread, &failures[t], 0, NULL);
+    }
+    for (int t = 0; t < 4; t++) {
+        ASSERT_EQ(WaitForSingleObject(threads[t], 30000), WAIT_OBJECT_0);
+        CloseHandle(threads[t]);
+        EXPECT_EQ(failures[t], 0);
+    }
+    EXPECT_EQ(view[0], 'k');
+
+    UnmapViewOfFile(view);
+    CloseHandle(section);
+    EXPECT_EQ(OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, "TestPlatformSection"), (HANDLE)NULL);
+}
@@ -0,0 +1,344 @@
+#include <gtest/gtest.h>
+#include "../src/range_lease.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include "../src/memory_layout.h"
+#include <string.h>
+
+#define LEASE_REGION "TestLeaseRegion"
+#define LEASE_DATA_SIZE 4096
+#define LEASE_DATA_OFFSET MULTI_WRITER_DATA_OFFSET
+
+/// Writes passed to the forwarder, and the nodes they were sent to
+static std::vector<SyncMessage> g_forwarded;
+static std::vector<uint32_t> g_forwardedTo;
+
+static void captureForwardedWrite(uint32_t nodeId, const SyncMessage& message) {
+    g_forwarded.push_back(message);
+    g_forwardedTo.push_back(nodeId);
+}
+
+class RangeLeaseTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        initChangeTracking();
+        ASSERT_TRUE(initializeSharedMemory(LEASE_REGION, LEASE_DATA_OFFSET + LEASE_DATA_SIZE));
+        ASSERT_TRUE(initRangeLeaseTable(LEASE_REGION));
+        ASSERT_TRUE(setLeaseNodeId(1));
+        region = static_cast<char*>(getSharedMemory(LEASE_REGION));
+        g_forwarded.clear();
+        g_forwardedTo.clear();
+        setRangeWriteForwarder(captureForwardedWrite);
+        setRangeMigration(RANGE_MIGRATION_DEFAULT_WRITES, RANGE_MIGRATION_WINDOW_MS);
+    }
+
+    void TearDown() override {
+        setRangeWriteForwarder(NULL);
+        lockChangesMutex();
+        g_pendingChanges.erase(LEASE_REGION);
+        unlockChangesMutex();
+        cleanupSharedMemory(LEASE_REGION);
+        cleanupChangeTracking();
+    }
+
+    RangeLeaseTable* table() {
+        return reinterpret_cast<RangeLeaseTable*>(region + RANGE_LEASE_TABLE_OFFSET);
+    }
+
+    SyncMessage update(size_t offset, size_t size, uint32_t origin) {
+        SyncMessage message;
+        memset(&message, 0, sizeof(message));
+        message.msgType = MSG_SINGLE_UPDATE;
+        strcpy(message.memoryName, LEASE_REGION);
+        message.offset = offset;
+        message.size = size;
+        message.origin = origin;
+        return message;
+    }
+
+    SyncMessage rangeWrite(size_t offset, int value, uint32_t origin) {
+        SyncMessage message = update(offset, sizeof(value), origin);
+        message.msgType = MSG_RANGE_WRITE;
+        memcpy(message.data, &value, sizeof(value));
+        return message;
+    }
+
+    int valueAt(size_t offset) {
+        int value;
+        memcpy(&value, region + offset, sizeof(value));
+        return value;
+    }
+
+    char* region;
+};
+
+TEST_F(RangeLeaseTest, HolderWritesItsRange) {
+    EXPECT_FALSE(setLeaseNodeId(0));
+    EXPECT_FALSE(setLeaseNodeId(MAX_LEASE_NODES + 1));
+    EXPECT_FALSE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET - 8, 16, 10000));   // Overlaps the table
+    EXPECT_FALSE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET + LEASE_DATA_SIZE - 8, 16, 10000));
+
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+    EXPECT_EQ(1u, rangeLeaseHolder(LEASE_REGION, LEASE_DATA_OFFSET + 10, 4));
+    EXPECT_EQ(0u, rangeLeaseHolder(LEASE_REGION, LEASE_DATA_OFFSET + 98, 4));
+
+    uint64_t version = reinterpret_cast<MemoryLayout*>(region)->version;
+    int value = 1234;
+    ASSERT_TRUE(writeLeasedRange(LEASE_REGION, LEASE_DATA_OFFSET + 10, &value, sizeof(value)));
+    EXPECT_EQ(0, memcmp(region + LEASE_DATA_OFFSET + 10, &value, sizeof(value)));
+    EXPECT_GT(reinterpret_cast<MemoryLayout*>(region)->version, version);
+
+    // The write is queued for the peers along with the lease itself
+    lockChangesMutex();
+    std::vector<MemoryChange>& changes = g_pendingChanges[LEASE_REGION];
+    bool queued = false;
+    for (size_t i = 0; i < changes.size(); i++) {
+        queued = queued || (changes[i].offset == LEASE_DATA_OFFSET + 10 && changes[i].size == sizeof(value));
+    }
+    unlockChangesMutex();
+    EXPECT_TRUE(queued);
+
+    EXPECT_FALSE(writeLeasedRange(LEASE_REGION, LEASE_DATA_OFFSET + 98, &value, sizeof(value)));
+    EXPECT_FALSE(writeLeasedRange(LEASE_REGION, LEASE_DATA_OFFSET + 200, &value, sizeof(value)));
+}
+
+TEST_F(RangeLeaseTest, RefusesRangesLeasedByOthers) {
+    ASSERT_TRUE(setLeaseNodeId(2));
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+
+    ASSERT_TRUE(setLeaseNodeId(1));
+    EXPECT_FALSE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET + 50, 100, 10000));
+    EXPECT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET + 100, 100, 10000));
+    int value = 5;
+    EXPECT_FALSE(writeLeasedRange(LEASE_REGION, LEASE_DATA_OFFSET, &value, sizeof(value)));
+    EXPECT_TRUE(writeLeasedRange(LEASE_REGION, LEASE_DATA_OFFSET + 100, &value, sizeof(value)));
+
+    std::vector<RangeLease> leases;
+    ASSERT_TRUE(getRangeLeases(LEASE_REGION, leases));
+    ASSERT_EQ(2u, leases.size());
+    EXPECT_EQ(1u, leases[0].owner);
+    EXPECT_EQ(2u, leases[1].owner);
+}
+
+TEST_F(RangeLeaseTest, EarlierGrantWinsAnOverlap) {
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+
+    // Node 2 claimed an overlapping range first, before the rows had replicated
+    RangeLease rival = table()->leases[0][0];
+    rival.owner = 2;
+    rival.offset = LEASE_DATA_OFFSET + 50;
+    rival.granted -= 1;
+    table()->leases[1][0] = rival;
+
+    EXPECT_EQ(2u, rangeLeaseHolder(LEASE_REGION, LEASE_DATA_OFFSET + 60, 4));
+    EXPECT_EQ(1u, rangeLeaseHolder(LEASE_REGION, LEASE_DATA_OFFSET + 10, 4));
+    int value = 5;
+    EXPECT_FALSE(writeLeasedRange(LEASE_REGION, LEASE_DATA_OFFSET + 60, &value, sizeof(value)));
+
+    // A tie goes to the lower node ID
+    table()->leases[1][0].granted += 1;
+    EXPECT_EQ(1u, rangeLeaseHolder(LEASE_REGION, LEASE_DATA_OFFSET + 60, 4));
+    EXPECT_TRUE(writeLeasedRange(LEASE_REGION, LEASE_DATA_OFFSET + 60, &value, sizeof(value)));
+}
+
+TEST_F(RangeLeaseTest, AdmitsUpdatesFromTheHolderOnly) {
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+
+    EXPECT_TRUE(rangeLeasesAdmit(update(LEASE_DATA_OFFSET + 10, 4, 1)));
+    EXPECT_FALSE(rangeLeasesAdmit(update(LEASE_DATA_OFFSET + 10, 4, 2)));
+    EXPECT_FALSE(rangeLeasesAdmit(update(LEASE_DATA_OFFSET + 10, 4, 0)));
+    EXPECT_TRUE(rangeLeasesAdmit(update(LEASE_DATA_OFFSET + 500, 4, 2)));     // Nobody leases it
+    EXPECT_TRUE(rangeLeasesAdmit(update(offsetof(MemoryLayout, data), sizeof(int), 2)));
+
+    // Lease rows are written by their own node
+    size_t row2 = RANGE_LEASE_TABLE_OFFSET + offsetof(RangeLeaseTable, leases[1][0]);
+    size_t row1 = RANGE_LEASE_TABLE_OFFSET + offsetof(RangeLeaseTable, leases[0][0]);
+    EXPECT_TRUE(rangeLeasesAdmit(update(row2, sizeof(RangeLease), 2)));
+    EXPECT_FALSE(rangeLeasesAdmit(update(row1, sizeof(RangeLease), 2)));
+    EXPECT_FALSE(rangeLeasesAdmit(update(RANGE_LEASE_TABLE_OFFSET, 4, 2)));
+
+    SyncMessage resync = update(LEASE_DATA_OFFSET + 10, 4, 2);
+    resync.msgType = MSG_RESYNC_REQUEST;
+    EXPECT_TRUE(rangeLeasesAdmit(resync));
+}
+
+TEST_F(RangeLeaseTest, ChecksMultipartUpdatesWithTheRowsTheyCarry) {
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+
+    // Node 2 takes the range from node 1 and writes it in the same update
+    RangeLease handed = table()->leases[0][0];
+    handed.handoffTo = 2;
+    table()->leases[0][0] = handed;
+    RangeLease taken = handed;
+    taken.owner = 2;
+    taken.handoffTo = 0;
+
+    std::vector<SyncMessage> chunks;
+    chunks.push_back(update(RANGE_LEASE_TABLE_OFFSET + offsetof(RangeLeaseTable, leases[1][0]), sizeof(taken), 2));
+    chunks[0].msgType = MSG_START_UPDATE;
+    memcpy(chunks[0].data, &taken, sizeof(taken));
+    chunks.push_back(update(LEASE_DATA_OFFSET + 10, 4, 2));
+    chunks[1].msgType = MSG_END_UPDATE;
+    EXPECT_TRUE(rangeLeasesAdmit(chunks[0]));
+    EXPECT_TRUE(rangeLeasesAdmit(chunks[1]));
+    EXPECT_EQ(0u, rangeLeasesFilterUpdate(chunks));
+    EXPECT_EQ(2u, chunks.size());
+
+    // Without the row the data part is removed
+    chunks.erase(chunks.begin());
+    EXPECT_EQ(1u, rangeLeasesFilterUpdate(chunks));
+    EXPECT_TRUE(chunks.empty());
+}
+
+TEST_F(RangeLeaseTest, LeasesRenewAndLapse) {
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 600));
+    EXPECT_EQ(0, renewRangeLeases(LEASE_REGION));
+    Sleep(350);
+    EXPECT_EQ(1, renewRangeLeases(LEASE_REGION));
+    EXPECT_EQ(1u, rangeLeaseHolder(LEASE_REGION, LEASE_DATA_OFFSET, 100));
+
+    // A node that stops renewing loses the range
+    Sleep(650);
+    EXPECT_EQ(0u, rangeLeaseHolder(LEASE_REGION, LEASE_DATA_OFFSET, 100));
+    ASSERT_TRUE(setLeaseNodeId(2));
+    EXPECT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+    ASSERT_TRUE(setLeaseNodeId(1));
+    EXPECT_EQ(0, renewRangeLeases(LEASE_REGION));
+    EXPECT_EQ(0u, table()->leases[0][0].size);
+}
+
+TEST_F(RangeLeaseTest, ReleaseFreesTheRange) {
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+    EXPECT_TRUE(releaseRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100));
+    EXPECT_FALSE(releaseRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100));
+    EXPECT_EQ(0u, rangeLeaseHolder(LEASE_REGION, LEASE_DATA_OFFSET, 100));
+
+    ASSERT_TRUE(setLeaseNodeId(2));
+    EXPECT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+}
+
+TEST_F(RangeLeaseTest, ForwardsWritesToTheHolder) {
+    ASSERT_TRUE(setLeaseNodeId(2));
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+    ASSERT_TRUE(setLeaseNodeId(1));
+
+    int value = 77;
+    ASSERT_TRUE(writeSharedRange(LEASE_REGION, LEASE_DATA_OFFSET + 10, &value, sizeof(value)));
+    EXPECT_EQ(0, valueAt(LEASE_DATA_OFFSET + 10));
+    ASSERT_EQ(1u, g_forwarded.size());
+    EXPECT_EQ(2u, g_forwardedTo[0]);
+    EXPECT_EQ(MSG_RANGE_WRITE, g_forwarded[0].msgType);
+    EXPECT_EQ(1u, g_forwarded[0].origin);
+    EXPECT_EQ(0u, g_forwarded[0].flags & SYNC_FLAG_FORWARDED);
+
+    // The holder applies it; a node that doesn't hold the range passes it on once
+    ASSERT_TRUE(setLeaseNodeId(2));
+    receiveRangeWrite(g_forwarded[0]);
+    EXPECT_EQ(77, valueAt(LEASE_DATA_OFFSET + 10));
+
+    ASSERT_TRUE(setLeaseNodeId(3));
+    receiveRangeWrite(rangeWrite(LEASE_DATA_OFFSET + 20, 5, 4));
+    ASSERT_EQ(2u, g_forwarded.size());
+    EXPECT_EQ(2u, g_forwardedTo[1]);
+    EXPECT_NE(0u, g_forwarded[1].flags & SYNC_FLAG_FORWARDED);
+    receiveRangeWrite(g_forwarded[1]);
+    EXPECT_EQ(2u, g_forwarded.size());
+
+    // Nobody leases it
+    EXPECT_FALSE(writeSharedRange(LEASE_REGION, LEASE_DATA_OFFSET + 200, &value, sizeof(value)));
+}
+
+TEST_F(RangeLeaseTest, MovesToTheDominantWriter) {
+    setRangeMigration(10, 50);
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+    EXPECT_EQ(0, balanceRangeLeases(LEASE_REGION));    // Starts the first window
+
+    // Node 2 makes most of the writes
+    int value = 1;
+    ASSERT_TRUE(writeSharedRange(LEASE_REGION, LEASE_DATA_OFFSET, &value, sizeof(value)));
+    for (int i = 0; i < 20; i++) {
+        receiveRangeWrite(rangeWrite(LEASE_DATA_OFFSET + 4, i, 2));
+    }
+    EXPECT_EQ(19, valueAt(LEASE_DATA_OFFSET + 4));
+    Sleep(60);
+    EXPECT_EQ(1, balanceRangeLeases(LEASE_REGION));
+    RangeLease lease = table()->leases[0][0];
+    EXPECT_EQ(2u, lease.handoffTo);
+    EXPECT_EQ(reinterpret_cast<MemoryLayout*>(region)->version - 1, lease.handoffVersion);
+
+    // Node 1 stops writing the range and passes writes to node 2
+    EXPECT_FALSE(writeLeasedRange(LEASE_REGION, LEASE_DATA_OFFSET, &value, sizeof(value)));
+    ASSERT_TRUE(writeSharedRange(LEASE_REGION, LEASE_DATA_OFFSET, &value, sizeof(value)));
+    receiveRangeWrite(rangeWrite(LEASE_DATA_OFFSET + 8, 3, 3));
+    ASSERT_EQ(2u, g_forwarded.size());
+    EXPECT_EQ(2u, g_forwardedTo[0]);
+    EXPECT_EQ(2u, g_forwardedTo[1]);
+    EXPECT_NE(0u, g_forwarded[1].flags & SYNC_FLAG_FORWARDED);
+
+    // Node 2 takes the range and applies what was passed to it
+    ASSERT_TRUE(setLeaseNodeId(2));
+    receiveRangeWrite(g_forwarded[1]);
+    EXPECT_EQ(0, valueAt(LEASE_DATA_OFFSET + 8));
+    EXPECT_EQ(1, balanceRangeLeases(LEASE_REGION));
+    EXPECT_EQ(2u, rangeLeaseHolder(LEASE_REGION, LEASE_DATA_OFFSET, 100));
+    EXPECT_EQ(3, valueAt(LEASE_DATA_OFFSET + 8));
+    EXPECT_EQ(lease.granted, table()->leases[1][0].granted);
+    value = 9;
+    EXPECT_TRUE(writeLeasedRange(LEASE_REGION, LEASE_DATA_OFFSET, &value, sizeof(value)));
+    EXPECT_TRUE(rangeLeasesAdmit(update(LEASE_DATA_OFFSET, 4, 2)));
+    EXPECT_FALSE(rangeLeasesAdmit(update(LEASE_DATA_OFFSET, 4, 1)));
+
+    // Node 1 sees the new lease and drops its own
+    ASSERT_TRUE(setLeaseNodeId(1));
+    EXPECT_EQ(1, balanceRangeLeases(LEASE_REGION));
+    EXPECT_EQ(0u, table()->leases[0][0].size);
+    EXPECT_EQ(2u, rangeLeaseHolder(LEASE_REGION, LEASE_DATA_OFFSET, 100));
+}
+
+TEST_F(RangeLeaseTest, StaysWithoutADominantWriter) {
+    setRangeMigration(10, 50);
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 10000));
+    EXPECT_EQ(0, balanceRangeLeases(LEASE_REGION));
+    int value = 1;
+    for (int i = 0; i < 20; i++) {
+        receiveRangeWrite(rangeWrite(LEASE_DATA_OFFSET, i, 2));
+        ASSERT_TRUE(writeSharedRange(LEASE_REGION, LEASE_DATA_OFFSET, &value, sizeof(value)));
+    }
+    Sleep(60);
+    EXPECT_EQ(0, balanceRangeLeases(LEASE_REGION));
+    EXPECT_EQ(0u, table()->leases[0][0].handoffTo);
+
+    setRangeMigration(0, 50);
+    for (int i = 0; i < 20; i++) {
+        receiveRangeWrite(rangeWrite(LEASE_DATA_OFFSET, i, 2));
+    }
+    Sleep(60);
+    EXPECT_EQ(0, balanceRangeLeases(LEASE_REGION));
+    EXPECT_EQ(0u, table()->leases[0][0].handoffTo);
+}
+
+TEST_F(RangeLeaseTest, TakesBackAHandoffThatIsNotTaken) {
+    setRangeMigration(5, 50);
+    ASSERT_TRUE(acquireRangeLease(LEASE_REGION, LEASE_DATA_OFFSET, 100, 1000));
+    EXPECT_EQ(0, balanceRangeLeases(LEASE_REGION));
+    for (int i = 0; i < 10; i++) {
+        receiveRangeWrite(rangeWrite(LEASE_DATA_OFFSET, i, 2));
+    }
+    Sleep(60);
+    EXPECT_EQ(1, balanceRangeLeases(LEASE_REGION));
+    ASSERT_EQ(2u, table()->leases[0][0].handoffTo);
+
+    // Node 2 is too late to take it once half the handoff has passed
+    Sleep(600);
+    ASSERT_TRUE(setLeaseNodeId(2));
+    EXPECT_EQ(0, balanceRangeLeases(LEASE_REGION));
+    EXPECT_EQ(0u, table()->leases[1][0].size);
+
+    ASSERT_TRUE(setLeaseNodeId(1));
+    renewRangeLeases(LEASE_REGION);
+    Sleep(500);
+    balanceRangeLeases(LEASE_REGION);
+    EXPECT_EQ(0u, table()->leases[0][0].handoffTo);
+    int value = 4;
+    EXPECT_TRUE(writeLeasedRange(LEASE_REGION, LEASE_DATA_OFFSET, &value, sizeof(value)));
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include "../src/record_table.h"
+#include "../src/memory_layout.h"
+#include <vector>
+
+class RecordTableTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        RecordColumnSpec specs[] = {
+            { "id", COLUMN_UINT64, 0 },
+            { "price", COLUMN_DOUBLE, 0 },
+            { "quantity", COLUMN_INT32, 0 }
+        };
+        regionSize = recordTableRegionSize(specs, 3, 1000);
+        region.assign(regionSize, 0);
+        table = createRecordTable(&region[0], regionSize, specs, 3, 1000);
+    }
+
+    size_t regionSize;
+    std::vector<char> region;
+    RecordTableHeader* table;
+};
+
+TEST_F(RecordTableTest, Layout) {
+    ASSERT_NE(table, nullptr);
+    EXPECT_EQ(openRecordTable(&region[0]), table);
+    EXPECT_EQ(table->columnCount, 3u);
+    EXPECT_EQ(table->capacity, 1000u);
+    EXPECT_EQ(findRecordColumn(table, "price"), 1);
+    EXPECT_EQ(findRecordColumn(table, "missing"), -1);
+
+    // Columns are aligned and don't overlap
+    for (uint32_t i = 0; i < table->columnCount; i++) {
+        EXPECT_EQ(table->columns[i].dataOffset % RECORD_TABLE_ALIGNMENT, 0u);
+        EXPECT_LE(table->columns[i].dataOffset + table->columns[i].width * table->capacity,
+                  table->columns[i].dirtyOffset);
+    }
+    EXPECT_LE(table->columns[2].dirtyOffset + 16 * sizeof(uint64_t), regionSize);
+}
+
+TEST_F(RecordTableTest, RegionTooSmall) {
+    RecordColumnSpec spec = { "id", COLUMN_UINT64, 0 };
+    std::vector<char> small(sizeof(MemoryLayout) + sizeof(RecordTableHeader), 0);
+    EXPECT_EQ(createRecordTable(&small[0], small.size(), &spec, 1, 1000), nullptr);
+    EXPECT_EQ(openRecordTable(&small[0]), nullptr);
+}
+
+TEST_F(RecordTableTest, TypedAccessors) {
+    setRecordCell<double>(table, 1, 10, 12.5);
+    setRecordCell<int32_t>(table, 2, 10, -7);
+    EXPECT_DOUBLE_EQ(getRecordCell<double>(table, 1, 10), 12.5);
+    EXPECT_EQ(getRecordCell<int32_t>(table, 2, 10), -7);
+}
+
+TEST_F(RecordTableTest, CollectOnlyChangedCells) {
+    setRecordCell<double>(table, 1, 5, 1.0);
+    setRecordCell<double>(table, 1, 500, 2.0);
+    setRecordCell<int32_t>(table, 2, 7, 3);
+
+    std::vector<RecordTableRange> ranges;
+    ASSERT_EQ(collectRecordTableChanges(table, ranges, 0), 3u);
+
+    // Ranges come out column by column
+    EXPECT_EQ(ranges[0].column, 1);
+    EXPECT_EQ(ranges[0].offset, table->columns[1].dataOffset + 5 * sizeof(double));
+    EXPECT_EQ(ranges[0].size, sizeof(double));
+    EXPECT_EQ(ranges[1].column, 1);
+    EXPECT_EQ(ranges[1].offset, table->columns[1].dataOffset + 500 * sizeof(double));
+    EXPECT_EQ(ranges[2].column, 2);
+    EXPECT_EQ(ranges[2].offset, table->columns[2].dataOffset + 7 * sizeof(int32_t));
+
+    // Collecting clears the dirty bits
+    ranges.clear();
+    EXPECT_EQ(collectRecordTableChanges(table, ranges, 0), 0u);
+}
+
+TEST_F(RecordTableTest, RunsMergeAcrossWords) {
+    markRecordCellsDirty(table, 0, 60, 10);     // Spans two bitmap words
+    markRecordCellsDirty(table, 0, 72, 1);      // Two clean records after the run
+
+    std::vector<RecordTableRange> ranges;
+    ASSERT_EQ(collectRecordTableChanges(table, ranges, 2 * sizeof(uint64_t)), 1u);
+    EXPECT_EQ(ranges[0].offset, table->columns[0].dataOffset + 60 * sizeof(uint64_t));
+    EXPECT_EQ(ranges[0].size, 13 * sizeof(uint64_t));
+}
+
+TEST_F(RecordTableTest, UnchangedWriteIsNotDirty) {
+    setRecordCell<int32_t>(table, 2, 3, 0);
+    std::vector<RecordTableRange> ranges;
+    EXPECT_EQ(collectRecordTableChanges(table, ranges, 0), 0u);
+}
+
+TEST_F(RecordTableTest, HeaderReportedFirst) {
+    setRecordCount(table, 42);
+    setRecordCell<uint64_t>(table, 0, 0, 1);
+
+    std::vector<RecordTableRange> ranges;
+    ASSERT_EQ(collectRecordTableChanges(table, ranges, 0), 2u);
+    EXPECT_EQ(ranges[0].column, -1);
+    EXPECT_EQ(ranges[0].offset, recordTableHeaderOffset(table));
+    EXPECT_EQ(table->recordCount, 42u);
+}
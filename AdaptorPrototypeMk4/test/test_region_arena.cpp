@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include "../src/region_arena.h"
+#include "../src/shared_memory.h"
+#include <string.h>
+#include <vector>
+
+class RegionArenaTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        memset(region, 0, sizeof(region));
+        memset(replica, 0, sizeof(replica));
+        arena = createRegionArena(region, sizeof(region), 64, sizeof(region) - 64);
+        ASSERT_NE(arena, nullptr);
+    }
+
+    // Copy reported ranges to the replica, as the sync thread would
+    void replicate(const std::vector<MemoryChange>& changes) {
+        for (size_t i = 0; i < changes.size(); i++) {
+            memcpy(replica + changes[i].offset, region + changes[i].offset, changes[i].size);
+        }
+    }
+
+    char region[64 * 1024];
+    char replica[64 * 1024];
+    RegionArenaHeader* arena;
+};
+
+TEST_F(RegionArenaTest, SizeClasses) {
+    ArenaOffset small = arenaAllocate(arena, 1, NULL);
+    ArenaOffset medium = arenaAllocate(arena, 100, NULL);
+    ASSERT_NE(small, 0u);
+    ASSERT_NE(medium, 0u);
+
+    EXPECT_EQ(arenaBlockSize(arena, small), static_cast<size_t>(ARENA_MIN_BLOCK) - sizeof(ArenaBlockHeader));
+    EXPECT_EQ(arenaBlockSize(arena, medium), 128u - sizeof(ArenaBlockHeader));
+    EXPECT_EQ(small % 16, 0u);
+
+    // Too large for any class, and larger than the arena
+    EXPECT_EQ(arenaAllocate(arena, ARENA_MAX_BLOCK, NULL), 0u);
+    EXPECT_EQ(arenaAllocate(arena, 60 * 1024, NULL), 0u);
+}
+
+TEST_F(RegionArenaTest, FreedBlocksAreReusedByTheirClass) {
+    ArenaOffset first = arenaAllocate(arena, 40, NULL);
+    uint64_t top = arena->top;
+    ASSERT_TRUE(arenaFree(arena, first, NULL));
+    EXPECT_EQ(arena->bytesInUse, 0u);
+
+    // A different class doesn't take the freed block
+    ArenaOffset other = arenaAllocate(arena, 200, NULL);
+    EXPECT_NE(other, first);
+
+    // The same class does, without growing the arena
+    top = arena->top;
+    EXPECT_EQ(arenaAllocate(arena, 33, NULL), first);
+    EXPECT_EQ(arena->top, top);
+
+    // Double free and stray offsets are rejected
+    EXPECT_TRUE(arenaFree(arena, first, NULL));
+    EXPECT_FALSE(arenaFree(arena, first, NULL));
+    EXPECT_FALSE(arenaFree(arena, first + 8, NULL));
+    EXPECT_EQ(arenaResolve(arena, first, 1), nullptr);
+}
+
+TEST_F(RegionArenaTest, ReplicaResolvesSameOffsets) {
+    std::vector<MemoryChange> changes;
+    changes.push_back(MemoryChange());
+    changes[0].offset = 64;
+    changes[0].size = sizeof(RegionArenaHeader);
+    replicate(changes);
+    changes.clear();
+
+    const char* text = "variable length payload";
+    ArenaOffset offset = arenaAllocate(arena, strlen(text) + 1, &changes);
+    ASSERT_NE(offset, 0u);
+    memcpy(region + offset, text, strlen(text) + 1);
+
+    MemoryChange payload;
+    payload.offset = static_cast<size_t>(offset);
+    payload.size = strlen(text) + 1;
+    payload.inProgress = false;
+    changes.push_back(payload);
+    replicate(changes);
+
+    RegionArenaHeader* replicaArena = openRegionArena(replica, 64);
+    ASSERT_NE(replicaArena, nullptr);
+    const char* copy = static_cast<const char*>(arenaResolve(replicaArena, offset, strlen(text) + 1));
+    ASSERT_NE(copy, nullptr);
+    EXPECT_STREQ(copy, text);
+
+    // Frees replicate too: the replica sees the block leave use
+    changes.clear();
+    ASSERT_TRUE(arenaFree(arena, offset, &changes));
+    replicate(changes);
+    EXPECT_EQ(arenaResolve(replicaArena, offset, 1), nullptr);
+    EXPECT_EQ(memcmp(region + 64, replica + 64, sizeof(RegionArenaHeader)), 0);
+}
+
+TEST_F(RegionArenaTest, FullArenaSplitsLargerFreeBlocks) {
+    // Use the arena up with 8 KB blocks, then free one
+    std::vector<ArenaOffset> blocks;
+    for (;;) {
+        ArenaOffset block = arenaAllocate(arena, 8000, NULL);
+        if (block == 0) {
+            break;
+        }
+        blocks.push_back(block);
+    }
+    ASSERT_GE(blocks.size(), 2u);
+    while (arenaAllocate(arena, 1, NULL) != 0) {
+        // Take what's left at the top as well
+    }
+    ASSERT_TRUE(arenaFree(arena, blocks[0], NULL));
+    uint64_t top = arena->top;
+
+    // Small blocks come out of the freed block, halving it down to their class
+    std::vector<MemoryChange> changes;
+    ArenaOffset small = arenaAllocate(arena, 1, &changes);
+    EXPECT_EQ(small, blocks[0]);
+    EXPECT_EQ(arena->top, top);
+    ArenaOffset next = arenaAllocate(arena, 1, NULL);
+    EXPECT_EQ(next, small + ARENA_MIN_BLOCK);
+
+    // The split is replicated like any other update
+    replicate(changes);
+    size_t upperHalf = static_cast<size_t>(blocks[0]) + 4096 - sizeof(ArenaBlockHeader);
+    EXPECT_EQ(memcmp(region + upperHalf, replica + upperHalf, sizeof(ArenaBlockHeader)), 0);
+
+    // A 4 KB block fits in the upper half; a second 8 KB block doesn't
+    EXPECT_EQ(arenaAllocate(arena, 4000, NULL), blocks[0] + 4096);
+    EXPECT_EQ(arenaAllocate(arena, 8000, NULL), 0u);
+}
+
+TEST(RegionArenaLockTest, LockOfExitedProcessIsTakenOver) {
+    initChangeTracking();
+    ASSERT_TRUE(initializeArenaRegion("TestArenaLock", 16 * 1024));
+    RegionArenaHeader* arena = getRegionArena("TestArenaLock");
+    ASSERT_NE(arena, nullptr);
+
+    EXPECT_NE(regionAllocate("TestArenaLock", 100), 0u);
+    EXPECT_EQ(arena->lock, 0);
+
+    // No running process has this ID
+    arena->lock = 0x7FFFFFF0;
+    EXPECT_NE(regionAllocate("TestArenaLock", 100), 0u);
+    EXPECT_EQ(arena->lock, 0);
+
+    cleanupSharedMemory("TestArenaLock");
+    cleanupChangeTracking();
+}
@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include "../src/region_checksum.h"
+#include "../src/crc32c.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include "../src/memory_layout.h"
+#include <stddef.h>
+#include <string.h>
+
+#define OWNER_REGION "TestChecksumOwner"
+#define COPY_REGION "TestChecksumCopy"
+#define CHECKSUM_TEST_SIZE (3 * RESYNC_BLOCK_SIZE + 100)
+
+class RegionChecksumTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        initChangeTracking();
+        ASSERT_TRUE(initializeSharedMemory(OWNER_REGION, CHECKSUM_TEST_SIZE));
+        ASSERT_TRUE(initializeSharedMemory(COPY_REGION, CHECKSUM_TEST_SIZE));
+        owner = static_cast<char*>(getSharedMemory(OWNER_REGION));
+        copy = static_cast<char*>(getSharedMemory(COPY_REGION));
+
+        // Same contents past the header in both
+        for (size_t i = sizeof(MemoryLayout); i < CHECKSUM_TEST_SIZE; i++) {
+            owner[i] = copy[i] = static_cast<char>(i * 7);
+        }
+        ownerLayout()->version = 5;
+        copyLayout()->version = 5;
+        copyLayout()->data = ownerLayout()->data;
+        copyLayout()->last_modified = ownerLayout()->last_modified;
+    }
+
+    void TearDown() override {
+        stopRegionChecksums(COPY_REGION);
+        cleanupSharedMemory(OWNER_REGION);
+        cleanupSharedMemory(COPY_REGION);
+        cleanupChangeTracking();
+    }
+
+    MemoryLayout* ownerLayout() { return reinterpret_cast<MemoryLayout*>(owner); }
+    MemoryLayout* copyLayout() { return reinterpret_cast<MemoryLayout*>(copy); }
+
+    // Write to the owner and apply the same bytes to the copy, as the receive thread would
+    void replicate(uint64_t version, size_t offset, const void* data, size_t size) {
+        memcpy(owner + offset, data, size);
+        ownerLayout()->version = version;
+
+        SyncMessage message;
+        memset(&message, 0, sizeof(message));
+        strcpy(message.memoryName, COPY_REGION);
+        message.msgType = MSG_SINGLE_UPDATE;
+        message.version = version;
+        message.offset = offset;
+        message.size = size;
+        memcpy(message.data, data, size);
+        applyUpdate(message);
+    }
+
+    // The owner's checksum message, addressed to the copy
+    SyncMessage ownerChecksum() {
+        SyncMessage message;
+        EXPECT_TRUE(buildRegionChecksumMessage(OWNER_REGION, message));
+        strcpy(message.memoryName, COPY_REGION);
+        return message;
+    }
+
+    char* owner;
+    char* copy;
+};
+
+TEST_F(RegionChecksumTest, VerifiesStampedDatagrams) {
+    IntegrityStats before;
+    getIntegrityStats(&before);
+
+    SyncMessage message;
+    memset(&message, 0, sizeof(message));
+    strcpy(message.memoryName, COPY_REGION);
+    message.version = 9;
+    message.offset = 100;
+    message.size = 16;
+    memset(message.data, 0xAB, message.size);
+    stampSyncMessage(message);
+    EXPECT_TRUE(verifySyncMessage(message, sizeof(message)));
+
+    // Bytes past the data size are not covered
+    message.data[message.size] = 1;
+    EXPECT_TRUE(verifySyncMessage(message, sizeof(message)));
+
+    SyncMessage damaged = message;
+    damaged.data[3] ^= 0x10;
+    EXPECT_FALSE(verifySyncMessage(damaged, sizeof(damaged)));
+    damaged = message;
+    damaged.offset ^= 0x1000;
+    EXPECT_FALSE(verifySyncMessage(damaged, sizeof(damaged)));
+    EXPECT_FALSE(verifySyncMessage(message, offsetof(SyncMessage, data) + 8));
+
+    IntegrityStats after;
+    getIntegrityStats(&after);
+    EXPECT_EQ(before.datagramsRejected + 3, after.datagramsRejected);
+}
+
+TEST_F(RegionChecksumTest, IgnoresLocalHeaderFields) {
+    uint32_t crc = computeRegionChecksum(copy, CHECKSUM_TEST_SIZE);
+    copyLayout()->version = 77;
+    copyLayout()->dirty = true;
+    copyLayout()->generation = 3;
+    EXPECT_EQ(crc, computeRegionChecksum(copy, CHECKSUM_TEST_SIZE));
+
+    copyLayout()->data = 42;
+    EXPECT_NE(crc, computeRegionChecksum(copy, CHECKSUM_TEST_SIZE));
+    copyLayout()->data = ownerLayout()->data;
+    copy[CHECKSUM_TEST_SIZE - 1] ^= 1;
+    EXPECT_NE(crc, computeRegionChecksum(copy, CHECKSUM_TEST_SIZE));
+}
+
+TEST_F(RegionChecksumTest, KeepsBlockChecksumsAcrossUpdates) {
+    ASSERT_TRUE(startRegionChecksums(COPY_REGION));
+
+    // Inside a block, across a block boundary, in the header and in the short last block
+    char bytes[600];
+    memset(bytes, 0x5A, sizeof(bytes));
+    replicate(6, 1000, bytes, 64);
+    replicate(7, 2 * RESYNC_BLOCK_SIZE - 300, bytes, sizeof(bytes));
+    int data = 1234;
+    replicate(8, offsetof(MemoryLayout, data), &data, sizeof(data));
+    replicate(9, CHECKSUM_TEST_SIZE - 50, bytes, 50);
+
+    std::vector<uint32_t> kept;
+    ASSERT_TRUE(getRegionBlockChecksums(COPY_REGION, kept));
+    ASSERT_EQ(4u, kept.size());
+
+    // Same as computing them again from scratch
+    EXPECT_TRUE(stopRegionChecksums(COPY_REGION));
+    ASSERT_TRUE(startRegionChecksums(COPY_REGION));
+    std::vector<uint32_t> fresh;
+    ASSERT_TRUE(getRegionBlockChecksums(COPY_REGION, fresh));
+    EXPECT_EQ(fresh, kept);
+
+    // And folded together they are the region checksum
+    uint32_t folded = kept[0];
+    for (size_t i = 1; i < kept.size(); i++) {
+        size_t length = (i + 1 < kept.size()) ? RESYNC_BLOCK_SIZE : CHECKSUM_TEST_SIZE - i * RESYNC_BLOCK_SIZE;
+        folded = crc32cCombine(folded, kept[i], length);
+    }
+    EXPECT_EQ(computeRegionChecksum(copy, CHECKSUM_TEST_SIZE), folded);
+}
+
+TEST_F(RegionChecksumTest, ComparesCopyWithOwner) {
+    ASSERT_TRUE(startRegionChecksums(COPY_REGION));
+    char bytes[32];
+    memset(bytes, 0x11, sizeof(bytes));
+    replicate(6, 5000, bytes, sizeof(bytes));
+
+    IntegrityStats before;
+    getIntegrityStats(&before);
+    EXPECT_TRUE(checkRegionChecksum(ownerChecksum()));
+
+    // A lost update leaves the copy behind the owner at the same version
+    memset(owner + 7000, 0x22, 16);
+    SyncMessage stale = ownerChecksum();
+    EXPECT_FALSE(checkRegionChecksum(stale));
+
+    // Copies at another version or size are not compared
+    stale.version = 5;
+    EXPECT_TRUE(checkRegionChecksum(stale));
+    RegionChecksumInfo info;
+    memcpy(&info, stale.data, sizeof(info));
+    info.regionSize += RESYNC_BLOCK_SIZE;
+    memcpy(stale.data, &info, sizeof(info));
+    stale.version = 6;
+    EXPECT_TRUE(checkRegionChecksum(stale));
+
+    IntegrityStats after;
+    getIntegrityStats(&after);
+    EXPECT_EQ(before.regionsChecked + 2, after.regionsChecked);
+    EXPECT_EQ(before.regionMismatches + 1, after.regionMismatches);
+}
+
+TEST_F(RegionChecksumTest, ChecksWithoutBlockChecksums) {
+    EXPECT_TRUE(checkRegionChecksum(ownerChecksum()));
+    copy[CHECKSUM_TEST_SIZE - 1] ^= 1;
+    EXPECT_FALSE(checkRegionChecksum(ownerChecksum()));
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include "../src/region_snapshot.h"
+#include "../src/version_history.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include "../src/memory_layout.h"
+#include <string.h>
+
+#define SNAPSHOT_TEST_A "TestSnapshotA"
+#define SNAPSHOT_TEST_B "TestSnapshotB"
+#define SNAPSHOT_TEST_SIZE (SNAPSHOT_CHUNK_SIZE + 4096)
+#define VALUE_OFFSET (SNAPSHOT_CHUNK_SIZE + 100)
+
+/**
+ * @brief Sink collecting streamed contents by region
+ */
+static bool collectSink(const char* memoryName, uint64_t version, size_t regionSize,
+                        size_t offset, const void* data, size_t size, void* context) {
+    (void)version;
+    std::map<std::string, std::vector<char> >* contents = static_cast<std::map<std::string, std::vector<char> >*>(context);
+    std::vector<char>& region = (*contents)[memoryName];
+    region.resize(regionSize);
+    memcpy(&region[offset], data, size);
+    return true;
+}
+
+class RegionSnapshotTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        initChangeTracking();
+        ASSERT_TRUE(initializeSharedMemory(SNAPSHOT_TEST_A, SNAPSHOT_TEST_SIZE));
+        ASSERT_TRUE(initializeSharedMemory(SNAPSHOT_TEST_B, SNAPSHOT_TEST_SIZE));
+        regionA = static_cast<MemoryLayout*>(getSharedMemory(SNAPSHOT_TEST_A));
+        regionB = static_cast<MemoryLayout*>(getSharedMemory(SNAPSHOT_TEST_B));
+        regionA->version = 5;
+        regionB->version = 7;
+        setInt(regionA, 1);
+        setInt(regionB, 2);
+        names.push_back(SNAPSHOT_TEST_A);
+        names.push_back(SNAPSHOT_TEST_B);
+    }
+
+    void TearDown() override {
+        cleanupSharedMemory(SNAPSHOT_TEST_A);
+        cleanupSharedMemory(SNAPSHOT_TEST_B);
+        cleanupChangeTracking();
+    }
+
+    static void setInt(MemoryLayout* region, int value) {
+        memcpy(reinterpret_cast<char*>(region) + VALUE_OFFSET, &value, sizeof(value));
+    }
+
+    static int intIn(const std::vector<char>& contents) {
+        int value = -1;
+        memcpy(&value, &contents[VALUE_OFFSET], sizeof(value));
+        return value;
+    }
+
+    // Apply a replicated write at a version, as the receive thread would
+    void applyInt(const char* memoryName, uint64_t version, int value) {
+        SyncMessage message;
+        memset(&message, 0, sizeof(message));
+        strcpy(message.memoryName, memoryName);
+        message.msgType = MSG_SINGLE_UPDATE;
+        message.version = version;
+        message.offset = VALUE_OFFSET;
+        message.size = sizeof(value);
+        memcpy(message.data, &value, sizeof(value));
+        applyUpdate(message);
+    }
+
+    MemoryLayout* regionA;
+    MemoryLayout* regionB;
+    std::vector<std::string> names;
+};
+
+TEST_F(RegionSnapshotTest, CutCopiesRegionsWithoutHistory) {
+    SnapshotCut cut;
+    ASSERT_TRUE(captureSnapshotCut(names, cut));
+    ASSERT_EQ(2u, cut.regions.size());
+    EXPECT_EQ(5u, cut.regions[0].version);
+    EXPECT_EQ(7u, cut.regions[1].version);
+    EXPECT_EQ(-1, cut.regions[0].history);
+
+    // Later writes don't reach the cut
+    applyInt(SNAPSHOT_TEST_A, 6, 10);
+    applyInt(SNAPSHOT_TEST_B, 8, 20);
+
+    std::map<std::string, std::vector<char> > contents;
+    ASSERT_TRUE(streamSnapshot(cut, collectSink, &contents));
+    EXPECT_EQ(1, intIn(contents[SNAPSHOT_TEST_A]));
+    EXPECT_EQ(2, intIn(contents[SNAPSHOT_TEST_B]));
+    EXPECT_EQ(SNAPSHOT_TEST_SIZE, contents[SNAPSHOT_TEST_A].size());
+}
+
+TEST_F(RegionSnapshotTest, RegionsWithHistoryArePinnedByVersion) {
+    int history = startVersionHistory(SNAPSHOT_TEST_A, 64 * 1024);
+    ASSERT_GE(history, 0);
+
+    SnapshotCut cut;
+    ASSERT_TRUE(captureSnapshotCut(names, cut));
+    EXPECT_EQ(history, cut.regions[0].history);
+    EXPECT_TRUE(cut.regions[0].copy.empty());
+
+    applyInt(SNAPSHOT_TEST_A, 6, 10);
+    applyInt(SNAPSHOT_TEST_A, 7, 11);
+    EXPECT_EQ(7u, regionA->version);
+
+    std::map<std::string, std::vector<char> > contents;
+    ASSERT_TRUE(streamSnapshot(cut, collectSink, &contents));
+    EXPECT_EQ(1, intIn(contents[SNAPSHOT_TEST_A]));
+
+    // The streamed header carries the cut version
+    MemoryLayout header;
+    memcpy(&header, &contents[SNAPSHOT_TEST_A][0], sizeof(header));
+    EXPECT_EQ(5u, header.version);
+
+    stopVersionHistory(history);
+}
+
+TEST_F(RegionSnapshotTest, VersionVectorReproducesTheCut) {
+    int history = startVersionHistory(SNAPSHOT_TEST_A, 64 * 1024);
+    ASSERT_GE(history, 0);
+    applyInt(SNAPSHOT_TEST_A, 6, 10);
+    applyInt(SNAPSHOT_TEST_A, 7, 11);
+
+    SnapshotVersionVector versions;
+    versions[SNAPSHOT_TEST_A] = 6;
+    versions[SNAPSHOT_TEST_B] = 7;
+
+    SnapshotCut cut;
+    ASSERT_TRUE(captureSnapshotAt(versions, 100, cut));
+    SnapshotVersionVector captured;
+    getSnapshotVersions(cut, captured);
+    EXPECT_EQ(versions, captured);
+
+    std::map<std::string, std::vector<char> > contents;
+    ASSERT_TRUE(streamSnapshot(cut, collectSink, &contents));
+    EXPECT_EQ(10, intIn(contents[SNAPSHOT_TEST_A]));
+    EXPECT_EQ(2, intIn(contents[SNAPSHOT_TEST_B]));
+
+    // Without a history only the current version of B can be captured
+    versions[SNAPSHOT_TEST_B] = 6;
+    EXPECT_FALSE(captureSnapshotAt(versions, 100, cut));
+
+    // And a version a copy never reaches times out
+    versions[SNAPSHOT_TEST_B] = 9;
+    EXPECT_FALSE(captureSnapshotAt(versions, 20, cut));
+
+    stopVersionHistory(history);
+}
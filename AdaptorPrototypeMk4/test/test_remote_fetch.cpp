@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+#include "../src/remote_fetch.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include "../src/memory_layout.h"
+#include "../src/network_sync.h"
+#include <string.h>
+
+#define FETCH_REGION "TestFetchSource"
+#define FETCH_REGION_SIZE (512 * 1024)
+#define FETCH_PEER "10.0.0.2:8081"
+#define FETCH_TEST_PORT 47420
+
+static int g_requestsSent = 0;
+static int g_partsSent = 0;
+static bool g_answerRequests = true;
+static int g_partsToDrop = 0;
+static size_t g_writeAfterWindow = 0;   // Region offset written once the window at it has been served; 0 for none
+
+static char* sourceRegion() {
+    return static_cast<char*>(getSharedMemory(FETCH_REGION));
+}
+
+/**
+ * @brief Answer a request as the source of the region would, on the calling thread
+ */
+static void testFetchSender(const SyncMessage& request) {
+    g_requestsSent++;
+    if (!g_answerRequests) {
+        return;
+    }
+    std::vector<SyncMessage> replies;
+    buildFetchReplies(request, FETCH_PEER, replies);
+    for (size_t i = 0; i < replies.size(); i++) {
+        g_partsSent++;
+        if (g_partsToDrop > 0 && replies[i].size > 0) {
+            g_partsToDrop--;
+            continue;
+        }
+        receiveFetchData(replies[i]);
+    }
+
+    // A write made while the rest of the range is still being fetched
+    if (g_writeAfterWindow != 0 && request.offset == g_writeAfterWindow) {
+        char* region = sourceRegion();
+        beginRegionWrite(region);
+        memset(region + g_writeAfterWindow + FETCH_WINDOW_SIZE, 'W', 100);
+        reinterpret_cast<MemoryLayout*>(region)->version++;
+        endRegionWrite(region);
+        g_writeAfterWindow = 0;
+    }
+}
+
+class RemoteFetchTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        initChangeTracking();
+        ASSERT_TRUE(initializeSharedMemory(FETCH_REGION, FETCH_REGION_SIZE));
+        char* region = sourceRegion();
+        for (size_t i = sizeof(MemoryLayout); i < FETCH_REGION_SIZE; i++) {
+            region[i] = static_cast<char>(i * 7 + i / 4096);
+        }
+        reinterpret_cast<MemoryLayout*>(region)->version = 10;
+        g_requestsSent = 0;
+        g_partsSent = 0;
+        g_answerRequests = true;
+        g_partsToDrop = 0;
+        g_writeAfterWindow = 0;
+        memset(&before, 0, sizeof(before));
+        getRemoteFetchStats(&before);
+        setFetchRequestSender(testFetchSender);
+    }
+
+    void TearDown() override {
+        setFetchRequestSender(NULL);
+        clearRemoteFetchCache();
+        cleanupSharedMemory(FETCH_REGION);
+        cleanupChangeTracking();
+    }
+
+    RemoteFetchStats since() {
+        RemoteFetchStats now;
+        getRemoteFetchStats(&now);
+        now.fetches -= before.fetches;
+        now.cacheHits -= before.cacheHits;
+        now.bytesFetched -= before.bytesFetched;
+        now.windowRetries -= before.windowRetries;
+        now.restarts -= before.restarts;
+        now.failures -= before.failures;
+        return now;
+    }
+
+    RemoteFetchStats before;
+};
+
+TEST_F(RemoteFetchTest, FetchesARangeInWindows) {
+    const size_t offset = 5000;
+    const size_t size = 7 * FETCH_WINDOW_SIZE + 333;
+    std::vector<char> range(size);
+    uint64_t version = 0;
+    ASSERT_TRUE(fetchRemote(FETCH_REGION, offset, size, &range[0], 1000, &version));
+    EXPECT_EQ(10u, version);
+    EXPECT_EQ(0, memcmp(&range[0], sourceRegion() + offset, size));
+    EXPECT_EQ(8, g_requestsSent);
+    EXPECT_EQ(size, since().bytesFetched);
+    EXPECT_EQ(0u, since().windowRetries);
+}
+
+TEST_F(RemoteFetchTest, RangeIsReadAtOneVersion) {
+    const size_t offset = 4096;
+    const size_t size = 4 * FETCH_WINDOW_SIZE;
+    std::vector<char> expected(sourceRegion() + offset, sourceRegion() + offset + size);
+    g_writeAfterWindow = offset;
+
+    std::vector<char> range(size);
+    uint64_t version = 0;
+    ASSERT_TRUE(fetchRemote(FETCH_REGION, offset, size, &range[0], 1000, &version));
+    EXPECT_EQ(10u, version);
+    EXPECT_TRUE(range == expected);
+    EXPECT_EQ('W', sourceRegion()[offset + FETCH_WINDOW_SIZE]);
+}
+
+TEST_F(RemoteFetchTest, CachedRangesAreCheckedAgainstTheSource) {
+    const size_t offset = 64;
+    const size_t size = 3 * FETCH_WINDOW_SIZE;
+    std::vector<char> range(size);
+    ASSERT_TRUE(fetchRemote(FETCH_REGION, offset, size, &range[0], 1000, NULL));
+    EXPECT_EQ(3, g_requestsSent);
+
+    // Unchanged: a single request confirms the cached copy
+    std::vector<char> again(size, 0);
+    uint64_t version = 0;
+    ASSERT_TRUE(fetchRemote(FETCH_REGION, offset, size, &again[0], 1000, &version));
+    EXPECT_EQ(4, g_requestsSent);
+    EXPECT_EQ(10u, version);
+    EXPECT_TRUE(again == range);
+    EXPECT_EQ(1u, since().cacheHits);
+
+    // Changed: the range is sent again
+    char* region = sourceRegion();
+    memset(region + offset + 2 * FETCH_WINDOW_SIZE, 'N', 16);
+    reinterpret_cast<MemoryLayout*>(region)->version = 11;
+    ASSERT_TRUE(fetchRemote(FETCH_REGION, offset, size, &again[0], 1000, &version));
+    EXPECT_EQ(11u, version);
+    EXPECT_EQ(0, memcmp(&again[0], region + offset, size));
+    EXPECT_EQ(1u, since().cacheHits);
+    EXPECT_EQ(2 * size, since().bytesFetched);
+}
+
+TEST_F(RemoteFetchTest, LostPartsAreRequestedAgain) {
+    const size_t size = 2 * FETCH_WINDOW_SIZE;
+    g_partsToDrop = 3;
+    std::vector<char> range(size);
+    ASSERT_TRUE(fetchRemote(FETCH_REGION, 8192, size, &range[0], 2000, NULL));
+    EXPECT_EQ(0, memcmp(&range[0], sourceRegion() + 8192, size));
+    EXPECT_EQ(1u, since().windowRetries);
+
+    // The retry named the parts that arrived, so only the lost ones were sent again
+    EXPECT_EQ(static_cast<int>(size / MAX_SYNC_DATA_SIZE) + 3, g_partsSent);
+}
+
+TEST_F(RemoteFetchTest, FetchesThroughTheNetwork) {
+    // This node is the source and its own remote node, so requests and replies go over UDP
+    ASSERT_TRUE(initNetworkSync("127.0.0.1", FETCH_TEST_PORT));
+    setRegionSource(FETCH_REGION);
+    ASSERT_TRUE(connectToRemoteNode("127.0.0.1", FETCH_TEST_PORT));
+
+    const size_t offset = 1000;
+    const size_t size = 12 * FETCH_WINDOW_SIZE + 100;
+    std::vector<char> range(size);
+    uint64_t version = 0;
+    bool fetched = fetchRemote(FETCH_REGION, offset, size, &range[0], 5000, &version);
+    RemoteFetchStats stats = since();
+    shutdownNetworkSync();
+
+    ASSERT_TRUE(fetched);
+    EXPECT_EQ(10u, version);
+    EXPECT_EQ(0, memcmp(&range[0], sourceRegion() + offset, size));
+    EXPECT_EQ(size, stats.bytesFetched);
+    EXPECT_EQ(0u, stats.restarts);
+}
+
+TEST_F(RemoteFetchTest, FailsWhenNoSourceAnswers) {
+    g_answerRequests = false;
+    char buffer[64];
+    memset(buffer, 'x', sizeof(buffer));
+    ULONGLONG start = GetTickCount64();
+    EXPECT_FALSE(fetchRemote(FETCH_REGION, 100, sizeof(buffer), buffer, 300, NULL));
+    EXPECT_EQ(0, buffer[0]);
+    EXPECT_EQ(0, buffer[sizeof(buffer) - 1]);
+    EXPECT_GE(GetTickCount64() - start, 250u);
+    EXPECT_GE(g_requestsSent, 2);
+    EXPECT_EQ(1u, since().failures);
+}
+
+TEST_F(RemoteFetchTest, RangesOutsideTheRegionAreRefused) {
+    char buffer[64];
+    ULONGLONG start = GetTickCount64();
+    EXPECT_FALSE(fetchRemote(FETCH_REGION, FETCH_REGION_SIZE - 10, sizeof(buffer), buffer, 2000, NULL));
+    EXPECT_LT(GetTickCount64() - start, 1000u);
+    EXPECT_EQ(1, g_requestsSent);
+
+    EXPECT_FALSE(fetchRemote(FETCH_REGION, 0, 0, buffer, 100, NULL));
+    EXPECT_FALSE(fetchRemote(FETCH_REGION, 0, FETCH_MAX_SIZE + 1, buffer, 100, NULL));
+    EXPECT_EQ(1, g_requestsSent);
+}
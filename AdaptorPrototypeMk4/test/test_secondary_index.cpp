@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include "../src/secondary_index.h"
+#include "../src/record_table.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include <vector>
+
+class SecondaryIndexTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        initChangeTracking();
+
+        RecordColumnSpec specs[] = {
+            { "id", COLUMN_UINT64, 0 },
+            { "price", COLUMN_DOUBLE, 0 },
+            { "venue", COLUMN_INT32, 0 }
+        };
+        size_t size = recordTableRegionSize(specs, 3, 256);
+        ASSERT_TRUE(initializeSharedMemory("TestIndexTable", size));
+        table = createRecordTable(getSharedMemory("TestIndexTable"), size, specs, 3, 256);
+        ASSERT_NE(table, nullptr);
+
+        int32_t* venues = recordColumn<int32_t>(table, 2);
+        for (int i = 0; i < 100; i++) {
+            venues[i] = i % 10;
+        }
+        table->recordCount = 100;
+    }
+
+    void TearDown() override {
+        cleanupSharedMemory("TestIndexTable");
+        cleanupChangeTracking();
+    }
+
+    // Apply a replicated write of one venue cell, as the receive thread would
+    void applyVenue(uint64_t record, int32_t venue) {
+        SyncMessage message;
+        memset(&message, 0, sizeof(message));
+        strcpy(message.memoryName, "TestIndexTable");
+        message.msgType = MSG_SINGLE_UPDATE;
+        message.offset = static_cast<size_t>(table->columns[2].dataOffset + record * sizeof(int32_t));
+        message.size = sizeof(int32_t);
+        memcpy(message.data, &venue, sizeof(venue));
+        applyUpdate(message);
+    }
+
+    RecordTableHeader* table;
+};
+
+TEST_F(SecondaryIndexTest, InitialBuild) {
+    int handle = registerSecondaryIndex("TestIndexTable", "venue", INDEX_SORTED);
+    ASSERT_GE(handle, 0);
+    EXPECT_EQ(secondaryIndexSize(handle), 100u);
+
+    std::vector<uint64_t> records;
+    EXPECT_EQ(indexFindEqual<int32_t>(handle, 3, records), 10u);
+    EXPECT_EQ(records[0], 3u);
+
+    unregisterSecondaryIndex(handle);
+}
+
+TEST_F(SecondaryIndexTest, SortedIndexFollowsAppliedUpdates) {
+    int handle = registerSecondaryIndex("TestIndexTable", "venue", INDEX_SORTED);
+    ASSERT_GE(handle, 0);
+
+    applyVenue(13, 42);
+
+    std::vector<uint64_t> records;
+    EXPECT_EQ(indexFindEqual<int32_t>(handle, 42, records), 1u);
+    EXPECT_EQ(records[0], 13u);
+
+    records.clear();
+    EXPECT_EQ(indexFindEqual<int32_t>(handle, 3, records), 9u);
+
+    records.clear();
+    EXPECT_EQ(indexFindRange<int32_t>(handle, 8, 100, records), 21u);
+
+    unregisterSecondaryIndex(handle);
+}
+
+TEST_F(SecondaryIndexTest, HashedIndexFollowsAppliedUpdates) {
+    int handle = registerSecondaryIndex("TestIndexTable", "venue", INDEX_HASHED);
+    ASSERT_GE(handle, 0);
+
+    applyVenue(0, -5);
+
+    std::vector<uint64_t> records;
+    EXPECT_EQ(indexFindEqual<int32_t>(handle, -5, records), 1u);
+    records.clear();
+    EXPECT_EQ(indexFindEqual<int32_t>(handle, 0, records), 9u);
+
+    // Hashed indexes don't answer range queries
+    records.clear();
+    EXPECT_EQ(indexFindRange<int32_t>(handle, 0, 9, records), 0u);
+
+    unregisterSecondaryIndex(handle);
+}
+
+TEST_F(SecondaryIndexTest, RecordCountChange) {
+    int handle = registerSecondaryIndex("TestIndexTable", "venue", INDEX_SORTED);
+    ASSERT_GE(handle, 0);
+
+    // Replicate a header that shrinks the table to 50 records
+    RecordTableHeader header = *table;
+    header.recordCount = 50;
+
+    SyncMessage message;
+    memset(&message, 0, sizeof(message));
+    strcpy(message.memoryName, "TestIndexTable");
+    message.msgType = MSG_SINGLE_UPDATE;
+    message.offset = recordTableHeaderOffset(table) + offsetof(RecordTableHeader, recordCount);
+    message.size = sizeof(uint64_t);
+    memcpy(message.data, &header.recordCount, sizeof(uint64_t));
+    applyUpdate(message);
+
+    EXPECT_EQ(secondaryIndexSize(handle), 50u);
+
+    unregisterSecondaryIndex(handle);
+}
+
+TEST_F(SecondaryIndexTest, UnknownColumn) {
+    EXPECT_EQ(registerSecondaryIndex("TestIndexTable", "missing", INDEX_SORTED), -1);
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "../src/shared_memory.h"
-#include "../src/structs/memory_layout.h"
+#include "../src/memory_layout.h"
+#include "../src/change_tracking.h"
 
 class SharedMemoryTest : public ::testing::Test {
 protected:
@@ -38,4 +39,283 @@ TEST_F(SharedMemoryTest, TestMultipleAccess) {
 
     // Read from shared memory from second instance
     ASSERT_EQ(mem2->data, 100);
-}
\ No newline at end of file
+}
+TEST(FileBackedSharedMemoryTest, ContentsSurviveRestart) {
+    const char* name = "TestFileBackedMemory";
+    remove("test_regions/TestFileBackedMemory.region");
+
+    RegionOptions options;
+    options.backingDirectory = "test_regions";
+    ASSERT_TRUE(initializeSharedMemoryWithOptions(name, sizeof(MemoryLayout), options));
+    EXPECT_FALSE(wasSharedMemoryRestored(name));
+
+    MemoryLayout* mem = static_cast<MemoryLayout*>(getSharedMemory(name));
+    ASSERT_NE(mem, nullptr);
+    mem->version = 5;
+    mem->data = 77;
+    mem->sequence = 3;  // As if a write was interrupted
+    markSharedMemoryRangeDirty(name, 0, sizeof(MemoryLayout));
+    EXPECT_TRUE(flushSharedMemory(name));
+    ASSERT_TRUE(cleanupSharedMemory(name));
+
+    // The region comes back with its contents and a clean write sequence
+    ASSERT_TRUE(initializeSharedMemoryWithOptions(name, sizeof(MemoryLayout), options));
+    EXPECT_TRUE(wasSharedMemoryRestored(name));
+    mem = static_cast<MemoryLayout*>(getSharedMemory(name));
+    ASSERT_NE(mem, nullptr);
+    EXPECT_EQ(mem->version, 5u);
+    EXPECT_EQ(mem->data, 77);
+    EXPECT_EQ(mem->sequence, 0u);
+
+    // Changes still pending at cleanup are written back too
+    mem->data = 78;
+    markSharedMemoryRangeDirty(name, 0, sizeof(MemoryLayout));
+    ASSERT_TRUE(cleanupSharedMemory(name));
+    ASSERT_TRUE(initializeSharedMemoryWithOptions(name, sizeof(MemoryLayout), options));
+    mem = static_cast<MemoryLayout*>(getSharedMemory(name));
+    ASSERT_NE(mem, nullptr);
+    EXPECT_EQ(mem->data, 78);
+
+    cleanupSharedMemory(name);
+    remove("test_regions/TestFileBackedMemory.region");
+}
+
+TEST(FileBackedSharedMemoryTest, PagingFileRegionsAreNotRestored) {
+    ASSERT_TRUE(initializeSharedMemory("TestPagingFileMemory", sizeof(MemoryLayout)));
+    EXPECT_FALSE(wasSharedMemoryRestored("TestPagingFileMemory"));
+    cleanupSharedMemory("TestPagingFileMemory");
+}
+
+TEST(SurvivingSegmentTest, ReattachesToLiveSegment) {
+    const char* name = "TestSurvivingMemory";
+    ASSERT_TRUE(initializeSharedMemory(name, sizeof(MemoryLayout)));
+    MemoryLayout* mem = static_cast<MemoryLayout*>(getSharedMemory(name));
+    ASSERT_NE(mem, nullptr);
+    mem->version = 9;
+    mem->data = 31;
+
+    // Another process keeps the segment alive across the restart
+    HANDLE other = OpenSharedMemory(name);
+    ASSERT_NE(other, (HANDLE)NULL);
+    ASSERT_TRUE(cleanupSharedMemory(name));
+
+    ASSERT_TRUE(initializeSharedMemory(name, sizeof(MemoryLayout)));
+    EXPECT_TRUE(wasSharedMemoryRestored(name));
+    mem = static_cast<MemoryLayout*>(getSharedMemory(name));
+    ASSERT_NE(mem, nullptr);
+    EXPECT_EQ(mem->version, 9u);
+    EXPECT_EQ(mem->data, 31);
+
+    cleanupSharedMemory(name);
+    CloseSharedMemory(other);
+}
+
+TEST(SurvivingSegmentTest, MismatchedLayoutIsReset) {
+    const char* name = "TestMismatchedMemory";
+    ASSERT_TRUE(initializeSharedMemory(name, sizeof(MemoryLayout)));
+    MemoryLayout* mem = static_cast<MemoryLayout*>(getSharedMemory(name));
+    ASSERT_NE(mem, nullptr);
+    mem->version = 4;
+    mem->data = 12;
+
+    HANDLE other = OpenSharedMemory(name);
+    ASSERT_NE(other, (HANDLE)NULL);
+    ASSERT_TRUE(cleanupSharedMemory(name));
+
+    RegionOptions options;
+    options.layoutId = 2;
+    ASSERT_TRUE(initializeSharedMemoryWithOptions(name, sizeof(MemoryLayout), options));
+    EXPECT_FALSE(wasSharedMemoryRestored(name));
+    mem = static_cast<MemoryLayout*>(getSharedMemory(name));
+    ASSERT_NE(mem, nullptr);
+    EXPECT_EQ(mem->version, 0u);
+    EXPECT_EQ(mem->data, 0);
+    EXPECT_EQ(mem->magic, REGION_MAGIC);
+    EXPECT_EQ(mem->layoutHash, computeRegionLayoutHash(sizeof(MemoryLayout), 2));
+
+    cleanupSharedMemory(name);
+    CloseSharedMemory(other);
+}
+
+TEST(RegionPrefaultTest, NewRegionsStartZeroedWithoutPrefault) {
+    const char* name = "TestLazyMemory";
+    const size_t size = 4 * 1024 * 1024;
+    ASSERT_TRUE(initializeSharedMemory(name, size));
+
+    RegionStartupStats stats;
+    ASSERT_TRUE(getSharedMemoryStartupStats(name, &stats));
+    EXPECT_TRUE(stats.prefaultComplete);
+    EXPECT_EQ(stats.prefaultMs, 0.0);
+    EXPECT_FALSE(stats.locked);
+
+    const char* bytes = static_cast<const char*>(getSharedMemory(name));
+    ASSERT_NE(bytes, nullptr);
+    EXPECT_EQ(bytes[sizeof(MemoryLayout)], 0);
+    EXPECT_EQ(bytes[size - 1], 0);
+
+    cleanupSharedMemory(name);
+}
+
+TEST(RegionPrefaultTest, SyncPrefaultCompletesBeforeReturning) {
+    const char* name = "TestSyncPrefaultMemory";
+    RegionOptions options;
+    options.prefault = REGION_PREFAULT_SYNC;
+    ASSERT_TRUE(initializeSharedMemoryWithOptions(name, 4 * 1024 * 1024, options));
+
+    RegionStartupStats stats;
+    ASSERT_TRUE(getSharedMemoryStartupStats(name, &stats));
+    EXPECT_TRUE(stats.prefaultComplete);
+    EXPECT_GE(stats.initMs, stats.prefaultMs);
+
+    cleanupSharedMemory(name);
+}
+
+TEST(RegionPrefaultTest, AsyncPrefaultFinishesInBackground) {
+    const char* name = "TestAsyncPrefaultMemory";
+    RegionOptions options;
+    options.prefault = REGION_PREFAULT_ASYNC;
+    ASSERT_TRUE(initializeSharedMemoryWithOptions(name, 4 * 1024 * 1024, options));
+
+    RegionStartupStats stats;
+    for (int i = 0; i < 200; i++) {
+        ASSERT_TRUE(getSharedMemoryStartupStats(name, &stats));
+        if (stats.prefaultComplete) {
+            break;
+        }
+        Sleep(10);
+    }
+    EXPECT_TRUE(stats.prefaultComplete);
+
+    // Cleanup while a prefault runs must not touch the unmapped region
+    ASSERT_TRUE(cleanupSharedMemory(name));
+    ASSERT_TRUE(initializeSharedMemoryWithOptions(name, 64 * 1024 * 1024, options));
+    EXPECT_TRUE(cleanupSharedMemory(name));
+    EXPECT_FALSE(getSharedMemoryStartupStats(name, &stats));
+}
+
+TEST(RegionPrefaultTest, ParsesModeNames) {
+    RegionPrefaultMode mode = REGION_PREFAULT_NONE;
+    EXPECT_TRUE(parseRegionPrefaultMode("locked", &mode));
+    EXPECT_EQ(mode, REGION_PREFAULT_LOCKED);
+    EXPECT_TRUE(parseRegionPrefaultMode("async", &mode));
+    EXPECT_EQ(mode, REGION_PREFAULT_ASYNC);
+    EXPECT_FALSE(parseRegionPrefaultMode("eager", &mode));
+    EXPECT_EQ(mode, REGION_PREFAULT_ASYNC);
+}
+
+TEST(RegionResizeTest, GrowsWithContentsAndKeepsOldPointerReadable) {
+    const char* name = "TestResizeMemory";
+    const size_t oldSize = 64 * 1024;
+    const size_t newSize = 4 * 1024 * 1024;
+    ASSERT_TRUE(initializeSharedMemory(name, oldSize));
+    char* old = static_cast<char*>(getSharedMemory(name));
+    ASSERT_NE(old, nullptr);
+    static_cast<MemoryLayout*>(static_cast<void*>(old))->version = 7;
+    old[oldSize - 1] = 'z';
+
+    ASSERT_TRUE(resizeSharedMemory(name, newSize));
+    ASSERT_TRUE(waitForSharedMemoryResize(name, 5000));
+
+    size_t size = 0;
+    char* current = static_cast<char*>(getSharedMemoryMapping(name, &size));
+    ASSERT_NE(current, nullptr);
+    EXPECT_EQ(size, newSize);
+    EXPECT_EQ(getSharedMemorySize(name), newSize);
+    MemoryLayout* layout = static_cast<MemoryLayout*>(static_cast<void*>(current));
+    EXPECT_EQ(layout->version, 7u);
+    EXPECT_EQ(layout->generation, 1u);
+    EXPECT_EQ(layout->segmentSize, newSize);
+    EXPECT_EQ(current[oldSize - 1], 'z');
+    EXPECT_EQ(current[newSize - 1], 0);
+
+    // The old segment stays mapped and names the new one
+    EXPECT_EQ(static_cast<MemoryLayout*>(static_cast<void*>(old))->generation, 1u);
+
+    // Regions only grow
+    EXPECT_FALSE(resizeSharedMemory(name, oldSize));
+    EXPECT_TRUE(resizeSharedMemory(name, newSize));
+
+    cleanupSharedMemory(name);
+}
+
+TEST(RegionResizeTest, ChangesDuringTheCopyReachTheNewSegment) {
+    const char* name = "TestResizeChangesMemory";
+    const size_t oldSize = 16 * 1024 * 1024;
+    ASSERT_TRUE(initializeSharedMemory(name, oldSize));
+    char* old = static_cast<char*>(getSharedMemory(name));
+    ASSERT_NE(old, nullptr);
+
+    // An update in progress holds the switch off until it ends
+    ASSERT_TRUE(beginRegionWrite(old));
+    ASSERT_TRUE(resizeSharedMemory(name, 2 * oldSize));
+    old[oldSize - 2] = 'c';
+    markSharedMemoryRangeDirty(name, oldSize - 2, 1);
+    EXPECT_FALSE(waitForSharedMemoryResize(name, 50));
+    endRegionWrite(old);
+    ASSERT_TRUE(waitForSharedMemoryResize(name, 5000));
+
+    char* current = static_cast<char*>(getSharedMemory(name));
+    EXPECT_NE(current, old);
+    EXPECT_EQ(current[oldSize - 2], 'c');
+
+    // The old segment is retired: writes started through it move to the new one
+    EXPECT_FALSE(beginRegionWrite(old));
+    void* region = beginNamedRegionWrite(name, old);
+    EXPECT_EQ(region, static_cast<void*>(current));
+    if (region) {
+        endRegionWrite(region);
+    }
+
+    cleanupSharedMemory(name);
+}
+
+TEST(RegionResizeTest, RestartFollowsResizedSegment) {
+    const char* name = "TestResizeRestartMemory";
+    ASSERT_TRUE(initializeSharedMemory(name, sizeof(MemoryLayout)));
+    ASSERT_TRUE(resizeSharedMemory(name, 64 * 1024));
+    ASSERT_TRUE(waitForSharedMemoryResize(name, 5000));
+    static_cast<char*>(getSharedMemory(name))[60000] = 'r';
+
+    // Another process keeps both generations alive across the restart
+    HANDLE base = OpenSharedMemory(name);
+    HANDLE grown = OpenSharedMemory("TestResizeRestartMemory.g1");
+    ASSERT_NE(base, (HANDLE)NULL);
+    ASSERT_NE(grown, (HANDLE)NULL);
+    ASSERT_TRUE(cleanupSharedMemory(name));
+
+    ASSERT_TRUE(initializeSharedMemory(name, sizeof(MemoryLayout)));
+    EXPECT_TRUE(wasSharedMemoryRestored(name));
+    size_t size = 0;
+    char* current = static_cast<char*>(getSharedMemoryMapping(name, &size));
+    EXPECT_EQ(size, 64u * 1024);
+    EXPECT_EQ(current[60000], 'r');
+
+    cleanupSharedMemory(name);
+    CloseSharedMemory(base);
+    CloseSharedMemory(grown);
+}
+
+TEST(RegionResizeTest, FileBackedRegionGrowsInPlace) {
+    const char* name = "TestResizeFileMemory";
+    remove("test_regions/TestResizeFileMemory.region");
+
+    RegionOptions options;
+    options.backingDirectory = "test_regions";
+    ASSERT_TRUE(initializeSharedMemoryWithOptions(name, sizeof(MemoryLayout), options));
+    ASSERT_TRUE(resizeSharedMemory(name, 64 * 1024));
+    ASSERT_TRUE(waitForSharedMemoryResize(name, 5000));
+    static_cast<char*>(getSharedMemory(name))[60000] = 'f';
+    markSharedMemoryRangeDirty(name, 60000, 1);
+    ASSERT_TRUE(cleanupSharedMemory(name));
+
+    // The restarted region maps its file again at the grown size
+    ASSERT_TRUE(initializeSharedMemoryWithOptions(name, sizeof(MemoryLayout), options));
+    EXPECT_TRUE(wasSharedMemoryRestored(name));
+    size_t size = 0;
+    char* current = static_cast<char*>(getSharedMemoryMapping(name, &size));
+    EXPECT_EQ(size, 64u * 1024);
+    EXPECT_EQ(current[60000], 'f');
+
+    cleanupSharedMemory(name);
+    remove("test_regions/TestResizeFileMemory.region");
+}
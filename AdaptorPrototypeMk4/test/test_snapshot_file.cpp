@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include "../src/snapshot_file.h"
+#include "../src/block_hash.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include "../src/memory_layout.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SNAPSHOT_FILE_TEST_A "TestSnapshotFileA"
+#define SNAPSHOT_FILE_TEST_B "TestSnapshotFileB"
+#define SNAPSHOT_FILE_TEST_SEED "TestSnapshotFileSeed"
+#define SNAPSHOT_FILE_TEST_SIZE (3 * SNAPSHOT_CHUNK_SIZE + 4096)
+#define SNAPSHOT_FILE_TEST_PATH "test_snapshot_file.bin"
+
+class SnapshotFileTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        initChangeTracking();
+        ASSERT_TRUE(initializeSharedMemory(SNAPSHOT_FILE_TEST_A, SNAPSHOT_FILE_TEST_SIZE));
+        ASSERT_TRUE(initializeSharedMemory(SNAPSHOT_FILE_TEST_B, SNAPSHOT_FILE_TEST_SIZE));
+        regionA = static_cast<char*>(getSharedMemory(SNAPSHOT_FILE_TEST_A));
+        regionB = static_cast<char*>(getSharedMemory(SNAPSHOT_FILE_TEST_B));
+        reinterpret_cast<MemoryLayout*>(regionA)->version = 5;
+        reinterpret_cast<MemoryLayout*>(regionB)->version = 7;
+
+        // Region A compresses well, region B's second block doesn't compress at all
+        for (size_t i = sizeof(MemoryLayout); i < SNAPSHOT_FILE_TEST_SIZE; i++) {
+            regionA[i] = static_cast<char>(i % 13);
+        }
+        uint32_t state = 99;
+        for (size_t i = SNAPSHOT_CHUNK_SIZE; i < 2 * SNAPSHOT_CHUNK_SIZE; i++) {
+            state = state * 1103515245u + 12345u;
+            regionB[i] = static_cast<char>(state >> 24);
+        }
+
+        std::vector<std::string> names;
+        names.push_back(SNAPSHOT_FILE_TEST_A);
+        names.push_back(SNAPSHOT_FILE_TEST_B);
+        ASSERT_TRUE(captureSnapshotCut(names, cut));
+        ASSERT_TRUE(writeSnapshotFile(cut, SNAPSHOT_FILE_TEST_PATH, true));
+    }
+
+    void TearDown() override {
+        cleanupSharedMemory(SNAPSHOT_FILE_TEST_A);
+        cleanupSharedMemory(SNAPSHOT_FILE_TEST_B);
+        cleanupSharedMemory(SNAPSHOT_FILE_TEST_SEED);
+        cleanupChangeTracking();
+        remove(SNAPSHOT_FILE_TEST_PATH);
+    }
+
+    // Overwrite one byte of the file
+    static void corruptByte(uint64_t offset) {
+        FILE* file = fopen(SNAPSHOT_FILE_TEST_PATH, "r+b");
+        ASSERT_NE(file, nullptr);
+        fseek(file, static_cast<long>(offset), SEEK_SET);
+        int byte = fgetc(file);
+        fseek(file, static_cast<long>(offset), SEEK_SET);
+        fputc(byte ^ 0xFF, file);
+        fclose(file);
+    }
+
+    char* regionA;
+    char* regionB;
+    SnapshotCut cut;
+};
+
+TEST_F(SnapshotFileTest, IndexDescribesRegionsAndBlocks) {
+    SnapshotFile snapshot;
+    ASSERT_TRUE(openSnapshotFile(SNAPSHOT_FILE_TEST_PATH, &snapshot));
+    EXPECT_EQ(SNAPSHOT_FILE_MAGIC, snapshot.header->magic);
+    EXPECT_EQ(2u, snapshot.header->regionCount);
+    EXPECT_EQ(8u, snapshot.header->blockCount);
+
+    int b = findSnapshotRegion(&snapshot, SNAPSHOT_FILE_TEST_B);
+    ASSERT_EQ(1, b);
+    EXPECT_EQ(-1, findSnapshotRegion(&snapshot, "NoSuchRegion"));
+    EXPECT_EQ(7u, snapshot.regions[b].version);
+    EXPECT_EQ(4u, snapshot.regions[b].firstBlock);
+    EXPECT_EQ(4096u, snapshot.blocks[7].rawSize);
+
+    // Compressible blocks are compressed, the random one is stored raw
+    EXPECT_TRUE((snapshot.blocks[1].flags & SNAPSHOT_BLOCK_COMPRESSED) != 0);
+    EXPECT_LT(snapshot.blocks[1].storedSize, snapshot.blocks[1].rawSize / 4);
+    EXPECT_EQ(0u, snapshot.blocks[5].flags);
+    EXPECT_EQ(snapshot.blocks[5].rawSize, snapshot.blocks[5].storedSize);
+    closeSnapshotFile(&snapshot);
+}
+
+TEST_F(SnapshotFileTest, ReadsAnyBlockOnItsOwn) {
+    SnapshotFile snapshot;
+    ASSERT_TRUE(openSnapshotFile(SNAPSHOT_FILE_TEST_PATH, &snapshot));
+    std::vector<char> block(snapshot.header->blockSize);
+
+    uint64_t order[] = { 6, 2, 5, 0, 3 };
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        size_t size = readSnapshotBlock(&snapshot, order[i], &block[0]);
+        const char* region = (order[i] < 4) ? regionA : regionB;
+        size_t offset = static_cast<size_t>(order[i] % 4) * SNAPSHOT_CHUNK_SIZE;
+        ASSERT_EQ((order[i] % 4 == 3) ? 4096u : static_cast<size_t>(SNAPSHOT_CHUNK_SIZE), size);
+        if (offset > 0) {
+            EXPECT_EQ(0, memcmp(region + offset, &block[0], size));
+        }
+    }
+
+    // The header block carries the cut version
+    ASSERT_EQ(static_cast<size_t>(SNAPSHOT_CHUNK_SIZE), readSnapshotBlock(&snapshot, 4, &block[0]));
+    EXPECT_EQ(7u, reinterpret_cast<MemoryLayout*>(&block[0])->version);
+    EXPECT_EQ(static_cast<size_t>(-1), readSnapshotBlock(&snapshot, 8, &block[0]));
+    closeSnapshotFile(&snapshot);
+}
+
+TEST_F(SnapshotFileTest, DetectsCorruptBlocksAndIndex) {
+    uint64_t blockOffset = 0;
+    {
+        SnapshotFile snapshot;
+        ASSERT_TRUE(openSnapshotFile(SNAPSHOT_FILE_TEST_PATH, &snapshot));
+        blockOffset = snapshot.blocks[5].offset;
+        closeSnapshotFile(&snapshot);
+    }
+
+    // A damaged block fails its own check and leaves the others readable
+    corruptByte(blockOffset + 100);
+    SnapshotFile snapshot;
+    ASSERT_TRUE(openSnapshotFile(SNAPSHOT_FILE_TEST_PATH, &snapshot));
+    std::vector<char> block(snapshot.header->blockSize);
+    EXPECT_EQ(static_cast<size_t>(-1), readSnapshotBlock(&snapshot, 5, &block[0]));
+    EXPECT_EQ(static_cast<size_t>(SNAPSHOT_CHUNK_SIZE), readSnapshotBlock(&snapshot, 6, &block[0]));
+    closeSnapshotFile(&snapshot);
+
+    // A damaged index means the file isn't opened at all
+    corruptByte(sizeof(SnapshotFileHeader) + 2 * sizeof(SnapshotFileRegion) + 8);
+    EXPECT_FALSE(openSnapshotFile(SNAPSHOT_FILE_TEST_PATH, &snapshot));
+}
+
+TEST_F(SnapshotFileTest, SeedsNewRegionFromFile) {
+    ASSERT_TRUE(initializeSharedMemory(SNAPSHOT_FILE_TEST_SEED, SNAPSHOT_FILE_TEST_SIZE));
+
+    // The file has no region of this name
+    EXPECT_FALSE(seedRegionFromSnapshot(SNAPSHOT_FILE_TEST_PATH, SNAPSHOT_FILE_TEST_SEED));
+
+    // Seed a fresh copy of B, then check everything past the header matches
+    cleanupSharedMemory(SNAPSHOT_FILE_TEST_B);
+    ASSERT_TRUE(initializeSharedMemory(SNAPSHOT_FILE_TEST_B, SNAPSHOT_FILE_TEST_SIZE));
+    char* seed = static_cast<char*>(getSharedMemory(SNAPSHOT_FILE_TEST_B));
+    ASSERT_TRUE(seedRegionFromSnapshot(SNAPSHOT_FILE_TEST_PATH, SNAPSHOT_FILE_TEST_B));
+    EXPECT_EQ(7u, reinterpret_cast<MemoryLayout*>(seed)->version);
+    EXPECT_EQ(0, memcmp(seed + sizeof(MemoryLayout), &cut.regions[1].copy[sizeof(MemoryLayout)],
+                        SNAPSHOT_FILE_TEST_SIZE - sizeof(MemoryLayout)));
+
+    // A copy at or past the snapshot's version is left alone
+    EXPECT_FALSE(seedRegionFromSnapshot(SNAPSHOT_FILE_TEST_PATH, SNAPSHOT_FILE_TEST_B));
+}
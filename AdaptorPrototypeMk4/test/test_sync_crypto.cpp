@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include "../src/sync_crypto.h"
+#include "../src/region_checksum.h"
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define PEER_IP "127.0.0.1"
+#define PEER_PORT 9500
+
+class SyncCryptoTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(parseSyncKey("000102030405060708090a0b0c0d0e0f", key));
+        ASSERT_TRUE(addPeerKey(PEER_IP, PEER_PORT, &key[0], key.size()));
+        setSecureSenderId(7);
+
+        memset(&message, 0, sizeof(message));
+        message.msgType = MSG_SINGLE_UPDATE;
+        strcpy(message.memoryName, "TestCryptoRegion");
+        message.version = 42;
+        message.offset = 128;
+        message.size = 100;
+        for (size_t i = 0; i < message.size; i++) {
+            message.data[i] = static_cast<char>(i * 3);
+        }
+        stampSyncMessage(message);
+    }
+
+    void TearDown() override {
+        clearPeerKeys();
+    }
+
+    size_t seal(char* datagram) {
+        return sealSyncMessage(message, PEER_IP, PEER_PORT, datagram);
+    }
+
+    std::vector<unsigned char> key;
+    SyncMessage message;
+};
+
+TEST_F(SyncCryptoTest, RoundTrip) {
+    EXPECT_TRUE(syncEncryptionEnabled());
+    char datagram[MAX_SECURE_DATAGRAM_SIZE];
+    size_t size = seal(datagram);
+    ASSERT_EQ(sizeof(SecureDatagramHeader) + offsetof(SyncMessage, data) + 100 + AES_GCM_TAG_SIZE, size);
+
+    // The data does not appear in the clear
+    EXPECT_EQ(std::string::npos, std::string(datagram, size).find(std::string(message.data + 10, 32)));
+
+    SyncMessage opened;
+    size_t messageBytes = 0;
+    ASSERT_TRUE(openSyncMessage(datagram, size, PEER_IP, PEER_PORT, opened, &messageBytes));
+    EXPECT_EQ(offsetof(SyncMessage, data) + 100, messageBytes);
+    EXPECT_TRUE(verifySyncMessage(opened, messageBytes));
+    EXPECT_EQ(0, memcmp(&message, &opened, messageBytes));
+}
+
+TEST_F(SyncCryptoTest, RejectsWrongPeerAndTampering) {
+    char datagram[MAX_SECURE_DATAGRAM_SIZE];
+    size_t size = seal(datagram);
+    SyncMessage opened;
+    size_t messageBytes = 0;
+
+    // No key for the port it claims to come from
+    EXPECT_FALSE(openSyncMessage(datagram, size, PEER_IP, PEER_PORT + 1, opened, &messageBytes));
+    EXPECT_EQ(0u, sealSyncMessage(message, PEER_IP, PEER_PORT + 1, datagram + size));
+
+    // A different key for the same peer
+    std::vector<unsigned char> otherKey;
+    ASSERT_TRUE(parseSyncKey("ffeeddccbbaa99887766554433221100ffeeddccbbaa99887766554433221100", otherKey));
+    ASSERT_TRUE(addPeerKey(PEER_IP, PEER_PORT + 1, &otherKey[0], otherKey.size()));
+    EXPECT_FALSE(openSyncMessage(datagram, size, PEER_IP, PEER_PORT + 1, opened, &messageBytes));
+
+    // Changed header, ciphertext or length
+    datagram[4] ^= 1;
+    EXPECT_FALSE(openSyncMessage(datagram, size, PEER_IP, PEER_PORT, opened, &messageBytes));
+    datagram[4] ^= 1;
+    datagram[sizeof(SecureDatagramHeader) + 20] ^= 1;
+    EXPECT_FALSE(openSyncMessage(datagram, size, PEER_IP, PEER_PORT, opened, &messageBytes));
+    datagram[sizeof(SecureDatagramHeader) + 20] ^= 1;
+    EXPECT_FALSE(openSyncMessage(datagram, size - 1, PEER_IP, PEER_PORT, opened, &messageBytes));
+    EXPECT_FALSE(openSyncMessage(datagram, 10, PEER_IP, PEER_PORT, opened, &messageBytes));
+
+    // Still opens once restored
+    EXPECT_TRUE(openSyncMessage(datagram, size, PEER_IP, PEER_PORT, opened, &messageBytes));
+}
+
+TEST_F(SyncCryptoTest, RejectsReplays) {
+    char first[MAX_SECURE_DATAGRAM_SIZE];
+    char second[MAX_SECURE_DATAGRAM_SIZE];
+    size_t firstSize = seal(first);
+    size_t secondSize = seal(second);
+    SyncMessage opened;
+    size_t messageBytes = 0;
+
+    // Out of order within the window is fine, but each datagram opens once
+    EXPECT_TRUE(openSyncMessage(second, secondSize, PEER_IP, PEER_PORT, opened, &messageBytes));
+    EXPECT_TRUE(openSyncMessage(first, firstSize, PEER_IP, PEER_PORT, opened, &messageBytes));
+    EXPECT_FALSE(openSyncMessage(first, firstSize, PEER_IP, PEER_PORT, opened, &messageBytes));
+    EXPECT_FALSE(openSyncMessage(second, secondSize, PEER_IP, PEER_PORT, opened, &messageBytes));
+
+    SyncCryptoStats stats;
+    getSyncCryptoStats(&stats);
+    EXPECT_GE(stats.replays, 2u);
+}
+
+TEST_F(SyncCryptoTest, RejectsDatagramsOlderThanTheWindow) {
+    char old[MAX_SECURE_DATAGRAM_SIZE];
+    size_t oldSize = seal(old);
+    char datagram[MAX_SECURE_DATAGRAM_SIZE];
+    size_t size = 0;
+    for (int i = 0; i < SYNC_REPLAY_WINDOW; i++) {
+        size = seal(datagram);
+    }
+    SyncMessage opened;
+    size_t messageBytes = 0;
+    EXPECT_TRUE(openSyncMessage(datagram, size, PEER_IP, PEER_PORT, opened, &messageBytes));
+    EXPECT_FALSE(openSyncMessage(old, oldSize, PEER_IP, PEER_PORT, opened, &messageBytes));
+}
+
+TEST_F(SyncCryptoTest, ParsesKeys) {
+    std::vector<unsigned char> parsed;
+    EXPECT_TRUE(parseSyncKey("00112233445566778899AABBCCDDEEFF", parsed));
+    ASSERT_EQ(16u, parsed.size());
+    EXPECT_EQ(0x00, parsed[0]);
+    EXPECT_EQ(0xFF, parsed[15]);
+    EXPECT_FALSE(parseSyncKey("0011", parsed));
+    EXPECT_FALSE(parseSyncKey("00112233445566778899aabbccddeefg", parsed));
+    EXPECT_FALSE(parseSyncKey("00112233445566778899aabbccddeeff00112233445566778899aabbccddee", parsed));
+
+    clearPeerKeys();
+    EXPECT_FALSE(syncEncryptionEnabled());
+}
+
+TEST_F(SyncCryptoTest, DataIsSealedWithTheBootSessionKey) {
+    char datagram[MAX_SECURE_DATAGRAM_SIZE];
+    size_t size = seal(datagram);
+    SecureDatagramHeader header;
+    memcpy(&header, datagram, sizeof(header));
+    EXPECT_NE(0u, header.bootSalt);
+
+    // The configured key alone doesn't reproduce the ciphertext
+    AesGcmKey raw;
+    ASSERT_TRUE(aesGcmInitKey(&raw, &key[0], key.size()));
+    std::vector<unsigned char> ciphertext(offsetof(SyncMessage, data) + 100);
+    unsigned char tag[AES_GCM_TAG_SIZE];
+    aesGcmSeal(&raw, reinterpret_cast<const unsigned char*>(&header.senderId), &header, sizeof(header),
+               &message, ciphertext.size(), &ciphertext[0], tag);
+    EXPECT_NE(0, memcmp(&ciphertext[0], datagram + sizeof(header), ciphertext.size()));
+
+    // Another salt selects another session key
+    SyncMessage opened;
+    size_t messageBytes = 0;
+    header.bootSalt ^= 1;
+    memcpy(datagram, &header, sizeof(header));
+    EXPECT_FALSE(openSyncMessage(datagram, size, PEER_IP, PEER_PORT, opened, &messageBytes));
+    header.bootSalt ^= 1;
+    memcpy(datagram, &header, sizeof(header));
+    EXPECT_TRUE(openSyncMessage(datagram, size, PEER_IP, PEER_PORT, opened, &messageBytes));
+}
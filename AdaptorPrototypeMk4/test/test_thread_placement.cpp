@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include "../src/thread_placement.h"
+#include "../src/shared_memory.h"
+#include "../src/memory_layout.h"
+#include <process.h>
+#include <string.h>
+
+#define PLACEMENT_TEST_REGION "TestPlacementRegion"
+#define PLACEMENT_TEST_SIZE (64 * 1024)
+
+/**
+ * @brief Work for a thread that places itself, so the test runner's affinity is left alone
+ */
+struct PlacementJob {
+    ThreadRole role;
+    const char* memoryName;
+    int node;
+};
+
+static unsigned int __stdcall placementThreadFunc(void* arg) {
+    PlacementJob* job = static_cast<PlacementJob*>(arg);
+    job->node = placeCurrentThread(job->role, job->memoryName);
+    return 0;
+}
+
+class ThreadPlacementTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(initializeSharedMemory(PLACEMENT_TEST_REGION, PLACEMENT_TEST_SIZE));
+        // Touch every page past the header so the region is resident
+        char* memory = static_cast<char*>(getSharedMemory(PLACEMENT_TEST_REGION));
+        memset(memory + sizeof(MemoryLayout), 0x5A, PLACEMENT_TEST_SIZE - sizeof(MemoryLayout));
+    }
+
+    void TearDown() override {
+        configureThreadPlacement(false, -1, NULL);
+        cleanupSharedMemory(PLACEMENT_TEST_REGION);
+    }
+
+    int placeOnNewThread(ThreadRole role, const char* memoryName) {
+        PlacementJob job;
+        job.role = role;
+        job.memoryName = memoryName;
+        job.node = -2;
+        unsigned int threadId;
+        HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, placementThreadFunc, &job, 0, &threadId);
+        EXPECT_TRUE(thread != NULL);
+        if (thread != NULL) {
+            WaitForSingleObject(thread, INFINITE);
+            CloseHandle(thread);
+        }
+        return job.node;
+    }
+};
+
+TEST_F(ThreadPlacementTest, ReadsTopology) {
+    NumaTopology topology;
+    ASSERT_TRUE(readNumaTopology(&topology));
+    EXPECT_GE(topology.nodeCount, 1);
+    EXPECT_GE(topology.processorCount, 1);
+
+    int total = 0;
+    for (int node = 0; node < topology.nodeCount; node++) {
+        total += topology.nodeProcessors[node];
+    }
+    EXPECT_EQ(total, topology.processorCount);
+}
+
+TEST_F(ThreadPlacementTest, FindsNodeOfRegion) {
+    NumaTopology topology;
+    ASSERT_TRUE(readNumaTopology(&topology));
+
+    int node = getRegionNumaNode(PLACEMENT_TEST_REGION);
+    EXPECT_GE(node, 0);
+    EXPECT_LT(node, topology.nodeCount);
+
+    EXPECT_EQ(getRegionNumaNode("NoSuchPlacementRegion"), -1);
+}
+
+TEST_F(ThreadPlacementTest, UntouchedMemoryHasNoNode) {
+    const size_t size = 16 * 4096;
+    char* memory = static_cast<char*>(VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    ASSERT_TRUE(memory != NULL);
+
+    EXPECT_EQ(getMemoryNumaNode(memory, size), -1);
+
+    memset(memory, 1, size);
+    EXPECT_GE(getMemoryNumaNode(memory, size), 0);
+
+    VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+TEST_F(ThreadPlacementTest, DisabledPlacementLeavesThreadsAlone) {
+    configureThreadPlacement(false, -1, "127.0.0.1");
+    EXPECT_FALSE(isThreadPlacementEnabled());
+    EXPECT_EQ(placeOnNewThread(THREAD_ROLE_SYNC, PLACEMENT_TEST_REGION), -1);
+}
+
+TEST_F(ThreadPlacementTest, PlacesRegionThreadsOnRegionNode) {
+    configureThreadPlacement(true, -1, "127.0.0.1");
+    EXPECT_TRUE(isThreadPlacementEnabled());
+
+    int regionNode = getRegionNumaNode(PLACEMENT_TEST_REGION);
+    EXPECT_EQ(placeOnNewThread(THREAD_ROLE_SYNC, PLACEMENT_TEST_REGION), regionNode);
+    EXPECT_EQ(placeOnNewThread(THREAD_ROLE_NOTIFIER, PLACEMENT_TEST_REGION), regionNode);
+}
+
+TEST_F(ThreadPlacementTest, ReceiveThreadFollowsApplyRegions) {
+    configureThreadPlacement(true, -1, "127.0.0.1");
+    addApplyRegion(PLACEMENT_TEST_REGION);
+    EXPECT_EQ(placeOnNewThread(THREAD_ROLE_RECEIVE, NULL), getRegionNumaNode(PLACEMENT_TEST_REGION));
+}
+
+TEST_F(ThreadPlacementTest, ConfiguredNetworkNodeWins) {
+    configureThreadPlacement(true, 0, "127.0.0.1");
+    EXPECT_EQ(placeOnNewThread(THREAD_ROLE_RECEIVE, NULL), 0);
+}
+
+TEST_F(ThreadPlacementTest, AddingRegionRequestsReplacement) {
+    long generation = -1;
+    EXPECT_TRUE(threadPlacementChanged(&generation));
+    EXPECT_FALSE(threadPlacementChanged(&generation));
+
+    addApplyRegion(PLACEMENT_TEST_REGION);
+    EXPECT_TRUE(threadPlacementChanged(&generation));
+    EXPECT_FALSE(threadPlacementChanged(&generation));
+}
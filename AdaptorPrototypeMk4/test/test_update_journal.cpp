@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include "../src/update_journal.h"
+#include "../src/change_tracking.h"
+#include "../src/shared_memory.h"
+#include "../src/memory_layout.h"
+#include <string.h>
+#include <stdio.h>
+#include <vector>
+
+#define JOURNAL_TEST_DIR "test_journal"
+#define JOURNAL_TEST_REGION "JournalTestRegion"
+#define JOURNAL_TEST_SIZE (16 * CHECKPOINT_BLOCK_SIZE)
+
+class UpdateJournalTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        removeFiles();
+        ASSERT_TRUE(setJournalDirectory(JOURNAL_TEST_DIR, 1024 * 1024));
+        setCheckpointInterval(0);
+        ASSERT_TRUE(initializeSharedMemory(JOURNAL_TEST_REGION, JOURNAL_TEST_SIZE));
+    }
+
+    void TearDown() override {
+        shutdownUpdateJournals();
+        cleanupSharedMemory(JOURNAL_TEST_REGION);
+        removeFiles();
+    }
+
+    // Read an int from the region image in the checkpoint file
+    int checkpointValueAt(size_t offset) {
+        int value = 0;
+        FILE* file = fopen(JOURNAL_TEST_DIR "/" JOURNAL_TEST_REGION ".checkpoint", "rb");
+        if (file) {
+            fseek(file, static_cast<long>(CHECKPOINT_IMAGE_OFFSET + offset), SEEK_SET);
+            if (fread(&value, sizeof(value), 1, file) != 1) {
+                value = -1;
+            }
+            fclose(file);
+        }
+        return value;
+    }
+
+    void removeFiles() {
+        remove(JOURNAL_TEST_DIR "/" JOURNAL_TEST_REGION ".journal");
+        remove(JOURNAL_TEST_DIR "/" JOURNAL_TEST_REGION ".journal.tmp");
+        remove(JOURNAL_TEST_DIR "/" JOURNAL_TEST_REGION ".checkpoint");
+    }
+
+    // Apply a remote update as the receive thread would
+    void apply(uint64_t version, size_t offset, int value, uint32_t flags = 0) {
+        SyncMessage message;
+        memset(&message, 0, sizeof(message));
+        message.msgType = MSG_SINGLE_UPDATE;
+        strncpy(message.memoryName, JOURNAL_TEST_REGION, sizeof(message.memoryName) - 1);
+        message.version = version;
+        message.flags = flags;
+        message.offset = offset;
+        message.size = sizeof(value);
+        memcpy(message.data, &value, sizeof(value));
+        applyUpdate(message);
+    }
+
+    // Simulate a restart: the region comes back zeroed and the journal is reopened
+    uint64_t restart(bool* recovered) {
+        shutdownUpdateJournals();
+        cleanupSharedMemory(JOURNAL_TEST_REGION);
+        EXPECT_TRUE(setJournalDirectory(JOURNAL_TEST_DIR, 1024 * 1024));
+        setCheckpointInterval(0);
+        EXPECT_TRUE(initializeSharedMemory(JOURNAL_TEST_REGION, JOURNAL_TEST_SIZE));
+        return recoverRegionFromJournal(JOURNAL_TEST_REGION, recovered);
+    }
+
+    int valueAt(size_t offset) {
+        int value;
+        memcpy(&value, static_cast<char*>(getSharedMemory(JOURNAL_TEST_REGION)) + offset, sizeof(value));
+        return value;
+    }
+
+    MemoryLayout* layout() {
+        return static_cast<MemoryLayout*>(getSharedMemory(JOURNAL_TEST_REGION));
+    }
+};
+
+TEST_F(UpdateJournalTest, ReplaysJournalAfterRestart) {
+    ASSERT_TRUE(openUpdateJournal(JOURNAL_TEST_REGION, JOURNAL_REPLICA));
+    apply(2, 100, 11);
+    apply(3, 200, 22);
+    EXPECT_EQ(layout()->version, 3u);
+
+    bool recovered = false;
+    EXPECT_EQ(restart(&recovered), 3u);
+    EXPECT_TRUE(recovered);
+    EXPECT_EQ(layout()->version, 3u);
+    EXPECT_EQ(valueAt(100), 11);
+    EXPECT_EQ(valueAt(200), 22);
+}
+
+TEST_F(UpdateJournalTest, NothingToRecoverWithoutJournal) {
+    bool recovered = true;
+    EXPECT_EQ(recoverRegionFromJournal(JOURNAL_TEST_REGION, &recovered), 0u);
+    EXPECT_FALSE(recovered);
+    EXPECT_EQ(layout()->version, 0u);
+}
+
+TEST_F(UpdateJournalTest, CheckpointCompactsJournal) {
+    ASSERT_TRUE(openUpdateJournal(JOURNAL_TEST_REGION, JOURNAL_SOURCE));
+    apply(2, 100, 11);
+    apply(3, 200, 22);
+    ASSERT_TRUE(checkpointRegion(JOURNAL_TEST_REGION));
+    apply(4, 300, 33);
+
+    // Only the update after the checkpoint is left, and older versions aren't covered
+    std::vector<JournalUpdate> updates;
+    EXPECT_TRUE(collectJournalUpdates(JOURNAL_TEST_REGION, 3, updates));
+    ASSERT_EQ(updates.size(), 1u);
+    EXPECT_EQ(updates[0].message.version, 4u);
+    EXPECT_EQ(updates[0].message.offset, 300u);
+    EXPECT_TRUE(updates[0].lastChunk);
+    EXPECT_STREQ(updates[0].message.memoryName, JOURNAL_TEST_REGION);
+    updates.clear();
+    EXPECT_FALSE(collectJournalUpdates(JOURNAL_TEST_REGION, 1, updates));
+
+    bool recovered = false;
+    EXPECT_EQ(restart(&recovered), 4u);
+    EXPECT_TRUE(recovered);
+    EXPECT_EQ(valueAt(100), 11);
+    EXPECT_EQ(valueAt(200), 22);
+    EXPECT_EQ(valueAt(300), 33);
+}
+
+TEST_F(UpdateJournalTest, IncompleteVersionIsNotClaimed) {
+    ASSERT_TRUE(openUpdateJournal(JOURNAL_TEST_REGION, JOURNAL_REPLICA));
+    apply(2, 100, 11);
+    apply(3, 200, 22, SYNC_FLAG_MORE_IN_VERSION);
+    EXPECT_EQ(layout()->version, 2u);
+
+    // The part of version 3 is replayed but the region stays at version 2
+    EXPECT_EQ(restart(NULL), 2u);
+    EXPECT_EQ(layout()->version, 2u);
+    EXPECT_EQ(valueAt(200), 22);
+
+    // The rest of version 3 completes it
+    ASSERT_TRUE(openUpdateJournal(JOURNAL_TEST_REGION, JOURNAL_REPLICA));
+    apply(3, 300, 33);
+    EXPECT_EQ(layout()->version, 3u);
+}
+
+TEST_F(UpdateJournalTest, IncrementalCheckpointWritesOnlyDirtyBlocks) {
+    ASSERT_TRUE(openUpdateJournal(JOURNAL_TEST_REGION, JOURNAL_REPLICA));
+    apply(2, 100, 11);
+    ASSERT_TRUE(checkpointRegion(JOURNAL_TEST_REGION));
+    EXPECT_EQ(checkpointValueAt(100), 11);
+
+    // An untracked write to block 5 is not picked up; a journaled one to block 2 is
+    size_t untracked = 5 * CHECKPOINT_BLOCK_SIZE + 8;
+    size_t tracked = 2 * CHECKPOINT_BLOCK_SIZE + 8;
+    int stray = 99;
+    memcpy(static_cast<char*>(getSharedMemory(JOURNAL_TEST_REGION)) + untracked, &stray, sizeof(stray));
+    apply(3, tracked, 33);
+    ASSERT_TRUE(checkpointRegion(JOURNAL_TEST_REGION));
+    EXPECT_EQ(checkpointValueAt(tracked), 33);
+    EXPECT_EQ(checkpointValueAt(untracked), 0);
+
+    // The journal is empty after the checkpoint and the image alone restores the region
+    std::vector<JournalUpdate> updates;
+    EXPECT_TRUE(collectJournalUpdates(JOURNAL_TEST_REGION, 3, updates));
+    EXPECT_TRUE(updates.empty());
+
+    bool recovered = false;
+    EXPECT_EQ(restart(&recovered), 3u);
+    EXPECT_TRUE(recovered);
+    EXPECT_EQ(valueAt(100), 11);
+    EXPECT_EQ(valueAt(tracked), 33);
+
+    // After recovery the next checkpoint stays incremental
+    ASSERT_TRUE(openUpdateJournal(JOURNAL_TEST_REGION, JOURNAL_REPLICA));
+    memcpy(static_cast<char*>(getSharedMemory(JOURNAL_TEST_REGION)) + untracked, &stray, sizeof(stray));
+    apply(4, 300, 44);
+    ASSERT_TRUE(checkpointRegion(JOURNAL_TEST_REGION));
+    EXPECT_EQ(checkpointValueAt(300), 44);
+    EXPECT_EQ(checkpointValueAt(untracked), 0);
+}
+
+TEST_F(UpdateJournalTest, FullJournalSpillsUntilTheCheckpoint) {
+    // Room for a couple of hundred records, so most of the updates below spill
+    ASSERT_TRUE(setJournalDirectory(JOURNAL_TEST_DIR, 8 * 1024));
+    ASSERT_TRUE(openUpdateJournal(JOURNAL_TEST_REGION, JOURNAL_REPLICA));
+    const int updates = 1000;
+    const size_t first = CHECKPOINT_BLOCK_SIZE;
+    for (int i = 0; i < updates; i++) {
+        apply(2 + i, first + i * sizeof(int), i);
+    }
+
+    // The checkpoint compacts the journal into a new file and moves the spill into it
+    ASSERT_TRUE(checkpointRegion(JOURNAL_TEST_REGION));
+    apply(2 + updates, 100, 11);
+    FILE* compacted = fopen(JOURNAL_TEST_DIR "/" JOURNAL_TEST_REGION ".journal.tmp", "rb");
+    EXPECT_TRUE(compacted == NULL);
+    if (compacted) {
+        fclose(compacted);
+    }
+
+    bool recovered = false;
+    EXPECT_EQ(restart(&recovered), static_cast<uint64_t>(2 + updates));
+    EXPECT_TRUE(recovered);
+    EXPECT_EQ(valueAt(100), 11);
+    for (int i = 0; i < updates; i++) {
+        ASSERT_EQ(valueAt(first + i * sizeof(int)), i);
+    }
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include "../src/version_history.h"
+#include "../src/shared_memory.h"
+#include "../src/change_tracking.h"
+#include "../src/memory_layout.h"
+#include <string.h>
+
+#define HISTORY_TEST_REGION "TestHistoryRegion"
+#define HISTORY_TEST_SIZE 4096
+#define VALUE_OFFSET 1024
+
+class VersionHistoryTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        initChangeTracking();
+        ASSERT_TRUE(initializeSharedMemory(HISTORY_TEST_REGION, HISTORY_TEST_SIZE));
+        layout = static_cast<MemoryLayout*>(getSharedMemory(HISTORY_TEST_REGION));
+        layout->version = 1;
+        writeInt(VALUE_OFFSET, 100);
+    }
+
+    void TearDown() override {
+        cleanupSharedMemory(HISTORY_TEST_REGION);
+        cleanupChangeTracking();
+    }
+
+    void writeInt(size_t offset, int value) {
+        memcpy(reinterpret_cast<char*>(layout) + offset, &value, sizeof(value));
+    }
+
+    // Apply a replicated write at a version, as the receive thread would
+    void applyInt(uint64_t version, size_t offset, int value, uint32_t flags = 0) {
+        SyncMessage message;
+        memset(&message, 0, sizeof(message));
+        strcpy(message.memoryName, HISTORY_TEST_REGION);
+        message.msgType = MSG_SINGLE_UPDATE;
+        message.version = version;
+        message.flags = flags;
+        message.offset = offset;
+        message.size = sizeof(value);
+        memcpy(message.data, &value, sizeof(value));
+        applyUpdate(message);
+    }
+
+    int intAt(int handle, uint64_t version, size_t offset) {
+        int value = -1;
+        EXPECT_TRUE(readAtVersion(handle, version, offset, sizeof(value), &value));
+        return value;
+    }
+
+    MemoryLayout* layout;
+};
+
+TEST_F(VersionHistoryTest, ReadsOlderVersions) {
+    int handle = startVersionHistory(HISTORY_TEST_REGION, 64 * 1024);
+    ASSERT_GE(handle, 0);
+
+    applyInt(2, VALUE_OFFSET, 200);
+    applyInt(3, VALUE_OFFSET, 300);
+    applyInt(4, VALUE_OFFSET + 8, 48);
+    EXPECT_EQ(4u, layout->version);
+
+    EXPECT_EQ(100, intAt(handle, 1, VALUE_OFFSET));
+    EXPECT_EQ(200, intAt(handle, 2, VALUE_OFFSET));
+    EXPECT_EQ(300, intAt(handle, 3, VALUE_OFFSET));
+    EXPECT_EQ(300, intAt(handle, 4, VALUE_OFFSET));
+    EXPECT_EQ(0, intAt(handle, 3, VALUE_OFFSET + 8));
+    EXPECT_EQ(48, intAt(handle, 4, VALUE_OFFSET + 8));
+
+    EXPECT_TRUE(stopVersionHistory(handle));
+    EXPECT_FALSE(stopVersionHistory(handle));
+}
+
+TEST_F(VersionHistoryTest, OverlappingUpdatesTakeTheOldestBytes) {
+    int handle = startVersionHistory(HISTORY_TEST_REGION, 64 * 1024);
+    ASSERT_GE(handle, 0);
+
+    // Version 2 changes the low half of the value, version 3 all of it
+    SyncMessage message;
+    memset(&message, 0, sizeof(message));
+    strcpy(message.memoryName, HISTORY_TEST_REGION);
+    message.msgType = MSG_SINGLE_UPDATE;
+    message.version = 2;
+    message.offset = VALUE_OFFSET;
+    message.size = 2;
+    message.data[0] = 0x11;
+    message.data[1] = 0x22;
+    applyUpdate(message);
+    applyInt(3, VALUE_OFFSET - 2, 0x33333333);
+
+    char bytes[8];
+    ASSERT_TRUE(readAtVersion(handle, 1, VALUE_OFFSET - 2, sizeof(bytes), bytes));
+    int value;
+    memcpy(&value, bytes + 2, sizeof(value));
+    EXPECT_EQ(100, value);
+
+    ASSERT_TRUE(readAtVersion(handle, 2, VALUE_OFFSET - 2, sizeof(bytes), bytes));
+    EXPECT_EQ(0x11, bytes[2]);
+    EXPECT_EQ(0x22, bytes[3]);
+    EXPECT_EQ(0, bytes[4]);
+
+    stopVersionHistory(handle);
+}
+
+TEST_F(VersionHistoryTest, UnfinishedVersionIsNotVisible) {
+    int handle = startVersionHistory(HISTORY_TEST_REGION, 64 * 1024);
+    ASSERT_GE(handle, 0);
+
+    // First part of version 2 has arrived, the rest hasn't
+    applyInt(2, VALUE_OFFSET, 200, SYNC_FLAG_MORE_IN_VERSION);
+    EXPECT_EQ(1u, layout->version);
+    EXPECT_EQ(100, intAt(handle, 1, VALUE_OFFSET));
+    EXPECT_EQ(200, intAt(handle, 2, VALUE_OFFSET));
+
+    stopVersionHistory(handle);
+}
+
+TEST_F(VersionHistoryTest, RingDropsOldestVersions) {
+    // Room for eight 4-byte records
+    int handle = startVersionHistory(HISTORY_TEST_REGION, 8 * 32);
+    ASSERT_GE(handle, 0);
+    EXPECT_EQ(1u, oldestReadableVersion(handle));
+
+    for (int version = 2; version <= 21; version++) {
+        applyInt(version, VALUE_OFFSET, version * 100);
+    }
+    EXPECT_EQ(21u, layout->version);
+
+    uint64_t oldest = oldestReadableVersion(handle);
+    EXPECT_GT(oldest, 1u);
+    EXPECT_GE(oldest, 21u - 8);
+
+    int value;
+    EXPECT_FALSE(readAtVersion(handle, oldest - 1, VALUE_OFFSET, sizeof(value), &value));
+    for (uint64_t version = oldest; version <= 21; version++) {
+        EXPECT_EQ(static_cast<int>(version) * 100, intAt(handle, version, VALUE_OFFSET));
+    }
+
+    stopVersionHistory(handle);
+}
+
+TEST_F(VersionHistoryTest, RejectsRangesOutsideTheRegion) {
+    int handle = startVersionHistory(HISTORY_TEST_REGION, 1024);
+    ASSERT_GE(handle, 0);
+
+    char buffer[16];
+    EXPECT_FALSE(readAtVersion(handle, 1, HISTORY_TEST_SIZE - 8, sizeof(buffer), buffer));
+    EXPECT_FALSE(readAtVersion(handle + 1, 1, 0, sizeof(buffer), buffer));
+
+    stopVersionHistory(handle);
+}